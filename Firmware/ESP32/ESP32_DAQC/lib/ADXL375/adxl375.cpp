@@ -8,7 +8,7 @@ void ADXL375_init() {
   Wire.begin();
   ADXL375_write(ADXL_POWER_CTL, 0x08); // Set to measure mode
   ADXL375_write(ADXL_DATA_FORMAT, 0x0B); // Set to full resolution
-  ADXL375_write(ADXL_BW_RATE, 0x0A); // Set to 100Hz
+  ADXL375_write(ADXL_BW_RATE, ADXL_RATE_100HZ); // Set to 100Hz
 }
 
 /**
@@ -40,8 +40,10 @@ void ADXL375_read(uint8_t reg, uint8_t *value, uint8_t number_of_bytes) {
   Wire.beginTransmission(ADXL_ADDR);
   Wire.write(reg); // Write register address
   Wire.endTransmission(true);
-  Wire.requestFrom(ADXL_ADDR, number_of_bytes); // Request 1 byte
-  *value = Wire.read(); // Read value
+  Wire.requestFrom(ADXL_ADDR, number_of_bytes); // Request number_of_bytes bytes
+  for (uint8_t i = 0; i < number_of_bytes; i++) {
+    value[i] = Wire.read(); // Read value
+  }
 }
 
 
@@ -64,4 +66,48 @@ void ADXL375_read_acceleration(int16_t *x, int16_t *y, int16_t *z) {
   *x = (int16_t)(data[1] << 8 | data[0]);
   *y = (int16_t)(data[3] << 8 | data[2]);
   *z = (int16_t)(data[5] << 8 | data[4]);
-}
\ No newline at end of file
+}
+
+
+/**
+ * @brief Arm the ADXL375 activity detector on the INT1 pin.
+ *
+ * The datasheet recommends configuring the interrupt function before enabling
+ * it, so INT_ENABLE is cleared first and written last. INT_SOURCE is read at the
+ * end to drop any activity event latched while the registers were changing.
+ *
+ * @param[in] threshold_mg Activity threshold in mg (780 mg/LSB, rounded up).
+ */
+void ADXL375_enable_activity_int(uint16_t threshold_mg) {
+  uint16_t counts = (threshold_mg + ADXL_THRESH_ACT_MG - 1) / ADXL_THRESH_ACT_MG;
+  if (counts == 0) counts = 1;
+  if (counts > 0xFF) counts = 0xFF;
+
+  ADXL375_write(ADXL_INT_ENABLE, 0x00);                            // Disable interrupts while configuring
+  ADXL375_write(ADXL_BW_RATE, ADXL_BW_LOW_POWER | ADXL_RATE_100HZ); // Low power 100Hz while on the pad
+  ADXL375_write(ADXL_THRESH_ACT, (uint8_t)counts);
+  ADXL375_write(ADXL_ACT_INACT_CTL, ADXL_ACT_AC_XYZ);              // ac-coupled so gravity is ignored
+  ADXL375_write(ADXL_INT_MAP, 0x00);                               // All interrupts routed to INT1
+  ADXL375_write(ADXL_INT_ENABLE, ADXL_INT_ACTIVITY);
+  ADXL375_read_int_source();
+}
+
+/**
+ * @brief Disarm the activity detector and return to full power measurement.
+ */
+void ADXL375_disable_activity_int() {
+  ADXL375_write(ADXL_INT_ENABLE, 0x00);
+  ADXL375_write(ADXL_ACT_INACT_CTL, 0x00);
+  ADXL375_write(ADXL_BW_RATE, ADXL_RATE_100HZ); // Same rate as ADXL375_init(), full power
+  ADXL375_read_int_source();
+}
+
+/**
+ * @brief Read INT_SOURCE, which also clears any latched interrupt.
+ * @return Contents of the INT_SOURCE register.
+ */
+uint8_t ADXL375_read_int_source() {
+  uint8_t source = 0;
+  ADXL375_read(ADXL_INT_SOURCE, &source, 1);
+  return source;
+}
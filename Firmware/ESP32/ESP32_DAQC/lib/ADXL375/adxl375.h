@@ -42,6 +42,13 @@
 #define ADXL_FIFO_CTL 0x38        // FIFO control
 #define ADXL_FIFO_STATUS 0x39     // FIFO status
 
+// Register bit fields used for activity (launch) detection
+#define ADXL_INT_ACTIVITY 0x10        // ACTIVITY bit in INT_ENABLE / INT_MAP / INT_SOURCE
+#define ADXL_ACT_AC_XYZ 0xF0          // ACT_INACT_CTL : ac-coupled activity on X, Y and Z
+#define ADXL_BW_LOW_POWER 0x10        // BW_RATE : reduced power operation
+#define ADXL_RATE_100HZ 0x0A          // BW_RATE : 100Hz output data rate
+#define ADXL_THRESH_ACT_MG 780        // THRESH_ACT scale factor, 780 mg/LSB
+
 
 /**
  * @brief Initialize the ADXL375 accelerometer
@@ -80,4 +87,27 @@ void ADXL375_read(uint8_t reg, uint8_t *value, uint8_t bytes);
  */
 void ADXL375_read_acceleration(int16_t *x, int16_t *y, int16_t *z); 
 
+/**
+ * @brief Arm the ADXL375 activity detector on the INT1 pin.
+ *
+ * Activity detection is ac-coupled on all three axes, so the 1g seen on the pad
+ * is taken as the reference when the detector is armed and only a change larger
+ * than the threshold (e.g. motor ignition) raises INT1. The sensor is put into
+ * reduced power mode at 100Hz while waiting.
+ *
+ * @param[in] threshold_mg Activity threshold in mg (780 mg/LSB, rounded up).
+ */
+void ADXL375_enable_activity_int(uint16_t threshold_mg);
+
+/**
+ * @brief Disarm the activity detector and return to full power measurement.
+ */
+void ADXL375_disable_activity_int();
+
+/**
+ * @brief Read INT_SOURCE, which also clears any latched interrupt.
+ * @return Contents of the INT_SOURCE register.
+ */
+uint8_t ADXL375_read_int_source();
+
 #endif
\ No newline at end of file
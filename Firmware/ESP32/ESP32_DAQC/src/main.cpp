@@ -1,40 +1,140 @@
 /**
  * @file main.cpp
  * @brief Main firmware for ESP32 DAQC computer.
- * 
+ *
  * This file contains the main firmware for the ESP32 DAQC computer.
  * Firmware has the following functionalities:
  * - Initialize all sensors.
  * - Read data from sensors.
- * - Store data either on built-in flash memory or SD card. 
+ * - Store data either on built-in flash memory or SD card.
  *    - SD card data storage is prioritized over built-in flash memory.
+ *
+ * Pad idle mode :
+ * - While waiting on the pad the ADXL375 activity detector watches for the
+ *   launch acceleration and the ESP32 stays in light sleep.
+ * - ADXL375 INT1 wakes the ESP32 (ext0 wakeup) and the acquisition loop starts
+ *   immediately, so ignition is never missed.
+ * - If the acceleration does not reach the confirm threshold above 1 g (a bump
+ *   while handling the rocket), the firmware goes back to pad idle.
+ * - Wake latency bound : activity detector needs one 100Hz sample (<= 10ms),
+ *   plus light sleep exit (not measured, the CPU is stopped until it is out
+ *   of sleep), plus the time to the first sample. Only the last part, from
+ *   esp_light_sleep_start() returning to the first accelerometer sample, is
+ *   measured on every wake and its worst case printed.
  */
 
 #include <Arduino.h>
+#include "esp_sleep.h"
+#include "esp_timer.h"
 #include "adxl375.h"
 #include "bmp390.h"
 
 
+// Pad idle configuration
+#define ADXL375_INT1_PIN GPIO_NUM_4   // ADXL375 INT1, must be an RTC GPIO for ext0 wakeup
+#define LAUNCH_THRESHOLD_MG 3000      // Activity threshold above the 1g pad reference
+#define LAUNCH_CONFIRM_MG 3000        // Acceleration above 1 g (magnitude less gravity) that confirms a real launch
+#define GRAVITY_MG 1000               // On the pad the magnitude reads 1 g
+#define LAUNCH_CONFIRM_MS 100         // Window after wake to see the confirm threshold
+#define ADXL375_MG_PER_LSB 49         // ADXL375 scale factor in full resolution mode
+
+
+typedef enum {
+  DAQC_PAD_IDLE = 0,  // Light sleep, waiting for ADXL375 activity interrupt
+  DAQC_ACQUIRE,       // Full rate acquisition
+} DAQC_State_t;
+
+DAQC_State_t daqc_state = DAQC_PAD_IDLE;
+
+// Wake to first sample measurement (light sleep exit -> first accelerometer sample)
+int64_t wake_time_us = 0;
+int64_t wake_to_sample_us = 0;
+int64_t wake_to_sample_max_us = 0;
+uint32_t wake_count = 0;
+bool launch_confirmed = false;
+
+void pad_idle_wait();
+
 
 void setup() {
 
   Serial.begin(9600); // Enabling serial communication
   ADXL375_init(); // Initializing the ADXL375 accelerometer
   // bmp390_init(); // Initializing the BMP390 barometric pressure sensor
+  pinMode(ADXL375_INT1_PIN, INPUT);
 
 }
 
 // Initialization variables :
-    // ADXL375 accelerometer variables. 
+    // ADXL375 accelerometer variables.
   int16_t x_acc;
   int16_t y_acc;
   int16_t z_acc;
 
 void loop() {
-  
+
+  if (daqc_state == DAQC_PAD_IDLE) {
+    pad_idle_wait(); // Returns only once the activity interrupt fired
+  }
 
   // Reading ADX375 accelerometer data
   ADXL375_read_acceleration(&x_acc, &y_acc, &z_acc);
 
+  int64_t now_us = esp_timer_get_time();
+  if (wake_to_sample_us == 0) {
+    // First sample after wakeup, record the time it took.
+    wake_to_sample_us = now_us - wake_time_us;
+    if (wake_to_sample_us > wake_to_sample_max_us) wake_to_sample_max_us = wake_to_sample_us;
+    Serial.printf("Wake #%lu to first sample %lld us (max %lld us)\n",
+                  (unsigned long)wake_count, wake_to_sample_us, wake_to_sample_max_us);
+  }
+
+  // Launch confirmation : magnitude squared in mg^2 against 1 g plus the confirm threshold.
+  if (!launch_confirmed) {
+    int32_t x = (int32_t)x_acc * ADXL375_MG_PER_LSB;
+    int32_t y = (int32_t)y_acc * ADXL375_MG_PER_LSB;
+    int32_t z = (int32_t)z_acc * ADXL375_MG_PER_LSB;
+    int64_t mag2 = (int64_t)x * x + (int64_t)y * y + (int64_t)z * z;
+    const int64_t confirm_mg = LAUNCH_CONFIRM_MG + GRAVITY_MG;
+    if (mag2 > confirm_mg * confirm_mg) {
+      launch_confirmed = true;
+      Serial.println("Launch confirmed");
+    }
+    else if (now_us - wake_time_us > (int64_t)LAUNCH_CONFIRM_MS * 1000) {
+      // Not a launch (bump or handling), go back to sleep.
+      daqc_state = DAQC_PAD_IDLE;
+    }
+  }
+
 }
 
+
+/**
+ * @brief Wait on the pad in light sleep until the ADXL375 reports activity.
+ *
+ * The ADXL375 activity detector is armed and the ESP32 enters light sleep with
+ * INT1 as ext0 wakeup source. RAM and the I2C peripheral state are retained
+ * through light sleep so acquisition resumes straight after wakeup.
+ */
+void pad_idle_wait() {
+
+  ADXL375_enable_activity_int(LAUNCH_THRESHOLD_MG);
+  esp_sleep_enable_ext0_wakeup(ADXL375_INT1_PIN, 1);
+
+  Serial.println("Pad idle, waiting for launch");
+  Serial.flush();
+
+  // INT1 is level triggered, so loop in case of a spurious wakeup.
+  while (digitalRead(ADXL375_INT1_PIN) == LOW) {
+    esp_light_sleep_start();
+  }
+
+  wake_time_us = esp_timer_get_time();   // Out of sleep : the INT1 edge itself is not seen by the CPU
+  wake_to_sample_us = 0;
+  wake_count++;
+
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_EXT0);
+  ADXL375_disable_activity_int(); // Back to full power, clears INT1
+  launch_confirmed = false;
+  daqc_state = DAQC_ACQUIRE;
+}
@@ -0,0 +1,171 @@
+/**
+ * @file altitude_kf.cpp
+ * @brief 3-state altitude Kalman filter implementation.
+ *
+ * All matrix products are written out by hand for the 3x3 case. Covariance is
+ * kept symmetric explicitly, which avoids drift from float round-off over long
+ * flights. Cost per call is fixed :
+ * - KF_predict()      : ~60 multiply/adds
+ * - KF_update_*()     : ~25 multiply/adds + 1 divide
+ */
+
+#include <math.h>
+#include "altitude_kf.h"
+
+
+void KF_default_config(KF_Config_t *cfg) {
+  cfg->accel_sigma = KF_ACCEL_SIGMA;
+  cfg->baro_sigma = KF_BARO_SIGMA;
+  cfg->jerk_psd = KF_JERK_PSD;
+  cfg->baro_lockout_speed = KF_BARO_LOCKOUT_SPEED;
+  cfg->baro_unlock_speed = KF_BARO_UNLOCK_SPEED;
+  cfg->baro_gate_sigma = KF_BARO_GATE_SIGMA;
+}
+
+
+void KF_init(KF_t *kf, const KF_Config_t *cfg, float altitude) {
+  kf->cfg = *cfg;
+  kf->x[0] = altitude;
+  kf->x[1] = 0.0f;
+  kf->x[2] = 0.0f;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      kf->P[i][j] = 0.0f;
+    }
+  }
+  // Sitting on the pad, altitude and velocity are well known.
+  kf->P[0][0] = cfg->baro_sigma * cfg->baro_sigma;
+  kf->P[1][1] = 0.01f;
+  kf->P[2][2] = cfg->accel_sigma * cfg->accel_sigma;
+  kf->baro_locked = false;
+  kf->baro_rejected = 0;
+  kf->baro_gate_streak = 0;
+}
+
+
+/**
+ * @brief Propagate state and covariance forward by dt seconds.
+ *
+ * P' = F P F^T + Q, with Q the discretised white jerk model :
+ *
+ *          | dt^5/20  dt^4/8  dt^3/6 |
+ *  Q = q * | dt^4/8   dt^3/3  dt^2/2 |
+ *          | dt^3/6   dt^2/2  dt     |
+ */
+void KF_predict(KF_t *kf, float dt) {
+  if (!(dt > 0.0f)) {
+    return;
+  }
+
+  float dt2 = dt * dt;
+  float hdt2 = 0.5f * dt2;
+  float *x = kf->x;
+  float (*P)[3] = kf->P;
+
+  // State
+  x[0] += x[1] * dt + x[2] * hdt2;
+  x[1] += x[2] * dt;
+
+  // A = F P
+  float a00 = P[0][0] + dt * P[1][0] + hdt2 * P[2][0];
+  float a01 = P[0][1] + dt * P[1][1] + hdt2 * P[2][1];
+  float a02 = P[0][2] + dt * P[1][2] + hdt2 * P[2][2];
+  float a11 = P[1][1] + dt * P[2][1];
+  float a12 = P[1][2] + dt * P[2][2];
+  float a22 = P[2][2];
+
+  // P = A F^T + Q (upper triangle, then mirror)
+  float q = kf->cfg.jerk_psd;
+  float dt3 = dt2 * dt;
+  P[0][0] = a00 + dt * a01 + hdt2 * a02 + q * dt3 * dt2 * (1.0f / 20.0f);
+  P[0][1] = a01 + dt * a02 + q * dt2 * dt2 * (1.0f / 8.0f);
+  P[0][2] = a02 + q * dt3 * (1.0f / 6.0f);
+  P[1][1] = a11 + dt * a12 + q * dt3 * (1.0f / 3.0f);
+  P[1][2] = a12 + q * hdt2;
+  P[2][2] = a22 + q * dt;
+
+  P[1][0] = P[0][1];
+  P[2][0] = P[0][2];
+  P[2][1] = P[1][2];
+}
+
+
+/**
+ * @brief Scalar measurement update for H = e_i.
+ *
+ * K = P[:,i] / (P[i][i] + R)
+ * x = x + K (z - x[i])
+ * P = P - K P[i,:]
+ */
+static void KF_scalar_update(KF_t *kf, int i, float z, float r) {
+  float (*P)[3] = kf->P;
+  float s = P[i][i] + r;
+  float inv_s = 1.0f / s;
+  float innov = z - kf->x[i];
+
+  float p0 = P[0][i];
+  float p1 = P[1][i];
+  float p2 = P[2][i];
+  float k0 = p0 * inv_s;
+  float k1 = p1 * inv_s;
+  float k2 = p2 * inv_s;
+
+  kf->x[0] += k0 * innov;
+  kf->x[1] += k1 * innov;
+  kf->x[2] += k2 * innov;
+
+  P[0][0] -= k0 * p0;
+  P[0][1] -= k0 * p1;
+  P[0][2] -= k0 * p2;
+  P[1][1] -= k1 * p1;
+  P[1][2] -= k1 * p2;
+  P[2][2] -= k2 * p2;
+  P[1][0] = P[0][1];
+  P[2][0] = P[0][2];
+  P[2][1] = P[1][2];
+}
+
+
+void KF_update_accel(KF_t *kf, float accel) {
+  float r = kf->cfg.accel_sigma * kf->cfg.accel_sigma;
+  KF_scalar_update(kf, 2, accel, r);
+}
+
+
+bool KF_update_baro(KF_t *kf, float altitude) {
+  float speed = fabsf(kf->x[1]);
+
+  // Transonic lockout with hysteresis
+  if (kf->baro_locked) {
+    if (speed < kf->cfg.baro_unlock_speed) {
+      kf->baro_locked = false;
+    }
+  }
+  else if (speed > kf->cfg.baro_lockout_speed) {
+    kf->baro_locked = true;
+  }
+  if (kf->baro_locked) {
+    kf->baro_rejected++;
+    return false;
+  }
+
+  float r = kf->cfg.baro_sigma * kf->cfg.baro_sigma;
+
+  // Innovation gate, catches pressure spikes outside the lockout window
+  // (ejection charge, gusts on the static port). A long run of rejections means
+  // the filter itself has drifted (e.g. after lockout), so the baro is trusted again.
+  if (kf->cfg.baro_gate_sigma > 0.0f) {
+    float innov = altitude - kf->x[0];
+    float s = kf->P[0][0] + r;
+    float gate = kf->cfg.baro_gate_sigma;
+    if (innov * innov > gate * gate * s && kf->baro_gate_streak < KF_BARO_GATE_MAX_REJECT) {
+      kf->baro_gate_streak++;
+      kf->baro_rejected++;
+      return false;
+    }
+  }
+  kf->baro_gate_streak = 0;
+
+  KF_scalar_update(kf, 0, altitude, r);
+  return true;
+}
@@ -0,0 +1,127 @@
+/**
+ * @file altitude_kf.h
+ * @brief 3-state altitude/velocity/acceleration Kalman filter for the flight computer.
+ *
+ * State vector : x = [ altitude (m), vertical velocity (m/s), vertical acceleration (m/s^2) ]
+ *
+ * Process model is constant acceleration driven by white jerk noise :
+ *
+ *      | 1  dt  dt^2/2 |
+ *  F = | 0  1   dt     |
+ *      | 0  0   1      |
+ *
+ * Measurements are fused one at a time as scalar updates, so there is no matrix
+ * inversion and every call costs a fixed number of float operations :
+ * - ADXL375 axial acceleration (gravity removed), H = [0 0 1]
+ * - BMP390 pressure altitude above the pad,       H = [1 0 0]
+ *
+ * Each sensor is fused at its own rate, KF_predict() is called with the time
+ * since the previous predict before every update.
+ *
+ * Transonic baro lockout :
+ * Around Mach 1 the static port pressure is unreliable (shock waves over the
+ * airframe). Baro updates are ignored while |velocity| is above the lockout
+ * speed and resume once it drops below the unlock speed (hysteresis).
+ *
+ * This file has no Arduino dependencies so it can be built into host tools.
+ */
+
+#ifndef ALTITUDE_KF_H
+#define ALTITUDE_KF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+// Default noise model. Can be overridden with build flags or a generated noise header
+// (Tools/noise_char from a bench log, build with -DKF_NOISE_HEADER='"kf_noise.h"').
+#ifdef KF_NOISE_HEADER
+#include KF_NOISE_HEADER
+#endif
+#ifndef KF_ACCEL_SIGMA
+#define KF_ACCEL_SIGMA 0.5f           // ADXL375 axial acceleration noise (m/s^2, 1 sigma)
+#endif
+#ifndef KF_BARO_SIGMA
+#define KF_BARO_SIGMA 0.5f            // BMP390 altitude noise (m, 1 sigma)
+#endif
+#ifndef KF_JERK_PSD
+#define KF_JERK_PSD 50.0f             // Process noise, white jerk spectral density ((m/s^3)^2/Hz)
+#endif
+#ifndef KF_BARO_LOCKOUT_SPEED
+#define KF_BARO_LOCKOUT_SPEED 240.0f  // Ignore baro above ~Mach 0.7 (m/s)
+#endif
+#ifndef KF_BARO_UNLOCK_SPEED
+#define KF_BARO_UNLOCK_SPEED 200.0f   // Resume baro below this speed (m/s)
+#endif
+#ifndef KF_BARO_GATE_SIGMA
+#define KF_BARO_GATE_SIGMA 6.0f       // Reject baro innovations larger than this many sigma
+#endif
+#ifndef KF_BARO_GATE_MAX_REJECT
+#define KF_BARO_GATE_MAX_REJECT 10    // Consecutive gated samples before the baro is trusted again
+#endif
+
+
+//--------------------------------------------------------------------------------------------
+// Filter configuration and state
+//--------------------------------------------------------------------------------------------
+
+typedef struct {
+  float accel_sigma;          // Accelerometer measurement noise (m/s^2)
+  float baro_sigma;           // Baro altitude measurement noise (m)
+  float jerk_psd;             // White jerk spectral density
+  float baro_lockout_speed;   // Transonic lockout entry speed (m/s)
+  float baro_unlock_speed;    // Transonic lockout exit speed (m/s)
+  float baro_gate_sigma;      // Innovation gate for baro updates (sigma), 0 disables
+} KF_Config_t;
+
+typedef struct {
+  float x[3];                 // altitude, velocity, acceleration
+  float P[3][3];              // State covariance
+  KF_Config_t cfg;
+  bool baro_locked;           // Transonic lockout active
+  uint32_t baro_rejected;     // Baro updates skipped by lockout or gate
+  uint32_t baro_gate_streak;  // Consecutive gated baro updates
+} KF_t;
+
+
+//--------------------------------------------------------------------------------------------
+// Function prototypes
+//--------------------------------------------------------------------------------------------
+
+/**
+ * @brief Fill a configuration with the compiled-in defaults (KF_* macros).
+ * @param[out] cfg Configuration to fill.
+ */
+void KF_default_config(KF_Config_t *cfg);
+
+/**
+ * @brief Initialize the filter at rest at a known altitude.
+ * @param[out] kf Filter to initialize.
+ * @param[in] cfg Noise configuration, copied into the filter.
+ * @param[in] altitude Initial altitude (m), usually 0 on the pad.
+ */
+void KF_init(KF_t *kf, const KF_Config_t *cfg, float altitude);
+
+/**
+ * @brief Propagate state and covariance forward by dt seconds.
+ * @param[in,out] kf Filter.
+ * @param[in] dt Time step in seconds. Non-positive steps are ignored.
+ */
+void KF_predict(KF_t *kf, float dt);
+
+/**
+ * @brief Fuse an axial acceleration measurement.
+ * @param[in,out] kf Filter.
+ * @param[in] accel Vertical acceleration with gravity removed (m/s^2).
+ */
+void KF_update_accel(KF_t *kf, float accel);
+
+/**
+ * @brief Fuse a baro altitude measurement, subject to transonic lockout and gating.
+ * @param[in,out] kf Filter.
+ * @param[in] altitude Pressure altitude above the pad (m).
+ * @return true if the measurement was used, false if it was locked out or gated.
+ */
+bool KF_update_baro(KF_t *kf, float altitude);
+
+#endif /* ALTITUDE_KF_H */
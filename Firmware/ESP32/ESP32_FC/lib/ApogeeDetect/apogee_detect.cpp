@@ -0,0 +1,182 @@
+/**
+ * @file apogee_detect.cpp
+ * @brief Multi-sensor apogee detection with voting and lockouts.
+ */
+
+#include <string.h>
+#include "apogee_detect.h"
+
+
+void APOGEE_default_config(APOGEE_Config_t *cfg) {
+  cfg->launch_velocity = 15.0f;
+  cfg->min_coast_us = 3000000;        // Covers burn and transonic on our motors
+  cfg->backup_time_us = 30000000;
+  cfg->backup_margin_us = 2000000;
+  cfg->votes_required = 2;
+  cfg->kf_confirm = 10;
+  cfg->baro_gate = 2.0f;
+  cfg->baro_confirm = 5;
+  cfg->gps_window = 16;                // 1.5 s at 10 Hz, 3 m noise gives ~1.6 m/s slope noise
+  cfg->gps_slope = 3.0f;
+  cfg->gps_confirm = 3;
+}
+
+
+void APOGEE_init(APOGEE_t *ad, const APOGEE_Config_t *cfg) {
+  memset(ad, 0, sizeof(*ad));
+  ad->cfg = *cfg;
+  if (ad->cfg.gps_window > APOGEE_GPS_WINDOW_MAX) ad->cfg.gps_window = APOGEE_GPS_WINDOW_MAX;
+  if (ad->cfg.gps_window < 2) ad->cfg.gps_window = 2;
+  ad->phase = APOGEE_PAD;
+  ad->kf_peak_altitude = -1e9f;
+  ad->baro_peak = -1e9f;
+}
+
+
+static void APOGEE_vote(APOGEE_t *ad, int detector, int64_t t_us) {
+  uint8_t bit = (uint8_t)(1 << detector);
+  if (!(ad->votes & bit)) {
+    ad->votes |= bit;
+    ad->t_vote_us[detector] = t_us;
+  }
+}
+
+
+static void APOGEE_unvote(APOGEE_t *ad, int detector) {
+  ad->votes &= (uint8_t)~(1 << detector);
+  ad->t_vote_us[detector] = 0;
+}
+
+
+void APOGEE_update_kf(APOGEE_t *ad, int64_t t_us, float altitude, float velocity) {
+  if (ad->phase == APOGEE_PAD) {
+    if (velocity > ad->cfg.launch_velocity) {
+      ad->phase = APOGEE_ASCENT;
+      ad->t_launch_us = t_us;
+      ad->launch_altitude = altitude;
+    }
+    return;
+  }
+  if (ad->phase != APOGEE_ASCENT) {
+    return;
+  }
+
+  if (altitude > ad->kf_peak_altitude) {
+    ad->kf_peak_altitude = altitude;
+    ad->t_kf_peak_us = t_us;
+  }
+
+  if (velocity < 0.0f) {
+    if (++ad->kf_count >= ad->cfg.kf_confirm) APOGEE_vote(ad, 0, t_us);
+  }
+  else {
+    ad->kf_count = 0;
+    APOGEE_unvote(ad, 0);
+  }
+}
+
+
+void APOGEE_update_baro(APOGEE_t *ad, int64_t t_us, float altitude, bool valid) {
+  if (ad->phase != APOGEE_ASCENT || !valid) {
+    return;
+  }
+  if (altitude > ad->baro_peak) {
+    ad->baro_peak = altitude;
+  }
+  if (altitude < ad->baro_peak - ad->cfg.baro_gate) {
+    if (++ad->baro_count >= ad->cfg.baro_confirm) APOGEE_vote(ad, 1, t_us);
+  }
+  else {
+    ad->baro_count = 0;
+    APOGEE_unvote(ad, 1);
+  }
+}
+
+
+void APOGEE_update_gps(APOGEE_t *ad, int64_t t_us, float height) {
+  uint8_t w = ad->cfg.gps_window;
+  ad->gps_t_us[ad->gps_head] = t_us;
+  ad->gps_h[ad->gps_head] = height;
+  ad->gps_head = (uint8_t)((ad->gps_head + 1) % w);
+  if (ad->gps_n < w) ad->gps_n++;
+
+  if (ad->phase != APOGEE_ASCENT || ad->gps_n < w) {
+    return;
+  }
+
+  // Least squares slope of height against time, times relative to the newest fix.
+  float st = 0.0f, sh = 0.0f, stt = 0.0f, sth = 0.0f;
+  for (uint8_t i = 0; i < w; i++) {
+    float t = (float)(ad->gps_t_us[i] - t_us) * 1e-6f;
+    float h = ad->gps_h[i];
+    st += t;
+    sh += h;
+    stt += t * t;
+    sth += t * h;
+  }
+  float den = w * stt - st * st;
+  if (den <= 0.0f) {
+    return;
+  }
+  float slope = (w * sth - st * sh) / den;
+
+  if (slope < -ad->cfg.gps_slope) {
+    if (++ad->gps_count >= ad->cfg.gps_confirm) APOGEE_vote(ad, 2, t_us);
+  }
+  else {
+    ad->gps_count = 0;
+    APOGEE_unvote(ad, 2);
+  }
+}
+
+
+static uint8_t APOGEE_popcount(uint8_t v) {
+  uint8_t n = 0;
+  while (v) {
+    n += v & 1;
+    v >>= 1;
+  }
+  return n;
+}
+
+
+bool APOGEE_check_launch(APOGEE_t *ad, APOGEE_Event_t *ev) {
+  if (ad->phase == APOGEE_PAD || ad->launch_reported) {
+    return false;
+  }
+  ad->launch_reported = true;
+  memset(ev, 0, sizeof(*ev));
+  ev->t_fired_us = ad->t_launch_us;
+  ev->t_estimate_us = ad->t_launch_us;
+  ev->altitude = ad->launch_altitude;
+  return true;
+}
+
+
+bool APOGEE_check(APOGEE_t *ad, int64_t t_us, APOGEE_Event_t *ev) {
+  if (ad->phase != APOGEE_ASCENT) {
+    return false;
+  }
+  int64_t since_launch = t_us - ad->t_launch_us;
+  if (since_launch < ad->cfg.min_coast_us) {
+    // Votes cast during the lockout do not count.
+    ad->votes = 0;
+    for (int i = 0; i < APOGEE_DETECTORS; i++) ad->t_vote_us[i] = 0;
+    return false;
+  }
+
+  uint8_t needed = ad->cfg.votes_required;
+  if (since_launch >= ad->cfg.backup_time_us) needed = 1;
+  if (since_launch >= ad->cfg.backup_time_us + ad->cfg.backup_margin_us) needed = 0;
+  if (APOGEE_popcount(ad->votes) < needed) {
+    return false;
+  }
+
+  ad->phase = APOGEE_DESCENT;
+  ev->t_fired_us = t_us;
+  ev->t_estimate_us = ad->t_kf_peak_us;
+  ev->altitude = ad->kf_peak_altitude;
+  ev->votes = ad->votes;
+  for (int i = 0; i < APOGEE_DETECTORS; i++) ev->t_vote_us[i] = ad->t_vote_us[i];
+  return true;
+}
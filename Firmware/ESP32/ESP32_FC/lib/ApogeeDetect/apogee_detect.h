@@ -0,0 +1,141 @@
+/**
+ * @file apogee_detect.h
+ * @brief Multi-sensor apogee detection with voting and lockouts.
+ *
+ * Three independent detectors vote for apogee :
+ *
+ * | Bit | Detector | Votes when                                                     |
+ * | --- | -------- | -------------------------------------------------------------- |
+ * | 0   | Kalman   | filter velocity < 0 for kf_confirm consecutive updates         |
+ * | 1   | Baro     | altitude below its running peak by more than baro_gate for      |
+ * |     |          | baro_confirm consecutive samples (noise gate)                  |
+ * | 2   | GPS      | least squares height slope over the last gps_window fixes is    |
+ * |     |          | below -gps_slope for gps_confirm consecutive fixes              |
+ *
+ * A vote is withdrawn as soon as its detector's condition breaks (a noise
+ * spike or a GPS slope excursion on the way up does not stay counted). Apogee
+ * fires when votes_required detectors vote at the same time, subject to lockouts :
+ * - Nothing fires before launch (filter velocity above launch_velocity).
+ * - Nothing fires during min_coast after launch (motor burn, transonic).
+ * - backup_time after launch, apogee fires on any single vote, and on no vote
+ *   at all at backup_time + backup_margin, so a failed sensor cannot stop deployment.
+ *
+ * Baro samples taken while the Kalman filter transonic lockout is active are
+ * ignored by the baro detector.
+ *
+ * Launch is an event of its own : APOGEE_check_launch() reports the move
+ * from PAD to ASCENT once, stamped when the filter velocity crossed
+ * launch_velocity.
+ *
+ * Times are flight computer microseconds. This file has no Arduino
+ * dependencies so it can be built into host tools.
+ */
+
+#ifndef APOGEE_DETECT_H
+#define APOGEE_DETECT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define APOGEE_VOTE_KF 0x01
+#define APOGEE_VOTE_BARO 0x02
+#define APOGEE_VOTE_GPS 0x04
+#define APOGEE_DETECTORS 3
+#define APOGEE_GPS_WINDOW_MAX 16      // Largest GPS regression window
+
+
+typedef enum {
+  APOGEE_PAD = 0,             // Waiting for launch
+  APOGEE_ASCENT,              // Launched, watching for apogee
+  APOGEE_DESCENT,             // Apogee fired
+} APOGEE_Phase_t;
+
+typedef struct {
+  float launch_velocity;      // m/s, filter velocity that declares launch
+  int64_t min_coast_us;       // No apogee before this long after launch
+  int64_t backup_time_us;     // After this, a single vote is enough
+  int64_t backup_margin_us;   // After backup_time + margin, fire with no vote
+  uint8_t votes_required;     // Detectors that must agree (1 - 3)
+  uint16_t kf_confirm;        // Consecutive negative velocity updates
+  float baro_gate;            // m below peak
+  uint16_t baro_confirm;      // Consecutive samples below peak - gate
+  uint8_t gps_window;         // Fixes used for the slope (<= APOGEE_GPS_WINDOW_MAX)
+  float gps_slope;            // m/s, descent rate the GPS slope must exceed
+  uint8_t gps_confirm;        // Consecutive fixes with descending slope
+} APOGEE_Config_t;
+
+typedef struct {
+  APOGEE_Config_t cfg;
+  APOGEE_Phase_t phase;
+  int64_t t_launch_us;
+  float launch_altitude;      // Kalman altitude when launch was declared
+  bool launch_reported;       // APOGEE_check_launch() has returned it
+  uint8_t votes;              // Current votes
+  int64_t t_vote_us[APOGEE_DETECTORS];
+
+  // Kalman detector
+  uint16_t kf_count;
+  float kf_peak_altitude;
+  int64_t t_kf_peak_us;
+
+  // Baro detector
+  float baro_peak;
+  uint16_t baro_count;
+
+  // GPS detector
+  int64_t gps_t_us[APOGEE_GPS_WINDOW_MAX];
+  float gps_h[APOGEE_GPS_WINDOW_MAX];
+  uint8_t gps_n;
+  uint8_t gps_head;
+  uint8_t gps_count;
+} APOGEE_t;
+
+typedef struct {
+  int64_t t_fired_us;         // When the detector fired
+  int64_t t_estimate_us;      // Time of the Kalman altitude peak
+  float altitude;             // Kalman altitude peak (m)
+  uint8_t votes;              // Detectors voting when it fired
+  int64_t t_vote_us[APOGEE_DETECTORS]; // Start of each detector's vote, 0 = not voting
+} APOGEE_Event_t;
+
+
+/**
+ * @brief Fill a configuration with defaults (2 of 3 votes).
+ */
+void APOGEE_default_config(APOGEE_Config_t *cfg);
+
+/**
+ * @brief Reset the detector to the pad phase.
+ */
+void APOGEE_init(APOGEE_t *ad, const APOGEE_Config_t *cfg);
+
+/**
+ * @brief Feed the Kalman filter output after each filter step.
+ */
+void APOGEE_update_kf(APOGEE_t *ad, int64_t t_us, float altitude, float velocity);
+
+/**
+ * @brief Feed a baro altitude sample.
+ * @param[in] valid false while the baro is locked out (transonic).
+ */
+void APOGEE_update_baro(APOGEE_t *ad, int64_t t_us, float altitude, bool valid);
+
+/**
+ * @brief Feed a GPS height from a new fix.
+ */
+void APOGEE_update_gps(APOGEE_t *ad, int64_t t_us, float height);
+
+/**
+ * @brief Returns true exactly once, after launch is declared.
+ * @param[out] ev t_fired_us and t_estimate_us at launch, altitude then, no votes.
+ */
+bool APOGEE_check_launch(APOGEE_t *ad, APOGEE_Event_t *ev);
+
+/**
+ * @brief Evaluate the vote. Returns true exactly once, when apogee fires.
+ * @param[out] ev Event details, filled when returning true.
+ */
+bool APOGEE_check(APOGEE_t *ad, int64_t t_us, APOGEE_Event_t *ev);
+
+#endif /* APOGEE_DETECT_H */
@@ -0,0 +1,87 @@
+/**
+ * @file baro_altitude.cpp
+ * @brief Piecewise cubic pressure to altitude table.
+ *
+ * Coefficients are kept as four separate arrays (structure of arrays) so the
+ * batch loop can gather each coefficient with one vector load per lane.
+ */
+
+#include <math.h>
+#include "baro_altitude.h"
+
+
+#define BARO_ISA_SCALE 44330.0        // m
+#define BARO_ISA_EXPONENT 0.1903
+
+
+static float baro_c0[BARO_TABLE_SEGMENTS];
+static float baro_c1[BARO_TABLE_SEGMENTS];
+static float baro_c2[BARO_TABLE_SEGMENTS];
+static float baro_c3[BARO_TABLE_SEGMENTS];
+
+
+double BARO_reference_altitude(double pressure) {
+  return BARO_ISA_SCALE * (1.0 - pow(pressure / BARO_SEA_LEVEL_PA, BARO_ISA_EXPONENT));
+}
+
+// dh/dp of the reference formula (m/Pa)
+static double baro_reference_slope(double pressure) {
+  return -BARO_ISA_SCALE * BARO_ISA_EXPONENT *
+         pow(pressure / BARO_SEA_LEVEL_PA, BARO_ISA_EXPONENT - 1.0) / BARO_SEA_LEVEL_PA;
+}
+
+
+/**
+ * @brief Build the segment table.
+ *
+ * Cubic Hermite segment on [p_i, p_i + s] in local coordinate t = p - p_i :
+ *   c0 = h0
+ *   c1 = d0
+ *   c2 = (3 (h1 - h0) / s - 2 d0 - d1) / s
+ *   c3 = (d0 + d1 - 2 (h1 - h0) / s) / s^2
+ */
+void BARO_init_table() {
+  const double s = BARO_TABLE_STEP;
+  for (int i = 0; i < BARO_TABLE_SEGMENTS; i++) {
+    double p0 = BARO_TABLE_P_MIN + i * s;
+    double p1 = p0 + s;
+    double h0 = BARO_reference_altitude(p0);
+    double h1 = BARO_reference_altitude(p1);
+    double d0 = baro_reference_slope(p0);
+    double d1 = baro_reference_slope(p1);
+    double slope = (h1 - h0) / s;
+    baro_c0[i] = (float)h0;
+    baro_c1[i] = (float)d0;
+    baro_c2[i] = (float)((3.0 * slope - 2.0 * d0 - d1) / s);
+    baro_c3[i] = (float)((d0 + d1 - 2.0 * slope) / (s * s));
+  }
+}
+
+
+float BARO_pressure_altitude(float pressure) {
+  float x = (pressure - BARO_TABLE_P_MIN) * (1.0f / BARO_TABLE_STEP);
+  int i = (int)x;
+  if (x < 0.0f) i = 0;
+  if (i > BARO_TABLE_SEGMENTS - 1) i = BARO_TABLE_SEGMENTS - 1;
+  float t = pressure - (BARO_TABLE_P_MIN + i * BARO_TABLE_STEP);
+  return baro_c0[i] + t * (baro_c1[i] + t * (baro_c2[i] + t * baro_c3[i]));
+}
+
+
+float BARO_altitude_above(float pressure, float reference_altitude) {
+  return BARO_pressure_altitude(pressure) - reference_altitude;
+}
+
+
+void BARO_pressure_altitude_batch(const float *__restrict pressure, float *__restrict altitude, size_t n) {
+  const float inv_step = 1.0f / BARO_TABLE_STEP;
+  for (size_t k = 0; k < n; k++) {
+    float p = pressure[k];
+    // Clamp the integer index (min/max) so the loop stays branch free.
+    int i = (int)((p - BARO_TABLE_P_MIN) * inv_step);
+    i = i < 0 ? 0 : i;
+    i = i > BARO_TABLE_SEGMENTS - 1 ? BARO_TABLE_SEGMENTS - 1 : i;
+    float t = p - (BARO_TABLE_P_MIN + (float)i * BARO_TABLE_STEP);
+    altitude[k] = baro_c0[i] + t * (baro_c1[i] + t * (baro_c2[i] + t * baro_c3[i]));
+  }
+}
@@ -0,0 +1,81 @@
+/**
+ * @file baro_altitude.h
+ * @brief Fast pressure to altitude conversion (piecewise cubic table).
+ *
+ * Reference formula (BMPXXX library, ISA troposphere) :
+ *
+ *      h(p) = 44330 * (1 - (p / 101325)^0.1903)
+ *
+ * costs a double pow() per sample. Here h(p) is replaced by a table of cubic
+ * Hermite segments over 30 - 110 kPa (~9100 m to -750 m), uniform in pressure :
+ *
+ *      segment i = (p - BARO_TABLE_P_MIN) / BARO_TABLE_STEP
+ *      h = c0[i] + t*(c1[i] + t*(c2[i] + t*c3[i])),   t = p - p_i
+ *
+ * Each segment matches h and dh/dp at both ends, so the curve is C1 continuous.
+ * Interpolation error is below 1 mm over the table range with 64 segments;
+ * float evaluation limits the result to ~1 mm at 9 km. Table is 1 KB of RAM.
+ *
+ * Altitude above the pad is h(p) - h(p_pad). This is the exact difference of
+ * pressure altitudes, unlike 44330 * (1 - (p / p_pad)^0.1903) which scales the
+ * altitude by (p_pad / 101325)^0.1903 (about -2% per 1000 m of pad elevation).
+ *
+ * This file has no Arduino dependencies so it can be built into host tools.
+ */
+
+#ifndef BARO_ALTITUDE_H
+#define BARO_ALTITUDE_H
+
+#include <stddef.h>
+
+
+#define BARO_SEA_LEVEL_PA 101325.0    // ISA sea level pressure (Pa)
+#define BARO_TABLE_P_MIN 30000.0f     // Table start (Pa)
+#define BARO_TABLE_P_MAX 110000.0f    // Table end (Pa)
+#define BARO_TABLE_SEGMENTS 64        // Number of cubic segments
+#define BARO_TABLE_STEP ((BARO_TABLE_P_MAX - BARO_TABLE_P_MIN) / BARO_TABLE_SEGMENTS)
+
+
+/**
+ * @brief Build the segment table. Must be called once before any conversion.
+ */
+void BARO_init_table();
+
+/**
+ * @brief Reference conversion with pow(), used to build and check the table.
+ * @param[in] pressure Pressure (Pa).
+ * @return ISA pressure altitude (m).
+ */
+double BARO_reference_altitude(double pressure);
+
+/**
+ * @brief ISA pressure altitude from the segment table.
+ *
+ * Pressures outside the table range are extrapolated with the end segments.
+ *
+ * @param[in] pressure Pressure (Pa).
+ * @return ISA pressure altitude (m).
+ */
+float BARO_pressure_altitude(float pressure);
+
+/**
+ * @brief Altitude above a reference, e.g. the pad.
+ * @param[in] pressure Pressure (Pa).
+ * @param[in] reference_altitude BARO_pressure_altitude() of the reference pressure (m).
+ * @return Altitude above the reference (m).
+ */
+float BARO_altitude_above(float pressure, float reference_altitude);
+
+/**
+ * @brief Convert a block of pressures, written to be auto-vectorised.
+ *
+ * Same result as BARO_pressure_altitude() for each element. With -O3 and AVX2
+ * the table lookup compiles to gathers and the polynomial to packed FMAs.
+ *
+ * @param[in] pressure Pressures (Pa).
+ * @param[out] altitude ISA pressure altitudes (m).
+ * @param[in] n Number of samples.
+ */
+void BARO_pressure_altitude_batch(const float *pressure, float *altitude, size_t n);
+
+#endif /* BARO_ALTITUDE_H */
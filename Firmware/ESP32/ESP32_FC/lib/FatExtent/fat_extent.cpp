@@ -0,0 +1,339 @@
+/**
+ * @file fat_extent.cpp
+ * @brief Card sectors of a file on a FAT16 / FAT32 volume, for raw sector writes.
+ */
+
+#include <string.h>
+#include "fat_extent.h"
+
+
+#define FAT_DIR_ENTRY 32
+#define FAT_ATTR_LFN 0x0F
+#define FAT_ATTR_VOLUME 0x08
+#define FAT_ATTR_DIR 0x10
+#define FAT_LFN_MAX 255
+
+typedef struct {
+  FATX_SectorRead_t read;
+  void *ctx;
+  uint8_t *buf;
+  uint32_t buf_lba;           // Sector in buf, UINT32_MAX if none
+  uint32_t reads;
+
+  uint32_t fat_lba;           // First FAT
+  uint32_t root_lba;          // FAT16 root directory
+  uint32_t root_sectors;      // 0 on FAT32
+  uint32_t root_cluster;      // FAT32
+  uint32_t data_lba;          // Cluster 2
+  uint32_t cluster_sectors;
+  uint32_t clusters;          // Data clusters, numbered 2 to clusters + 1
+  uint8_t fat_bits;
+} Volume_t;
+
+
+static uint16_t rd16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+
+static uint32_t rd32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+static bool load(Volume_t *v, uint32_t lba) {
+  if (v->buf_lba == lba) {
+    return true;
+  }
+  v->buf_lba = UINT32_MAX;
+  if (!v->read(v->ctx, lba, v->buf)) {
+    return false;
+  }
+  v->buf_lba = lba;
+  v->reads++;
+  return true;
+}
+
+
+// Volume boot sector in buf (at lba) : fills the layout, false if it is not FAT16 / FAT32.
+static bool parse_boot(Volume_t *v, uint32_t lba) {
+  const uint8_t *b = v->buf;
+  if (b[510] != 0x55 || b[511] != 0xAA || (b[0] != 0xEB && b[0] != 0xE9)) {
+    return false;
+  }
+  uint16_t sector_bytes = rd16(b + 11);
+  uint8_t cluster_sectors = b[13];
+  uint16_t reserved = rd16(b + 14);
+  uint8_t fats = b[16];
+  uint16_t root_entries = rd16(b + 17);
+  uint32_t total = rd16(b + 19) ? rd16(b + 19) : rd32(b + 32);
+  uint32_t fat_sectors = rd16(b + 22) ? rd16(b + 22) : rd32(b + 36);
+  if (sector_bytes != FATX_SECTOR_SIZE || cluster_sectors == 0 || (cluster_sectors & (cluster_sectors - 1)) ||
+      reserved == 0 || fats == 0 || fats > 2 || fat_sectors == 0) {
+    return false;
+  }
+
+  uint32_t root_sectors = ((uint32_t)root_entries * FAT_DIR_ENTRY + FATX_SECTOR_SIZE - 1) / FATX_SECTOR_SIZE;
+  uint32_t meta = reserved + fats * fat_sectors + root_sectors;
+  if (total <= meta) {
+    return false;
+  }
+  // The FAT type follows from the cluster count alone (FAT specification).
+  uint32_t clusters = (total - meta) / cluster_sectors;
+  if (clusters < 4085) {
+    return false;
+  }
+  v->fat_bits = clusters < 65525 ? 16 : 32;
+  if ((v->fat_bits == 16) != (root_sectors != 0)) {
+    return false;
+  }
+  v->fat_lba = lba + reserved;
+  v->root_lba = v->fat_lba + fats * fat_sectors;
+  v->root_sectors = root_sectors;
+  v->root_cluster = v->fat_bits == 32 ? rd32(b + 44) : 0;
+  v->data_lba = lba + meta;
+  v->cluster_sectors = cluster_sectors;
+  v->clusters = clusters;
+  return true;
+}
+
+
+// Sector 0 as a volume, else the MBR partitions in order, as FatFs mounts.
+static FATX_Status_t mount(Volume_t *v) {
+  if (!load(v, 0)) {
+    return FATX_IO_ERROR;
+  }
+  if (parse_boot(v, 0)) {
+    return FATX_OK;
+  }
+  if (v->buf[510] != 0x55 || v->buf[511] != 0xAA) {
+    return FATX_NO_VOLUME;
+  }
+  uint32_t starts[4];
+  for (int i = 0; i < 4; i++) {
+    const uint8_t *e = v->buf + 446 + 16 * i;
+    uint8_t type = e[4];
+    bool fat = type == 0x04 || type == 0x06 || type == 0x0E || type == 0x0B || type == 0x0C;
+    starts[i] = fat ? rd32(e + 8) : 0;
+  }
+  for (int i = 0; i < 4; i++) {
+    if (!starts[i]) continue;
+    if (!load(v, starts[i])) {
+      return FATX_IO_ERROR;
+    }
+    if (parse_boot(v, starts[i])) {
+      return FATX_OK;
+    }
+  }
+  return FATX_NO_VOLUME;
+}
+
+
+// FAT entry of a cluster; values past the last cluster (end of chain, bad) come back as 0.
+static bool fat_next(Volume_t *v, uint32_t cluster, uint32_t *next) {
+  uint32_t at = cluster * (v->fat_bits / 8);
+  if (!load(v, v->fat_lba + at / FATX_SECTOR_SIZE)) {
+    return false;
+  }
+  const uint8_t *p = v->buf + at % FATX_SECTOR_SIZE;
+  uint32_t n = v->fat_bits == 32 ? rd32(p) & 0x0FFFFFFF : rd16(p);
+  *next = n >= 2 && n < v->clusters + 2 ? n : 0;
+  return true;
+}
+
+
+static uint32_t cluster_lba(const Volume_t *v, uint32_t cluster) {
+  return v->data_lba + (cluster - 2) * v->cluster_sectors;
+}
+
+
+static char upper(char c) {
+  return c >= 'a' && c <= 'z' ? (char)(c - 'a' + 'A') : c;
+}
+
+
+static bool same_name(const char *a, const char *b) {
+  while (*a && upper(*a) == upper(*b)) {
+    a++;
+    b++;
+  }
+  return *a == 0 && *b == 0;
+}
+
+
+static uint8_t short_name_sum(const uint8_t *e) {
+  uint8_t sum = 0;
+  for (int i = 0; i < 11; i++) sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + e[i]);
+  return sum;
+}
+
+
+// Long name assembled from the LFN entries before a short entry.
+typedef struct {
+  char name[FAT_LFN_MAX + 1];
+  uint8_t sum;
+  uint8_t expect;             // Next LFN ordinal expected, 0 : no name pending
+  bool ascii;
+} LongName_t;
+
+
+static void lfn_reset(LongName_t *ln) {
+  ln->name[0] = 0;
+  ln->expect = 0;
+}
+
+
+static void lfn_entry(LongName_t *ln, const uint8_t *e) {
+  static const uint8_t pos[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+  uint8_t ord = e[0] & 0x1F;
+  if (e[0] & 0x40) {
+    memset(ln->name, 0, sizeof(ln->name));
+    ln->sum = e[13];
+    ln->ascii = true;
+  } else if (ord != ln->expect || e[13] != ln->sum) {
+    lfn_reset(ln);
+    return;
+  }
+  if (ord == 0 || ord * 13 > FAT_LFN_MAX) {
+    lfn_reset(ln);
+    return;
+  }
+  for (int i = 0; i < 13; i++) {
+    uint16_t c = rd16(e + pos[i]);
+    if (c == 0 || c == 0xFFFF) break;
+    if (c > 0x7F) ln->ascii = false;
+    ln->name[(ord - 1) * 13 + i] = (char)c;
+  }
+  ln->expect = (uint8_t)(ord - 1);
+}
+
+
+// 8.3 name of a directory entry as "NAME.EXT".
+static void short_name(const uint8_t *e, char *out) {
+  int n = 0;
+  for (int i = 0; i < 8 && e[i] != ' '; i++) out[n++] = (char)e[i];
+  if (e[8] != ' ') {
+    out[n++] = '.';
+    for (int i = 8; i < 11 && e[i] != ' '; i++) out[n++] = (char)e[i];
+  }
+  out[n] = 0;
+  if (out[0] == 0x05) out[0] = (char)0xE5;
+}
+
+
+typedef enum { SCAN_MORE, SCAN_FOUND, SCAN_END } Scan_t;
+
+
+// One directory sector : the entry of name, or the end marker.
+static Scan_t scan_sector(const uint8_t *s, const char *name, LongName_t *ln, uint8_t *entry) {
+  for (int off = 0; off < FATX_SECTOR_SIZE; off += FAT_DIR_ENTRY) {
+    const uint8_t *e = s + off;
+    if (e[0] == 0x00) {
+      return SCAN_END;
+    }
+    if (e[0] == 0xE5) {
+      lfn_reset(ln);
+      continue;
+    }
+    if (e[11] == FAT_ATTR_LFN) {
+      lfn_entry(ln, e);
+      continue;
+    }
+    bool has_long = ln->expect == 0 && ln->name[0] && ln->ascii && ln->sum == short_name_sum(e);
+    bool match = has_long && same_name(name, ln->name);
+    lfn_reset(ln);
+    if (e[11] & (FAT_ATTR_VOLUME | FAT_ATTR_DIR)) {
+      continue;
+    }
+    char sn[13];
+    short_name(e, sn);
+    if (match || same_name(name, sn)) {
+      memcpy(entry, e, FAT_DIR_ENTRY);
+      return SCAN_FOUND;
+    }
+  }
+  return SCAN_MORE;
+}
+
+
+static FATX_Status_t find_entry(Volume_t *v, const char *name, uint8_t *entry) {
+  LongName_t ln;
+  memset(&ln, 0, sizeof(ln));
+  Scan_t r = SCAN_MORE;
+  if (v->fat_bits == 16) {
+    for (uint32_t i = 0; i < v->root_sectors && r == SCAN_MORE; i++) {
+      if (!load(v, v->root_lba + i)) return FATX_IO_ERROR;
+      r = scan_sector(v->buf, name, &ln, entry);
+    }
+  } else {
+    // Bounded by the cluster count, a corrupt FAT could loop the chain.
+    uint32_t cluster = v->root_cluster;
+    for (uint32_t hops = 0; cluster && hops < v->clusters && r == SCAN_MORE; hops++) {
+      for (uint32_t i = 0; i < v->cluster_sectors && r == SCAN_MORE; i++) {
+        if (!load(v, cluster_lba(v, cluster) + i)) return FATX_IO_ERROR;
+        r = scan_sector(v->buf, name, &ln, entry);
+      }
+      if (r == SCAN_MORE && !fat_next(v, cluster, &cluster)) return FATX_IO_ERROR;
+    }
+  }
+  return r == SCAN_FOUND ? FATX_OK : FATX_NOT_FOUND;
+}
+
+
+FATX_Status_t FATX_find(FATX_SectorRead_t read, void *ctx, const char *name, uint8_t *buf, FATX_Extent_t *ext) {
+  memset(ext, 0, sizeof(*ext));
+  Volume_t v;
+  memset(&v, 0, sizeof(v));
+  v.read = read;
+  v.ctx = ctx;
+  v.buf = buf;
+  v.buf_lba = UINT32_MAX;
+  while (*name == '/') name++;
+
+  FATX_Status_t st = mount(&v);
+  uint8_t entry[FAT_DIR_ENTRY];
+  if (st == FATX_OK) st = find_entry(&v, name, entry);
+  ext->reads = v.reads;
+  if (st != FATX_OK) {
+    return st;
+  }
+
+  uint32_t first = rd16(entry + 26) | (v.fat_bits == 32 ? (uint32_t)rd16(entry + 20) << 16 : 0);
+  ext->size = rd32(entry + 28);
+  ext->cluster_sectors = v.cluster_sectors;
+  ext->fat_bits = v.fat_bits;
+  if (ext->size == 0) {
+    return FATX_OK;
+  }
+  if (first < 2 || first >= v.clusters + 2) {
+    return FATX_FRAGMENTED;
+  }
+  ext->first_lba = cluster_lba(&v, first);
+
+  // Every link but the last to the next cluster; FAT sectors are read in order.
+  uint32_t cluster_bytes = v.cluster_sectors * FATX_SECTOR_SIZE;
+  uint32_t count = (uint32_t)(((uint64_t)ext->size + cluster_bytes - 1) / cluster_bytes);
+  if (first + count > v.clusters + 2) {
+    st = FATX_FRAGMENTED;
+  }
+  for (uint32_t i = 0; i + 1 < count && st == FATX_OK; i++) {
+    uint32_t next;
+    if (!fat_next(&v, first + i, &next)) st = FATX_IO_ERROR;
+    else if (next != first + i + 1) st = FATX_FRAGMENTED;
+  }
+  ext->reads = v.reads;
+  if (st == FATX_OK) ext->sectors = count * v.cluster_sectors;
+  return st;
+}
+
+
+const char *FATX_status_name(FATX_Status_t st) {
+  switch (st) {
+    case FATX_OK: return "ok";
+    case FATX_IO_ERROR: return "read error";
+    case FATX_NO_VOLUME: return "no FAT16/FAT32 volume";
+    case FATX_NOT_FOUND: return "not found";
+    case FATX_FRAGMENTED: return "fragmented";
+  }
+  return "?";
+}
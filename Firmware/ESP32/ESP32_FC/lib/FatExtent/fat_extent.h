@@ -0,0 +1,74 @@
+/**
+ * @file fat_extent.h
+ * @brief Card sectors of a file on a FAT16 / FAT32 volume, for raw sector writes.
+ *
+ * The logger preallocates its log file through the file system once, then
+ * writes it sector by sector straight to the card, bypassing the file system
+ * on the hot path : no cluster allocation, no FAT or directory entry update,
+ * nothing but data sectors. That is only safe if the file's clusters are
+ * consecutive, so the file maps to one range of card sectors. FATX_find()
+ * reads the volume the way FatFs does and returns that range :
+ *
+ * - Sector 0 is the volume boot sector (superfloppy), or an MBR whose first
+ *   FAT16 / FAT32 partition holds the volume (SD cards come formatted so).
+ * - The file is looked up in the root directory, by long (ASCII) or 8.3
+ *   name, case insensitive.
+ * - Its cluster chain is followed through the first FAT; every link must be
+ *   to the next cluster, or the file is FATX_FRAGMENTED.
+ *
+ * Reads one sector at a time through a callback into a caller buffer,
+ * skipping a read of the sector already in it. Following the chain of a
+ * 1 GB file with 32 KB clusters reads 256 FAT sectors.
+ *
+ * The file stays a normal file : a PC reads it through the FAT like any
+ * other. Its size and modification time are those of the preallocation.
+ * exFAT (SDXC cards as formatted, > 32 GB) is not supported.
+ *
+ * This file has no Arduino dependencies so it can be built into host tools.
+ */
+
+#ifndef FAT_EXTENT_H
+#define FAT_EXTENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+
+#define FATX_SECTOR_SIZE 512
+
+typedef enum {
+  FATX_OK = 0,
+  FATX_IO_ERROR,              // A sector read failed
+  FATX_NO_VOLUME,             // No FAT16 / FAT32 volume (unformatted, exFAT, FAT12)
+  FATX_NOT_FOUND,             // No such file in the root directory
+  FATX_FRAGMENTED,            // The file's clusters are not consecutive
+} FATX_Status_t;
+
+// Reads card sector lba (FATX_SECTOR_SIZE bytes) into buf.
+typedef bool (*FATX_SectorRead_t)(void *ctx, uint32_t lba, uint8_t *buf);
+
+typedef struct {
+  uint32_t first_lba;         // Card sector of file offset 0
+  uint32_t sectors;           // Sectors of the file's clusters, from first_lba on
+  uint32_t size;              // Bytes, from the directory entry
+  uint32_t cluster_sectors;
+  uint8_t fat_bits;           // 16 or 32
+  uint32_t reads;             // Sectors read to find all this
+} FATX_Extent_t;
+
+
+/**
+ * @brief Find a file in the root directory and check it is one run of sectors.
+ * @param[in] name File name, a leading '/' is ignored.
+ * @param buf Scratch buffer of FATX_SECTOR_SIZE bytes.
+ * @param[out] ext Filled on FATX_OK; on FATX_FRAGMENTED all but sectors.
+ */
+FATX_Status_t FATX_find(FATX_SectorRead_t read, void *ctx, const char *name, uint8_t *buf, FATX_Extent_t *ext);
+
+/**
+ * @brief Short name of a status, for messages.
+ */
+const char *FATX_status_name(FATX_Status_t st);
+
+#endif /* FAT_EXTENT_H */
@@ -0,0 +1,145 @@
+/**
+ * @file fec.cpp
+ * @brief Packet erasure code : repair symbols over a group of K data symbols, any K of K + M rebuild it.
+ */
+
+#include <string.h>
+#include "fec.h"
+
+
+#define GF_POLY 0x11D
+
+
+static uint8_t GfExp[512];            // Twice over, so a sum of two logs needs no modulo
+static uint8_t GfLog[256];
+
+
+void FEC_init_tables() {
+  uint32_t x = 1;
+  for (int i = 0; i < 255; i++) {
+    GfExp[i] = (uint8_t)x;
+    GfExp[i + 255] = (uint8_t)x;
+    GfLog[x] = (uint8_t)i;
+    x <<= 1;
+    if (x & 0x100) x ^= GF_POLY;
+  }
+  GfExp[510] = GfExp[0];
+  GfExp[511] = GfExp[1];
+  GfLog[0] = 0;                       // Never used : 0 is handled before any look up
+}
+
+
+static uint8_t gf_mul(uint8_t a, uint8_t b) {
+  return (a && b) ? GfExp[GfLog[a] + GfLog[b]] : 0;
+}
+
+
+static uint8_t gf_inv(uint8_t a) {
+  return GfExp[255 - GfLog[a]];
+}
+
+
+uint8_t FEC_coefficient(uint8_t row, uint8_t i) {
+  uint8_t y = (uint8_t)(FEC_MAX_M + i);
+  // (1 / (row + y)) / (1 / (0 + y)) : row 0 all ones.
+  return gf_mul(gf_inv((uint8_t)(row ^ y)), y);
+}
+
+
+// out += c * in, over len bytes.
+static void add_scaled(uint8_t *out, const uint8_t *in, uint8_t c, size_t len) {
+  if (c == 0) {
+    return;
+  }
+  if (c == 1) {
+    for (size_t b = 0; b < len; b++) out[b] ^= in[b];
+    return;
+  }
+  const uint8_t *exp = GfExp + GfLog[c];
+  for (size_t b = 0; b < len; b++) {
+    if (in[b]) out[b] ^= exp[GfLog[in[b]]];
+  }
+}
+
+
+void FEC_encode(const uint8_t *const data[], uint8_t k, size_t len, uint8_t row, uint8_t *repair) {
+  memset(repair, 0, len);
+  for (uint8_t i = 0; i < k; i++) {
+    add_scaled(repair, data[i], FEC_coefficient(row, i), len);
+  }
+}
+
+
+bool FEC_decode(uint8_t *const data[], uint32_t have, uint8_t k, const uint8_t *const repair[],
+                const uint8_t rows[], uint8_t r, size_t len) {
+  if (len > FEC_MAX_SYMBOL) {
+    return false;
+  }
+  uint8_t lost[FEC_MAX_M];
+  uint8_t e = 0;
+  for (uint8_t i = 0; i < k; i++) {
+    if (have & (1UL << i)) continue;
+    if (e == r || e == FEC_MAX_M) {
+      return false;
+    }
+    lost[e++] = i;
+  }
+  if (e == 0) {
+    return true;
+  }
+
+  // What the lost symbols add up to in each of the first e repairs : the repair minus the symbols received.
+  static_assert(FEC_MAX_M * FEC_MAX_SYMBOL <= 256, "decode scratch on the stack");
+  uint8_t s[FEC_MAX_M][FEC_MAX_SYMBOL];
+  for (uint8_t n = 0; n < e; n++) {
+    memcpy(s[n], repair[n], len);
+    for (uint8_t i = 0; i < k; i++) {
+      if (have & (1UL << i)) add_scaled(s[n], data[i], FEC_coefficient(rows[n], i), len);
+    }
+  }
+
+  // Invert the e x e block of the lost columns, Gauss-Jordan.
+  uint8_t a[FEC_MAX_M][FEC_MAX_M];
+  uint8_t inv[FEC_MAX_M][FEC_MAX_M];
+  for (uint8_t n = 0; n < e; n++) {
+    for (uint8_t m = 0; m < e; m++) {
+      a[n][m] = FEC_coefficient(rows[n], lost[m]);
+      inv[n][m] = n == m;
+    }
+  }
+  for (uint8_t c = 0; c < e; c++) {
+    uint8_t p = c;
+    while (p < e && a[p][c] == 0) p++;
+    if (p == e) {
+      return false;                   // Only with two repairs of the same row
+    }
+    if (p != c) {
+      for (uint8_t m = 0; m < e; m++) {
+        uint8_t t = a[c][m]; a[c][m] = a[p][m]; a[p][m] = t;
+        t = inv[c][m]; inv[c][m] = inv[p][m]; inv[p][m] = t;
+      }
+    }
+    uint8_t scale = gf_inv(a[c][c]);
+    for (uint8_t m = 0; m < e; m++) {
+      a[c][m] = gf_mul(a[c][m], scale);
+      inv[c][m] = gf_mul(inv[c][m], scale);
+    }
+    for (uint8_t n = 0; n < e; n++) {
+      uint8_t f = a[n][c];
+      if (n == c || f == 0) continue;
+      for (uint8_t m = 0; m < e; m++) {
+        a[n][m] ^= gf_mul(f, a[c][m]);
+        inv[n][m] ^= gf_mul(f, inv[c][m]);
+      }
+    }
+  }
+
+  for (uint8_t m = 0; m < e; m++) {
+    uint8_t *out = data[lost[m]];
+    memset(out, 0, len);
+    for (uint8_t n = 0; n < e; n++) {
+      add_scaled(out, s[n], inv[m][n], len);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file fec.h
+ * @brief Packet erasure code : repair symbols over a group of K data symbols, any K of K + M rebuild it.
+ *
+ * A group is K data symbols of the same length (shorter packets padded with
+ * zeros). Repair symbol j is a sum over GF(2^8) of the data symbols, each
+ * byte i scaled by a coefficient c(j, i) :
+ *
+ *  repair_j = c(j, 0) d_0 + c(j, 1) d_1 + ... + c(j, K-1) d_(K-1)
+ *
+ * The coefficients are a Cauchy matrix, 1 / (x_j + y_i) with x_j = j and
+ * y_i = FEC_MAX_M + i, each column scaled so row 0 is all ones : repair 0
+ * is the XOR of the data (plain parity, and the cheap case), the rows after
+ * it Reed-Solomon. Every square block of a Cauchy matrix is invertible and
+ * scaling columns keeps that, so any e repairs rebuild any e lost data
+ * symbols : the code is MDS, K of the K + M symbols always do.
+ *
+ * Rows and columns are fixed by their index, not by K and M : the first M
+ * rows of a group of K are the same whatever the M, and a receiver only
+ * needs K, the row of each repair and the symbol length.
+ *
+ * GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11D),
+ * multiplication through log / exp tables (768 bytes, FEC_init_tables()).
+ * Encoding a repair costs K table look ups per byte (XOR only for row 0);
+ * decoding e lost symbols inverts an e x e matrix then costs about
+ * (K + e) e look ups per byte.
+ *
+ * This file has no Arduino dependencies so it can be built into host tools.
+ */
+
+#ifndef FEC_H
+#define FEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+
+#define FEC_MAX_K 16                  // Data symbols per group
+#define FEC_MAX_M 4                   // Repair symbols per group
+#define FEC_MAX_SYMBOL 64             // Bytes per symbol
+
+
+/**
+ * @brief Build the GF(2^8) tables. Must be called once before any encode or decode.
+ */
+void FEC_init_tables();
+
+/**
+ * @brief Coefficient of data symbol i in repair row j.
+ */
+uint8_t FEC_coefficient(uint8_t row, uint8_t i);
+
+/**
+ * @brief Repair symbol row of a group.
+ * @param[in] data k data symbols of len bytes, k <= FEC_MAX_K.
+ * @param[in] row 0 .. FEC_MAX_M - 1, 0 : XOR parity.
+ * @param[out] repair len bytes.
+ */
+void FEC_encode(const uint8_t *const data[], uint8_t k, size_t len, uint8_t row, uint8_t *repair);
+
+/**
+ * @brief Rebuild the data symbols a group lost from its repairs.
+ * @param[in,out] data k data symbols of len bytes, len <= FEC_MAX_SYMBOL. Those with their bit of have clear are written.
+ * @param[in] have Bit i set : data[i] received.
+ * @param[in] repair r repair symbols received, rows[n] the row of repair[n], all different.
+ * @return false if fewer repairs than lost symbols or len too long (nothing written).
+ */
+bool FEC_decode(uint8_t *const data[], uint32_t have, uint8_t k, const uint8_t *const repair[],
+                const uint8_t rows[], uint8_t r, size_t len);
+
+#endif /* FEC_H */
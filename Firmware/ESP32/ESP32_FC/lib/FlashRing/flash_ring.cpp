@@ -0,0 +1,203 @@
+/**
+ * @file flash_ring.cpp
+ * @brief Append only flight log on a raw flash partition, a ring of erase sectors.
+ */
+
+#include <string.h>
+#include "flash_ring.h"
+
+
+#define GENERATIONS_TRACKED 4         // Distinct generations counted by the boot scan
+
+
+// Erased flash reads all ones. Checked in small reads, the slot buffer may hold staged records.
+static bool sector_blank(FRING_t *r, uint32_t sector, bool *blank) {
+  uint32_t words[64];
+  for (uint32_t at = 0; at < FRING_SECTOR_SIZE; at += sizeof(words)) {
+    if (!r->io.read(r->io.ctx, sector * FRING_SECTOR_SIZE + at, words, sizeof(words))) {
+      return false;
+    }
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+      if (words[i] != 0xFFFFFFFFu) {
+        *blank = false;
+        return true;
+      }
+    }
+  }
+  *blank = true;
+  return true;
+}
+
+
+// A blank sector is left as it is : an erase costs a cycle of its endurance.
+static bool erase_sector(FRING_t *r, uint32_t sector) {
+  bool blank;
+  if (!sector_blank(r, sector, &blank)) {
+    return false;
+  }
+  if (blank) {
+    return true;
+  }
+  if (!r->io.erase(r->io.ctx, sector * FRING_SECTOR_SIZE, FRING_SECTOR_SIZE)) {
+    return false;
+  }
+  r->erases++;
+  return true;
+}
+
+
+bool FRING_open(FRING_t *r, const FRING_Io_t *io, uint32_t generation, FRING_Recovery_t *rec) {
+  memset(r, 0, sizeof(*r));
+  memset(rec, 0, sizeof(*rec));
+  r->io = *io;
+  r->slots = io->size / FRING_SECTOR_SIZE;
+  if (r->slots < 2) {
+    return false;
+  }
+
+  // Newest valid slot, and how many valid slots each generation has.
+  bool found = false;
+  LOG_Commit_t newest = {};
+  uint32_t gens[GENERATIONS_TRACKED], counts[GENERATIONS_TRACKED];
+  size_t n_gens = 0;
+  for (uint32_t s = 0; s < r->slots; s++) {
+    LOG_Commit_t c;
+    if (!r->io.read(r->io.ctx, s * FRING_SECTOR_SIZE, r->slot, LOG_SLOT_SIZE)) {
+      return false;
+    }
+    if (!LOG_slot_check(r->slot, &c) || c.seq % r->slots != s) {
+      continue;
+    }
+    if (!found || c.seq > newest.seq) {
+      newest = c;
+      found = true;
+    }
+    size_t g = 0;
+    while (g < n_gens && gens[g] != c.generation) g++;
+    if (g == n_gens && n_gens < GENERATIONS_TRACKED) {
+      gens[n_gens] = c.generation;
+      counts[n_gens++] = 0;
+    }
+    if (g < n_gens) counts[g]++;
+  }
+
+  // Seq is contiguous up to the newest : a torn slot is written again with its own seq.
+  if (found) {
+    uint32_t count = 1;
+    for (size_t g = 0; g < n_gens; g++) {
+      if (gens[g] == newest.generation) count = counts[g];
+    }
+    r->generation = newest.generation;
+    r->session = newest.session + 1;
+    r->next = newest.seq + 1;
+    r->first = r->next - count;
+    rec->slots = count;
+    rec->first = r->first;
+    rec->last_session = newest.session;
+  } else {
+    r->generation = generation;
+    r->session = 1;
+  }
+
+  // Runway left by the last session. A torn slot at the head is not blank : it is erased first.
+  while (r->erased < r->slots) {
+    bool blank;
+    if (!sector_blank(r, (r->next + r->erased) % r->slots, &blank)) {
+      return false;
+    }
+    if (!blank) break;
+    r->erased++;
+  }
+  rec->erased = r->erased;
+  r->used = 0;
+  return true;
+}
+
+
+bool FRING_fits(const FRING_t *r, uint16_t len) {
+  return LOG_slot_fits(r->used, len);
+}
+
+
+bool FRING_service(FRING_t *r, uint32_t ahead) {
+  if (ahead > r->slots) {
+    ahead = r->slots;
+  }
+  if (r->erased >= ahead) {
+    return false;
+  }
+  if (!erase_sector(r, (r->next + r->erased) % r->slots)) {
+    return false;
+  }
+  r->erased++;
+
+  // The sector held the oldest slot.
+  uint32_t end = r->next + r->erased;
+  if (end > r->slots && r->first < end - r->slots) {
+    r->first = end - r->slots;
+  }
+  return true;
+}
+
+
+bool FRING_commit(FRING_t *r) {
+  if (r->used == 0) {
+    return true;
+  }
+  LOG_Commit_t c;
+  c.magic = LOG_JOURNAL_MAGIC;
+  c.generation = r->generation;
+  c.session = r->session;
+  c.seq = r->next;
+  LOG_slot_close(r->slot, r->used, &c);
+  r->used = 0;
+
+  if (r->erased == 0) {
+    r->stalls++;
+    if (!FRING_service(r, 1)) {
+      r->write_errors++;
+      return false;
+    }
+  }
+  // A failed program leaves the sector dirty : erased again for the next slot, same seq.
+  if (!r->io.write(r->io.ctx, (r->next % r->slots) * FRING_SECTOR_SIZE, r->slot, LOG_SLOT_SIZE)) {
+    r->write_errors++;
+    r->erased = 0;
+    return false;
+  }
+  r->next++;
+  r->erased--;
+  return true;
+}
+
+
+bool FRING_append(FRING_t *r, uint8_t type, uint64_t t_us, const void *payload, uint16_t len) {
+  if (!LOG_slot_fits(0, len)) {
+    return false;
+  }
+  if (!FRING_fits(r, len)) {
+    FRING_commit(r);
+  }
+  r->used += LOG_encode(r->slot + r->used, type, t_us, payload, len);
+  return true;
+}
+
+
+bool FRING_append_block(FRING_t *r, const uint8_t *records, size_t n) {
+  if (r->used != 0 || n > LOG_SLOT_DATA_SIZE) {
+    return false;
+  }
+  memcpy(r->slot, records, n);
+  r->used = n;
+  return true;
+}
+
+
+bool FRING_read(FRING_t *r, uint32_t seq, uint8_t *buf) {
+  if (seq < r->first || seq >= r->next) {
+    return false;
+  }
+  LOG_Commit_t c;
+  return r->io.read(r->io.ctx, (seq % r->slots) * FRING_SECTOR_SIZE, buf, LOG_SLOT_SIZE) &&
+         LOG_slot_check(buf, &c) && c.seq == seq && c.generation == r->generation;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file flash_ring.h
+ * @brief Append only flight log on a raw flash partition, a ring of erase sectors.
+ *
+ * The same slots as the SD journal (lib/FlightLog, "Journal slots") : records
+ * staged into a LOG_SLOT_SIZE slot, padded and closed with a COMMIT record,
+ * written whole. A slot is one 4 KB flash erase sector. The ring never fills :
+ * once it wraps, each slot written takes the sector of the oldest one.
+ *
+ * Slots carry a sequence number that keeps counting across laps, slot seq
+ * lives in sector seq % slots. A slot is valid when its COMMIT checks, its
+ * seq falls in its own sector and its generation is that of the newest slot.
+ * At boot FRING_open() reads every sector once (a linear scan, ~0.3 s for a
+ * 12 MB partition) for the newest and oldest valid seq and appends after the
+ * newest in a new session. Then it counts the sectors already erased ahead.
+ *
+ * Flash wants a sector erased (~45 ms, up to 400 ms) before it is programmed
+ * (16 pages, ~6 ms). Sectors are erased ahead of the writes : FRING_service()
+ * erases one when fewer than the runway asked for are ready, FRING_commit()
+ * then only programs. A commit that finds no erased sector erases first and
+ * counts a stall. Wear :
+ *
+ * - The ring goes on from its head across boots, so every sector is erased
+ *   once per lap, none more often than the others.
+ * - A sector is read before it is erased; a blank one is not erased again.
+ * - Erasing ahead takes the oldest slots only as far as the runway asks.
+ *
+ * A power cut while programming tears that slot only (its CRC fails), one
+ * while erasing leaves a half erased sector; either is erased again before
+ * it is written. A dump of the partition is read back in order with
+ * FRING_read() (Tools/flash_ring turns it into a journal file for the host
+ * tools).
+ *
+ * The flash is reached through FRING_Io_t callbacks (esp_partition on the
+ * flight computer, a mock flash in the host tools). This file has no Arduino
+ * dependencies so it can be built into host tools.
+ */
+
+#ifndef FLASH_RING_H
+#define FLASH_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "flight_log.h"
+
+
+#define FRING_SECTOR_SIZE 4096        // Flash erase sector, one slot
+
+typedef struct {
+  bool (*read)(void *ctx, uint32_t offset, void *buf, size_t n);
+  bool (*write)(void *ctx, uint32_t offset, const void *buf, size_t n);  // Programs erased bytes
+  bool (*erase)(void *ctx, uint32_t offset, size_t n);                   // Whole sectors
+  void *ctx;
+  uint32_t size;              // Bytes of the partition
+} FRING_Io_t;
+
+typedef struct {
+  uint32_t slots;             // Valid slots found, 0 for a new ring
+  uint32_t first;             // Oldest valid seq
+  uint32_t erased;            // Sectors found erased ahead of the head
+  uint32_t last_session;      // Session of the newest slot, 0 for a new ring
+} FRING_Recovery_t;
+
+typedef struct {
+  FRING_Io_t io;
+  uint32_t slots;             // Sectors of the ring
+  uint32_t generation;
+  uint32_t session;
+  uint32_t next;              // Seq of the slot being staged, it goes to sector next % slots
+  uint32_t first;             // Oldest seq still in the ring
+  uint32_t erased;            // Erased sectors from next % slots on
+  uint8_t slot[LOG_SLOT_SIZE];
+  size_t used;                // Record bytes staged
+  uint32_t write_errors;      // Slots whose program or erase failed (their records are lost)
+  uint32_t erases;            // Sectors erased since boot
+  uint32_t stalls;            // Commits that had to erase their sector first
+} FRING_t;
+
+
+/**
+ * @brief Recover the ring from the partition, or start a new one.
+ * @param[in] generation Used only if no valid slot is found.
+ * @return false if the partition holds no slot or a read fails.
+ */
+bool FRING_open(FRING_t *r, const FRING_Io_t *io, uint32_t generation, FRING_Recovery_t *rec);
+
+/**
+ * @brief Stage a record; a full slot is committed first.
+ * @return false if the payload can never fit a slot.
+ */
+bool FRING_append(FRING_t *r, uint8_t type, uint64_t t_us, const void *payload, uint16_t len);
+
+/**
+ * @brief True if a record with a len byte payload fits the staged slot.
+ */
+bool FRING_fits(const FRING_t *r, uint16_t len);
+
+/**
+ * @brief Stage n bytes of records encoded elsewhere (a lib/LogSink block) as a whole slot.
+ * @return false if a slot is already staged or n is more than a slot holds.
+ */
+bool FRING_append_block(FRING_t *r, const uint8_t *records, size_t n);
+
+/**
+ * @brief Close the staged slot and program it, erasing its sector first if needed.
+ * @return false if the slot could not be written (counted in write_errors).
+ */
+bool FRING_commit(FRING_t *r);
+
+/**
+ * @brief Erase the next sector ahead if fewer than ahead sectors are ready.
+ * @return true if a sector was erased (or found blank and counted as erased).
+ */
+bool FRING_service(FRING_t *r, uint32_t ahead);
+
+/**
+ * @brief Read committed slot seq (first <= seq < next) and check it.
+ */
+bool FRING_read(FRING_t *r, uint32_t seq, uint8_t *buf);
+
+#endif /* FLASH_RING_H */
@@ -0,0 +1,369 @@
+/**
+ * @file flight_log.cpp
+ * @brief Record framing for the flight computer log.
+ */
+
+#include <string.h>
+#include "flight_log.h"
+
+
+void LOG_checksum(const uint8_t *data, size_t len, uint8_t *ck_a, uint8_t *ck_b) {
+  uint8_t a = 0, b = 0;
+  for (size_t i = 0; i < len; i++) {
+    a += data[i];
+    b += a;
+  }
+  *ck_a = a;
+  *ck_b = b;
+}
+
+
+size_t LOG_encode(uint8_t *out, uint8_t type, uint64_t t_us, const void *payload, uint16_t len) {
+  out[0] = LOG_SYNC;
+  out[1] = type;
+  out[2] = (uint8_t)(len & 0xFF);
+  out[3] = (uint8_t)(len >> 8);
+  memcpy(out + 4, &t_us, sizeof(t_us));
+  memcpy(out + LOG_HEADER_SIZE, payload, len);
+  LOG_checksum(out + 1, LOG_HEADER_SIZE - 1 + len, &out[LOG_HEADER_SIZE + len], &out[LOG_HEADER_SIZE + len + 1]);
+  return LOG_OVERHEAD + len;
+}
+
+
+LOG_Status_t LOG_decode(const uint8_t *buf, size_t avail, LOG_Record_t *rec) {
+  if (avail < 1) {
+    return LOG_NEED_MORE;
+  }
+  if (buf[0] != LOG_SYNC) {
+    return LOG_BAD_RECORD;
+  }
+  if (avail < LOG_HEADER_SIZE) {
+    return LOG_NEED_MORE;
+  }
+
+  uint16_t len = (uint16_t)(buf[2] | (buf[3] << 8));
+  if (len > LOG_MAX_PAYLOAD) {
+    return LOG_BAD_RECORD;
+  }
+  if (avail < (size_t)LOG_OVERHEAD + len) {
+    return LOG_NEED_MORE;
+  }
+
+  uint8_t ck_a, ck_b;
+  LOG_checksum(buf + 1, LOG_HEADER_SIZE - 1 + len, &ck_a, &ck_b);
+  if (ck_a != buf[LOG_HEADER_SIZE + len] || ck_b != buf[LOG_HEADER_SIZE + len + 1]) {
+    return LOG_BAD_RECORD;
+  }
+
+  rec->type = buf[1];
+  rec->len = len;
+  memcpy(&rec->t_us, buf + 4, sizeof(rec->t_us));
+  rec->payload = buf + LOG_HEADER_SIZE;
+  rec->size = LOG_OVERHEAD + len;
+  return LOG_OK;
+}
+
+
+void LOG_index_add(LOG_IndexBlock_t *block, uint8_t type, uint64_t t_us, const void *payload) {
+  if (!block->has_t && (type == LOG_REC_ACCEL || type == LOG_REC_ACCEL_PACK || type == LOG_REC_BARO)) {
+    block->t_us = t_us;
+    block->has_t = true;
+  }
+  if (type == LOG_REC_EVENT) {
+    uint8_t id = ((const LOG_Event_t *)payload)->id;
+    if (id >= 1 && id <= 8) block->events |= (uint8_t)(1u << (id - 1));
+  }
+  block->records++;
+}
+
+
+void LOG_index_close(LOG_IndexBlock_t *block, uint32_t offset, LOG_IndexEntry_t *entry) {
+  entry->t_us = block->has_t ? block->t_us : 0;
+  entry->offset = offset;
+  entry->records = block->records;
+  entry->events = block->events;
+  uint8_t ck_a;
+  LOG_checksum((const uint8_t *)entry, sizeof(*entry) - 1, &ck_a, &entry->check);
+  block->t_us = 0;
+  block->records = 0;
+  block->has_t = false;
+}
+
+
+bool LOG_index_valid(const LOG_IndexEntry_t *entry) {
+  uint8_t ck_a, ck_b;
+  LOG_checksum((const uint8_t *)entry, sizeof(*entry) - 1, &ck_a, &ck_b);
+  return ck_b == entry->check;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Journal slots
+//--------------------------------------------------------------------------------------------
+uint32_t LOG_crc32(uint32_t crc, const uint8_t *data, size_t len) {
+  static uint32_t table[256];
+  static bool table_ready = false;
+  if (!table_ready) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+    table_ready = true;
+  }
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+
+bool LOG_slot_fits(size_t used, uint16_t len) {
+  size_t end = used + LOG_OVERHEAD + len;
+  return end == LOG_SLOT_DATA_SIZE || end + LOG_OVERHEAD <= LOG_SLOT_DATA_SIZE;
+}
+
+
+void LOG_slot_close(uint8_t *slot, size_t used, const LOG_Commit_t *commit) {
+  static const uint8_t zeros[LOG_MAX_PAYLOAD] = { 0 };
+
+  // PAD records up to the COMMIT, none leaving a gap too short for a header.
+  size_t pos = used;
+  while (pos < LOG_SLOT_DATA_SIZE) {
+    size_t gap = LOG_SLOT_DATA_SIZE - pos;
+    size_t len = gap - LOG_OVERHEAD;
+    if (len > LOG_MAX_PAYLOAD) {
+      len = LOG_MAX_PAYLOAD;
+      size_t rest = gap - (LOG_OVERHEAD + len);
+      if (rest > 0 && rest < LOG_OVERHEAD) len -= LOG_OVERHEAD;
+    }
+    pos += LOG_encode(slot + pos, LOG_REC_PAD, 0, zeros, (uint16_t)len);
+  }
+
+  LOG_Commit_t c = *commit;
+  c.used = (uint16_t)used;
+  c.crc = 0;
+  LOG_encode(slot + pos, LOG_REC_COMMIT, 0, &c, sizeof(c));
+  // CRC of everything before the crc field, then the record checksum again.
+  size_t crc_at = pos + LOG_HEADER_SIZE + offsetof(LOG_Commit_t, crc);
+  c.crc = LOG_crc32(0, slot, crc_at);
+  LOG_encode(slot + pos, LOG_REC_COMMIT, 0, &c, sizeof(c));
+}
+
+
+bool LOG_slot_check(const uint8_t *slot, LOG_Commit_t *commit) {
+  LOG_Record_t rec;
+  if (LOG_decode(slot + LOG_SLOT_DATA_SIZE, LOG_COMMIT_RECORD_SIZE, &rec) != LOG_OK ||
+      rec.type != LOG_REC_COMMIT || rec.len != sizeof(LOG_Commit_t)) {
+    return false;
+  }
+  memcpy(commit, rec.payload, sizeof(*commit));
+  size_t crc_at = LOG_SLOT_DATA_SIZE + LOG_HEADER_SIZE + offsetof(LOG_Commit_t, crc);
+  return commit->magic == LOG_JOURNAL_MAGIC && commit->used <= LOG_SLOT_DATA_SIZE &&
+         LOG_crc32(0, slot, crc_at) == commit->crc;
+}
+
+
+uint32_t LOG_journal_scan(LOG_SlotRead_t read, void *ctx, uint32_t slots, uint8_t *buf, LOG_Commit_t *last,
+                          uint32_t *reads) {
+  uint32_t n_reads = 0;
+  LOG_Commit_t c;
+  uint32_t valid = 0;
+  if (slots > 0) {
+    n_reads++;
+    if (read(ctx, 0, buf) && LOG_slot_check(buf, &c) && c.seq == 0) {
+      *last = c;
+      valid = 1;
+    }
+  }
+  if (valid) {
+    // Invariant : slot lo - 1 valid, slot hi invalid (or past the end).
+    uint32_t generation = c.generation;
+    uint32_t lo = 1, hi = slots;
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      n_reads++;
+      if (read(ctx, mid, buf) && LOG_slot_check(buf, &c) && c.seq == mid && c.generation == generation) {
+        *last = c;
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    valid = lo;                 // The last probe that passed was slot lo - 1
+  }
+  if (reads) *reads = n_reads;
+  return valid;
+}
+
+
+bool LOG_index_slot(LOG_IndexBlock_t *block, const uint8_t *slot, uint32_t offset, LOG_IndexEntry_t *entry) {
+  LOG_Commit_t c;
+  if (!LOG_slot_check(slot, &c)) {
+    return false;
+  }
+  for (size_t pos = 0; pos < c.used;) {
+    LOG_Record_t rec;
+    if (LOG_decode(slot + pos, c.used - pos, &rec) != LOG_OK) {
+      return false;
+    }
+    LOG_index_add(block, rec.type, rec.t_us, rec.payload);
+    pos += rec.size;
+  }
+  LOG_index_close(block, offset, entry);
+  return true;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Packed ACCEL blocks
+//--------------------------------------------------------------------------------------------
+static_assert(LOG_ACCEL_PACK_MAX <= LOG_MAX_PAYLOAD, "a packed block must fit a record");
+
+bool LOG_accel_pack_add(LOG_AccelPack_t *p, uint64_t t_us, const LOG_Accel_t *acc) {
+  if (p->count == LOG_ACCEL_PACK_SAMPLES) {
+    return false;
+  }
+  if (p->count == 1) {
+    int64_t dt = (int64_t)(t_us - p->t_us[0]);
+    if (dt < 0 || dt > UINT16_MAX) return false;
+    p->period_us = (uint16_t)dt;
+  } else if (p->count > 1) {
+    int64_t r = (int64_t)(t_us - p->t_us[p->count - 1]) - p->period_us;
+    if (r < -LOG_ACCEL_PACK_SLACK_US || r > LOG_ACCEL_PACK_SLACK_US) return false;
+  }
+  p->t_us[p->count] = t_us;
+  p->acc[p->count] = *acc;
+  p->count++;
+  return true;
+}
+
+
+typedef struct {
+  uint8_t *out;
+  uint32_t bits;              // Waiting in acc, fewer than 8 between calls
+  uint32_t acc;
+} BitWriter_t;
+
+
+static inline void put_bits(BitWriter_t *w, uint32_t v, uint32_t n) {
+  if (n == 0) return;
+  w->acc |= v << w->bits;    // n <= 17 and bits < 8 : fits 32 bits
+  w->bits += n;
+  while (w->bits >= 8) {
+    *w->out++ = (uint8_t)w->acc;
+    w->acc >>= 8;
+    w->bits -= 8;
+  }
+}
+
+
+static inline uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+
+static inline uint32_t bit_width(uint32_t v) {
+  return v ? 32 - (uint32_t)__builtin_clz(v) : 0;
+}
+
+
+uint16_t LOG_accel_pack_close(LOG_AccelPack_t *p, uint8_t *out, uint64_t *t_us) {
+  if (p->count == 0) {
+    return 0;
+  }
+  *t_us = p->t_us[0];
+  out[0] = p->count;
+  out[1] = (uint8_t)p->period_us;
+  out[2] = (uint8_t)(p->period_us >> 8);
+  memcpy(out + 3, &p->acc[0], sizeof(LOG_Accel_t));
+
+  BitWriter_t w = { out + LOG_ACCEL_PACK_HEADER, 0, 0 };
+  uint32_t v[LOG_ACCEL_PACK_GROUP][4];
+  for (int g = 1; g < p->count; g += LOG_ACCEL_PACK_GROUP) {
+    int n = p->count - g < LOG_ACCEL_PACK_GROUP ? p->count - g : LOG_ACCEL_PACK_GROUP;
+    uint32_t any[4] = { 0, 0, 0, 0 };
+    for (int k = 0; k < n; k++) {
+      int i = g + k;
+      v[k][0] = zigzag((int32_t)(p->t_us[i] - p->t_us[i - 1]) - p->period_us);
+      for (int a = 0; a < 3; a++) {
+        v[k][a + 1] = zigzag((int32_t)p->acc[i].acc_raw[a] - p->acc[i - 1].acc_raw[a]);
+      }
+      for (int c = 0; c < 4; c++) any[c] |= v[k][c];
+    }
+    uint32_t width[4];
+    for (int c = 0; c < 4; c++) {
+      width[c] = bit_width(any[c]);
+      put_bits(&w, width[c], 5);
+    }
+    for (int k = 0; k < n; k++) {
+      for (int c = 0; c < 4; c++) put_bits(&w, v[k][c], width[c]);
+    }
+  }
+  if (w.bits) *w.out++ = (uint8_t)w.acc;
+  p->count = 0;
+  return (uint16_t)(w.out - out);
+}
+
+
+typedef struct {
+  const uint8_t *in, *end;
+  uint32_t bits;
+  uint32_t acc;
+  bool overrun;
+} BitReader_t;
+
+
+static inline uint32_t get_bits(BitReader_t *r, uint32_t n) {
+  while (r->bits < n) {
+    if (r->in == r->end) {
+      r->overrun = true;
+      return 0;
+    }
+    r->acc |= (uint32_t)*r->in++ << r->bits;
+    r->bits += 8;
+  }
+  uint32_t v = r->acc & ((1u << n) - 1);   // n <= 17
+  r->acc >>= n;
+  r->bits -= n;
+  return v;
+}
+
+
+static inline int32_t unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+
+int LOG_accel_unpack(const uint8_t *payload, uint16_t len, uint64_t t_us, uint64_t *t_out, LOG_Accel_t *acc_out) {
+  if (len < LOG_ACCEL_PACK_HEADER || payload[0] == 0 || payload[0] > LOG_ACCEL_PACK_SAMPLES) {
+    return -1;
+  }
+  int count = payload[0];
+  uint16_t period = (uint16_t)(payload[1] | payload[2] << 8);
+  t_out[0] = t_us;
+  memcpy(&acc_out[0], payload + 3, sizeof(LOG_Accel_t));
+
+  BitReader_t r = { payload + LOG_ACCEL_PACK_HEADER, payload + len, 0, 0, false };
+  for (int g = 1; g < count; g += LOG_ACCEL_PACK_GROUP) {
+    int n = count - g < LOG_ACCEL_PACK_GROUP ? count - g : LOG_ACCEL_PACK_GROUP;
+    uint32_t width[4];
+    for (int c = 0; c < 4; c++) {
+      width[c] = get_bits(&r, 5);
+      if (width[c] > (c == 0 ? 16u : 17u)) return -1;
+    }
+    for (int k = 0; k < n; k++) {
+      int i = g + k;
+      t_out[i] = t_out[i - 1] + period + unzigzag(get_bits(&r, width[0]));
+      for (int a = 0; a < 3; a++) {
+        acc_out[i].acc_raw[a] = (int16_t)(acc_out[i - 1].acc_raw[a] + unzigzag(get_bits(&r, width[a + 1])));
+      }
+    }
+  }
+  // Every byte used, the last one only in part
+  if (r.overrun || r.in != r.end) {
+    return -1;
+  }
+  return count;
+}
@@ -0,0 +1,455 @@
+/**
+ * @file flight_log.h
+ * @brief Record format of the flight computer log.
+ *
+ * The log is a stream of self-describing records, so new kinds of data
+ * (filter state, events) can be added without breaking older decoders :
+ *
+ *  |-----------------------------------------------------------------------------------|
+ *  | SYNC (0xA5) | TYPE | LEN (u16) | T_US (u64) | ~ payload (LEN bytes) ~ | CK_A | CK_B |
+ *  |-----------------------------------------------------------------------------------|
+ *
+ * - T_US : esp_timer microseconds since boot when the data was sampled. Each
+ *   sensor has its own record type so every sample carries its own time.
+ * - CK_A, CK_B : 8-bit Fletcher checksum over TYPE, LEN, T_US and payload, same
+ *   algorithm as the UBX protocol used for the GPS.
+ * - All multi-byte fields are little endian (native on ESP32 and x86).
+ *
+ * A reader that hits a bad checksum skips one byte and searches for the next
+ * SYNC, so a corrupted record only loses itself.
+ *
+ * Written through lib/LogJournal, the stream is cut in LOG_SLOT_SIZE slots,
+ * each ending in a COMMIT record (see "Journal slots"), so the last complete
+ * write can be found after a power loss. Readers that do not know the slots
+ * still read the records in them.
+ *
+ * This file has no Arduino dependencies so it can be built into host tools.
+ */
+
+#ifndef FLIGHT_LOG_H
+#define FLIGHT_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+
+#define LOG_SYNC 0xA5
+#define LOG_HEADER_SIZE 12            // SYNC, TYPE, LEN, T_US
+#define LOG_CHECKSUM_SIZE 2           // CK_A, CK_B
+#define LOG_OVERHEAD (LOG_HEADER_SIZE + LOG_CHECKSUM_SIZE)
+#define LOG_MAX_PAYLOAD 1024          // Largest payload a reader accepts
+
+
+//--------------------------------------------------------------------------------------------
+// Record types
+//--------------------------------------------------------------------------------------------
+// 0x01 was the combined, untimed sensor record of the first record logs.
+typedef enum {
+  LOG_REC_STATE = 0x02,       // LOG_State_t, Kalman filter output
+  LOG_REC_EVENT = 0x03,       // LOG_Event_t, flight events (apogee, ...)
+  LOG_REC_ACCEL = 0x04,       // LOG_Accel_t, one per ADXL375 sample
+  LOG_REC_BARO = 0x05,        // LOG_Baro_t, one per BMP390 sample
+  LOG_REC_GPS = 0x06,         // LOG_Gps_t, one per NAV-PVT
+  LOG_REC_TIMING = 0x07,      // LOG_Timing_t, sampling jitter per sensor, once a second
+  LOG_REC_TIMESYNC = 0x08,    // LOG_TimeSync_t, PPS edge to GPS time correlation, once a second
+  LOG_REC_SPECTRUM = 0x09,    // LOG_Spectrum_t, ADXL375 full rate vibration PSD, once a second
+  LOG_REC_PAD = 0x0A,         // Zeros, fills a journal slot up to its COMMIT
+  LOG_REC_COMMIT = 0x0B,      // LOG_Commit_t, last record of a journal slot
+  LOG_REC_STORAGE = 0x0C,     // LOG_Storage_t, log write latency, once a second
+  LOG_REC_BLOCK = 0x0D,       // LOG_Block_t, first record of a journal slot
+  LOG_REC_SINK = 0x0E,        // LOG_Sink_t, health of a log destination, once a second
+  LOG_REC_ACCEL_PACK = 0x0F,  // Block of ACCEL samples, delta coded (see "Packed ACCEL blocks")
+  LOG_REC_RADIO = 0x10,       // LOG_Radio_t, a telemetry packet received on the ground
+} LOG_RecordType_t;
+
+typedef enum {
+  LOG_SENSOR_ACCEL = 0,
+  LOG_SENSOR_BARO = 1,
+} LOG_SensorId_t;
+
+typedef enum {
+  LOG_STORAGE_FILE = 0,       // Slots written through the file system
+  LOG_STORAGE_RAW = 1,        // Slots written straight to the file's card sectors
+  LOG_STORAGE_FLASH = 2,      // Slots written to the internal flash ring (lib/FlashRing)
+} LOG_StoragePath_t;
+
+typedef enum {
+  LOG_EVENT_LAUNCH = 1,
+  LOG_EVENT_APOGEE = 2,
+} LOG_EventId_t;
+
+
+//--------------------------------------------------------------------------------------------
+// Record payloads
+//--------------------------------------------------------------------------------------------
+typedef struct __attribute__((packed)) {
+  int16_t acc_raw[3];         // ADXL375 counts, 49 mg/LSB
+} LOG_Accel_t;
+
+typedef struct __attribute__((packed)) {
+  float pressure;             // Pa
+  float temperature;          // C
+} LOG_Baro_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t gps_itow;          // ms, GPS time of week
+  uint16_t gps_year;
+  uint8_t gps_month;
+  uint8_t gps_day;
+  uint8_t gps_hour;
+  uint8_t gps_min;
+  uint8_t gps_sec;
+  uint8_t gps_fix;            // NAV-PVT fixType
+  int32_t gps_lon;            // deg 1e-7
+  int32_t gps_lat;            // deg 1e-7
+  int32_t gps_height;         // mm above ellipsoid
+} LOG_Gps_t;
+
+typedef struct __attribute__((packed)) {
+  float altitude;             // m above pad
+  float velocity;             // m/s
+  float acceleration;         // m/s^2
+  uint8_t baro_locked;        // Transonic baro lockout active
+} LOG_State_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t id;                 // LOG_EventId_t
+  uint8_t votes;              // Bit mask of detectors that agreed
+  int64_t t_fired_us;         // Flight computer time the event fired
+  int64_t t_estimate_us;      // Best estimate of when the event really happened
+  float altitude;             // m above pad at t_estimate
+  int32_t vote_offset_ms[3];  // Per detector first vote relative to t_fired (INT32_MIN = never)
+} LOG_Event_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t sensor;             // LOG_SensorId_t
+  uint32_t period_us;         // Nominal sample period
+  uint32_t samples;           // Intervals measured in the window
+  uint32_t missed;            // Periods with no sample
+  uint32_t dropped;           // Samples lost because the log queue was full
+  int32_t jitter_min_us;
+  int32_t jitter_max_us;
+  uint32_t jitter_rms_us;
+  uint32_t hist[8];           // |jitter| < 1, 2, 5, 10, 20, 50, 100, >= 100 us
+} LOG_Timing_t;
+
+// T_US of the record is the MCU time of the PPS edge.
+typedef struct __attribute__((packed)) {
+  uint32_t gps_itow;          // ms, GPS time of week of the edge
+  uint16_t utc_year;          // UTC of the edge, from the same NAV-PVT
+  uint8_t utc_month;
+  uint8_t utc_day;
+  uint8_t utc_hour;
+  uint8_t utc_min;
+  uint8_t utc_sec;
+  uint8_t flags;              // bit 0 fit valid, bit 1 locked, bit 2 pair rejected
+  int64_t offset_us;          // Onboard fit : GPS time of week - MCU time at the edge
+  int32_t drift_ppb;          // Onboard fit : MCU clock rate error
+  uint32_t residual_ns;       // Onboard fit : rms residual
+} LOG_TimeSync_t;
+
+#define LOG_TIMESYNC_VALID 0x01
+#define LOG_TIMESYNC_LOCKED 0x02
+#define LOG_TIMESYNC_REJECTED 0x04
+
+// Welch PSD of the full rate ADXL375 stream (lib/Vibration). T_US is the
+// newest sample in the average. Bin k is centred on k * rate_hz / n_fft Hz.
+#define LOG_SPECTRUM_BINS 128
+#define LOG_SPECTRUM_DB_MIN -100.0f   // Code 0, dB re 1 g^2/Hz
+#define LOG_SPECTRUM_DB_STEP 0.5f     // dB per code
+
+typedef struct __attribute__((packed)) {
+  uint16_t rate_hz;           // Input sample rate
+  uint16_t n_fft;             // FFT length, 2 * LOG_SPECTRUM_BINS
+  uint16_t windows;           // Hann windows averaged, 50 % overlap
+  uint8_t db[3][LOG_SPECTRUM_BINS];   // X, Y, Z, DB_MIN + code * DB_STEP dB re 1 g^2/Hz
+} LOG_Spectrum_t;
+
+// Window since the previous STORAGE record. A flush commits the staged slot
+// and, once a second, syncs the files : its time is what the logging loop stalls.
+// The flash ring has its own window : flush_max_us is its longest sector erase
+// ahead, dropped the commits that had to erase first (it never drops records).
+typedef struct __attribute__((packed)) {
+  uint8_t path;               // LOG_StoragePath_t
+  uint16_t slots;             // Slots written
+  uint32_t write_us;          // Time spent writing them
+  uint32_t write_max_us;      // Longest slot write
+  uint32_t flush_max_us;      // Longest flush, slot write and sync
+  uint32_t write_errors;      // Slot writes failed since boot
+  uint32_t dropped;           // Records dropped since boot, file full
+} LOG_Storage_t;
+
+// Which block of the record stream a slot holds. Every log destination is
+// handed the same blocks (lib/LogSink), so copies of one flight on the SD card
+// and in flash line up block by block (Tools/log_merge).
+typedef struct __attribute__((packed)) {
+  uint32_t boot;              // Random, picked at boot
+  uint32_t block;             // Blocks since boot, from 0
+} LOG_Block_t;
+
+// One log destination since boot. Blocks are handed to it through its own
+// buffers : a block it has no free buffer for is dropped there only.
+typedef struct __attribute__((packed)) {
+  uint8_t path;               // LOG_StoragePath_t
+  uint32_t blocks;            // Handed to it
+  uint32_t written;           // Written
+  uint32_t overruns;          // Dropped, every buffer still waiting for the writer
+  uint32_t write_errors;      // Failed to write
+  uint16_t queue_max;         // Most blocks waiting at once
+  uint32_t wait_max_us;       // Longest from handed over to written
+} LOG_Sink_t;
+
+// A telemetry packet (lib/Telemetry) as a LoRa receiver heard it. A receiver
+// forwards each packet on its serial port as this record, T_US its own clock
+// at RxDone, and the ground station (Tools/ground_station) logs it as it
+// came. LEN is LOG_RADIO_HEADER + len : only the packet's own bytes follow.
+#define LOG_RADIO_HEADER 4
+#define LOG_RADIO_MAX_PACKET 64
+
+typedef struct __attribute__((packed)) {
+  int16_t rssi_dbm;           // Packet RSSI
+  int8_t snr_qdb;             // Packet SNR, 0.25 dB
+  uint8_t len;                // Packet bytes
+  uint8_t packet[LOG_RADIO_MAX_PACKET];
+} LOG_Radio_t;
+
+
+//--------------------------------------------------------------------------------------------
+// Time index
+//--------------------------------------------------------------------------------------------
+// Sparse index kept in a sidecar file next to the log : one entry per block
+// of records written to the card (a journal slot, a few hundred
+// records). Entries are fixed size and in file order, so a reader binary
+// searches them by time and jumps to the block instead of scanning the log.
+//
+// t_us is the stamp of the first ACCEL or BARO record of the block : sample
+// records are written in stamp order to within the sample queue delay, other
+// records (TIMESYNC edges, EVENT estimates) can carry older stamps, so a
+// reader starts LOG_INDEX_SLACK_US early. A torn last entry fails its check.
+//
+// events is cumulative (every EVENT id logged so far), so the first block
+// holding an event is found by binary search too.
+//
+// Next to a journal the index is preallocated as well and entry i is the
+// block of slot i, written a sector (LOG_INDEX_SECTOR_ENTRIES entries) at a
+// time; entries past the last sector written are zeros. At boot the entries
+// of the sector being filled are rebuilt from the journal (LOG_index_slot()),
+// events carried over from the entry before.
+#define LOG_INDEX_SLACK_US 2000000
+#define LOG_INDEX_SECTOR_ENTRIES 32   // 512 byte sector
+
+typedef struct __attribute__((packed)) {
+  uint64_t t_us;              // First ACCEL / BARO stamp of the block, 0 if none
+  uint32_t offset;            // Byte offset of the block in the log file
+  uint16_t records;           // Records in the block
+  uint8_t events;             // Bit (LOG_EventId_t - 1) set once that EVENT is logged, this block or before
+  uint8_t check;              // Fletcher CK_B of the bytes before
+} LOG_IndexEntry_t;
+
+// Block being staged; events carries over from block to block.
+typedef struct {
+  uint64_t t_us;
+  uint16_t records;
+  uint8_t events;
+  bool has_t;
+} LOG_IndexBlock_t;
+
+
+//--------------------------------------------------------------------------------------------
+// Journal slots
+//--------------------------------------------------------------------------------------------
+// The journal is a preallocated file of LOG_SLOT_SIZE slots (8 sectors),
+// each written whole, once, in order :
+//
+//  | records ... | PAD records | COMMIT (LOG_COMMIT_RECORD_SIZE bytes, ends the slot) |
+//
+// The COMMIT holds the slot number, the boot session and a CRC-32 of the
+// whole slot before the CRC. A slot is valid when its COMMIT decodes, the
+// CRC matches, its seq is its slot number and its generation is that of
+// slot 0 (a new journal picks a new generation, so slots left on the card
+// by an earlier journal in the same place are not valid). Valid slots form a
+// prefix of the file : the end of the journal is found by binary search.
+#define LOG_SLOT_SIZE 4096
+#define LOG_JOURNAL_MAGIC 0x4C4E524Au // "JRNL"
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;             // LOG_JOURNAL_MAGIC
+  uint32_t generation;        // Picked when the journal file is created
+  uint32_t session;           // Boot count of the journal, 1 for the first
+  uint32_t seq;               // Slot number in the file
+  uint16_t used;              // Record bytes before the padding
+  uint32_t crc;               // CRC-32 of the slot up to this field
+} LOG_Commit_t;
+
+#define LOG_COMMIT_RECORD_SIZE (LOG_OVERHEAD + sizeof(LOG_Commit_t))
+#define LOG_SLOT_DATA_SIZE (LOG_SLOT_SIZE - LOG_COMMIT_RECORD_SIZE)    // Room for records and padding
+
+// Reads slot i of a journal into buf (LOG_SLOT_SIZE bytes).
+typedef bool (*LOG_SlotRead_t)(void *ctx, uint32_t slot, uint8_t *buf);
+
+
+//--------------------------------------------------------------------------------------------
+// Packed ACCEL blocks
+//--------------------------------------------------------------------------------------------
+// At 800 Hz an ACCEL record is 20 bytes for 6 bytes of counts. An ACCEL_PACK
+// record holds up to LOG_ACCEL_PACK_SAMPLES of them instead (80 ms), T_US the
+// stamp of the first :
+//
+//  | count (u8) | period_us (u16) | acc_raw[3] of sample 0 | groups ... |
+//
+// Samples 1 .. count - 1 follow in groups of LOG_ACCEL_PACK_GROUP, one bit
+// stream LSB first : four 5 bit widths (stamp, X, Y, Z), then per sample the
+// stamp and the three axes, each a zig-zag value (0, -1, 1, -2 ... as 0, 1,
+// 2, 3) in its width, 0 bits when the whole group is 0. The stamp value is
+// (t_i - t_i-1) - period_us, an axis value a_i - a_i-1. period_us is the
+// first interval, so a steady stream costs no stamp bits at all.
+//
+// Each block decodes on its own and is checked like any record : a
+// corrupted block loses its own samples only. A stamp further than
+// LOG_ACCEL_PACK_SLACK_US from the block's period starts a new block, which
+// bounds every value, and the block, to LOG_ACCEL_PACK_MAX bytes.
+#define LOG_ACCEL_PACK_SAMPLES 64
+#define LOG_ACCEL_PACK_GROUP 16
+#define LOG_ACCEL_PACK_HEADER 9       // count, period_us, first sample
+#define LOG_ACCEL_PACK_SLACK_US 32767 // Stamp values fit 16 bits, axis values 17
+#define LOG_ACCEL_PACK_MAX (LOG_ACCEL_PACK_HEADER +                                                   \
+                            (((LOG_ACCEL_PACK_SAMPLES - 2) / LOG_ACCEL_PACK_GROUP + 1) * 4 * 5 +        \
+                             (LOG_ACCEL_PACK_SAMPLES - 1) * (16 + 3 * 17) + 7) / 8)
+
+// Samples of the block being packed.
+typedef struct {
+  uint8_t count;
+  uint16_t period_us;
+  uint64_t t_us[LOG_ACCEL_PACK_SAMPLES];
+  LOG_Accel_t acc[LOG_ACCEL_PACK_SAMPLES];
+} LOG_AccelPack_t;
+
+
+//--------------------------------------------------------------------------------------------
+// Reader result
+//--------------------------------------------------------------------------------------------
+typedef enum {
+  LOG_OK = 0,                 // Record decoded
+  LOG_NEED_MORE,              // Buffer ends inside a record
+  LOG_BAD_RECORD,             // No sync or checksum mismatch at this position
+} LOG_Status_t;
+
+typedef struct {
+  uint8_t type;
+  uint16_t len;
+  uint64_t t_us;
+  const uint8_t *payload;     // Points into the input buffer
+  size_t size;                // Total bytes including header and checksum
+} LOG_Record_t;
+
+
+//--------------------------------------------------------------------------------------------
+// Function prototypes
+//--------------------------------------------------------------------------------------------
+
+/**
+ * @brief 8-bit Fletcher checksum, as used by UBX.
+ */
+void LOG_checksum(const uint8_t *data, size_t len, uint8_t *ck_a, uint8_t *ck_b);
+
+/**
+ * @brief Frame a payload into a record.
+ * @param[out] out Destination, must hold len + LOG_OVERHEAD bytes.
+ * @param[in] type Record type (LOG_RecordType_t).
+ * @param[in] t_us Sample time, esp_timer microseconds.
+ * @param[in] payload Payload bytes.
+ * @param[in] len Payload length.
+ * @return Number of bytes written.
+ */
+size_t LOG_encode(uint8_t *out, uint8_t type, uint64_t t_us, const void *payload, uint16_t len);
+
+/**
+ * @brief Decode the record starting at buf[0].
+ *
+ * On LOG_BAD_RECORD the caller should advance one byte and try again.
+ *
+ * @param[in] buf Input bytes.
+ * @param[in] avail Number of bytes available.
+ * @param[out] rec Decoded record, payload points into buf.
+ */
+LOG_Status_t LOG_decode(const uint8_t *buf, size_t avail, LOG_Record_t *rec);
+
+/**
+ * @brief CRC-32 (IEEE, reflected), continued from crc (0 to start).
+ */
+uint32_t LOG_crc32(uint32_t crc, const uint8_t *data, size_t len);
+
+/**
+ * @brief True if a record with a len byte payload still fits a slot holding used bytes.
+ *
+ * Leaves either no room or room for at least one PAD record.
+ */
+bool LOG_slot_fits(size_t used, uint16_t len);
+
+/**
+ * @brief Pad a slot holding used bytes of records and append its COMMIT.
+ * @param[in] commit magic, generation, session and seq; used and crc are filled in.
+ */
+void LOG_slot_close(uint8_t *slot, size_t used, const LOG_Commit_t *commit);
+
+/**
+ * @brief Decode and verify the COMMIT of a slot (position, checksum, CRC, magic).
+ */
+bool LOG_slot_check(const uint8_t *slot, LOG_Commit_t *commit);
+
+/**
+ * @brief Number of valid slots of a journal of slots slots, by binary search.
+ * @param[in] buf LOG_SLOT_SIZE bytes of scratch.
+ * @param[out] last COMMIT of the last valid slot.
+ * @param[out] reads Slots read, may be NULL.
+ * @return 0 if slot 0 is not a valid journal slot.
+ */
+uint32_t LOG_journal_scan(LOG_SlotRead_t read, void *ctx, uint32_t slots, uint8_t *buf, LOG_Commit_t *last,
+                          uint32_t *reads);
+
+/**
+ * @brief Account one staged record in the index block (type, stamp, EVENT id).
+ */
+void LOG_index_add(LOG_IndexBlock_t *block, uint8_t type, uint64_t t_us, const void *payload);
+
+/**
+ * @brief Entry of the staged block written at offset, then start the next block.
+ */
+void LOG_index_close(LOG_IndexBlock_t *block, uint32_t offset, LOG_IndexEntry_t *entry);
+
+/**
+ * @brief True if the entry check byte matches (not torn or corrupted).
+ */
+bool LOG_index_valid(const LOG_IndexEntry_t *entry);
+
+/**
+ * @brief Index entry of a committed journal slot, from its records : rebuilds
+ * the entries a power cut lost. block carries the events as LOG_index_close() does.
+ * @return false if the slot is not valid.
+ */
+bool LOG_index_slot(LOG_IndexBlock_t *block, const uint8_t *slot, uint32_t offset, LOG_IndexEntry_t *entry);
+
+/**
+ * @brief Add a sample to the block being packed (start from LOG_AccelPack_t p = {}).
+ * @return false if it does not fit : the block is full, or the stamp is too far
+ * from its period. Close the block and add the sample again.
+ */
+bool LOG_accel_pack_add(LOG_AccelPack_t *p, uint64_t t_us, const LOG_Accel_t *acc);
+
+/**
+ * @brief Encode the block into an ACCEL_PACK payload and start the next one.
+ * @param[out] out At least LOG_ACCEL_PACK_MAX bytes.
+ * @param[out] t_us Stamp of the first sample, the record's T_US.
+ * @return Payload bytes, 0 if the block was empty.
+ */
+uint16_t LOG_accel_pack_close(LOG_AccelPack_t *p, uint8_t *out, uint64_t *t_us);
+
+/**
+ * @brief Samples of an ACCEL_PACK payload.
+ * @param[out] t_out, acc_out LOG_ACCEL_PACK_SAMPLES entries each.
+ * @return Samples decoded, -1 if the payload is malformed.
+ */
+int LOG_accel_unpack(const uint8_t *payload, uint16_t len, uint64_t t_us, uint64_t *t_out, LOG_Accel_t *acc_out);
+
+#endif /* FLIGHT_LOG_H */
@@ -0,0 +1,102 @@
+/**
+ * @file log_journal.cpp
+ * @brief Power loss safe log writer : committed slots and boot time recovery.
+ */
+
+#include <string.h>
+#include "log_journal.h"
+
+
+static bool read_slot(void *ctx, uint32_t slot, uint8_t *buf) {
+  const JRNL_Io_t *io = (const JRNL_Io_t *)ctx;
+  return io->read(io->ctx, (uint64_t)slot * LOG_SLOT_SIZE, buf, LOG_SLOT_SIZE);
+}
+
+
+bool JRNL_open(JRNL_t *j, const JRNL_Io_t *io, uint32_t generation, JRNL_Recovery_t *rec) {
+  memset(j, 0, sizeof(*j));
+  memset(rec, 0, sizeof(*rec));
+  j->io = *io;
+  j->slots = (uint32_t)(io->size / LOG_SLOT_SIZE);
+  if (j->slots == 0) {
+    return false;
+  }
+
+  LOG_Commit_t last;
+  rec->slots = LOG_journal_scan(read_slot, &j->io, j->slots, j->slot, &last, &rec->reads);
+  if (rec->slots > 0) {
+    rec->last_session = last.session;
+    j->generation = last.generation;
+    j->session = last.session + 1;
+    j->next = rec->slots;
+  } else {
+    j->generation = generation;
+    j->session = 1;
+    j->next = 0;
+  }
+  j->used = 0;
+  return true;
+}
+
+
+bool JRNL_fits(const JRNL_t *j, uint16_t len) {
+  return LOG_slot_fits(j->used, len);
+}
+
+
+bool JRNL_commit(JRNL_t *j) {
+  if (j->used == 0) {
+    return true;
+  }
+  LOG_Commit_t c;
+  c.magic = LOG_JOURNAL_MAGIC;
+  c.generation = j->generation;
+  c.session = j->session;
+  c.seq = j->next;
+  LOG_slot_close(j->slot, j->used, &c);
+  j->used = 0;
+
+  // A failed write leaves the slot number as it is : the next slot goes there.
+  if (!j->io.write(j->io.ctx, JRNL_offset(j), j->slot, LOG_SLOT_SIZE)) {
+    j->write_errors++;
+    return false;
+  }
+  j->next++;
+  return true;
+}
+
+
+bool JRNL_append(JRNL_t *j, uint8_t type, uint64_t t_us, const void *payload, uint16_t len) {
+  if (!LOG_slot_fits(0, len)) {
+    j->dropped++;
+    return false;
+  }
+  if (!JRNL_fits(j, len)) {
+    JRNL_commit(j);
+  }
+  if (j->next >= j->slots) {
+    j->dropped++;
+    return false;
+  }
+  j->used += LOG_encode(j->slot + j->used, type, t_us, payload, len);
+  return true;
+}
+
+
+bool JRNL_append_block(JRNL_t *j, const uint8_t *records, size_t n) {
+  if (j->used != 0 || n > LOG_SLOT_DATA_SIZE) {
+    return false;
+  }
+  if (j->next >= j->slots) {
+    j->dropped++;
+    return false;
+  }
+  memcpy(j->slot, records, n);
+  j->used = n;
+  return true;
+}
+
+
+uint64_t JRNL_offset(const JRNL_t *j) {
+  return (uint64_t)j->next * LOG_SLOT_SIZE;
+}
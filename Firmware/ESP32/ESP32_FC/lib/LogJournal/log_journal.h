@@ -0,0 +1,97 @@
+/**
+ * @file log_journal.h
+ * @brief Power loss safe log writer : committed slots and boot time recovery.
+ *
+ * Records are staged into a LOG_SLOT_SIZE slot (lib/FlightLog, "Journal
+ * slots"); a full slot, or a partial one on JRNL_commit(), is padded, closed
+ * with its COMMIT record and written whole at its place in a preallocated
+ * file. Nothing already on the card is ever rewritten, so a battery pulled
+ * mid write loses at most the slot being written, and the file metadata
+ * (size, FAT) never changes after the file is created.
+ *
+ * At boot JRNL_open() finds the end of the journal by binary search over the
+ * slots (LOG_journal_scan() : log2(slots) + 1 slot reads, ~21 for a 4 GB
+ * file) and appends after it in a new session. A torn slot fails its CRC and
+ * is written over.
+ *
+ * The storage is reached through JRNL_Io_t callbacks (an SD file on the
+ * flight computer, a mock card in the host tools). This file has no Arduino
+ * dependencies so it can be built into host tools.
+ */
+
+#ifndef LOG_JOURNAL_H
+#define LOG_JOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "flight_log.h"
+
+
+typedef struct {
+  bool (*read)(void *ctx, uint64_t offset, void *buf, size_t n);
+  bool (*write)(void *ctx, uint64_t offset, const void *buf, size_t n);
+  bool (*sync)(void *ctx);    // Data written so far is on the card, may be NULL
+  void *ctx;
+  uint64_t size;              // Bytes of the preallocated file
+} JRNL_Io_t;
+
+typedef struct {
+  uint32_t slots;             // Valid slots found, 0 for a new journal
+  uint32_t reads;             // Slots read by the search
+  uint32_t last_session;      // Session of the last valid slot, 0 for a new journal
+} JRNL_Recovery_t;
+
+typedef struct {
+  JRNL_Io_t io;
+  uint32_t slots;             // Capacity
+  uint32_t generation;
+  uint32_t session;
+  uint32_t next;              // Slot the staged records go to
+  uint8_t slot[LOG_SLOT_SIZE];
+  size_t used;                // Record bytes staged
+  uint32_t write_errors;      // Slots whose write failed (their records are lost)
+  uint32_t dropped;           // Records not logged because the file is full
+} JRNL_t;
+
+
+/**
+ * @brief Find the end of the journal in io and start a new session after it.
+ *
+ * If slot 0 is not a valid journal slot, a new journal with this generation
+ * starts at slot 0 (pick a random one, see "Journal slots").
+ *
+ * @return false if io is smaller than one slot.
+ */
+bool JRNL_open(JRNL_t *j, const JRNL_Io_t *io, uint32_t generation, JRNL_Recovery_t *rec);
+
+/**
+ * @brief Stage a record, writing the current slot first if it does not fit.
+ * @return false if the record was dropped (file full).
+ */
+bool JRNL_append(JRNL_t *j, uint8_t type, uint64_t t_us, const void *payload, uint16_t len);
+
+/**
+ * @brief True if a record with a len byte payload fits the slot being staged.
+ */
+bool JRNL_fits(const JRNL_t *j, uint16_t len);
+
+/**
+ * @brief Stage n bytes of records encoded elsewhere (a lib/LogSink block) as a whole slot.
+ * @return false if a slot is already staged, n is more than a slot holds or the file is full.
+ */
+bool JRNL_append_block(JRNL_t *j, const uint8_t *records, size_t n);
+
+/**
+ * @brief Close and write the slot being staged (nothing if it is empty).
+ * @return false if the write failed.
+ */
+bool JRNL_commit(JRNL_t *j);
+
+/**
+ * @brief File offset of the slot being staged.
+ */
+uint64_t JRNL_offset(const JRNL_t *j);
+
+#endif /* LOG_JOURNAL_H */
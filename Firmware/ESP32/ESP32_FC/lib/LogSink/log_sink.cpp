@@ -0,0 +1,104 @@
+/**
+ * @file log_sink.cpp
+ * @brief Blocks of the record stream handed to each log destination through its own buffers.
+ */
+
+#include <string.h>
+#include "log_sink.h"
+
+
+void SINK_init(SINK_t *s, SINK_Block_t *pool, uint32_t n, uint8_t path) {
+  memset(s, 0, sizeof(*s));
+  s->pool = pool;
+  s->n = n;
+  s->path = path;
+}
+
+
+// The block is copied in before head moves on : the consumer sees it whole.
+bool SINK_push(SINK_t *s, const uint8_t *records, uint16_t used, bool sync, int64_t now_us) {
+  uint32_t head = s->head;
+  uint32_t waiting = head - __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+  if (waiting >= s->n) {
+    __atomic_store_n(&s->overruns, s->overruns + 1, __ATOMIC_RELAXED);
+    return false;
+  }
+  SINK_Block_t *b = &s->pool[head % s->n];
+  memcpy(b->data, records, used);
+  b->used = used;
+  b->sync = sync;
+  b->queued_us = now_us;
+  __atomic_store_n(&s->head, head + 1, __ATOMIC_RELEASE);
+  if (waiting + 1 > s->queue_max) {
+    __atomic_store_n(&s->queue_max, waiting + 1, __ATOMIC_RELAXED);
+  }
+  return true;
+}
+
+
+SINK_Block_t *SINK_peek(SINK_t *s) {
+  uint32_t tail = s->tail;
+  if (__atomic_load_n(&s->head, __ATOMIC_ACQUIRE) == tail) {
+    return NULL;
+  }
+  return &s->pool[tail % s->n];
+}
+
+
+// Written blocks are counted by tail, only failures need a counter.
+void SINK_pop(SINK_t *s, bool written, int64_t now_us) {
+  uint32_t tail = s->tail;
+  uint32_t wait_us = (uint32_t)(now_us - s->pool[tail % s->n].queued_us);
+  if (!written) {
+    __atomic_store_n(&s->write_errors, s->write_errors + 1, __ATOMIC_RELAXED);
+  }
+  if (wait_us > s->wait_max_us) {
+    __atomic_store_n(&s->wait_max_us, wait_us, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&s->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+
+uint32_t SINK_waiting(const SINK_t *s) {
+  return __atomic_load_n(&s->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+}
+
+
+void SINK_health(const SINK_t *s, LOG_Sink_t *h) {
+  uint32_t tail = __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+  uint32_t write_errors = __atomic_load_n(&s->write_errors, __ATOMIC_RELAXED);
+  uint32_t overruns = __atomic_load_n(&s->overruns, __ATOMIC_RELAXED);
+  h->path = s->path;
+  h->blocks = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE) + overruns;
+  h->written = tail - write_errors;
+  h->overruns = overruns;
+  h->write_errors = write_errors;
+  h->queue_max = (uint16_t)__atomic_load_n(&s->queue_max, __ATOMIC_RELAXED);
+  h->wait_max_us = __atomic_load_n(&s->wait_max_us, __ATOMIC_RELAXED);
+}
+
+
+void SINK_stage_init(SINK_Stage_t *st, uint32_t boot) {
+  st->used = 0;
+  st->id.boot = boot;
+  st->id.block = 0;
+}
+
+
+bool SINK_stage_add(SINK_Stage_t *st, uint8_t type, uint64_t t_us, const void *payload, uint16_t len) {
+  size_t used = st->used ? st->used : LOG_OVERHEAD + sizeof(LOG_Block_t);
+  if (!LOG_slot_fits(used, len)) {
+    return false;
+  }
+  if (st->used == 0) {
+    st->used = LOG_encode(st->data, LOG_REC_BLOCK, t_us, &st->id, sizeof(st->id));
+  }
+  st->used += LOG_encode(st->data + st->used, type, t_us, payload, len);
+  return true;
+}
+
+
+void SINK_stage_next(SINK_Stage_t *st) {
+  st->used = 0;
+  st->id.block++;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file log_sink.h
+ * @brief Blocks of the record stream handed to each log destination through its own buffers.
+ *
+ * The logging loop encodes every record once, into a block that becomes one
+ * journal slot (lib/FlightLog, "Journal slots") : a BLOCK record first (boot,
+ * block number), then records while they fit. A full block, or a partial one
+ * at the once a second flush, is copied to every destination (SD card, flash
+ * ring) and the next block starts.
+ *
+ * Each destination is a SINK_t : a pool of block buffers, filled by the loop
+ * and emptied by that destination's writer task, oldest first. The loop never
+ * waits : a block finding every buffer of a destination still queued is
+ * dropped for that destination only and counted as an overrun. A stalled or
+ * failed SD card so costs its own copy of the blocks, never the samples nor
+ * the flash copy, and the reverse. Copies of one flight are merged block by
+ * block on the host (Tools/log_merge).
+ *
+ * The pool is a single producer, single consumer ring : SINK_push() from one
+ * task, SINK_peek() / SINK_pop() from another, no lock. Each health counter
+ * is written by one side only, SINK_health() reads them into a SINK record.
+ *
+ * This file has no Arduino dependencies so it can be built into host tools.
+ */
+
+#ifndef LOG_SINK_H
+#define LOG_SINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "flight_log.h"
+
+
+typedef struct {
+  uint8_t data[LOG_SLOT_DATA_SIZE];
+  uint16_t used;
+  bool sync;                  // Push the destination's data to its medium after this block
+  int64_t queued_us;
+} SINK_Block_t;
+
+typedef struct {
+  SINK_Block_t *pool;
+  uint32_t n;
+  uint8_t path;               // LOG_StoragePath_t
+  uint32_t head;              // Blocks pushed, written by the producer only
+  uint32_t tail;              // Blocks popped, written by the consumer only
+  uint32_t overruns;          // Producer
+  uint32_t queue_max;         // Producer
+  uint32_t write_errors;      // Consumer
+  uint32_t wait_max_us;       // Consumer
+} SINK_t;
+
+// Block being encoded by the logging loop.
+typedef struct {
+  uint8_t data[LOG_SLOT_DATA_SIZE];
+  size_t used;
+  LOG_Block_t id;
+} SINK_Stage_t;
+
+
+/**
+ * @brief Empty sink over n block buffers.
+ */
+void SINK_init(SINK_t *s, SINK_Block_t *pool, uint32_t n, uint8_t path);
+
+/**
+ * @brief Copy a block into a free buffer (producer).
+ * @return false if every buffer is queued : the block is dropped here, counted in overruns.
+ */
+bool SINK_push(SINK_t *s, const uint8_t *records, uint16_t used, bool sync, int64_t now_us);
+
+/**
+ * @brief Oldest queued block, NULL if none (consumer). Stays queued until SINK_pop().
+ */
+SINK_Block_t *SINK_peek(SINK_t *s);
+
+/**
+ * @brief Release the block SINK_peek() returned, written or not (consumer).
+ */
+void SINK_pop(SINK_t *s, bool written, int64_t now_us);
+
+/**
+ * @brief Blocks queued and not yet popped.
+ */
+uint32_t SINK_waiting(const SINK_t *s);
+
+/**
+ * @brief Health since SINK_init(), from either side.
+ */
+void SINK_health(const SINK_t *s, LOG_Sink_t *h);
+
+/**
+ * @brief Start block 0 of a boot.
+ */
+void SINK_stage_init(SINK_Stage_t *st, uint32_t boot);
+
+/**
+ * @brief Encode a record into the staged block, after its BLOCK record.
+ * @return false if it does not fit : hand the block over, SINK_stage_next(), and add it again.
+ */
+bool SINK_stage_add(SINK_Stage_t *st, uint8_t type, uint64_t t_us, const void *payload, uint16_t len);
+
+/**
+ * @brief Start the next block, once the staged one is handed to every sink.
+ */
+void SINK_stage_next(SINK_Stage_t *st);
+
+#endif /* LOG_SINK_H */
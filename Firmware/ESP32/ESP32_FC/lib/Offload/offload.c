@@ -0,0 +1,326 @@
+/**
+ * @file offload.c
+ * @brief Resumable log offload over a serial link : CRC-protected chunks, a sliding window, resume from any offset.
+ */
+
+#include <string.h>
+#include "offload.h"
+
+
+static void put32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+
+static uint32_t get32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+uint32_t OFF_crc32(uint32_t crc, const void *data, size_t len) {
+  static uint32_t table[256];
+  static bool table_ready = false;
+  if (!table_ready) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+    table_ready = true;
+  }
+  const uint8_t *d = (const uint8_t *)data;
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc = table[(crc ^ d[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+
+size_t OFF_encode(uint8_t *out, uint8_t type, uint8_t file, uint32_t offset, uint32_t arg,
+                  const void *payload, uint16_t len) {
+  out[0] = OFF_MAGIC0;
+  out[1] = OFF_MAGIC1;
+  out[2] = type;
+  out[3] = file;
+  put32(out + 4, offset);
+  put32(out + 8, arg);
+  out[12] = (uint8_t)len;
+  out[13] = (uint8_t)(len >> 8);
+  if (payload && len) memcpy(out + OFF_HEADER_SIZE, payload, len);
+  put32(out + OFF_HEADER_SIZE + len, OFF_crc32(0, out, OFF_HEADER_SIZE + len));
+  return OFF_OVERHEAD + len;
+}
+
+
+//------------------------------------------------------------------------------------------------------
+// Parser
+//------------------------------------------------------------------------------------------------------
+void OFF_parser_init(OFF_Parser_t *p, uint8_t *buf, size_t cap) {
+  memset(p, 0, sizeof(*p));
+  p->buf = buf;
+  p->cap = cap;
+}
+
+
+static uint16_t frame_len(const uint8_t *b) {
+  return (uint16_t)(b[12] | b[13] << 8);
+}
+
+
+// Whether the bytes so far can start a frame.
+static bool prefix_ok(const OFF_Parser_t *p, const uint8_t *b, size_t have) {
+  if (have >= 1 && b[0] != OFF_MAGIC0) return false;
+  if (have >= 2 && b[1] != OFF_MAGIC1) return false;
+  if (have >= OFF_HEADER_SIZE &&
+      (b[2] < OFF_LIST || b[2] > OFF_ERROR || (size_t)OFF_OVERHEAD + frame_len(b) > p->cap)) {
+    return false;
+  }
+  return true;
+}
+
+
+// Drop the first byte, and every one after it that cannot start a frame.
+static void skip(OFF_Parser_t *p) {
+  size_t at = 1;
+  while (at < p->have) {
+    const uint8_t *m = (const uint8_t *)memchr(p->buf + at, OFF_MAGIC0, p->have - at);
+    if (!m) {
+      at = p->have;
+      break;
+    }
+    at = (size_t)(m - p->buf);
+    if (prefix_ok(p, m, p->have - at)) break;
+    at++;
+  }
+  p->skipped += (uint32_t)at;
+  memmove(p->buf, p->buf + at, p->have - at);
+  p->have -= at;
+}
+
+
+size_t OFF_parse(OFF_Parser_t *p, const uint8_t *data, size_t n, OFF_Frame_t *frame, bool *got) {
+  size_t used = 0;
+  *got = false;
+  if (p->done) {
+    memmove(p->buf, p->buf + p->done, p->have - p->done);
+    p->have -= p->done;
+    p->done = 0;
+  }
+  for (;;) {
+    if (p->have == 0) {
+      const uint8_t *m = n > used ? (const uint8_t *)memchr(data + used, OFF_MAGIC0, n - used) : NULL;
+      size_t at = m ? (size_t)(m - data) : n;
+      p->skipped += (uint32_t)(at - used);
+      used = at;
+      if (used == n) break;
+    }
+    size_t want = p->have < OFF_HEADER_SIZE ? OFF_HEADER_SIZE : OFF_OVERHEAD + frame_len(p->buf);
+    if (p->have < want) {
+      if (used == n) break;
+      size_t take = want - p->have < n - used ? want - p->have : n - used;
+      memcpy(p->buf + p->have, data + used, take);
+      p->have += take;
+      used += take;
+    }
+    if (!prefix_ok(p, p->buf, p->have)) {
+      skip(p);
+      continue;
+    }
+    if (p->have < OFF_HEADER_SIZE || p->have < (size_t)OFF_OVERHEAD + frame_len(p->buf)) {
+      continue;
+    }
+    uint16_t len = frame_len(p->buf);
+    if (OFF_crc32(0, p->buf, OFF_HEADER_SIZE + len) != get32(p->buf + OFF_HEADER_SIZE + len)) {
+      p->bad_frames++;
+      skip(p);
+      continue;
+    }
+    frame->type = p->buf[2];
+    frame->file = p->buf[3];
+    frame->offset = get32(p->buf + 4);
+    frame->arg = get32(p->buf + 8);
+    frame->len = len;
+    frame->payload = p->buf + OFF_HEADER_SIZE;
+    p->frames++;
+    p->done = OFF_OVERHEAD + len;  // Dropped at the next call, the frame stays until then
+    *got = true;
+    break;
+  }
+  return used;
+}
+
+
+//------------------------------------------------------------------------------------------------------
+// Board side
+//------------------------------------------------------------------------------------------------------
+void OFF_server_init(OFF_Server_t *s, const OFF_File_t *files, uint8_t n_files, const OFF_Link_t *link,
+                     uint8_t *buf, size_t size) {
+  memset(s, 0, sizeof(*s));
+  s->files = files;
+  s->n_files = n_files < OFF_FILES_MAX ? n_files : OFF_FILES_MAX;
+  s->link = *link;
+  s->tx[0] = buf;
+  s->tx[1] = buf + size / 2;
+  s->chunk = size / 2 - OFF_OVERHEAD;
+  if (s->chunk > OFF_CHUNK_MAX) s->chunk = OFF_CHUNK_MAX;
+  OFF_parser_init(&s->rx, s->rx_buf, sizeof(s->rx_buf));
+}
+
+
+static void owe_error(OFF_Server_t *s, uint8_t error, uint8_t file, uint32_t offset) {
+  s->error = error;
+  s->error_file = file;
+  s->error_offset = offset;
+}
+
+
+static void request(OFF_Server_t *s, const OFF_Frame_t *f) {
+  s->requests++;
+  bool known = f->file < s->n_files;
+  uint32_t size = known ? s->files[f->file].size : 0;
+  switch (f->type) {
+    case OFF_LIST:
+      s->info = true;
+      break;
+    case OFF_READ: {
+      if (!known || f->offset > size) {
+        owe_error(s, OFF_ERR_FILE, f->file, f->offset);
+        break;
+      }
+      uint32_t start = f->offset - f->offset % (uint32_t)s->chunk;
+      if (s->streaming && s->file == f->file && start < s->next) s->resent += s->next - start;
+      s->streaming = true;
+      s->file = f->file;
+      s->next = s->acked = start;
+      s->window = f->arg > s->chunk ? f->arg : (uint32_t)s->chunk;
+      s->reads++;
+      break;
+    }
+    case OFF_ACK:
+      if (s->streaming && f->file == s->file && f->offset > s->acked && f->offset <= s->next) {
+        s->acked = f->offset;
+      }
+      break;
+    case OFF_SUM:
+      if (!known || f->offset > size || f->arg > size - f->offset) {
+        owe_error(s, OFF_ERR_FILE, f->file, f->offset);
+        break;
+      }
+      s->sum = true;
+      s->sum_file = f->file;
+      s->sum_offset = f->offset;
+      s->sum_len = f->arg;
+      break;
+    case OFF_BYE:
+      s->bye = true;
+      s->streaming = false;
+      break;
+    default:
+      break;
+  }
+}
+
+
+void OFF_server_rx(OFF_Server_t *s, const uint8_t *data, size_t n) {
+  for (;;) {
+    OFF_Frame_t f;
+    bool got;
+    size_t used = OFF_parse(&s->rx, data, n, &f, &got);
+    data += used;
+    n -= used;
+    if (got) {
+      request(s, &f);
+    } else if (n == 0) {
+      break;
+    }
+  }
+}
+
+
+// INFO : the chunk size, then each file's size and name.
+static size_t build_info(OFF_Server_t *s, uint8_t *out) {
+  uint8_t *p = out + OFF_HEADER_SIZE;
+  size_t len = 0;
+  for (uint8_t i = 0; i < s->n_files; i++) {
+    size_t name = strlen(s->files[i].name);
+    if (name > OFF_NAME_MAX) name = OFF_NAME_MAX;
+    if (len + 5 + name > s->chunk) break;
+    put32(p + len, s->files[i].size);
+    p[len + 4] = (uint8_t)name;
+    memcpy(p + len + 5, s->files[i].name, name);
+    len += 5 + name;
+  }
+  return OFF_encode(out, OFF_INFO, 0, 0, (uint32_t)s->chunk, NULL, (uint16_t)len);
+}
+
+
+// SUM : CRC of the range, read a chunk at a time through the frame buffer.
+static size_t build_sum(OFF_Server_t *s, uint8_t *out) {
+  const OFF_File_t *f = &s->files[s->sum_file];
+  uint8_t *scratch = out + OFF_HEADER_SIZE;
+  uint32_t chunk = (uint32_t)s->chunk;
+  uint32_t end = s->sum_offset + s->sum_len;
+  uint32_t crc = 0;
+  for (uint32_t at = s->sum_offset - s->sum_offset % chunk; at < end; at += chunk) {
+    uint32_t n = f->size - at < chunk ? f->size - at : chunk;
+    if (!f->read(f->ctx, at, scratch, n)) {
+      s->read_errors++;
+      return OFF_encode(out, OFF_ERROR, s->sum_file, at, OFF_ERR_READ, NULL, 0);
+    }
+    uint32_t from = at < s->sum_offset ? s->sum_offset - at : 0;
+    uint32_t to = end - at < n ? end - at : n;
+    crc = OFF_crc32(crc, scratch + from, to - from);
+  }
+  uint8_t sum[4];
+  put32(sum, crc);
+  return OFF_encode(out, OFF_SUM, s->sum_file, s->sum_offset, s->sum_len, sum, sizeof(sum));
+}
+
+
+bool OFF_server_service(OFF_Server_t *s) {
+  if (s->ready) {
+    if (!s->link.send(s->link.ctx, s->tx[s->fill], s->ready)) {
+      return false;
+    }
+    s->fill ^= 1;
+    s->ready = 0;
+    return true;
+  }
+
+  // Replies before DATA : a request is never stuck behind a window of chunks.
+  uint8_t *out = s->tx[s->fill];
+  if (s->error) {
+    s->ready = OFF_encode(out, OFF_ERROR, s->error_file, s->error_offset, s->error, NULL, 0);
+    s->error = 0;
+  } else if (s->info) {
+    s->ready = build_info(s, out);
+    s->info = false;
+  } else if (s->sum) {
+    s->ready = build_sum(s, out);
+    s->sum = false;
+  } else if (s->streaming && s->next < s->files[s->file].size && s->next - s->acked < s->window) {
+    const OFF_File_t *f = &s->files[s->file];
+    uint32_t n = f->size - s->next < s->chunk ? f->size - s->next : (uint32_t)s->chunk;
+    if (!f->read(f->ctx, s->next, out + OFF_HEADER_SIZE, n)) {
+      s->read_errors++;
+      s->streaming = false;
+      s->ready = OFF_encode(out, OFF_ERROR, s->file, s->next, OFF_ERR_READ, NULL, 0);
+    } else {
+      s->ready = OFF_encode(out, OFF_DATA, s->file, s->next, f->size, NULL, (uint16_t)n);
+      s->next += n;
+      s->data_frames++;
+    }
+  } else {
+    return false;
+  }
+
+  if (s->link.send(s->link.ctx, out, s->ready)) {
+    s->fill ^= 1;
+    s->ready = 0;
+  }
+  return true;
+}
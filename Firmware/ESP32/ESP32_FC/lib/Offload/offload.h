@@ -0,0 +1,181 @@
+/**
+ * @file offload.h
+ * @brief Resumable log offload over a serial link : CRC-protected chunks, a sliding window, resume from any offset.
+ *
+ * After recovery the logs come off the board over its USB CDC port (the
+ * flight computer) or its UART (the STM32G030) instead of out of the SD card.
+ * The host (Tools/offload) asks, the board answers; every frame, both ways :
+ *
+ *   'O' 'F' | type | file | offset (4) | arg (4) | len (2) | payload (len) | CRC-32 (4)
+ *
+ * little endian, the CRC-32 (the IEEE one of LOG_crc32()) over everything
+ * before it. A receiver skips bytes until a frame checks, so text the board
+ * printed before, or a corrupted frame, costs only that frame.
+ *
+ * - LIST : the board answers INFO, arg its chunk size, payload an entry per
+ *   file (size (4), name length (1), name).
+ * - READ file, offset, arg window : the board streams DATA frames of a chunk
+ *   each from offset (rounded down to a chunk), never more than window bytes
+ *   past the last ACK. A READ at any time restarts the stream there, which
+ *   is how the host resumes : after a gap or a bad frame, after a timeout,
+ *   after either side was reset, from the bytes already in its file.
+ * - ACK file, offset : everything before offset arrived, the window slides.
+ * - SUM file, offset, arg length : the board answers SUM with the CRC-32 of
+ *   that range in its payload, so the host checks the file it wrote.
+ * - BYE : the host is done.
+ * - ERROR file, offset, arg OFF_Error_t : no such file, a read that failed.
+ *
+ * The board side is an OFF_Server_t over a send callback that may return
+ * before the bytes are out (a DMA transfer) : frames are built in two
+ * buffers taking turns, the next one filled while the last one goes out.
+ *
+ * This file is plain C with no platform dependencies, so the STM32 board
+ * and the host tools build the same source.
+ */
+
+#ifndef OFFLOAD_H
+#define OFFLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define OFF_MAGIC0 'O'
+#define OFF_MAGIC1 'F'
+#define OFF_HEADER_SIZE 14
+#define OFF_OVERHEAD (OFF_HEADER_SIZE + 4)  // Header and CRC
+#define OFF_CHUNK_MAX 32768
+#define OFF_NAME_MAX 31
+#define OFF_FILES_MAX 8
+
+typedef enum {
+  OFF_LIST = 1,               // Host
+  OFF_INFO,                   // Board
+  OFF_READ,                   // Host
+  OFF_DATA,                   // Board
+  OFF_ACK,                    // Host
+  OFF_SUM,                    // Both
+  OFF_BYE,                    // Host
+  OFF_ERROR,                  // Board
+} OFF_Type_t;
+
+typedef enum {
+  OFF_ERR_FILE = 1,           // No such file, or a range past its end
+  OFF_ERR_READ,               // The storage read failed at offset
+} OFF_Error_t;
+
+typedef struct {
+  uint8_t type;
+  uint8_t file;
+  uint32_t offset;
+  uint32_t arg;
+  uint16_t len;
+  const uint8_t *payload;     // Inside the parser's buffer, until the next OFF_parse()
+} OFF_Frame_t;
+
+typedef struct {
+  uint8_t *buf;
+  size_t cap;                 // Longest frame taken, OFF_OVERHEAD + payload
+  size_t have;
+  size_t done;                // Bytes of the frame last returned, dropped at the next call
+  // Statistics
+  uint32_t frames;
+  uint32_t bad_frames;        // CRC failures
+  uint32_t skipped;           // Bytes skipped looking for a frame
+} OFF_Parser_t;
+
+typedef struct {
+  const char *name;
+  uint32_t size;
+  bool (*read)(void *ctx, uint32_t offset, void *buf, size_t n);  // Chunk aligned offsets
+  void *ctx;
+} OFF_File_t;
+
+typedef struct {
+  // Start sending n bytes of buf. false while the last send is still going
+  // out : try again later. A buffer is left alone until a later send is taken.
+  bool (*send)(void *ctx, const uint8_t *buf, size_t n);
+  void *ctx;
+} OFF_Link_t;
+
+typedef struct {
+  const OFF_File_t *files;
+  uint8_t n_files;
+  OFF_Link_t link;
+  uint8_t *tx[2];             // Frame buffers, OFF_OVERHEAD + chunk each
+  size_t chunk;
+  uint8_t fill;               // tx[fill] is the one to build in
+  size_t ready;               // Bytes of a frame built in tx[fill] the link has not taken yet
+  OFF_Parser_t rx;
+  uint8_t rx_buf[OFF_OVERHEAD];  // Requests carry no payload
+  // Replies owed, sent before any more DATA
+  bool info;
+  uint8_t sum_file;
+  uint32_t sum_offset, sum_len;
+  bool sum;
+  uint8_t error;              // OFF_Error_t, 0 : none
+  uint8_t error_file;
+  uint32_t error_offset;
+  // Stream
+  bool streaming;
+  uint8_t file;
+  uint32_t next;              // Next byte to send
+  uint32_t acked;             // Bytes the host has
+  uint32_t window;
+  bool bye;
+  // Statistics
+  uint32_t requests;
+  uint32_t reads;             // READ requests, the first of each file and every resume
+  uint32_t data_frames;
+  uint32_t resent;            // Bytes sent again after a READ went back
+  uint32_t read_errors;
+} OFF_Server_t;
+
+
+/**
+ * @brief CRC-32 (IEEE, reflected) as LOG_crc32(), continued from crc (0 to start).
+ */
+uint32_t OFF_crc32(uint32_t crc, const void *data, size_t len);
+
+/**
+ * @brief Build a frame in out (OFF_OVERHEAD + len bytes). payload may be NULL when it is already at out + OFF_HEADER_SIZE.
+ * @return Frame bytes.
+ */
+size_t OFF_encode(uint8_t *out, uint8_t type, uint8_t file, uint32_t offset, uint32_t arg,
+                  const void *payload, uint16_t len);
+
+void OFF_parser_init(OFF_Parser_t *p, uint8_t *buf, size_t cap);
+
+/**
+ * @brief Take received bytes until a whole frame checks; n may be 0 to look for one among bytes already taken.
+ * @return Bytes taken from data. *got is true when frame holds one, valid until the next call.
+ */
+size_t OFF_parse(OFF_Parser_t *p, const uint8_t *data, size_t n, OFF_Frame_t *frame, bool *got);
+
+/**
+ * @brief Serve files over a link. buf (size bytes) is split into the two frame buffers : chunk = size / 2 - OFF_OVERHEAD.
+ */
+void OFF_server_init(OFF_Server_t *s, const OFF_File_t *files, uint8_t n_files, const OFF_Link_t *link,
+                     uint8_t *buf, size_t size);
+
+/**
+ * @brief Take bytes received from the host; requests are answered from OFF_server_service().
+ */
+void OFF_server_rx(OFF_Server_t *s, const uint8_t *data, size_t n);
+
+/**
+ * @brief Hand the link the next frame owed, if it takes one. Call as often as the link drains.
+ * @return true if a frame was sent or built.
+ */
+bool OFF_server_service(OFF_Server_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OFFLOAD_H */
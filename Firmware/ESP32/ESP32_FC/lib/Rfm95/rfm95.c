@@ -0,0 +1,187 @@
+/**
+ * @file rfm95.c
+ * @brief HopeRF RFM95 (Semtech SX1276) LoRa transmitter driver : packets sent without waiting for the air.
+ */
+
+#include "rfm95.h"
+
+
+#define REG_FIFO 0x00
+#define REG_OP_MODE 0x01
+#define REG_FRF_MSB 0x06
+#define REG_PA_CONFIG 0x09
+#define REG_OCP 0x0B
+#define REG_FIFO_ADDR_PTR 0x0D
+#define REG_FIFO_TX_BASE 0x0E
+#define REG_FIFO_RX_BASE 0x0F
+#define REG_IRQ_FLAGS 0x12
+#define REG_MODEM_CONFIG1 0x1D
+#define REG_MODEM_CONFIG2 0x1E
+#define REG_PREAMBLE_MSB 0x20
+#define REG_PAYLOAD_LENGTH 0x22
+#define REG_MODEM_CONFIG3 0x26
+#define REG_SYNC_WORD 0x39
+#define REG_DIO_MAPPING1 0x40
+#define REG_VERSION 0x42
+#define REG_PA_DAC 0x4D
+
+#define WRITE 0x80                    // Address bit 7 : write access
+
+#define MODE_LORA 0x80                // LongRangeMode, only changed in sleep
+#define MODE_SLEEP 0x00
+#define MODE_STANDBY 0x01
+#define MODE_TX 0x03
+
+#define IRQ_TX_DONE 0x08
+#define DIO0_TX_DONE 0x40             // RegDioMapping1 bits 7:6 = 01
+#define PA_BOOST 0x80
+#define PA_DAC_HIGH 0x87              // +20 dBm on PA_BOOST
+#define PA_DAC_DEFAULT 0x84
+#define OCP_140MA 0x31                // OcpOn, Imax = -30 + 10 * 17 mA
+#define CONFIG2_CRC_ON 0x04
+#define CONFIG3_LDRO 0x08
+#define CONFIG3_AGC_AUTO 0x04
+
+#define TX_TIMEOUT_SLACK_US 10000     // On top of twice the airtime before TxDone is given up
+
+
+// RegModemConfig1 bits 7:4 index this table.
+static const uint32_t BANDWIDTHS[] = { 7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000 };
+
+
+static bool write_reg(RFM_t *r, uint8_t addr, uint8_t v) {
+  return r->bus.xfer(r->bus.ctx, addr | WRITE, &v, NULL, 1);
+}
+
+
+static uint8_t read_reg(RFM_t *r, uint8_t addr) {
+  uint8_t v = 0;
+  r->bus.xfer(r->bus.ctx, addr, NULL, &v, 1);
+  return v;
+}
+
+
+static int bw_code(uint32_t bw_hz) {
+  for (int i = 0; i < (int)(sizeof(BANDWIDTHS) / sizeof(BANDWIDTHS[0])); i++) {
+    if (BANDWIDTHS[i] == bw_hz) return i;
+  }
+  return -1;
+}
+
+
+// Symbols over 16 ms need low data rate optimisation (SF11 and SF12 at 125 kHz).
+static bool low_data_rate(const RFM_Config_t *cfg) {
+  return ((1000000ULL << cfg->sf) / cfg->bw_hz) > 16000;
+}
+
+
+uint32_t RFM_airtime_us(const RFM_Config_t *cfg, size_t len) {
+  int de = low_data_rate(cfg) ? 1 : 0;
+  int32_t num = 8 * (int32_t)len - 4 * cfg->sf + 28 + 16;
+  int32_t den = 4 * (cfg->sf - 2 * de);
+  int32_t blocks = num > 0 ? (num + den - 1) / den : 0;
+  // Preamble + 4.25 sync symbols + 8 header symbols + the payload, in quarter symbols
+  uint64_t quarters = 4ULL * (cfg->preamble + 8 + (uint32_t)blocks * cfg->cr) + 17;
+  return (uint32_t)((quarters * (1000000ULL << cfg->sf)) / (4ULL * cfg->bw_hz));
+}
+
+
+bool RFM_init(RFM_t *r, const RFM_Bus_t *bus, const RFM_Config_t *cfg) {
+  r->bus = *bus;
+  r->cfg = *cfg;
+  r->busy = false;
+  r->sent = r->bytes = r->timeouts = r->busy_rejects = r->load_us_max = 0;
+  r->airtime_us = 0;
+  int bw = bw_code(cfg->bw_hz);
+  bool high_power = cfg->power_dbm == 20;
+  if (bw < 0 || cfg->sf < 7 || cfg->sf > 12 || cfg->cr < 5 || cfg->cr > 8 || cfg->preamble < 6 ||
+      (!high_power && (cfg->power_dbm < 2 || cfg->power_dbm > 17))) {
+    return false;               // SF6 needs the implicit header, not supported
+  }
+  r->version = read_reg(r, REG_VERSION);
+  if (r->version != RFM_VERSION) {
+    return false;
+  }
+
+  // LoRa mode can only be entered from sleep.
+  write_reg(r, REG_OP_MODE, MODE_SLEEP);
+  write_reg(r, REG_OP_MODE, MODE_LORA | MODE_SLEEP);
+  uint64_t frf = ((uint64_t)cfg->freq_hz << 19) / RFM_XTAL_HZ;
+  uint8_t f[3] = { (uint8_t)(frf >> 16), (uint8_t)(frf >> 8), (uint8_t)frf };
+  r->bus.xfer(r->bus.ctx, REG_FRF_MSB | WRITE, f, NULL, sizeof(f));
+  write_reg(r, REG_PA_CONFIG, PA_BOOST | (uint8_t)(high_power ? 15 : cfg->power_dbm - 2));
+  write_reg(r, REG_PA_DAC, high_power ? PA_DAC_HIGH : PA_DAC_DEFAULT);
+  write_reg(r, REG_OCP, OCP_140MA);
+  write_reg(r, REG_FIFO_TX_BASE, 0);
+  write_reg(r, REG_FIFO_RX_BASE, 0);
+  write_reg(r, REG_MODEM_CONFIG1, (uint8_t)((bw << 4) | ((cfg->cr - 4) << 1)));
+  write_reg(r, REG_MODEM_CONFIG2, (uint8_t)((cfg->sf << 4) | CONFIG2_CRC_ON));
+  write_reg(r, REG_MODEM_CONFIG3, (uint8_t)((low_data_rate(cfg) ? CONFIG3_LDRO : 0) | CONFIG3_AGC_AUTO));
+  uint8_t p[2] = { (uint8_t)(cfg->preamble >> 8), (uint8_t)cfg->preamble };
+  r->bus.xfer(r->bus.ctx, REG_PREAMBLE_MSB | WRITE, p, NULL, sizeof(p));
+  write_reg(r, REG_SYNC_WORD, cfg->sync_word);
+  write_reg(r, REG_DIO_MAPPING1, DIO0_TX_DONE);
+  write_reg(r, REG_OP_MODE, MODE_LORA | MODE_STANDBY);
+
+  // A radio that took the settings reads them back.
+  return read_reg(r, REG_MODEM_CONFIG2) == (uint8_t)((cfg->sf << 4) | CONFIG2_CRC_ON) &&
+         read_reg(r, REG_OP_MODE) == (MODE_LORA | MODE_STANDBY);
+}
+
+
+bool RFM_send(RFM_t *r, const void *buf, size_t len) {
+  if (r->busy && !RFM_service(r)) {
+    r->busy_rejects++;
+    return false;
+  }
+  if (len == 0 || len > RFM_MAX_PAYLOAD) {
+    return false;
+  }
+  uint32_t t0 = r->bus.now_us(r->bus.ctx);
+  // The FIFO is only written in standby; TxDone goes back to standby by itself.
+  bool ok = write_reg(r, REG_OP_MODE, MODE_LORA | MODE_STANDBY) &&
+            write_reg(r, REG_FIFO_ADDR_PTR, 0) &&
+            r->bus.xfer(r->bus.ctx, REG_FIFO | WRITE, (const uint8_t *)buf, NULL, len) &&
+            write_reg(r, REG_PAYLOAD_LENGTH, (uint8_t)len) &&
+            write_reg(r, REG_IRQ_FLAGS, 0xFF) &&
+            write_reg(r, REG_OP_MODE, MODE_LORA | MODE_TX);
+  if (!ok) {
+    return false;
+  }
+  r->busy = true;
+  r->tx_start_us = r->bus.now_us(r->bus.ctx);
+  r->tx_airtime_us = RFM_airtime_us(&r->cfg, len);
+  r->bytes += (uint32_t)len;
+  uint32_t load_us = r->tx_start_us - t0;
+  if (load_us > r->load_us_max) {
+    r->load_us_max = load_us;
+  }
+  return true;
+}
+
+
+bool RFM_service(RFM_t *r) {
+  if (!r->busy) {
+    return true;
+  }
+  if (read_reg(r, REG_IRQ_FLAGS) & IRQ_TX_DONE) {
+    write_reg(r, REG_IRQ_FLAGS, IRQ_TX_DONE);
+    r->busy = false;
+    r->sent++;
+    r->airtime_us += r->tx_airtime_us;
+    return true;
+  }
+  if ((uint32_t)(r->bus.now_us(r->bus.ctx) - r->tx_start_us) > 2 * r->tx_airtime_us + TX_TIMEOUT_SLACK_US) {
+    write_reg(r, REG_OP_MODE, MODE_LORA | MODE_STANDBY);
+    r->busy = false;
+    r->timeouts++;
+    return true;
+  }
+  return false;
+}
+
+
+void RFM_sleep(RFM_t *r) {
+  write_reg(r, REG_OP_MODE, MODE_LORA | MODE_SLEEP);
+  r->busy = false;
+}
@@ -0,0 +1,113 @@
+/**
+ * @file rfm95.h
+ * @brief HopeRF RFM95 (Semtech SX1276) LoRa transmitter driver : packets sent without waiting for the air.
+ *
+ * The radio sends from its own 256 byte FIFO. RFM_send() loads the packet
+ * (a few register writes and one FIFO burst, ~50 us of SPI at 8 MHz), starts
+ * the transmission and returns; the packet spends its airtime on the air
+ * with no help from the MCU. DIO0 rises on TxDone : its interrupt only has
+ * to get RFM_service() called, which clears the flag and frees the driver
+ * for the next packet. A TxDone that never comes (interrupt lost, radio
+ * reset by a brown out) is given up after twice the airtime and counted.
+ *
+ * Modem settings are the usual LoRa ones (RFM_Config_t) : carrier,
+ * bandwidth, spreading factor, coding rate, preamble, sync word and output
+ * power on the PA_BOOST pin (the only one an RFM95 wires to its antenna).
+ * Explicit header and payload CRC are always on, so the receiver drops a
+ * corrupted packet by itself. Low data rate optimisation is switched on
+ * when a symbol lasts over 16 ms, as the datasheet requires.
+ *
+ * RFM_airtime_us() is the SX1276 time on air formula, for any packet
+ * length : the telemetry scheduler (lib/Telemetry) paces packets with it
+ * and the host tools use it to model the channel.
+ *
+ * The bus is reached through RFM_Bus_t callbacks : the Arduino SPI library
+ * on the flight computer (main.cpp), an SX1276 register model in the host
+ * tools (Tools/common/mock_rfm95.h). This file is plain C with no platform
+ * dependencies so the STM32 board can build the same source.
+ */
+
+#ifndef RFM95_H
+#define RFM95_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define RFM_MAX_PAYLOAD 255
+#define RFM_VERSION 0x12              // RegVersion of the SX1276/77/78/79
+#define RFM_XTAL_HZ 32000000UL
+
+typedef struct {
+  uint32_t freq_hz;           // Carrier
+  uint32_t bw_hz;             // 7800 .. 500000, one of the SX1276 bandwidths
+  uint8_t sf;                 // Spreading factor 6 .. 12
+  uint8_t cr;                 // Coding rate 4 / cr, 5 .. 8
+  uint16_t preamble;          // Symbols, 6 .. 65535
+  uint8_t sync_word;          // 0x12 private networks, 0x34 LoRaWAN
+  int8_t power_dbm;           // PA_BOOST, 2 .. 17, or 20
+} RFM_Config_t;
+
+typedef struct {
+  // One transaction with chip select held : the address byte (bit 7 set for
+  // a write), then n bytes out of tx or into rx (either NULL).
+  bool (*xfer)(void *ctx, uint8_t addr, const uint8_t *tx, uint8_t *rx, size_t n);
+  uint32_t (*now_us)(void *ctx);
+  void *ctx;
+} RFM_Bus_t;
+
+typedef struct {
+  RFM_Bus_t bus;
+  RFM_Config_t cfg;
+  uint8_t version;
+  bool busy;                  // A packet is on the air
+  uint32_t tx_start_us;
+  uint32_t tx_airtime_us;
+  // Statistics
+  uint32_t sent;              // TxDone seen
+  uint32_t bytes;
+  uint64_t airtime_us;        // Sum of the airtime of the packets sent
+  uint32_t timeouts;          // No TxDone within twice the airtime
+  uint32_t busy_rejects;      // RFM_send() while a packet was on the air
+  uint32_t load_us_max;       // Longest RFM_send(), SPI included
+} RFM_t;
+
+
+/**
+ * @brief Time on air of a packet of len bytes with these settings (explicit header, CRC on).
+ */
+uint32_t RFM_airtime_us(const RFM_Config_t *cfg, size_t len);
+
+/**
+ * @brief Check the radio answers, put it in LoRa mode with cfg and leave it in standby.
+ * @return false if no SX1276 answers or cfg is out of range.
+ */
+bool RFM_init(RFM_t *r, const RFM_Bus_t *bus, const RFM_Config_t *cfg);
+
+/**
+ * @brief Load a packet into the FIFO and start sending it, never waiting for the air.
+ * @return false if a packet is still on the air (call RFM_service() first) or the bus failed.
+ */
+bool RFM_send(RFM_t *r, const void *buf, size_t len);
+
+/**
+ * @brief Check for TxDone (after DIO0 rose, or polled) and free the driver.
+ * @return true if no packet is on the air any more.
+ */
+bool RFM_service(RFM_t *r);
+
+/**
+ * @brief Sleep the radio (~0.2 uA), RFM_send() wakes it again.
+ */
+void RFM_sleep(RFM_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RFM95_H */
@@ -0,0 +1,441 @@
+/**
+ * @file spi_nor.c
+ * @brief W25Q class SPI NOR flash driver : background erases, pipelined page programs, a streaming log.
+ */
+
+#include <string.h>
+#include "spi_nor.h"
+
+
+#define CMD_WRITE_ENABLE 0x06
+#define CMD_READ_STATUS1 0x05
+#define CMD_READ_STATUS2 0x35
+#define CMD_PAGE_PROGRAM 0x02
+#define CMD_FAST_READ 0x0B            // One dummy byte after the address, any SPI clock
+#define CMD_SECTOR_ERASE 0x20
+#define CMD_BLOCK_ERASE 0xD8
+#define CMD_CHIP_ERASE 0xC7
+#define CMD_SUSPEND 0x75
+#define CMD_RESUME 0x7A
+#define CMD_RELEASE_POWER_DOWN 0xAB
+#define CMD_JEDEC_ID 0x9F
+
+#define SR1_BUSY 0x01
+#define SR2_SUS 0x80
+
+
+static uint8_t read_status(NOR_t *n, uint8_t cmd) {
+  uint8_t sr;
+  n->polls++;
+  if (!n->bus.xfer(n->bus.ctx, &cmd, 1, NULL, &sr, 1)) {
+    return 0xFF;                // Busy : a wait ends in a timeout
+  }
+  return sr;
+}
+
+
+static bool command(NOR_t *n, uint8_t cmd, uint32_t addr, bool with_addr, const void *tx, size_t len) {
+  uint8_t c[4] = { cmd, (uint8_t)(addr >> 16), (uint8_t)(addr >> 8), (uint8_t)addr };
+  return n->bus.xfer(n->bus.ctx, c, with_addr ? 4 : 1, (const uint8_t *)tx, NULL, len);
+}
+
+
+static bool in_erase(const NOR_t *n, uint32_t addr, size_t len) {
+  return n->erase_size != 0 && addr < n->erase_addr + n->erase_size && addr + len > n->erase_addr;
+}
+
+
+static void resume(NOR_t *n) {
+  command(n, CMD_RESUME, 0, false, NULL, 0);
+  n->suspended = false;
+  n->op = NOR_OP_ERASE;
+  n->resumed_us = n->bus.now_us(n->bus.ctx);
+}
+
+
+// Suspending an erase that has just ended is harmless : the chip ignores the
+// suspend, and the resume after it, and the next poll finds it idle.
+static bool try_suspend(NOR_t *n) {
+  if ((uint32_t)(n->bus.now_us(n->bus.ctx) - n->resumed_us) < NOR_RESUME_MIN_US) {
+    return false;
+  }
+  command(n, CMD_SUSPEND, 0, false, NULL, 0);
+  n->op = NOR_OP_SUSPEND;
+  n->suspends++;
+  return true;
+}
+
+
+// Whether the operation in progress is over, without resuming an idle suspended erase.
+static void poll(NOR_t *n) {
+  if (n->op == NOR_OP_NONE || (read_status(n, CMD_READ_STATUS1) & SR1_BUSY)) {
+    return;
+  }
+  switch (n->op) {
+    case NOR_OP_PROGRAM:
+      if (n->suspended) {
+        resume(n);
+        return;
+      }
+      break;
+    case NOR_OP_SUSPEND:
+      n->suspended = true;
+      break;
+    case NOR_OP_ERASE:
+      n->erase_size = 0;
+      break;
+    default:
+      break;
+  }
+  n->op = NOR_OP_NONE;
+}
+
+
+static void waited(NOR_t *n, uint32_t t0) {
+  uint32_t us = n->bus.now_us(n->bus.ctx) - t0;
+  if (us > n->wait_max_us) n->wait_max_us = us;
+}
+
+
+// Between polls of a wait; false once the wait has lasted timeout_us (the chip is then taken as idle).
+static bool still_waiting(NOR_t *n, uint32_t t0, uint32_t timeout_us) {
+  uint32_t us = n->bus.now_us(n->bus.ctx) - t0;
+  if (us >= timeout_us) {
+    n->timeouts++;
+    n->op = NOR_OP_NONE;
+    n->suspended = false;
+    n->erase_size = 0;
+    return false;
+  }
+  if (n->bus.idle) n->bus.idle(n->bus.ctx, us);
+  return true;
+}
+
+
+bool NOR_init(NOR_t *n, const NOR_Bus_t *bus) {
+  memset(n, 0, sizeof(*n));
+  n->bus = *bus;
+  uint8_t cmd = CMD_RELEASE_POWER_DOWN;
+  n->bus.xfer(n->bus.ctx, &cmd, 1, NULL, NULL, 0);
+  uint32_t t0 = n->bus.now_us(n->bus.ctx);
+  while ((uint32_t)(n->bus.now_us(n->bus.ctx) - t0) < 5) {
+  }
+  cmd = CMD_JEDEC_ID;
+  if (!n->bus.xfer(n->bus.ctx, &cmd, 1, NULL, n->jedec, sizeof(n->jedec))) {
+    return false;
+  }
+  if (n->jedec[0] == 0x00 || n->jedec[0] == 0xFF || n->jedec[2] < 0x11 || n->jedec[2] > 0x1F) {
+    return false;
+  }
+  n->size = 1UL << n->jedec[2];
+  if (n->size > NOR_MAX_SIZE) {
+    return false;
+  }
+
+  // A reset of the MCU alone leaves the chip as it was : an erase suspended
+  // goes on, anything in progress ends.
+  if (read_status(n, CMD_READ_STATUS2) & SR2_SUS) {
+    resume(n);
+  }
+  n->op = NOR_OP_ERASE;
+  n->erase_addr = 0;
+  n->erase_size = n->size;
+  return NOR_wait(n);
+}
+
+
+bool NOR_service(NOR_t *n) {
+  if (n->op == NOR_OP_NONE && n->suspended) {
+    resume(n);                  // Nothing used the suspend
+  }
+  poll(n);
+  return n->op == NOR_OP_NONE;
+}
+
+
+bool NOR_wait(NOR_t *n) {
+  uint32_t t0 = n->bus.now_us(n->bus.ctx);
+  for (;;) {
+    poll(n);
+    if (n->op == NOR_OP_NONE && n->suspended) {
+      resume(n);
+      continue;
+    }
+    if (n->op == NOR_OP_NONE) {
+      break;
+    }
+    if (!still_waiting(n, t0, NOR_WAIT_TIMEOUT_US)) {
+      return false;
+    }
+  }
+  waited(n, t0);
+  return true;
+}
+
+
+bool NOR_program_start(NOR_t *n, uint32_t addr, const void *buf, size_t len) {
+  if (len == 0 || len > NOR_PAGE_SIZE - addr % NOR_PAGE_SIZE || addr + len > n->size) {
+    return false;
+  }
+  poll(n);
+  if (n->op == NOR_OP_ERASE && !in_erase(n, addr, len)) {
+    try_suspend(n);
+    return false;
+  }
+  if (n->op != NOR_OP_NONE) {
+    return false;
+  }
+  if (n->suspended && in_erase(n, addr, len)) {
+    resume(n);
+    return false;
+  }
+  command(n, CMD_WRITE_ENABLE, 0, false, NULL, 0);
+  command(n, CMD_PAGE_PROGRAM, addr, true, buf, len);
+  n->op = NOR_OP_PROGRAM;
+  n->op_start_us = n->bus.now_us(n->bus.ctx);
+  n->pages++;
+  return true;
+}
+
+
+bool NOR_erase_start(NOR_t *n, uint32_t addr, uint32_t size) {
+  if ((size != NOR_SECTOR_SIZE && size != NOR_BLOCK_SIZE) || addr % size || addr + size > n->size) {
+    return false;
+  }
+  poll(n);
+  if (n->op != NOR_OP_NONE || n->suspended) {
+    return false;
+  }
+  command(n, CMD_WRITE_ENABLE, 0, false, NULL, 0);
+  command(n, size == NOR_BLOCK_SIZE ? CMD_BLOCK_ERASE : CMD_SECTOR_ERASE, addr, true, NULL, 0);
+  n->op = NOR_OP_ERASE;
+  n->erase_addr = addr;
+  n->erase_size = size;
+  n->op_start_us = n->resumed_us = n->bus.now_us(n->bus.ctx);
+  n->erases++;
+  return true;
+}
+
+
+bool NOR_program(NOR_t *n, uint32_t addr, const void *buf, size_t len) {
+  const uint8_t *p = (const uint8_t *)buf;
+  while (len > 0) {
+    size_t take = NOR_PAGE_SIZE - addr % NOR_PAGE_SIZE;
+    if (take > len) take = len;
+    uint32_t t0 = n->bus.now_us(n->bus.ctx);
+    while (!NOR_program_start(n, addr, p, take)) {
+      if (addr + take > n->size || !still_waiting(n, t0, NOR_WAIT_TIMEOUT_US)) {
+        return false;
+      }
+    }
+    waited(n, t0);
+    addr += (uint32_t)take;
+    p += take;
+    len -= take;
+  }
+  return true;
+}
+
+
+bool NOR_erase(NOR_t *n, uint32_t addr, size_t len) {
+  if (addr % NOR_SECTOR_SIZE || len % NOR_SECTOR_SIZE) {
+    return false;
+  }
+  while (len > 0) {
+    uint32_t size = (addr % NOR_BLOCK_SIZE == 0 && len >= NOR_BLOCK_SIZE) ? NOR_BLOCK_SIZE : NOR_SECTOR_SIZE;
+    if (!NOR_wait(n) || !NOR_erase_start(n, addr, size)) {
+      return false;
+    }
+    addr += size;
+    len -= size;
+  }
+  return true;
+}
+
+
+bool NOR_read(NOR_t *n, uint32_t addr, void *buf, size_t len) {
+  if (addr + len > n->size) {
+    return false;
+  }
+  uint32_t t0 = n->bus.now_us(n->bus.ctx);
+  for (;;) {
+    poll(n);
+    if (n->op == NOR_OP_NONE) {
+      if (!n->suspended || !in_erase(n, addr, len)) {
+        break;
+      }
+      resume(n);
+    } else if (n->op == NOR_OP_ERASE && !in_erase(n, addr, len) && try_suspend(n)) {
+      continue;
+    }
+    if (!still_waiting(n, t0, NOR_WAIT_TIMEOUT_US)) {
+      return false;
+    }
+  }
+  waited(n, t0);
+  uint8_t cmd[5] = { CMD_FAST_READ, (uint8_t)(addr >> 16), (uint8_t)(addr >> 8), (uint8_t)addr, 0 };
+  bool ok = n->bus.xfer(n->bus.ctx, cmd, sizeof(cmd), NULL, (uint8_t *)buf, len);
+  if (n->suspended) {
+    resume(n);
+  }
+  return ok;
+}
+
+
+bool NOR_erase_chip(NOR_t *n, uint32_t timeout_s) {
+  if (!NOR_wait(n)) {
+    return false;
+  }
+  command(n, CMD_WRITE_ENABLE, 0, false, NULL, 0);
+  command(n, CMD_CHIP_ERASE, 0, false, NULL, 0);
+  n->op = NOR_OP_ERASE;
+  n->erase_addr = 0;
+  n->erase_size = n->size;
+  n->erases++;
+  uint32_t t0 = n->bus.now_us(n->bus.ctx);
+  while (n->op != NOR_OP_NONE) {
+    poll(n);
+    if (n->op != NOR_OP_NONE && !still_waiting(n, t0, timeout_s * 1000000UL)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Streaming log
+//--------------------------------------------------------------------------------------------
+static bool page_blank(NOR_t *n, uint32_t addr, bool *blank) {
+  uint32_t words[NOR_PAGE_SIZE / 4];
+  if (!NOR_read(n, addr, words, sizeof(words))) {
+    return false;
+  }
+  *blank = true;
+  for (size_t i = 0; i < NOR_PAGE_SIZE / 4; i++) {
+    if (words[i] != 0xFFFFFFFFu) *blank = false;
+  }
+  return true;
+}
+
+
+// Pages are written in order and the chip erased after each read out, so the
+// log is the pages before the first blank one : log2(pages) + 1 page reads.
+// A page torn by a power cut is not blank, the log goes on after it.
+bool NOR_log_open(NOR_Log_t *l, NOR_t *n, uint32_t start, uint32_t end, uint32_t runway) {
+  memset(l, 0, sizeof(*l));
+  l->nor = n;
+  l->start = start - start % NOR_BLOCK_SIZE;
+  l->end = end > n->size ? n->size : end - end % NOR_BLOCK_SIZE;
+  l->runway = runway;
+  uint32_t lo = l->start / NOR_PAGE_SIZE, hi = l->end / NOR_PAGE_SIZE;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    bool blank;
+    if (!page_blank(n, mid * NOR_PAGE_SIZE, &blank)) {
+      return false;
+    }
+    if (blank) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  l->head = lo * NOR_PAGE_SIZE;
+  l->erased = (l->head + NOR_BLOCK_SIZE - 1) / NOR_BLOCK_SIZE * NOR_BLOCK_SIZE;
+  if (l->erased > l->end) l->erased = l->end;
+
+  // Blocks after the head's are erased before use, the rest of its own block
+  // is programmed as it is : the log goes on after any page a power cut left
+  // bits in (a torn erase ahead, a torn page after a blank one).
+  for (uint32_t addr = l->head; addr < l->erased; addr += NOR_PAGE_SIZE) {
+    bool blank;
+    if (!page_blank(n, addr, &blank)) {
+      return false;
+    }
+    if (!blank) l->head = addr + NOR_PAGE_SIZE;
+  }
+  return true;
+}
+
+
+size_t NOR_log_write(NOR_Log_t *l, const void *data, size_t len) {
+  // Whole or not at all : the records stay whole.
+  uint32_t waiting = l->filled - l->programmed;
+  if (waiting >= NOR_LOG_PAGES || len > (NOR_LOG_PAGES - waiting) * NOR_PAGE_SIZE - l->fill) {
+    l->dropped += (uint32_t)len;
+    return 0;
+  }
+  const uint8_t *p = (const uint8_t *)data;
+  size_t left = len;
+  while (left > 0) {
+    size_t take = NOR_PAGE_SIZE - l->fill;
+    if (take > left) take = left;
+    memcpy(l->page[l->filled % NOR_LOG_PAGES] + l->fill, p, take);
+    l->fill += (uint16_t)take;
+    p += take;
+    left -= take;
+    if (l->fill == NOR_PAGE_SIZE) {
+      l->full_us[l->filled % NOR_LOG_PAGES] = l->nor->bus.now_us(l->nor->bus.ctx);
+      l->filled++;
+      l->fill = 0;
+    }
+  }
+  if (l->programmed < l->filled) {
+    NOR_log_service(l);
+  }
+  return len;
+}
+
+
+void NOR_log_service(NOR_Log_t *l) {
+  NOR_t *n = l->nor;
+  NOR_service(n);
+
+  if (l->programmed < l->filled) {
+    uint32_t slot = l->programmed % NOR_LOG_PAGES;
+    if (l->head >= l->end) {
+      l->dropped += NOR_PAGE_SIZE;      // Log area full
+      l->programmed++;
+      return;
+    }
+    if (l->head < l->erased) {
+      if (in_erase(n, l->head, NOR_PAGE_SIZE) && l->erase_wait_page != l->programmed + 1) {
+        l->erase_waits++;
+        l->erase_wait_page = l->programmed + 1;
+      }
+      if (NOR_program_start(n, l->head, l->page[slot], NOR_PAGE_SIZE)) {
+        uint32_t us = n->op_start_us - l->full_us[slot];
+        if (us > l->page_wait_max_us) l->page_wait_max_us = us;
+        l->programmed++;
+        l->head += NOR_PAGE_SIZE;
+      }
+      return;
+    }
+  }
+
+  // Erase ahead while nothing waits, or when the next page needs it.
+  if (l->erased < l->end && l->erased - l->head < l->runway + NOR_PAGE_SIZE &&
+      NOR_erase_start(n, l->erased, NOR_BLOCK_SIZE)) {
+    l->erased += NOR_BLOCK_SIZE;
+  }
+}
+
+
+bool NOR_log_flush(NOR_Log_t *l) {
+  if (l->fill > 0 && l->filled - l->programmed < NOR_LOG_PAGES) {
+    // Programming 0xFF leaves the end of the page blank.
+    memset(l->page[l->filled % NOR_LOG_PAGES] + l->fill, 0xFF, NOR_PAGE_SIZE - l->fill);
+    l->full_us[l->filled % NOR_LOG_PAGES] = l->nor->bus.now_us(l->nor->bus.ctx);
+    l->filled++;
+    l->fill = 0;
+  }
+  uint32_t t0 = l->nor->bus.now_us(l->nor->bus.ctx);
+  while (l->programmed < l->filled) {
+    NOR_log_service(l);
+    if (l->programmed < l->filled && !still_waiting(l->nor, t0, NOR_WAIT_TIMEOUT_US)) {
+      return false;
+    }
+  }
+  return NOR_wait(l->nor);
+}
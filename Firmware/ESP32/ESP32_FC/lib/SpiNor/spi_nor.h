@@ -0,0 +1,207 @@
+/**
+ * @file spi_nor.h
+ * @brief W25Q class SPI NOR flash driver : background erases, pipelined page programs, a streaming log.
+ *
+ * A log chip on its own SPI bus, away from the SD card and the program
+ * flash : a Winbond W25Q (W25Q128JV, 16 MB) or any NOR with the same command
+ * set, 3 byte addresses (16 MB at most). Pages of 256 bytes are programmed
+ * (~0.4 ms), sectors of 4 KB (~45 ms) and blocks of 64 KB (~150 ms) erased.
+ *
+ * The driver never waits for the chip unless asked to. NOR_erase() and
+ * NOR_program() start the operation and return; the next call that needs
+ * the chip finds out from its status register whether it is done. An erase
+ * goes on in the background : a page to program outside the sector being
+ * erased suspends the erase (75h), is programmed and resumes it (7Ah), so
+ * erasing ahead of the log never holds a page back for the length of an
+ * erase. NOR_RESUME_MIN_US of erase is let run between two suspends, or an
+ * erase under a steady stream of pages would never end. A program or read
+ * inside the area being erased waits for the erase. NOR_read() is the only
+ * call that waits for data, and it too suspends an erase elsewhere.
+ *
+ * Two ways to log :
+ *
+ * - The flash ring (lib/FlashRing) on the chip : NOR_read(), NOR_program()
+ *   and NOR_erase() are its FRING_Io_t callbacks (main.cpp,
+ *   FLASH_LOG_DEVICE). The ring's slots go in 16 pipelined pages, sectors
+ *   are erased ahead in flight as well as on the pad, the chip being on
+ *   its own bus.
+ *
+ * - A streaming log (NOR_Log_t) for a board too small for a 4 KB slot (the
+ *   STM32G030, 8 KB of RAM) : records are copied into a ring of
+ *   NOR_LOG_PAGES page buffers, the next page filled while the last one
+ *   programs. NOR_log_service() in the main loop starts the next page
+ *   program the moment the chip is free and erases blocks ahead in between.
+ *   NOR_log_write() never waits : bytes finding every buffer full are
+ *   dropped and counted. The log is linear
+ *   from the start of the chip; at boot its end is found by binary search
+ *   for the first blank page, so the chip must be erased (NOR_erase_chip())
+ *   once its log is read out. Blocks ahead are erased again before use
+ *   without a blank check (one erase cycle per block and flight, of 100k),
+ *   so a block a power cut left half erased is never programmed over.
+ *
+ * The bus is reached through NOR_Bus_t callbacks : the Arduino SPI library
+ * on the flight computer, SPI1 registers on the STM32G030
+ * (Firmware/STM32/Drivers/Sensors/W25Q), a chip model in the host tools
+ * (Tools/common/mock_w25q.h). This file is plain C with no platform
+ * dependencies so the STM32 board builds the same source.
+ */
+
+#ifndef SPI_NOR_H
+#define SPI_NOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define NOR_PAGE_SIZE 256
+#define NOR_SECTOR_SIZE 4096
+#define NOR_BLOCK_SIZE 65536
+#define NOR_MAX_SIZE (16UL * 1024 * 1024)   // 3 byte addresses
+
+#ifndef NOR_RESUME_MIN_US
+#define NOR_RESUME_MIN_US 200         // Erase time let run between two suspends (assumed, the datasheet gives none)
+#endif
+
+#ifndef NOR_WAIT_TIMEOUT_US
+#define NOR_WAIT_TIMEOUT_US 3000000   // Longest wait for the chip, a 64 KB block erase (2 s datasheet maximum)
+#endif
+
+#ifndef NOR_LOG_PAGES
+#define NOR_LOG_PAGES 4               // Page buffers of the streaming log, 1 KB : a once a second burst of records (~0.6 KB) while a page programs
+#endif
+
+typedef enum {
+  NOR_OP_NONE = 0,            // Ready for a command
+  NOR_OP_PROGRAM,             // Page program, maybe over a suspended erase
+  NOR_OP_ERASE,               // Sector or block erase
+  NOR_OP_SUSPEND,             // Erase being suspended (~20 us)
+} NOR_Op_t;
+
+typedef struct {
+  // One transaction with chip select held : n_cmd bytes out, then n bytes out of tx or into rx (either NULL).
+  bool (*xfer)(void *ctx, const uint8_t *cmd, size_t n_cmd, const uint8_t *tx, uint8_t *rx, size_t n);
+  uint32_t (*now_us)(void *ctx);
+  void (*idle)(void *ctx, uint32_t waited_us);  // Between status polls of a wait, may be NULL
+  void *ctx;
+} NOR_Bus_t;
+
+typedef struct {
+  NOR_Bus_t bus;
+  uint8_t jedec[3];           // Manufacturer, memory type, capacity
+  uint32_t size;              // Bytes
+  NOR_Op_t op;
+  bool suspended;             // An erase is suspended under op
+  uint32_t erase_addr;        // Erase in progress or suspended
+  uint32_t erase_size;
+  uint32_t resumed_us;        // Last resume, the next suspend not before NOR_RESUME_MIN_US
+  uint32_t op_start_us;
+  // Statistics
+  uint32_t pages;             // Page programs started
+  uint32_t erases;            // Sector and block erases started
+  uint32_t suspends;
+  uint32_t polls;             // Status register reads
+  uint32_t timeouts;          // Waits given up (the chip is then taken as ready)
+  uint32_t wait_max_us;       // Longest wait inside a call
+} NOR_t;
+
+// Streaming log, linear from start to end.
+typedef struct {
+  NOR_t *nor;
+  uint32_t start, end;        // Log area, block aligned
+  uint32_t head;              // Next page to program
+  uint32_t erased;            // The log area is erased from head to here (block aligned)
+  uint32_t runway;            // Bytes kept erased ahead of head
+  uint8_t page[NOR_LOG_PAGES][NOR_PAGE_SIZE];
+  uint32_t filled;            // Pages filled, page[filled % NOR_LOG_PAGES] is being filled
+  uint32_t programmed;        // Pages handed to the chip
+  uint16_t fill;              // Bytes in the page being filled
+  uint32_t full_us[NOR_LOG_PAGES];  // When each page was filled
+  uint32_t erase_wait_page;   // programmed + 1 of the last page counted in erase_waits
+  // Statistics
+  uint32_t dropped;           // Bytes not logged : every buffer full, or the log area full
+  uint32_t page_wait_max_us;  // Longest a full page waited for the chip
+  uint32_t erase_waits;       // Pages that waited for an erase of their own block
+} NOR_Log_t;
+
+
+/**
+ * @brief Wake the chip, read its JEDEC id and settle any operation left from before a reset.
+ * @return false if no W25Q class chip of at most 16 MB answers.
+ */
+bool NOR_init(NOR_t *n, const NOR_Bus_t *bus);
+
+/**
+ * @brief Poll the chip once and move the driver on (an operation done, an erase to resume).
+ * @return true if the chip takes a command now.
+ */
+bool NOR_service(NOR_t *n);
+
+/**
+ * @brief Wait until programs and erases are over, a suspended erase resumed first. false on timeout.
+ */
+bool NOR_wait(NOR_t *n);
+
+/**
+ * @brief Start programming up to one page at addr (not across a page boundary), never waiting.
+ * @return false if the chip is busy : call NOR_service() and try again. An erase elsewhere is suspended.
+ */
+bool NOR_program_start(NOR_t *n, uint32_t addr, const void *buf, size_t len);
+
+/**
+ * @brief Start erasing the sector or block (NOR_SECTOR_SIZE, NOR_BLOCK_SIZE) at addr, never waiting.
+ * @return false if the chip is busy or an erase is already suspended.
+ */
+bool NOR_erase_start(NOR_t *n, uint32_t addr, uint32_t size);
+
+/**
+ * @brief Program n bytes, page by page, each started as soon as the chip is free. The last is left programming.
+ */
+bool NOR_program(NOR_t *n, uint32_t addr, const void *buf, size_t len);
+
+/**
+ * @brief Erase whole sectors (4 KB aligned); blocks where 64 KB aligned. The last is left erasing.
+ */
+bool NOR_erase(NOR_t *n, uint32_t addr, size_t len);
+
+/**
+ * @brief Read n bytes, once programs are done and any erase of that area is over.
+ */
+bool NOR_read(NOR_t *n, uint32_t addr, void *buf, size_t len);
+
+/**
+ * @brief Erase the whole chip and wait for it (up to ~200 s for 16 MB).
+ */
+bool NOR_erase_chip(NOR_t *n, uint32_t timeout_s);
+
+/**
+ * @brief Open the streaming log on [start, end) : find its end, keep runway bytes erased ahead.
+ * @return false if a read fails.
+ */
+bool NOR_log_open(NOR_Log_t *l, NOR_t *n, uint32_t start, uint32_t end, uint32_t runway);
+
+/**
+ * @brief Copy bytes into the page buffers, never waiting.
+ * @return Bytes taken, the rest is dropped (counted).
+ */
+size_t NOR_log_write(NOR_Log_t *l, const void *data, size_t len);
+
+/**
+ * @brief Program a full page as soon as the chip is free, erase ahead in between. Call from the main loop.
+ */
+void NOR_log_service(NOR_Log_t *l);
+
+/**
+ * @brief Close the page being filled (its unused end stays blank) and program everything, waiting.
+ */
+bool NOR_log_flush(NOR_Log_t *l);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPI_NOR_H */
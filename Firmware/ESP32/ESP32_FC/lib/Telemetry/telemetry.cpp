@@ -0,0 +1,568 @@
+/**
+ * @file telemetry.cpp
+ * @brief LoRa telemetry downlink : bit packed state packets, flight phase and a scheduler paced by airtime.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "telemetry.h"
+
+
+#define APOGEE_PHASE_ASCENT 1         // APOGEE_Phase_t, lib/ApogeeDetect
+#define APOGEE_PHASE_DESCENT 2
+
+static_assert(TLM_STATE_SIZE <= TLM_MAX_PACKET && TLM_BEACON_SIZE <= TLM_MAX_PACKET && TLM_DELTA_SIZE <= TLM_MAX_PACKET,
+              "packet over TLM_MAX_PACKET");
+static_assert(1 + TLM_STATE_SIZE <= TLM_FEC_SYMBOL && TLM_FEC_SYMBOL <= FEC_MAX_SYMBOL, "REPAIR symbol");
+static_assert(FEC_MAX_M <= 4 && FEC_MAX_K <= 16, "REPAIR ROW and K - 1 fields");
+
+#define T_MASK 0xFFFFFF               // T field, 10 ms
+
+
+typedef struct {
+  uint8_t *out;
+  uint32_t bits;              // Waiting in acc, fewer than 8 between calls
+  uint64_t acc;
+} BitWriter_t;
+
+typedef struct {
+  const uint8_t *in;
+  const uint8_t *end;
+  uint32_t bits;              // Left in acc
+  uint64_t acc;
+} BitReader_t;
+
+
+static void put_bits(BitWriter_t *w, uint32_t v, uint32_t n) {
+  w->acc |= (uint64_t)(v & ((1ULL << n) - 1)) << w->bits;
+  w->bits += n;
+  while (w->bits >= 8) {
+    *w->out++ = (uint8_t)w->acc;
+    w->acc >>= 8;
+    w->bits -= 8;
+  }
+}
+
+
+static void flush_bits(BitWriter_t *w) {
+  if (w->bits) {
+    *w->out++ = (uint8_t)w->acc;
+    w->acc = 0;
+    w->bits = 0;
+  }
+}
+
+
+static uint32_t get_bits(BitReader_t *r, uint32_t n) {
+  while (r->bits < n) {
+    r->acc |= (uint64_t)(r->in < r->end ? *r->in++ : 0) << r->bits;
+    r->bits += 8;
+  }
+  uint32_t v = (uint32_t)(r->acc & ((1ULL << n) - 1));
+  r->acc >>= n;
+  r->bits -= n;
+  return v;
+}
+
+
+// v / scale rounded, clamped to a signed field of n bits.
+static void put_signed(BitWriter_t *w, double v, double scale, uint32_t n) {
+  double lim = (double)((1L << (n - 1)) - 1);
+  double q = isnan(v) ? 0.0 : round(v / scale);
+  q = q > lim ? lim : (q < -lim - 1 ? -lim - 1 : q);
+  put_bits(w, (uint32_t)(int32_t)q, n);
+}
+
+
+static int32_t get_signed(BitReader_t *r, uint32_t n) {
+  uint32_t v = get_bits(r, n);
+  return (int32_t)(v << (32 - n)) >> (32 - n);
+}
+
+
+static void put_unsigned(BitWriter_t *w, uint32_t v, uint32_t n) {
+  uint32_t lim = (1UL << n) - 1;
+  put_bits(w, v > lim ? lim : v, n);
+}
+
+
+// v / scale rounded, as put_signed() sends it before the clamp.
+static int32_t quantize(double v, double scale) {
+  return isnan(v) ? 0 : (int32_t)lround(v / scale);
+}
+
+
+static bool fits(int32_t v, uint32_t n) {
+  return v >= -(1L << (n - 1)) && v < (1L << (n - 1));
+}
+
+
+static void put_gps(BitWriter_t *w, const TLM_State_t *s) {
+  put_signed(w, s->lat_e7, 100.0, 25);
+  put_signed(w, s->lon_e7, 100.0, 26);
+  put_signed(w, s->gps_height_mm, 1000.0, 17);
+  put_unsigned(w, s->gps_fix, 2);
+}
+
+
+static void get_gps(BitReader_t *r, TLM_State_t *s) {
+  s->lat_e7 = get_signed(r, 25) * 100;
+  s->lon_e7 = get_signed(r, 26) * 100;
+  s->gps_height_mm = get_signed(r, 17) * 1000;
+  s->gps_fix = (uint8_t)get_bits(r, 2);
+}
+
+
+size_t TLM_encode(uint8_t type, uint16_t seq, const TLM_State_t *state, uint8_t *out) {
+  if (type >= TLM_PKT_TYPES || type == TLM_PKT_DELTA) {
+    return 0;
+  }
+  BitWriter_t w = { out, 0, 0 };
+  put_bits(&w, type, 3);
+  put_bits(&w, seq & TLM_SEQ_MASK, 13);
+  put_bits(&w, state->phase, 3);
+  put_bits(&w, (uint32_t)(state->t_us / 10000) & T_MASK, 24);
+  if (type == TLM_PKT_STATE) {
+    put_signed(&w, state->altitude, 0.1, 20);
+    put_signed(&w, state->velocity, 0.1, 15);
+    put_signed(&w, state->acceleration, 0.1, 16);
+    put_signed(&w, state->max_altitude, 0.1, 20);
+    put_gps(&w, state);
+    put_unsigned(&w, state->battery_mv / 40, 8);
+    put_bits(&w, state->health, 8);
+    put_unsigned(&w, state->samples_dropped, 8);
+    put_unsigned(&w, state->blocks_dropped, 8);
+  } else {
+    put_gps(&w, state);
+    put_signed(&w, state->max_altitude, 0.1, 20);
+    put_unsigned(&w, state->battery_mv / 40, 8);
+    put_bits(&w, state->health, 8);
+  }
+  flush_bits(&w);
+  return (size_t)(w.out - out);
+}
+
+
+size_t TLM_encode_delta(uint16_t seq, uint8_t key_index, const TLM_State_t *key, const TLM_State_t *state,
+                        uint8_t *out) {
+  // Differences of what the ground decoded from the keyframe, so the rounding never adds up.
+  uint32_t dt = ((uint32_t)(state->t_us / 10000) - (uint32_t)(key->t_us / 10000)) & T_MASK;
+  int32_t alt = quantize(state->altitude, 0.1) - quantize(key->altitude, 0.1);
+  int32_t vel = quantize(state->velocity, 0.1);
+  int32_t acc = quantize(state->acceleration, 0.1);
+  int32_t lat = quantize(state->lat_e7, 100.0) - quantize(key->lat_e7, 100.0);
+  int32_t lon = quantize(state->lon_e7, 100.0) - quantize(key->lon_e7, 100.0);
+  if (key_index == 0 || key_index >= TLM_KEYFRAME_MAX || dt >= (1u << 10) || !fits(alt, 16) || !fits(vel, 15) ||
+      !fits(acc, 15) || !fits(lat, 8) || !fits(lon, 8)) {
+    return 0;
+  }
+  BitWriter_t w = { out, 0, 0 };
+  put_bits(&w, TLM_PKT_DELTA, 3);
+  put_bits(&w, seq & TLM_SEQ_MASK, 13);
+  put_bits(&w, state->phase, 3);
+  put_bits(&w, key_index, 4);
+  put_bits(&w, dt, 10);
+  put_bits(&w, (uint32_t)alt, 16);
+  put_bits(&w, (uint32_t)vel, 15);
+  put_bits(&w, (uint32_t)acc, 15);
+  put_bits(&w, (uint32_t)lat, 8);
+  put_bits(&w, (uint32_t)lon, 8);
+  flush_bits(&w);
+  return (size_t)(w.out - out);
+}
+
+
+size_t TLM_encode_repair(uint16_t base, uint8_t k, uint8_t row, const uint8_t *const symbols[], size_t sym_len,
+                         uint8_t *out) {
+  BitWriter_t w = { out, 0, 0 };
+  put_bits(&w, TLM_PKT_REPAIR, 3);
+  put_bits(&w, base & TLM_SEQ_MASK, 13);
+  put_bits(&w, row, 2);
+  put_bits(&w, k - 1, 4);
+  put_bits(&w, 0, 2);
+  FEC_encode(symbols, k, sym_len, row, out + TLM_REPAIR_HEADER);
+  return TLM_REPAIR_HEADER + sym_len;
+}
+
+
+bool TLM_decode(const uint8_t *buf, size_t len, TLM_Packet_t *pkt) {
+  memset(pkt, 0, sizeof(*pkt));
+  if (len == 0) {
+    return false;
+  }
+  BitReader_t r = { buf, buf + len, 0, 0 };
+  pkt->type = (uint8_t)get_bits(&r, 3);
+  if ((pkt->type == TLM_PKT_STATE && len != TLM_STATE_SIZE) ||
+      (pkt->type == TLM_PKT_BEACON && len != TLM_BEACON_SIZE) ||
+      (pkt->type == TLM_PKT_DELTA && len != TLM_DELTA_SIZE) ||
+      (pkt->type == TLM_PKT_REPAIR && (len < TLM_REPAIR_HEADER + 2 || len > TLM_MAX_PACKET)) ||
+      pkt->type >= TLM_PKT_TYPES) {
+    return false;
+  }
+  TLM_State_t *s = &pkt->state;
+  pkt->seq = (uint16_t)get_bits(&r, 13);
+  if (pkt->type == TLM_PKT_REPAIR) {
+    pkt->fec_row = (uint8_t)get_bits(&r, 2);
+    pkt->fec_k = (uint8_t)(get_bits(&r, 4) + 1);
+    return true;
+  }
+  s->phase = (uint8_t)get_bits(&r, 3);
+  if (pkt->type == TLM_PKT_DELTA) {
+    pkt->key_index = (uint8_t)get_bits(&r, 4);
+    s->t_us = (uint64_t)get_bits(&r, 10) * 10000;
+    s->altitude = get_signed(&r, 16) * 0.1f;
+    s->velocity = get_signed(&r, 15) * 0.1f;
+    s->acceleration = get_signed(&r, 15) * 0.1f;
+    s->lat_e7 = get_signed(&r, 8) * 100;
+    s->lon_e7 = get_signed(&r, 8) * 100;
+    return true;
+  }
+  s->t_us = (uint64_t)get_bits(&r, 24) * 10000;
+  if (pkt->type == TLM_PKT_STATE) {
+    s->altitude = get_signed(&r, 20) * 0.1f;
+    s->velocity = get_signed(&r, 15) * 0.1f;
+    s->acceleration = get_signed(&r, 16) * 0.1f;
+    s->max_altitude = get_signed(&r, 20) * 0.1f;
+    get_gps(&r, s);
+    s->battery_mv = (uint16_t)(get_bits(&r, 8) * 40);
+    s->health = (uint8_t)get_bits(&r, 8);
+    s->samples_dropped = get_bits(&r, 8);
+    s->blocks_dropped = get_bits(&r, 8);
+  } else {
+    get_gps(&r, s);
+    s->max_altitude = get_signed(&r, 20) * 0.1f;
+    s->battery_mv = (uint16_t)(get_bits(&r, 8) * 40);
+    s->health = (uint8_t)get_bits(&r, 8);
+  }
+  return true;
+}
+
+
+void TLM_rx_init(TLM_Receiver_t *rx) {
+  memset(rx, 0, sizeof(*rx));
+  rx->last_seq = -1;
+}
+
+
+static TLM_RxSlot_t *slot_of(TLM_Receiver_t *rx, uint16_t seq) {
+  return &rx->history[seq % TLM_RX_HISTORY];
+}
+
+
+// The slot holding packet seq, NULL if it was not received or is out of the history.
+static TLM_RxSlot_t *held(TLM_Receiver_t *rx, uint16_t seq) {
+  TLM_RxSlot_t *slot = slot_of(rx, seq);
+  return (slot->len && slot->seq == seq) ? slot : NULL;
+}
+
+
+static void keep(TLM_Receiver_t *rx, uint16_t seq, const uint8_t *buf, size_t len, bool rebuilt) {
+  TLM_RxSlot_t *slot = slot_of(rx, seq);
+  slot->len = (uint8_t)len;
+  slot->seq = seq;
+  slot->no_key = false;
+  slot->rebuilt = rebuilt;
+  memcpy(slot->bytes, buf, len);
+}
+
+
+// Keyframe key_seq : the newest one, else one still in the history.
+static bool key_of(TLM_Receiver_t *rx, uint16_t key_seq, TLM_State_t *key) {
+  if (rx->have_key && key_seq == rx->key_seq) {
+    *key = rx->key;
+    return true;
+  }
+  TLM_RxSlot_t *slot = held(rx, key_seq);
+  TLM_Packet_t k;
+  if (slot && TLM_decode(slot->bytes, slot->len, &k) && k.type == TLM_PKT_STATE) {
+    *key = k.state;
+    return true;
+  }
+  return false;
+}
+
+
+// A DELTA whole from its keyframe, false if the keyframe is not there.
+static bool apply_delta(TLM_Receiver_t *rx, TLM_Packet_t *pkt) {
+  TLM_State_t key;
+  if (!key_of(rx, (uint16_t)((pkt->seq - pkt->key_index) & TLM_SEQ_MASK), &key)) {
+    return false;
+  }
+  TLM_State_t d = pkt->state;
+  TLM_State_t *s = &pkt->state;
+  *s = key;
+  s->phase = d.phase;
+  s->t_us = (((key.t_us / 10000) + d.t_us / 10000) & T_MASK) * 10000;
+  s->altitude = (quantize(key.altitude, 0.1) + quantize(d.altitude, 0.1)) * 0.1f;
+  s->velocity = d.velocity;
+  s->acceleration = d.acceleration;
+  s->lat_e7 = key.lat_e7 + d.lat_e7;
+  s->lon_e7 = key.lon_e7 + d.lon_e7;
+  if (s->altitude > s->max_altitude) s->max_altitude = s->altitude;
+  return true;
+}
+
+
+// Rebuild what the group lost once there are as many REPAIRs, and set TLM_rebuilt() going.
+static void rebuild(TLM_Receiver_t *rx) {
+  uint8_t k = rx->repair_k;
+  uint8_t len = rx->repair_len;
+  uint16_t base = rx->repair_base;
+  uint16_t age = (uint16_t)((rx->last_seq - base) & TLM_SEQ_MASK);
+  if (rx->last_seq >= 0 && age >= TLM_RX_HISTORY && age <= TLM_SEQ_MASK / 2) {
+    rx->repair_done = true;           // The group is out of the history
+    return;
+  }
+
+  uint8_t sym[FEC_MAX_K][TLM_FEC_SYMBOL];
+  uint8_t *data[FEC_MAX_K];
+  uint32_t have = 0;
+  for (uint8_t i = 0; i < k; i++) {
+    data[i] = sym[i];
+    TLM_RxSlot_t *slot = held(rx, (uint16_t)((base + i) & TLM_SEQ_MASK));
+    if (!slot) continue;
+    if (slot->len + 1 > len) {
+      rx->repair_done = true;         // Not the group the REPAIRs were made over
+      return;
+    }
+    sym[i][0] = slot->len;
+    memcpy(sym[i] + 1, slot->bytes, slot->len);
+    memset(sym[i] + 1 + slot->len, 0, len - 1 - slot->len);
+    have |= 1UL << i;
+  }
+  if (have == (1UL << k) - 1) {
+    rx->repair_done = true;           // Nothing lost
+    return;
+  }
+  const uint8_t *repair[FEC_MAX_M];
+  for (uint8_t n = 0; n < rx->repairs; n++) repair[n] = rx->repair[n];
+  if (!FEC_decode(data, have, k, repair, rx->repair_rows, rx->repairs, len)) {
+    return;                           // Not enough REPAIRs yet
+  }
+  rx->repair_done = true;
+
+  uint16_t last = (uint16_t)((base + k - 1) & TLM_SEQ_MASK);
+  for (uint8_t i = 0; i < k; i++) {
+    uint16_t seq = (uint16_t)((base + i) & TLM_SEQ_MASK);
+    TLM_Packet_t p;
+    uint8_t n = sym[i][0];
+    if ((have & (1UL << i)) || n == 0 || n + 1 > len || !TLM_decode(sym[i] + 1, n, &p) ||
+        p.type == TLM_PKT_REPAIR || p.seq != seq) {
+      continue;
+    }
+    keep(rx, seq, sym[i] + 1, n, true);
+  }
+  // Hand out from the group's start up to the newest packet, received or rebuilt.
+  if (rx->last_seq >= 0 && ((rx->last_seq - last) & TLM_SEQ_MASK) <= TLM_SEQ_MASK / 2) {
+    last = (uint16_t)rx->last_seq;
+  }
+  rx->late_seq = base;
+  rx->late_left = (uint16_t)(((last - base) & TLM_SEQ_MASK) + 1);
+  if (rx->late_left > TLM_RX_HISTORY) rx->late_left = TLM_RX_HISTORY;
+}
+
+
+static void take_repair(TLM_Receiver_t *rx, const TLM_Packet_t *pkt, const uint8_t *buf, size_t len) {
+  uint8_t sym_len = (uint8_t)(len - TLM_REPAIR_HEADER);
+  if (rx->repairs == 0 || pkt->seq != rx->repair_base || pkt->fec_k != rx->repair_k || sym_len != rx->repair_len) {
+    rx->repairs = 0;                  // A new group
+    rx->repair_base = pkt->seq;
+    rx->repair_k = pkt->fec_k;
+    rx->repair_len = sym_len;
+    rx->repair_done = false;
+  }
+  if (rx->repair_done || rx->repairs == FEC_MAX_M) {
+    return;
+  }
+  for (uint8_t n = 0; n < rx->repairs; n++) {
+    if (rx->repair_rows[n] == pkt->fec_row) return;
+  }
+  memcpy(rx->repair[rx->repairs], buf + TLM_REPAIR_HEADER, sym_len);
+  rx->repair_rows[rx->repairs++] = pkt->fec_row;
+  rebuild(rx);
+}
+
+
+TLM_RxStatus_t TLM_receive(TLM_Receiver_t *rx, const uint8_t *buf, size_t len, TLM_Packet_t *pkt) {
+  if (!TLM_decode(buf, len, pkt)) {
+    rx->bad++;
+    return TLM_RX_BAD;
+  }
+  rx->received[pkt->type]++;
+  if (pkt->type == TLM_PKT_REPAIR) {
+    take_repair(rx, pkt, buf, len);
+    return TLM_RX_REPAIR;
+  }
+  if (rx->last_seq >= 0) {
+    uint32_t gap = (pkt->seq - (uint32_t)rx->last_seq - 1) & TLM_SEQ_MASK;
+    if (gap <= TLM_SEQ_MASK / 2) rx->lost += gap;    // Else repeated or the board restarted
+  }
+  rx->last_seq = pkt->seq;
+  keep(rx, pkt->seq, buf, len, false);
+
+  if (pkt->type == TLM_PKT_STATE) {
+    rx->key = pkt->state;
+    rx->key_seq = pkt->seq;
+    rx->have_key = true;
+  } else if (pkt->type == TLM_PKT_DELTA) {
+    if (!apply_delta(rx, pkt)) {
+      slot_of(rx, pkt->seq)->no_key = true;
+      rx->no_key++;
+      return TLM_RX_NO_KEY;
+    }
+  }
+  return TLM_RX_OK;
+}
+
+
+bool TLM_rebuilt(TLM_Receiver_t *rx, TLM_Packet_t *pkt) {
+  while (rx->late_left) {
+    uint16_t seq = rx->late_seq;
+    rx->late_seq = (uint16_t)((seq + 1) & TLM_SEQ_MASK);
+    rx->late_left--;
+    TLM_RxSlot_t *slot = held(rx, seq);
+    if (!slot || !(slot->rebuilt || slot->no_key)) continue;
+    TLM_decode(slot->bytes, slot->len, pkt);
+
+    if (!slot->rebuilt) {             // A DELTA dropped before : its keyframe may be back
+      if (!apply_delta(rx, pkt)) continue;
+      slot->no_key = false;
+      rx->no_key--;
+      rx->rekeyed++;
+      return true;
+    }
+    slot->rebuilt = false;
+    rx->rebuilt++;
+    uint32_t ahead = (seq - (uint32_t)rx->last_seq) & TLM_SEQ_MASK;
+    if (rx->last_seq < 0 || (ahead != 0 && ahead <= TLM_SEQ_MASK / 2)) {
+      if (rx->last_seq >= 0) rx->lost += ahead - 1;   // Past the newest received : as if received now
+      rx->last_seq = seq;
+    } else if (rx->lost) {
+      rx->lost--;
+    }
+    if (pkt->type == TLM_PKT_STATE) {
+      uint32_t newer = (seq - (uint32_t)rx->key_seq) & TLM_SEQ_MASK;
+      if (!rx->have_key || (newer != 0 && newer <= TLM_SEQ_MASK / 2)) {
+        rx->key = pkt->state;
+        rx->key_seq = seq;
+        rx->have_key = true;
+      }
+    } else if (pkt->type == TLM_PKT_DELTA && !apply_delta(rx, pkt)) {
+      slot->no_key = true;
+      rx->no_key++;
+      continue;
+    }
+    return true;
+  }
+  return false;
+}
+
+
+void TLM_phase_init(TLM_PhaseTracker_t *p) {
+  p->phase = TLM_PHASE_PAD;
+  p->still_since_us = -1;
+}
+
+
+TLM_Phase_t TLM_phase_update(TLM_PhaseTracker_t *p, int64_t t_us, uint8_t apogee_phase, float velocity,
+                             float acceleration) {
+  switch (p->phase) {
+    case TLM_PHASE_PAD:
+      if (apogee_phase == APOGEE_PHASE_ASCENT) p->phase = TLM_PHASE_BOOST;
+      break;
+    case TLM_PHASE_BOOST:
+      if (acceleration < 0.0f) p->phase = TLM_PHASE_COAST;      // Drag and gravity only
+      if (apogee_phase == APOGEE_PHASE_DESCENT) p->phase = TLM_PHASE_DESCENT;
+      break;
+    case TLM_PHASE_COAST:
+      if (apogee_phase == APOGEE_PHASE_DESCENT) p->phase = TLM_PHASE_DESCENT;
+      break;
+    case TLM_PHASE_DESCENT:
+      if (fabsf(velocity) >= TLM_LANDED_SPEED) {
+        p->still_since_us = -1;
+      } else if (p->still_since_us < 0) {
+        p->still_since_us = t_us;
+      } else if (t_us - p->still_since_us >= TLM_LANDED_US) {
+        p->phase = TLM_PHASE_LANDED;
+      }
+      break;
+    case TLM_PHASE_LANDED:
+      break;
+  }
+  return p->phase;
+}
+
+
+// The wait after airtime_us on the air, as the duty cycle allows and no less than min_us.
+static uint32_t period_of(const TLM_SchedConfig_t *cfg, uint32_t airtime_us, uint32_t min_us) {
+  uint32_t by_duty = cfg->duty > 0.0f ? (uint32_t)(airtime_us / cfg->duty) : airtime_us;
+  return by_duty > min_us ? by_duty : min_us;
+}
+
+
+void TLM_sched_init(TLM_Sched_t *s, const TLM_SchedConfig_t *cfg) {
+  memset(s, 0, sizeof(*s));
+  s->cfg = *cfg;
+  if (s->cfg.keyframe_every > TLM_KEYFRAME_MAX) s->cfg.keyframe_every = TLM_KEYFRAME_MAX;
+  if (s->cfg.fec_k > FEC_MAX_K) s->cfg.fec_k = FEC_MAX_K;
+  if (s->cfg.fec_m > FEC_MAX_M) s->cfg.fec_m = FEC_MAX_M;
+  if (s->cfg.fec_k == 0) s->cfg.fec_m = 0;
+  if (s->cfg.fec_m) FEC_init_tables();
+  for (int t = 0; t < TLM_PKT_TYPES; t++) {
+    s->period_us[t] = period_of(cfg, cfg->airtime_us[t], cfg->min_period_us[t]);
+  }
+  s->next_us = INT64_MIN;
+}
+
+
+size_t TLM_sched_poll(TLM_Sched_t *s, int64_t now_us, const TLM_State_t *state, uint8_t *out) {
+  if (now_us < s->next_us) {
+    return 0;
+  }
+  if (s->cfg.fec_m && s->fec_n == s->cfg.fec_k) {
+    const uint8_t *symbols[FEC_MAX_K];
+    for (uint8_t i = 0; i < s->fec_n; i++) symbols[i] = s->fec_data[i];
+    size_t len = TLM_encode_repair(s->fec_base, s->fec_n, s->fec_row, symbols, s->fec_len, out);
+    s->next_us = now_us + period_of(&s->cfg, s->cfg.repair_airtime_us[len], 0);
+    s->sent[TLM_PKT_REPAIR]++;
+    if (++s->fec_row == s->cfg.fec_m) {
+      s->fec_n = 0;                   // Next group
+      s->fec_row = 0;
+    }
+    return len;
+  }
+  uint8_t type = state->phase == TLM_PHASE_LANDED ? TLM_PKT_BEACON : TLM_PKT_STATE;
+  size_t len = 0;
+  uint8_t key_index = (uint8_t)((s->seq - s->key_seq) & TLM_SEQ_MASK);
+  if (type == TLM_PKT_STATE && s->have_key && key_index < s->cfg.keyframe_every) {
+    len = TLM_encode_delta(s->seq, key_index, &s->key, state, out);
+    if (len) {
+      type = TLM_PKT_DELTA;
+    } else {
+      s->forced_keys++;
+    }
+  }
+  if (!len) {
+    len = TLM_encode(type, s->seq, state, out);
+  }
+  if (type == TLM_PKT_STATE) {
+    s->key = *state;
+    s->key_seq = s->seq;
+    s->have_key = true;
+  }
+  if (s->cfg.fec_m) {
+    if (s->fec_n == 0) {
+      s->fec_base = s->seq;
+      s->fec_len = 0;
+    }
+    uint8_t *sym = s->fec_data[s->fec_n++];
+    sym[0] = (uint8_t)len;
+    memcpy(sym + 1, out, len);
+    memset(sym + 1 + len, 0, TLM_FEC_SYMBOL - 1 - len);
+    if (len + 1 > s->fec_len) s->fec_len = (uint8_t)(len + 1);
+  }
+  s->seq = (s->seq + 1) & TLM_SEQ_MASK;
+  s->next_us = now_us + s->period_us[type];
+  s->sent[type]++;
+  return len;
+}
@@ -0,0 +1,304 @@
+/**
+ * @file telemetry.h
+ * @brief LoRa telemetry downlink : bit packed state packets, flight phase and a scheduler paced by airtime.
+ *
+ * A packet is the latest flight state in a few dozen bytes, fields packed
+ * bit by bit LSB first at the resolution the ground needs :
+ *
+ *  | TYPE (3) | SEQ (13) | PHASE (3) | T (24, 10 ms) | ~ fields of the type ~ |
+ *
+ * - STATE, in flight : altitude, velocity, acceleration and peak altitude
+ *   from the filter, GPS lat / lon / height / fix, battery, health flags
+ *   and drop counters (TLM_STATE_SIZE bytes);
+ * - DELTA, in flight between two STATE keyframes : the time, altitude and
+ *   GPS position as a difference from the keyframe KEY packets before it,
+ *   velocity and acceleration whole (TLM_DELTA_SIZE bytes) :
+ *
+ *  | TYPE | SEQ | PHASE | KEY (4) | DT (10, 10 ms) | ALT (16) | VEL (15) | ACC (15) | LAT (8) | LON (8) |
+ *
+ * - BEACON, after landing : GPS position, peak altitude, battery and
+ *   health, all a recovery team needs (TLM_BEACON_SIZE bytes);
+ * - REPAIR, optional forward erasure coding (lib/Fec) : after every fec_k
+ *   packets, fec_m repairs over them, from which the ground rebuilds up to
+ *   fec_m of the fec_k lost with no return channel. Each group member is a
+ *   symbol of its length byte and its bytes, zero padded to the group's
+ *   longest; BASE is the SEQ of the group's first packet, ROW the repair's
+ *   row (0 : XOR parity, Reed-Solomon after) :
+ *
+ *  | TYPE | BASE (13) | ROW (2) | K - 1 (4) | 0 (2) | ~ repair symbol ~ |
+ *
+ *   A REPAIR takes no SEQ of its own, so the loss count and the DELTA KEYs
+ *   only see data packets.
+ *
+ * A value outside its field is clamped to the field's end; a state whose
+ * DELTA fields would not hold it goes out as a keyframe instead. SEQ counts
+ * every packet sent, so the ground sees what was lost. The radio's own CRC
+ * keeps corrupted packets out; TLM_decode() still rejects a wrong length or
+ * type.
+ *
+ * A DELTA is against the keyframe only, never the DELTA before it : a lost
+ * DELTA costs that one update and nothing more. A lost keyframe leaves the
+ * DELTAs after it without a base; the receiver (TLM_receive()) knows them
+ * by SEQ - KEY and drops them until the next keyframe.
+ *
+ * The receiver keeps the last TLM_RX_HISTORY data packets and the REPAIRs
+ * of the newest group. Once it holds as many repairs as the group lost
+ * packets, it rebuilds them and hands them out late (TLM_rebuilt()), with
+ * the DELTAs a rebuilt keyframe gives a base back. Repairs go out right
+ * after their group, so that is before the next group's first packet.
+ *
+ * The phase (TLM_Phase_t) follows the apogee detector's launch and apogee,
+ * burnout from the filter acceleration, and landing from the filter velocity
+ * staying under TLM_LANDED_SPEED for TLM_LANDED_US.
+ *
+ * The scheduler sends the packet of the phase as often as the channel
+ * allows : after a packet of airtime A, the next one waits until A / duty
+ * has gone by, duty being the share of time the band lets the radio
+ * transmit (10 % in the 869.4 - 869.65 MHz band). Beacons also wait for
+ * their own period. In flight every keyframe_every-th packet is a STATE
+ * keyframe and the others DELTAs, which take less airtime and so come
+ * sooner. Repairs are paced by their own airtime, as data packets. It
+ * never touches the radio : the caller asks it for a
+ * packet when the radio is free and sends what it gets.
+ *
+ * This file has no Arduino dependencies so it can be built into host tools.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "fec.h"
+
+
+#define TLM_HEADER_BITS 43            // TYPE, SEQ, PHASE, T
+#define TLM_STATE_BITS (TLM_HEADER_BITS + 71 + 70 + 32)
+#define TLM_BEACON_BITS (TLM_HEADER_BITS + 70 + 20 + 16)
+#define TLM_DELTA_BITS (TLM_HEADER_BITS - 24 + 14 + 46 + 16)
+#define TLM_STATE_SIZE ((TLM_STATE_BITS + 7) / 8)
+#define TLM_BEACON_SIZE ((TLM_BEACON_BITS + 7) / 8)
+#define TLM_DELTA_SIZE ((TLM_DELTA_BITS + 7) / 8)   // 12 : one LoRa payload block less than 13 at SF7
+#define TLM_KEYFRAME_MAX 16           // KEY is 4 bits : a keyframe at least every 16 packets
+#define TLM_MAX_PACKET 32
+#define TLM_SEQ_MASK 0x1FFF
+#define TLM_REPAIR_HEADER 3           // TYPE, BASE, ROW, K - 1
+#define TLM_FEC_SYMBOL (TLM_MAX_PACKET - TLM_REPAIR_HEADER)  // Length byte and the longest packet fit
+#define TLM_RX_HISTORY 32             // Data packets the receiver keeps to rebuild from
+
+#define TLM_LANDED_SPEED 2.0f         // m/s, filter velocity below this ...
+#define TLM_LANDED_US 5000000         // ... this long after apogee : landed
+
+
+//--------------------------------------------------------------------------------------------
+// Packets
+//--------------------------------------------------------------------------------------------
+typedef enum {
+  TLM_PKT_STATE = 0,
+  TLM_PKT_BEACON = 1,
+  TLM_PKT_DELTA = 2,
+  TLM_PKT_REPAIR = 3,
+  TLM_PKT_TYPES
+} TLM_PacketType_t;
+
+typedef enum {
+  TLM_PHASE_PAD = 0,
+  TLM_PHASE_BOOST,
+  TLM_PHASE_COAST,
+  TLM_PHASE_DESCENT,
+  TLM_PHASE_LANDED,
+} TLM_Phase_t;
+
+// Health flags
+#define TLM_HEALTH_SD 0x01            // SD journal open
+#define TLM_HEALTH_FLASH 0x02         // Flash ring open
+#define TLM_HEALTH_GPS_3D 0x04        // Last fix 3D
+#define TLM_HEALTH_TIME_LOCKED 0x08   // PPS time discipline locked
+#define TLM_HEALTH_BARO_LOCKED 0x10   // Baro locked out of the filter (transonic)
+
+typedef struct {
+  uint64_t t_us;              // Stamp of the filter state
+  uint8_t phase;              // TLM_Phase_t
+  float altitude;             // m above the pad, 0.1 m
+  float velocity;             // m/s, 0.1 m/s
+  float acceleration;         // m/s^2, 0.1 m/s^2
+  float max_altitude;         // m, 0.1 m
+  int32_t lat_e7;             // deg 1e-7 as NAV-PVT, sent at 1e-5 (~1 m)
+  int32_t lon_e7;
+  int32_t gps_height_mm;      // Height above the ellipsoid, sent in m
+  uint8_t gps_fix;            // 0 .. 3
+  uint16_t battery_mv;        // Sent in 40 mV steps, up to 10.2 V
+  uint8_t health;             // TLM_HEALTH_*
+  uint32_t samples_dropped;   // Since boot, sent saturated at 255
+  uint32_t blocks_dropped;    // Log blocks dropped by any destination, saturated at 255
+} TLM_State_t;
+
+typedef struct {
+  uint8_t type;               // TLM_PacketType_t
+  uint16_t seq;
+  uint8_t key_index;          // DELTA : packets since its keyframe
+  uint8_t fec_row;            // REPAIR : its row ...
+  uint8_t fec_k;              // ... and the size of its group, seq the group's first packet
+  TLM_State_t state;          // Fields of the type, the others 0
+} TLM_Packet_t;
+
+typedef enum {
+  TLM_RX_OK = 0,              // State of the packet in pkt
+  TLM_RX_NO_KEY,              // A DELTA whose keyframe was not received
+  TLM_RX_BAD,                 // Wrong length or type
+  TLM_RX_REPAIR,              // A REPAIR, kept : TLM_rebuilt() hands out what it rebuilt
+} TLM_RxStatus_t;
+
+typedef struct {
+  uint8_t len;                // 0 : not received
+  uint16_t seq;
+  bool no_key;                // A DELTA dropped, keyframe lost
+  bool rebuilt;               // Rebuilt, not handed out yet
+  uint8_t bytes[TLM_MAX_PACKET];
+} TLM_RxSlot_t;
+
+// Ground side : the keyframe the DELTAs apply to, and what was lost.
+typedef struct {
+  TLM_State_t key;            // Newest keyframe received, decoded
+  uint16_t key_seq;
+  bool have_key;
+  int32_t last_seq;           // -1 : nothing received yet
+  TLM_RxSlot_t history[TLM_RX_HISTORY];  // Data packets by SEQ, to rebuild from
+  uint8_t repair[FEC_MAX_M][TLM_FEC_SYMBOL];  // REPAIRs of the newest group ...
+  uint8_t repair_rows[FEC_MAX_M];
+  uint8_t repairs;
+  uint16_t repair_base;       // ... its first SEQ, size and symbol length
+  uint8_t repair_k;
+  uint8_t repair_len;
+  bool repair_done;           // Nothing lost or rebuilt
+  uint16_t late_seq;          // TLM_rebuilt() walk : next SEQ ...
+  uint16_t late_left;         // ... and how many to go
+  // Statistics
+  uint32_t received[TLM_PKT_TYPES];
+  uint32_t lost;              // Gaps in SEQ, not rebuilt
+  uint32_t no_key;            // DELTAs dropped, keyframe lost
+  uint32_t bad;
+  uint32_t rebuilt;           // Lost packets rebuilt from REPAIRs
+  uint32_t rekeyed;           // DELTAs dropped, then applied to a rebuilt keyframe
+} TLM_Receiver_t;
+
+
+//--------------------------------------------------------------------------------------------
+// Flight phase
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  TLM_Phase_t phase;
+  int64_t still_since_us;     // Descent under TLM_LANDED_SPEED since, -1 : moving
+} TLM_PhaseTracker_t;
+
+
+//--------------------------------------------------------------------------------------------
+// Scheduler
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  uint32_t airtime_us[TLM_PKT_TYPES];     // Time on air of each packet, RFM_airtime_us()
+  float duty;                             // Share of time on air the band allows, 0 .. 1
+  uint32_t min_period_us[TLM_PKT_TYPES];  // Never more often than this, 0 : as the duty allows
+  uint8_t keyframe_every;                 // In flight a STATE every this many packets, DELTAs between; 0, 1 : STATE only
+  uint8_t fec_k;                          // fec_m REPAIRs after every fec_k packets, up to FEC_MAX_K ...
+  uint8_t fec_m;                          // ... and FEC_MAX_M; 0 : no FEC
+  uint32_t repair_airtime_us[TLM_MAX_PACKET + 1];  // Time on air of a REPAIR by its length
+} TLM_SchedConfig_t;
+
+typedef struct {
+  TLM_SchedConfig_t cfg;
+  uint32_t period_us[TLM_PKT_TYPES];
+  int64_t next_us;            // No packet before
+  uint16_t seq;               // Of the next packet
+  TLM_State_t key;            // Last keyframe sent ...
+  uint16_t key_seq;           // ... with this SEQ
+  bool have_key;
+  uint8_t fec_data[FEC_MAX_K][TLM_FEC_SYMBOL];  // Symbols of the group so far
+  uint8_t fec_n;              // Packets in the group ...
+  uint8_t fec_len;            // ... its longest symbol ...
+  uint16_t fec_base;          // ... and first SEQ
+  uint8_t fec_row;            // Next REPAIR of a full group
+  // Statistics
+  uint32_t sent[TLM_PKT_TYPES];
+  uint32_t forced_keys;       // Keyframes sent early, the state out of DELTA range
+} TLM_Sched_t;
+
+
+//--------------------------------------------------------------------------------------------
+// Function prototypes
+//--------------------------------------------------------------------------------------------
+
+/**
+ * @brief Encode a packet of type with sequence number seq.
+ * @param[out] out At least TLM_MAX_PACKET bytes.
+ * @return Packet length, 0 for an unknown type.
+ */
+size_t TLM_encode(uint8_t type, uint16_t seq, const TLM_State_t *state, uint8_t *out);
+
+/**
+ * @brief Encode a DELTA against keyframe key, sent key_index packets before.
+ * @param[out] out At least TLM_MAX_PACKET bytes.
+ * @return Packet length, 0 if key_index or a difference is out of its field : send a keyframe.
+ */
+size_t TLM_encode_delta(uint16_t seq, uint8_t key_index, const TLM_State_t *key, const TLM_State_t *state,
+                        uint8_t *out);
+
+/**
+ * @brief Decode a received packet on its own.
+ *
+ * A DELTA comes out as it was sent : t_us, altitude, lat_e7 and lon_e7 the
+ * differences from its keyframe, the fields it does not carry 0.
+ * TLM_receive() applies it.
+ *
+ * @return false if its length does not match its type.
+ */
+bool TLM_decode(const uint8_t *buf, size_t len, TLM_Packet_t *pkt);
+
+/**
+ * @brief Encode REPAIR row over the k symbols of a group whose first packet has SEQ base.
+ * @param[in] symbols k symbols of sym_len bytes (length byte, packet, zeros), sym_len <= TLM_FEC_SYMBOL.
+ * @param[out] out At least TLM_MAX_PACKET bytes.
+ * @return Packet length.
+ */
+size_t TLM_encode_repair(uint16_t base, uint8_t k, uint8_t row, const uint8_t *const symbols[], size_t sym_len,
+                         uint8_t *out);
+
+void TLM_rx_init(TLM_Receiver_t *rx);
+
+/**
+ * @brief Decode a received packet, a DELTA applied to its keyframe, and count the loss.
+ * @param[out] pkt The packet, state whole for TLM_RX_OK : a DELTA takes what it does not carry from its keyframe.
+ */
+TLM_RxStatus_t TLM_receive(TLM_Receiver_t *rx, const uint8_t *buf, size_t len, TLM_Packet_t *pkt);
+
+/**
+ * @brief After a TLM_RX_REPAIR, the next state it brought back, oldest first : lost packets rebuilt, and
+ *        DELTAs dropped for a keyframe that was rebuilt. A rebuilt keyframe becomes the key if newer.
+ * @param[out] pkt As TLM_receive() gives it for TLM_RX_OK.
+ * @return false when there is none left.
+ */
+bool TLM_rebuilt(TLM_Receiver_t *rx, TLM_Packet_t *pkt);
+
+void TLM_phase_init(TLM_PhaseTracker_t *p);
+
+/**
+ * @brief Move the phase on after a filter step.
+ * @param[in] apogee_phase APOGEE_Phase_t of the apogee detector (pad, ascent, descent).
+ */
+TLM_Phase_t TLM_phase_update(TLM_PhaseTracker_t *p, int64_t t_us, uint8_t apogee_phase, float velocity,
+                             float acceleration);
+
+/**
+ * @brief Start the schedule, the first packet due at once.
+ */
+void TLM_sched_init(TLM_Sched_t *s, const TLM_SchedConfig_t *cfg);
+
+/**
+ * @brief The packet due at now_us for the state's phase, if any. Call when the radio is free.
+ * @param[out] out Encoded packet, at least TLM_MAX_PACKET bytes.
+ * @return Packet length, 0 if nothing is due yet. The packet counts as sent at now_us.
+ */
+size_t TLM_sched_poll(TLM_Sched_t *s, int64_t now_us, const TLM_State_t *state, uint8_t *out);
+
+#endif /* TELEMETRY_H */
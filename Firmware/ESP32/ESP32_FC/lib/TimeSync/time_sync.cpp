@@ -0,0 +1,119 @@
+/**
+ * @file time_sync.cpp
+ * @brief GPS PPS discipline of the flight computer clock.
+ *
+ * The fit runs once a second, so double precision (software on the ESP32-S3)
+ * costs nothing that matters and keeps sub-microsecond resolution over a week.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "time_sync.h"
+
+
+void TS_init(TS_t *ts) {
+  memset(ts, 0, sizeof(*ts));
+  ts->last_gps_us = -1;
+}
+
+
+void TS_pps_edge(TS_t *ts, int64_t t_mcu_us) {
+  ts->edge_us = t_mcu_us;
+  ts->edge_pending = true;
+}
+
+
+static void TS_fit(TS_t *ts) {
+  uint8_t newest = (uint8_t)((ts->head + TS_WINDOW - 1) % TS_WINDOW);
+  ts->mcu_ref_us = ts->mcu_us[newest];
+  ts->gps_ref_us = ts->gps_us[newest];
+
+  // Centred on the newest pair so the sums stay small.
+  double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+  for (uint8_t i = 0; i < ts->n; i++) {
+    uint8_t k = (uint8_t)((newest + TS_WINDOW - i) % TS_WINDOW);
+    double x = (double)(ts->mcu_us[k] - ts->mcu_ref_us);
+    double y = (double)(ts->gps_us[k] - ts->gps_ref_us) - x;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  double n = ts->n;
+  double den = n * sxx - sx * sx;
+  double slope = den > 0.0 ? (n * sxy - sx * sy) / den : 0.0;
+  double intercept = (sy - slope * sx) / n;
+
+  double ss = 0.0;
+  for (uint8_t i = 0; i < ts->n; i++) {
+    uint8_t k = (uint8_t)((newest + TS_WINDOW - i) % TS_WINDOW);
+    double x = (double)(ts->mcu_us[k] - ts->mcu_ref_us);
+    double y = (double)(ts->gps_us[k] - ts->gps_ref_us) - x;
+    double r = y - (intercept + slope * x);
+    ss += r * r;
+  }
+
+  ts->scale = slope;
+  ts->drift = -slope / (1.0 + slope);
+  ts->offset_us = (double)(ts->gps_ref_us - ts->mcu_ref_us) + intercept;
+  ts->residual_us = sqrt(ss / n);
+  ts->valid = ts->n >= TS_MIN_PAIRS;
+  ts->locked = ts->valid && ts->residual_us < TS_LOCK_RESIDUAL_US;
+}
+
+
+bool TS_nav_epoch(TS_t *ts, int64_t t_rx_us, uint32_t itow_ms, bool fix_ok) {
+  if (!ts->edge_pending) {
+    return false;
+  }
+  int64_t age = t_rx_us - ts->edge_us;
+  if (age < 0 || age > TS_PAIR_TIMEOUT_US || !fix_ok) {
+    ts->edge_pending = false;
+    return false;
+  }
+  if (itow_ms % 1000 != 0) {
+    return false;             // Not the epoch of the edge, wait for it
+  }
+  ts->edge_pending = false;
+
+  int64_t gps_us = (int64_t)itow_ms * 1000 + ts->week_offset_us;
+  if (ts->last_gps_us >= 0 && gps_us < ts->last_gps_us - TS_WEEK_US / 2) {
+    ts->week_offset_us += TS_WEEK_US;
+    gps_us += TS_WEEK_US;
+  }
+  ts->last_gps_us = gps_us;
+
+  if (ts->locked) {
+    double err = (double)(gps_us - TS_mcu_to_gps(ts, ts->edge_us));
+    if (fabs(err) > TS_OUTLIER_US) {
+      if (++ts->rejects < TS_MAX_REJECT) {
+        return true;
+      }
+      // The relation really changed, start over from this pair.
+      ts->n = 0;
+      ts->head = 0;
+    }
+  }
+  ts->rejects = 0;
+
+  ts->mcu_us[ts->head] = ts->edge_us;
+  ts->gps_us[ts->head] = gps_us;
+  ts->head = (uint8_t)((ts->head + 1) % TS_WINDOW);
+  if (ts->n < TS_WINDOW) ts->n++;
+  TS_fit(ts);
+  return true;
+}
+
+
+int64_t TS_mcu_to_gps(const TS_t *ts, int64_t t_mcu_us) {
+  double dx = (double)(t_mcu_us - ts->mcu_ref_us);
+  double gps = (double)ts->mcu_ref_us + ts->offset_us + dx * (1.0 + ts->scale);
+  return (int64_t)llround(gps);
+}
+
+
+int64_t TS_gps_to_mcu(const TS_t *ts, int64_t t_gps_us) {
+  double gps_at_ref = (double)ts->mcu_ref_us + ts->offset_us;
+  double dx = ((double)t_gps_us - gps_at_ref) / (1.0 + ts->scale);
+  return ts->mcu_ref_us + (int64_t)llround(dx);
+}
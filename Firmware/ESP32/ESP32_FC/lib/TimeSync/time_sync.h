@@ -0,0 +1,98 @@
+/**
+ * @file time_sync.h
+ * @brief GPS PPS discipline of the flight computer clock.
+ *
+ * The NEO-7M time pulse (PPS) rises at the top of every GPS second. Its edge
+ * is stamped in a GPIO interrupt with the esp_timer clock, then paired with
+ * the NAV-PVT that follows it : the first top of second epoch (iTOW % 1000 == 0)
+ * received within a second of the edge names the GPS second of that edge.
+ *
+ * The pairs (MCU us, GPS us) are fitted with a least squares line over the
+ * last TS_WINDOW seconds :
+ *
+ *  gps_us = gps_ref + (1 + scale) * (mcu_us - mcu_ref)
+ *
+ * giving the offset and the crystal drift (drift = MCU rate / GPS rate - 1,
+ * positive when the MCU clock runs fast). Pairs far off the line once locked
+ * (missed edge, interrupt held off) are rejected; TS_MAX_REJECT in a row
+ * means the clock relation changed and the fit restarts.
+ *
+ * GPS time is time of week in microseconds, unwrapped across week rollovers.
+ * This file has no Arduino dependencies so it can be built into host tools.
+ */
+
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifndef TS_WINDOW
+#define TS_WINDOW 16                  // Pairs in the fit (seconds at 1 Hz PPS)
+#endif
+#define TS_MIN_PAIRS 4                // Pairs before the fit is used
+#define TS_LOCK_RESIDUAL_US 20.0      // Fit rms residual to call the clock locked
+#define TS_OUTLIER_US 50.0            // Reject pairs this far from the locked fit
+#define TS_MAX_REJECT 3               // Consecutive rejects that restart the fit
+#define TS_PAIR_TIMEOUT_US 1000000    // NAV-PVT must follow the edge within this
+#define TS_WEEK_US 604800000000LL
+
+
+typedef struct {
+  // Pending PPS edge
+  int64_t edge_us;
+  bool edge_pending;
+
+  // Fit window, circular
+  int64_t mcu_us[TS_WINDOW];
+  int64_t gps_us[TS_WINDOW];
+  uint8_t n;
+  uint8_t head;
+  uint8_t rejects;
+  int64_t week_offset_us;     // Added to time of week after rollovers
+  int64_t last_gps_us;
+
+  // Fit result
+  bool valid;                 // At least TS_MIN_PAIRS pairs
+  bool locked;                // valid and residual below TS_LOCK_RESIDUAL_US
+  int64_t mcu_ref_us;         // Newest pair, the fit is centred here
+  int64_t gps_ref_us;
+  double offset_us;           // gps - mcu at mcu_ref, from the fit
+  double scale;               // Fit slope, GPS us per MCU us - 1
+  double drift;               // MCU clock rate error, mcu/gps - 1
+  double residual_us;         // rms of the fit
+} TS_t;
+
+
+/**
+ * @brief Reset, no time relation known.
+ */
+void TS_init(TS_t *ts);
+
+/**
+ * @brief A PPS rising edge was stamped at t_mcu_us (from the interrupt).
+ */
+void TS_pps_edge(TS_t *ts, int64_t t_mcu_us);
+
+/**
+ * @brief A NAV-PVT arrived.
+ * @param[in] t_rx_us MCU time the message was parsed.
+ * @param[in] itow_ms GPS time of week of the epoch.
+ * @param[in] fix_ok Fix good enough to trust the time pulse.
+ * @return true if it completed a pair and the fit was updated (or the pair
+ *  rejected, check ts->rejects); false if it is not a PPS epoch.
+ */
+bool TS_nav_epoch(TS_t *ts, int64_t t_rx_us, uint32_t itow_ms, bool fix_ok);
+
+/**
+ * @brief MCU time to GPS time of week (us, unwrapped). Only meaningful when ts->valid.
+ */
+int64_t TS_mcu_to_gps(const TS_t *ts, int64_t t_mcu_us);
+
+/**
+ * @brief GPS time (us, unwrapped) to MCU time. Only meaningful when ts->valid.
+ */
+int64_t TS_gps_to_mcu(const TS_t *ts, int64_t t_gps_us);
+
+#endif /* TIME_SYNC_H */
@@ -0,0 +1,74 @@
+/**
+ * @file timebase.cpp
+ * @brief Sampling jitter monitor for the timer driven acquisition.
+ */
+
+#include "timebase.h"
+
+
+static const uint32_t TB_HIST_EDGES_US[TB_HIST_BINS - 1] = { 1, 2, 5, 10, 20, 50, 100 };
+
+
+void TB_jitter_init(TB_Jitter_t *j, uint32_t period_us) {
+  j->period_us = period_us ? period_us : 1;
+  j->t_last_us = -1;
+  TB_jitter_reset(j);
+}
+
+
+void TB_jitter_reset(TB_Jitter_t *j) {
+  j->samples = 0;
+  j->missed = 0;
+  j->jitter_min_us = INT32_MAX;
+  j->jitter_max_us = INT32_MIN;
+  j->jitter_sq_sum = 0;
+  for (int i = 0; i < TB_HIST_BINS; i++) j->hist[i] = 0;
+}
+
+
+void TB_jitter_add(TB_Jitter_t *j, int64_t t_us) {
+  int64_t last = j->t_last_us;
+  j->t_last_us = t_us;
+  if (last < 0 || t_us <= last) {
+    return;
+  }
+
+  int64_t dt = t_us - last;
+  int64_t k = (dt + j->period_us / 2) / j->period_us;
+  if (k < 1) k = 1;
+  if (k > 1) j->missed += (uint32_t)(k - 1);
+  int32_t jitter = (int32_t)(dt - k * (int64_t)j->period_us);
+
+  j->samples++;
+  if (jitter < j->jitter_min_us) j->jitter_min_us = jitter;
+  if (jitter > j->jitter_max_us) j->jitter_max_us = jitter;
+  j->jitter_sq_sum += (int64_t)jitter * jitter;
+
+  uint32_t mag = (uint32_t)(jitter < 0 ? -jitter : jitter);
+  int bin = 0;
+  while (bin < TB_HIST_BINS - 1 && mag >= TB_HIST_EDGES_US[bin]) bin++;
+  j->hist[bin]++;
+}
+
+
+uint32_t TB_jitter_rms_us(const TB_Jitter_t *j) {
+  if (!j->samples) {
+    return 0;
+  }
+  // Integer square root of the mean, no float needed.
+  uint64_t mean = (uint64_t)j->jitter_sq_sum / j->samples;
+  uint64_t r = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+  while (bit > mean) bit >>= 2;
+  while (bit) {
+    if (mean >= r + bit) {
+      mean -= r + bit;
+      r = (r >> 1) + bit;
+    }
+    else {
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)r;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file timebase.h
+ * @brief Sampling jitter monitor for the timer driven acquisition.
+ *
+ * Every sensor is sampled from a periodic hardware timer and each sample is
+ * stamped with the 64-bit esp_timer microsecond clock. The monitor compares
+ * the interval between consecutive stamps with the nominal period :
+ *
+ *  jitter = (t[n] - t[n-1]) - k * period,   k = nearest whole number of periods
+ *
+ * k > 1 means k - 1 samples were missed (task starved, bus busy), those are
+ * counted apart so a missed sample does not show up as one huge jitter value.
+ *
+ * Statistics cover one report window (TB_jitter_reset() starts a new one) :
+ * min/max/rms jitter and a histogram of |jitter| :
+ *
+ * | Bin | 0    | 1    | 2    | 3     | 4      | 5      | 6       | 7        |
+ * | --- | ---- | ---- | ---- | ----- | ------ | ------ | ------- | -------- |
+ * | us  | < 1  | < 2  | < 5  | < 10  | < 20   | < 50   | < 100   | >= 100   |
+ *
+ * Integer only, so it is cheap enough to run on every sample.
+ * This file has no Arduino dependencies so it can be built into host tools.
+ */
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdint.h>
+
+
+#define TB_HIST_BINS 8
+
+
+typedef struct {
+  uint32_t period_us;         // Nominal sample period
+  int64_t t_last_us;          // Stamp of the previous sample, < 0 before the first one
+  uint32_t samples;           // Intervals measured in this window
+  uint32_t missed;            // Periods with no sample in this window
+  int32_t jitter_min_us;
+  int32_t jitter_max_us;
+  int64_t jitter_sq_sum;      // Sum of jitter^2 (us^2), for the rms
+  uint32_t hist[TB_HIST_BINS];
+} TB_Jitter_t;
+
+
+/**
+ * @brief Start monitoring a sensor sampled every period_us.
+ */
+void TB_jitter_init(TB_Jitter_t *j, uint32_t period_us);
+
+/**
+ * @brief Add the stamp of a new sample.
+ */
+void TB_jitter_add(TB_Jitter_t *j, int64_t t_us);
+
+/**
+ * @brief Clear the window statistics, keeps the last stamp.
+ */
+void TB_jitter_reset(TB_Jitter_t *j);
+
+/**
+ * @brief RMS jitter of the window in microseconds.
+ */
+uint32_t TB_jitter_rms_us(const TB_Jitter_t *j);
+
+#endif /* TIMEBASE_H */
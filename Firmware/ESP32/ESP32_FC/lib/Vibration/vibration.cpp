@@ -0,0 +1,346 @@
+/**
+ * @file vibration.cpp
+ * @brief ADXL375 vibration front end : FIR decimation and windowed FFT spectra.
+ *
+ * Two real axes share one complex FFT (X + iY), Z gets its own, so a window
+ * costs two VIB_FFT_N point FFTs for three axes. Everything runs in single
+ * precision, the ESP32-S3 FPU has no double.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "vibration.h"
+
+
+#define VIB_INPUT_PERIOD_US (1e6f / VIB_INPUT_RATE_HZ)
+#define VIB_GROUP_DELAY_US ((VIB_FIR_TAPS - 1) * 0.5f * VIB_INPUT_PERIOD_US)
+
+
+// Zeroth order modified Bessel function of the first kind, power series.
+static double bessel_i0(double x) {
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 40; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < 1e-12 * sum) break;
+  }
+  return sum;
+}
+
+
+// Low pass at the output Nyquist frequency, unity gain at DC.
+static void VIB_fir_design(float *h) {
+  double cutoff = 0.5 / VIB_DECIM;    // cycles per input sample
+  double i0_beta = bessel_i0(VIB_FIR_KAISER_BETA);
+  double half = 0.5 * (VIB_FIR_TAPS - 1);
+  double sum = 0.0;
+  for (int j = 0; j < VIB_FIR_TAPS; j++) {
+    double u = j - half;
+    double x = 2.0 * cutoff * u;
+    double sinc = x == 0.0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+    double w = u / (half + 1.0);
+    h[j] = (float)(sinc * bessel_i0(VIB_FIR_KAISER_BETA * sqrt(1.0 - w * w)) / i0_beta);
+    sum += h[j];
+  }
+  for (int j = 0; j < VIB_FIR_TAPS; j++) h[j] = (float)(h[j] / sum);
+}
+
+
+void VIB_init(VIB_t *vib) {
+  memset(vib, 0, sizeof(*vib));
+  VIB_fir_design(vib->coeffs);
+
+  double power = 0.0;
+  for (int i = 0; i < VIB_FFT_N; i++) {
+    vib->window[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * i / VIB_FFT_N));
+    power += (double)vib->window[i] * vib->window[i];
+  }
+  vib->window_power = (float)power;
+  for (int k = 0; k < VIB_FFT_N / 2; k++) {
+    vib->twiddle[2 * k] = (float)cos(2.0 * M_PI * k / VIB_FFT_N);
+    vib->twiddle[2 * k + 1] = (float)-sin(2.0 * M_PI * k / VIB_FFT_N);
+  }
+
+#if VIB_USE_ESP_DSP
+  for (int a = 0; a < VIB_AXES; a++) {
+    dsps_fird_init_f32(&vib->fird[a], vib->coeffs, vib->delay[a], VIB_FIR_TAPS, VIB_DECIM);
+  }
+  // Shared twiddle table, allocated once by esp-dsp.
+  static bool fft_ready = false;
+  if (!fft_ready) {
+    fft_ready = dsps_fft2r_init_fc32(NULL, VIB_FFT_N) == ESP_OK;
+  }
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Portable kernels
+//--------------------------------------------------------------------------------------------
+int VIB_fird_c(const float *coeffs, float *delay, int *pos, const float *in, float *out, int n_out) {
+  int p = *pos;
+  for (int i = 0; i < n_out; i++) {
+    for (int k = 0; k < VIB_DECIM; k++) {
+      float v = *in++;
+      delay[p] = v;
+      delay[p + VIB_FIR_TAPS] = v;
+      if (++p == VIB_FIR_TAPS) p = 0;
+    }
+    // delay[p] is now the oldest sample of the window. Four partial sums
+    // keep the adds independent, as the esp-dsp S3 kernel does.
+    const float *x = &delay[p];
+    float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int j = 0; j < VIB_FIR_TAPS; j += 4) {
+      acc[0] += coeffs[j] * x[j];
+      acc[1] += coeffs[j + 1] * x[j + 1];
+      acc[2] += coeffs[j + 2] * x[j + 2];
+      acc[3] += coeffs[j + 3] * x[j + 3];
+    }
+    out[i] = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+  }
+  *pos = p;
+  return n_out;
+}
+
+
+void VIB_fft_c(float *data, const float *twiddle) {
+  const int n = VIB_FFT_N;
+  // Bit reversal permutation
+  for (int i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j |= bit;
+    if (i < j) {
+      float re = data[2 * i], im = data[2 * i + 1];
+      data[2 * i] = data[2 * j];
+      data[2 * i + 1] = data[2 * j + 1];
+      data[2 * j] = re;
+      data[2 * j + 1] = im;
+    }
+  }
+  // Decimation in time butterflies, W^k = exp(-2 pi i k / n)
+  for (int len = 2; len <= n; len <<= 1) {
+    int half = len >> 1;
+    int stride = n / len;
+    for (int start = 0; start < n; start += len) {
+      for (int k = 0; k < half; k++) {
+        float wr = twiddle[2 * k * stride], wi = twiddle[2 * k * stride + 1];
+        float *a = &data[2 * (start + k)];
+        float *b = &data[2 * (start + k + half)];
+        float tr = b[0] * wr - b[1] * wi;
+        float ti = b[0] * wi + b[1] * wr;
+        b[0] = a[0] - tr;
+        b[1] = a[1] - ti;
+        a[0] += tr;
+        a[1] += ti;
+      }
+    }
+  }
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Kernel dispatch
+//--------------------------------------------------------------------------------------------
+static void VIB_fird(VIB_t *vib, int axis, const float *in, float *out, int n_out) {
+#if VIB_USE_ESP_DSP
+  dsps_fird_f32(&vib->fird[axis], in, out, n_out);
+#else
+  VIB_fird_c(vib->coeffs, vib->delay[axis], &vib->pos[axis], in, out, n_out);
+#endif
+}
+
+
+static void VIB_fft(VIB_t *vib, float *data) {
+#if VIB_USE_ESP_DSP
+  dsps_fft2r_fc32(data, VIB_FFT_N);
+  dsps_bit_rev_fc32(data, VIB_FFT_N);
+#else
+  VIB_fft_c(data, vib->twiddle);
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Spectrum
+//--------------------------------------------------------------------------------------------
+
+// One full window in vib->frame : detrend, Hann, FFT, accumulate |X|^2.
+static void VIB_spectrum_frame(VIB_t *vib) {
+  float mean[VIB_AXES];
+  for (int a = 0; a < VIB_AXES; a++) {
+    float sum = 0.0f;
+    for (int i = 0; i < VIB_FFT_N; i++) sum += vib->frame[a][i];
+    mean[a] = sum / VIB_FFT_N;
+  }
+
+  // X + iY in fft[0], Z + i0 in fft[1]
+  for (int i = 0; i < VIB_FFT_N; i++) {
+    float w = vib->window[i];
+    vib->fft[0][2 * i] = (vib->frame[0][i] - mean[0]) * w;
+    vib->fft[0][2 * i + 1] = (vib->frame[1][i] - mean[1]) * w;
+    vib->fft[1][2 * i] = (vib->frame[2][i] - mean[2]) * w;
+    vib->fft[1][2 * i + 1] = 0.0f;
+  }
+  VIB_fft(vib, vib->fft[0]);
+  VIB_fft(vib, vib->fft[1]);
+
+  // Split the packed pair : X[k] = (Z[k] + Z*[N-k]) / 2, Y[k] = (Z[k] - Z*[N-k]) / 2i
+  const float *z = vib->fft[0];
+  const float *zz = vib->fft[1];
+  for (int k = 0; k < VIB_BINS; k++) {
+    int m = (VIB_FFT_N - k) & (VIB_FFT_N - 1);
+    float sr = z[2 * k] + z[2 * m], si = z[2 * k + 1] - z[2 * m + 1];
+    float dr = z[2 * k] - z[2 * m], di = z[2 * k + 1] + z[2 * m + 1];
+    vib->power[0][k] += 0.25f * (sr * sr + si * si);
+    vib->power[1][k] += 0.25f * (dr * dr + di * di);
+    vib->power[2][k] += zz[2 * k] * zz[2 * k] + zz[2 * k + 1] * zz[2 * k + 1];
+  }
+  if (vib->windows < UINT16_MAX) {
+    vib->windows++;
+  }
+}
+
+
+// Append one input sample to the spectrum window, 50 % overlap.
+static void VIB_spectrum_add(VIB_t *vib, const float *acc, int64_t t_us) {
+  for (int a = 0; a < VIB_AXES; a++) vib->frame[a][vib->frame_fill] = acc[a];
+  if (++vib->frame_fill < VIB_FFT_N) {
+    return;
+  }
+  VIB_spectrum_frame(vib);
+  vib->t_frame_us = t_us;
+  for (int a = 0; a < VIB_AXES; a++) {
+    memmove(vib->frame[a], &vib->frame[a][VIB_FFT_N / 2], VIB_FFT_N / 2 * sizeof(float));
+  }
+  vib->frame_fill = VIB_FFT_N / 2;
+}
+
+
+uint16_t VIB_spectrum_take(VIB_t *vib, uint8_t db[VIB_AXES][VIB_BINS], int64_t *t_us) {
+  uint16_t windows = vib->windows;
+  if (!windows) {
+    return 0;
+  }
+  // One sided PSD in g^2/Hz : 2 |X|^2 / (fs sum(w^2)), DC not doubled.
+  float scale = VIB_G_PER_LSB * VIB_G_PER_LSB / (VIB_INPUT_RATE_HZ * vib->window_power * windows);
+  for (int a = 0; a < VIB_AXES; a++) {
+    for (int k = 0; k < VIB_BINS; k++) {
+      float psd = vib->power[a][k] * scale * (k ? 2.0f : 1.0f);
+      float code = psd > 0.0f ? (10.0f * log10f(psd) - VIB_DB_MIN) / VIB_DB_STEP : 0.0f;
+      db[a][k] = code <= 0.0f ? 0 : code >= 255.0f ? 255 : (uint8_t)(code + 0.5f);
+    }
+  }
+  *t_us = vib->t_frame_us;
+  memset(vib->power, 0, sizeof(vib->power));
+  vib->windows = 0;
+  return windows;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Sample path
+//--------------------------------------------------------------------------------------------
+
+// At most VIB_MAX_BLOCK samples.
+static int VIB_process_block(VIB_t *vib, const int16_t (*raw)[3], int n, int64_t t_newest_us,
+                             int16_t (*out)[3], int64_t *t_out_us) {
+  for (int i = 0; i < n; i++) {
+    int64_t t_us = t_newest_us - (int64_t)((n - 1 - i) * VIB_INPUT_PERIOD_US + 0.5f);
+    float acc[VIB_AXES];
+    for (int a = 0; a < VIB_AXES; a++) {
+      acc[a] = raw[i][a];
+      vib->stage[a][vib->staged] = acc[a];
+    }
+    vib->stage_t_us[vib->staged++] = t_us;
+    VIB_spectrum_add(vib, acc, t_us);
+  }
+
+  int n_out = vib->staged / VIB_DECIM;
+  if (!n_out) {
+    return 0;
+  }
+  for (int a = 0; a < VIB_AXES; a++) {
+    VIB_fird(vib, a, vib->stage[a], vib->decimated[a], n_out);
+  }
+  for (int k = 0; k < n_out; k++) {
+    for (int a = 0; a < VIB_AXES; a++) {
+      float v = vib->decimated[a][k];
+      v = v > 32767.0f ? 32767.0f : v < -32768.0f ? -32768.0f : v;
+      out[k][a] = (int16_t)lrintf(v);
+    }
+    t_out_us[k] = vib->stage_t_us[(k + 1) * VIB_DECIM - 1] - (int64_t)(VIB_GROUP_DELAY_US + 0.5f);
+  }
+
+  // Keep the incomplete group for the next call.
+  int used = n_out * VIB_DECIM;
+  int left = vib->staged - used;
+  for (int a = 0; a < VIB_AXES; a++) {
+    memmove(vib->stage[a], &vib->stage[a][used], left * sizeof(float));
+  }
+  memmove(vib->stage_t_us, &vib->stage_t_us[used], left * sizeof(int64_t));
+  vib->staged = left;
+  return n_out;
+}
+
+
+int VIB_process(VIB_t *vib, const int16_t (*raw)[3], int n, int64_t t_newest_us,
+                int16_t (*out)[3], int64_t *t_out_us) {
+  int written = 0;
+  for (int done = 0; done < n; ) {
+    int chunk = n - done < VIB_MAX_BLOCK ? n - done : VIB_MAX_BLOCK;
+    // Stamp of the newest sample of this chunk
+    int64_t t_us = t_newest_us - (int64_t)((n - done - chunk) * VIB_INPUT_PERIOD_US + 0.5f);
+    written += VIB_process_block(vib, raw + done, chunk, t_us, out + written, t_out_us + written);
+    done += chunk;
+  }
+  return written;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Self test
+//--------------------------------------------------------------------------------------------
+float VIB_self_test(VIB_t *vib) {
+  float worst = 0.0f;
+#if VIB_USE_ESP_DSP
+  VIB_init(vib);
+  // Deterministic test signal : a few tones plus LCG noise, ADXL375 count scale.
+  uint32_t seed = 12345;
+  float *in = vib->frame[0];
+  for (int i = 0; i < VIB_FFT_N; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    in[i] = 400.0f * sinf(0.3f * i) + 150.0f * sinf(2.1f * i) + (float)(seed >> 20) - 2048.0f;
+  }
+
+  // FIR : esp-dsp on axis 0, portable on axis 1, same input
+  const int n_out = VIB_FFT_N / VIB_DECIM;
+  float *fast = vib->frame[1], *ref = vib->frame[2];
+  dsps_fird_f32(&vib->fird[0], in, fast, n_out);
+  VIB_fird_c(vib->coeffs, vib->delay[1], &vib->pos[1], in, ref, n_out);
+  float err = 0.0f, rms = 0.0f;
+  for (int i = 0; i < n_out; i++) {
+    err = fmaxf(err, fabsf(fast[i] - ref[i]));
+    rms += ref[i] * ref[i];
+  }
+  worst = fmaxf(worst, err / sqrtf(rms / n_out));
+
+  // FFT : esp-dsp in fft[0], portable in fft[1]
+  for (int i = 0; i < VIB_FFT_N; i++) {
+    vib->fft[0][2 * i] = vib->fft[1][2 * i] = in[i];
+    vib->fft[0][2 * i + 1] = vib->fft[1][2 * i + 1] = in[(i * 7) % VIB_FFT_N];
+  }
+  dsps_fft2r_fc32(vib->fft[0], VIB_FFT_N);
+  dsps_bit_rev_fc32(vib->fft[0], VIB_FFT_N);
+  VIB_fft_c(vib->fft[1], vib->twiddle);
+  err = 0.0f;
+  rms = 0.0f;
+  for (int i = 0; i < 2 * VIB_FFT_N; i++) {
+    err = fmaxf(err, fabsf(vib->fft[0][i] - vib->fft[1][i]));
+    rms += vib->fft[1][i] * vib->fft[1][i];
+  }
+  worst = fmaxf(worst, err / sqrtf(rms / (2 * VIB_FFT_N)));
+#endif
+  VIB_init(vib);                      // Leave the state as it found a fresh one, whatever ran
+  return worst;
+}
@@ -0,0 +1,162 @@
+/**
+ * @file vibration.h
+ * @brief ADXL375 vibration front end : FIR decimation and windowed FFT spectra.
+ *
+ * The ADXL375 runs at VIB_INPUT_RATE_HZ so airframe vibration (motor
+ * roughness, fin flutter, structural modes) is not aliased away. Full rate
+ * samples are not logged; this module turns them into :
+ *
+ *  - a decimated stream at VIB_OUTPUT_RATE_HZ for the ACCEL records and the
+ *    Kalman filter. Kaiser windowed sinc, VIB_FIR_TAPS taps, cut off at the
+ *    output Nyquist frequency : flat to ~300 Hz, > 50 dB down from ~500 Hz,
+ *    so nothing aliases into 0 - 300 Hz.
+ *  - Welch power spectral density per axis : Hann windows of VIB_FFT_N
+ *    samples, 50 % overlap, mean removed, averaged until VIB_spectrum_take().
+ *
+ *  | Input   | Decimate | Output | FFT | Bin width | Window | Hop      |
+ *  | ------- | -------- | ------ | --- | --------- | ------ | -------- |
+ *  | 3200 Hz | 4        | 800 Hz | 256 | 12.5 Hz   | 80 ms  | 40 ms    |
+ *
+ * Spectra are quantised to VIB_DB_STEP dB from VIB_DB_MIN dB re 1 g^2/Hz,
+ * one byte per bin : 0.5 dB steps over -100 .. +27.5 dB covers the ADXL375
+ * quantisation floor (~-69 dB) up to a 50 g tone.
+ *
+ * Output stamps are the stamp of the input sample that completed them minus
+ * the FIR group delay, (VIB_FIR_TAPS - 1) / 2 input periods, so the decimated
+ * samples sit at the time they describe.
+ *
+ * Kernels : with esp-dsp available (ESP-IDF / Arduino ESP32 core) the FIR
+ * and FFT run on dsps_fird_f32() and dsps_fft2r_fc32(), which use the
+ * ESP32-S3 PIE vector instructions. The portable C kernels below are the
+ * reference : same arithmetic order as esp-dsp for the FIR, checked against
+ * double precision on the host (Tools/vib_check) and against esp-dsp at boot
+ * (VIB_self_test()). Set VIB_USE_ESP_DSP to 0 to force the portable kernels.
+ *
+ * This file has no Arduino dependencies so it can be built into host tools.
+ */
+
+#ifndef VIBRATION_H
+#define VIBRATION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifndef VIB_USE_ESP_DSP
+#if defined(ESP_PLATFORM) && defined(__has_include)
+#if __has_include(<esp_dsp.h>)
+#define VIB_USE_ESP_DSP 1
+#endif
+#endif
+#endif
+#ifndef VIB_USE_ESP_DSP
+#define VIB_USE_ESP_DSP 0
+#endif
+
+#if VIB_USE_ESP_DSP
+#include <esp_dsp.h>
+#endif
+
+
+#ifndef VIB_INPUT_RATE_HZ
+#define VIB_INPUT_RATE_HZ 3200        // ADXL375 output data rate
+#endif
+#ifndef VIB_DECIM
+#define VIB_DECIM 4                   // Logged / filtered rate = input / VIB_DECIM
+#endif
+#define VIB_OUTPUT_RATE_HZ (VIB_INPUT_RATE_HZ / VIB_DECIM)
+#define VIB_FIR_TAPS 48               // Multiple of 4 and of VIB_DECIM (esp-dsp S3 kernel)
+#define VIB_FIR_KAISER_BETA 5.0
+#define VIB_MAX_BLOCK 32              // Samples per VIB_process() chunk, the ADXL375 FIFO depth
+#define VIB_FFT_N 256                 // Spectrum window, power of two
+#define VIB_BINS (VIB_FFT_N / 2)      // DC .. Nyquist - 1 bin
+#define VIB_AXES 3
+#define VIB_G_PER_LSB 0.049f          // ADXL375 scale
+#define VIB_DB_MIN -100.0f            // Code 0, dB re 1 g^2/Hz
+#define VIB_DB_STEP 0.5f              // dB per code
+
+
+typedef struct {
+  // Decimating FIR, one delay line per axis. The portable kernel writes every
+  // sample twice (pos and pos + VIB_FIR_TAPS) so the window is contiguous.
+  float coeffs[VIB_FIR_TAPS] __attribute__((aligned(16)));
+  float delay[VIB_AXES][2 * VIB_FIR_TAPS] __attribute__((aligned(16)));
+  int pos[VIB_AXES];
+#if VIB_USE_ESP_DSP
+  fir_f32_t fird[VIB_AXES];
+#endif
+
+  // Input staged until a whole VIB_DECIM group is there
+  float stage[VIB_AXES][VIB_MAX_BLOCK + VIB_DECIM] __attribute__((aligned(16)));
+  int64_t stage_t_us[VIB_MAX_BLOCK + VIB_DECIM];
+  int staged;
+  float decimated[VIB_AXES][VIB_MAX_BLOCK / VIB_DECIM + 1] __attribute__((aligned(16)));
+
+  // Spectrum : current window per axis, FFT work buffers, Welch accumulators
+  float frame[VIB_AXES][VIB_FFT_N];
+  int frame_fill;
+  float window[VIB_FFT_N];
+  float window_power;         // sum of window^2
+  float twiddle[VIB_FFT_N] __attribute__((aligned(16)));   // cos, -sin pairs for k < N / 2
+  float fft[2][2 * VIB_FFT_N] __attribute__((aligned(16))); // Interleaved complex
+  float power[VIB_AXES][VIB_BINS];
+  uint16_t windows;           // Windows accumulated in power
+  int64_t t_frame_us;         // Stamp of the newest sample of the last window
+} VIB_t;
+
+
+/**
+ * @brief Design the FIR, clear the delay lines and spectrum accumulators.
+ */
+void VIB_init(VIB_t *vib);
+
+/**
+ * @brief Feed full rate samples.
+ *
+ * Input samples are VIB_INPUT_RATE_HZ apart, oldest first, the newest one
+ * taken at t_newest_us (an ADXL375 FIFO burst).
+ *
+ * @param[in] raw n samples of X, Y, Z counts.
+ * @param[out] out Decimated counts, room for n / VIB_DECIM + 1 samples.
+ * @param[out] t_out_us Stamp of each decimated sample, group delay removed.
+ * @return Number of decimated samples written.
+ */
+int VIB_process(VIB_t *vib, const int16_t (*raw)[3], int n, int64_t t_newest_us,
+                int16_t (*out)[3], int64_t *t_out_us);
+
+/**
+ * @brief Quantised mean PSD since the last call, then restart the average.
+ * @param[out] db Per axis and bin, VIB_DB_MIN + code * VIB_DB_STEP dB re 1 g^2/Hz.
+ * @param[out] t_us Stamp of the newest sample in the average.
+ * @return Windows averaged, 0 if none (db untouched).
+ */
+uint16_t VIB_spectrum_take(VIB_t *vib, uint8_t db[VIB_AXES][VIB_BINS], int64_t *t_us);
+
+/**
+ * @brief Portable decimating FIR, same contract as esp-dsp dsps_fird_f32().
+ *
+ * Consumes n_out * VIB_DECIM inputs. coeffs[0] weighs the oldest sample
+ * of the window.
+ *
+ * @param delay 2 * VIB_FIR_TAPS floats.
+ * @param pos Write position in delay, 0 .. VIB_FIR_TAPS - 1.
+ * @return n_out.
+ */
+int VIB_fird_c(const float *coeffs, float *delay, int *pos, const float *in, float *out, int n_out);
+
+/**
+ * @brief Portable in place radix-2 FFT of VIB_FFT_N interleaved complex values, natural order out.
+ */
+void VIB_fft_c(float *data, const float *twiddle);
+
+/**
+ * @brief Compare the accelerated kernels with the portable ones on a fixed signal.
+ *
+ * Runs in the vib work buffers and leaves them as VIB_init() does, with or
+ * without accelerated kernels. It does not replace the caller's VIB_init().
+ *
+ * @return Largest difference relative to the output rms, 0 without accelerated kernels.
+ */
+float VIB_self_test(VIB_t *vib);
+
+#endif /* VIBRATION_H */
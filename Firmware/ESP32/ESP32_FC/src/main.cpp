@@ -38,8 +38,16 @@
  *      float atmospheric = readPressure() / 100.0F;
         return 44330.0 * (1.0 - pow(atmospheric / seaLevel, 0.1903));
 
- * Formula is taken from BMPXXX library. But we will calculate altitude 
- *  in post-procesing and not onboard the flight computer
+ * Formula is taken from BMPXXX library. Onboard it is evaluated with a
+ *  piecewise cubic table (lib/BaroAltitude) instead of pow(). Altitude above
+ *  the pad is the difference to the pad pressure altitude measured at startup
+ *  (BMP390_ground_reference())
+ *  and fused with the ADXL375 axial acceleration in a 3-state Kalman filter
+ *  (lib/AltitudeKF) to give real-time altitude, velocity and acceleration.
+ *
+ * Apogee is detected by vote (lib/ApogeeDetect) between the Kalman velocity
+ *  zero crossing, the baro altitude peak and the GPS height trend, and logged
+ *  as an EVENT record with the time of each vote.
  * 
  * ------------------------------------------------------------------------
  *          Ublox NEO-7M GPS 
@@ -47,6 +55,13 @@
  * 
  * GPS Sensor will use UART Port 2. (Serial 2) for data collection.
  * For debugging, we might use another Serial port if needed. 
+ *
+ * The time pulse (PPS) output goes to GPS_PPS_PIN. Its rising edge is stamped
+ *  in an interrupt and paired with the NAV-PVT of that second (lib/TimeSync),
+ *  which fits the esp_timer clock offset and drift against GPS time. A
+ *  TIMESYNC record per second lets the host map every sample to UTC, and
+ *  once locked the apogee GPS detector uses the real epoch time of each fix
+ *  instead of its arrival time.
  * 
  * ------------------------------------------------------------------------
  *          SD Card Data storage
@@ -75,6 +90,193 @@
  *  - GPIO 11 -> MOSI
  *  - GPIO 13 -> MISO
  *  - GPIO 10 -> CSO
+ *
+ * SPI3 takes the external W25Q log flash when FLASH_LOG_DEVICE selects it :
+ *  - GPIO 39 -> SCK
+ *  - GPIO 41 -> MOSI
+ *  - GPIO 40 -> MISO
+ *  - GPIO 42 -> CS
+ *
+ * ------------------------------------------------------------------------
+ *          Sampling time base
+ * ------------------------------------------------------------------------
+ *
+ * Sensors are sampled from periodic esp_timer timers, not from loop() :
+ *
+ * | Sensor  | Rate   | Task          | Notes                                 |
+ * | ------- | ------ | ------------- | ------------------------------------- |
+ * | ADXL375 | 800 Hz | Accel_Task    | 3200 Hz ODR, FIFO drained every wake   |
+ * | BMP390  | 50 Hz  | Baro_Task     | Forced conversion (4x/4x) takes ~17 ms |
+ *
+ * The timer callback only wakes the sampling task (both pinned to core 0),
+ *  which stamps the sample with esp_timer_get_time() (64-bit us since boot)
+ *  right before the I2C read and queues it. loop() on core 1 drains the
+ *  queue : Kalman filter with the real dt between stamps, apogee detection,
+ *  and the SD log. The two tasks share Wire, whose transactions are locked
+ *  by the Arduino core, so a BMP390 conversion wait does not block the ADXL375.
+ *
+ * The ADXL375 samples at 3200 Hz into its 32 entry FIFO (stream mode).
+ *  Every wake Accel_Task drains the ~4 new entries through lib/Vibration :
+ *  a decimating FIR back to 800 Hz for the ACCEL records and the filter
+ *  (stamps corrected for the FIR group delay), and a Welch spectrum of the
+ *  full rate stream, logged once a second as a SPECTRUM record (PSD per
+ *  axis, 12.5 Hz bins up to 1600 Hz). Each FIFO entry is its own 6 byte
+ *  I2C read, ~0.2 ms at 400 kHz, so the ADXL375 keeps the bus ~65 % busy;
+ *  the BMP390 transactions still fit in between.
+ *
+ * Each task wake also feeds a jitter monitor (lib/Timebase) : the BARO
+ *  stamp, and for ACCEL the FIFO drain itself, not the decimated stamps,
+ *  which are evenly spaced by construction. Once a second a
+ *  TIMING record per sensor logs min/max/rms jitter, a histogram, missed
+ *  periods and samples dropped on a full queue.
+ *
+ * The log file (LOG_FILE_PATH) is a stream of timestamped records (lib/FlightLog) :
+ *  ACCEL, BARO, GPS per sample, STATE from the filter, EVENT on flight
+ *  events, TIMING and SPECTRUM once a second. Decode with Tools/log_decode.
+ *  With LOG_ACCEL_PACK the ACCEL samples go in ACCEL_PACK records instead,
+ *  80 ms a record, stamps and counts delta coded and bit packed : ~8 times
+ *  less log for the same samples, see Tools/accel_pack.
+ *  Every slot written also has a LOG_IndexEntry_t (first sample stamp,
+ *  file offset, events so far) in LOG_INDEX_PATH, so host tools seek by
+ *  time or event without scanning the log (Tools/log_extract).
+ *
+ * The log file is a journal (lib/LogJournal) : preallocated once to
+ *  LOG_JOURNAL_SIZE, then written in 4 KB slots that each end in a COMMIT
+ *  record, never rewritten and never growing the file, so a battery pulled
+ *  mid write loses at most the slot in flight. At boot the end of the journal
+ *  is found by binary search and logging resumes after it in a new session.
+ *  A partial slot is committed with the once a second flush, so at most one
+ *  slot a second is part padding.
+ *
+ * Slots bypass the file system : at boot lib/FatExtent reads the FAT to find
+ *  the card sectors of the preallocated file and, if its clusters are
+ *  consecutive, slots are written there sector by sector. The index is
+ *  preallocated too (entry i for slot i) and written a whole sector per 32
+ *  slots the same way; the entries of the sector being filled are rebuilt
+ *  from the journal at boot. No cluster allocation, FAT, directory entry or
+ *  FSInfo update is left on the logging path, only data sectors, and both
+ *  stay normal files for a PC. A fragmented file (card not empty when it was
+ *  created) is written through the file system instead. A STORAGE record
+ *  once a second logs the worst slot write and flush times.
+ *
+ * The card is on SPI (SD library) or on the SDMMC host with a 4 bit bus and
+ *  DMA (SD_MMC library, SDMMC_* pins), chosen at build time with SD_BACKEND.
+ *  Both mount FatFs and take raw sector reads and writes, everything above
+ *  SD_Bus_Begin() / SD_Bus_Read() / SD_Bus_Write() is the same. Built with
+ *  SD_BENCHMARK=1, boot first times 16 MB of slot writes on the bus, raw and
+ *  through the file system, and prints MB/s and p50 / p99 / worst latency
+ *  (SD_Benchmark()).
+ *
+ * ------------------------------------------------------------------------
+ *          Internal flash log
+ * ------------------------------------------------------------------------
+ *
+ * The rest of the 16 MB flash is a raw data partition (FLASH_PARTITION in
+ *  partitions.csv, ~13 MB) holding a ring of the same 4 KB slots
+ *  (lib/FlashRing). With FLASH_LOG_MODE at FLASH_LOG_FALLBACK the ring takes
+ *  every record when the SD card fails to mount or its journal does not
+ *  open; with FLASH_LOG_MIRROR it takes them as well as the card. The ring
+ *  keeps the newest ~9 min at the flight data rate and carries on from its
+ *  head across boots, so each sector wears the same.
+ *
+ * A sector erase stops the flash cache, and both cores with it, for ~45 ms
+ *  (400 ms worst), longer than the ADXL375 FIFO holds at 3200 Hz (10 ms) :
+ *  Accel_Task stops as well, so the sample queue does not cover an erase and
+ *  the FIFO overflows. Sectors are only erased ahead before launch, to keep
+ *  FLASH_RUNWAY_SLOTS (~3.5 min of flight log) ready :
+ *  - at a power on boot, setup() fills the runway before the sampling
+ *    timers start (up to ~1 min after a long flight, blank sectors are only
+ *    read);
+ *  - on the pad, after each commit, the flash writer erases one sector the
+ *    moment Accel_Task has drained the FIFO, the next commit ~0.16 s off.
+ *    That holds the runway while the rocket waits; each erase still costs
+ *    the FIFO ~35 ms of samples on the pad.
+ *  Erasing ahead stops for good once the apogee detector leaves PAD. A
+ *  reset other than power on (brownout, panic, watchdog) that finds the
+ *  ring in use may be a reboot in flight : it neither fills nor tops up,
+ *  sampling starts at once on what runway is left. In flight a commit only
+ *  programs its sector (~6 ms). Past the runway each commit erases first,
+ *  stops acquisition like any erase and is counted in the flash STORAGE
+ *  record. Read the partition back with esptool read_flash and
+ *  Tools/flash_ring unwrap.
+ *
+ * With FLASH_LOG_DEVICE at FLASH_DEVICE_W25Q the ring is on an external
+ *  W25Q class chip (lib/SpiNor) on SPI3 instead, the whole 16 MB of it. Its
+ *  erases stop neither the cache nor the cores, so sectors are erased ahead
+ *  in flight as well : the chip erases in the background and suspends for
+ *  each page of a commit. Within FLASH_DUMP_WAIT_MS of boot a 'D' on Serial
+ *  sends the chip out (Tools/spi_nor fetch, then Tools/flash_ring unwrap).
+ *
+ * ------------------------------------------------------------------------
+ *          Log destinations
+ * ------------------------------------------------------------------------
+ *
+ * loop() encodes each record once, into a block the size of a slot
+ *  (lib/LogSink) that starts with a BLOCK record (boot id, block number).
+ *  Every open destination, the SD journal and the flash ring, gets its own
+ *  copy of each block through its own LOG_SINK_BLOCKS buffers and writes it
+ *  from its own task (LOG_WRITER_CORE, below the sampling tasks). loop()
+ *  never waits for a write : a destination whose buffers are all still
+ *  queued drops that block, its own copy only, so a stalled or dead card
+ *  costs neither samples nor the flash copy. A SINK record per destination
+ *  once a second logs blocks handed over, written, dropped and failed, the
+ *  deepest queue and the longest wait. Built with FLASH_LOG_MIRROR, both
+ *  copies of a flight are merged block by block with Tools/log_merge.
+ *  The exception is the flash ring on the internal flash (FLASH_LOG_DEVICE
+ *  at FLASH_DEVICE_INTERNAL) : its erases stop both cores, sampling tasks
+ *  included, so once its runway is used up (~3.5 min of flight, see
+ *  "Internal flash log") each of its commits does hold up acquisition, in
+ *  mirror mode as in fallback. Mirror onto the W25Q for copies that fail
+ *  apart for the whole flight.
+ *
+ * ------------------------------------------------------------------------
+ *          Log offload
+ * ------------------------------------------------------------------------
+ *
+ * After recovery the logs come off over the USB port (Serial is the native
+ *  USB CDC port of the ESP32-S3) instead of out of the card : within
+ *  OFFLOAD_WAIT_MS of boot, before logging starts, a request from
+ *  Tools/offload turns the board into a file server (lib/Offload) for the
+ *  journal used so far, its index and the flash ring partition. DATA comes
+ *  in CRC-checked chunks of a slot through a sliding window, the host
+ *  resumes from its last whole chunk after anything goes wrong, and checks
+ *  each file against a CRC-32 of the board's. Logging starts once the host
+ *  says BYE or is quiet for OFFLOAD_IDLE_MS.
+ *
+ * ------------------------------------------------------------------------
+ *          Telemetry
+ * ------------------------------------------------------------------------
+ *
+ * An RFM95 (SX1276 LoRa, lib/Rfm95) shares SPI3 with the W25Q :
+ *               SCK  -> 39 (NOR_SCK)
+ *               MISO -> 40 (NOR_MISO)
+ *               MOSI -> 41 (NOR_MOSI)
+ *               NSS  -> 38
+ *               DIO0 -> 47 (TxDone)
+ *               RESET-> 48
+ *  Each STATE record also refreshes the state the radio sends (lib/Telemetry) :
+ *  flight phase, altitude, velocity, acceleration, highest altitude, GPS
+ *  position and fix, battery, health flags and drop counters, bit packed in
+ *  a 27 byte STATE packet. Telemetry_Task (TLM_CORE, between the log
+ *  writers and the sampling tasks) sends the newest one as often as the
+ *  band's duty cycle (TLM_DUTY_PERCENT) allows at the LoRa settings. Every
+ *  TLM_KEYFRAME_EVERY-th packet is a whole STATE keyframe, the others 12
+ *  byte DELTAs against it (time, altitude and position as differences) :
+ *  ~4 a second at SF7 / 250 kHz, against ~3 of STATE packets alone. A send only loads the radio's FIFO (~90 us of
+ *  SPI) and starts the TX; TxDone on DIO0 wakes the task for the next one,
+ *  so nothing waits for the air. Once landed (descending slower than
+ *  TLM_LANDED_SPEED for TLM_LANDED_US) it only sends a 19 byte GPS BEACON
+ *  every TLM_BEACON_PERIOD_MS and sleeps the radio in between. Build with
+ *  TELEMETRY=0 to leave the radio out; the link is simulated with
+ *  Tools/telemetry.
+ *  Optional erasure coding (lib/Fec) for burst losses : with TLM_FEC_M > 0,
+ *  TLM_FEC_M REPAIR packets follow every TLM_FEC_K packets (the first one
+ *  XOR parity, Reed-Solomon after), and the ground rebuilds up to
+ *  TLM_FEC_M lost packets of each group with no return channel. The
+ *  repairs take airtime from the states at the same duty cycle, so it is
+ *  off by default; `telemetry fec` weighs it on burst loss channels.
+ *  TLM_FEC_BENCHMARK=1 times the code on this core at boot
+ *  (Telemetry_Fec_Benchmark()).
  * 
  * 
  * @author Taizun Jafri (jafri.taizun.s@gmail.com)
@@ -91,8 +293,31 @@
 #include <UbxGpsNavPvt.h>             // Configure NAVPVT message from GPS Module for UBX protocol.
 #include <HardwareSerial.h>
 #include <stdint.h>
+#include <algorithm>
 #include <SD.h>
+#include <SD_MMC.h>
 #include <SPI.h> 
+#include <esp_timer.h>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include "altitude_kf.h"
+#include "apogee_detect.h"
+#include "baro_altitude.h"
+#include "flight_log.h"
+#include "log_journal.h"
+#include "log_sink.h"
+#include "offload.h"
+#include "rfm95.h"
+#include "fat_extent.h"
+#include "fec.h"
+#include "flash_ring.h"
+#include "spi_nor.h"
+#include "telemetry.h"
+#include "time_sync.h"
+#include "timebase.h"
+#include "vibration.h"
 
 
 // Defines
@@ -100,17 +325,156 @@
 #define I2C_SCL 22                    // I2C SCL Line 
 #define ADXL375_I2C_ADDRESS (0x53)    // ADXL375 I2C address
 #define ADXL375_DATA_X0_REG (0x32)    // This and next 5 regs contain X,Y,Z acceleration respectively.
+#define ADXL375_BW_RATE_REG (0x2C)    // Output data rate register
+#define ADXL375_RATE_3200HZ (0x0F)    // BW_RATE code for 3200 Hz
+#define ADXL375_FIFO_CTL_REG (0x38)   // FIFO mode and watermark
+#define ADXL375_FIFO_STATUS_REG (0x39) // Entries waiting in the FIFO, bits 5:0
+#define ADXL375_FIFO_STREAM (0x80)    // Stream mode, the oldest entry is dropped when full
+#define ADXL375_FIFO_DEPTH 32
+#define I2C_CLOCK (400000)            // Fast mode, one ADXL375 read takes ~0.3 ms
 #define GPS_BAUDRATE (115200)         // GPS Serial2 port baud rate
+#define GPS_PPS_PIN 8                 // NEO-7M TIMEPULSE, rising edge at the top of each second
 #define SERIAL_BAUDRATE (115200)      // Serial monitor baud rate
 // Any pins can be defined for SPI use. 
 #define HSPI_MOSI  4                  // HSPI MOSI pin
 #define HSPI_MISO  5                  // HSPI MISO pin
 #define HSPI_SCK   6                  // HSPI SCK pin
 #define HSPI_CS    7                  // HSPI Chip Select Pin
+#define SD_BACKEND_SPI 0              // SD library, SPI
+#define SD_BACKEND_SDMMC 1            // SD_MMC library, SDMMC host, 4 bit bus with DMA
+#ifndef SD_BACKEND
+#define SD_BACKEND SD_BACKEND_SPI     // Card bus, build flag -DSD_BACKEND=1 for SDMMC
+#endif
+#ifndef SD_SPI_FREQ
+#define SD_SPI_FREQ 20000000          // Hz, the SD library default is 4 MHz
+#endif
+// SDMMC pins go through the GPIO matrix, any free pins do. D3 is also the card's
+// SPI chip select : it needs its pull-up for 4 bit mode.
+#define SDMMC_CLK 14
+#define SDMMC_CMD 15
+#define SDMMC_D0 16
+#define SDMMC_D1 17
+#define SDMMC_D2 18
+#define SDMMC_D3 9
+#ifndef SDMMC_FREQ_KHZ
+#define SDMMC_FREQ_KHZ 40000          // High speed, 20 MB/s on 4 lines
+#endif
+#ifndef SD_BENCHMARK
+#define SD_BENCHMARK 0                // 1 : time slot writes on SD_BENCH_PATH at boot, see SD_Benchmark()
+#endif
+#define SD_BENCH_PATH "/SD_BENCH.bin"
+#define SD_BENCH_SIZE (16UL * 1024 * 1024)
+#define SD_BENCH_SYNC_SLOTS 4         // A sync every 4 slots, about the flight data rate's once a second
+#define FLASH_LOG_OFF 0
+#define FLASH_LOG_FALLBACK 1          // Flash ring only when the SD card log does not open
+#define FLASH_LOG_MIRROR 2            // Flash ring next to the SD card log, always
+#ifndef FLASH_LOG_MODE
+#define FLASH_LOG_MODE FLASH_LOG_FALLBACK
+#endif
+#define FLASH_PARTITION "flightlog"   // partitions.csv, data partition of subtype FLASH_PARTITION_SUBTYPE
+#define FLASH_PARTITION_SUBTYPE 0x40
+#define FLASH_RUNWAY_SLOTS 1280       // Sectors kept erased ahead before launch, ~3.5 min of flight log
+#define FLASH_ERASE_POLL_MS 10        // Flash writer wakes this often to erase ahead on the W25Q
+#define FLASH_DEVICE_INTERNAL 0       // FLASH_PARTITION of the module's own flash
+#define FLASH_DEVICE_W25Q 1           // External W25Q class chip on SPI3 (lib/SpiNor), erased ahead in flight too
+#ifndef FLASH_LOG_DEVICE
+#define FLASH_LOG_DEVICE FLASH_DEVICE_INTERNAL
+#endif
+#define NOR_SCK 39                    // W25Q on SPI3, any free pins
+#define NOR_MISO 40
+#define NOR_MOSI 41
+#define NOR_CS 42
+#ifndef NOR_SPI_FREQ
+#define NOR_SPI_FREQ 40000000         // Hz, the W25Q128JV takes 133 MHz
+#endif
+#define NOR_YIELD_US 1000             // A wait for the chip yields the core, then sleeps a tick past this
+#define FLASH_DUMP_WAIT_MS 3000       // W25Q : a 'D' on Serial this long after boot dumps the chip
+#define OFFLOAD_WAIT_MS 2000          // A host asking for the logs this long after boot gets them before logging starts
+#define OFFLOAD_IDLE_MS 5000          // Logging starts once the host is quiet this long
+#define OFFLOAD_CHUNK 4096            // DATA payload, a slot
+#ifndef TELEMETRY
+#define TELEMETRY 1                   // 0 : no radio
+#endif
+#define RFM_CS 38                     // RFM95 on SPI3 with the W25Q, its own chip select
+#define RFM_DIO0 47                   // TxDone
+#define RFM_RST 48
+#define RFM_SPI_FREQ 8000000          // Hz, the SX1276 takes 10 MHz
+#ifndef TLM_FREQ_HZ
+#define TLM_FREQ_HZ 869525000         // 869.40 - 869.65 MHz : 10 % duty cycle, 500 mW ERP (EU)
+#endif
+#ifndef TLM_SF
+#define TLM_SF 7                      // Spreading factor, each step up doubles the airtime
+#endif
+#ifndef TLM_BW_HZ
+#define TLM_BW_HZ 250000
+#endif
+#define TLM_CR 5                      // Coding rate 4/5
+#define TLM_PREAMBLE 8                // Symbols
+#define TLM_SYNC_WORD 0x12            // Private network
+#define TLM_POWER_DBM 17              // PA_BOOST
+#ifndef TLM_DUTY_PERCENT
+#define TLM_DUTY_PERCENT 10           // Share of the time on the air
+#endif
+#ifndef TLM_KEYFRAME_EVERY
+#define TLM_KEYFRAME_EVERY 4          // STATE keyframe every 4 packets in flight, DELTAs between; 1 : STATE only
+#endif
+#ifndef TLM_FEC_K
+#define TLM_FEC_K 4                   // Packets per FEC group, up to FEC_MAX_K
+#endif
+#ifndef TLM_FEC_M
+#define TLM_FEC_M 0                   // REPAIR packets per group, up to FEC_MAX_M; 0 : no FEC
+#endif
+#ifndef TLM_FEC_BENCHMARK
+#define TLM_FEC_BENCHMARK 0           // 1 : time the erasure code at boot, see Telemetry_Fec_Benchmark()
+#endif
+#define TLM_FEC_BENCH_RUNS 1000
+#define TLM_BEACON_PERIOD_MS 5000     // GPS beacon after landing
+#define TLM_WAKE_MS 100               // Radio task wakes at least this often : TxDone missed, state of the schedule
+#define TLM_CORE 0
+#define TLM_PRIORITY 2                // Above the log writers, below Accel_Task and Baro_Task
+#define BATT_SENSE_PIN 1              // Battery through a BATT_DIVIDER : 1 divider, ADC1
+#define BATT_DIVIDER 3                // 2S LiPo, 8.4 V full, into the ADC's 3.1 V range
+#define BATT_READ_US 1000000
+#ifndef LOG_ACCEL_PACK
+#define LOG_ACCEL_PACK 1              // 0 : an ACCEL record per sample, for decoders older than ACCEL_PACK
+#endif
+#define LOG_SINK_BLOCKS 8             // Block buffers per destination, ~1.3 s of log at the flight data rate
+#define LOG_WRITER_CORE 0             // Destination writer tasks, preempted by the sampling tasks
+#define LOG_WRITER_PRIORITY 1         // Time sliced with each other, below Accel_Task and Baro_Task
+#define ADXL375_AXIAL_AXIS 2          // ADXL375 axis along the rocket body (0 = X, 1 = Y, 2 = Z)
+#define BARO_GROUND_SAMPLES 50        // Pressure samples averaged for the pad reference
+#define LOG_FILE_PATH "/SENSOR_DATA.bin"
+#define LOG_INDEX_PATH "/SENSOR_DATA.idx"   // Sparse time index of LOG_FILE_PATH, one entry per slot
+#define LOG_OLD_PATH "/SENSOR_DATA.old"     // A log from before the journal is moved here
+#define LOG_OLD_INDEX_PATH "/SENSOR_DATA.oldidx"
+#ifndef LOG_JOURNAL_SIZE
+#define LOG_JOURNAL_SIZE (1024UL * 1024 * 1024)  // Preallocated journal (< 4 GB, FAT32), ~17 h at the flight data rate
+#endif
+#ifndef LOG_RAW_SECTORS
+#define LOG_RAW_SECTORS 1             // 0 : write the journal through the file system
+#endif
+#define LOG_INDEX_SIZE (LOG_JOURNAL_SIZE / LOG_SLOT_SIZE * sizeof(LOG_IndexEntry_t))  // Entry i : slot i
+#define ACCEL_PERIOD_US 1250          // 800 Hz, FIFO drain and decimated rate (VIB_OUTPUT_RATE_HZ)
+#define BARO_PERIOD_US 20000          // 50 Hz, a 4x/4x forced conversion takes ~17 ms
+#define SAMPLE_QUEUE_LEN 512          // Samples buffered between the sampling tasks and loop()
+#define SAMPLE_CORE 0                 // Sampling tasks run here, loop() runs on core 1
+#define STATE_LOG_DIVIDER 8           // STATE record every 8 accel samples (100 Hz)
+#define TIMING_REPORT_US 1000000      // TIMING records and file flush period
+#define SPECTRUM_REPORT_US 1000000    // SPECTRUM record period
+#define SPECTRUM_QUEUE_LEN 2          // Spectra buffered between Accel_Task and loop()
 
 
 // Defining File for Data Logging
 File DATA_LOG_FILE; // File Object for SD card file.
+File DATA_INDEX_FILE; // Time index of DATA_LOG_FILE
+File SD_BENCH_FILE; // SD_Benchmark() scratch file
+#if SD_BACKEND == SD_BACKEND_SDMMC
+fs::FS &SDCard = SD_MMC;
+#define SD_BUS_NAME "sdmmc 4 bit"
+#else
+fs::FS &SDCard = SD;
+#define SD_BUS_NAME "spi"
+#endif
 
 HardwareSerial *gpsSerial = &Serial2;
 
@@ -121,11 +485,8 @@ HardwareSerial *gpsSerial = &Serial2;
 //------------------------------------------------------------------------------------------------------
 Adafruit_ADXL375 High_G_accelerometer = Adafruit_ADXL375(0200);  // Defining ADXL375 object
 void ADXL375_init(void);                                         // Initialize ADXL375
-void ADXL375_acc_in_G (
-             int16_t *x,
-             int16_t *y,
-             int16_t *z
-);                                                               // Get acceleration data in G
+void ADXL375_read_raw(int16_t raw[3]);                           // Read raw counts (49 mg/LSB)
+int ADXL375_read_fifo(int16_t (*raw)[3]);                        // Drain the FIFO, oldest first
 
 
 //------------------------------------------------------------------------------------------------------
@@ -133,12 +494,76 @@ void ADXL375_acc_in_G (
 //------------------------------------------------------------------------------------------------------
 Adafruit_BMP3XX BMP390; //Creating BMP390 Instance.
 void BMP390_init();
-void BMP390_Pressure_Temp(
+bool BMP390_Pressure_Temp(
   double *Temp,
   double *Pressure
 );
 
 
+void BMP390_ground_reference();
+float BMP390_altitude(double pressure);
+
+
+//------------------------------------------------------------------------------------------------------
+// Altitude Kalman filter
+//------------------------------------------------------------------------------------------------------
+KF_t AltitudeKF;                 // altitude, velocity, acceleration estimate
+void KF_accel_sample(int64_t t_us, const int16_t raw[3]);
+void KF_baro_sample(int64_t t_us, float pressure);
+
+
+//------------------------------------------------------------------------------------------------------
+// Timer driven sampling
+//------------------------------------------------------------------------------------------------------
+typedef struct {
+  uint8_t sensor;                // LOG_SensorId_t
+  int64_t t_us;                  // esp_timer time of the read
+  union {
+    int16_t acc[3];
+    struct {
+      float pressure;
+      float temperature;
+    } baro;
+  };
+} Sample_t;
+
+QueueHandle_t SampleQueue;
+TaskHandle_t AccelTaskHandle, BaroTaskHandle;
+esp_timer_handle_t AccelTimer, BaroTimer;
+TB_Jitter_t SampleJitter[2];     // Indexed by LOG_SensorId_t
+uint32_t SampleDropped[2];
+portMUX_TYPE JitterLock = portMUX_INITIALIZER_UNLOCKED;
+void Sampling_Init();
+void Accel_Task(void *arg);
+void Baro_Task(void *arg);
+void Sample_Jitter(uint8_t sensor, int64_t t_us);
+void Sample_Queue(Sample_t *sample);
+void Timing_Report(int64_t t_us);
+
+
+//------------------------------------------------------------------------------------------------------
+// Vibration spectrum
+//------------------------------------------------------------------------------------------------------
+typedef struct {
+  int64_t t_us;                  // Newest sample in the average
+  LOG_Spectrum_t rec;
+} Spectrum_t;
+
+VIB_t Vibration;                 // Used by Accel_Task only once sampling starts
+QueueHandle_t SpectrumQueue;
+int64_t SpectrumReport_us = 0;   // Next SPECTRUM record
+void Vibration_Init();
+void Vibration_Report();
+
+
+//------------------------------------------------------------------------------------------------------
+// Apogee detection
+//------------------------------------------------------------------------------------------------------
+APOGEE_t ApogeeDetector;
+void APOGEE_run(int64_t t_us);
+void APOGEE_log_event(uint8_t id, const APOGEE_Event_t *ev);
+
+
 //------------------------------------------------------------------------------------------------------
 // Ublox NEO-7M GPS function declarations 
 //------------------------------------------------------------------------------------------------------
@@ -161,6 +586,8 @@ void BMP390_Pressure_Temp(
  */
 void GPS_Init();
 void GPS_Capture_data();
+void GPS_PPS_ISR();
+void GPS_Time_Sync(int64_t t_rx_us);
 bool syncGPSmsg(uint8_t GPS_byte); // Function to sync UART message to correct UBX btye
 
 
@@ -174,9 +601,104 @@ bool syncGPSmsg(uint8_t GPS_byte); // Function to sync UART message to correct U
  *  - GPIO 11 -> MOSI
  *  - GPIO 13 -> MISO
  *  - GPIO 10 -> CSO
+ * or with SD_BACKEND_SDMMC, SDMMC_CLK / CMD / D0..D3.
  */
+// A preallocated file, updated in place : straight to its card sectors when
+// they are one run (raw), else through the file system.
+typedef struct {
+  const char *path;
+  uint32_t size;
+  File *file;
+  FATX_Extent_t extent;
+  bool raw;
+} SD_Target_t;
+
+bool SD_Bus_Begin();
+bool SD_Bus_Read(uint32_t lba, uint8_t *buf);
+bool SD_Bus_Write(uint32_t lba, const uint8_t *buf);
 void SD_Card_Init();
-void SD_Save_Data();
+void SD_Benchmark();
+void SD_Bench_Pass(SD_Target_t *t);
+bool SD_Preallocate(const char *path, uint32_t size);
+bool SD_Target_Open(SD_Target_t *t);
+bool SD_Raw_Sector(void *ctx, uint32_t lba, uint8_t *buf);
+bool SD_Target_Read(void *ctx, uint64_t offset, void *buf, size_t n);
+bool SD_Target_Write(void *ctx, uint64_t offset, const void *buf, size_t n);
+bool SD_Target_Sync(void *ctx);
+void SD_Index_Resume();
+bool SD_Write_Block(const SINK_Block_t *b);
+void SD_Writer_Task(void *arg);
+
+
+//------------------------------------------------------------------------------------------------------
+// Internal flash log
+//------------------------------------------------------------------------------------------------------
+void Flash_Log_Init();
+void Flash_Fill_Runway();
+bool Flash_Top_Up();
+bool Flash_Read(void *ctx, uint32_t offset, void *buf, size_t n);
+bool Flash_Write(void *ctx, uint32_t offset, const void *buf, size_t n);
+bool Flash_Erase(void *ctx, uint32_t offset, size_t n);
+bool Nor_Xfer(void *ctx, const uint8_t *cmd, size_t n_cmd, const uint8_t *tx, uint8_t *rx, size_t n);
+uint32_t Nor_Now_us(void *ctx);
+void Nor_Idle(void *ctx, uint32_t waited_us);
+bool Nor_Read(void *ctx, uint32_t offset, void *buf, size_t n);
+bool Nor_Write(void *ctx, uint32_t offset, const void *buf, size_t n);
+bool Nor_Erase(void *ctx, uint32_t offset, size_t n);
+void Nor_Dump();
+bool Flash_Write_Block(const SINK_Block_t *b);
+void Flash_Erase_Ahead();
+void Flash_Writer_Task(void *arg);
+
+
+//------------------------------------------------------------------------------------------------------
+// Log destinations
+//------------------------------------------------------------------------------------------------------
+SINK_Stage_t LogStage;                  // Block being encoded, loop() only
+SINK_Block_t SdBlocks[LOG_SINK_BLOCKS];
+SINK_Block_t FlashBlocks[LOG_SINK_BLOCKS];
+SINK_t SdSink, FlashSink;
+TaskHandle_t SdWriterHandle, FlashWriterHandle;
+portMUX_TYPE StorageLock = portMUX_INITIALIZER_UNLOCKED;  // STORAGE windows, updated by the writer tasks
+void Log_Sinks_Init();
+LOG_AccelPack_t AccelPack;              // ACCEL samples of the next ACCEL_PACK record, loop() only
+uint8_t AccelPackPayload[LOG_ACCEL_PACK_MAX];
+void Log_Write_Record(uint8_t type, int64_t t_us, const void *payload, uint16_t len);
+void Log_Accel(int64_t t_us, const int16_t acc[3]);
+void Log_Accel_Close();
+void Log_Flush(bool sync);
+void Storage_Report(int64_t t_us);
+void Storage_Window_Report(int64_t t_us, LOG_Storage_t *window, const SINK_t *sink);
+
+
+//------------------------------------------------------------------------------------------------------
+// Log offload
+//------------------------------------------------------------------------------------------------------
+OFF_Server_t Offload;
+uint8_t OffloadBuf[2 * (OFFLOAD_CHUNK + OFF_OVERHEAD)];  // Frame buffers, built in turns
+void Offload_Run();
+bool Offload_Read_Sd(void *ctx, uint32_t offset, void *buf, size_t n);
+bool Offload_Read_Flash(void *ctx, uint32_t offset, void *buf, size_t n);
+bool Offload_Send(void *ctx, const uint8_t *buf, size_t n);
+
+//------------------------------------------------------------------------------------------------------
+// Telemetry
+//------------------------------------------------------------------------------------------------------
+RFM_t Radio;
+bool RadioOpen = false;
+TLM_Sched_t TelemetrySched;             // Telemetry_Task only
+TLM_PhaseTracker_t TelemetryPhase;      // loop() only
+TLM_State_t TelemetryState;             // Written by loop(), sent by Telemetry_Task
+portMUX_TYPE TelemetryLock = portMUX_INITIALIZER_UNLOCKED;
+TaskHandle_t TelemetryTaskHandle;
+static_assert(TLM_FEC_K >= 1 && TLM_FEC_K <= FEC_MAX_K && TLM_FEC_M <= FEC_MAX_M, "TLM_FEC_K / TLM_FEC_M out of range");
+void Telemetry_Init();
+void Telemetry_Fec_Benchmark();
+void Telemetry_Update(int64_t t_us);
+void Telemetry_Task(void *arg);
+void Telemetry_DIO0_ISR();
+bool Rfm_Xfer(void *ctx, uint8_t addr, const uint8_t *tx, uint8_t *rx, size_t n);
+uint32_t Rfm_Now_us(void *ctx);
 
 
 
@@ -188,7 +710,7 @@ void SD_Save_Data();
  * - These variables to be saved in the SD Card every cycle.
  * ------------------------------------------------------------------------------------------------------
  */
-int16_t AccX, AccY, AccZ = {0};
+int16_t AccRaw[3] = {0};                // Raw ADXL375 counts (49 mg/LSB), latest sample
 double Pressure, Temperature = {0};     // Pressure Reg -> [23:0] i.e 3 bytes. So we take 4B to be safe
 // GPS values : 
 // Type         Name            Unit  Description (Scaling)
@@ -202,8 +724,45 @@ unsigned char   GPS_sec;        //  s     Seconds of minute, range 0..60 (UTC)
 long            GPS_lon;        //  deg   Longitude (1e-7)
 long            GPS_lat;        //  deg   Latitude (1e-7)
 long            GPS_height;     //  mm    Height above Ellipsoid
-// Dataframe separater so that dataframes can be separated.
-uint8_t DATA_FRAME_START_END_BYTE = 0xFF;  
+unsigned char   GPS_fix;        //  -     Fix type (0 none, 2 2D, 3 3D)
+// PPS time discipline :
+TS_t GpsTimeSync;
+volatile int64_t PPS_Edge_us = 0;       // esp_timer time of the last PPS edge, set in the ISR
+volatile uint32_t PPS_Edge_count = 0;   // Edges seen by the ISR
+uint32_t PPS_Edge_handled = 0;          // Edges passed to the time sync
+portMUX_TYPE PPSLock = portMUX_INITIALIZER_UNLOCKED;
+// Kalman filter bookkeeping :
+double BaroGroundPressure = 101325.0;   // Pa, pad reference for altitude
+float BaroGroundAltitude = 0.0f;        // m, pressure altitude of the pad
+int64_t KF_last_us = -1;                // Stamp of the previous filter step, -1 before the first
+uint32_t KF_cycles = 0;                 // CPU cycles used by the last filter step
+uint32_t KF_cycles_max = 0;             // Worst case CPU cycles per filter step
+uint32_t KF_accel_count = 0;            // Accel samples filtered, paces STATE records
+uint32_t SampleDroppedTotal = 0;        // Samples dropped since boot, loop() only
+uint16_t BatteryMv = 0;                 // Last battery reading
+int64_t BatteryRead_us = 0;             // Next battery reading
+// SD journal, written by SD_Writer_Task once logging starts :
+JRNL_t Journal;
+bool JournalOpen = false;
+LOG_IndexBlock_t LogIndexBlock;         // Events carried from index entry to entry
+SD_Target_t LogTarget = { LOG_FILE_PATH, LOG_JOURNAL_SIZE, &DATA_LOG_FILE };
+SD_Target_t IndexTarget = { LOG_INDEX_PATH, LOG_INDEX_SIZE, &DATA_INDEX_FILE };
+bool IndexOpen = false;
+LOG_IndexEntry_t IndexSector[LOG_INDEX_SECTOR_ENTRIES];  // Index entries of the slots of this sector
+uint8_t SectorBuf[FATX_SECTOR_SIZE];
+LOG_Storage_t StorageWindow;            // Write latency since the last STORAGE record
+// Internal flash ring, FLASH_LOG_MODE :
+const esp_partition_t *FlashPartition = NULL;
+SPIClass NorSpi(HSPI);                  // SPI3 : FLASH_DEVICE_W25Q and the RFM95
+NOR_t Nor;
+FRING_t FlashRing;
+bool FlashOpen = false;
+bool FlashWarmBoot = false;             // Reset other than power on with the ring in use : no erase ahead
+volatile bool FlashEraseWanted = false; // Flash writer waits on the next FIFO drain to erase
+volatile bool FlashEraseDrained = false;  // Set by Accel_Task as it wakes the flash writer for that erase
+bool FlashLaunched = false;             // Erasing ahead over for this boot (internal flash)
+LOG_Storage_t FlashWindow;              // Its own STORAGE record
+int64_t TimingReport_us = 0;            // Next TIMING report / file flush
 
 
 
@@ -212,38 +771,81 @@ void setup() {
   Serial.begin(SERIAL_BAUDRATE);          // 115200
   Serial2.begin(GPS_BAUDRATE);            // UART connection to GPS.
   Wire.begin(I2C_SDA, I2C_SCL);           // Use this I2C interface instead of default.
+  Wire.setClock(I2C_CLOCK);
 
   // Initialize ADXL375 High-G Accelerometer.
   ADXL375_init();
+  Vibration_Init();
   // Initialize Barometer for Pressure and Temp measurement
   BMP390_init();
+  BARO_init_table();
+  BMP390_ground_reference();
   // GPS Initialization : 
   GPS_Init();
   // SD card Initialization
   SD_Card_Init();
+  if (FLASH_LOG_MODE == FLASH_LOG_MIRROR || (FLASH_LOG_MODE == FLASH_LOG_FALLBACK && !JournalOpen)) {
+    Flash_Log_Init();
+  }
+  Offload_Run();
+  // Erasing stops both cores : the runway is filled before any sensor runs, after the offload (it takes the
+  // oldest slots) and while the ring is still setup()'s. Not on what may be a reboot in flight.
+  if (FlashOpen && !FlashWarmBoot) {
+    Flash_Fill_Runway();
+  }
+  Log_Sinks_Init();
+  if (TELEMETRY) {
+    Telemetry_Init();
+  }
+
+  // Filter starts at rest on the pad.
+  KF_Config_t kf_config;
+  KF_default_config(&kf_config);
+  KF_init(&AltitudeKF, &kf_config, 0.0f);
+
+  APOGEE_Config_t apogee_config;
+  APOGEE_default_config(&apogee_config);
+  APOGEE_init(&ApogeeDetector, &apogee_config);
+
+  // Start the sampling timers last, everything they feed is ready.
+  Sampling_Init();
 
 }
 
 void loop() {
 
-  // Fetching Acceleration data and storing in Global variables
-  ADXL375_acc_in_G ( 
-    &AccX,
-    &AccY,
-    &AccZ
-  );
+  // Filter, vote and log every sample taken since the last pass, in order.
+  Sample_t sample;
+  while (xQueueReceive(SampleQueue, &sample, 0) == pdTRUE) {
+    if (sample.sensor == LOG_SENSOR_ACCEL) {
+      Log_Accel(sample.t_us, sample.acc);
+      KF_accel_sample(sample.t_us, sample.acc);
+    }
+    else {
+      LOG_Baro_t baro = { sample.baro.pressure, sample.baro.temperature };
+      Log_Write_Record(LOG_REC_BARO, sample.t_us, &baro, sizeof(baro));
+      KF_baro_sample(sample.t_us, sample.baro.pressure);
+      APOGEE_update_baro(&ApogeeDetector, sample.t_us, BMP390_altitude(Pressure), !AltitudeKF.baro_locked);
+    }
+    APOGEE_run(sample.t_us);
+  }
 
-  // Fetching Pressure and temperature data to Global buffers
-  BMP390_Pressure_Temp (
-    &Temperature,
-    &Pressure
-  );
+  Spectrum_t spectrum;
+  while (xQueueReceive(SpectrumQueue, &spectrum, 0) == pdTRUE) {
+    Log_Write_Record(LOG_REC_SPECTRUM, spectrum.t_us, &spectrum.rec, sizeof(spectrum.rec));
+  }
 
   // Capture and parse GPS data :
   GPS_Capture_data();
 
-  // Save data to SD Card:
-  SD_Save_Data();
+  int64_t now_us = esp_timer_get_time();
+  if (now_us >= TimingReport_us) {
+    TimingReport_us = now_us + TIMING_REPORT_US;
+    Timing_Report(now_us);
+    Storage_Report(now_us);
+    Log_Accel_Close();
+    Log_Flush(true);
+  }
 
 }
 
@@ -258,13 +860,21 @@ void ADXL375_init(void){
   else{
     Serial.println("Initializing ADXL375 Accelerometer to collect 3-axis acceleration data");
   }
+
+  // Full rate into the FIFO, Accel_Task drains it every ACCEL_PERIOD_US.
+  Wire.beginTransmission(ADXL375_I2C_ADDRESS);
+  Wire.write(ADXL375_BW_RATE_REG);
+  Wire.write(ADXL375_RATE_3200HZ);
+  Wire.endTransmission();
+
+  Wire.beginTransmission(ADXL375_I2C_ADDRESS);
+  Wire.write(ADXL375_FIFO_CTL_REG);
+  Wire.write(ADXL375_FIFO_STREAM);
+  Wire.endTransmission();
 }
 
-void ADXL375_acc_in_G (
-                       int16_t *x,
-                       int16_t *y,
-                       int16_t *z
-){
+// Raw counts straight from the data registers, X0 to Z1 in one burst.
+void ADXL375_read_raw(int16_t raw[3]) {
 
   uint8_t raw_acc_data[6] = {0};
 
@@ -277,9 +887,32 @@ void ADXL375_acc_in_G (
     raw_acc_data[i] = Wire.read();
   }
 
-  *x = (((int16_t)((raw_acc_data[1] << 8) | (raw_acc_data[0]) )) * ADXL375_MG2G_MULTIPLIER) ; // Converting raw data to 'G' data via multiplier/
-  *y = (((int16_t)((raw_acc_data[3] << 8) | (raw_acc_data[2]) )) * ADXL375_MG2G_MULTIPLIER);
-  *z = (((int16_t)((raw_acc_data[5] << 8) | (raw_acc_data[4]) )) * ADXL375_MG2G_MULTIPLIER);
+  raw[0] = (int16_t)((raw_acc_data[1] << 8) | (raw_acc_data[0]));
+  raw[1] = (int16_t)((raw_acc_data[3] << 8) | (raw_acc_data[2]));
+  raw[2] = (int16_t)((raw_acc_data[5] << 8) | (raw_acc_data[4]));
+
+}
+
+/**
+ * Read the entries waiting in the FIFO, oldest first. Reading the data
+ * registers pops one entry; the I2C transaction gap covers the 5 us the
+ * ADXL375 needs before the next one. raw must hold ADXL375_FIFO_DEPTH samples.
+ */
+int ADXL375_read_fifo(int16_t (*raw)[3]) {
+
+  Wire.beginTransmission(ADXL375_I2C_ADDRESS);
+  Wire.write(ADXL375_FIFO_STATUS_REG);
+  Wire.endTransmission(false);
+  Wire.requestFrom(ADXL375_I2C_ADDRESS, 1);
+  int entries = Wire.read() & 0x3F;
+  if (entries > ADXL375_FIFO_DEPTH) {
+    entries = ADXL375_FIFO_DEPTH;
+  }
+
+  for (int i = 0; i < entries; i++) {
+    ADXL375_read_raw(raw[i]);
+  }
+  return entries;
 
 }
 
@@ -312,15 +945,297 @@ void BMP390_init () {
 }
 
 
-void BMP390_Pressure_Temp ( 
+bool BMP390_Pressure_Temp ( 
   double *Temp,
   double *Pressure
 ) {
-  *Temp = BMP390.readTemperature();
-  *Pressure = BMP390.readPressure();
+  // One forced conversion gives both, readTemperature()/readPressure() would run two.
+  if (!BMP390.performReading()) {
+    return false;
+  }
+  *Temp = BMP390.temperature;
+  *Pressure = BMP390.pressure;
+  return true;
 
 }
 
+/**
+ * Average pressure on the pad. Altitude above the pad is computed against
+ * this reference, so the filter starts at 0m.
+ */
+void BMP390_ground_reference() {
+  double sum = 0;
+  for (int i = 0; i < BARO_GROUND_SAMPLES; i++) {
+    sum += BMP390.readPressure();
+  }
+  BaroGroundPressure = sum / BARO_GROUND_SAMPLES;
+  BaroGroundAltitude = BARO_pressure_altitude(BaroGroundPressure);
+}
+
+// Pressure altitude above the pad in meters.
+float BMP390_altitude(double pressure) {
+  return BARO_altitude_above(pressure, BaroGroundAltitude);
+}
+
+
+//------------------------------------------------------------------------------------------------------
+// Altitude Kalman filter Function Definitions :
+//------------------------------------------------------------------------------------------------------
+
+/**
+ * The filter runs on the sample stamps : predict over the real time since the
+ * previous sample, then fuse it. Accel is the axial acceleration with gravity
+ * removed (rocket assumed vertical), baro the pressure altitude above the pad.
+ * Cycle count of each accel step is kept to check the per-update budget.
+ */
+static void KF_predict_to(int64_t t_us) {
+  if (KF_last_us >= 0 && t_us > KF_last_us) {
+    KF_predict(&AltitudeKF, (t_us - KF_last_us) * 1e-6f);
+  }
+  if (t_us > KF_last_us) {
+    KF_last_us = t_us;
+  }
+}
+
+void KF_accel_sample(int64_t t_us, const int16_t raw[3]) {
+  uint32_t start_cycles = ESP.getCycleCount();
+
+  AccRaw[0] = raw[0];
+  AccRaw[1] = raw[1];
+  AccRaw[2] = raw[2];
+  float axial_g = AccRaw[ADXL375_AXIAL_AXIS] * ADXL375_MG2G_MULTIPLIER;
+  KF_predict_to(t_us);
+  KF_update_accel(&AltitudeKF, (axial_g - 1.0f) * SENSORS_GRAVITY_STANDARD);
+
+  KF_cycles = ESP.getCycleCount() - start_cycles;
+  if (KF_cycles > KF_cycles_max) {
+    KF_cycles_max = KF_cycles;
+  }
+
+  APOGEE_update_kf(&ApogeeDetector, t_us, AltitudeKF.x[0], AltitudeKF.x[1]);
+  if (++KF_accel_count % STATE_LOG_DIVIDER == 0) {
+    LOG_State_t state;
+    state.altitude     = AltitudeKF.x[0];
+    state.velocity     = AltitudeKF.x[1];
+    state.acceleration = AltitudeKF.x[2];
+    state.baro_locked  = AltitudeKF.baro_locked;
+    Log_Write_Record(LOG_REC_STATE, t_us, &state, sizeof(state));
+    if (RadioOpen) {
+      Telemetry_Update(t_us);
+    }
+  }
+}
+
+void KF_baro_sample(int64_t t_us, float pressure) {
+  Pressure = pressure;
+  KF_predict_to(t_us);
+  KF_update_baro(&AltitudeKF, BMP390_altitude(pressure));
+}
+
+
+//------------------------------------------------------------------------------------------------------
+// Timer driven sampling Function Definitions :
+//------------------------------------------------------------------------------------------------------
+
+// Timer callbacks run in the esp_timer task, they only wake the sampling task.
+static void Accel_Timer_Callback(void *arg) {
+  xTaskNotifyGive(AccelTaskHandle);
+}
+
+static void Baro_Timer_Callback(void *arg) {
+  xTaskNotifyGive(BaroTaskHandle);
+}
+
+void Sampling_Init() {
+  SampleQueue = xQueueCreate(SAMPLE_QUEUE_LEN, sizeof(Sample_t));
+  TB_jitter_init(&SampleJitter[LOG_SENSOR_ACCEL], ACCEL_PERIOD_US);
+  TB_jitter_init(&SampleJitter[LOG_SENSOR_BARO], BARO_PERIOD_US);
+
+  xTaskCreatePinnedToCore(Accel_Task, "accel", 4096, NULL, 10, &AccelTaskHandle, SAMPLE_CORE);
+  xTaskCreatePinnedToCore(Baro_Task, "baro", 4096, NULL, 9, &BaroTaskHandle, SAMPLE_CORE);
+
+  esp_timer_create_args_t accel_args = {};
+  accel_args.callback = Accel_Timer_Callback;
+  accel_args.name = "accel";
+  esp_timer_create(&accel_args, &AccelTimer);
+
+  esp_timer_create_args_t baro_args = {};
+  baro_args.callback = Baro_Timer_Callback;
+  baro_args.name = "baro";
+  esp_timer_create(&baro_args, &BaroTimer);
+
+  SpectrumReport_us = esp_timer_get_time() + SPECTRUM_REPORT_US;
+  esp_timer_start_periodic(AccelTimer, ACCEL_PERIOD_US);
+  esp_timer_start_periodic(BaroTimer, BARO_PERIOD_US);
+  TimingReport_us = esp_timer_get_time() + TIMING_REPORT_US;
+}
+
+// A sensor task's wake, as the timer delivered it, into the jitter monitor.
+void Sample_Jitter(uint8_t sensor, int64_t t_us) {
+  portENTER_CRITICAL(&JitterLock);
+  TB_jitter_add(&SampleJitter[sensor], t_us);
+  portEXIT_CRITICAL(&JitterLock);
+}
+
+// Hand the sample to loop().
+void Sample_Queue(Sample_t *sample) {
+  if (xQueueSend(SampleQueue, sample, 0) != pdTRUE) {
+    portENTER_CRITICAL(&JitterLock);
+    SampleDropped[sample->sensor]++;
+    portEXIT_CRITICAL(&JitterLock);
+  }
+}
+
+/**
+ * Drain the FIFO through the decimator. The newest entry was sampled on
+ * average half an input period before the FIFO status read; the decimated
+ * samples come out stamped at the time they describe. Those stamps are
+ * evenly spaced by construction, so the jitter monitor gets the wake itself.
+ */
+void Accel_Task(void *arg) {
+  static int16_t fifo[ADXL375_FIFO_DEPTH][3];
+  int16_t decimated[ADXL375_FIFO_DEPTH / VIB_DECIM + 1][3];
+  int64_t decimated_t_us[ADXL375_FIFO_DEPTH / VIB_DECIM + 1];
+  Sample_t sample;
+  sample.sensor = LOG_SENSOR_ACCEL;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    int64_t wake_us = esp_timer_get_time();
+    Sample_Jitter(LOG_SENSOR_ACCEL, wake_us);
+    int64_t t_us = wake_us - 500000 / VIB_INPUT_RATE_HZ;
+    int entries = ADXL375_read_fifo(fifo);
+    if (FlashEraseWanted) {
+      // The FIFO was just read : the flash writer's erase on the pad starts with it empty.
+      FlashEraseWanted = false;
+      FlashEraseDrained = true;
+      xTaskNotifyGive(FlashWriterHandle);
+    }
+    int n = VIB_process(&Vibration, fifo, entries, t_us, decimated, decimated_t_us);
+    for (int i = 0; i < n; i++) {
+      sample.t_us = decimated_t_us[i];
+      memcpy(sample.acc, decimated[i], sizeof(sample.acc));
+      Sample_Queue(&sample);
+    }
+    if (t_us >= SpectrumReport_us) {
+      SpectrumReport_us += SPECTRUM_REPORT_US;
+      Vibration_Report();
+    }
+  }
+}
+
+// The stamp is the start of the forced conversion, the BMP390 samples after that.
+void Baro_Task(void *arg) {
+  Sample_t sample;
+  sample.sensor = LOG_SENSOR_BARO;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    sample.t_us = esp_timer_get_time();
+    double temperature, pressure;
+    if (!BMP390_Pressure_Temp(&temperature, &pressure)) {
+      continue;                  // Shows up as a missed period in the jitter monitor
+    }
+    sample.baro.pressure = (float)pressure;
+    sample.baro.temperature = (float)temperature;
+    Sample_Jitter(LOG_SENSOR_BARO, sample.t_us);
+    Sample_Queue(&sample);
+  }
+}
+
+// One TIMING record per sensor, then a new statistics window.
+void Timing_Report(int64_t t_us) {
+  for (uint8_t sensor = LOG_SENSOR_ACCEL; sensor <= LOG_SENSOR_BARO; sensor++) {
+    TB_Jitter_t window;
+    uint32_t dropped;
+    portENTER_CRITICAL(&JitterLock);
+    window = SampleJitter[sensor];
+    dropped = SampleDropped[sensor];
+    TB_jitter_reset(&SampleJitter[sensor]);
+    SampleDropped[sensor] = 0;
+    portEXIT_CRITICAL(&JitterLock);
+    SampleDroppedTotal += dropped;
+
+    LOG_Timing_t rec;
+    rec.sensor = sensor;
+    rec.period_us = window.period_us;
+    rec.samples = window.samples;
+    rec.missed = window.missed;
+    rec.dropped = dropped;
+    rec.jitter_min_us = window.samples ? window.jitter_min_us : 0;
+    rec.jitter_max_us = window.samples ? window.jitter_max_us : 0;
+    rec.jitter_rms_us = TB_jitter_rms_us(&window);
+    for (int i = 0; i < TB_HIST_BINS; i++) rec.hist[i] = window.hist[i];
+    Log_Write_Record(LOG_REC_TIMING, t_us, &rec, sizeof(rec));
+  }
+}
+
+
+//------------------------------------------------------------------------------------------------------
+// Vibration spectrum Function Definitions :
+//------------------------------------------------------------------------------------------------------
+
+static_assert(LOG_SPECTRUM_BINS == VIB_BINS, "SPECTRUM record and lib/Vibration bins differ");
+
+// Check the esp-dsp kernels against the portable ones before trusting them in flight, then set up the
+// decimator and spectrum state the flight runs on.
+void Vibration_Init() {
+  SpectrumQueue = xQueueCreate(SPECTRUM_QUEUE_LEN, sizeof(Spectrum_t));
+  float error = VIB_self_test(&Vibration);
+  VIB_init(&Vibration);
+  Serial.printf("Vibration : %d Hz in, %d Hz out, esp-dsp %s, kernel self test error %.2e\n",
+                VIB_INPUT_RATE_HZ, VIB_OUTPUT_RATE_HZ, VIB_USE_ESP_DSP ? "on" : "off", error);
+}
+
+// Called from Accel_Task : the PSD averaged since the last report goes to loop() for the log.
+void Vibration_Report() {
+  Spectrum_t spectrum;
+  spectrum.rec.windows = VIB_spectrum_take(&Vibration, spectrum.rec.db, &spectrum.t_us);
+  if (!spectrum.rec.windows) {
+    return;
+  }
+  spectrum.rec.rate_hz = VIB_INPUT_RATE_HZ;
+  spectrum.rec.n_fft = VIB_FFT_N;
+  xQueueSend(SpectrumQueue, &spectrum, 0);
+}
+
+
+//------------------------------------------------------------------------------------------------------
+// Apogee detection Function Definitions :
+//------------------------------------------------------------------------------------------------------
+
+// Log launch once the detector leaves PAD, then evaluate the vote, after every sample.
+void APOGEE_run(int64_t t_us) {
+  APOGEE_Event_t ev;
+  if (APOGEE_check_launch(&ApogeeDetector, &ev)) {
+    APOGEE_log_event(LOG_EVENT_LAUNCH, &ev);
+  }
+  if (APOGEE_check(&ApogeeDetector, t_us, &ev)) {
+    APOGEE_log_event(LOG_EVENT_APOGEE, &ev);
+  }
+}
+
+/**
+ * Write a LAUNCH or APOGEE EVENT record, stamped when it fired (launch : when
+ * the filter velocity crossed launch_velocity). Vote times are stored relative
+ * to the fire time so the latency of each detector can be read straight from
+ * the log; a launch has none.
+ */
+void APOGEE_log_event(uint8_t id, const APOGEE_Event_t *ev) {
+  LOG_Event_t rec;
+  rec.id = id;
+  rec.votes = ev->votes;
+  rec.t_fired_us = ev->t_fired_us;
+  rec.t_estimate_us = ev->t_estimate_us;
+  rec.altitude = ev->altitude;
+  for (int i = 0; i < APOGEE_DETECTORS; i++) {
+    rec.vote_offset_ms[i] = (ev->votes & (1 << i)) ? (int32_t)((ev->t_vote_us[i] - ev->t_fired_us) / 1000) : INT32_MIN;
+  }
+  Log_Write_Record(LOG_REC_EVENT, ev->t_fired_us, &rec, sizeof(rec));
+
+  Serial.printf("%s fired at %lld us, votes 0x%02X, %.1f m at %lld us\n", id == LOG_EVENT_LAUNCH ? "LAUNCH" : "APOGEE",
+                ev->t_fired_us, ev->votes, ev->altitude, ev->t_estimate_us);
+}
+
+
 //------------------------------------------------------------------------------------------------------
 // Ublox NEO-7M GPS Function declarations : 
 //------------------------------------------------------------------------------------------------------
@@ -332,18 +1247,87 @@ void GPS_Init(){
   ubxGpsConfig->setMessage(UbxGpsConfigMessage::NavPvt);
   ubxGpsConfig->setRate(100); //Set rate to 10Hz.
   ubxGpsConfig->configure();
+
+  TS_init(&GpsTimeSync);
+  pinMode(GPS_PPS_PIN, INPUT);
+  attachInterrupt(digitalPinToInterrupt(GPS_PPS_PIN), GPS_PPS_ISR, RISING);
    
 }
 
+// Stamp the PPS edge, nothing else in interrupt context.
+void IRAM_ATTR GPS_PPS_ISR() {
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL_ISR(&PPSLock);
+  PPS_Edge_us = now;
+  PPS_Edge_count++;
+  portEXIT_CRITICAL_ISR(&PPSLock);
+}
+
+// Pair the last PPS edge with the NAV-PVT just parsed and log the correlation.
+void GPS_Time_Sync(int64_t t_rx_us) {
+  if (!TS_nav_epoch(&GpsTimeSync, t_rx_us, GPS_iTOW, GPS_fix >= 3)) {
+    return;
+  }
+
+  LOG_TimeSync_t rec;
+  rec.gps_itow = GPS_iTOW;
+  rec.utc_year = GPS_year;
+  rec.utc_month = GPS_month;
+  rec.utc_day = GPS_day;
+  rec.utc_hour = GPS_hour;
+  rec.utc_min = GPS_min;
+  rec.utc_sec = GPS_sec;
+  rec.flags = (GpsTimeSync.valid ? LOG_TIMESYNC_VALID : 0) |
+              (GpsTimeSync.locked ? LOG_TIMESYNC_LOCKED : 0) |
+              (GpsTimeSync.rejects ? LOG_TIMESYNC_REJECTED : 0);
+  rec.offset_us = GpsTimeSync.valid ? TS_mcu_to_gps(&GpsTimeSync, GpsTimeSync.edge_us) - GpsTimeSync.edge_us : 0;
+  rec.drift_ppb = (int32_t)(GpsTimeSync.drift * 1e9);
+  rec.residual_ns = (uint32_t)(GpsTimeSync.residual_us * 1e3);
+  Log_Write_Record(LOG_REC_TIMESYNC, GpsTimeSync.edge_us, &rec, sizeof(rec));
+}
+
 void GPS_Capture_data() {
+  // New PPS edge since the last call
+  if (PPS_Edge_count != PPS_Edge_handled) {
+    portENTER_CRITICAL(&PPSLock);
+    int64_t edge_us = PPS_Edge_us;
+    PPS_Edge_handled = PPS_Edge_count;
+    portEXIT_CRITICAL(&PPSLock);
+    TS_pps_edge(&GpsTimeSync, edge_us);
+  }
+
   // Process only the available GPS bytes without waiting
   while (gpsSerial->available()) {
     uint8_t GPSbyte = gpsSerial->read();
     
     // Process the received byte without blocking
     if (syncGPSmsg(GPSbyte)) {
-      // GPS message successfully synced and parsed
-      Serial.println("GPS message successfully synced and parsed.");
+      // NAV-PVT parsed, values are in the GPS_* globals. Stamped on arrival.
+      int64_t t_us = esp_timer_get_time();
+      LOG_Gps_t gps;
+      gps.gps_itow   = GPS_iTOW;
+      gps.gps_year   = GPS_year;
+      gps.gps_month  = GPS_month;
+      gps.gps_day    = GPS_day;
+      gps.gps_hour   = GPS_hour;
+      gps.gps_min    = GPS_min;
+      gps.gps_sec    = GPS_sec;
+      gps.gps_fix    = GPS_fix;
+      gps.gps_lon    = GPS_lon;
+      gps.gps_lat    = GPS_lat;
+      gps.gps_height = GPS_height;
+      Log_Write_Record(LOG_REC_GPS, t_us, &gps, sizeof(gps));
+      GPS_Time_Sync(t_us);
+
+      if (GPS_fix >= 3) {
+        // Once locked, the fix is placed at its epoch rather than its arrival.
+        int64_t t_fix_us = t_us;
+        if (GpsTimeSync.locked) {
+          t_fix_us = TS_gps_to_mcu(&GpsTimeSync, (int64_t)GPS_iTOW * 1000 + GpsTimeSync.week_offset_us);
+        }
+        APOGEE_update_gps(&ApogeeDetector, t_fix_us, GPS_height / 1000.0f);
+        APOGEE_run(t_us);
+      }
     }
   }
 }
@@ -361,7 +1345,7 @@ bool syncGPSmsg(uint8_t GPS_byte){
     if ( index == 0 && GPS_byte == 0xB5 ){
        buffer[index++] = GPS_byte;
     } 
-    else if ( index == 1 && GPS_byte == 0x65 ){
+    else if ( index == 1 && GPS_byte == 0x62 ){
       buffer[index++] = GPS_byte;
       msgSync = true;
     }
@@ -390,96 +1374,943 @@ bool syncGPSmsg(uint8_t GPS_byte){
       GPS_hour   = *((uint8_t  *)&buffer[14]);
       GPS_min    = *((uint8_t  *)&buffer[15]);
       GPS_sec    = *((uint8_t  *)&buffer[16]);
+      GPS_fix    = *((uint8_t  *)&buffer[26]);
       GPS_lon    = *((uint32_t *)&buffer[30]);
       GPS_lat    = *((uint32_t *)&buffer[34]);
-      GPS_height = *((uint32_t *)&buffer[38]);
+      GPS_height = *((int32_t  *)&buffer[38]);
+      return true;
     }
   }
 
-  return true;
+  return false;
 }
 
 //------------------------------------------------------------------------------------------------------
 // SD Card and SPI Interfaces
 //------------------------------------------------------------------------------------------------------
 
+// Mount the card on the bus SD_BACKEND selects. Both run FatFs underneath;
+// the rest of the logger only sees SDCard and the two sector calls below.
+bool SD_Bus_Begin() {
+#if SD_BACKEND == SD_BACKEND_SDMMC
+  return SD_MMC.setPins(SDMMC_CLK, SDMMC_CMD, SDMMC_D0, SDMMC_D1, SDMMC_D2, SDMMC_D3) &&
+         SD_MMC.begin("/sdcard", false, false, SDMMC_FREQ_KHZ);
+#else
+  return SD.begin(HSPI_CS, SPI, SD_SPI_FREQ);
+#endif
+}
+
+// One card sector. Both libraries only take single sectors (SD_MMC from
+// arduino-esp32 3.0 on), a multi block write is one command per sector.
+bool SD_Bus_Read(uint32_t lba, uint8_t *buf) {
+#if SD_BACKEND == SD_BACKEND_SDMMC
+  return SD_MMC.readRAW(buf, lba);
+#else
+  return SD.readRAW(buf, lba);
+#endif
+}
+
+bool SD_Bus_Write(uint32_t lba, const uint8_t *buf) {
+#if SD_BACKEND == SD_BACKEND_SDMMC
+  return SD_MMC.writeRAW((uint8_t *)buf, lba);
+#else
+  return SD.writeRAW((uint8_t *)buf, lba);
+#endif
+}
+
 void SD_Card_Init() {
 
   // Check for SD card initialization:
-  if ( !SD.begin(HSPI_CS)){
+  if (!SD_Bus_Begin()) {
     Serial.println("FAILED SD Card initialization...");
     return;
   }
 
-  Serial.println("Initializing SD Card...");
+  Serial.println("Initializing SD Card (" SD_BUS_NAME ")...");
+  if (SD_BENCHMARK) {
+    SD_Benchmark();
+  }
+
+  // A log from before the journal (appended, any size) is moved aside, never written over.
+  if (SDCard.exists(LOG_FILE_PATH)) {
+    File f = SDCard.open(LOG_FILE_PATH, FILE_READ);
+    bool journal = f && f.size() == LOG_JOURNAL_SIZE;
+    f.close();
+    if (!journal) {
+      SDCard.remove(LOG_OLD_PATH);
+      SDCard.remove(LOG_OLD_INDEX_PATH);
+      SDCard.rename(LOG_FILE_PATH, LOG_OLD_PATH);
+      SDCard.rename(LOG_INDEX_PATH, LOG_OLD_INDEX_PATH);
+      Serial.println("Previous log moved to " LOG_OLD_PATH);
+    }
+  }
 
-  // Open file in append mode and file open check logic : 
-  // Check for errors while opening file
-  DATA_LOG_FILE = SD.open("/SENSOR_DATA.bin", FILE_APPEND);
-  if (!DATA_LOG_FILE) {
+  // An index from before the preallocated one is dropped : the slots it
+  // covered are found by bisecting the log instead.
+  if (SDCard.exists(LOG_INDEX_PATH)) {
+    File f = SDCard.open(LOG_INDEX_PATH, FILE_READ);
+    bool current = f && f.size() == LOG_INDEX_SIZE;
+    f.close();
+    if (!current) SDCard.remove(LOG_INDEX_PATH);
+  }
+
+  if (!SD_Preallocate(LOG_FILE_PATH, LOG_JOURNAL_SIZE) || !SD_Target_Open(&LogTarget)) {
     Serial.println("Error Opening file...");
-  }else {
-    Serial.println("File opened successfully");
+    return;
+  }
+  Serial.println("File opened successfully");
+  IndexOpen = SD_Preallocate(LOG_INDEX_PATH, LOG_INDEX_SIZE) && SD_Target_Open(&IndexTarget);
+  if (!IndexOpen) {
+    Serial.println("Error Opening index file, logging without it...");
+  }
+  StorageWindow.path = LogTarget.raw ? LOG_STORAGE_RAW : LOG_STORAGE_FILE;
+
+  JRNL_Io_t io = { SD_Target_Read, SD_Target_Write, SD_Target_Sync, &LogTarget, LOG_JOURNAL_SIZE };
+  JRNL_Recovery_t rec;
+  int64_t t0 = esp_timer_get_time();
+  JournalOpen = JRNL_open(&Journal, &io, esp_random(), &rec);
+  Serial.printf("Journal : %lu slots valid (%lu read, %lld us), session %lu, %lu slots free\n",
+                (unsigned long)rec.slots, (unsigned long)rec.reads, esp_timer_get_time() - t0,
+                (unsigned long)Journal.session, (unsigned long)(Journal.slots - Journal.next));
+  if (JournalOpen && IndexOpen) {
+    SD_Index_Resume();
+  }
+
+  // Kept open for the whole flight, SD_Write_Block() commits a slot per block.
+
+}
+
+// Slot writes on this bus, raw and through the file system, as the logger
+// does them : SD_BENCH_SIZE of 4 KB slots to a preallocated scratch file, a
+// sync every SD_BENCH_SYNC_SLOTS slots, each write and sync timed, then read
+// back and checked. Prints write MB/s, p50 / p99 / worst write latency and
+// read MB/s per path. Flash once per SD_BACKEND to compare the buses.
+void SD_Benchmark() {
+  SD_Target_t bench = { SD_BENCH_PATH, SD_BENCH_SIZE, &SD_BENCH_FILE };
+  if (!SD_Preallocate(bench.path, bench.size) || !SD_Target_Open(&bench)) {
+    Serial.println("SD bench : no scratch file...");
+    return;
+  }
+  if (bench.raw) {
+    SD_Bench_Pass(&bench);
+    bench.raw = false;
+    *bench.file = SDCard.open(bench.path, "r+");
+  }
+  if (*bench.file) {
+    SD_Bench_Pass(&bench);
+    bench.file->close();
   }
+}
 
-  DATA_LOG_FILE.close();
+void SD_Bench_Pass(SD_Target_t *t) {
+  uint32_t slots = t->size / LOG_SLOT_SIZE;
+  uint32_t *lat_us = (uint32_t *)malloc(slots * sizeof(uint32_t));
+  if (!lat_us) {
+    return;
+  }
+  uint32_t errors = 0;
+  int64_t t0 = esp_timer_get_time();
+  for (uint32_t i = 0; i < slots; i++) {
+    for (size_t k = 0; k < LOG_SLOT_SIZE; k += 4) {
+      uint32_t word = i * LOG_SLOT_SIZE + (uint32_t)k;
+      memcpy(&Journal.slot[k], &word, 4);
+    }
+    int64_t w0 = esp_timer_get_time();
+    errors += !SD_Target_Write(t, (uint64_t)i * LOG_SLOT_SIZE, Journal.slot, LOG_SLOT_SIZE);
+    if (i % SD_BENCH_SYNC_SLOTS == SD_BENCH_SYNC_SLOTS - 1) {
+      SD_Target_Sync(t);
+    }
+    lat_us[i] = (uint32_t)(esp_timer_get_time() - w0);
+  }
+  double write_s = (esp_timer_get_time() - t0) * 1e-6;
 
+  t0 = esp_timer_get_time();
+  for (uint32_t i = 0; i < slots; i++) {
+    if (!SD_Target_Read(t, (uint64_t)i * LOG_SLOT_SIZE, Journal.slot, LOG_SLOT_SIZE)) {
+      errors++;
+      continue;
+    }
+    uint32_t word;
+    memcpy(&word, &Journal.slot[LOG_SLOT_SIZE - 4], 4);
+    errors += word != i * LOG_SLOT_SIZE + LOG_SLOT_SIZE - 4;
+  }
+  double read_s = (esp_timer_get_time() - t0) * 1e-6;
+
+  std::sort(lat_us, lat_us + slots);
+  double mb = t->size / 1e6;
+  Serial.printf("SD bench " SD_BUS_NAME " %s : %lu x 4 KB, write %.2f MB/s, p50 %lu us, p99 %lu us, worst %lu us, "
+                "read %.2f MB/s, %lu errors\n",
+                t->raw ? "raw" : "file", (unsigned long)slots, mb / write_s, (unsigned long)lat_us[slots / 2],
+                (unsigned long)lat_us[slots - 1 - slots / 100], (unsigned long)lat_us[slots - 1], mb / read_s,
+                (unsigned long)errors);
+  free(lat_us);
+}
 
+// Create path at its full size : seeking past the end and writing one byte
+// allocates every cluster once (a few seconds for 1 GB), the file never grows
+// after that. On an empty card the clusters come out consecutive. They are
+// not cleared : the first slot is, so whatever a deleted file left in them
+// is no journal.
+bool SD_Preallocate(const char *path, uint32_t size) {
+  if (!SDCard.exists(path)) {
+    Serial.printf("Preallocating %s...\n", path);
+    File f = SDCard.open(path, FILE_WRITE);
+    memset(Journal.slot, 0, LOG_SLOT_SIZE);
+    if (!f || f.write(Journal.slot, LOG_SLOT_SIZE) != LOG_SLOT_SIZE || !f.seek(size - 1) ||
+        f.write((uint8_t)0) != 1) {
+      Serial.println("Error preallocating...");
+    }
+    f.close();
+  }
+  File f = SDCard.open(path, FILE_READ);
+  bool ok = f && f.size() == size;
+  f.close();
+  return ok;
 }
 
-// Function to write binary data to SD card for speed purposes :
-void SD_Save_Data () {
+// Raw if the file's clusters are one run of card sectors (lib/FatExtent reads
+// the FAT : 256 sectors for 1 GB in 32 KB clusters, ~0.2 s), else opened for
+// update. A raw file stays closed : the file system never touches its data
+// sectors again, so raw writes do not race its caches.
+bool SD_Target_Open(SD_Target_t *t) {
+  if (LOG_RAW_SECTORS) {
+    int64_t t0 = esp_timer_get_time();
+    FATX_Status_t st = FATX_find(SD_Raw_Sector, NULL, t->path, SectorBuf, &t->extent);
+    Serial.printf("%s sectors : %s (%lu read, %lld us)\n", t->path, FATX_status_name(st),
+                  (unsigned long)t->extent.reads, esp_timer_get_time() - t0);
+    t->raw = st == FATX_OK && t->extent.size == t->size &&
+             (uint64_t)t->extent.sectors * FATX_SECTOR_SIZE >= t->size;
+    if (t->raw) {
+      Serial.printf("Raw writes from sector %lu\n", (unsigned long)t->extent.first_lba);
+      return true;
+    }
+    Serial.println("Writing it through the file system...");
+  }
+  *t->file = SDCard.open(t->path, "r+");
+  return *t->file && t->file->size() == t->size;
+}
 
+bool SD_Raw_Sector(void *ctx, uint32_t lba, uint8_t *buf) {
+  return SD_Bus_Read(lba, buf);
+}
 
-  DATA_LOG_FILE = SD.open("/sensor_data.csv", FILE_APPEND);
-    if (DATA_LOG_FILE) {
-        // Write raw numeric values, separated by commas (CSV-like format)
-        // DATA_LOG_FILE.print(AccX); DATA_LOG_FILE.print(',');
-        // DATA_LOG_FILE.print(AccY); DATA_LOG_FILE.print(',');
-        // DATA_LOG_FILE.print(AccZ); DATA_LOG_FILE.print(',');
-        // DATA_LOG_FILE.print(Pressure, 2); DATA_LOG_FILE.print(',');
-        // DATA_LOG_FILE.print(Temperature, 2); DATA_LOG_FILE.print(',');
-        // DATA_LOG_FILE.print(GPS_iTOW); DATA_LOG_FILE.print(',');
-        // DATA_LOG_FILE.print(GPS_year); DATA_LOG_FILE.print(',');
-        // DATA_LOG_FILE.print(GPS_month); DATA_LOG_FILE.print(',');
-        // DATA_LOG_FILE.print(GPS_day); DATA_LOG_FILE.print(',');
-        // DATA_LOG_FILE.print(GPS_hour); DATA_LOG_FILE.print(',');
-        // DATA_LOG_FILE.print(GPS_min); DATA_LOG_FILE.print(',');
-        // DATA_LOG_FILE.print(GPS_sec); DATA_LOG_FILE.print(',');
-        // DATA_LOG_FILE.print(GPS_lon); DATA_LOG_FILE.print(',');
-        // DATA_LOG_FILE.print(GPS_lat); DATA_LOG_FILE.print(',');
-        // DATA_LOG_FILE.println(GPS_height);  // End line
+// Raw access is slot or sector aligned, so whole sectors only.
+bool SD_Target_Read(void *ctx, uint64_t offset, void *buf, size_t n) {
+  SD_Target_t *t = (SD_Target_t *)ctx;
+  if (!t->raw) {
+    return t->file->seek((uint32_t)offset) && t->file->read((uint8_t *)buf, n) == n;
+  }
+  if (offset % FATX_SECTOR_SIZE || n % FATX_SECTOR_SIZE) {
+    return false;
+  }
+  uint32_t lba = t->extent.first_lba + (uint32_t)(offset / FATX_SECTOR_SIZE);
+  for (size_t i = 0; i < n / FATX_SECTOR_SIZE; i++) {
+    if (!SD_Bus_Read(lba + i, (uint8_t *)buf + i * FATX_SECTOR_SIZE)) return false;
+  }
+  return true;
+}
 
-        // Write separater byte of Dataframe:
-        DATA_LOG_FILE.write ( (uint8_t *)&DATA_FRAME_START_END_BYTE, sizeof(DATA_FRAME_START_END_BYTE));
-        //Writing Acceleration (X,Y,Z) in binary format
-        DATA_LOG_FILE.write ( (uint8_t *)&AccX, sizeof(AccX));
-        DATA_LOG_FILE.write ( (uint8_t *)&AccY, sizeof(AccY));
-        DATA_LOG_FILE.write ( (uint8_t *)&AccZ, sizeof(AccZ));
-        // Writing Temp and Pressure
-        DATA_LOG_FILE.write ( (uint8_t *)&Pressure, sizeof(Pressure));
-        DATA_LOG_FILE.write ( (uint8_t *)&Temperature, sizeof(Temperature));
-        // Writing GPS Data fields 
-        DATA_LOG_FILE.write ( (uint8_t *)&GPS_iTOW, sizeof(GPS_iTOW));
-        DATA_LOG_FILE.write ( (uint8_t *)&GPS_year, sizeof(GPS_year));
-        DATA_LOG_FILE.write ( (uint8_t *)&GPS_month, sizeof(GPS_month));
-        DATA_LOG_FILE.write ( (uint8_t *)&GPS_day, sizeof(GPS_day));
-        DATA_LOG_FILE.write ( (uint8_t *)&GPS_hour, sizeof(GPS_hour));
-        DATA_LOG_FILE.write ( (uint8_t *)&GPS_min, sizeof(GPS_min));
-        DATA_LOG_FILE.write ( (uint8_t *)&GPS_sec, sizeof(GPS_sec));
-        DATA_LOG_FILE.write ( (uint8_t *)&GPS_lon, sizeof(GPS_lon));
-        DATA_LOG_FILE.write ( (uint8_t *)&GPS_lat, sizeof(GPS_lat));
-        DATA_LOG_FILE.write ( (uint8_t *)&GPS_height, sizeof(GPS_height));
+bool SD_Target_Write(void *ctx, uint64_t offset, const void *buf, size_t n) {
+  SD_Target_t *t = (SD_Target_t *)ctx;
+  if (!t->raw) {
+    return t->file->seek((uint32_t)offset) && t->file->write((const uint8_t *)buf, n) == n;
+  }
+  if (offset % FATX_SECTOR_SIZE || n % FATX_SECTOR_SIZE) {
+    return false;
+  }
+  uint32_t lba = t->extent.first_lba + (uint32_t)(offset / FATX_SECTOR_SIZE);
+  for (size_t i = 0; i < n / FATX_SECTOR_SIZE; i++) {
+    if (!SD_Bus_Write(lba + i, (const uint8_t *)buf + i * FATX_SECTOR_SIZE)) return false;
+  }
+  return true;
+}
 
-        // Dataframe containing data ends with custom dataframe end i.e 0xFF.
-        DATA_LOG_FILE.write ( (uint8_t *)&DATA_FRAME_START_END_BYTE, sizeof(DATA_FRAME_START_END_BYTE));
+// Raw writes are on the card when writeRAW() returns.
+bool SD_Target_Sync(void *ctx) {
+  SD_Target_t *t = (SD_Target_t *)ctx;
+  if (!t->raw) t->file->flush();
+  return true;
+}
 
+// Index sector of the next slot : the entries before it in the sector never
+// reached the card (a sector is written when full), rebuild them from the
+// journal, events carried over from the last entry written. Up to 31 slot
+// reads; the staging slot is empty until the first record, it is the buffer.
+void SD_Index_Resume() {
+  uint32_t first = Journal.next / LOG_INDEX_SECTOR_ENTRIES * LOG_INDEX_SECTOR_ENTRIES;
+  memset(&LogIndexBlock, 0, sizeof(LogIndexBlock));
+  if (first > 0 &&
+      SD_Target_Read(&IndexTarget, (uint64_t)(first - LOG_INDEX_SECTOR_ENTRIES) * sizeof(LOG_IndexEntry_t),
+                     IndexSector, sizeof(IndexSector)) &&
+      LOG_index_valid(&IndexSector[LOG_INDEX_SECTOR_ENTRIES - 1])) {
+    LogIndexBlock.events = IndexSector[LOG_INDEX_SECTOR_ENTRIES - 1].events;
+  }
+  memset(IndexSector, 0, sizeof(IndexSector));
+  for (uint32_t slot = first; slot < Journal.next; slot++) {
+    uint64_t offset = (uint64_t)slot * LOG_SLOT_SIZE;
+    if (!SD_Target_Read(&LogTarget, offset, Journal.slot, LOG_SLOT_SIZE) ||
+        !LOG_index_slot(&LogIndexBlock, Journal.slot, (uint32_t)offset, &IndexSector[slot - first])) {
+      break;
+    }
+  }
+}
 
-        // Troubleshooting code : 
-        // fprintf(&DATA_LOG_FILE, "%lf,%lf,%ld,%ld,%lf\n", Pressure, Temperature, GPS_lon, GPS_lat, GPS_height);
+// One block as one journal slot, then its index entry; with b->sync both files
+// are pushed to the card (a no-op for raw ones). The slot is written first :
+// an index entry on the card always points at a slot that is there.
+bool SD_Write_Block(const SINK_Block_t *b) {
+
+  int64_t t0 = esp_timer_get_time();
+  uint32_t slot = Journal.next;
+  uint32_t offset = (uint32_t)JRNL_offset(&Journal);
+  bool written = JRNL_append_block(&Journal, b->data, b->used) && JRNL_commit(&Journal);
+  uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+  portENTER_CRITICAL(&StorageLock);
+  StorageWindow.slots++;
+  StorageWindow.write_us += us;
+  if (us > StorageWindow.write_max_us) StorageWindow.write_max_us = us;
+  portEXIT_CRITICAL(&StorageLock);
+
+  // Entry i is slot i; the sector goes to the card with its last slot.
+  LOG_IndexEntry_t entry;
+  if (written && LOG_index_slot(&LogIndexBlock, Journal.slot, offset, &entry)) {
+    IndexSector[slot % LOG_INDEX_SECTOR_ENTRIES] = entry;
+    if (slot % LOG_INDEX_SECTOR_ENTRIES == LOG_INDEX_SECTOR_ENTRIES - 1) {
+      if (IndexOpen) {
+        SD_Target_Write(&IndexTarget, (uint64_t)(slot / LOG_INDEX_SECTOR_ENTRIES) * sizeof(IndexSector),
+                        IndexSector, sizeof(IndexSector));
+      }
+      memset(IndexSector, 0, sizeof(IndexSector));
+    }
+  }
+  if (b->sync) {
+    SD_Target_Sync(&LogTarget);
+    if (IndexOpen) SD_Target_Sync(&IndexTarget);
+  }
+  us = (uint32_t)(esp_timer_get_time() - t0);
+  portENTER_CRITICAL(&StorageLock);
+  if (us > StorageWindow.flush_max_us) StorageWindow.flush_max_us = us;
+  portEXIT_CRITICAL(&StorageLock);
+  return written;
 
+}
 
-        DATA_LOG_FILE.close();
+// Writes the SD card's blocks as loop() hands them over, oldest first.
+void SD_Writer_Task(void *arg) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    SINK_Block_t *b;
+    while ((b = SINK_peek(&SdSink)) != NULL) {
+      bool written = SD_Write_Block(b);
+      SINK_pop(&SdSink, written, esp_timer_get_time());
     }
+  }
+}
 
-}
\ No newline at end of file
+
+//------------------------------------------------------------------------------------------------------
+// Log destinations Function Definitions :
+//------------------------------------------------------------------------------------------------------
+// A buffer pool and a writer task per open destination. Before this the
+// journal and the ring belong to setup(), after it to their writer task.
+void Log_Sinks_Init() {
+
+  SINK_stage_init(&LogStage, esp_random());
+  if (JournalOpen) {
+    SINK_init(&SdSink, SdBlocks, LOG_SINK_BLOCKS, StorageWindow.path);
+    xTaskCreatePinnedToCore(SD_Writer_Task, "sd writer", 4096, NULL, LOG_WRITER_PRIORITY, &SdWriterHandle,
+                            LOG_WRITER_CORE);
+  }
+  if (FlashOpen) {
+    SINK_init(&FlashSink, FlashBlocks, LOG_SINK_BLOCKS, LOG_STORAGE_FLASH);
+    xTaskCreatePinnedToCore(Flash_Writer_Task, "flash writer", 4096, NULL, LOG_WRITER_PRIORITY,
+                            &FlashWriterHandle, LOG_WRITER_CORE);
+  }
+  if (!JournalOpen && !FlashOpen) {
+    Serial.println("No log destination, flying without a log...");
+  }
+
+}
+
+// Encode a record into the staged block, a full block is handed over first.
+void Log_Write_Record(uint8_t type, int64_t t_us, const void *payload, uint16_t len) {
+
+  if (!JournalOpen && !FlashOpen) {
+    return;
+  }
+  if (!SINK_stage_add(&LogStage, type, (uint64_t)t_us, payload, len)) {
+    Log_Flush(false);
+    SINK_stage_add(&LogStage, type, (uint64_t)t_us, payload, len);
+  }
+
+}
+
+// One ACCEL sample, into the block being packed with LOG_ACCEL_PACK.
+void Log_Accel(int64_t t_us, const int16_t acc[3]) {
+
+  LOG_Accel_t a;
+  memcpy(a.acc_raw, acc, sizeof(a.acc_raw));
+  if (!LOG_ACCEL_PACK) {
+    Log_Write_Record(LOG_REC_ACCEL, t_us, &a, sizeof(a));
+    return;
+  }
+  if (!LOG_accel_pack_add(&AccelPack, (uint64_t)t_us, &a)) {
+    Log_Accel_Close();
+    LOG_accel_pack_add(&AccelPack, (uint64_t)t_us, &a);
+  }
+  if (AccelPack.count == LOG_ACCEL_PACK_SAMPLES) {
+    Log_Accel_Close();
+  }
+
+}
+
+// The packed block as an ACCEL_PACK record; once a second too, so the samples
+// of a partial block go out with that second's flush.
+void Log_Accel_Close() {
+
+  uint64_t t_us;
+  uint16_t len = LOG_accel_pack_close(&AccelPack, AccelPackPayload, &t_us);
+  if (len) {
+    Log_Write_Record(LOG_REC_ACCEL_PACK, (int64_t)t_us, AccelPackPayload, len);
+  }
+
+}
+
+// Hand the staged block to every open destination and wake its writer, sync =
+// true also has the SD files pushed to the card after it. Never waits : a
+// destination with no free buffer loses this block, counted in its overruns.
+void Log_Flush(bool sync) {
+
+  if (LogStage.used == 0) {
+    return;
+  }
+  int64_t now_us = esp_timer_get_time();
+  if (JournalOpen && SINK_push(&SdSink, LogStage.data, LogStage.used, sync, now_us)) {
+    xTaskNotifyGive(SdWriterHandle);
+  }
+  if (FlashOpen && SINK_push(&FlashSink, LogStage.data, LogStage.used, sync, now_us)) {
+    xTaskNotifyGive(FlashWriterHandle);
+  }
+  SINK_stage_next(&LogStage);
+
+}
+
+// A STORAGE and a SINK record per destination, then new STORAGE windows.
+// Written before the flush they close on.
+void Storage_Report(int64_t t_us) {
+  if (JournalOpen) {
+    portENTER_CRITICAL(&StorageLock);
+    StorageWindow.write_errors = Journal.write_errors;
+    StorageWindow.dropped = Journal.dropped;
+    portEXIT_CRITICAL(&StorageLock);
+    Storage_Window_Report(t_us, &StorageWindow, &SdSink);
+  }
+  if (FlashOpen) {
+    portENTER_CRITICAL(&StorageLock);
+    FlashWindow.write_errors = FlashRing.write_errors;
+    FlashWindow.dropped = FlashRing.stalls;
+    portEXIT_CRITICAL(&StorageLock);
+    Storage_Window_Report(t_us, &FlashWindow, &FlashSink);
+  }
+}
+
+void Storage_Window_Report(int64_t t_us, LOG_Storage_t *window, const SINK_t *sink) {
+  LOG_Storage_t storage;
+  portENTER_CRITICAL(&StorageLock);
+  storage = *window;
+  window->slots = 0;
+  window->write_us = 0;
+  window->write_max_us = 0;
+  window->flush_max_us = 0;
+  portEXIT_CRITICAL(&StorageLock);
+  Log_Write_Record(LOG_REC_STORAGE, t_us, &storage, sizeof(storage));
+
+  LOG_Sink_t health;
+  SINK_health(sink, &health);
+  Log_Write_Record(LOG_REC_SINK, t_us, &health, sizeof(health));
+}
+
+
+//------------------------------------------------------------------------------------------------------
+// Internal flash log Function Definitions :
+//------------------------------------------------------------------------------------------------------
+// Recover the ring on its partition (or the W25Q chip), records go to it from now on.
+void Flash_Log_Init() {
+
+#if FLASH_LOG_DEVICE == FLASH_DEVICE_W25Q
+  pinMode(NOR_CS, OUTPUT);
+  digitalWrite(NOR_CS, HIGH);
+  NorSpi.begin(NOR_SCK, NOR_MISO, NOR_MOSI, NOR_CS);
+  NOR_Bus_t bus = { Nor_Xfer, Nor_Now_us, Nor_Idle, &NorSpi };
+  if (!NOR_init(&Nor, &bus)) {
+    Serial.println("No W25Q flash answering, logging to flash off...");
+    return;
+  }
+  Serial.printf("W25Q flash : JEDEC %02X %02X %02X, %lu KB\n", Nor.jedec[0], Nor.jedec[1], Nor.jedec[2],
+                (unsigned long)(Nor.size / 1024));
+  Nor_Dump();
+  FRING_Io_t io = { Nor_Read, Nor_Write, Nor_Erase, &Nor, Nor.size };
+#else
+  FlashPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                            (esp_partition_subtype_t)FLASH_PARTITION_SUBTYPE, FLASH_PARTITION);
+  if (!FlashPartition) {
+    Serial.println("No " FLASH_PARTITION " partition, logging to flash off...");
+    return;
+  }
+
+  FRING_Io_t io = { Flash_Read, Flash_Write, Flash_Erase, (void *)FlashPartition, (uint32_t)FlashPartition->size };
+#endif
+  FRING_Recovery_t rec;
+  int64_t t0 = esp_timer_get_time();
+  FlashOpen = FRING_open(&FlashRing, &io, esp_random(), &rec);
+  if (!FlashOpen) {
+    Serial.println("Error reading the " FLASH_PARTITION " partition, logging to flash off...");
+    return;
+  }
+  FlashWindow.path = LOG_STORAGE_FLASH;
+  esp_reset_reason_t reset = esp_reset_reason();
+  FlashWarmBoot = rec.slots > 0 && reset != ESP_RST_POWERON && reset != ESP_RST_UNKNOWN;
+  if (FlashWarmBoot) {
+    Serial.printf("Flash ring : reset reason %d, maybe in flight, no erasing ahead this boot\n", (int)reset);
+  }
+  Serial.printf("Flash ring : %lu slots valid from seq %lu (%lld us), session %lu, %lu of %lu sectors erased ahead\n",
+                (unsigned long)rec.slots, (unsigned long)rec.first, esp_timer_get_time() - t0,
+                (unsigned long)FlashRing.session, (unsigned long)rec.erased, (unsigned long)FlashRing.slots);
+
+}
+
+bool Flash_Read(void *ctx, uint32_t offset, void *buf, size_t n) {
+  return esp_partition_read((const esp_partition_t *)ctx, offset, buf, n) == ESP_OK;
+}
+
+bool Flash_Write(void *ctx, uint32_t offset, const void *buf, size_t n) {
+  return esp_partition_write((const esp_partition_t *)ctx, offset, buf, n) == ESP_OK;
+}
+
+bool Flash_Erase(void *ctx, uint32_t offset, size_t n) {
+  return esp_partition_erase_range((const esp_partition_t *)ctx, offset, n) == ESP_OK;
+}
+
+// W25Q transaction on SPI3, chip select by hand around the command and data.
+bool Nor_Xfer(void *ctx, const uint8_t *cmd, size_t n_cmd, const uint8_t *tx, uint8_t *rx, size_t n) {
+
+  SPIClass *spi = (SPIClass *)ctx;
+  spi->beginTransaction(SPISettings(NOR_SPI_FREQ, MSBFIRST, SPI_MODE0));
+  digitalWrite(NOR_CS, LOW);
+  spi->writeBytes(cmd, n_cmd);
+  if (tx) {
+    spi->writeBytes(tx, n);
+  } else if (rx) {
+    spi->transferBytes(NULL, rx, n);
+  }
+  digitalWrite(NOR_CS, HIGH);
+  spi->endTransaction();
+  return true;
+
+}
+
+uint32_t Nor_Now_us(void *ctx) {
+  return (uint32_t)esp_timer_get_time();
+}
+
+// Short waits (a page program) yield to the other tasks, long ones (an erase) sleep.
+void Nor_Idle(void *ctx, uint32_t waited_us) {
+  if (waited_us < NOR_YIELD_US) {
+    taskYIELD();
+  } else {
+    vTaskDelay(1);
+  }
+}
+
+bool Nor_Read(void *ctx, uint32_t offset, void *buf, size_t n) {
+  return NOR_read((NOR_t *)ctx, offset, buf, n);
+}
+
+bool Nor_Write(void *ctx, uint32_t offset, const void *buf, size_t n) {
+  return NOR_program((NOR_t *)ctx, offset, buf, n);
+}
+
+bool Nor_Erase(void *ctx, uint32_t offset, size_t n) {
+  return NOR_erase((NOR_t *)ctx, offset, n);
+}
+
+// A 'D' on Serial within FLASH_DUMP_WAIT_MS sends "NORDUMP <bytes>" and the
+// whole chip, before the ring touches it (Tools/spi_nor fetch).
+void Nor_Dump() {
+
+  static uint8_t buf[NOR_SECTOR_SIZE];
+  uint32_t t0 = millis();
+  while (millis() - t0 < FLASH_DUMP_WAIT_MS) {
+    if (Serial.available() && Serial.read() == 'D') {
+      Serial.printf("NORDUMP %lu\n", (unsigned long)Nor.size);
+      for (uint32_t addr = 0; addr < Nor.size; addr += sizeof(buf)) {
+        if (!NOR_read(&Nor, addr, buf, sizeof(buf))) memset(buf, 0xFF, sizeof(buf));
+        Serial.write(buf, sizeof(buf));
+      }
+      Serial.flush();
+      return;
+    }
+    delay(10);
+  }
+
+}
+
+// One block as one ring slot, timed like an SD slot write.
+bool Flash_Write_Block(const SINK_Block_t *b) {
+
+  int64_t t0 = esp_timer_get_time();
+  bool written = FRING_append_block(&FlashRing, b->data, b->used) && FRING_commit(&FlashRing);
+  uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+  portENTER_CRITICAL(&StorageLock);
+  FlashWindow.slots++;
+  FlashWindow.write_us += us;
+  if (us > FlashWindow.write_max_us) FlashWindow.write_max_us = us;
+  portEXIT_CRITICAL(&StorageLock);
+  return written;
+
+}
+
+// One sector erased ahead per call, until the runway is ready.
+void Flash_Erase_Ahead() {
+
+  int64_t t0 = esp_timer_get_time();
+  if (FRING_service(&FlashRing, FLASH_RUNWAY_SLOTS)) {
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    portENTER_CRITICAL(&StorageLock);
+    if (us > FlashWindow.flush_max_us) FlashWindow.flush_max_us = us;
+    portEXIT_CRITICAL(&StorageLock);
+  }
+
+}
+
+// Erase ahead until the runway is ready, from setup() before the flash writer and the sampling timers
+// start (see "Internal flash log").
+void Flash_Fill_Runway() {
+
+  int64_t t0 = esp_timer_get_time();
+  uint32_t before = FlashRing.erased;
+  while (FlashRing.erased < FLASH_RUNWAY_SLOTS && FlashRing.erased < FlashRing.slots) {
+    if (!FRING_service(&FlashRing, FLASH_RUNWAY_SLOTS)) {
+      break;
+    }
+  }
+  uint32_t ready = FlashRing.erased;
+  uint32_t want = std::min<uint32_t>(FLASH_RUNWAY_SLOTS, FlashRing.slots);
+  Serial.printf("Flash ring : %lu sectors erased ahead in %lld ms, runway %lu of %lu\n",
+                (unsigned long)(ready - before), (esp_timer_get_time() - t0) / 1000,
+                (unsigned long)ready, (unsigned long)want);
+  if (ready < want) {
+    Serial.printf("Flash ring : runway %lu sectors short, those commits will erase first...\n",
+                  (unsigned long)(want - ready));
+  }
+
+}
+
+// True while the internal flash may still erase ahead : on the pad, not after a warm reset, never again once
+// the apogee detector has left PAD this boot.
+bool Flash_Top_Up() {
+
+  if (ApogeeDetector.phase != APOGEE_PAD) {
+    FlashLaunched = true;
+  }
+  return !FlashWarmBoot && !FlashLaunched && FlashRing.erased < FLASH_RUNWAY_SLOTS;
+
+}
+
+// The ring's blocks as loop() hands them over and the sectors ahead of them. The W25Q erases ahead at
+// every pass, its erases stop neither the cache nor the cores. The internal flash erases one sector after
+// a commit on the pad, once Accel_Task has woken this task straight out of a FIFO drain.
+void Flash_Writer_Task(void *arg) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FLASH_ERASE_POLL_MS));
+    bool drained = FlashEraseDrained;
+    FlashEraseDrained = false;
+    bool committed = false;
+    SINK_Block_t *b;
+    while ((b = SINK_peek(&FlashSink)) != NULL) {
+      bool written = Flash_Write_Block(b);
+      SINK_pop(&FlashSink, written, esp_timer_get_time());
+      committed = true;
+    }
+    if (FLASH_LOG_DEVICE == FLASH_DEVICE_W25Q) {
+      Flash_Erase_Ahead();
+    }
+    else if (drained && !committed) {
+      if (Flash_Top_Up()) {
+        Flash_Erase_Ahead();
+      }
+    }
+    else if (committed && Flash_Top_Up()) {
+      FlashEraseWanted = true;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------------------------------
+// Log offload Function Definitions :
+//------------------------------------------------------------------------------------------------------
+// Serve the logs to a host that asks within OFFLOAD_WAIT_MS (see "Log offload").
+// The journal and its index are offered up to the last slot written, the
+// flash ring as its whole partition (Tools/flash_ring unwrap).
+void Offload_Run() {
+
+  OFF_File_t files[3];
+  uint8_t n_files = 0;
+  if (JournalOpen) {
+    files[n_files++] = { LOG_FILE_PATH + 1, Journal.next * LOG_SLOT_SIZE, Offload_Read_Sd, &LogTarget };
+    if (IndexOpen) {
+      uint32_t sectors = Journal.next / LOG_INDEX_SECTOR_ENTRIES;  // The one being filled is not on the card
+      files[n_files++] = { LOG_INDEX_PATH + 1, sectors * (uint32_t)sizeof(IndexSector), Offload_Read_Sd, &IndexTarget };
+    }
+  }
+  if (FlashOpen) {
+    files[n_files++] = { FLASH_PARTITION ".bin", FlashRing.io.size, Offload_Read_Flash, &FlashRing.io };
+  }
+  if (n_files == 0) {
+    return;
+  }
+
+  OFF_Link_t link = { Offload_Send, NULL };
+  OFF_server_init(&Offload, files, n_files, &link, OffloadBuf, sizeof(OffloadBuf));
+  uint32_t heard = millis();
+  uint32_t wait = OFFLOAD_WAIT_MS;
+  while (!Offload.bye && millis() - heard < wait) {
+    uint8_t rx[64];
+    size_t got = 0;
+    int available = Serial.available();
+    if (available > 0) {
+      got = Serial.readBytes(rx, std::min((size_t)available, sizeof(rx)));
+      uint32_t requests = Offload.requests;
+      OFF_server_rx(&Offload, rx, got);
+      if (Offload.requests != requests) {
+        heard = millis();
+        wait = OFFLOAD_IDLE_MS;
+      }
+    }
+    if (!OFF_server_service(&Offload) && got == 0) {
+      delay(1);
+    }
+  }
+  if (Offload.requests) {
+    Serial.printf("Offload : %lu requests, %lu DATA frames, %lu bytes sent again, %lu read errors\n",
+                  (unsigned long)Offload.requests, (unsigned long)Offload.data_frames,
+                  (unsigned long)Offload.resent, (unsigned long)Offload.read_errors);
+  }
+
+}
+
+// DATA chunks are slot aligned, index ones sector aligned : raw reads take them.
+bool Offload_Read_Sd(void *ctx, uint32_t offset, void *buf, size_t n) {
+  return SD_Target_Read(ctx, offset, buf, n);
+}
+
+bool Offload_Read_Flash(void *ctx, uint32_t offset, void *buf, size_t n) {
+  FRING_Io_t *io = (FRING_Io_t *)ctx;
+  return io->read(io->ctx, offset, buf, n);
+}
+
+// USB CDC : write() returns once the frame is queued, the next one is built meanwhile.
+bool Offload_Send(void *ctx, const uint8_t *buf, size_t n) {
+  Serial.write(buf, n);
+  return true;
+}
+
+
+//------------------------------------------------------------------------------------------------------
+// Telemetry Function Definitions :
+//------------------------------------------------------------------------------------------------------
+void Telemetry_Init() {
+
+  if (TLM_FEC_BENCHMARK) {
+    Telemetry_Fec_Benchmark();
+  }
+
+  pinMode(NOR_CS, OUTPUT);               // The W25Q stays off the bus while the radio talks
+  digitalWrite(NOR_CS, HIGH);
+  pinMode(RFM_CS, OUTPUT);
+  digitalWrite(RFM_CS, HIGH);
+  pinMode(RFM_RST, OUTPUT);
+  digitalWrite(RFM_RST, LOW);
+  delay(1);
+  digitalWrite(RFM_RST, HIGH);
+  delay(10);                             // POR : 10 ms before the first access
+  NorSpi.begin(NOR_SCK, NOR_MISO, NOR_MOSI, NOR_CS);  // Nothing if the W25Q began it
+
+  RFM_Config_t cfg = { TLM_FREQ_HZ, TLM_BW_HZ, TLM_SF, TLM_CR, TLM_PREAMBLE, TLM_SYNC_WORD, TLM_POWER_DBM };
+  RFM_Bus_t bus = { Rfm_Xfer, Rfm_Now_us, &NorSpi };
+  if (!RFM_init(&Radio, &bus, &cfg)) {
+    Serial.println("No RFM95 answering, telemetry off...");
+    return;
+  }
+  RadioOpen = true;
+
+  TLM_SchedConfig_t sched = {};
+  sched.airtime_us[TLM_PKT_STATE] = RFM_airtime_us(&cfg, TLM_STATE_SIZE);
+  sched.airtime_us[TLM_PKT_BEACON] = RFM_airtime_us(&cfg, TLM_BEACON_SIZE);
+  sched.airtime_us[TLM_PKT_DELTA] = RFM_airtime_us(&cfg, TLM_DELTA_SIZE);
+  sched.duty = TLM_DUTY_PERCENT / 100.0f;
+  sched.min_period_us[TLM_PKT_BEACON] = TLM_BEACON_PERIOD_MS * 1000UL;
+  sched.keyframe_every = TLM_KEYFRAME_EVERY;
+  sched.fec_k = TLM_FEC_K;
+  sched.fec_m = TLM_FEC_M;
+  for (size_t n = TLM_REPAIR_HEADER + 2; n <= TLM_MAX_PACKET; n++) {
+    sched.repair_airtime_us[n] = RFM_airtime_us(&cfg, n);
+  }
+  TLM_sched_init(&TelemetrySched, &sched);
+  TLM_phase_init(&TelemetryPhase);
+  Serial.printf("Telemetry : %lu Hz SF%u %lu kHz, STATE %lu us on the air, DELTA %lu us, keyframe every %u, "
+                "%u REPAIRs every %u packets\n",
+                (unsigned long)cfg.freq_hz, cfg.sf, (unsigned long)(cfg.bw_hz / 1000),
+                (unsigned long)sched.airtime_us[TLM_PKT_STATE], (unsigned long)sched.airtime_us[TLM_PKT_DELTA],
+                (unsigned)TelemetrySched.cfg.keyframe_every, (unsigned)TelemetrySched.cfg.fec_m,
+                (unsigned)TelemetrySched.cfg.fec_k);
+
+  xTaskCreatePinnedToCore(Telemetry_Task, "telemetry", 4096, NULL, TLM_PRIORITY, &TelemetryTaskHandle, TLM_CORE);
+  attachInterrupt(digitalPinToInterrupt(RFM_DIO0), Telemetry_DIO0_ISR, RISING);
+
+}
+
+// The erasure code as the radio task would run it, on this core : a group of
+// TLM_FEC_K symbols the size of a STATE packet, its repairs encoded and as
+// many lost packets rebuilt, TLM_FEC_BENCH_RUNS times, for XOR parity
+// (M = 1) and Reed-Solomon (TLM_FEC_M, at least 2). Prints us per group and
+// cycles per byte; the same table for the host comes from `telemetry fec`.
+void Telemetry_Fec_Benchmark() {
+  static uint8_t data[FEC_MAX_K][FEC_MAX_SYMBOL];
+  static uint8_t repair[FEC_MAX_M][FEC_MAX_SYMBOL];
+  const size_t len = 1 + TLM_STATE_SIZE;
+  const uint8_t k = TLM_FEC_K;
+  const uint8_t *in[FEC_MAX_K];
+  uint8_t *io[FEC_MAX_K];
+  const uint8_t *rep[FEC_MAX_M];
+  uint8_t rows[FEC_MAX_M];
+  FEC_init_tables();
+  for (int i = 0; i < FEC_MAX_K; i++) {
+    for (size_t b = 0; b < len; b++) data[i][b] = (uint8_t)(esp_random() & 0xFF);
+    in[i] = io[i] = data[i];
+  }
+  for (int j = 0; j < FEC_MAX_M; j++) {
+    rep[j] = repair[j];
+    rows[j] = (uint8_t)j;
+  }
+
+  const uint8_t ms[2] = { 1, TLM_FEC_M > 1 ? TLM_FEC_M : 2 };
+  for (uint8_t m : ms) {
+    uint32_t c0 = ESP.getCycleCount();
+    for (int r = 0; r < TLM_FEC_BENCH_RUNS; r++) {
+      for (uint8_t j = 0; j < m; j++) FEC_encode(in, k, len, j, repair[j]);
+    }
+    uint32_t enc = ESP.getCycleCount() - c0;
+    uint32_t have = ((1UL << k) - 1) & ~((1UL << m) - 1);  // The first m lost
+    c0 = ESP.getCycleCount();
+    for (int r = 0; r < TLM_FEC_BENCH_RUNS; r++) {
+      FEC_decode(io, have, k, rep, rows, m, len);
+    }
+    uint32_t dec = ESP.getCycleCount() - c0;
+    double mhz = ESP.getCpuFreqMHz();
+    Serial.printf("FEC bench K %u M %u, %u B symbols : encode %.1f us a group (%.1f cycles/B), rebuild %.1f us (%.1f cycles/B)\n",
+                  (unsigned)k, (unsigned)m, (unsigned)len, enc / mhz / TLM_FEC_BENCH_RUNS,
+                  (double)enc / TLM_FEC_BENCH_RUNS / (k * len), dec / mhz / TLM_FEC_BENCH_RUNS,
+                  (double)dec / TLM_FEC_BENCH_RUNS / (k * len));
+  }
+}
+
+// Called with every STATE record : the newest state for the next packet.
+void Telemetry_Update(int64_t t_us) {
+
+  TLM_Phase_t phase = TLM_phase_update(&TelemetryPhase, t_us, (uint8_t)ApogeeDetector.phase,
+                                       AltitudeKF.x[1], AltitudeKF.x[2]);
+  if (t_us >= BatteryRead_us) {
+    BatteryRead_us = t_us + BATT_READ_US;
+    BatteryMv = (uint16_t)(analogReadMilliVolts(BATT_SENSE_PIN) * BATT_DIVIDER);
+  }
+
+  uint8_t health = 0;
+  if (JournalOpen) health |= TLM_HEALTH_SD;
+  if (FlashOpen) health |= TLM_HEALTH_FLASH;
+  if (GPS_fix >= 3) health |= TLM_HEALTH_GPS_3D;
+  if (GpsTimeSync.locked) health |= TLM_HEALTH_TIME_LOCKED;
+  if (AltitudeKF.baro_locked) health |= TLM_HEALTH_BARO_LOCKED;
+
+  portENTER_CRITICAL(&TelemetryLock);
+  TelemetryState.t_us = (uint64_t)t_us;
+  TelemetryState.phase = (uint8_t)phase;
+  TelemetryState.altitude = AltitudeKF.x[0];
+  TelemetryState.velocity = AltitudeKF.x[1];
+  TelemetryState.acceleration = AltitudeKF.x[2];
+  if (AltitudeKF.x[0] > TelemetryState.max_altitude) {
+    TelemetryState.max_altitude = AltitudeKF.x[0];
+  }
+  TelemetryState.lat_e7 = (int32_t)GPS_lat;
+  TelemetryState.lon_e7 = (int32_t)GPS_lon;
+  TelemetryState.gps_height_mm = (int32_t)GPS_height;
+  TelemetryState.gps_fix = GPS_fix;
+  TelemetryState.battery_mv = BatteryMv;
+  TelemetryState.health = health;
+  TelemetryState.samples_dropped = SampleDroppedTotal;
+  TelemetryState.blocks_dropped = SdSink.overruns + FlashSink.overruns;
+  portEXIT_CRITICAL(&TelemetryLock);
+
+}
+
+/**
+ * Wakes on TxDone or when the next packet is due. A packet goes out as soon
+ * as the schedule allows and the last one has left; the state it carries is
+ * the newest loop() handed over. On the ground the radio sleeps between
+ * beacons.
+ */
+void Telemetry_Task(void *arg) {
+  uint8_t packet[TLM_MAX_PACKET];
+  for (;;) {
+    int64_t wait_us = TelemetrySched.next_us - esp_timer_get_time();
+    uint32_t wait_ms = wait_us <= 0 ? 0 : std::min<int64_t>(wait_us / 1000 + 1, TLM_WAKE_MS);
+    if (Radio.busy || wait_ms > 0) {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(Radio.busy ? TLM_WAKE_MS : wait_ms));
+    }
+
+    TLM_State_t state;
+    portENTER_CRITICAL(&TelemetryLock);
+    state = TelemetryState;
+    portEXIT_CRITICAL(&TelemetryLock);
+
+    if (Radio.busy) {
+      if (!RFM_service(&Radio)) continue;
+      if (state.phase == TLM_PHASE_LANDED) RFM_sleep(&Radio);
+    }
+    size_t len = TLM_sched_poll(&TelemetrySched, esp_timer_get_time(), &state, packet);
+    if (len) {
+      RFM_send(&Radio, packet, len);
+    }
+  }
+}
+
+// TxDone : wake the radio task, nothing else in interrupt context.
+void IRAM_ATTR Telemetry_DIO0_ISR() {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(TelemetryTaskHandle, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+// SX1276 access on SPI3 : address byte then data, one chip select. The SPI
+// library's transaction lock keeps it apart from the W25Q writer.
+bool Rfm_Xfer(void *ctx, uint8_t addr, const uint8_t *tx, uint8_t *rx, size_t n) {
+
+  SPIClass *spi = (SPIClass *)ctx;
+  spi->beginTransaction(SPISettings(RFM_SPI_FREQ, MSBFIRST, SPI_MODE0));
+  digitalWrite(RFM_CS, LOW);
+  spi->transfer(addr);
+  if (tx) {
+    spi->writeBytes(tx, n);
+  } else if (rx) {
+    spi->transferBytes(NULL, rx, n);
+  }
+  digitalWrite(RFM_CS, HIGH);
+  spi->endTransaction();
+  return true;
+
+}
+
+uint32_t Rfm_Now_us(void *ctx) {
+  return (uint32_t)esp_timer_get_time();
+}
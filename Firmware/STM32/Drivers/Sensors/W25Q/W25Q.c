@@ -0,0 +1,269 @@
+/**
+ * @file W25Q.c
+ * @brief SPI1, USART2 and DMA register glue for lib/SpiNor and lib/Offload on the STM32G030 (no HAL SPI, UART or DMA in this build).
+ */
+
+
+#include "stm32g0xx_hal.h"
+#include <stdint.h>
+#include "W25Q.h"
+
+// The drivers are shared with the flight computer, built here as part of this file.
+#include "../../../../ESP32/ESP32_FC/lib/SpiNor/spi_nor.c"
+#include "../../../../ESP32/ESP32_FC/lib/Offload/offload.c"
+
+// DMAMUX request lines (RM0454, DMAMUX table)
+#define W25Q_DMAREQ_USART2_RX 52
+#define W25Q_DMAREQ_USART2_TX 53
+
+
+static NOR_t W25Q_Nor;
+static NOR_Log_t W25Q_Stream;
+static bool W25Q_Open = false;
+
+// Offload : DMA1 channel 1 sends the frames, channel 2 receives into a ring.
+static OFF_Server_t W25Q_Server;
+static OFF_File_t W25Q_File;
+static uint8_t W25Q_Tx[2 * (W25Q_OFFLOAD_CHUNK + OFF_OVERHEAD)];
+static uint8_t W25Q_Rx[W25Q_RX_SIZE];
+static uint32_t W25Q_Rx_At = 0;
+
+
+static uint8_t W25Q_Spi_Byte(uint8_t out)
+{
+    while (!(SPI1->SR & SPI_SR_TXE));
+    *(volatile uint8_t *)&SPI1->DR = out;
+    while (!(SPI1->SR & SPI_SR_RXNE));
+    return *(volatile uint8_t *)&SPI1->DR;
+}
+
+
+/**
+ * @brief One transaction with CS held low : the command, then n bytes out of tx or into rx.
+ */
+static bool W25Q_Xfer(void *ctx, const uint8_t *cmd, size_t n_cmd,
+                        const uint8_t *tx, uint8_t *rx, size_t n)
+{
+    GPIOA->BRR = 1UL << W25Q_CS_PIN;
+    for (size_t i = 0; i < n_cmd; i++) W25Q_Spi_Byte(cmd[i]);
+    for (size_t i = 0; i < n; i++) {
+        uint8_t in = W25Q_Spi_Byte(tx ? tx[i] : 0xFF);
+        if (rx) rx[i] = in;
+    }
+    while (SPI1->SR & SPI_SR_BSY);
+    GPIOA->BSRR = 1UL << W25Q_CS_PIN;
+    return true;
+}
+
+
+/**
+ * @brief Microseconds from the HAL millisecond tick and the SysTick count down.
+ */
+static uint32_t W25Q_Now_us(void *ctx)
+{
+    uint32_t ms, val;
+    do {
+        ms = HAL_GetTick();
+        val = SysTick->VAL;
+    } while (ms != HAL_GetTick());
+    return ms * 1000 + (SysTick->LOAD - val) / (SystemCoreClock / 1000000);
+}
+
+
+/**
+ * @brief Whether DMA1 channel 1 is done with the last frame (or never started one).
+ */
+static bool W25Q_Tx_Idle(void)
+{
+    return !(DMA1_Channel1->CCR & DMA_CCR_EN) || (DMA1->ISR & DMA_ISR_TCIF1);
+}
+
+
+static void W25Q_Uart_Send(const uint8_t *data, uint32_t n)
+{
+    while (!W25Q_Tx_Idle());
+    for (uint32_t i = 0; i < n; i++) {
+        while (!(USART2->ISR & USART_ISR_TXE_TXFNF));
+        USART2->TDR = data[i];
+    }
+}
+
+
+/**
+ * @brief Offload link : a frame out of DMA1 channel 1, false while the last one is still going out.
+ * @note The buffer is the server's, left alone until it hands over the next frame.
+ */
+static bool W25Q_Offload_Send(void *ctx, const uint8_t *buf, size_t n)
+{
+    if (!W25Q_Tx_Idle()) {
+        return false;
+    }
+    DMA1_Channel1->CCR = 0;
+    DMA1->IFCR = DMA_IFCR_CGIF1;
+    DMA1_Channel1->CPAR = (uint32_t)&USART2->TDR;
+    DMA1_Channel1->CMAR = (uint32_t)buf;
+    DMA1_Channel1->CNDTR = (uint32_t)n;
+    DMA1_Channel1->CCR = DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_EN;
+    return true;
+}
+
+
+/**
+ * @brief Offload reads : file offset 0 is the start of the log.
+ */
+static bool W25Q_Offload_Read(void *ctx, uint32_t offset, void *buf, size_t n)
+{
+    return NOR_read(&W25Q_Nor, W25Q_Stream.start + offset, buf, n);
+}
+
+
+/**
+ * @brief PA4-PA7 to SPI1 at fPCLK / 2 (8 MHz on HSI), mode 0, 8 bit frames; PA2-PA3 to USART2.
+ * @note USART2 transmits and receives through DMA1 channels 1 and 2 (the DMAMUX routes the requests).
+ */
+static void W25Q_Bus_Init(void)
+{
+    RCC->IOPENR |= RCC_IOPENR_GPIOAEN;
+    RCC->APBENR2 |= RCC_APBENR2_SPI1EN;
+    RCC->APBENR1 |= RCC_APBENR1_USART2EN;
+
+    // CS high before it is an output
+    GPIOA->BSRR = 1UL << W25Q_CS_PIN;
+    GPIOA->MODER &= ~(GPIO_MODER_MODE2 | GPIO_MODER_MODE3 | GPIO_MODER_MODE4 |
+                      GPIO_MODER_MODE5 | GPIO_MODER_MODE6 | GPIO_MODER_MODE7);
+    GPIOA->MODER |= (2UL << GPIO_MODER_MODE2_Pos) | (2UL << GPIO_MODER_MODE3_Pos) |
+                    (1UL << GPIO_MODER_MODE4_Pos) | (2UL << GPIO_MODER_MODE5_Pos) |
+                    (2UL << GPIO_MODER_MODE6_Pos) | (2UL << GPIO_MODER_MODE7_Pos);
+    GPIOA->OSPEEDR |= GPIO_OSPEEDR_OSPEED4 | GPIO_OSPEEDR_OSPEED5 | GPIO_OSPEEDR_OSPEED7;
+    // AF1 (USART2) on PA2 and PA3, AF0 (SPI1) on PA5 to PA7
+    GPIOA->AFR[0] &= ~(GPIO_AFRL_AFSEL2 | GPIO_AFRL_AFSEL3 | GPIO_AFRL_AFSEL5 |
+                       GPIO_AFRL_AFSEL6 | GPIO_AFRL_AFSEL7);
+    GPIOA->AFR[0] |= (1UL << GPIO_AFRL_AFSEL2_Pos) | (1UL << GPIO_AFRL_AFSEL3_Pos);
+
+    SPI1->CR1 = SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI;     // BR = 000 : fPCLK / 2
+    SPI1->CR2 = SPI_CR2_FRXTH | (7UL << SPI_CR2_DS_Pos);      // RXNE on a byte
+    SPI1->CR1 |= SPI_CR1_SPE;
+
+    // Oversampling by 8 : 921600 baud is 0.8 % off on 16 MHz, 2 % by 16
+    uint32_t div = (2 * SystemCoreClock + W25Q_UART_BAUD / 2) / W25Q_UART_BAUD;
+    USART2->CR1 = 0;
+    USART2->BRR = (div & 0xFFF0) | ((div & 0x000F) >> 1);
+    USART2->CR3 = USART_CR3_DMAT | USART_CR3_DMAR;
+    USART2->CR1 = USART_CR1_OVER8 | USART_CR1_TE | USART_CR1_RE | USART_CR1_UE;
+
+    // Receive ring : channel 2 circular, read up to where CNDTR has got
+    RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+    DMAMUX1_Channel0->CCR = W25Q_DMAREQ_USART2_TX;
+    DMAMUX1_Channel1->CCR = W25Q_DMAREQ_USART2_RX;
+    DMA1_Channel2->CPAR = (uint32_t)&USART2->RDR;
+    DMA1_Channel2->CMAR = (uint32_t)W25Q_Rx;
+    DMA1_Channel2->CNDTR = W25Q_RX_SIZE;
+    DMA1_Channel2->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_EN;
+}
+
+
+/**
+ * @brief Set up the buses, find the chip and open the log on all of it.
+ * @note Without a W25Q class chip the log stays off and W25Q_Log_Write() does nothing.
+ */
+bool W25Q_Init(void)
+{
+    W25Q_Bus_Init();
+    NOR_Bus_t bus = { W25Q_Xfer, W25Q_Now_us, NULL, NULL };
+    if (!NOR_init(&W25Q_Nor, &bus)) {
+        return false;
+    }
+    W25Q_Open = NOR_log_open(&W25Q_Stream, &W25Q_Nor, 0, W25Q_Nor.size, W25Q_RUNWAY);
+    W25Q_File.name = W25Q_OFFLOAD_NAME;
+    W25Q_File.size = W25Q_Stream.head - W25Q_Stream.start;
+    W25Q_File.read = W25Q_Offload_Read;
+    OFF_Link_t link = { W25Q_Offload_Send, NULL };
+    OFF_server_init(&W25Q_Server, &W25Q_File, 1, &link, W25Q_Tx, sizeof(W25Q_Tx));
+    return W25Q_Open;
+}
+
+
+void W25Q_Log_Write(const void *data, uint16_t len)
+{
+    if (W25Q_Open) {
+        NOR_log_write(&W25Q_Stream, data, len);
+    }
+}
+
+
+void W25Q_Log_Service(void)
+{
+    if (!W25Q_Open) {
+        return;
+    }
+    NOR_log_service(&W25Q_Stream);
+
+    if (USART2->ISR & USART_ISR_ORE) {
+        USART2->ICR = USART_ICR_ORECF;
+    }
+    uint32_t end = W25Q_RX_SIZE - DMA1_Channel2->CNDTR;
+    while (W25Q_Rx_At != end) {
+        uint8_t c = W25Q_Rx[W25Q_Rx_At];
+        W25Q_Rx_At = (W25Q_Rx_At + 1) % W25Q_RX_SIZE;
+        // Commands only between offload frames, a frame's bytes go to the server
+        bool between = W25Q_Server.rx.have == W25Q_Server.rx.done;
+        if (between && c == 'D') {
+            W25Q_Dump();
+        } else if (between && c == 'E') {
+            NOR_log_flush(&W25Q_Stream);
+            NOR_erase_chip(&W25Q_Nor, 400);
+            W25Q_Open = NOR_log_open(&W25Q_Stream, &W25Q_Nor, 0, W25Q_Nor.size, W25Q_RUNWAY);
+            W25Q_File.size = 0;
+        } else {
+            uint32_t requests = W25Q_Server.requests;
+            OFF_server_rx(&W25Q_Server, &c, 1);
+            if (W25Q_Server.requests != requests && W25Q_Server.info) {
+                // LIST : the file is the log up to now, its last page programmed
+                NOR_log_flush(&W25Q_Stream);
+                W25Q_File.size = W25Q_Stream.head - W25Q_Stream.start;
+            }
+        }
+    }
+    OFF_server_service(&W25Q_Server);
+}
+
+
+/**
+ * @brief The log from the start of the chip to its head, page by page (~180 s for 16 MB at 921600 baud).
+ * @note The records are the flight computer's (sync byte and checksum) : Tools/log_decode reads the dump as it is.
+ */
+void W25Q_Dump(void)
+{
+    static uint8_t page[NOR_PAGE_SIZE];
+    char header[24] = "NORDUMP ";
+    char digits[11];
+    uint32_t len = 8, n = 0;
+
+    NOR_log_flush(&W25Q_Stream);
+    uint32_t total = W25Q_Stream.head - W25Q_Stream.start;
+    do {
+        digits[n++] = (char)('0' + total % 10);
+        total /= 10;
+    } while (total);
+    while (n) header[len++] = digits[--n];
+    header[len++] = '\n';
+    W25Q_Uart_Send((const uint8_t *)header, len);
+
+    for (uint32_t addr = W25Q_Stream.start; addr < W25Q_Stream.head; addr += NOR_PAGE_SIZE) {
+        NOR_read(&W25Q_Nor, addr, page, NOR_PAGE_SIZE);
+        W25Q_Uart_Send(page, NOR_PAGE_SIZE);
+    }
+    while (!(USART2->ISR & USART_ISR_TC));
+}
+
+
+const NOR_Log_t *W25Q_Log(void)
+{
+    return &W25Q_Stream;
+}
+
+
+const OFF_Server_t *W25Q_Offload(void)
+{
+    return &W25Q_Server;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file W25Q.h
+ * @brief Flight log on an external W25Q SPI NOR flash, and its read out over USART2.
+ *
+ * The driver itself is the flight computer's lib/SpiNor (spi_nor.c, plain C),
+ * built here through W25Q.c; this file gives it the SPI1 bus and a clock.
+ * The log is read out either as a plain dump ('D') or through the flight
+ * computer's resumable offload protocol (lib/Offload, Tools/offload), its
+ * frames sent and received by DMA on USART2.
+ * See Driver_Documentation_and_Build.md for the wiring and the read out.
+ */
+
+#ifndef W25Q_H
+#define W25Q_H
+
+#include "stm32g0xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../../../../ESP32/ESP32_FC/lib/SpiNor/spi_nor.h"
+#include "../../../../ESP32/ESP32_FC/lib/Offload/offload.h"
+
+
+// SPI1 (AF0) to the flash, chip select by hand :
+//  - PA5 -> SCK
+//  - PA6 -> MISO
+//  - PA7 -> MOSI
+//  - PA4 -> CS
+#define W25Q_CS_PIN 4
+
+// USART2 (AF1) for the read out :
+//  - PA2 -> TX
+//  - PA3 -> RX
+#define W25Q_UART_BAUD 921600
+#define W25Q_OFFLOAD_CHUNK 512      // DATA payload, two frame buffers of it in RAM
+#define W25Q_OFFLOAD_NAME "flightlog.bin"
+#define W25Q_RX_SIZE 64             // USART2 receive ring, filled by DMA
+
+#define W25Q_RUNWAY (64UL * 1024)   // Bytes kept erased ahead of the log : a block erase never holds a page back
+
+
+/**
+ * @brief Set up SPI1 and USART2, find the chip and the end of its log.
+ * @return false if no flash answers, the log is then off.
+ */
+bool W25Q_Init(void);
+
+/**
+ * @brief Add a record to the log, never waiting. Bytes finding the page buffers full are dropped (counted).
+ */
+void W25Q_Log_Write(const void *data, uint16_t len);
+
+/**
+ * @brief Program full pages, erase ahead, answer the host. Call from the main loop.
+ * @note 'D' on USART2 sends the log (W25Q_Dump()), 'E' erases the chip for the next flight.
+ *       Offload frames are answered a frame per call, the next one built while DMA sends the last.
+ */
+void W25Q_Log_Service(void);
+
+/**
+ * @brief Send "NORDUMP <bytes>\n" then the log, from the start of the chip to its end.
+ */
+void W25Q_Dump(void);
+
+/**
+ * @brief The streaming log, for its statistics (dropped bytes, waits).
+ */
+const NOR_Log_t *W25Q_Log(void);
+
+/**
+ * @brief The offload server, for its statistics (requests, bytes sent again).
+ */
+const OFF_Server_t *W25Q_Offload(void);
+
+#endif /* W25Q_H */
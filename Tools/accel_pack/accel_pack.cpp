@@ -0,0 +1,348 @@
+/**
+ * @file accel_pack.cpp
+ * @brief ACCEL_PACK records (lib/FlightLog) : compression of the ADXL375 stream, CPU cost, worst case block, corruption.
+ *
+ * sim runs the reference flights with the ADXL375 at its 3200 Hz output
+ * rate, through lib/Vibration in FIFO bursts stamped as Accel_Task does
+ * (wake latency modelled), and packs what the flight computer logs : the
+ * 800 Hz ACCEL samples, blocks closed when full and at every once a second
+ * flush. The 3200 Hz FIFO stream itself is packed as well, for comparison.
+ * Every block is unpacked again and checked sample for sample.
+ *
+ * Reported per stream : bytes against an ACCEL record per sample, bits per
+ * sample on the pad and in boost, the largest block against
+ * LOG_ACCEL_PACK_MAX, ns per sample to pack and to unpack (this machine), and
+ * samples lost to corrupted records.
+ *
+ * A log given instead has its ACCEL samples packed the same way; with an
+ * output file the log is written again with ACCEL_PACK records in place of
+ * the ACCEL ones, every other record as it was.
+ *
+ * Usage :
+ *   accel_pack sim
+ *   accel_pack <log.bin> [packed.bin]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "flight_log.h"
+#include "flight_sim.h"
+#include "log_reader.h"
+#include "vibration.h"
+
+
+#define WAKE_LATENCY_US 10.0          // Accel_Task wake after its timer, mean
+#define WAKE_JITTER_US 8.0            // and spread (half normal)
+#define CORRUPT_EVERY 100             // One byte flipped in every this many records
+#define FLUSH_US 1000000              // Blocks closed at the once a second flush
+
+
+typedef struct {
+  std::vector<uint64_t> t_us;
+  std::vector<LOG_Accel_t> acc;
+} Stream_t;
+
+typedef struct {
+  size_t samples;
+  size_t records;
+  uint64_t raw_bytes;         // As ACCEL records
+  uint64_t packed_bytes;      // As ACCEL_PACK records, record overhead included
+  uint64_t pad_bits, pad_samples;
+  uint64_t boost_bits, boost_samples;
+  uint16_t max_block;
+  double pack_ns, unpack_ns;  // Per sample
+  size_t lost;                // Samples not recovered from a log with corrupted records
+  size_t corrupted;
+  bool exact;
+} Result_t;
+
+
+template <typename F>
+static double ns_per_sample(size_t n, F fn) {
+  int reps = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  double s;
+  do {
+    fn();
+    reps++;
+    s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  } while (s < 0.2);
+  return s * 1e9 / ((double)n * reps);
+}
+
+
+// Blocks of the stream as ACCEL_PACK records, closed when full, when a stamp
+// does not fit and at every flush (flush_us, 0 : none), as Log_Accel() does.
+static void pack_stream(const Stream_t &s, uint64_t flush_us, std::vector<uint8_t> *log,
+                        std::vector<uint16_t> *lens, std::vector<size_t> *firsts) {
+  static LOG_AccelPack_t p;
+  p.count = 0;
+  uint8_t payload[LOG_ACCEL_PACK_MAX];
+  uint8_t rec[LOG_ACCEL_PACK_MAX + LOG_OVERHEAD];
+  uint64_t flush_at = s.t_us.empty() || !flush_us ? UINT64_MAX : s.t_us[0] + flush_us;
+  size_t first = 0;
+  auto close = [&](size_t next) {
+    uint64_t t0;
+    uint16_t len = LOG_accel_pack_close(&p, payload, &t0);
+    if (!len) return;
+    size_t n = LOG_encode(rec, LOG_REC_ACCEL_PACK, t0, payload, len);
+    if (log) log->insert(log->end(), rec, rec + n);
+    if (lens) lens->push_back(len);
+    if (firsts) firsts->push_back(first);
+    first = next;
+  };
+  for (size_t i = 0; i < s.t_us.size(); i++) {
+    if (s.t_us[i] >= flush_at) {
+      close(i);
+      flush_at += flush_us;
+    }
+    if (!LOG_accel_pack_add(&p, s.t_us[i], &s.acc[i])) {
+      close(i);
+      LOG_accel_pack_add(&p, s.t_us[i], &s.acc[i]);
+    }
+    if (p.count == LOG_ACCEL_PACK_SAMPLES) close(i + 1);
+  }
+  close(s.t_us.size());
+}
+
+
+static Result_t measure(const Stream_t &s, uint64_t flush_us, double pad_end_s, double boost_end_s, uint64_t t0_us,
+                        uint32_t seed) {
+  Result_t r = {};
+  r.samples = s.t_us.size();
+  r.raw_bytes = (uint64_t)r.samples * (LOG_OVERHEAD + sizeof(LOG_Accel_t));
+
+  std::vector<uint8_t> log;
+  std::vector<uint16_t> lens;
+  std::vector<size_t> firsts;
+  pack_stream(s, flush_us, &log, &lens, &firsts);
+  r.records = lens.size();
+  r.packed_bytes = log.size();
+  for (size_t b = 0; b < lens.size(); b++) {
+    r.max_block = std::max(r.max_block, lens[b]);
+    size_t end = b + 1 < firsts.size() ? firsts[b + 1] : r.samples;
+    double t = (double)(s.t_us[firsts[b]] - t0_us) * 1e-6;
+    uint64_t bits = (uint64_t)(lens[b] + LOG_OVERHEAD) * 8;
+    if (t < pad_end_s) {
+      r.pad_bits += bits;
+      r.pad_samples += end - firsts[b];
+    } else if (t < boost_end_s) {
+      r.boost_bits += bits;
+      r.boost_samples += end - firsts[b];
+    }
+  }
+
+  // Unpacked again, sample for sample
+  LogData_t d = {};
+  LOGREAD_parse(log.data(), log.size(), &d);
+  r.exact = d.accel.size() == r.samples;
+  for (size_t i = 0; r.exact && i < r.samples; i++) {
+    r.exact = d.accel[i].t_us == s.t_us[i] && !memcmp(&d.accel[i].v, &s.acc[i], sizeof(LOG_Accel_t));
+  }
+
+  r.pack_ns = ns_per_sample(r.samples, [&]() { pack_stream(s, flush_us, NULL, NULL, NULL); });
+  std::vector<uint64_t> t(LOG_ACCEL_PACK_SAMPLES);
+  std::vector<LOG_Accel_t> a(LOG_ACCEL_PACK_SAMPLES);
+  r.unpack_ns = ns_per_sample(r.samples, [&]() {
+    for (size_t pos = 0; pos < log.size();) {
+      LOG_Record_t rec;
+      LOG_decode(log.data() + pos, log.size() - pos, &rec);
+      LOG_accel_unpack(rec.payload, rec.len, rec.t_us, t.data(), a.data());
+      pos += rec.size;
+    }
+  });
+
+  // One byte flipped in every CORRUPT_EVERY records : only their samples go
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> bad = log;
+  size_t pos = 0;
+  for (size_t b = 0; b < lens.size(); b++) {
+    size_t size = lens[b] + LOG_OVERHEAD;
+    if (b % CORRUPT_EVERY == CORRUPT_EVERY / 2) {
+      bad[pos + 1 + rng() % (size - 1)] ^= (uint8_t)(1u << (rng() % 8));
+      r.corrupted++;
+    }
+    pos += size;
+  }
+  LogData_t dbad = {};
+  LOGREAD_parse(bad.data(), bad.size(), &dbad);
+  r.lost = r.samples - dbad.accel.size();
+  return r;
+}
+
+
+static void print_header(void) {
+  printf("| Stream                          | Samples  | ACCEL (kB) | Packed (kB) | Ratio | Bits/sample | Pad  | Boost | Largest block (B) | Pack (ns/sample) | Unpack (ns/sample) | Corrupted | Lost   | Check |\n");
+  printf("| ------------------------------- | -------- | ---------- | ----------- | ----- | ----------- | ---- | ----- | ----------------- | ---------------- | ------------------ | --------- | ------ | ----- |\n");
+}
+
+
+static void print_row(const char *name, const Result_t &r) {
+  char pad[16] = "-", boost[16] = "-";
+  if (r.pad_samples) snprintf(pad, sizeof(pad), "%.1f", (double)r.pad_bits / r.pad_samples);
+  if (r.boost_samples) snprintf(boost, sizeof(boost), "%.1f", (double)r.boost_bits / r.boost_samples);
+  printf("| %-31s | %8zu | %10.0f | %11.0f | %5.2f | %11.1f | %4s | %5s | %10u of %4d | %16.1f | %18.1f | %9zu | %6zu | %-5s |\n",
+         name, r.samples, r.raw_bytes / 1024.0, r.packed_bytes / 1024.0, (double)r.raw_bytes / r.packed_bytes,
+         (double)r.packed_bytes * 8.0 / r.samples, pad, boost, r.max_block, LOG_ACCEL_PACK_MAX, r.pack_ns,
+         r.unpack_ns, r.corrupted, r.lost, r.exact ? "ok" : "FAIL");
+}
+
+
+// Worst case : every value at its widest. The first interval (the block's
+// period) at LOG_ACCEL_PACK_SLACK_US, the others 0 and twice that in turn,
+// the axes stepping between full scale ends every sample.
+static Result_t worst_case(void) {
+  Stream_t s;
+  uint64_t t = 1000000;
+  for (int i = 0; i < LOG_ACCEL_PACK_SAMPLES * 1000; i++) {
+    int j = i % LOG_ACCEL_PACK_SAMPLES;
+    LOG_Accel_t a;
+    for (int k = 0; k < 3; k++) a.acc_raw[k] = (int16_t)(j % 2 ? INT16_MAX : INT16_MIN);
+    if (j == 1) t += LOG_ACCEL_PACK_SLACK_US;
+    else if (j > 1 && j % 2) t += 2 * LOG_ACCEL_PACK_SLACK_US;
+    s.t_us.push_back(t);
+    s.acc.push_back(a);
+    if (j == LOG_ACCEL_PACK_SAMPLES - 1) t += LOG_ACCEL_PACK_SLACK_US;
+  }
+  return measure(s, 0, 0.0, 0.0, s.t_us[0], 1);
+}
+
+
+static int sim(void) {
+  print_header();
+  bool ok = true;
+  std::vector<SimConfig_t> lib = FLIGHTSIM_library();
+  for (size_t f = 0; f < lib.size(); f++) {
+    SimConfig_t cfg = lib[f];
+    cfg.accel_rate = VIB_INPUT_RATE_HZ;
+    SimFlight_t flight = FLIGHTSIM_run(cfg, 46 + (uint32_t)f);
+    const uint64_t t0_us = 10000000;
+
+    // Accel_Task : a FIFO burst per wake, stamped at the wake
+    static VIB_t vib;
+    VIB_init(&vib);
+    std::mt19937 rng(460 + (uint32_t)f);
+    std::normal_distribution<double> jitter(0.0, WAKE_JITTER_US);
+    Stream_t logged, fifo;
+    int16_t burst[VIB_DECIM][3];
+    int16_t out[VIB_MAX_BLOCK / VIB_DECIM + 1][3];
+    int64_t out_t[VIB_MAX_BLOCK / VIB_DECIM + 1];
+    for (size_t i = 0; i + VIB_DECIM <= flight.accel.size(); i += VIB_DECIM) {
+      for (int k = 0; k < VIB_DECIM; k++) {
+        memcpy(burst[k], flight.accel[i + k].raw, sizeof(burst[k]));
+        LOG_Accel_t a;
+        memcpy(a.acc_raw, flight.accel[i + k].raw, sizeof(a.acc_raw));
+        fifo.t_us.push_back(t0_us + (uint64_t)llround(flight.accel[i + k].t * 1e6));
+        fifo.acc.push_back(a);
+      }
+      double wake_us = flight.accel[i + VIB_DECIM - 1].t * 1e6 + WAKE_LATENCY_US + std::fabs(jitter(rng));
+      int64_t t_newest = (int64_t)t0_us + (int64_t)llround(wake_us) - 500000 / VIB_INPUT_RATE_HZ;
+      int n = VIB_process(&vib, burst, VIB_DECIM, t_newest, out, out_t);
+      for (int k = 0; k < n; k++) {
+        LOG_Accel_t a;
+        memcpy(a.acc_raw, out[k], sizeof(a.acc_raw));
+        logged.t_us.push_back((uint64_t)out_t[k]);
+        logged.acc.push_back(a);
+      }
+    }
+
+    double boost_end = flight.launch_t + cfg.burn_time;
+    Result_t r = measure(logged, FLUSH_US, flight.launch_t, boost_end, t0_us, 1 + (uint32_t)f);
+    std::string name = flight.name + ", 800 Hz logged";
+    print_row(name.c_str(), r);
+    ok = ok && r.exact && r.max_block <= LOG_ACCEL_PACK_MAX && r.lost <= r.corrupted * LOG_ACCEL_PACK_SAMPLES;
+    r = measure(fifo, FLUSH_US, flight.launch_t, boost_end, t0_us, 2 + (uint32_t)f);
+    name = flight.name + ", 3200 Hz FIFO";
+    print_row(name.c_str(), r);
+    ok = ok && r.exact && r.max_block <= LOG_ACCEL_PACK_MAX && r.lost <= r.corrupted * LOG_ACCEL_PACK_SAMPLES;
+    fflush(stdout);
+  }
+  Result_t w = worst_case();
+  print_row("worst case, full scale steps", w);
+  ok = ok && w.exact && w.max_block <= LOG_ACCEL_PACK_MAX;
+  printf("\n%s\n", ok ? "every sample unpacked exactly, every block within LOG_ACCEL_PACK_MAX" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+
+static int repack(const char *path, const char *out_path) {
+  std::vector<uint8_t> data;
+  if (!LOGREAD_load_file(path, data)) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return 1;
+  }
+  LogData_t d = {};
+  LOGREAD_parse(data.data(), data.size(), &d);
+  if (d.accel.empty()) {
+    fprintf(stderr, "%s : no ACCEL samples\n", path);
+    return 1;
+  }
+  Stream_t s;
+  for (const LogAccel_t &a : d.accel) {
+    s.t_us.push_back(a.t_us);
+    s.acc.push_back(a.v);
+  }
+  print_header();
+  Result_t r = measure(s, FLUSH_US, 0.0, 0.0, s.t_us[0], 1);
+  print_row(path, r);
+
+  if (out_path) {
+    // Records as they were, the ACCEL ones replaced by blocks of them, in stamp order.
+    std::vector<uint8_t> packed, out;
+    pack_stream(s, FLUSH_US, &packed, NULL, NULL);
+    size_t journal = LOGREAD_journal_length(data.data(), data.size());
+    size_t n = journal ? journal : data.size();
+    size_t at = 0;
+    for (size_t pos = 0; pos < n;) {
+      LOG_Record_t rec;
+      if (LOG_decode(data.data() + pos, n - pos, &rec) != LOG_OK) {
+        pos++;
+        continue;
+      }
+      pos += rec.size;
+      if (rec.type == LOG_REC_ACCEL || rec.type == LOG_REC_PAD || rec.type == LOG_REC_COMMIT ||
+          rec.type == LOG_REC_BLOCK) {
+        continue;
+      }
+      while (at < packed.size()) {
+        LOG_Record_t p;
+        LOG_decode(packed.data() + at, packed.size() - at, &p);
+        if (p.t_us > rec.t_us) break;
+        out.insert(out.end(), packed.begin() + at, packed.begin() + at + p.size);
+        at += p.size;
+      }
+      out.insert(out.end(), rec.payload - LOG_HEADER_SIZE, rec.payload - LOG_HEADER_SIZE + rec.size);
+    }
+    out.insert(out.end(), packed.begin() + at, packed.end());
+    FILE *f = fopen(out_path, "wb");
+    if (!f || fwrite(out.data(), 1, out.size(), f) != out.size()) {
+      fprintf(stderr, "cannot write %s\n", out_path);
+      if (f) fclose(f);
+      return 1;
+    }
+    fclose(f);
+    printf("\n%s : %zu bytes, was %zu\n", out_path, out.size(), n);
+  }
+  return r.exact ? 0 : 1;
+}
+
+
+int main(int argc, char **argv) {
+  if (argc == 2 && !strcmp(argv[1], "sim")) {
+    return sim();
+  }
+  if (argc == 2 || argc == 3) {
+    return repack(argv[1], argc == 3 ? argv[2] : NULL);
+  }
+  fprintf(stderr, "usage: %s sim\n       %s <log.bin> [packed.bin]\n", argv[0], argv[0]);
+  return 1;
+}
@@ -0,0 +1,654 @@
+/**
+ * @file accel_psd.cpp
+ * @brief Welch PSD and spectrogram of the ADXL375 channels of a record log.
+ *
+ * Reads the ACCEL records of a log (any rate : 800 Hz decimated flight logs,
+ * 3200 Hz bench logs) over a time range, cuts them in windows of --nfft
+ * samples with --overlap, and computes per axis either
+ *
+ *  - the Welch PSD : mean of the windowed periodograms (default), or
+ *  - a spectrogram : one PSD column per --spectrogram K consecutive windows.
+ *
+ * PSD is one sided, g^2/Hz (--db : dB re 1 g^2/Hz), mean removed per window.
+ * Windows that would span a gap in the stamps (missed samples, more than
+ * half a period late) are not used; the window grid restarts after the gap.
+ *
+ * FFT : common/fft, mixed radix 4/2/3/5, so --nfft can be any 2^a 3^b 5^c
+ * (--resolution HZ picks the smallest such size). Two real windows go through
+ * one complex transform (x0 + i x1) and are split after. Work is cut in
+ * (axis, block of windows) tasks over --threads workers; Welch partial sums
+ * are reduced in task order, so the result does not depend on the thread count.
+ *
+ * Output, from the extension of the out path (default <log>_psd.csv or
+ * <log>_spectrogram.csv) :
+ * - .csv : Welch : freq_hz, x, y, z. Spectrogram : t_us, axis, one column per bin.
+ * - anything else, binary, little endian :
+ *
+ *   | "PSD1" | axes u32 | bins u32 | columns u32 | n_fft u32 | windows u32 | flags u32 | 0 u32 |
+ *   | rate_hz f64 | columns x t_us f64 | axes x columns x bins f32                              |
+ *
+ *   bin k is at k * rate_hz / n_fft Hz, windows is the windows per column (all
+ *   of them for Welch, columns = 1), t_us the MCU time of the column centre,
+ *   flags bit 0 : values in dB.
+ *
+ * --bench [minutes] runs on a synthetic 3200 Hz log (tones at 35, 180, 900 Hz,
+ * white noise, a few missed samples) written to a temporary file, and reports
+ * the time of each step, the tone amplitudes and noise floor recovered from the
+ * Welch PSD, and the FFT error against a double precision DFT.
+ *
+ * Usage :
+ *   accel_psd <SENSOR_DATA.bin> [out.csv | out.bin] [--from S] [--to S] [--nfft N | --resolution HZ]
+ *             [--overlap F] [--window hann|hamming|blackman|rect] [--spectrogram K] [--db] [--threads N]
+ *   accel_psd --bench [minutes] [--threads N] [--nfft N] [--tmp DIR]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "fft.h"
+#include "flight_log.h"
+#include "log_reader.h"
+#include "parallel.h"
+#include "resample.h"
+
+
+#define ADXL_G_PER_LSB 0.049
+#define AXES 3
+#define TASK_WINDOWS 64               // Windows per Welch task
+#define TASK_COLUMNS 16               // Columns per spectrogram task
+#define DEFAULT_NFFT 4096
+
+
+typedef enum { WIN_HANN = 0, WIN_HAMMING, WIN_BLACKMAN, WIN_RECT } WindowKind_t;
+static const char *WindowNames[] = { "hann", "hamming", "blackman", "rect" };
+
+typedef struct {
+  size_t nfft;
+  double overlap;             // Fraction of a window shared with the next one
+  WindowKind_t window;
+  size_t spectrogram;         // Windows per column, 0 for Welch
+  bool db;
+  int threads;
+  double from_s, to_s;        // Range relative to the first accel sample, to_s < 0 : to the end
+} Options_t;
+
+typedef struct {
+  std::vector<int64_t> t;
+  std::vector<float> x[AXES]; // g
+} Accel_t;
+
+typedef struct {
+  size_t bins;
+  double rate_hz;
+  size_t windows;             // Used
+  size_t gap_skips;           // Window grid restarts
+  std::vector<size_t> starts; // First sample of every window used
+  size_t columns;
+  size_t per_column;
+  std::vector<double> t_us;   // Column centres
+  std::vector<float> psd;     // [axis][column][bin]
+} Result_t;
+
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Input
+//--------------------------------------------------------------------------------------------
+static bool read_accel(const char *path, double from_s, double to_s, Accel_t *a) {
+  LogStream_t s;
+  if (!LOGREAD_stream_open(&s, path)) {
+    return false;
+  }
+  LOG_Record_t rec;
+  int64_t first = -1;
+  while (LOGREAD_stream_next(&s, &rec)) {
+    if (rec.type != LOG_REC_ACCEL || rec.len != sizeof(LOG_Accel_t)) continue;
+    int64_t t = (int64_t)rec.t_us;
+    if (first < 0) first = t;
+    double rel = (double)(t - first) * 1e-6;
+    if (rel < from_s) continue;
+    if (to_s >= 0.0 && rel > to_s) break;
+    LOG_Accel_t v;
+    memcpy(&v, rec.payload, sizeof(v));
+    a->t.push_back(t);
+    for (int i = 0; i < AXES; i++) a->x[i].push_back((float)(v.acc_raw[i] * ADXL_G_PER_LSB));
+  }
+  LOGREAD_stream_close(&s);
+  return true;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Windows
+//--------------------------------------------------------------------------------------------
+static void make_window(WindowKind_t kind, size_t n, std::vector<float> &w, double *power) {
+  w.resize(n);
+  *power = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    double c = 2.0 * M_PI * (double)i / (double)n;   // Periodic form, as used for spectra
+    double v = 1.0;
+    switch (kind) {
+      case WIN_HANN:     v = 0.5 - 0.5 * std::cos(c); break;
+      case WIN_HAMMING:  v = 0.54 - 0.46 * std::cos(c); break;
+      case WIN_BLACKMAN: v = 0.42 - 0.5 * std::cos(c) + 0.08 * std::cos(2.0 * c); break;
+      case WIN_RECT:     break;
+    }
+    w[i] = (float)v;
+    *power += v * v;
+  }
+}
+
+
+// Window starts on a hop grid that restarts after every gap in the stamps.
+static void place_windows(const Accel_t &a, size_t nfft, size_t hop, double period_us, Result_t *r) {
+  size_t n = a.t.size();
+  double max_step = 1.5 * period_us;
+  // Index of the first gap at or after i, n if none.
+  std::vector<size_t> next_gap(n + 1, n);
+  for (size_t i = n; i-- > 1;) {
+    next_gap[i - 1] = (double)(a.t[i] - a.t[i - 1]) > max_step ? i - 1 : next_gap[i];
+  }
+  size_t k = 0;
+  while (k + nfft <= n) {
+    size_t gap = next_gap[k];
+    if (gap < k + nfft - 1) {
+      k = gap + 1;           // Samples gap and gap + 1 are apart
+      r->gap_skips++;
+      continue;
+    }
+    r->starts.push_back(k);
+    k += hop;
+  }
+  r->windows = r->starts.size();
+}
+
+
+//--------------------------------------------------------------------------------------------
+// PSD
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  std::vector<float> re, im, work_re, work_im;
+} Scratch_t;
+
+
+// Add the periodograms |X|^2 of the windows starts[0 .. count-1] of one axis to acc.
+static void periodograms(const FFT_Plan_t *plan, const std::vector<float> &w, const float *x,
+                         const size_t *starts, size_t count, Scratch_t *s, double *acc) {
+  const size_t n = plan->n;
+  s->re.resize(n);
+  s->im.resize(n);
+  s->work_re.resize(n);
+  s->work_im.resize(n);
+  for (size_t j = 0; j < count; j += 2) {
+    // Two windows per transform : re the first, im the second (or zero).
+    bool pair = j + 1 < count;
+    const float *x0 = x + starts[j];
+    const float *x1 = pair ? x + starts[j + 1] : x0;
+    double m0 = 0.0, m1 = 0.0;
+    for (size_t i = 0; i < n; i++) {
+      m0 += x0[i];
+      m1 += x1[i];
+    }
+    float mean0 = (float)(m0 / n), mean1 = (float)(m1 / n);
+    float *__restrict re = s->re.data();
+    float *__restrict im = s->im.data();
+    const float *__restrict win = w.data();
+    for (size_t i = 0; i < n; i++) {
+      re[i] = (x0[i] - mean0) * win[i];
+      im[i] = pair ? (x1[i] - mean1) * win[i] : 0.0f;
+    }
+    FFT_forward(plan, re, im, s->work_re.data(), s->work_im.data());
+
+    // A[k] = (Z[k] + Z*[N-k]) / 2, B[k] = (Z[k] - Z*[N-k]) / 2i
+    for (size_t k = 0; k <= n / 2; k++) {
+      size_t m = k ? n - k : 0;
+      float sr = re[k] + re[m], si = im[k] - im[m];
+      float dr = re[k] - re[m], di = im[k] + im[m];
+      acc[k] += 0.25 * ((double)sr * sr + (double)si * si + (double)dr * dr + (double)di * di);
+    }
+  }
+}
+
+
+// Periodogram sums to one sided PSD in place (or dB).
+static void scale_psd(const double *acc, size_t bins, size_t nfft, double rate_hz, double power, size_t windows,
+                      bool db, float *out) {
+  double scale = 1.0 / (rate_hz * power * (double)windows);
+  for (size_t k = 0; k < bins; k++) {
+    bool single = k == 0 || (nfft % 2 == 0 && k == nfft / 2);
+    double psd = acc[k] * scale * (single ? 1.0 : 2.0);
+    out[k] = db ? (float)(10.0 * std::log10(psd > 0.0 ? psd : 1e-30)) : (float)psd;
+  }
+}
+
+
+static bool compute(const Accel_t &a, const Options_t &opt, Result_t *r) {
+  FFT_Plan_t plan;
+  if (!FFT_plan(&plan, opt.nfft)) {
+    fprintf(stderr, "--nfft %zu : size must be 2^a 3^b 5^c (try %zu)\n", opt.nfft, FFT_good_size(opt.nfft));
+    return false;
+  }
+  double period_us = RESAMPLE_nominal_period(a.t.data(), a.t.size());
+  if (!(period_us > 0.0)) {
+    fprintf(stderr, "not enough accel samples\n");
+    return false;
+  }
+  r->rate_hz = 1e6 / period_us;
+  r->bins = opt.nfft / 2 + 1;
+  size_t hop = (size_t)std::llround((double)opt.nfft * (1.0 - opt.overlap));
+  if (hop == 0) hop = 1;
+  place_windows(a, opt.nfft, hop, period_us, r);
+  if (!r->windows) {
+    fprintf(stderr, "no gap free window of %zu samples in the range\n", opt.nfft);
+    return false;
+  }
+
+  std::vector<float> w;
+  double power;
+  make_window(opt.window, opt.nfft, w, &power);
+  const size_t bins = r->bins;
+
+  r->per_column = opt.spectrogram ? opt.spectrogram : r->windows;
+  r->columns = r->windows / r->per_column;
+  if (!r->columns) {
+    fprintf(stderr, "fewer windows (%zu) than --spectrogram %zu\n", r->windows, opt.spectrogram);
+    return false;
+  }
+  r->psd.assign(AXES * r->columns * bins, 0.0f);
+  r->t_us.resize(r->columns);
+  for (size_t c = 0; c < r->columns; c++) {
+    size_t first = r->starts[c * r->per_column];
+    size_t last = r->starts[(c + 1) * r->per_column - 1] + opt.nfft - 1;
+    r->t_us[c] = 0.5 * ((double)a.t[first] + (double)a.t[last]);
+  }
+
+  if (opt.spectrogram) {
+    // (axis, block of columns) tasks, each writes its own columns.
+    size_t blocks = (r->columns + TASK_COLUMNS - 1) / TASK_COLUMNS;
+    PARALLEL_for(AXES * blocks, opt.threads, [&](size_t task) {
+      size_t axis = task / blocks, c0 = (task % blocks) * TASK_COLUMNS;
+      size_t c1 = std::min(r->columns, c0 + TASK_COLUMNS);
+      Scratch_t s;
+      std::vector<double> acc(bins);
+      for (size_t c = c0; c < c1; c++) {
+        std::fill(acc.begin(), acc.end(), 0.0);
+        periodograms(&plan, w, a.x[axis].data(), &r->starts[c * r->per_column], r->per_column, &s, acc.data());
+        scale_psd(acc.data(), bins, opt.nfft, r->rate_hz, power, r->per_column, opt.db,
+                  &r->psd[(axis * r->columns + c) * bins]);
+      }
+    });
+    return true;
+  }
+
+  // Welch : (axis, block of windows) partial sums, reduced in task order.
+  size_t blocks = (r->windows + TASK_WINDOWS - 1) / TASK_WINDOWS;
+  std::vector<double> partial(AXES * blocks * bins, 0.0);
+  PARALLEL_for(AXES * blocks, opt.threads, [&](size_t task) {
+    size_t axis = task / blocks, j0 = (task % blocks) * TASK_WINDOWS;
+    size_t count = std::min(r->windows - j0, (size_t)TASK_WINDOWS);
+    Scratch_t s;
+    periodograms(&plan, w, a.x[axis].data(), &r->starts[j0], count, &s, &partial[task * bins]);
+  });
+  for (size_t axis = 0; axis < AXES; axis++) {
+    std::vector<double> acc(bins, 0.0);
+    for (size_t b = 0; b < blocks; b++) {
+      const double *p = &partial[(axis * blocks + b) * bins];
+      for (size_t k = 0; k < bins; k++) acc[k] += p[k];
+    }
+    scale_psd(acc.data(), bins, opt.nfft, r->rate_hz, power, r->windows, opt.db, &r->psd[axis * bins]);
+  }
+  return true;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Output
+//--------------------------------------------------------------------------------------------
+static bool ends_with(const std::string &s, const char *suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+
+static bool write_csv(const char *path, const Options_t &opt, const Result_t &r) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  double bin_hz = r.rate_hz / (double)opt.nfft;
+  if (!opt.spectrogram) {
+    fprintf(f, "freq_hz,x,y,z\n");
+    for (size_t k = 0; k < r.bins; k++) {
+      fprintf(f, "%.4f", k * bin_hz);
+      for (int axis = 0; axis < AXES; axis++) fprintf(f, opt.db ? ",%.2f" : ",%.6e", r.psd[axis * r.bins + k]);
+      fprintf(f, "\n");
+    }
+  }
+  else {
+    fprintf(f, "t_us,axis");
+    for (size_t k = 0; k < r.bins; k++) fprintf(f, ",%g", k * bin_hz);
+    fprintf(f, "\n");
+    for (size_t c = 0; c < r.columns; c++) {
+      for (int axis = 0; axis < AXES; axis++) {
+        fprintf(f, "%.0f,%c", r.t_us[c], 'x' + axis);
+        const float *row = &r.psd[(axis * r.columns + c) * r.bins];
+        for (size_t k = 0; k < r.bins; k++) fprintf(f, opt.db ? ",%.2f" : ",%.6e", row[k]);
+        fprintf(f, "\n");
+      }
+    }
+  }
+  bool ok = !ferror(f);
+  fclose(f);
+  return ok;
+}
+
+
+static bool write_binary(const char *path, const Options_t &opt, const Result_t &r) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  uint32_t header[7] = { AXES, (uint32_t)r.bins, (uint32_t)r.columns, (uint32_t)opt.nfft,
+                         (uint32_t)r.per_column, opt.db ? 1u : 0u, 0u };
+  fwrite("PSD1", 1, 4, f);
+  fwrite(header, sizeof(header), 1, f);
+  fwrite(&r.rate_hz, sizeof(double), 1, f);
+  fwrite(r.t_us.data(), sizeof(double), r.columns, f);
+  fwrite(r.psd.data(), sizeof(float), r.psd.size(), f);
+  bool ok = !ferror(f);
+  fclose(f);
+  return ok;
+}
+
+
+static bool write_result(const char *path, const Options_t &opt, const Result_t &r) {
+  return ends_with(path, ".csv") ? write_csv(path, opt, r) : write_binary(path, opt, r);
+}
+
+
+// Band power of a linear Welch PSD, bins k0 .. k1.
+static double band_power(const Result_t &r, size_t nfft, int axis, size_t k0, size_t k1) {
+  double bin_hz = r.rate_hz / (double)nfft, sum = 0.0;
+  for (size_t k = k0; k <= k1 && k < r.bins; k++) sum += r.psd[axis * r.bins + k];
+  return sum * bin_hz;
+}
+
+
+// Rms and loudest bins per axis, Welch only.
+static void print_summary(const Options_t &opt, const Result_t &r) {
+  if (opt.spectrogram || opt.db) return;
+  double bin_hz = r.rate_hz / (double)opt.nfft;
+  for (int axis = 0; axis < AXES; axis++) {
+    const float *p = &r.psd[axis * r.bins];
+    std::vector<size_t> peaks;
+    for (size_t k = 2; k + 1 < r.bins; k++) {
+      if (p[k] > p[k - 1] && p[k] >= p[k + 1]) peaks.push_back(k);
+    }
+    std::sort(peaks.begin(), peaks.end(), [&](size_t a, size_t b) { return p[a] > p[b]; });
+    fprintf(stderr, "%c : rms %.3f g, peaks", 'x' + axis, std::sqrt(band_power(r, opt.nfft, axis, 1, r.bins - 1)));
+    for (size_t i = 0; i < peaks.size() && i < 3; i++) {
+      fprintf(stderr, " %.1f Hz (%.3g g^2/Hz)", peaks[i] * bin_hz, p[peaks[i]]);
+    }
+    fprintf(stderr, "\n");
+  }
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Bench
+//--------------------------------------------------------------------------------------------
+#define BENCH_ACCEL_HZ 3200.0
+#define BENCH_JITTER_US 3.0
+#define BENCH_MISS_RATE 1e-5
+#define BENCH_NOISE_G 0.2
+
+static const double BenchTone_hz[3] = { 35.0, 180.0, 900.0 };
+static const double BenchTone_g[3] = { 1.0, 2.0, 0.5 };
+
+
+// Synthetic record log : tones on X, Y = 0.5 X, Z = 1 g + noise only.
+static bool bench_log(const char *path, double minutes, size_t *samples) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  std::mt19937 rng(3200);
+  std::normal_distribution<double> jitter(0.0, BENCH_JITTER_US), noise(0.0, BENCH_NOISE_G);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  double period = 1e6 / BENCH_ACCEL_HZ;
+  size_t n = (size_t)(minutes * 60e6 / period);
+  std::vector<uint8_t> buf;
+  buf.reserve(1 << 20);
+  *samples = 0;
+  for (size_t k = 0; k < n; k++) {
+    if (u(rng) < BENCH_MISS_RATE) continue;
+    double t = 1e6 + (double)k * period;
+    double s = 0.0;
+    for (int i = 0; i < 3; i++) s += BenchTone_g[i] * std::sin(2.0 * M_PI * BenchTone_hz[i] * t * 1e-6 + i);
+    double g[AXES] = { s + noise(rng), 0.5 * s + noise(rng), 1.0 + noise(rng) };
+    LOG_Accel_t v;
+    for (int i = 0; i < AXES; i++) v.acc_raw[i] = (int16_t)std::lrint(g[i] / ADXL_G_PER_LSB);
+    uint8_t rec[LOG_OVERHEAD + sizeof(v)];
+    size_t len = LOG_encode(rec, LOG_REC_ACCEL, (uint64_t)std::llround(t + jitter(rng)), &v, sizeof(v));
+    buf.insert(buf.end(), rec, rec + len);
+    if (buf.size() >= (1 << 20)) {
+      fwrite(buf.data(), 1, buf.size(), f);
+      buf.clear();
+    }
+    (*samples)++;
+  }
+  fwrite(buf.data(), 1, buf.size(), f);
+  fclose(f);
+  return true;
+}
+
+
+// Max error of FFT_forward against a double DFT, relative to the output rms.
+static double fft_error(size_t n) {
+  FFT_Plan_t plan;
+  FFT_plan(&plan, n);
+  std::mt19937 rng((uint32_t)n);
+  std::normal_distribution<double> g(0.0, 1.0);
+  std::vector<float> re(n), im(n), wr(n), wi(n);
+  for (size_t i = 0; i < n; i++) {
+    re[i] = (float)g(rng);
+    im[i] = (float)g(rng);
+  }
+  std::vector<std::complex<double>> ref(n);
+  for (size_t k = 0; k < n; k++) {
+    for (size_t i = 0; i < n; i++) {
+      ref[k] += std::complex<double>(re[i], im[i]) * std::polar(1.0, -2.0 * M_PI * (double)((k * i) % n) / (double)n);
+    }
+  }
+  FFT_forward(&plan, re.data(), im.data(), wr.data(), wi.data());
+  double err = 0.0, sq = 0.0;
+  for (size_t k = 0; k < n; k++) {
+    err = std::max(err, std::abs(std::complex<double>(re[k], im[k]) - ref[k]));
+    sq += std::norm(ref[k]);
+  }
+  return err / std::sqrt(sq / (double)n);
+}
+
+
+static int run_bench(double minutes, Options_t opt, const char *tmp_dir) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/accel_psd.%d.bin", tmp_dir, (int)getpid());
+  size_t samples;
+  if (!bench_log(path, minutes, &samples)) {
+    return 1;
+  }
+  printf("synthetic log : %.0f min at %.0f Hz, %zu samples x 3 axes, nfft %zu, %s, threads %d\n\n", minutes,
+         BENCH_ACCEL_HZ, samples, opt.nfft, WindowNames[opt.window], opt.threads);
+
+  auto t0 = std::chrono::steady_clock::now();
+  Accel_t a;
+  bool ok = read_accel(path, 0.0, -1.0, &a);
+  double read_s = seconds_since(t0);
+  remove(path);
+  if (!ok) {
+    perror(path);
+    return 1;
+  }
+
+  printf("| Output            | Windows | Columns | Read (s) | PSD (s) | Total (s) | Msamples/s |\n");
+  printf("| ----------------- | ------- | ------- | -------- | ------- | --------- | ---------- |\n");
+  Result_t welch;
+  const size_t per_column[3] = { 0, 1, 8 };
+  for (size_t pc : per_column) {
+    opt.spectrogram = pc;
+    Result_t r = {};
+    auto t1 = std::chrono::steady_clock::now();
+    if (!compute(a, opt, &r)) return 1;
+    double psd_s = seconds_since(t1);
+    char name[48];
+    if (pc) snprintf(name, sizeof(name), "spectrogram K=%zu", pc);
+    else snprintf(name, sizeof(name), "Welch");
+    printf("| %-17s | %7zu | %7zu | %8.3f | %7.3f | %9.3f | %10.1f |\n", name, r.windows, r.columns, read_s, psd_s,
+           read_s + psd_s, AXES * a.t.size() / (read_s + psd_s) * 1e-6);
+    if (!pc) welch = r;
+  }
+
+  // Tone amplitude from the band power around each tone, noise floor from the Z axis.
+  printf("\n| Tone    | Amplitude (g) | Recovered (g) | Error    |\n");
+  printf("| ------- | ------------- | ------------- | -------- |\n");
+  double bin_hz = welch.rate_hz / (double)opt.nfft;
+  for (int i = 0; i < 3; i++) {
+    size_t k = (size_t)std::llround(BenchTone_hz[i] / bin_hz);
+    double amp = std::sqrt(2.0 * band_power(welch, opt.nfft, 0, k - 4, k + 4));
+    printf("| %4.0f Hz | %13.3f | %13.4f | %+7.2f%% |\n", BenchTone_hz[i], BenchTone_g[i], amp,
+           100.0 * (amp / BenchTone_g[i] - 1.0));
+  }
+  double q = ADXL_G_PER_LSB;
+  double expected = 2.0 * (BENCH_NOISE_G * BENCH_NOISE_G + q * q / 12.0) / welch.rate_hz;
+  std::vector<float> z(welch.psd.begin() + 2 * welch.bins + 1, welch.psd.begin() + 3 * welch.bins - 1);
+  std::nth_element(z.begin(), z.begin() + z.size() / 2, z.end());
+  printf("\nnoise floor (z, median bin) %.3e g^2/Hz, expected %.3e (%+.2f dB)\n", z[z.size() / 2], expected,
+         10.0 * std::log10(z[z.size() / 2] / expected));
+  printf("gap restarts %zu (%zu samples missed)\n", welch.gap_skips, (size_t)(minutes * 60.0 * BENCH_ACCEL_HZ) - samples);
+
+  printf("\n| FFT size | Stages | Max error / rms |\n");
+  printf("| -------- | ------ | --------------- |\n");
+  const size_t sizes[] = { 1000, 1024, 3200, 4096, 4500 };
+  for (size_t n : sizes) {
+    FFT_Plan_t plan;
+    FFT_plan(&plan, n);
+    printf("| %8zu | %6d | %15.2e |\n", n, plan.stages, fft_error(n));
+  }
+  return 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------------------------------
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s <SENSOR_DATA.bin> [out.csv | out.bin] [--from S] [--to S] [--nfft N | --resolution HZ]\n"
+          "          [--overlap F] [--window hann|hamming|blackman|rect] [--spectrogram K] [--db] [--threads N]\n"
+          "       %s --bench [minutes] [--threads N] [--nfft N] [--tmp DIR]\n", prog, prog);
+}
+
+
+int main(int argc, char **argv) {
+  const char *in_path = NULL;
+  const char *out_path = NULL;
+  const char *tmp_dir = "/tmp";
+  Options_t opt = { DEFAULT_NFFT, 0.5, WIN_HANN, 0, false, 0, 0.0, -1.0 };
+  double resolution = 0.0;
+  double bench_minutes = -1.0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--from") && i + 1 < argc) opt.from_s = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--to") && i + 1 < argc) opt.to_s = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--nfft") && i + 1 < argc) opt.nfft = (size_t)atol(argv[++i]);
+    else if (!strcmp(argv[i], "--resolution") && i + 1 < argc) resolution = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--overlap") && i + 1 < argc) opt.overlap = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--spectrogram") && i + 1 < argc) opt.spectrogram = (size_t)atol(argv[++i]);
+    else if (!strcmp(argv[i], "--db")) opt.db = true;
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc) opt.threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--tmp") && i + 1 < argc) tmp_dir = argv[++i];
+    else if (!strcmp(argv[i], "--window") && i + 1 < argc) {
+      const char *name = argv[++i];
+      int k = 0;
+      while (k <= WIN_RECT && strcmp(name, WindowNames[k])) k++;
+      if (k > WIN_RECT) { usage(argv[0]); return 1; }
+      opt.window = (WindowKind_t)k;
+    }
+    else if (!strcmp(argv[i], "--bench")) {
+      bench_minutes = 20.0;
+      if (i + 1 < argc && argv[i + 1][0] != '-') bench_minutes = atof(argv[++i]);
+    }
+    else if (!in_path) in_path = argv[i];
+    else if (!out_path) out_path = argv[i];
+    else { usage(argv[0]); return 1; }
+  }
+  opt.threads = PARALLEL_threads(opt.threads);
+  if (!(opt.overlap >= 0.0 && opt.overlap < 1.0)) {
+    fprintf(stderr, "--overlap : 0 <= F < 1\n");
+    return 1;
+  }
+
+  if (bench_minutes > 0.0) {
+    return run_bench(bench_minutes, opt, tmp_dir);
+  }
+  if (!in_path) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  Accel_t a;
+  if (!read_accel(in_path, opt.from_s, opt.to_s, &a)) {
+    perror(in_path);
+    return 1;
+  }
+  if (resolution > 0.0 && a.t.size() > 1) {
+    double rate_hz = 1e6 / RESAMPLE_nominal_period(a.t.data(), a.t.size());
+    opt.nfft = FFT_good_size((size_t)std::ceil(rate_hz / resolution));
+  }
+  double read_s = seconds_since(t0);
+
+  Result_t r = {};
+  t0 = std::chrono::steady_clock::now();
+  if (!compute(a, opt, &r)) {
+    return 1;
+  }
+  double psd_s = seconds_since(t0);
+
+  std::string out;
+  if (out_path) {
+    out = out_path;
+  }
+  else {
+    out = in_path;
+    size_t dot = out.find_last_of('.');
+    size_t slash = out.find_last_of('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) out.erase(dot);
+    out += opt.spectrogram ? "_spectrogram.csv" : "_psd.csv";
+  }
+  if (!write_result(out.c_str(), opt, r)) {
+    return 1;
+  }
+
+  fprintf(stderr, "%zu samples at %.1f Hz, nfft %zu (%.3f Hz bins), %s, %zu windows (%zu gap restarts), "
+          "%zu column%s -> %s\n", a.t.size(), r.rate_hz, opt.nfft, r.rate_hz / (double)opt.nfft,
+          WindowNames[opt.window], r.windows, r.gap_skips, r.columns, r.columns == 1 ? "" : "s", out.c_str());
+  print_summary(opt, r);
+  fprintf(stderr, "read %.3f s, psd %.3f s, %d threads\n", read_s, psd_s, opt.threads);
+  return 0;
+}
@@ -0,0 +1,267 @@
+/**
+ * @file apogee_bench.cpp
+ * @brief Apogee detection latency across the simulated flight library.
+ *
+ * Each flight is flown with several noise seeds through the same processing
+ * as the flight computer (Kalman filter, then the apogee detector fed with the
+ * filter output, baro altitude and GPS height). Latency is measured from the
+ * true apogee of the simulation to the moment the detector fires.
+ *
+ * Each run also writes what the firmware logs from the detector (APOGEE_run()
+ * in main.cpp) : a STATE record per baro sample, a LAUNCH EVENT when the
+ * detector leaves PAD and the APOGEE EVENT. The log is decoded back and
+ * checked : one LAUNCH, stamped between ignition and LAUNCH_MAX_MS after it,
+ * then one APOGEE. --log writes the first run's log, for log_extract
+ * --event launch.
+ *
+ * Usage :
+ *   apogee_bench [--seeds N] [--votes K] [--flight NAME] [--no-gps] [--log FILE]
+ *
+ * Reported per flight (milliseconds) :
+ * - fire latency : mean, min, p95, max over seeds
+ * - estimate error : Kalman peak time logged in the EVENT record minus true apogee
+ * - mean first vote latency of each detector (KF, baro, GPS)
+ * - ns per detector update on this host
+ * - mean LAUNCH event time after ignition, and the log check
+ *
+ * Exits 1 if a log check fails.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "altitude_kf.h"
+#include "apogee_detect.h"
+#include "baro_altitude.h"
+#include "flight_log.h"
+#include "flight_sim.h"
+#include "sim_pipeline.h"
+
+
+#define LAUNCH_MAX_MS 1000.0          // LAUNCH EVENT at most this long after ignition
+
+
+typedef struct {
+  bool fired;
+  double latency_ms;          // fire - true apogee
+  double estimate_ms;         // estimate - true apogee
+  double vote_ms[APOGEE_DETECTORS]; // NAN if the detector never voted
+  uint8_t votes;
+  double ns_per_update;
+  double launch_ms;           // LAUNCH EVENT - ignition, from the log
+  bool log_ok;
+} RunResult_t;
+
+
+static void log_record(std::vector<uint8_t> *log, uint8_t type, int64_t t_us, const void *payload, uint16_t len) {
+  uint8_t buf[LOG_OVERHEAD + sizeof(LOG_Event_t)];
+  size_t n = LOG_encode(buf, type, (uint64_t)t_us, payload, len);
+  log->insert(log->end(), buf, buf + n);
+}
+
+
+// As APOGEE_log_event() in main.cpp.
+static void log_event(std::vector<uint8_t> *log, uint8_t id, const APOGEE_Event_t *ev) {
+  LOG_Event_t rec;
+  rec.id = id;
+  rec.votes = ev->votes;
+  rec.t_fired_us = ev->t_fired_us;
+  rec.t_estimate_us = ev->t_estimate_us;
+  rec.altitude = ev->altitude;
+  for (int i = 0; i < APOGEE_DETECTORS; i++) {
+    rec.vote_offset_ms[i] = (ev->votes & (1 << i)) ? (int32_t)((ev->t_vote_us[i] - ev->t_fired_us) / 1000) : INT32_MIN;
+  }
+  log_record(log, LOG_REC_EVENT, ev->t_fired_us, &rec, sizeof(rec));
+}
+
+
+// The EVENT records read back : one LAUNCH stamped at its fire time within LAUNCH_MAX_MS of ignition, then one
+// APOGEE.
+static bool check_log(const SimFlight_t &f, const std::vector<uint8_t> &log, double *launch_ms) {
+  int launches = 0, apogees = 0;
+  bool ok = true;
+  *launch_ms = NAN;
+  for (size_t pos = 0; pos < log.size();) {
+    LOG_Record_t rec;
+    if (LOG_decode(log.data() + pos, log.size() - pos, &rec) != LOG_OK) {
+      return false;
+    }
+    pos += rec.size;
+    if (rec.type != LOG_REC_EVENT) continue;
+    LOG_Event_t ev;
+    memcpy(&ev, rec.payload, sizeof(ev));
+    if (ev.id == LOG_EVENT_LAUNCH) {
+      launches++;
+      *launch_ms = (rec.t_us * 1e-6 - f.launch_t) * 1e3;
+      ok = ok && (int64_t)rec.t_us == ev.t_fired_us && apogees == 0 && *launch_ms >= 0.0 &&
+           *launch_ms <= LAUNCH_MAX_MS;
+    }
+    else if (ev.id == LOG_EVENT_APOGEE) {
+      apogees++;
+    }
+  }
+  return ok && launches == 1 && apogees == 1;
+}
+
+
+static RunResult_t run_flight(const SimFlight_t &f, const std::vector<SimInput_t> &in,
+                              const APOGEE_Config_t &acfg, std::vector<uint8_t> *log) {
+  KF_Config_t kcfg;
+  KF_default_config(&kcfg);
+  KF_t kf;
+  KF_init(&kf, &kcfg, 0.0f);
+  APOGEE_t ad;
+  APOGEE_init(&ad, &acfg);
+
+  RunResult_t r;
+  r.fired = false;
+  r.latency_ms = r.estimate_ms = NAN;
+  r.votes = 0;
+  for (int i = 0; i < APOGEE_DETECTORS; i++) r.vote_ms[i] = NAN;
+  log->clear();
+
+  double last_t = in.empty() ? 0.0 : in[0].t;
+  double detector_ns = 0.0;
+  size_t detector_calls = 0;
+  for (const SimInput_t &k : in) {
+    int64_t t_us = (int64_t)llround(k.t * 1e6);
+    if (k.kind != SIM_INPUT_GPS) {
+      KF_predict(&kf, (float)(k.t - last_t));
+      last_t = k.t;
+      if (k.kind == SIM_INPUT_ACCEL) KF_update_accel(&kf, k.value);
+      else KF_update_baro(&kf, k.value);
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    if (k.kind == SIM_INPUT_GPS) {
+      APOGEE_update_gps(&ad, t_us, k.value);
+    }
+    else {
+      APOGEE_update_kf(&ad, t_us, kf.x[0], kf.x[1]);
+      if (k.kind == SIM_INPUT_BARO) APOGEE_update_baro(&ad, t_us, k.value, !kf.baro_locked);
+    }
+    APOGEE_Event_t launch;
+    bool launched = APOGEE_check_launch(&ad, &launch);
+    APOGEE_Event_t ev;
+    bool fired = APOGEE_check(&ad, t_us, &ev);
+    auto t1 = std::chrono::steady_clock::now();
+    detector_ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+    detector_calls++;
+
+    if (k.kind == SIM_INPUT_BARO) {
+      LOG_State_t st = { kf.x[0], kf.x[1], kf.x[2], (uint8_t)kf.baro_locked };
+      log_record(log, LOG_REC_STATE, t_us, &st, sizeof(st));
+    }
+    if (launched) log_event(log, LOG_EVENT_LAUNCH, &launch);
+    if (fired) log_event(log, LOG_EVENT_APOGEE, &ev);
+
+    if (fired) {
+      r.fired = true;
+      r.latency_ms = (k.t - f.apogee_t) * 1e3;
+      r.estimate_ms = (ev.t_estimate_us * 1e-6 - f.apogee_t) * 1e3;
+      r.votes = ev.votes;
+      for (int i = 0; i < APOGEE_DETECTORS; i++) {
+        if (ev.votes & (1 << i)) r.vote_ms[i] = (ev.t_vote_us[i] * 1e-6 - f.apogee_t) * 1e3;
+      }
+      break;
+    }
+  }
+  r.ns_per_update = detector_calls ? detector_ns / detector_calls : 0.0;
+  r.log_ok = check_log(f, *log, &r.launch_ms);
+  return r;
+}
+
+
+static double mean_of(const std::vector<double> &v) {
+  double s = 0.0;
+  size_t n = 0;
+  for (double x : v) {
+    if (!std::isnan(x)) {
+      s += x;
+      n++;
+    }
+  }
+  return n ? s / n : NAN;
+}
+
+
+int main(int argc, char **argv) {
+  int seeds = 20;
+  int votes = -1;
+  bool with_gps = true;
+  const char *only = NULL;
+  const char *log_path = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--seeds") && i + 1 < argc) seeds = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--votes") && i + 1 < argc) votes = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--flight") && i + 1 < argc) only = argv[++i];
+    else if (!strcmp(argv[i], "--no-gps")) with_gps = false;
+    else if (!strcmp(argv[i], "--log") && i + 1 < argc) log_path = argv[++i];
+    else {
+      fprintf(stderr, "usage: %s [--seeds N] [--votes K] [--flight NAME] [--no-gps] [--log FILE]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  BARO_init_table();
+  APOGEE_Config_t acfg;
+  APOGEE_default_config(&acfg);
+  if (votes >= 1 && votes <= 3) acfg.votes_required = (uint8_t)votes;
+
+  printf("votes required %u, %d seeds per flight, GPS %s\n", acfg.votes_required, seeds, with_gps ? "on" : "off");
+  printf("%-14s %5s %8s %8s %8s %8s %9s %8s %8s %8s %7s %8s %5s\n", "flight", "fired", "lat_mean", "lat_min",
+         "lat_p95", "lat_max", "est_err", "kf_vote", "baro_vt", "gps_vote", "ns/upd", "launch", "log");
+
+  int failures = 0;
+  std::vector<uint8_t> log;
+
+  for (const SimConfig_t &sc : FLIGHTSIM_library()) {
+    if (only && strcmp(only, sc.name)) continue;
+
+    std::vector<double> lat, est, vk, vb, vg, ns, launch;
+    int fired = 0, log_failed = 0;
+    for (int s = 1; s <= seeds; s++) {
+      SimFlight_t f = FLIGHTSIM_run(sc, (uint32_t)s);
+      std::vector<SimInput_t> in = SIMPIPE_build_inputs(f, with_gps);
+      RunResult_t r = run_flight(f, in, acfg, &log);
+      if (log_path) {
+        FILE *out = fopen(log_path, "wb");
+        if (!out || fwrite(log.data(), 1, log.size(), out) != log.size()) {
+          fprintf(stderr, "cannot write %s\n", log_path);
+          return 1;
+        }
+        fclose(out);
+        log_path = NULL;
+      }
+      log_failed += !r.log_ok;
+      launch.push_back(r.launch_ms);
+      if (!r.fired) continue;
+      fired++;
+      lat.push_back(r.latency_ms);
+      est.push_back(r.estimate_ms);
+      vk.push_back(r.vote_ms[0]);
+      vb.push_back(r.vote_ms[1]);
+      vg.push_back(r.vote_ms[2]);
+      ns.push_back(r.ns_per_update);
+    }
+    failures += log_failed;
+    if (lat.empty()) {
+      printf("%-14s %2d/%-2d never fired\n", sc.name, fired, seeds);
+      continue;
+    }
+    std::vector<double> sorted = lat;
+    std::sort(sorted.begin(), sorted.end());
+    double p95 = sorted[(size_t)std::min(sorted.size() - 1, (size_t)ceil(0.95 * sorted.size()) - 1)];
+    printf("%-14s %2d/%-2d %8.1f %8.1f %8.1f %8.1f %9.1f %8.1f %8.1f %8.1f %7.1f %8.1f %5s\n", sc.name, fired,
+           seeds, mean_of(lat), sorted.front(), p95, sorted.back(), mean_of(est),
+           mean_of(vk), mean_of(vb), mean_of(vg), mean_of(ns), mean_of(launch), log_failed ? "FAIL" : "ok");
+  }
+  printf("%s\n", failures ? "FAIL : LAUNCH / APOGEE events missing or out of place in the log" :
+                             "every log holds one LAUNCH after ignition, then one APOGEE");
+  return failures ? 1 : 0;
+}
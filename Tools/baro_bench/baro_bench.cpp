@@ -0,0 +1,135 @@
+/**
+ * @file baro_bench.cpp
+ * @brief Accuracy and speed of the pressure to altitude table against pow().
+ *
+ * Usage :
+ *   baro_bench [--samples N]
+ *
+ * Accuracy : every 0.05 Pa over 30 - 110 kPa, table (scalar and batch) against
+ * the double precision pow() reference. Also reports the error of the old
+ * "ratio to pad pressure" formula for a 1400 m pad, for comparison.
+ * The table must stay within BARO_BENCH_MAX_ERR of pow() and the batch form
+ * within BARO_BENCH_MAX_BATCH_DIFF of the scalar one, else the tool exits 1.
+ *
+ * Speed : ns/sample over N random pressures for
+ * - double pow() reference
+ * - float powf()
+ * - table, scalar call per sample
+ * - table, batch (auto-vectorised)
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "baro_altitude.h"
+
+
+#define BARO_BENCH_MAX_ERR 0.01           // m, table against pow() over the table range
+#define BARO_BENCH_MAX_BATCH_DIFF 1e-4    // m, batch against scalar (FMA contraction may round differently)
+
+
+template <typename F>
+static double time_ns_per_sample(size_t n, int reps, F fn) {
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < reps; r++) {
+    fn();
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / ((double)n * reps);
+}
+
+
+int main(int argc, char **argv) {
+  size_t n = 1 << 20;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--samples") && i + 1 < argc) n = (size_t)atol(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--samples N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  BARO_init_table();
+
+  // Accuracy sweep
+  double max_err = 0.0, max_err_p = 0.0, sum_sq = 0.0;
+  double max_batch_diff = 0.0;
+  size_t count = 0;
+  std::vector<float> sweep_p, sweep_h;
+  for (double p = BARO_TABLE_P_MIN; p <= BARO_TABLE_P_MAX; p += 0.05) {
+    sweep_p.push_back((float)p);
+  }
+  sweep_h.resize(sweep_p.size());
+  BARO_pressure_altitude_batch(sweep_p.data(), sweep_h.data(), sweep_p.size());
+  for (size_t k = 0; k < sweep_p.size(); k++) {
+    double ref = BARO_reference_altitude(sweep_p[k]);
+    double err = fabs((double)BARO_pressure_altitude(sweep_p[k]) - ref);
+    double bdiff = fabs((double)sweep_h[k] - (double)BARO_pressure_altitude(sweep_p[k]));
+    if (err > max_err) {
+      max_err = err;
+      max_err_p = sweep_p[k];
+    }
+    if (bdiff > max_batch_diff) max_batch_diff = bdiff;
+    sum_sq += err * err;
+    count++;
+  }
+  printf("Accuracy over %.0f - %.0f Pa (%zu points, %d segments)\n",
+         BARO_TABLE_P_MIN, BARO_TABLE_P_MAX, count, BARO_TABLE_SEGMENTS);
+  bool err_ok = max_err < BARO_BENCH_MAX_ERR;
+  bool batch_ok = max_batch_diff <= BARO_BENCH_MAX_BATCH_DIFF;
+  printf("  table vs pow  : max %.4f m at %.0f Pa, rms %.4f m  %s\n", max_err, max_err_p,
+         sqrt(sum_sq / count), err_ok ? "PASS" : "FAIL");
+  printf("  batch vs scalar : max %.6f m  %s\n", max_batch_diff, batch_ok ? "PASS" : "FAIL");
+
+  // Old ratio formula error for a high pad, 0 - 3000 m above it.
+  double pad = BARO_reference_altitude(85600.0);
+  double ratio_err = 0.0;
+  for (double p = 85600.0; p > 60000.0; p -= 10.0) {
+    double exact = BARO_reference_altitude(p) - pad;
+    double ratio = 44330.0 * (1.0 - pow(p / 85600.0, 0.1903));
+    if (fabs(ratio - exact) > ratio_err) ratio_err = fabs(ratio - exact);
+  }
+  printf("  ratio-to-pad formula, %.0f m pad : max %.2f m\n", pad, ratio_err);
+
+  // Speed
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> dist(30000.0f, 110000.0f);
+  std::vector<float> p(n), h(n);
+  std::vector<double> hd(n);
+  for (size_t k = 0; k < n; k++) p[k] = dist(rng);
+  const int reps = 10;
+
+  double ns_pow = time_ns_per_sample(n, reps, [&]() {
+    for (size_t k = 0; k < n; k++) hd[k] = BARO_reference_altitude(p[k]);
+  });
+  double ns_powf = time_ns_per_sample(n, reps, [&]() {
+    for (size_t k = 0; k < n; k++) h[k] = 44330.0f * (1.0f - powf(p[k] * (1.0f / 101325.0f), 0.1903f));
+  });
+  double ns_scalar = time_ns_per_sample(n, reps, [&]() {
+    for (size_t k = 0; k < n; k++) h[k] = BARO_pressure_altitude(p[k]);
+  });
+  double ns_batch = time_ns_per_sample(n, reps, [&]() {
+    BARO_pressure_altitude_batch(p.data(), h.data(), n);
+  });
+
+  double checksum = 0.0;
+  for (size_t k = 0; k < n; k += 4096) checksum += h[k] + hd[k];
+
+  printf("Speed over %zu samples (checksum %.1f)\n", n, checksum);
+  printf("  pow (double)  : %6.2f ns/sample\n", ns_pow);
+  printf("  powf (float)  : %6.2f ns/sample\n", ns_powf);
+  printf("  table scalar  : %6.2f ns/sample\n", ns_scalar);
+  printf("  table batch   : %6.2f ns/sample  (%.1fx vs pow)\n", ns_batch, ns_pow / ns_batch);
+
+  if (!err_ok || !batch_ok) {
+    printf("accuracy checks FAILED\n");
+    return 1;
+  }
+  printf("accuracy checks passed\n");
+  return 0;
+}
@@ -0,0 +1,464 @@
+/**
+ * @file fat_image.cpp
+ * @brief FAT32 volume on a mock SD card, written the way FatFs writes it.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include "fat_image.h"
+
+
+#define FAT_EOC 0x0FFFFFFFu
+#define FAT_RESERVED_SECTORS 32
+#define DIR_ENTRY 32
+
+
+static void wr16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+
+static void wr32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+
+static uint32_t rd32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+static bool write_sector(FatImage_t *v, uint32_t lba, const uint8_t *buf) {
+  return MOCKSD_write(v->sd, (uint64_t)lba * MOCKSD_SECTOR, buf, MOCKSD_SECTOR);
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Window and FAT
+//--------------------------------------------------------------------------------------------
+// Written back to both FATs when it holds a FAT sector.
+static bool sync_window(FatImage_t *v) {
+  if (!v->win_dirty) {
+    return true;
+  }
+  if (!write_sector(v, v->win_lba, v->win)) {
+    return false;
+  }
+  v->meta_writes++;
+  if (v->win_lba - v->fat_lba < v->fat_sectors) {
+    if (!write_sector(v, v->win_lba + v->fat_sectors, v->win)) {
+      return false;
+    }
+    v->meta_writes++;
+  }
+  v->win_dirty = false;
+  return true;
+}
+
+
+static bool move_window(FatImage_t *v, uint32_t lba) {
+  if (lba == v->win_lba) {
+    return true;
+  }
+  if (!sync_window(v)) {
+    return false;
+  }
+  v->win_lba = UINT32_MAX;
+  if (!MOCKSD_read(v->sd, (uint64_t)lba * MOCKSD_SECTOR, v->win, MOCKSD_SECTOR)) {
+    return false;
+  }
+  v->meta_reads++;
+  v->win_lba = lba;
+  return true;
+}
+
+
+static bool get_fat(FatImage_t *v, uint32_t cluster, uint32_t *value) {
+  if (!move_window(v, v->fat_lba + cluster / (MOCKSD_SECTOR / 4))) {
+    return false;
+  }
+  *value = rd32(v->win + cluster % (MOCKSD_SECTOR / 4) * 4) & 0x0FFFFFFF;
+  return true;
+}
+
+
+static bool put_fat(FatImage_t *v, uint32_t cluster, uint32_t value) {
+  if (!move_window(v, v->fat_lba + cluster / (MOCKSD_SECTOR / 4))) {
+    return false;
+  }
+  uint8_t *p = v->win + cluster % (MOCKSD_SECTOR / 4) * 4;
+  wr32(p, (rd32(p) & 0xF0000000) | (value & 0x0FFFFFFF));
+  v->win_dirty = true;
+  return true;
+}
+
+
+// Next cluster of a chain, allocating one if the chain ends there; cluster 0
+// starts a new chain. 0 if the card is full or on an error.
+static uint32_t create_chain(FatImage_t *v, uint32_t cluster) {
+  uint32_t start;
+  if (cluster == 0) {
+    start = v->last_cluster >= 2 && v->last_cluster < v->clusters + 2 ? v->last_cluster : 1;
+  } else {
+    uint32_t next;
+    if (!get_fat(v, cluster, &next)) return 0;
+    if (next >= 2 && next < v->clusters + 2) return next;
+    start = cluster;
+  }
+
+  uint32_t c = start;
+  for (;;) {
+    c++;
+    if (c >= v->clusters + 2) {
+      c = 2;
+      if (c > start) return 0;
+    }
+    uint32_t value;
+    if (!get_fat(v, c, &value)) return 0;
+    if (value == 0) break;
+    if (c == start) return 0;
+  }
+  if (!put_fat(v, c, FAT_EOC) || (cluster && !put_fat(v, cluster, c))) {
+    return 0;
+  }
+  v->last_cluster = c;
+  v->free_clusters--;
+  v->fsinfo_dirty = true;
+  return c;
+}
+
+
+uint32_t FATIMG_cluster_lba(const FatImage_t *v, uint32_t cluster) {
+  return v->data_lba + (cluster - 2) * v->cluster_sectors;
+}
+
+
+// FSInfo is rebuilt in the window and written, as FatFs does.
+static bool sync_fs(FatImage_t *v) {
+  if (!sync_window(v)) {
+    return false;
+  }
+  if (v->fsinfo_dirty) {
+    memset(v->win, 0, MOCKSD_SECTOR);
+    wr32(v->win, 0x41615252);
+    wr32(v->win + 484, 0x61417272);
+    wr32(v->win + 488, v->free_clusters);
+    wr32(v->win + 492, v->last_cluster);
+    wr32(v->win + 508, 0xAA550000);
+    v->win_lba = v->fsinfo_lba;
+    if (!write_sector(v, v->win_lba, v->win)) {
+      return false;
+    }
+    v->meta_writes++;
+    v->fsinfo_dirty = false;
+  }
+  return true;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Volume
+//--------------------------------------------------------------------------------------------
+bool FATIMG_format(FatImage_t *v, MockSd_t *sd, uint32_t cluster_bytes) {
+  memset(v, 0, sizeof(*v));
+  v->sd = sd;
+  v->win_lba = UINT32_MAX;
+  uint32_t total = (uint32_t)(sd->size / MOCKSD_SECTOR) - FATIMG_PART_LBA;
+  v->cluster_sectors = cluster_bytes / MOCKSD_SECTOR;
+  v->fat_sectors = (((total - FAT_RESERVED_SECTORS) / v->cluster_sectors + 2) * 4 + MOCKSD_SECTOR - 1) / MOCKSD_SECTOR;
+  v->fat_lba = FATIMG_PART_LBA + FAT_RESERVED_SECTORS;
+  v->fsinfo_lba = FATIMG_PART_LBA + 1;
+  v->data_lba = v->fat_lba + 2 * v->fat_sectors;
+  v->clusters = (FATIMG_PART_LBA + total - v->data_lba) / v->cluster_sectors;
+  v->root_cluster = 2;
+  if (v->clusters < 65525) {
+    return false;
+  }
+
+  uint8_t s[MOCKSD_SECTOR];
+  memset(s, 0, sizeof(s));
+  uint8_t *e = s + 446;
+  e[4] = 0x0C;
+  wr32(e + 8, FATIMG_PART_LBA);
+  wr32(e + 12, total);
+  s[510] = 0x55;
+  s[511] = 0xAA;
+  if (!write_sector(v, 0, s)) return false;
+
+  memset(s, 0, sizeof(s));
+  memcpy(s, "\xEB\x58\x90MSDOS5.0", 11);
+  wr16(s + 11, MOCKSD_SECTOR);
+  s[13] = (uint8_t)v->cluster_sectors;
+  wr16(s + 14, FAT_RESERVED_SECTORS);
+  s[16] = 2;
+  s[21] = 0xF8;
+  wr16(s + 24, 63);
+  wr16(s + 26, 255);
+  wr32(s + 28, FATIMG_PART_LBA);
+  wr32(s + 32, total);
+  wr32(s + 36, v->fat_sectors);
+  wr32(s + 44, v->root_cluster);
+  wr16(s + 48, 1);
+  wr16(s + 50, 6);
+  s[64] = 0x80;
+  s[66] = 0x29;
+  wr32(s + 67, 0x20250119);
+  memcpy(s + 71, "NO NAME    FAT32   ", 19);
+  s[510] = 0x55;
+  s[511] = 0xAA;
+  if (!write_sector(v, FATIMG_PART_LBA, s) || !write_sector(v, FATIMG_PART_LBA + 6, s)) return false;
+
+  // Both FATs : media, clean shutdown, root directory chain. The rest reads as zeros (free).
+  memset(s, 0, sizeof(s));
+  wr32(s, 0x0FFFFFF8);
+  wr32(s + 4, 0x0FFFFFFF);
+  wr32(s + 8, FAT_EOC);
+  if (!write_sector(v, v->fat_lba, s) || !write_sector(v, v->fat_lba + v->fat_sectors, s)) return false;
+  memset(s, 0, sizeof(s));
+  for (uint32_t i = 0; i < v->cluster_sectors; i++) {
+    if (!write_sector(v, FATIMG_cluster_lba(v, v->root_cluster) + i, s)) return false;
+  }
+  v->last_cluster = v->root_cluster;
+  v->free_clusters = v->clusters - 1;
+  v->fsinfo_dirty = true;
+  return sync_fs(v);
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Files
+//--------------------------------------------------------------------------------------------
+static uint8_t short_name_sum(const uint8_t *e) {
+  uint8_t sum = 0;
+  for (int i = 0; i < 11; i++) sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + e[i]);
+  return sum;
+}
+
+
+// "NAME~N  EXT" from a long name : alphanumerics of the stem and extension, upper case.
+static void make_short_name(const char *name, int n, uint8_t *out) {
+  memset(out, ' ', 11);
+  const char *dot = strrchr(name, '.');
+  int len = 0;
+  for (const char *p = name; *p && p != dot && len < 6; p++) {
+    if (isalnum((unsigned char)*p)) out[len++] = (uint8_t)toupper((unsigned char)*p);
+  }
+  out[len++] = '~';
+  out[len] = (uint8_t)('0' + n);
+  len = 8;
+  for (const char *p = dot ? dot + 1 : ""; *p && len < 11; p++) {
+    if (isalnum((unsigned char)*p)) out[len++] = (uint8_t)toupper((unsigned char)*p);
+  }
+}
+
+
+// Directory entry i of the root directory (first cluster only) into the window.
+static uint8_t *root_entry(FatImage_t *v, uint32_t i, uint32_t *lba) {
+  *lba = FATIMG_cluster_lba(v, v->root_cluster) + i * DIR_ENTRY / MOCKSD_SECTOR;
+  if (!move_window(v, *lba)) {
+    return NULL;
+  }
+  return v->win + i * DIR_ENTRY % MOCKSD_SECTOR;
+}
+
+
+bool FATIMG_create(FatImage_t *v, const char *name, FatFile_t *f) {
+  memset(f, 0, sizeof(*f));
+  f->buf_lba = UINT32_MAX;
+  if (name[0] == '/') name++;
+
+  uint32_t max = v->cluster_sectors * MOCKSD_SECTOR / DIR_ENTRY;
+  uint32_t at = 0, files = 0, lba;
+  for (; at < max; at++) {
+    uint8_t *e = root_entry(v, at, &lba);
+    if (!e) return false;
+    if (e[0] == 0) break;
+    files += e[11] != 0x0F;
+  }
+  int chars = (int)strlen(name);
+  uint32_t lfn = (uint32_t)(chars + 12) / 13;
+  if (chars > 255 || at + lfn + 1 >= max) {
+    return false;
+  }
+
+  uint8_t sn[11];
+  make_short_name(name, (int)(files % 9) + 1, sn);
+  uint8_t sum = short_name_sum(sn);
+  static const uint8_t pos[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+  for (uint32_t k = 0; k < lfn; k++) {
+    uint32_t ord = lfn - k;
+    uint8_t *e = root_entry(v, at + k, &lba);
+    if (!e) return false;
+    memset(e, 0, DIR_ENTRY);
+    e[0] = (uint8_t)(ord | (k == 0 ? 0x40 : 0));
+    e[11] = 0x0F;
+    e[13] = sum;
+    for (int i = 0; i < 13; i++) {
+      int c = (int)(ord - 1) * 13 + i;
+      wr16(e + pos[i], c < chars ? (uint16_t)(uint8_t)name[c] : c == chars ? 0x0000 : 0xFFFF);
+    }
+    v->win_dirty = true;
+  }
+  uint8_t *e = root_entry(v, at + lfn, &lba);
+  if (!e) return false;
+  memset(e, 0, DIR_ENTRY);
+  memcpy(e, sn, 11);
+  e[11] = 0x20;
+  v->win_dirty = true;
+  f->dir_lba = lba;
+  f->dir_offset = (at + lfn) * DIR_ENTRY % MOCKSD_SECTOR;
+  return sync_window(v);
+}
+
+
+static bool flush_buffer(FatImage_t *v, FatFile_t *f) {
+  if (!f->buf_dirty) {
+    return true;
+  }
+  if (!write_sector(v, f->buf_lba, f->buf)) {
+    return false;
+  }
+  f->buf_dirty = false;
+  return true;
+}
+
+
+bool FATIMG_seek(FatImage_t *v, FatFile_t *f, uint32_t offset) {
+  uint32_t bcs = v->cluster_sectors * MOCKSD_SECTOR;
+  uint32_t ifptr = f->fptr;
+  uint32_t nsect = 0;
+  f->fptr = 0;
+  if (offset > 0) {
+    uint32_t cluster;
+    if (ifptr > 0 && (offset - 1) / bcs >= (ifptr - 1) / bcs) {
+      f->fptr = (ifptr - 1) & ~(bcs - 1);
+      offset -= f->fptr;
+      cluster = f->cluster;
+    } else {
+      cluster = f->first_cluster;
+      if (cluster == 0) {
+        cluster = create_chain(v, 0);
+        if (!cluster) return false;
+        f->first_cluster = cluster;
+      }
+      f->cluster = cluster;
+    }
+    while (offset > bcs) {
+      offset -= bcs;
+      f->fptr += bcs;
+      cluster = create_chain(v, cluster);
+      if (!cluster) return false;
+      f->cluster = cluster;
+    }
+    f->fptr += offset;
+    if (offset % MOCKSD_SECTOR) nsect = FATIMG_cluster_lba(v, cluster) + offset / MOCKSD_SECTOR;
+  }
+  if (f->fptr > f->size) {
+    f->size = f->fptr;
+    f->modified = true;
+  }
+  if (f->fptr % MOCKSD_SECTOR && nsect != f->buf_lba) {
+    if (!flush_buffer(v, f)) return false;
+    f->buf_lba = UINT32_MAX;
+    if (!MOCKSD_read(v->sd, (uint64_t)nsect * MOCKSD_SECTOR, f->buf, MOCKSD_SECTOR)) return false;
+    f->buf_lba = nsect;
+  }
+  return true;
+}
+
+
+bool FATIMG_write(FatImage_t *v, FatFile_t *f, const void *data, size_t n) {
+  const uint8_t *in = (const uint8_t *)data;
+  while (n > 0) {
+    uint32_t in_sector = f->fptr % MOCKSD_SECTOR;
+    uint32_t csect = f->fptr / MOCKSD_SECTOR % v->cluster_sectors;
+    if (in_sector == 0 && csect == 0) {
+      uint32_t cluster;
+      if (f->fptr == 0) {
+        cluster = f->first_cluster ? f->first_cluster : create_chain(v, 0);
+      } else {
+        cluster = create_chain(v, f->cluster);
+      }
+      if (!cluster) return false;
+      if (!f->first_cluster) f->first_cluster = cluster;
+      f->cluster = cluster;
+    }
+    uint32_t sect = FATIMG_cluster_lba(v, f->cluster) + csect;
+
+    // Whole sectors straight to the card, up to the end of the cluster.
+    if (in_sector == 0 && n >= MOCKSD_SECTOR) {
+      uint32_t cc = std::min((uint32_t)(n / MOCKSD_SECTOR), v->cluster_sectors - csect);
+      if (!flush_buffer(v, f)) return false;
+      if (!MOCKSD_write(v->sd, (uint64_t)sect * MOCKSD_SECTOR, in, (size_t)cc * MOCKSD_SECTOR)) return false;
+      if (f->buf_lba - sect < cc) {
+        memcpy(f->buf, in + (f->buf_lba - sect) * MOCKSD_SECTOR, MOCKSD_SECTOR);
+      }
+      in += cc * MOCKSD_SECTOR;
+      n -= cc * MOCKSD_SECTOR;
+      f->fptr += cc * MOCKSD_SECTOR;
+    } else {
+      if (f->buf_lba != sect) {
+        if (!flush_buffer(v, f)) return false;
+        f->buf_lba = UINT32_MAX;
+        if (f->fptr < f->size) {
+          if (!MOCKSD_read(v->sd, (uint64_t)sect * MOCKSD_SECTOR, f->buf, MOCKSD_SECTOR)) return false;
+        } else {
+          memset(f->buf, 0, MOCKSD_SECTOR);
+        }
+        f->buf_lba = sect;
+      }
+      uint32_t take = std::min((uint32_t)n, MOCKSD_SECTOR - in_sector);
+      memcpy(f->buf + in_sector, in, take);
+      f->buf_dirty = true;
+      in += take;
+      n -= take;
+      f->fptr += take;
+    }
+    f->size = std::max(f->size, f->fptr);
+    f->modified = true;
+  }
+  return true;
+}
+
+
+bool FATIMG_sync(FatImage_t *v, FatFile_t *f) {
+  if (f->modified) {
+    if (!flush_buffer(v, f) || !move_window(v, f->dir_lba)) {
+      return false;
+    }
+    uint8_t *e = v->win + f->dir_offset;
+    wr16(e + 20, (uint16_t)(f->first_cluster >> 16));
+    wr16(e + 26, (uint16_t)f->first_cluster);
+    wr32(e + 28, f->size);
+    v->win_dirty = true;
+    f->modified = false;
+  }
+  return sync_fs(v);
+}
+
+
+bool FATIMG_read(FatImage_t *v, const FatFile_t *f, uint32_t offset, void *buf, size_t n) {
+  if ((uint64_t)offset + n > f->size) {
+    return false;
+  }
+  uint32_t bcs = v->cluster_sectors * MOCKSD_SECTOR;
+  uint32_t cluster = f->first_cluster;
+  for (uint32_t i = 0; i < offset / bcs; i++) {
+    if (!get_fat(v, cluster, &cluster) || cluster < 2) return false;
+  }
+  uint8_t *out = (uint8_t *)buf;
+  while (n > 0) {
+    uint32_t at = offset % bcs;
+    size_t take = std::min(n, (size_t)(bcs - at));
+    uint64_t byte = (uint64_t)FATIMG_cluster_lba(v, cluster) * MOCKSD_SECTOR + at;
+    if (!MOCKSD_read(v->sd, byte, out, take)) return false;
+    out += take;
+    offset += (uint32_t)take;
+    n -= take;
+    if (n > 0 && (!get_fat(v, cluster, &cluster) || cluster < 2)) return false;
+  }
+  return true;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file fat_image.h
+ * @brief FAT32 volume on a mock SD card, written the way FatFs writes it.
+ *
+ * Just enough of a FAT32 file system to time what the flight computer's
+ * file writes cost on the card (common/mock_sd.h) : the ESP32 SD library
+ * runs FatFs, and this follows its write path sector for sector :
+ *
+ * - One 512 byte window caches the FAT, directory or FSInfo sector being
+ *   worked on; it is written back (FAT sectors to both FATs) before another
+ *   sector is loaded, and on sync.
+ * - Each file has a one sector buffer for partial sector writes; whole
+ *   sectors go straight to the card, one write per run inside a cluster.
+ * - Clusters are allocated as writes or a seek past the end reach them,
+ *   searching the FAT forward from the last one allocated.
+ * - Sync writes the file buffer, the window, the directory entry (size,
+ *   first cluster) and, after an allocation, the FSInfo sector.
+ *
+ * Layout as an SD card comes : MBR, one FAT32 partition from sector 8192,
+ * 32 reserved sectors, two FATs, root directory in cluster 2. Files live in
+ * the root directory (long names), nothing is ever deleted.
+ */
+
+#ifndef FAT_IMAGE_H
+#define FAT_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mock_sd.h"
+
+
+#define FATIMG_PART_LBA 8192           // Partition start, 4 MB aligned
+
+typedef struct {
+  MockSd_t *sd;
+  uint32_t fat_lba;
+  uint32_t fat_sectors;               // Per FAT
+  uint32_t fsinfo_lba;
+  uint32_t data_lba;                  // Cluster 2
+  uint32_t cluster_sectors;
+  uint32_t clusters;
+  uint32_t root_cluster;
+
+  uint8_t win[MOCKSD_SECTOR];
+  uint32_t win_lba;                   // UINT32_MAX : empty
+  bool win_dirty;
+  uint32_t last_cluster;              // Allocation search starts after it
+  uint32_t free_clusters;
+  bool fsinfo_dirty;
+  uint64_t meta_writes;               // Sector writes to the FATs, directory and FSInfo
+  uint64_t meta_reads;
+} FatImage_t;
+
+typedef struct {
+  uint32_t dir_lba;                   // Directory entry
+  uint32_t dir_offset;
+  uint32_t first_cluster;             // 0 : no cluster yet
+  uint32_t size;
+  uint32_t fptr;
+  uint32_t cluster;                   // Cluster holding byte fptr - 1
+  uint8_t buf[MOCKSD_SECTOR];
+  uint32_t buf_lba;                   // UINT32_MAX : empty
+  bool buf_dirty;
+  bool modified;
+} FatFile_t;
+
+
+/**
+ * @brief Format the whole card, cluster_bytes per cluster (a power of two, 512 to 64 KB).
+ */
+bool FATIMG_format(FatImage_t *v, MockSd_t *sd, uint32_t cluster_bytes);
+
+/**
+ * @brief Create an empty file in the root directory, a leading '/' is ignored.
+ */
+bool FATIMG_create(FatImage_t *v, const char *name, FatFile_t *f);
+
+/**
+ * @brief Move the file pointer; past the end the file is extended, clusters and all.
+ */
+bool FATIMG_seek(FatImage_t *v, FatFile_t *f, uint32_t offset);
+
+bool FATIMG_write(FatImage_t *v, FatFile_t *f, const void *data, size_t n);
+
+/**
+ * @brief Put the file on the card : buffer, FAT, directory entry, FSInfo.
+ */
+bool FATIMG_sync(FatImage_t *v, FatFile_t *f);
+
+/**
+ * @brief Read the file through its cluster chain, as a PC would. Does not move fptr.
+ */
+bool FATIMG_read(FatImage_t *v, const FatFile_t *f, uint32_t offset, void *buf, size_t n);
+
+/**
+ * @brief Card sector of a cluster.
+ */
+uint32_t FATIMG_cluster_lba(const FatImage_t *v, uint32_t cluster);
+
+#endif /* FAT_IMAGE_H */
@@ -0,0 +1,205 @@
+/**
+ * @file fft.cpp
+ * @brief Mixed radix complex FFT (radix 4, 2, 3, 5) for the host analysis tools.
+ *
+ * A stage over sub-transforms of length L = r m at stride s (N = L s) does,
+ * for every p < m and q < s :
+ *
+ *   a_t = x[q + s (p + t m)]                       t = 0 .. r - 1
+ *   y[q + s (r p + u)] = w_L^(p u) sum_t a_t w_r^(t u)
+ *
+ * then the next stage runs on y with L / r and s r.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#include "fft.h"
+
+
+bool FFT_plan(FFT_Plan_t *plan, size_t n) {
+  plan->n = n;
+  plan->stages = 0;
+  plan->tw_re.clear();
+  plan->tw_im.clear();
+  if (n == 0) {
+    return false;
+  }
+
+  // Radix 4 while it divides, then 2, 3, 5.
+  size_t left = n;
+  static const int order[4] = { 4, 2, 3, 5 };
+  for (int r : order) {
+    while (left % r == 0 && plan->stages < FFT_MAX_STAGES) {
+      plan->radix[plan->stages++] = r;
+      left /= r;
+    }
+  }
+  if (left != 1) {
+    return false;
+  }
+
+  size_t L = n;
+  for (int st = 0; st < plan->stages; st++) {
+    int r = plan->radix[st];
+    size_t m = L / r;
+    plan->tw_offset[st] = plan->tw_re.size();
+    for (int u = 1; u < r; u++) {
+      for (size_t p = 0; p < m; p++) {
+        double a = -2.0 * M_PI * (double)(p * u) / (double)L;
+        plan->tw_re.push_back((float)std::cos(a));
+        plan->tw_im.push_back((float)std::sin(a));
+      }
+    }
+    L = m;
+  }
+  return true;
+}
+
+
+size_t FFT_good_size(size_t n) {
+  for (size_t k = n ? n : 1;; k++) {
+    size_t left = k;
+    while (left % 2 == 0) left /= 2;
+    while (left % 3 == 0) left /= 3;
+    while (left % 5 == 0) left /= 5;
+    if (left == 1) return k;
+  }
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Butterflies, in place r point DFT of a[0 .. r-1]
+//--------------------------------------------------------------------------------------------
+template <int R> static inline void butterfly(float *ar, float *ai);
+
+template <> inline void butterfly<2>(float *ar, float *ai) {
+  float r0 = ar[0] + ar[1], i0 = ai[0] + ai[1];
+  ar[1] = ar[0] - ar[1];
+  ai[1] = ai[0] - ai[1];
+  ar[0] = r0;
+  ai[0] = i0;
+}
+
+template <> inline void butterfly<4>(float *ar, float *ai) {
+  float t0r = ar[0] + ar[2], t0i = ai[0] + ai[2];
+  float t1r = ar[0] - ar[2], t1i = ai[0] - ai[2];
+  float t2r = ar[1] + ar[3], t2i = ai[1] + ai[3];
+  float t3r = ar[1] - ar[3], t3i = ai[1] - ai[3];
+  ar[0] = t0r + t2r; ai[0] = t0i + t2i;
+  ar[2] = t0r - t2r; ai[2] = t0i - t2i;
+  ar[1] = t1r + t3i; ai[1] = t1i - t3r;    // t1 - i t3
+  ar[3] = t1r - t3i; ai[3] = t1i + t3r;    // t1 + i t3
+}
+
+template <> inline void butterfly<3>(float *ar, float *ai) {
+  const float h = 0.86602540378443865f;  // sin(2 pi / 3)
+  float t1r = ar[1] + ar[2], t1i = ai[1] + ai[2];
+  float t2r = ar[1] - ar[2], t2i = ai[1] - ai[2];
+  float mr = ar[0] - 0.5f * t1r, mi = ai[0] - 0.5f * t1i;
+  float nr = h * t2i, ni = -h * t2r;       // -i h t2
+  ar[0] += t1r; ai[0] += t1i;
+  ar[1] = mr + nr; ai[1] = mi + ni;
+  ar[2] = mr - nr; ai[2] = mi - ni;
+}
+
+template <> inline void butterfly<5>(float *ar, float *ai) {
+  const float c1 = 0.30901699437494742f, c2 = -0.80901699437494742f;   // cos(2 pi / 5), cos(4 pi / 5)
+  const float s1 = 0.95105651629515357f, s2 = 0.58778525229247313f;    // sin(2 pi / 5), sin(4 pi / 5)
+  float t1r = ar[1] + ar[4], t1i = ai[1] + ai[4];
+  float t2r = ar[2] + ar[3], t2i = ai[2] + ai[3];
+  float t3r = ar[1] - ar[4], t3i = ai[1] - ai[4];
+  float t4r = ar[2] - ar[3], t4i = ai[2] - ai[3];
+  float m1r = ar[0] + c1 * t1r + c2 * t2r, m1i = ai[0] + c1 * t1i + c2 * t2i;
+  float m2r = ar[0] + c2 * t1r + c1 * t2r, m2i = ai[0] + c2 * t1i + c1 * t2i;
+  float n1r = s1 * t3r + s2 * t4r, n1i = s1 * t3i + s2 * t4i;
+  float n2r = s2 * t3r - s1 * t4r, n2i = s2 * t3i - s1 * t4i;
+  ar[0] += t1r + t2r; ai[0] += t1i + t2i;
+  ar[1] = m1r + n1i; ai[1] = m1i - n1r;    // m1 - i n1
+  ar[4] = m1r - n1i; ai[4] = m1i + n1r;    // m1 + i n1
+  ar[2] = m2r + n2i; ai[2] = m2i - n2r;
+  ar[3] = m2r - n2i; ai[3] = m2i + n2r;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Stages
+//--------------------------------------------------------------------------------------------
+template <int R>
+static void stage(size_t L, size_t s, const float *__restrict xr, const float *__restrict xi,
+                  float *__restrict yr, float *__restrict yi,
+                  const float *__restrict twr, const float *__restrict twi) {
+  const size_t m = L / R;
+  if (s == 1) {
+    // Butterflies along p : loads and twiddles contiguous, stores interleaved by R.
+    for (size_t p = 0; p < m; p++) {
+      float ar[R], ai[R];
+      for (int t = 0; t < R; t++) {
+        ar[t] = xr[p + t * m];
+        ai[t] = xi[p + t * m];
+      }
+      butterfly<R>(ar, ai);
+      yr[R * p] = ar[0];
+      yi[R * p] = ai[0];
+      for (int u = 1; u < R; u++) {
+        float wr = twr[(u - 1) * m + p], wi = twi[(u - 1) * m + p];
+        yr[R * p + u] = ar[u] * wr - ai[u] * wi;
+        yi[R * p + u] = ar[u] * wi + ai[u] * wr;
+      }
+    }
+    return;
+  }
+
+  // Butterflies along q : everything contiguous, one twiddle set per p.
+  const size_t sm = s * m;
+  for (size_t p = 0; p < m; p++) {
+    float wr[R], wi[R];
+    for (int u = 1; u < R; u++) {
+      wr[u] = twr[(u - 1) * m + p];
+      wi[u] = twi[(u - 1) * m + p];
+    }
+    const float *__restrict x0r = xr + s * p;
+    const float *__restrict x0i = xi + s * p;
+    float *__restrict y0r = yr + s * R * p;
+    float *__restrict y0i = yi + s * R * p;
+    for (size_t q = 0; q < s; q++) {
+      float ar[R], ai[R];
+      for (int t = 0; t < R; t++) {
+        ar[t] = x0r[q + t * sm];
+        ai[t] = x0i[q + t * sm];
+      }
+      butterfly<R>(ar, ai);
+      y0r[q] = ar[0];
+      y0i[q] = ai[0];
+      for (int u = 1; u < R; u++) {
+        y0r[q + u * s] = ar[u] * wr[u] - ai[u] * wi[u];
+        y0i[q + u * s] = ar[u] * wi[u] + ai[u] * wr[u];
+      }
+    }
+  }
+}
+
+
+void FFT_forward(const FFT_Plan_t *plan, float *re, float *im, float *work_re, float *work_im) {
+  float *xr = re, *xi = im, *yr = work_re, *yi = work_im;
+  size_t L = plan->n, s = 1;
+  for (int st = 0; st < plan->stages; st++) {
+    const float *twr = plan->tw_re.data() + plan->tw_offset[st];
+    const float *twi = plan->tw_im.data() + plan->tw_offset[st];
+    switch (plan->radix[st]) {
+      case 4: stage<4>(L, s, xr, xi, yr, yi, twr, twi); break;
+      case 2: stage<2>(L, s, xr, xi, yr, yi, twr, twi); break;
+      case 3: stage<3>(L, s, xr, xi, yr, yi, twr, twi); break;
+      case 5: stage<5>(L, s, xr, xi, yr, yi, twr, twi); break;
+    }
+    L /= plan->radix[st];
+    s *= plan->radix[st];
+    std::swap(xr, yr);
+    std::swap(xi, yi);
+  }
+  if (xr != re) {
+    memcpy(re, xr, plan->n * sizeof(float));
+    memcpy(im, xi, plan->n * sizeof(float));
+  }
+}
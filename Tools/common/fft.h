@@ -0,0 +1,55 @@
+/**
+ * @file fft.h
+ * @brief Mixed radix complex FFT (radix 4, 2, 3, 5) for the host analysis tools.
+ *
+ * Stockham autosort, decimation in frequency : every stage reads one buffer
+ * and writes the other, so there is no bit reversal pass and the output is
+ * in natural order. Data is split complex (separate re and im arrays), and
+ * each stage runs its butterflies along the contiguous index :
+ *
+ *  - first stage (stride 1) : along p, twiddles stored contiguous per p
+ *  - later stages (stride s) : along q, one twiddle per row of butterflies
+ *
+ * so the compiler vectorises the butterflies (-O3 -march=native) with no
+ * intrinsics. Sizes are any 2^a 3^b 5^c, FFT_good_size() rounds up to one.
+ *
+ * Forward transform, no scaling : X[k] = sum x[n] exp(-2 pi i k n / N).
+ */
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <cstddef>
+#include <vector>
+
+
+#define FFT_MAX_STAGES 40
+
+
+typedef struct {
+  size_t n;
+  int stages;
+  int radix[FFT_MAX_STAGES];
+  size_t tw_offset[FFT_MAX_STAGES];   // Stage twiddles in tw_re / tw_im
+  std::vector<float> tw_re, tw_im;    // Stage of length L, radix r : (r - 1) x L / r, w_L^(p u) at (u - 1) * L / r + p
+} FFT_Plan_t;
+
+
+/**
+ * @brief Plan a transform of n points.
+ * @return false if n is 0 or has a prime factor other than 2, 3, 5.
+ */
+bool FFT_plan(FFT_Plan_t *plan, size_t n);
+
+/**
+ * @brief Smallest size >= n that FFT_plan() accepts.
+ */
+size_t FFT_good_size(size_t n);
+
+/**
+ * @brief In place forward transform of plan->n points.
+ * @param work_re, work_im Scratch of plan->n floats each.
+ */
+void FFT_forward(const FFT_Plan_t *plan, float *re, float *im, float *work_re, float *work_im);
+
+#endif /* FFT_H */
@@ -0,0 +1,210 @@
+/**
+ * @file flight_sim.cpp
+ * @brief 1-D rocket flight simulator used by the host benchmarks.
+ *
+ * Integration uses a 0.1 ms step with the midpoint method, which is well below
+ * the fastest sensor period (3200 Hz accelerometer).
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "flight_sim.h"
+
+
+#define SIM_STEP 1e-4                 // Integration step (s)
+#define SIM_TRUTH_RATE 1000.0         // Truth output rate (Hz)
+#define ISA_T0 288.15                 // Sea level temperature (K)
+#define ISA_P0 101325.0               // Sea level pressure (Pa)
+#define ISA_LAPSE 0.0065              // Temperature lapse rate (K/m)
+#define ISA_R 287.05                  // Specific gas constant for air
+#define ISA_GAMMA 1.4
+
+
+std::vector<SimConfig_t> FLIGHTSIM_library() {
+  // name, dry, prop, thrust, burn, dia, cd, cd_peak, drogue, pad_msl, pad_wait,
+  // accel_rate, baro_rate, gps_rate, accel_noise, vib, baro_noise, transonic_cp, gps_noise
+  std::vector<SimConfig_t> lib = {
+    { "L1_H128",       1.20, 0.094,  120.0, 1.5, 0.054, 0.45, 0.75, 0.30, 200.0, 5.0,
+      1600.0, 100.0, 10.0, 0.05, 1.0, 3.0, 0.10, 3.0 },
+    { "L2_J350",       2.50, 0.370,  350.0, 2.0, 0.075, 0.45, 0.75, 0.40, 200.0, 5.0,
+      1600.0, 100.0, 10.0, 0.05, 2.0, 3.0, 0.10, 3.0 },
+    { "transonic_K",   3.00, 0.900, 1400.0, 1.6, 0.075, 0.42, 0.80, 0.50, 200.0, 5.0,
+      3200.0, 100.0, 10.0, 0.05, 3.0, 3.0, 0.25, 3.0 },
+    { "hard_boost_I",  1.00, 0.200,  600.0, 0.5, 0.054, 0.45, 0.75, 0.30, 1400.0, 5.0,
+      3200.0, 100.0, 10.0, 0.05, 4.0, 3.0, 0.10, 3.0 },
+  };
+  return lib;
+}
+
+
+double FLIGHTSIM_isa_pressure(double h_msl) {
+  double T = ISA_T0 - ISA_LAPSE * h_msl;
+  return ISA_P0 * pow(T / ISA_T0, FLIGHTSIM_G0 / (ISA_R * ISA_LAPSE));
+}
+
+static double isa_temperature(double h_msl) {
+  return ISA_T0 - ISA_LAPSE * h_msl;
+}
+
+static double drag_coefficient(const SimConfig_t &cfg, double mach) {
+  // Smooth rise through the transonic region, settling above the subsonic value.
+  double bump = exp(-pow((mach - 1.0) / 0.15, 2.0));
+  double supersonic = mach > 1.0 ? 0.5 * (cfg.cd_transonic_peak - cfg.cd_subsonic) : 0.0;
+  double rise = mach > 0.8 ? std::min(1.0, (mach - 0.8) / 0.2) : 0.0;
+  return cfg.cd_subsonic + std::max(rise * supersonic, bump * (cfg.cd_transonic_peak - cfg.cd_subsonic));
+}
+
+
+typedef struct {
+  double h, v;
+} SimState_t;
+
+typedef struct {
+  double a;                   // inertial acceleration (m/s^2)
+  double f;                   // specific force along the rocket axis (m/s^2)
+  double mach;
+  double q;                   // dynamic pressure (Pa)
+} SimDeriv_t;
+
+static SimDeriv_t flight_deriv(const SimConfig_t &cfg, const SimState_t &s, double t_flight, bool drogue) {
+  double h_msl = cfg.pad_altitude_msl + s.h;
+  double T = isa_temperature(h_msl);
+  double p = FLIGHTSIM_isa_pressure(h_msl);
+  double rho = p / (ISA_R * T);
+  double c = sqrt(ISA_GAMMA * ISA_R * T);
+
+  double burning = (t_flight >= 0.0 && t_flight < cfg.burn_time) ? 1.0 : 0.0;
+  double burnt = std::min(std::max(t_flight, 0.0), cfg.burn_time) / cfg.burn_time;
+  double mass = cfg.dry_mass + cfg.propellant_mass * (1.0 - burnt);
+  double thrust = burning * cfg.thrust;
+
+  SimDeriv_t d;
+  d.mach = fabs(s.v) / c;
+  d.q = 0.5 * rho * s.v * s.v;
+  double area = M_PI * 0.25 * cfg.diameter * cfg.diameter;
+  double cda = drag_coefficient(cfg, d.mach) * area + (drogue ? cfg.drogue_cd_area : 0.0);
+  double drag = d.q * cda * (s.v >= 0.0 ? 1.0 : -1.0);
+
+  d.a = (thrust - drag) / mass - FLIGHTSIM_G0;
+  if (s.h <= 0.0 && d.a < 0.0 && s.v <= 0.0) {
+    d.a = 0.0;                // Sitting on the pad / ground
+  }
+  d.f = d.a + FLIGHTSIM_G0;
+  return d;
+}
+
+
+SimFlight_t FLIGHTSIM_run(const SimConfig_t &cfg, uint32_t seed) {
+  SimFlight_t out;
+  out.name = cfg.name;
+  out.truth_rate = SIM_TRUTH_RATE;
+  out.p0 = FLIGHTSIM_isa_pressure(cfg.pad_altitude_msl);
+  out.launch_t = cfg.pad_wait;
+  out.apogee_t = 0.0;
+  out.apogee_h = 0.0;
+  out.max_mach = 0.0;
+
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> gauss(0.0, 1.0);
+
+  SimState_t s = { 0.0, 0.0 };
+  bool drogue = false;
+  bool launched = false;
+  double t = 0.0;
+  double next_truth = 0.0, next_accel = 0.0, next_baro = 0.0, next_gps = 0.0;
+  const double dt = SIM_STEP;
+
+  while (true) {
+    double t_flight = t - cfg.pad_wait;
+    SimDeriv_t d = flight_deriv(cfg, s, t_flight, drogue);
+
+    if (t + 1e-9 >= next_truth) {
+      SimTruth_t tr = { t, s.h, s.v, d.a, d.mach };
+      out.truth.push_back(tr);
+      next_truth += 1.0 / SIM_TRUTH_RATE;
+    }
+
+    if (t + 1e-9 >= next_accel) {
+      double f_g = d.f / FLIGHTSIM_G0;
+      double vib[3] = { 0.0, 0.0, 0.0 };
+      if (t_flight >= 0.0 && t_flight < cfg.burn_time) {
+        // Motor resonances, mostly lateral
+        vib[0] = cfg.vibration_g * sin(2.0 * M_PI * 180.0 * t);
+        vib[1] = cfg.vibration_g * 0.7 * sin(2.0 * M_PI * 430.0 * t + 0.3);
+        vib[2] = cfg.vibration_g * 0.3 * sin(2.0 * M_PI * 180.0 * t + 1.1);
+      }
+      SimAccel_t acc;
+      acc.t = t;
+      double axis_g[3] = { vib[0], vib[1], f_g + vib[2] };
+      for (int i = 0; i < 3; i++) {
+        double g = axis_g[i] + cfg.accel_noise_g * gauss(rng);
+        double counts = std::round(g / FLIGHTSIM_ADXL_G_PER_LSB);
+        counts = std::max(-4096.0, std::min(4095.0, counts)); // +/-200g
+        acc.raw[i] = (int16_t)counts;
+      }
+      out.accel.push_back(acc);
+      next_accel += 1.0 / cfg.accel_rate;
+    }
+
+    if (t + 1e-9 >= next_baro) {
+      double p = FLIGHTSIM_isa_pressure(cfg.pad_altitude_msl + s.h);
+      double cp = cfg.baro_transonic_cp * exp(-pow((d.mach - 1.0) / 0.12, 2.0));
+      SimSample_t b = { t, p - cp * d.q + cfg.baro_noise_pa * gauss(rng) };
+      out.baro.push_back(b);
+      next_baro += 1.0 / cfg.baro_rate;
+    }
+
+    if (t + 1e-9 >= next_gps) {
+      SimSample_t g = { t, s.h + cfg.gps_noise_m * gauss(rng) };
+      out.gps.push_back(g);
+      next_gps += 1.0 / cfg.gps_rate;
+    }
+
+    // Midpoint integration
+    SimState_t mid = { s.h + 0.5 * dt * s.v, s.v + 0.5 * dt * d.a };
+    SimDeriv_t dm = flight_deriv(cfg, mid, t_flight + 0.5 * dt, drogue);
+    s.h += dt * mid.v;
+    s.v += dt * dm.a;
+    t += dt;
+
+    if (s.h > 1.0) launched = true;
+    if (d.mach > out.max_mach) out.max_mach = d.mach;
+    if (s.h > out.apogee_h) {
+      out.apogee_h = s.h;
+      out.apogee_t = t;
+    }
+    if (launched && !drogue && s.v < 0.0) {
+      drogue = true;           // Deployment at apogee
+    }
+    if (launched && s.h <= 0.0) {
+      break;                   // Landed
+    }
+    if (t > 3600.0) {
+      break;                   // Guard against configurations that never land
+    }
+  }
+
+  return out;
+}
+
+
+SimTruth_t FLIGHTSIM_truth_at(const SimFlight_t &flight, double t) {
+  const std::vector<SimTruth_t> &tr = flight.truth;
+  if (tr.empty()) {
+    SimTruth_t z = { t, 0.0, 0.0, 0.0, 0.0 };
+    return z;
+  }
+  double pos = t * flight.truth_rate;
+  if (pos <= 0.0) return tr.front();
+  size_t i = (size_t)pos;
+  if (i + 1 >= tr.size()) return tr.back();
+  double w = pos - (double)i;
+  SimTruth_t r;
+  r.t = t;
+  r.h = tr[i].h + w * (tr[i + 1].h - tr[i].h);
+  r.v = tr[i].v + w * (tr[i + 1].v - tr[i].v);
+  r.a = tr[i].a + w * (tr[i + 1].a - tr[i].a);
+  r.mach = tr[i].mach + w * (tr[i + 1].mach - tr[i].mach);
+  return r;
+}
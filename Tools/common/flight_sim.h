@@ -0,0 +1,124 @@
+/**
+ * @file flight_sim.h
+ * @brief 1-D rocket flight simulator producing truth and sensor streams for host tools.
+ *
+ * The simulator integrates a vertical flight (boost, coast, descent under drogue)
+ * through the ISA troposphere and samples the flight computer sensors at their
+ * configured rates :
+ *
+ * | Sensor  | Output                         | Error model                              |
+ * | ------- | ------------------------------ | ---------------------------------------- |
+ * | ADXL375 | raw counts, 3 axes, 49 mg/LSB  | white noise, quantisation, +/-200g clip,  |
+ * |         | (Z is the rocket axis)         | motor vibration tones during boost       |
+ * | BMP390  | pressure (Pa)                  | white noise, transonic static port error |
+ * | GPS     | height above pad (m)           | white noise                              |
+ *
+ * FLIGHTSIM_library() returns the set of reference flights used by the host
+ * benchmarks, so results are comparable between tools.
+ */
+
+#ifndef FLIGHT_SIM_H
+#define FLIGHT_SIM_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+#define FLIGHTSIM_G0 9.80665          // Standard gravity (m/s^2)
+#define FLIGHTSIM_ADXL_G_PER_LSB 0.049 // ADXL375 scale factor
+
+
+//--------------------------------------------------------------------------------------------
+// Flight description
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  const char *name;
+  double dry_mass;            // kg, without propellant
+  double propellant_mass;     // kg
+  double thrust;              // N, average thrust
+  double burn_time;           // s
+  double diameter;            // m, body tube
+  double cd_subsonic;         // Drag coefficient below Mach 0.8
+  double cd_transonic_peak;   // Drag coefficient peak at Mach 1
+  double drogue_cd_area;      // m^2, Cd*A of the drogue deployed at apogee
+  double pad_altitude_msl;    // m, launch site altitude
+  double pad_wait;            // s of pad data before ignition
+
+  double accel_rate;          // Hz
+  double baro_rate;           // Hz
+  double gps_rate;            // Hz
+  double accel_noise_g;       // ADXL375 noise, g RMS
+  double vibration_g;         // Boost vibration amplitude, g
+  double baro_noise_pa;       // BMP390 noise, Pa RMS
+  double baro_transonic_cp;   // Peak static port pressure error as a fraction of dynamic pressure
+  double gps_noise_m;         // GPS height noise, m RMS
+} SimConfig_t;
+
+
+//--------------------------------------------------------------------------------------------
+// Simulation output
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  double t;                   // s since start of recording
+  double h;                   // m above pad
+  double v;                   // m/s
+  double a;                   // m/s^2 (inertial, gravity removed)
+  double mach;
+} SimTruth_t;
+
+typedef struct {
+  double t;
+  int16_t raw[3];             // ADXL375 counts X, Y, Z
+} SimAccel_t;
+
+typedef struct {
+  double t;
+  double value;               // Pa for baro, m for GPS
+} SimSample_t;
+
+typedef struct {
+  std::string name;
+  double truth_rate;          // Hz
+  double p0;                  // Pad pressure (Pa)
+  double launch_t;            // Ignition time (s)
+  double apogee_t;            // True apogee time (s)
+  double apogee_h;            // True apogee altitude above pad (m)
+  double max_mach;
+  std::vector<SimTruth_t> truth;
+  std::vector<SimAccel_t> accel;
+  std::vector<SimSample_t> baro;
+  std::vector<SimSample_t> gps;
+} SimFlight_t;
+
+
+//--------------------------------------------------------------------------------------------
+// Function prototypes
+//--------------------------------------------------------------------------------------------
+
+/**
+ * @brief Reference flights used by the host benchmarks.
+ */
+std::vector<SimConfig_t> FLIGHTSIM_library();
+
+/**
+ * @brief Simulate one flight from ignition until landing.
+ * @param[in] cfg Flight description.
+ * @param[in] seed Seed for the sensor noise generators.
+ * @return Truth and sensor streams.
+ */
+SimFlight_t FLIGHTSIM_run(const SimConfig_t &cfg, uint32_t seed);
+
+/**
+ * @brief Linearly interpolated truth at time t.
+ */
+SimTruth_t FLIGHTSIM_truth_at(const SimFlight_t &flight, double t);
+
+/**
+ * @brief ISA troposphere pressure at a geopotential altitude.
+ * @param[in] h_msl Altitude above mean sea level (m).
+ * @return Pressure (Pa).
+ */
+double FLIGHTSIM_isa_pressure(double h_msl);
+
+#endif /* FLIGHT_SIM_H */
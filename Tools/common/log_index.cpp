@@ -0,0 +1,262 @@
+/**
+ * @file log_index.cpp
+ * @brief Seek a record log by time or by flight event without reading it whole.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log_index.h"
+
+
+#define SCAN_CHUNK (1 << 20)          // Bytes read at a time when scanning
+
+
+static size_t read_at(LogIndex_t *x, int fd, uint64_t offset, void *buf, size_t n) {
+  x->reads++;
+  ssize_t got = pread(fd, buf, n, (off_t)offset);
+  if (got <= 0) return 0;
+  x->bytes_read += (uint64_t)got;
+  return (size_t)got;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Index entries
+//--------------------------------------------------------------------------------------------
+static bool read_entry(LogIndex_t *x, size_t i, LOG_IndexEntry_t *e) {
+  return read_at(x, x->index_fd, (uint64_t)i * sizeof(*e), e, sizeof(*e)) == sizeof(*e);
+}
+
+
+// Entry i passes its check, has records, points inside the log and after
+// entry i - 1; next to a journal, at slot i. A preallocated index is zeros
+// (which pass the check) or stale past the last sector written.
+static bool entry_usable(LogIndex_t *x, size_t i) {
+  LOG_IndexEntry_t e[2];
+  size_t first = i > 0 ? i - 1 : 0;
+  size_t want = (i - first + 1) * sizeof(LOG_IndexEntry_t);
+  if (read_at(x, x->index_fd, (uint64_t)first * sizeof(LOG_IndexEntry_t), e, want) != want) {
+    return false;
+  }
+  const LOG_IndexEntry_t &cur = e[i - first];
+  if (!LOG_index_valid(&cur) || cur.records == 0 || cur.offset >= x->log_size ||
+      (x->journal && cur.offset != (uint64_t)i * LOG_SLOT_SIZE)) {
+    return false;
+  }
+  return i == 0 || (LOG_index_valid(&e[0]) && e[0].offset < cur.offset);
+}
+
+
+// Sample stamp of entry i; a block without samples takes the stamp of the
+// last block before it that has some.
+static uint64_t entry_time(LogIndex_t *x, size_t i, uint64_t *offset) {
+  LOG_IndexEntry_t e;
+  read_entry(x, i, &e);
+  *offset = e.offset;
+  while (e.t_us == 0 && i > 0) {
+    read_entry(x, --i, &e);
+  }
+  return e.t_us;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Log bytes
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  std::vector<uint8_t> buf;
+  uint64_t base;              // Log offset of buf[0]
+  size_t pos;
+  size_t len;
+  size_t chunk;
+} Cursor_t;
+
+
+static void cursor_start(Cursor_t *c, uint64_t offset, size_t chunk) {
+  c->buf.resize(chunk + LOG_OVERHEAD + UINT16_MAX);
+  c->base = offset;
+  c->pos = 0;
+  c->len = 0;
+  c->chunk = chunk;
+}
+
+
+// Next valid record at or after the cursor, skipping corruption.
+static bool cursor_next(LogIndex_t *x, Cursor_t *c, LOG_Record_t *rec, uint64_t *rec_offset) {
+  for (;;) {
+    LOG_Status_t st = c->pos < c->len ? LOG_decode(c->buf.data() + c->pos, c->len - c->pos, rec) : LOG_NEED_MORE;
+    if (st == LOG_OK) {
+      *rec_offset = c->base + c->pos;
+      c->pos += rec->size;
+      return true;
+    }
+    if (st == LOG_BAD_RECORD) {
+      c->pos++;
+      continue;
+    }
+    // Keep the undecoded tail and read the next chunk behind it.
+    uint64_t end = c->base + c->len;
+    if (end >= x->log_size) return false;
+    size_t rest = c->len - c->pos;
+    memmove(c->buf.data(), c->buf.data() + c->pos, rest);
+    c->base += c->pos;
+    c->pos = 0;
+    size_t got = read_at(x, x->log_fd, end, c->buf.data() + rest, std::min(c->chunk, c->buf.size() - rest));
+    if (got == 0) return false;
+    c->len = rest + got;
+  }
+}
+
+
+static bool is_sample(uint8_t type) {
+  return type == LOG_REC_ACCEL || type == LOG_REC_ACCEL_PACK || type == LOG_REC_BARO;
+}
+
+
+// First sample record at or after offset : its stamp, UINT64_MAX if none.
+static uint64_t probe(LogIndex_t *x, uint64_t offset) {
+  Cursor_t c;
+  cursor_start(&c, offset, LOGINDEX_PROBE_SIZE);
+  LOG_Record_t rec;
+  uint64_t at;
+  while (cursor_next(x, &c, &rec, &at)) {
+    if (is_sample(rec.type)) return rec.t_us;
+  }
+  return UINT64_MAX;
+}
+
+
+static bool scan_event(LogIndex_t *x, uint64_t from, size_t chunk, uint8_t id, uint64_t *offset, LOG_Event_t *ev,
+                       uint64_t *t_us) {
+  Cursor_t c;
+  cursor_start(&c, from, chunk);
+  LOG_Record_t rec;
+  uint64_t at;
+  while (cursor_next(x, &c, &rec, &at)) {
+    if (rec.type != LOG_REC_EVENT || rec.len != sizeof(LOG_Event_t) || rec.payload[0] != id) continue;
+    *offset = at;
+    if (ev) memcpy(ev, rec.payload, sizeof(*ev));
+    if (t_us) *t_us = rec.t_us;
+    return true;
+  }
+  return false;
+}
+
+
+static bool read_slot(void *ctx, uint32_t slot, uint8_t *buf) {
+  LogIndex_t *x = (LogIndex_t *)ctx;
+  return read_at(x, x->log_fd, (uint64_t)slot * LOG_SLOT_SIZE, buf, LOG_SLOT_SIZE) == LOG_SLOT_SIZE;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Public API
+//--------------------------------------------------------------------------------------------
+bool LOGINDEX_open(LogIndex_t *x, const char *log_path, const char *index_path) {
+  memset(x, 0, sizeof(*x));
+  x->index_fd = -1;
+  x->log_fd = open(log_path, O_RDONLY);
+  if (x->log_fd < 0) {
+    return false;
+  }
+  struct stat st;
+  fstat(x->log_fd, &st);
+  x->log_size = (uint64_t)st.st_size;
+  // A journal ends at its last valid slot, whatever the preallocated size.
+  std::vector<uint8_t> slot(LOG_SLOT_SIZE);
+  LOG_Commit_t last;
+  uint32_t slots = LOG_journal_scan(read_slot, x, (uint32_t)(x->log_size / LOG_SLOT_SIZE), slot.data(), &last, NULL);
+  if (slots > 0) {
+    x->log_size = (uint64_t)slots * LOG_SLOT_SIZE;
+    x->journal = true;
+  }
+  x->reads = 0;
+  x->bytes_read = 0;
+
+  if (!index_path) return true;
+  x->index_fd = open(index_path, O_RDONLY);
+  if (x->index_fd < 0) return true;
+  fstat(x->index_fd, &st);
+  size_t n = (size_t)st.st_size / sizeof(LOG_IndexEntry_t);
+
+  // Usable entries are a prefix : find its end.
+  size_t lo = 0, hi = n;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (entry_usable(x, mid)) lo = mid + 1;
+    else hi = mid;
+  }
+  x->entries = lo;
+  x->dropped = n - lo + ((size_t)st.st_size % sizeof(LOG_IndexEntry_t) ? 1 : 0);
+  return true;
+}
+
+
+void LOGINDEX_close(LogIndex_t *x) {
+  if (x->log_fd >= 0) close(x->log_fd);
+  if (x->index_fd >= 0) close(x->index_fd);
+  x->log_fd = -1;
+  x->index_fd = -1;
+}
+
+
+uint64_t LOGINDEX_seek_time(LogIndex_t *x, uint64_t t_us) {
+  uint64_t target = t_us > LOG_INDEX_SLACK_US ? t_us - LOG_INDEX_SLACK_US : 0;
+
+  if (x->entries > 0) {
+    // Last entry stamped at or before target.
+    size_t lo = 0, hi = x->entries;
+    uint64_t offset = 0, at;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (entry_time(x, mid, &at) <= target) {
+        offset = at;
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return offset;
+  }
+
+  // Bisect the bytes : lo always starts before a sample stamped at or before target.
+  uint64_t lo = 0, hi = x->log_size;
+  while (hi - lo > LOGINDEX_PROBE_SIZE) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (probe(x, mid) <= target) lo = mid;
+    else hi = mid;
+  }
+  if (lo == 0) return 0;
+  Cursor_t c;
+  cursor_start(&c, lo, LOGINDEX_PROBE_SIZE);
+  LOG_Record_t rec;
+  uint64_t at;
+  return cursor_next(x, &c, &rec, &at) ? at : lo;
+}
+
+
+bool LOGINDEX_find_event(LogIndex_t *x, uint8_t id, uint64_t *offset, LOG_Event_t *ev, uint64_t *t_us) {
+  if (id < 1 || id > 8) return false;
+  if (x->entries == 0) {
+    return scan_event(x, 0, SCAN_CHUNK, id, offset, ev, t_us);
+  }
+
+  // First entry with the event bit; if none has it, the event may still be
+  // in the log past the last usable entry.
+  uint8_t bit = (uint8_t)(1u << (id - 1));
+  size_t lo = 0, hi = x->entries;
+  LOG_IndexEntry_t e;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    read_entry(x, mid, &e);
+    if (e.events & bit) hi = mid;
+    else lo = mid + 1;
+  }
+  read_entry(x, lo < x->entries ? lo : x->entries - 1, &e);
+  return scan_event(x, e.offset, LOGINDEX_PROBE_SIZE, id, offset, ev, t_us);
+}
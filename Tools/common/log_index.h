@@ -0,0 +1,80 @@
+/**
+ * @file log_index.h
+ * @brief Seek a record log by time or by flight event without reading it whole.
+ *
+ * Uses the sidecar time index the flight computer writes next to the log
+ * (LOG_IndexEntry_t in lib/FlightLog/flight_log.h, SENSOR_DATA.idx) :
+ *
+ * | Lookup        | With the index                   | Without                                 |
+ * | ------------- | -------------------------------- | --------------------------------------- |
+ * | Time          | binary search of the entries     | bisection of the log bytes, resyncing   |
+ * |               |                                  | on the first sample record of a probe   |
+ * | Event         | binary search of the cumulative  | scan of the log from the start          |
+ * |               | event bits, then one block       |                                         |
+ *
+ * Both are O(log n) reads of the files. Entries are read with pread() as the
+ * search needs them, nothing is loaded up front.
+ *
+ * The log may be truncated (card pulled, file recovered from a raw SD image)
+ * and the index may end in a torn entry or run past the end of the log : on
+ * open, the index is clipped to its last entry that passes its check and
+ * points inside the log (a binary search as well, damage is at the tail).
+ *
+ * A journal file (lib/LogJournal) is searched up to its last valid slot. Its
+ * index is preallocated, entry i for slot i, and written a sector at a time :
+ * the entries in use end at the first that is not slot i's.
+ * Stamps restart at each boot; lookups assume a single session per file.
+ */
+
+#ifndef LOG_INDEX_H
+#define LOG_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "flight_log.h"
+
+
+#define LOGINDEX_PROBE_SIZE 4096      // Bytes read per probe when bisecting the log
+
+
+typedef struct {
+  int log_fd;
+  uint64_t log_size;
+  bool journal;               // The log is a journal, entry i indexes slot i
+  int index_fd;               // -1 without an index
+  size_t entries;             // Usable entries : valid and inside the log
+  size_t dropped;             // Entries past the usable ones (torn, or beyond a truncated log)
+  size_t reads;               // pread() calls so far, for benchmarks
+  uint64_t bytes_read;        // Bytes they returned
+} LogIndex_t;
+
+
+/**
+ * @brief Open a log and, if index_path is not NULL and exists, its index.
+ * @return false if the log cannot be opened.
+ */
+bool LOGINDEX_open(LogIndex_t *x, const char *log_path, const char *index_path);
+
+void LOGINDEX_close(LogIndex_t *x);
+
+/**
+ * @brief Offset to start reading from so that no record stamped t_us or later
+ * (on the sample clock) comes before it.
+ *
+ * The offset is a block boundary with the index, a record boundary without,
+ * LOG_INDEX_SLACK_US early in both cases; records before t_us still follow it
+ * and are the caller's to drop.
+ */
+uint64_t LOGINDEX_seek_time(LogIndex_t *x, uint64_t t_us);
+
+/**
+ * @brief First EVENT record of an id.
+ * @param[out] offset Offset of the record in the log.
+ * @param[out] ev Its payload, may be NULL.
+ * @param[out] t_us Its stamp, may be NULL.
+ * @return false if the log has no such event.
+ */
+bool LOGINDEX_find_event(LogIndex_t *x, uint8_t id, uint64_t *offset, LOG_Event_t *ev, uint64_t *t_us);
+
+#endif /* LOG_INDEX_H */
@@ -0,0 +1,338 @@
+/**
+ * @file log_reader.cpp
+ * @brief Load a flight computer record log into per-record-type arrays.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#include "log_reader.h"
+
+
+bool LOGREAD_load_file(const char *path, std::vector<uint8_t> &data) {
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    return false;
+  }
+  data.clear();
+  uint8_t chunk[1 << 16];
+  size_t got;
+  while ((got = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+    data.insert(data.end(), chunk, chunk + got);
+  }
+  fclose(in);
+  return true;
+}
+
+
+typedef struct {
+  const uint8_t *buf;
+  size_t n;
+} MemSlots_t;
+
+
+static bool read_mem_slot(void *ctx, uint32_t slot, uint8_t *out) {
+  const MemSlots_t *m = (const MemSlots_t *)ctx;
+  size_t at = (size_t)slot * LOG_SLOT_SIZE;
+  if (at + LOG_SLOT_SIZE > m->n) return false;
+  memcpy(out, m->buf + at, LOG_SLOT_SIZE);
+  return true;
+}
+
+
+size_t LOGREAD_journal_length(const uint8_t *buf, size_t n) {
+  MemSlots_t m = { buf, n };
+  uint8_t slot[LOG_SLOT_SIZE];
+  LOG_Commit_t last;
+  return (size_t)LOG_journal_scan(read_mem_slot, &m, (uint32_t)(n / LOG_SLOT_SIZE), slot, &last, NULL) *
+         LOG_SLOT_SIZE;
+}
+
+
+bool LOGREAD_is_record_log(const uint8_t *buf, size_t n) {
+  LOG_Record_t rec;
+  return n > 0 && LOG_decode(buf, n, &rec) == LOG_OK;
+}
+
+
+template <typename Row, typename Payload>
+static bool take(const LOG_Record_t &rec, std::vector<Row> &dst) {
+  if (rec.len != sizeof(Payload)) {
+    return false;
+  }
+  Row row;
+  row.t_us = rec.t_us;
+  memcpy(&row.v, rec.payload, sizeof(Payload));
+  dst.push_back(row);
+  return true;
+}
+
+
+static bool take_pack(const LOG_Record_t &rec, std::vector<LogAccel_t> &dst) {
+  uint64_t t_us[LOG_ACCEL_PACK_SAMPLES];
+  LOG_Accel_t acc[LOG_ACCEL_PACK_SAMPLES];
+  int n = LOG_accel_unpack(rec.payload, rec.len, rec.t_us, t_us, acc);
+  for (int i = 0; i < n; i++) dst.push_back({ t_us[i], acc[i] });
+  return n > 0;
+}
+
+
+static bool take_radio(const LOG_Record_t &rec, std::vector<LogRadio_t> &dst) {
+  if (rec.len < LOG_RADIO_HEADER || rec.len != LOG_RADIO_HEADER + rec.payload[3] ||
+      rec.payload[3] > LOG_RADIO_MAX_PACKET) {
+    return false;
+  }
+  LogRadio_t row = {};
+  row.t_us = rec.t_us;
+  memcpy(&row.v, rec.payload, rec.len);
+  dst.push_back(row);
+  return true;
+}
+
+
+void LOGREAD_parse(const uint8_t *buf, size_t n, LogData_t *out) {
+  size_t journal = LOGREAD_journal_length(buf, n);
+  if (journal > 0) {
+    n = journal;
+    out->journal_slots += journal / LOG_SLOT_SIZE;
+  }
+  for (size_t pos = 0; pos < n;) {
+    LOG_Record_t rec;
+    LOG_Status_t st = LOG_decode(buf + pos, n - pos, &rec);
+    if (st == LOG_NEED_MORE) {
+      out->skipped += n - pos;
+      break;
+    }
+    if (st == LOG_BAD_RECORD) {
+      pos++;
+      out->skipped++;
+      continue;
+    }
+    pos += rec.size;
+    out->records++;
+
+    bool known = false;
+    switch (rec.type) {
+      case LOG_REC_ACCEL:  known = take<LogAccel_t, LOG_Accel_t>(rec, out->accel); break;
+      case LOG_REC_ACCEL_PACK: known = take_pack(rec, out->accel); break;
+      case LOG_REC_BARO:   known = take<LogBaro_t, LOG_Baro_t>(rec, out->baro); break;
+      case LOG_REC_GPS:    known = take<LogGps_t, LOG_Gps_t>(rec, out->gps); break;
+      case LOG_REC_STATE:  known = take<LogState_t, LOG_State_t>(rec, out->state); break;
+      case LOG_REC_EVENT:  known = take<LogEvent_t, LOG_Event_t>(rec, out->events); break;
+      case LOG_REC_TIMING: known = take<LogTiming_t, LOG_Timing_t>(rec, out->timing); break;
+      case LOG_REC_TIMESYNC: known = take<LogTimeSync_t, LOG_TimeSync_t>(rec, out->timesync); break;
+      case LOG_REC_SPECTRUM: known = take<LogSpectrum_t, LOG_Spectrum_t>(rec, out->spectrum); break;
+      case LOG_REC_STORAGE: known = take<LogStorage_t, LOG_Storage_t>(rec, out->storage); break;
+      case LOG_REC_SINK:   known = take<LogSink_t, LOG_Sink_t>(rec, out->sinks); break;
+      case LOG_REC_RADIO:  known = take_radio(rec, out->radio); break;
+      case LOG_REC_PAD:
+      case LOG_REC_COMMIT:
+      case LOG_REC_BLOCK:  known = true; break;
+      default: break;
+    }
+    if (!known) out->unknown++;
+  }
+}
+
+
+// Days since 1970-01-01 of a civil date (proleptic Gregorian).
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = (unsigned)(y - era * 400);
+  unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t)doe - 719468;
+}
+
+
+// Drop edges whose stamp sits off the line through their neighbours, by more
+// than LOGREAD_PPS_OUTLIER_US. The interrupt can only be late, so a stamp
+// delayed by a held off interrupt shows up as a one point excursion.
+static void drop_late_edges(LogTimeMap_t *map) {
+  size_t n = map->mcu_us.size();
+  std::vector<bool> keep(n, true);
+  for (size_t i = 0; i < n; i++) {
+    size_t lo = i >= LOGREAD_PPS_WINDOW ? i - LOGREAD_PPS_WINDOW : 0;
+    size_t hi = std::min(n, i + LOGREAD_PPS_WINDOW + 1);
+    double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0, m = 0.0;
+    for (size_t j = lo; j < hi; j++) {
+      if (j == i) continue;
+      double x = (double)(map->mcu_us[j] - map->mcu_us[i]);
+      double y = (double)(map->utc_us[j] - map->utc_us[i]) - x;
+      sx += x;
+      sy += y;
+      sxx += x * x;
+      sxy += x * y;
+      m++;
+    }
+    double den = m * sxx - sx * sx;
+    if (m < 3 || den <= 0.0) continue;
+    double slope = (m * sxy - sx * sy) / den;
+    double intercept = (sy - slope * sx) / m;
+    // Line value at point i (x = 0) is intercept : utc - mcu offset of the neighbours.
+    if (std::fabs(intercept) > LOGREAD_PPS_OUTLIER_US) keep[i] = false;
+  }
+  size_t k = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (!keep[i]) continue;
+    map->mcu_us[k] = map->mcu_us[i];
+    map->utc_us[k] = map->utc_us[i];
+    k++;
+  }
+  map->mcu_us.resize(k);
+  map->utc_us.resize(k);
+}
+
+
+void LOGREAD_time_map(const LogData_t &d, LogTimeMap_t *map) {
+  map->mcu_us.clear();
+  map->utc_us.clear();
+  for (const LogTimeSync_t &t : d.timesync) {
+    if (t.v.flags & LOG_TIMESYNC_REJECTED) continue;
+    if (t.v.utc_year < 2000 || t.v.utc_month < 1 || t.v.utc_month > 12) continue;
+    int64_t days = days_from_civil(t.v.utc_year, t.v.utc_month, t.v.utc_day);
+    int64_t sec = days * 86400 + t.v.utc_hour * 3600 + t.v.utc_min * 60 + t.v.utc_sec;
+    if (!map->mcu_us.empty()) {
+      // Drop pairs off by whole seconds (wrong edge) or going backwards.
+      int64_t dm = (int64_t)t.t_us - map->mcu_us.back();
+      int64_t du = sec * 1000000 - map->utc_us.back();
+      if (dm <= 0 || du <= 0 || std::llabs(du - dm) > dm / 2000) continue;
+    }
+    map->mcu_us.push_back((int64_t)t.t_us);
+    map->utc_us.push_back(sec * 1000000);
+  }
+  drop_late_edges(map);
+}
+
+
+bool LOGREAD_utc(const LogTimeMap_t &map, int64_t t_us, double *unix_s) {
+  size_t n = map.mcu_us.size();
+  if (n < 2) {
+    return false;
+  }
+  size_t hi = std::upper_bound(map.mcu_us.begin(), map.mcu_us.end(), t_us) - map.mcu_us.begin();
+  if (hi == 0) hi = 1;
+  if (hi >= n) hi = n - 1;
+  size_t lo = hi - 1;
+  double rate = (double)(map.utc_us[hi] - map.utc_us[lo]) / (double)(map.mcu_us[hi] - map.mcu_us[lo]);
+  double utc = (double)map.utc_us[lo] + rate * (double)(t_us - map.mcu_us[lo]);
+  *unix_s = utc * 1e-6;
+  return true;
+}
+
+
+static bool read_file_slot(void *ctx, uint32_t slot, uint8_t *out) {
+  FILE *f = (FILE *)ctx;
+  return fseeko(f, (off_t)slot * LOG_SLOT_SIZE, SEEK_SET) == 0 && fread(out, 1, LOG_SLOT_SIZE, f) == LOG_SLOT_SIZE;
+}
+
+
+bool LOGREAD_stream_open(LogStream_t *s, const char *path) {
+  s->f = fopen(path, "rb");
+  if (!s->f) {
+    return false;
+  }
+  fseeko(s->f, 0, SEEK_END);
+  s->end = (uint64_t)ftello(s->f);
+  std::vector<uint8_t> slot(LOG_SLOT_SIZE);
+  LOG_Commit_t last;
+  s->journal_slots = LOG_journal_scan(read_file_slot, s->f, (uint32_t)(s->end / LOG_SLOT_SIZE), slot.data(), &last,
+                                      NULL);
+  if (s->journal_slots > 0) s->end = (uint64_t)s->journal_slots * LOG_SLOT_SIZE;
+  fseeko(s->f, 0, SEEK_SET);
+  s->file_pos = 0;
+  // Room for a chunk plus the largest record left over from the previous one.
+  s->buf.resize(LOGREAD_STREAM_CHUNK + LOG_OVERHEAD + UINT16_MAX);
+  s->pos = 0;
+  s->len = 0;
+  s->eof = false;
+  s->records = 0;
+  s->skipped = 0;
+  s->unpacked_n = s->unpacked_at = 0;
+  return true;
+}
+
+
+// Move the undecoded tail to the front and read the next chunk behind it.
+static void stream_refill(LogStream_t *s) {
+  size_t rest = s->len - s->pos;
+  memmove(s->buf.data(), s->buf.data() + s->pos, rest);
+  s->pos = 0;
+  s->len = rest;
+  size_t want = std::min((size_t)LOGREAD_STREAM_CHUNK, s->buf.size() - rest);
+  if (s->file_pos + want > s->end) want = s->file_pos < s->end ? (size_t)(s->end - s->file_pos) : 0;
+  size_t got = want ? fread(s->buf.data() + rest, 1, want, s->f) : 0;
+  s->file_pos += got;
+  s->len += got;
+  if (got == 0) s->eof = true;
+}
+
+
+bool LOGREAD_stream_next(LogStream_t *s, LOG_Record_t *rec) {
+  if (s->unpacked_at < s->unpacked_n) {
+    int i = s->unpacked_at++;
+    rec->type = LOG_REC_ACCEL;
+    rec->len = sizeof(LOG_Accel_t);
+    rec->t_us = s->unpacked_t_us[i];
+    rec->payload = (const uint8_t *)&s->unpacked[i];
+    rec->size = LOG_OVERHEAD + sizeof(LOG_Accel_t);
+    return true;
+  }
+  for (;;) {
+    if (s->pos >= s->len) {
+      if (s->eof) return false;
+      stream_refill(s);
+      continue;
+    }
+    LOG_Status_t st = LOG_decode(s->buf.data() + s->pos, s->len - s->pos, rec);
+    if (st == LOG_NEED_MORE) {
+      if (s->eof) {
+        s->skipped += s->len - s->pos;
+        s->pos = s->len;
+        return false;
+      }
+      stream_refill(s);
+      continue;
+    }
+    if (st == LOG_BAD_RECORD) {
+      s->pos++;
+      s->skipped++;
+      continue;
+    }
+    s->pos += rec->size;
+    if (rec->type == LOG_REC_PAD || rec->type == LOG_REC_COMMIT || rec->type == LOG_REC_BLOCK) continue;
+    s->records++;
+    if (rec->type == LOG_REC_ACCEL_PACK) {
+      int n = LOG_accel_unpack(rec->payload, rec->len, rec->t_us, s->unpacked_t_us, s->unpacked);
+      if (n > 0) {
+        s->unpacked_n = n;
+        s->unpacked_at = 0;
+        return LOGREAD_stream_next(s, rec);
+      }
+    }
+    return true;
+  }
+}
+
+
+bool LOGREAD_stream_seek(LogStream_t *s, uint64_t offset) {
+  if (fseeko(s->f, (off_t)offset, SEEK_SET) != 0) {
+    return false;
+  }
+  s->pos = 0;
+  s->len = 0;
+  s->eof = false;
+  s->file_pos = offset;
+  s->unpacked_n = s->unpacked_at = 0;
+  return true;
+}
+
+
+void LOGREAD_stream_close(LogStream_t *s) {
+  if (s->f) fclose(s->f);
+  s->f = NULL;
+}
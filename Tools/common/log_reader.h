@@ -0,0 +1,154 @@
+/**
+ * @file log_reader.h
+ * @brief Load a flight computer record log into per-record-type arrays.
+ *
+ * Host side reader for the format in lib/FlightLog/flight_log.h. Every
+ * record keeps its T_US stamp; records that fail the checksum are skipped
+ * byte by byte until the next valid SYNC, unknown types are skipped whole.
+ *
+ * A journal file (lib/LogJournal) is read up to the end of its last valid
+ * slot, found by binary search : the preallocated space after it (blank, or
+ * stale data from an earlier journal) is not read. PAD, COMMIT and BLOCK
+ * records are skipped silently. ACCEL_PACK blocks are unpacked into ACCEL
+ * samples, so readers see the same samples whichever way they were logged.
+ */
+
+#ifndef LOG_READER_H
+#define LOG_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "flight_log.h"
+
+
+typedef struct { uint64_t t_us; LOG_Accel_t v; } LogAccel_t;
+typedef struct { uint64_t t_us; LOG_Baro_t v; } LogBaro_t;
+typedef struct { uint64_t t_us; LOG_Gps_t v; } LogGps_t;
+typedef struct { uint64_t t_us; LOG_State_t v; } LogState_t;
+typedef struct { uint64_t t_us; LOG_Event_t v; } LogEvent_t;
+typedef struct { uint64_t t_us; LOG_Timing_t v; } LogTiming_t;
+typedef struct { uint64_t t_us; LOG_TimeSync_t v; } LogTimeSync_t;
+typedef struct { uint64_t t_us; LOG_Spectrum_t v; } LogSpectrum_t;
+typedef struct { uint64_t t_us; LOG_Storage_t v; } LogStorage_t;
+typedef struct { uint64_t t_us; LOG_Sink_t v; } LogSink_t;
+typedef struct { uint64_t t_us; LOG_Radio_t v; } LogRadio_t;    // v.packet holds v.len bytes
+
+typedef struct {
+  std::vector<LogAccel_t> accel;
+  std::vector<LogBaro_t> baro;
+  std::vector<LogGps_t> gps;
+  std::vector<LogState_t> state;
+  std::vector<LogEvent_t> events;
+  std::vector<LogTiming_t> timing;
+  std::vector<LogTimeSync_t> timesync;
+  std::vector<LogSpectrum_t> spectrum;
+  std::vector<LogStorage_t> storage;
+  std::vector<LogSink_t> sinks;
+  std::vector<LogRadio_t> radio;
+  size_t records;             // Valid records, all types
+  size_t unknown;             // Valid records of a type (or size) this reader does not know
+  size_t skipped;             // Bytes skipped : corruption and a truncated last record
+  size_t journal_slots;       // Valid slots of a journal file, 0 if not a journal
+} LogData_t;
+
+#define LOGREAD_PPS_WINDOW 8          // Neighbours each side used to vet a PPS edge
+#define LOGREAD_PPS_OUTLIER_US 10.0   // Edge stamps further than this off their neighbours are dropped
+
+// MCU time to UTC, from the TIMESYNC records : one point per PPS edge.
+typedef struct {
+  std::vector<int64_t> mcu_us;
+  std::vector<int64_t> utc_us; // Unix time, microseconds
+} LogTimeMap_t;
+
+// Incremental reader for logs too large to load : records are decoded from a
+// window sliding over the file, LOGREAD_STREAM_CHUNK bytes at a time.
+#define LOGREAD_STREAM_CHUNK (1 << 20)
+
+typedef struct {
+  FILE *f;
+  std::vector<uint8_t> buf;
+  size_t pos;                 // Next byte to decode
+  size_t len;                 // Valid bytes in buf
+  bool eof;
+  uint64_t file_pos;          // File offset of the next read
+  uint64_t end;               // Read no further : file size, or end of the journal
+  size_t records;             // Valid records returned
+  size_t skipped;             // Bytes skipped, as in LogData_t
+  size_t journal_slots;       // As in LogData_t
+  // Samples of the last ACCEL_PACK record, returned one ACCEL record each
+  uint64_t unpacked_t_us[LOG_ACCEL_PACK_SAMPLES];
+  LOG_Accel_t unpacked[LOG_ACCEL_PACK_SAMPLES];
+  int unpacked_n, unpacked_at;
+} LogStream_t;
+
+
+/**
+ * @brief Read a whole file into memory.
+ * @return false if the file cannot be opened.
+ */
+bool LOGREAD_load_file(const char *path, std::vector<uint8_t> &data);
+
+/**
+ * @brief Parse a record log. Appends to out, start from LogData_t d = {}.
+ */
+void LOGREAD_parse(const uint8_t *buf, size_t n, LogData_t *out);
+
+/**
+ * @brief Bytes of buf holding the valid slots of a journal, 0 if buf is not a journal.
+ */
+size_t LOGREAD_journal_length(const uint8_t *buf, size_t n);
+
+/**
+ * @brief True if buf starts like a record log (as opposed to legacy frames).
+ */
+bool LOGREAD_is_record_log(const uint8_t *buf, size_t n);
+
+/**
+ * @brief Collect the PPS edge / UTC pairs of a log.
+ *
+ * Pairs rejected onboard, off by whole seconds, or stamped late compared with
+ * their neighbours (interrupt held off) are left out.
+ */
+void LOGREAD_time_map(const LogData_t &d, LogTimeMap_t *map);
+
+/**
+ * @brief MCU time to Unix time in seconds.
+ *
+ * Linear between the PPS edges around t_us (one second apart, so the crystal
+ * drift inside a segment is negligible), extrapolated from the nearest
+ * segment outside them.
+ *
+ * @return false if the map has fewer than two points.
+ */
+bool LOGREAD_utc(const LogTimeMap_t &map, int64_t t_us, double *unix_s);
+
+/**
+ * @brief Open a log for record by record reading.
+ * @return false if the file cannot be opened.
+ */
+bool LOGREAD_stream_open(LogStream_t *s, const char *path);
+
+/**
+ * @brief Next valid record of the log, skipping corruption like LOGREAD_parse().
+ *
+ * rec->payload points into the stream window and is valid until the next call.
+ * An ACCEL_PACK record comes out as its ACCEL samples, each with the size
+ * it would have as an ACCEL record.
+ *
+ * @return false at the end of the file.
+ */
+bool LOGREAD_stream_next(LogStream_t *s, LOG_Record_t *rec);
+
+/**
+ * @brief Continue reading at a byte offset of the file (a record boundary, or
+ * corruption is skipped up to the next valid record).
+ * @return false if the offset cannot be reached.
+ */
+bool LOGREAD_stream_seek(LogStream_t *s, uint64_t offset);
+
+void LOGREAD_stream_close(LogStream_t *s);
+
+#endif /* LOG_READER_H */
@@ -0,0 +1,144 @@
+/**
+ * @file mock_flash.cpp
+ * @brief In memory NOR flash with a timing model, wear counts and power cuts, for storage benchmarks.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "mock_flash.h"
+
+
+const MockFlashTiming_t MOCKFLASH_QSPI_NOR = { "qspi nor 80 MHz", 5.0, 40.0, 40.0, 400.0, 45000.0, 400000.0, 1000.0 };
+
+
+void MOCKFLASH_init(MockFlash_t *f, uint32_t size, const MockFlashTiming_t *timing) {
+  f->timing = *timing;
+  f->size = size / MOCKFLASH_SECTOR * MOCKFLASH_SECTOR;
+  f->mem.assign(f->size, 0xFF);
+  f->erase_count.assign(f->size / MOCKFLASH_SECTOR, 0);
+  f->powered = true;
+  f->cut_at = UINT64_MAX;
+  f->rng.seed(4096);
+  f->clock_us = 0.0;
+  f->worst_program_us = 0.0;
+  f->worst_erase_us = 0.0;
+  f->pages_programmed = 0;
+  f->sectors_erased = 0;
+  f->dirty_programs = 0;
+}
+
+
+// True if the power fails inside this operation.
+static bool cut_now(MockFlash_t *f) {
+  if (f->cut_at == UINT64_MAX) {
+    return false;
+  }
+  if (f->cut_at == 0) {
+    f->powered = false;
+    return true;
+  }
+  f->cut_at--;
+  return false;
+}
+
+
+bool MOCKFLASH_read(MockFlash_t *f, uint32_t offset, void *buf, size_t n) {
+  if (!f->powered || (uint64_t)offset + n > f->size) {
+    return false;
+  }
+  f->clock_us += f->timing.cmd_us + (double)n / f->timing.read_mb_s;
+  memcpy(buf, f->mem.data() + offset, n);
+  return true;
+}
+
+
+bool MOCKFLASH_program(MockFlash_t *f, uint32_t offset, const void *buf, size_t n) {
+  if (!f->powered || (uint64_t)offset + n > f->size) {
+    return false;
+  }
+  const uint8_t *in = (const uint8_t *)buf;
+  double t = 0.0;
+  bool ok = true;
+  while (n > 0) {
+    size_t take = std::min(n, (size_t)(MOCKFLASH_PAGE - offset % MOCKFLASH_PAGE));
+    uint8_t *p = f->mem.data() + offset;
+    t += f->timing.cmd_us + (double)take / f->timing.bus_mb_s + f->timing.page_program_us;
+    if (cut_now(f)) {
+      // Some of the new zeros made it.
+      for (size_t i = 0; i < take; i++) p[i] &= in[i] | (uint8_t)f->rng();
+      ok = false;
+      break;
+    }
+    for (size_t i = 0; i < take; i++) {
+      if ((in[i] & ~p[i]) != 0) f->dirty_programs++;
+      p[i] &= in[i];
+    }
+    f->pages_programmed++;
+    offset += (uint32_t)take;
+    in += take;
+    n -= take;
+  }
+  f->clock_us += t;
+  f->worst_program_us = std::max(f->worst_program_us, t);
+  return ok;
+}
+
+
+bool MOCKFLASH_erase(MockFlash_t *f, uint32_t offset, size_t n) {
+  if (!f->powered || (uint64_t)offset + n > f->size || offset % MOCKFLASH_SECTOR || n % MOCKFLASH_SECTOR) {
+    return false;
+  }
+  double t = 0.0;
+  bool ok = true;
+  for (uint32_t at = offset; at < offset + n; at += MOCKFLASH_SECTOR) {
+    bool slow = f->timing.erase_slow_every > 0.0 &&
+                (f->sectors_erased + 1) % (uint64_t)f->timing.erase_slow_every == 0;
+    t += f->timing.cmd_us + (slow ? f->timing.sector_erase_max_us : f->timing.sector_erase_us);
+    uint8_t *p = f->mem.data() + at;
+    if (cut_now(f)) {
+      // Half erased : a random part of the bits are set.
+      for (size_t i = 0; i < MOCKFLASH_SECTOR; i++) p[i] |= (uint8_t)f->rng();
+      ok = false;
+      break;
+    }
+    memset(p, 0xFF, MOCKFLASH_SECTOR);
+    f->erase_count[at / MOCKFLASH_SECTOR]++;
+    f->sectors_erased++;
+  }
+  f->clock_us += t;
+  f->worst_erase_us = std::max(f->worst_erase_us, t);
+  return ok;
+}
+
+
+void MOCKFLASH_cut_after(MockFlash_t *f, uint64_t ops) {
+  f->cut_at = ops;
+}
+
+
+void MOCKFLASH_power_on(MockFlash_t *f) {
+  f->powered = true;
+  f->cut_at = UINT64_MAX;
+}
+
+
+static bool io_read(void *ctx, uint32_t offset, void *buf, size_t n) {
+  return MOCKFLASH_read((MockFlash_t *)ctx, offset, buf, n);
+}
+
+
+static bool io_write(void *ctx, uint32_t offset, const void *buf, size_t n) {
+  return MOCKFLASH_program((MockFlash_t *)ctx, offset, buf, n);
+}
+
+
+static bool io_erase(void *ctx, uint32_t offset, size_t n) {
+  return MOCKFLASH_erase((MockFlash_t *)ctx, offset, n);
+}
+
+
+FRING_Io_t MOCKFLASH_ring_io(MockFlash_t *f) {
+  FRING_Io_t io = { io_read, io_write, io_erase, f, f->size };
+  return io;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file mock_flash.h
+ * @brief In memory NOR flash with a timing model, wear counts and power cuts, for storage benchmarks.
+ *
+ * NOR semantics : an erase sets a whole 4 KB sector to 0xFF, a program can
+ * only clear bits (the new byte is ANDed in) and goes page by page, 256 bytes
+ * at most per page program. Programming a byte whose bits are not all erased
+ * is allowed (the flash does it) but counted in dirty_programs : the flight
+ * log should never do it.
+ *
+ * Every operation advances a modelled clock :
+ *
+ *  read    = cmd_us + bytes / read rate
+ *  program = per page : cmd_us + 256 bytes on the bus + page_program_us
+ *  erase   = per sector : cmd_us + sector_erase_us, sector_erase_max_us
+ *            for one erase in erase_slow_every
+ *
+ * with the figures of a MockFlashTiming_t profile. Erases are counted per
+ * sector for wear. A power cut set with MOCKFLASH_cut_after() stops the flash
+ * inside an operation : a page being programmed keeps a random part of its new
+ * zeros, a sector being erased is left half erased (random bits set), and
+ * every access fails until MOCKFLASH_power_on().
+ */
+
+#ifndef MOCK_FLASH_H
+#define MOCK_FLASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "flash_ring.h"
+
+
+#define MOCKFLASH_PAGE 256
+#define MOCKFLASH_SECTOR 4096
+
+
+typedef struct {
+  const char *name;
+  double cmd_us;              // Command, address and status polling per operation
+  double read_mb_s;
+  double bus_mb_s;            // Page data into the flash
+  double page_program_us;     // Typical, 256 bytes
+  double sector_erase_us;     // Typical, 4 KB
+  double sector_erase_max_us; // Datasheet maximum
+  double erase_slow_every;    // One erase in this many takes the maximum, 0 for never
+} MockFlashTiming_t;
+
+// Quad SPI NOR of the W25Q128JV class at 80 MHz, the ESP32-S3 module's
+// internal flash : typical page program and sector erase, the maximum erase
+// one time in 1000 (an assumption, datasheets give no distribution).
+extern const MockFlashTiming_t MOCKFLASH_QSPI_NOR;
+
+typedef struct {
+  MockFlashTiming_t timing;
+  uint32_t size;
+  std::vector<uint8_t> mem;
+  std::vector<uint32_t> erase_count;  // Per sector
+
+  bool powered;
+  uint64_t cut_at;            // Power fails inside the operation this many more from now, UINT64_MAX : never
+  std::mt19937 rng;
+
+  double clock_us;            // Modelled time spent in the flash
+  double worst_program_us;    // Longest single program call
+  double worst_erase_us;      // Longest single erase call
+  uint64_t pages_programmed;
+  uint64_t sectors_erased;
+  uint64_t dirty_programs;    // Bytes programmed that were not erased
+} MockFlash_t;
+
+
+/**
+ * @brief A blank flash of size bytes (whole sectors).
+ */
+void MOCKFLASH_init(MockFlash_t *f, uint32_t size, const MockFlashTiming_t *timing);
+
+bool MOCKFLASH_read(MockFlash_t *f, uint32_t offset, void *buf, size_t n);
+
+/**
+ * @brief Program n bytes, split on page boundaries as the flash driver does.
+ */
+bool MOCKFLASH_program(MockFlash_t *f, uint32_t offset, const void *buf, size_t n);
+
+/**
+ * @brief Erase whole sectors, offset and n sector aligned.
+ */
+bool MOCKFLASH_erase(MockFlash_t *f, uint32_t offset, size_t n);
+
+/**
+ * @brief Cut the power inside the ops-th page program or sector erase from now (0 : the next).
+ */
+void MOCKFLASH_cut_after(MockFlash_t *f, uint64_t ops);
+
+/**
+ * @brief Power back on, no cut pending. Contents and statistics are kept.
+ */
+void MOCKFLASH_power_on(MockFlash_t *f);
+
+/**
+ * @brief Flash ring storage on the whole flash.
+ */
+FRING_Io_t MOCKFLASH_ring_io(MockFlash_t *f);
+
+#endif /* MOCK_FLASH_H */
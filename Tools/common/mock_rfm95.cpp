@@ -0,0 +1,197 @@
+/**
+ * @file mock_rfm95.cpp
+ * @brief SX1276 (RFM95) LoRa radio model at the register level, with time on air, for lib/Rfm95.
+ */
+
+#include <cstring>
+
+#include "mock_rfm95.h"
+
+
+#define REG_FIFO 0x00
+#define REG_OP_MODE 0x01
+#define REG_FRF_MSB 0x06
+#define REG_FIFO_ADDR_PTR 0x0D
+#define REG_FIFO_TX_BASE 0x0E
+#define REG_IRQ_FLAGS 0x12
+#define REG_MODEM_CONFIG1 0x1D
+#define REG_MODEM_CONFIG2 0x1E
+#define REG_PREAMBLE_MSB 0x20
+#define REG_PAYLOAD_LENGTH 0x22
+#define REG_MODEM_CONFIG3 0x26
+#define REG_SYNC_WORD 0x39
+#define REG_DIO_MAPPING1 0x40
+#define REG_VERSION 0x42
+
+#define MODE_LORA 0x80
+#define MODE_MASK 0x07
+#define MODE_SLEEP 0x00
+#define MODE_STANDBY 0x01
+#define MODE_TX 0x03
+#define IRQ_TX_DONE 0x08
+
+const MockRfmTiming_t MOCKRFM_ESP32 = { "RFM95 on the ESP32-S3 SPI library, 8 MHz", 8.0, 8.0 };
+
+static const uint32_t BANDWIDTHS[16] = { 7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000 };
+
+
+void MOCKRFM_init(MockRfm_t *m, const MockRfmTiming_t *timing) {
+  m->timing = *timing;
+  m->now_us = 0.0;
+  memset(m->regs, 0, sizeof(m->regs));
+  memset(m->fifo, 0, sizeof(m->fifo));
+  m->regs[REG_OP_MODE] = MODE_STANDBY;
+  m->regs[REG_FRF_MSB] = 0x6C;           // 434 MHz
+  m->regs[REG_FRF_MSB + 1] = 0x80;
+  m->regs[REG_FIFO_TX_BASE] = 0x80;
+  m->regs[REG_MODEM_CONFIG1] = 0x72;     // 125 kHz, 4/5, explicit header
+  m->regs[REG_MODEM_CONFIG2] = 0x70;     // SF7
+  m->regs[REG_PREAMBLE_MSB + 1] = 8;
+  m->regs[REG_PAYLOAD_LENGTH] = 1;
+  m->regs[REG_SYNC_WORD] = 0x12;
+  m->regs[REG_VERSION] = RFM_VERSION;
+  m->tx = false;
+  m->tx_end_us = 0.0;
+  m->air.clear();
+  m->xfers = 0;
+  m->bus_us = m->air_us = 0.0;
+  m->violations = 0;
+}
+
+
+RFM_Config_t MOCKRFM_config(const MockRfm_t *m) {
+  RFM_Config_t c = {};
+  uint64_t frf = (uint64_t)m->regs[REG_FRF_MSB] << 16 | (uint64_t)m->regs[REG_FRF_MSB + 1] << 8 | m->regs[REG_FRF_MSB + 2];
+  c.freq_hz = (uint32_t)((frf * RFM_XTAL_HZ) >> 19);
+  c.bw_hz = BANDWIDTHS[m->regs[REG_MODEM_CONFIG1] >> 4];
+  c.cr = (uint8_t)(((m->regs[REG_MODEM_CONFIG1] >> 1) & 0x07) + 4);
+  c.sf = (uint8_t)(m->regs[REG_MODEM_CONFIG2] >> 4);
+  c.preamble = (uint16_t)(m->regs[REG_PREAMBLE_MSB] << 8 | m->regs[REG_PREAMBLE_MSB + 1]);
+  c.sync_word = m->regs[REG_SYNC_WORD];
+  return c;
+}
+
+
+static uint8_t mode(const MockRfm_t *m) {
+  return m->regs[REG_OP_MODE] & MODE_MASK;
+}
+
+
+// A TX over by now : TxDone, back to standby.
+static void settle(MockRfm_t *m) {
+  if (m->tx && m->now_us >= m->tx_end_us) {
+    m->tx = false;
+    m->regs[REG_IRQ_FLAGS] |= IRQ_TX_DONE;
+    m->regs[REG_OP_MODE] = (uint8_t)((m->regs[REG_OP_MODE] & ~MODE_MASK) | MODE_STANDBY);
+  }
+}
+
+
+static void start_tx(MockRfm_t *m) {
+  uint8_t len = m->regs[REG_PAYLOAD_LENGTH];
+  if (len == 0 || !(m->regs[REG_OP_MODE] & MODE_LORA)) {
+    m->violations++;
+    return;
+  }
+  MockRfmPacket_t p;
+  uint8_t at = m->regs[REG_FIFO_TX_BASE];
+  for (int i = 0; i < len; i++) p.bytes.push_back(m->fifo[(uint8_t)(at + i)]);
+  RFM_Config_t c = MOCKRFM_config(m);
+  double airtime = RFM_airtime_us(&c, len);
+  p.t_start_us = m->now_us;
+  p.t_end_us = m->now_us + airtime;
+  m->air.push_back(p);
+  m->air_us += airtime;
+  m->tx = true;
+  m->tx_end_us = p.t_end_us;
+}
+
+
+static void write_op_mode(MockRfm_t *m, uint8_t v) {
+  uint8_t old = m->regs[REG_OP_MODE];
+  if (((v ^ old) & MODE_LORA) && (old & MODE_MASK) != MODE_SLEEP) {
+    m->violations++;
+    v = (uint8_t)((v & ~MODE_LORA) | (old & MODE_LORA));
+  }
+  if (m->tx && (v & MODE_MASK) != MODE_TX) {
+    // TX cut short : nothing usable went out.
+    m->air_us -= m->tx_end_us - m->now_us;
+    m->air.pop_back();
+    m->tx = false;
+  }
+  m->regs[REG_OP_MODE] = v;
+  if ((v & MODE_MASK) == MODE_TX && !m->tx) {
+    start_tx(m);
+    if (!m->tx) m->regs[REG_OP_MODE] = (uint8_t)((v & ~MODE_MASK) | MODE_STANDBY);
+  }
+}
+
+
+static bool modem_reg(uint8_t reg) {
+  return (reg >= REG_FRF_MSB && reg <= REG_FRF_MSB + 2) || reg == REG_MODEM_CONFIG1 || reg == REG_MODEM_CONFIG2 ||
+         (reg >= REG_PREAMBLE_MSB && reg <= REG_PAYLOAD_LENGTH) || reg == REG_MODEM_CONFIG3 ||
+         reg == REG_FIFO_TX_BASE;
+}
+
+
+static bool xfer(void *ctx, uint8_t addr, const uint8_t *tx, uint8_t *rx, size_t n) {
+  MockRfm_t *m = (MockRfm_t *)ctx;
+  double t = m->timing.xfer_us + (double)(1 + n) * 8.0 / m->timing.spi_mhz;
+  m->now_us += t;
+  m->bus_us += t;
+  m->xfers++;
+  settle(m);
+  bool write = addr & 0x80;
+  uint8_t reg = addr & 0x7F;
+  for (size_t i = 0; i < n; i++) {
+    if (reg == REG_FIFO) {
+      // The FIFO keeps its address, RegFifoAddrPtr moves on.
+      if (m->tx || mode(m) == MODE_SLEEP) m->violations++;
+      uint8_t &ptr = m->regs[REG_FIFO_ADDR_PTR];
+      if (write) m->fifo[ptr] = tx ? tx[i] : 0;
+      else if (rx) rx[i] = m->fifo[ptr];
+      ptr++;
+      continue;
+    }
+    if (write) {
+      uint8_t v = tx ? tx[i] : 0;
+      if (reg == REG_OP_MODE) {
+        write_op_mode(m, v);
+      } else if (reg == REG_IRQ_FLAGS) {
+        m->regs[reg] &= (uint8_t)~v;
+      } else if (reg != REG_VERSION) {
+        if (m->tx && modem_reg(reg)) m->violations++;
+        m->regs[reg] = v;
+      }
+    } else if (rx) {
+      rx[i] = m->regs[reg];
+    }
+    reg = (uint8_t)((reg + 1) & 0x7F);
+  }
+  return true;
+}
+
+
+static uint32_t now_us(void *ctx) {
+  MockRfm_t *m = (MockRfm_t *)ctx;
+  m->now_us += MOCKRFM_CLOCK_READ_US;
+  return (uint32_t)(uint64_t)m->now_us;
+}
+
+
+RFM_Bus_t MOCKRFM_bus(MockRfm_t *m) {
+  RFM_Bus_t bus = { xfer, now_us, m };
+  return bus;
+}
+
+
+void MOCKRFM_advance(MockRfm_t *m, double t_us) {
+  if (t_us > m->now_us) m->now_us = t_us;
+  settle(m);
+}
+
+
+bool MOCKRFM_dio0(MockRfm_t *m) {
+  settle(m);
+  return (m->regs[REG_DIO_MAPPING1] >> 6) == 1 && (m->regs[REG_IRQ_FLAGS] & IRQ_TX_DONE);
+}
@@ -0,0 +1,102 @@
+/**
+ * @file mock_rfm95.h
+ * @brief SX1276 (RFM95) LoRa radio model at the register level, with time on air, for lib/Rfm95.
+ *
+ * Answers the register accesses lib/Rfm95 makes through its RFM_Bus_t
+ * callbacks (MOCKRFM_bus()) as the chip does :
+ *
+ * - RegOpMode : LongRangeMode only taken in sleep, sleep / standby / TX;
+ * - RegFifo through RegFifoAddrPtr, auto incremented, 256 bytes;
+ * - RegIrqFlags, TxDone cleared by writing it 1; DIO0 follows TxDone when
+ *   RegDioMapping1 maps it there;
+ * - the modem registers (frequency, bandwidth, coding rate, spreading
+ *   factor, preamble, LDRO), read back as written; RegVersion 0x12.
+ *
+ * A TX takes RegPayloadLength bytes from RegFifoTxBaseAddr and stays on the
+ * air for the SX1276 time on air of those settings, then sets TxDone and
+ * goes back to standby. Every packet sent is kept in air with its start and
+ * end, for a receiver model to pick up.
+ *
+ * Anything the chip would ignore or get wrong is counted in violations :
+ * LongRangeMode changed outside sleep, the FIFO touched in sleep or during
+ * a TX, a TX of 0 bytes, modem settings changed during a TX. A driver that
+ * gets the protocol right keeps it at 0.
+ *
+ * Time : a modelled clock (now_us) that every transaction advances by
+ * xfer_us plus its bytes at the SPI clock, and every now_us() call by
+ * MOCKRFM_CLOCK_READ_US. The caller moves it on between calls with
+ * MOCKRFM_advance().
+ */
+
+#ifndef MOCK_RFM95_H
+#define MOCK_RFM95_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "rfm95.h"
+
+
+#define MOCKRFM_CLOCK_READ_US 0.1     // Reading the MCU timer
+
+
+typedef struct {
+  const char *name;
+  double spi_mhz;             // SPI clock
+  double xfer_us;             // Per transaction : chip select, driver and bus set up
+} MockRfmTiming_t;
+
+// RFM95 behind the ESP32-S3 SPI library at 8 MHz, sharing SPI3 with the W25Q.
+extern const MockRfmTiming_t MOCKRFM_ESP32;
+
+typedef struct {
+  double t_start_us;
+  double t_end_us;
+  std::vector<uint8_t> bytes;
+} MockRfmPacket_t;
+
+typedef struct {
+  MockRfmTiming_t timing;
+  double now_us;
+  uint8_t regs[128];
+  uint8_t fifo[256];
+  bool tx;                    // On the air until tx_end_us
+  double tx_end_us;
+
+  std::vector<MockRfmPacket_t> air;  // Every packet sent, oldest first
+
+  // Statistics
+  uint64_t xfers;
+  double bus_us;              // Time in transactions
+  double air_us;              // Time on the air
+  uint64_t violations;
+} MockRfm_t;
+
+
+/**
+ * @brief A radio just out of reset : FSK standby, registers at their defaults.
+ */
+void MOCKRFM_init(MockRfm_t *m, const MockRfmTiming_t *timing);
+
+/**
+ * @brief RFM_Bus_t callbacks on the radio.
+ */
+RFM_Bus_t MOCKRFM_bus(MockRfm_t *m);
+
+/**
+ * @brief Move the clock on to t_us, if later (the MCU busy elsewhere). A TX over by then ends.
+ */
+void MOCKRFM_advance(MockRfm_t *m, double t_us);
+
+/**
+ * @brief Level of DIO0 (TxDone mapped there and set).
+ */
+bool MOCKRFM_dio0(MockRfm_t *m);
+
+/**
+ * @brief The modem settings the registers hold.
+ */
+RFM_Config_t MOCKRFM_config(const MockRfm_t *m);
+
+#endif /* MOCK_RFM95_H */
@@ -0,0 +1,158 @@
+/**
+ * @file mock_sd.cpp
+ * @brief In memory SD card with a latency model and power cuts, for storage benchmarks.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "mock_sd.h"
+
+
+const MockSdTiming_t MOCKSD_SPI_20MHZ = { "spi 20 MHz", 150.0, 250.0, 2.3, 2.1, 4.0, 30000.0, 1500.0, 32.0, 150000.0 };
+const MockSdTiming_t MOCKSD_SDMMC_4BIT = { "sdmmc 4 bit 40 MHz", 60.0, 250.0, 18.0, 10.0, 4.0, 30000.0, 1500.0, 32.0, 150000.0 };
+
+
+void MOCKSD_init(MockSd_t *sd, uint64_t size, const MockSdTiming_t *timing) {
+  sd->timing = *timing;
+  sd->size = size;
+  sd->pages.clear();
+  sd->blank = NULL;
+  sd->blank_ctx = NULL;
+  sd->powered = true;
+  sd->cut_at = UINT64_MAX;
+  sd->rng.seed(512);
+  sd->clock_us = 0.0;
+  sd->worst_write_us = 0.0;
+  sd->reads = sd->writes = 0;
+  sd->bytes_read = sd->bytes_written = 0;
+  sd->stall_credit = 0.0;
+  sd->stream_end[0] = sd->stream_end[1] = 0;
+  sd->random_writes = 0;
+}
+
+
+// Page holding offset, allocated (filled from the blank content) on first write.
+static uint8_t *page_for_write(MockSd_t *sd, uint64_t page) {
+  auto it = sd->pages.find(page);
+  if (it != sd->pages.end()) return it->second.data();
+  std::vector<uint8_t> &p = sd->pages[page];
+  p.resize(MOCKSD_PAGE);
+  if (sd->blank) sd->blank(sd->blank_ctx, page * MOCKSD_PAGE, p.data(), MOCKSD_PAGE);
+  else memset(p.data(), 0, MOCKSD_PAGE);
+  return p.data();
+}
+
+
+bool MOCKSD_read(MockSd_t *sd, uint64_t offset, void *buf, size_t n) {
+  if (!sd->powered || offset + n > sd->size) {
+    return false;
+  }
+  sd->reads++;
+  sd->bytes_read += n;
+  sd->clock_us += sd->timing.read_cmd_us + (double)n / sd->timing.read_mb_s;
+
+  uint8_t *out = (uint8_t *)buf;
+  while (n > 0) {
+    uint64_t page = offset / MOCKSD_PAGE;
+    size_t at = (size_t)(offset % MOCKSD_PAGE);
+    size_t take = std::min(n, (size_t)MOCKSD_PAGE - at);
+    auto it = sd->pages.find(page);
+    if (it != sd->pages.end()) memcpy(out, it->second.data() + at, take);
+    else if (sd->blank) sd->blank(sd->blank_ctx, offset, out, take);
+    else memset(out, 0, take);
+    out += take;
+    offset += take;
+    n -= take;
+  }
+  return true;
+}
+
+
+bool MOCKSD_write(MockSd_t *sd, uint64_t offset, const void *buf, size_t n) {
+  if (!sd->powered || offset + n > sd->size) {
+    return false;
+  }
+  double t = sd->timing.write_cmd_us + (double)n / sd->timing.write_mb_s;
+  sd->stall_credit += (double)n;
+  if (sd->timing.stall_every_mb > 0.0 && sd->stall_credit >= sd->timing.stall_every_mb * 1e6) {
+    sd->stall_credit -= sd->timing.stall_every_mb * 1e6;
+    t += sd->timing.stall_us;
+  }
+  if (offset == sd->stream_end[0]) {
+    sd->stream_end[0] = offset + n;
+  } else {
+    if (offset != sd->stream_end[1]) {
+      t += sd->timing.random_write_us;
+      sd->random_writes++;
+      if (sd->timing.merge_every > 0.0 && sd->random_writes % (uint64_t)sd->timing.merge_every == 0) {
+        t += sd->timing.merge_us;
+      }
+    }
+    sd->stream_end[1] = sd->stream_end[0];
+    sd->stream_end[0] = offset + n;
+  }
+  sd->clock_us += t;
+  sd->worst_write_us = std::max(sd->worst_write_us, t);
+  sd->writes++;
+
+  // Sectors up to the cut are programmed, the one it falls in is garbage.
+  size_t keep = n;
+  bool cut = sd->cut_at < n;
+  if (cut) keep = (size_t)sd->cut_at;
+  else if (sd->cut_at != UINT64_MAX) sd->cut_at -= n;
+
+  const uint8_t *in = (const uint8_t *)buf;
+  size_t done = 0;
+  while (done < keep) {
+    uint64_t at = offset + done;
+    size_t in_page = (size_t)(at % MOCKSD_PAGE);
+    size_t take = std::min(keep - done, (size_t)MOCKSD_PAGE - in_page);
+    memcpy(page_for_write(sd, at / MOCKSD_PAGE) + in_page, in + done, take);
+    done += take;
+  }
+  sd->bytes_written += keep;
+  if (!cut) {
+    return true;
+  }
+  uint64_t torn = std::max(offset, (offset + keep) / MOCKSD_SECTOR * MOCKSD_SECTOR);
+  if (torn < offset + n) {
+    uint8_t *p = page_for_write(sd, torn / MOCKSD_PAGE) + torn % MOCKSD_PAGE;
+    size_t len = std::min((size_t)MOCKSD_SECTOR, (size_t)(MOCKSD_PAGE - torn % MOCKSD_PAGE));
+    for (size_t i = 0; i < len; i++) p[i] = (uint8_t)sd->rng();
+  }
+  sd->powered = false;
+  return false;
+}
+
+
+void MOCKSD_cut_after(MockSd_t *sd, uint64_t bytes) {
+  sd->cut_at = bytes;
+}
+
+
+void MOCKSD_power_on(MockSd_t *sd) {
+  sd->powered = true;
+  sd->cut_at = UINT64_MAX;
+}
+
+
+static bool io_read(void *ctx, uint64_t offset, void *buf, size_t n) {
+  return MOCKSD_read((MockSd_t *)ctx, offset, buf, n);
+}
+
+
+static bool io_write(void *ctx, uint64_t offset, const void *buf, size_t n) {
+  return MOCKSD_write((MockSd_t *)ctx, offset, buf, n);
+}
+
+
+static bool io_sync(void *ctx) {
+  return ((MockSd_t *)ctx)->powered;
+}
+
+
+JRNL_Io_t MOCKSD_journal_io(MockSd_t *sd) {
+  JRNL_Io_t io = { io_read, io_write, io_sync, sd, sd->size };
+  return io;
+}
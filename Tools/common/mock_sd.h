@@ -0,0 +1,108 @@
+/**
+ * @file mock_sd.h
+ * @brief In memory SD card with a latency model and power cuts, for storage benchmarks.
+ *
+ * Byte addressed storage of any size (up to the 4 GB of a FAT32 file and
+ * beyond) : only the 64 KB pages written are allocated, the rest reads as
+ * what the blank callback says (zeros by default, or the content of a card
+ * already filled, generated on demand).
+ *
+ * Every read and write advances a modelled clock :
+ *
+ *  t = command latency + bytes / bus rate   (+ a busy stall every stall_every bytes written)
+ *
+ * with the figures of a MockSdTiming_t profile. The card follows two write
+ * streams (a data stream and the file system metadata, say) : a write that
+ * continues neither is random, costs random_write_us more, and every
+ * merge_every random writes the card stops for merge_us to fold its random
+ * write buffer back into its erase blocks. Rewriting FAT and directory
+ * sectors is what triggers those merges on a real card. A power cut set with
+ * MOCKSD_cut_after() stops the card inside a write : sectors before the cut
+ * keep the new data, the sector being programmed gets garbage, the ones after
+ * keep their old content, and every access fails until MOCKSD_power_on().
+ */
+
+#ifndef MOCK_SD_H
+#define MOCK_SD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "log_journal.h"
+
+
+#define MOCKSD_SECTOR 512
+#define MOCKSD_PAGE (64 * 1024)
+
+
+typedef struct {
+  const char *name;
+  double read_cmd_us;         // Command to first data byte
+  double write_cmd_us;        // Command and programming busy per write
+  double read_mb_s;           // Bus rate
+  double write_mb_s;
+  double stall_every_mb;      // Internal housekeeping stall after this much written, 0 for none
+  double stall_us;
+  double random_write_us;     // Extra busy for a write continuing neither write stream
+  double merge_every;         // Random writes buffered before a merge, 0 for none
+  double merge_us;
+} MockSdTiming_t;
+
+// SPI mode at 20 MHz (2.5 MB/s on the wire), figures of a class 10 card. The
+// random write figures are assumptions, in the range logging benchmarks of
+// cards without the A1 random write rating report.
+extern const MockSdTiming_t MOCKSD_SPI_20MHZ;
+
+// SDMMC host, 4 bit bus at 40 MHz (20 MB/s on the wire) : the same card, its
+// class 10 write rate now the limit. Command, programming busy, housekeeping
+// and random write figures are the card's, the same as in SPI mode.
+extern const MockSdTiming_t MOCKSD_SDMMC_4BIT;
+
+typedef struct {
+  MockSdTiming_t timing;
+  uint64_t size;
+  std::unordered_map<uint64_t, std::vector<uint8_t>> pages;
+  void (*blank)(void *ctx, uint64_t offset, uint8_t *buf, size_t n);  // Content never written, NULL : zeros
+  void *blank_ctx;
+
+  bool powered;
+  uint64_t cut_at;            // Power fails once this many more bytes are written, UINT64_MAX : never
+  std::mt19937 rng;
+
+  double clock_us;            // Modelled time spent in the card
+  double worst_write_us;      // Longest single write
+  uint64_t reads;
+  uint64_t writes;
+  uint64_t bytes_read;
+  uint64_t bytes_written;
+  double stall_credit;        // Bytes written since the last stall
+  uint64_t stream_end[2];     // Where the two write streams continue, [0] most recent
+  uint64_t random_writes;
+} MockSd_t;
+
+
+void MOCKSD_init(MockSd_t *sd, uint64_t size, const MockSdTiming_t *timing);
+
+bool MOCKSD_read(MockSd_t *sd, uint64_t offset, void *buf, size_t n);
+
+bool MOCKSD_write(MockSd_t *sd, uint64_t offset, const void *buf, size_t n);
+
+/**
+ * @brief Cut the power after bytes more bytes are written.
+ */
+void MOCKSD_cut_after(MockSd_t *sd, uint64_t bytes);
+
+/**
+ * @brief Power back on, no cut pending. Statistics are kept.
+ */
+void MOCKSD_power_on(MockSd_t *sd);
+
+/**
+ * @brief Journal storage on the card, offset 0 to size.
+ */
+JRNL_Io_t MOCKSD_journal_io(MockSd_t *sd);
+
+#endif /* MOCK_SD_H */
@@ -0,0 +1,268 @@
+/**
+ * @file mock_w25q.cpp
+ * @brief W25Q class SPI NOR chip model at the command level, with timing and power cuts, for lib/SpiNor.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "mock_w25q.h"
+
+
+const MockW25QTiming_t MOCKW25Q_STM32G0 = { "W25Q128JV, STM32G030 SPI1 8 MHz", 8.0, 3.0, 400.0, 45000.0,
+                                             150000.0, 2000000.0, 40e6, 20.0, 1000.0 };
+const MockW25QTiming_t MOCKW25Q_ESP32 = { "W25Q128JV, ESP32-S3 SPI 40 MHz", 40.0, 10.0, 400.0, 45000.0,
+                                          150000.0, 2000000.0, 40e6, 20.0, 1000.0 };
+
+
+void MOCKW25Q_init(MockW25Q_t *m, uint32_t size, const MockW25QTiming_t *timing) {
+  m->timing = *timing;
+  MOCKFLASH_init(&m->flash, size, &MOCKFLASH_QSPI_NOR);
+  m->now_us = 0.0;
+  m->op = MOCKW25Q_IDLE;
+  m->op_start_us = m->busy_until_us = 0.0;
+  m->wel = false;
+  m->op_addr = m->op_size = 0;
+  m->suspended = false;
+  m->sus_addr = m->sus_size = 0;
+  m->sus_left_us = 0.0;
+  m->powered = true;
+  m->cut_at = UINT64_MAX;
+  m->rng.seed(25);
+  m->xfers = 0;
+  m->bus_us = m->chip_busy_us = 0.0;
+  m->programs = m->erases = m->suspends = 0;
+  m->violations = 0;
+}
+
+
+static bool overlaps(uint32_t a, uint32_t a_size, uint32_t b, uint32_t b_size) {
+  return a < b + b_size && b < a + a_size;
+}
+
+
+// Program the bytes of the page buffer, wrapping inside the page as the chip does.
+static void apply_program(MockW25Q_t *m) {
+  uint32_t base = m->op_addr - m->op_addr % MOCKFLASH_PAGE;
+  uint32_t off = m->op_addr % MOCKFLASH_PAGE;
+  uint32_t first = std::min(m->op_size, (uint32_t)MOCKFLASH_PAGE - off);
+  MOCKFLASH_program(&m->flash, base + off, m->page + off, first);
+  if (first < m->op_size) {
+    MOCKFLASH_program(&m->flash, base, m->page, m->op_size - first);
+  }
+}
+
+
+// The operation in progress ends once its time is up.
+static void settle(MockW25Q_t *m) {
+  if (m->op == MOCKW25Q_IDLE || m->now_us < m->busy_until_us) {
+    return;
+  }
+  switch (m->op) {
+    case MOCKW25Q_PROGRAM:
+      apply_program(m);
+      m->chip_busy_us += m->busy_until_us - m->op_start_us;
+      m->wel = false;
+      break;
+    case MOCKW25Q_ERASE:
+      MOCKFLASH_erase(&m->flash, m->op_addr, m->op_size);
+      m->chip_busy_us += m->busy_until_us - m->op_start_us;
+      m->wel = false;
+      break;
+    case MOCKW25Q_SUSPEND:
+      m->suspended = true;
+      break;
+    default:
+      break;
+  }
+  m->op = MOCKW25Q_IDLE;
+}
+
+
+// Power fails inside the operation just started : it is torn, the suspended erase too.
+static bool cut_now(MockW25Q_t *m) {
+  if (m->cut_at == UINT64_MAX) {
+    return false;
+  }
+  if (m->cut_at > 0) {
+    m->cut_at--;
+    return false;
+  }
+  uint8_t *mem = m->flash.mem.data();
+  if (m->op == MOCKW25Q_PROGRAM) {
+    for (uint32_t i = 0; i < m->op_size; i++) {
+      uint32_t at = m->op_addr - m->op_addr % MOCKFLASH_PAGE + (m->op_addr + i) % MOCKFLASH_PAGE;
+      mem[at] &= m->page[at % MOCKFLASH_PAGE] | (uint8_t)m->rng();
+    }
+  } else {
+    for (uint32_t i = 0; i < m->op_size; i++) mem[m->op_addr + i] = (uint8_t)m->rng();
+  }
+  if (m->suspended) {
+    for (uint32_t i = 0; i < m->sus_size; i++) mem[m->sus_addr + i] = (uint8_t)m->rng();
+  }
+  m->powered = false;
+  m->op = MOCKW25Q_IDLE;
+  m->suspended = false;
+  return true;
+}
+
+
+static void start(MockW25Q_t *m, MockW25QOp_t op, uint32_t addr, uint32_t size, double us) {
+  m->op = op;
+  m->op_addr = addr;
+  m->op_size = size;
+  m->op_start_us = m->now_us;
+  m->busy_until_us = m->now_us + us;
+  if (op == MOCKW25Q_PROGRAM) m->programs++;
+  else m->erases++;
+  cut_now(m);
+}
+
+
+static double erase_time(MockW25Q_t *m, double typical_us) {
+  bool slow = m->timing.erase_slow_every > 0.0 && (m->erases + 1) % (uint64_t)m->timing.erase_slow_every == 0;
+  return slow ? typical_us * m->timing.block_erase_max_us / m->timing.block_erase_us : typical_us;
+}
+
+
+static bool xfer(void *ctx, const uint8_t *cmd, size_t n_cmd, const uint8_t *tx, uint8_t *rx, size_t n) {
+  MockW25Q_t *m = (MockW25Q_t *)ctx;
+  double t = m->timing.xfer_us + (double)(n_cmd + n) * 8.0 / m->timing.spi_mhz;
+  m->now_us += t;
+  m->bus_us += t;
+  m->xfers++;
+  if (!m->powered) {
+    return false;
+  }
+  settle(m);
+  uint32_t addr = n_cmd >= 4 ? ((uint32_t)cmd[1] << 16 | (uint32_t)cmd[2] << 8 | cmd[3]) : 0;
+  bool busy = m->op != MOCKW25Q_IDLE;
+
+  switch (cmd[0]) {
+    case 0x05:
+      if (rx) memset(rx, (busy ? 0x01 : 0) | (m->wel ? 0x02 : 0), n);
+      return true;
+    case 0x35:
+      if (rx) memset(rx, m->suspended ? 0x80 : 0, n);
+      return true;
+    case 0x75:
+      if (m->op == MOCKW25Q_ERASE && m->op_size == m->flash.size) {
+        m->violations++;          // No suspending a chip erase
+      } else if (m->op == MOCKW25Q_ERASE) {
+        m->sus_addr = m->op_addr;
+        m->sus_size = m->op_size;
+        m->sus_left_us = m->busy_until_us - m->now_us;
+        m->chip_busy_us += m->now_us - m->op_start_us;
+        m->op = MOCKW25Q_SUSPEND;
+        m->busy_until_us = m->now_us + m->timing.suspend_us;
+        m->suspends++;
+      }
+      return true;                // Ignored when no erase runs
+    default:
+      break;
+  }
+  if (busy) {
+    m->violations++;
+    return true;
+  }
+
+  switch (cmd[0]) {
+    case 0x06:
+      m->wel = true;
+      break;
+    case 0x7A:
+      if (m->suspended) {
+        m->suspended = false;
+        m->op = MOCKW25Q_ERASE;
+        m->op_addr = m->sus_addr;
+        m->op_size = m->sus_size;
+        m->op_start_us = m->now_us;
+        m->busy_until_us = m->now_us + m->sus_left_us;
+      }
+      break;
+    case 0x02:
+      if (!m->wel || n_cmd != 4 || n == 0 || addr >= m->flash.size ||
+          (m->suspended && overlaps(addr - addr % MOCKFLASH_PAGE, MOCKFLASH_PAGE, m->sus_addr, m->sus_size))) {
+        m->violations++;
+        break;
+      }
+      // More than a page : the last 256 bytes are kept, as the chip does.
+      if (n > MOCKFLASH_PAGE) {
+        tx += n - MOCKFLASH_PAGE;
+        addr += (uint32_t)(n - MOCKFLASH_PAGE) % MOCKFLASH_PAGE;
+        n = MOCKFLASH_PAGE;
+      }
+      memset(m->page, 0xFF, sizeof(m->page));
+      for (size_t i = 0; i < n; i++) m->page[(addr + i) % MOCKFLASH_PAGE] = tx[i];
+      start(m, MOCKW25Q_PROGRAM, addr, (uint32_t)n, m->timing.page_program_us);
+      break;
+    case 0x20:
+    case 0xD8:
+    case 0xC7: {
+      uint32_t size = cmd[0] == 0x20 ? NOR_SECTOR_SIZE : cmd[0] == 0xD8 ? NOR_BLOCK_SIZE : m->flash.size;
+      if (!m->wel || m->suspended || (cmd[0] != 0xC7 && n_cmd != 4) || addr >= m->flash.size) {
+        m->violations++;
+        break;
+      }
+      addr -= addr % size;
+      double us = cmd[0] == 0x20 ? m->timing.sector_erase_us
+                  : cmd[0] == 0xD8 ? m->timing.block_erase_us : m->timing.chip_erase_us;
+      start(m, MOCKW25Q_ERASE, addr, size, erase_time(m, us));
+      break;
+    }
+    case 0x0B:
+      if (n_cmd != 5 || (uint64_t)addr + n > m->flash.size ||
+          (m->suspended && overlaps(addr, (uint32_t)n, m->sus_addr, m->sus_size))) {
+        m->violations++;
+        if (rx) memset(rx, 0xFF, n);
+        break;
+      }
+      if (rx) memcpy(rx, m->flash.mem.data() + addr, n);
+      break;
+    case 0x9F: {
+      uint8_t id[3] = { 0xEF, 0x40, 0 };
+      while ((1u << id[2]) < m->flash.size) id[2]++;
+      for (size_t i = 0; rx && i < n; i++) rx[i] = i < 3 ? id[i] : 0;
+      break;
+    }
+    case 0xAB:
+      if (rx) memset(rx, 0x17, n);
+      break;
+    default:
+      m->violations++;
+      break;
+  }
+  return m->powered;
+}
+
+
+static uint32_t now_us(void *ctx) {
+  MockW25Q_t *m = (MockW25Q_t *)ctx;
+  m->now_us += MOCKW25Q_CLOCK_READ_US;
+  return (uint32_t)(uint64_t)m->now_us;
+}
+
+
+NOR_Bus_t MOCKW25Q_bus(MockW25Q_t *m) {
+  NOR_Bus_t bus = { xfer, now_us, NULL, m };
+  return bus;
+}
+
+
+void MOCKW25Q_advance(MockW25Q_t *m, double t_us) {
+  if (t_us > m->now_us) m->now_us = t_us;
+}
+
+
+void MOCKW25Q_cut_after(MockW25Q_t *m, uint64_t ops) {
+  m->cut_at = ops;
+}
+
+
+void MOCKW25Q_power_on(MockW25Q_t *m) {
+  m->powered = true;
+  m->cut_at = UINT64_MAX;
+  m->op = MOCKW25Q_IDLE;
+  m->wel = false;
+  m->suspended = false;
+}
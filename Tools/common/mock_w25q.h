@@ -0,0 +1,127 @@
+/**
+ * @file mock_w25q.h
+ * @brief W25Q class SPI NOR chip model at the command level, with timing and power cuts, for lib/SpiNor.
+ *
+ * Answers the commands lib/SpiNor sends through its NOR_Bus_t callbacks
+ * (MOCKW25Q_bus()) as the chip does :
+ *
+ * - 05h / 35h status registers : BUSY, WEL, SUS;
+ * - 06h write enable, 02h page program (wrapping inside the page), 20h / D8h
+ *   / C7h sector, block and chip erase, each clearing WEL when done;
+ * - 75h erase suspend (BUSY for suspend_us, then SUS set, the rest of the
+ *   erase kept), 7Ah resume (the rest of the erase goes on);
+ * - 0Bh fast read, 9Fh JEDEC id, ABh release from power down.
+ *
+ * Contents, wear and dirty programs are those of a MockFlash_t
+ * (common/mock_flash.h, its own clock unused). A program or erase changes the
+ * contents when it ends, so a power cut before that tears it as the flash
+ * does : part of the new zeros of a page, random bytes over an erase (the
+ * chip programs the area to 0 before erasing it, blank or not).
+ *
+ * Anything the chip would ignore or get wrong is counted in violations
+ * instead : a command other than a status read or a suspend while BUSY, a
+ * program or erase without WEL, a program, read or erase inside a suspended
+ * erase, a resume with nothing suspended while BUSY. A driver that gets the
+ * protocol right keeps it at 0.
+ *
+ * Time : a modelled clock (now_us) that every transaction advances by
+ * xfer_us plus its bytes at the SPI clock, and every now_us() call by
+ * MOCKW25Q_CLOCK_READ_US. The caller moves it on between calls with
+ * MOCKW25Q_advance() (the rest of the firmware running).
+ */
+
+#ifndef MOCK_W25Q_H
+#define MOCK_W25Q_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+#include "mock_flash.h"
+#include "spi_nor.h"
+
+
+#define MOCKW25Q_CLOCK_READ_US 0.1    // Reading the MCU timer
+
+
+typedef struct {
+  const char *name;
+  double spi_mhz;             // SPI clock
+  double xfer_us;             // Per transaction : chip select, driver and bus set up
+  double page_program_us;     // Typical, 256 bytes
+  double sector_erase_us;     // Typical, 4 KB
+  double block_erase_us;      // Typical, 64 KB
+  double block_erase_max_us;  // Datasheet maximum, sectors scaled the same
+  double chip_erase_us;
+  double suspend_us;          // tSUS, erase suspend to ready
+  double erase_slow_every;    // One erase in this many takes the maximum, 0 for never
+} MockW25QTiming_t;
+
+// W25Q128JV (datasheet typicals, the maximum one erase in 1000 as for
+// MOCKFLASH_QSPI_NOR) behind SPI1 of the STM32G030 at 8 MHz (HSI 16 MHz / 2),
+// polled register access.
+extern const MockW25QTiming_t MOCKW25Q_STM32G0;
+// The same chip behind the ESP32-S3 SPI library at 40 MHz.
+extern const MockW25QTiming_t MOCKW25Q_ESP32;
+
+typedef enum {
+  MOCKW25Q_IDLE = 0,
+  MOCKW25Q_PROGRAM,
+  MOCKW25Q_ERASE,
+  MOCKW25Q_SUSPEND,
+} MockW25QOp_t;
+
+typedef struct {
+  MockW25QTiming_t timing;
+  MockFlash_t flash;          // Contents, wear, dirty programs
+  double now_us;
+
+  MockW25QOp_t op;
+  double op_start_us;         // Started or resumed
+  double busy_until_us;
+  bool wel;
+  uint32_t op_addr, op_size;  // Bytes being programmed (inside one page) or erased
+  uint8_t page[MOCKFLASH_PAGE];  // Data of the page program
+  bool suspended;
+  uint32_t sus_addr, sus_size;
+  double sus_left_us;         // Erase time left when suspended
+
+  bool powered;
+  uint64_t cut_at;            // Power fails inside the program or erase this many more from now, UINT64_MAX : never
+  std::mt19937 rng;
+
+  // Statistics
+  uint64_t xfers;
+  double bus_us;              // Time in transactions
+  double chip_busy_us;        // Programming or erasing, suspended time excluded
+  uint64_t programs, erases, suspends;
+  uint64_t violations;
+} MockW25Q_t;
+
+
+/**
+ * @brief A blank chip of size bytes (a power of two, 16 MB at most).
+ */
+void MOCKW25Q_init(MockW25Q_t *m, uint32_t size, const MockW25QTiming_t *timing);
+
+/**
+ * @brief NOR_Bus_t callbacks on the chip, idle NULL.
+ */
+NOR_Bus_t MOCKW25Q_bus(MockW25Q_t *m);
+
+/**
+ * @brief Move the clock on to t_us, if later (the MCU busy elsewhere).
+ */
+void MOCKW25Q_advance(MockW25Q_t *m, double t_us);
+
+/**
+ * @brief Cut the power inside the ops-th page program or erase started from now (0 : the next).
+ */
+void MOCKW25Q_cut_after(MockW25Q_t *m, uint64_t ops);
+
+/**
+ * @brief Power back on : idle, nothing suspended, no cut pending. Contents and statistics are kept.
+ */
+void MOCKW25Q_power_on(MockW25Q_t *m);
+
+#endif /* MOCK_W25Q_H */
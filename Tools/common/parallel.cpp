@@ -0,0 +1,36 @@
+/**
+ * @file parallel.cpp
+ * @brief Run independent tasks over a set of worker threads.
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+
+
+int PARALLEL_threads(int requested) {
+  if (requested > 0) {
+    return requested;
+  }
+  unsigned hw = std::thread::hardware_concurrency();
+  return hw ? (int)hw : 1;
+}
+
+
+void PARALLEL_for(size_t n_tasks, int threads, const std::function<void(size_t)> &task) {
+  if (threads <= 1 || n_tasks <= 1) {
+    for (size_t k = 0; k < n_tasks; k++) task(k);
+    return;
+  }
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t k = next++; k < n_tasks; k = next++) task(k);
+  };
+  size_t spawn = (size_t)threads - 1 < n_tasks - 1 ? (size_t)threads - 1 : n_tasks - 1;
+  std::vector<std::thread> pool;
+  for (size_t i = 0; i < spawn; i++) pool.emplace_back(worker);
+  worker();
+  for (std::thread &t : pool) t.join();
+}
@@ -0,0 +1,27 @@
+/**
+ * @file parallel.h
+ * @brief Run independent tasks over a set of worker threads.
+ *
+ * Tasks are numbered 0..n-1 and handed out one at a time from a shared
+ * counter, so uneven tasks balance themselves. The calling thread works too;
+ * with one thread everything runs inline, in order.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+
+/**
+ * @brief Worker count to use : requested if > 0, else the number of hardware threads.
+ */
+int PARALLEL_threads(int requested);
+
+/**
+ * @brief Run task(0) .. task(n_tasks - 1) on up to threads threads, return when all are done.
+ */
+void PARALLEL_for(size_t n_tasks, int threads, const std::function<void(size_t)> &task);
+
+#endif /* PARALLEL_H */
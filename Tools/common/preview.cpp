@@ -0,0 +1,326 @@
+/**
+ * @file preview.cpp
+ * @brief Multi resolution preview of the channels of a log, for plotting at any zoom.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "parallel.h"
+#include "preview.h"
+
+
+uint64_t PREVIEW_hash(const uint8_t *buf, size_t n) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < n; i++) {
+    h ^= buf[i];
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Build
+//--------------------------------------------------------------------------------------------
+// Level 0 and the bucket levels seen through the same accessors.
+typedef struct {
+  const int64_t *t;
+  const float *v;
+  int64_t t_start(size_t i) const { return t[i]; }
+  int64_t t_pick(size_t i) const { return t[i]; }
+  float pick(size_t i) const { return v[i]; }
+  float min(size_t i) const { return v[i]; }
+  float max(size_t i) const { return v[i]; }
+  uint32_t count(size_t) const { return 1; }
+} RawView_t;
+
+typedef struct {
+  const PreviewBucket_t *b;
+  int64_t t_start(size_t i) const { return b[i].t_us; }
+  int64_t t_pick(size_t i) const { return b[i].t_pick_us; }
+  float pick(size_t i) const { return b[i].pick; }
+  float min(size_t i) const { return b[i].min; }
+  float max(size_t i) const { return b[i].max; }
+  uint32_t count(size_t i) const { return b[i].count; }
+} BucketView_t;
+
+
+// Mean pick (t, v) of source entries [i0, i1).
+template <typename Src>
+static void bucket_mean(const Src &src, size_t i0, size_t i1, int64_t t_ref, double *t, double *v) {
+  double st = 0.0, sv = 0.0;
+  for (size_t i = i0; i < i1; i++) {
+    st += (double)(src.t_pick(i) - t_ref);
+    sv += src.pick(i);
+  }
+  *t = st / (double)(i1 - i0);
+  *v = sv / (double)(i1 - i0);
+}
+
+
+// Buckets [j0, j1) of the next level from n source entries.
+template <typename Src>
+static void build_chunk(const Src &src, size_t n, size_t j0, size_t j1, PreviewBucket_t *out) {
+  const size_t F = PREVIEW_FACTOR;
+  // Previous pick, times relative to t_ref so doubles keep microseconds.
+  int64_t t_ref = src.t_pick(j0 * F);
+  double ta, va;
+  if (j0 == 0) {
+    ta = 0.0;
+    va = src.pick(0);
+  }
+  else {
+    bucket_mean(src, (j0 - 1) * F, j0 * F, t_ref, &ta, &va);
+  }
+
+  for (size_t j = j0; j < j1; j++) {
+    size_t i0 = j * F, i1 = i0 + F < n ? i0 + F : n;
+    double tc, vc;
+    if (i1 < n) {
+      bucket_mean(src, i1, i1 + F < n ? i1 + F : n, t_ref, &tc, &vc);
+    }
+    else {
+      tc = (double)(src.t_pick(n - 1) - t_ref);
+      vc = src.pick(n - 1);
+    }
+
+    size_t best = i0;
+    double best_area = -1.0;
+    float lo = src.min(i0), hi = src.max(i0);
+    uint32_t count = 0;
+    for (size_t i = i0; i < i1; i++) {
+      double ti = (double)(src.t_pick(i) - t_ref), vi = src.pick(i);
+      double area = std::fabs((ta - tc) * (vi - va) - (ta - ti) * (vc - va));
+      if (area > best_area) {
+        best_area = area;
+        best = i;
+      }
+      if (src.min(i) < lo) lo = src.min(i);
+      if (src.max(i) > hi) hi = src.max(i);
+      count += src.count(i);
+    }
+
+    PreviewBucket_t &b = out[j];
+    b.t_us = src.t_start(i0);
+    b.t_pick_us = src.t_pick(best);
+    b.pick = src.pick(best);
+    b.min = lo;
+    b.max = hi;
+    b.count = count;
+    ta = (double)(b.t_pick_us - t_ref);
+    va = b.pick;
+  }
+}
+
+
+bool PREVIEW_write(const char *path, const PreviewInput_t *channels, int n_channels, uint64_t log_size,
+                   uint64_t log_hash, int threads) {
+  // levels[c][k - 1] is level k of channel c.
+  std::vector<std::vector<std::vector<PreviewBucket_t>>> levels(n_channels);
+  std::vector<bool> done(n_channels);
+  for (int c = 0; c < n_channels; c++) done[c] = channels[c].n <= PREVIEW_TOP;
+
+  for (int k = 1; k < PREVIEW_MAX_LEVELS; k++) {
+    // One task per (channel, chunk) of this level.
+    std::vector<std::pair<int, size_t>> tasks;
+    for (int c = 0; c < n_channels; c++) {
+      if (done[c]) continue;
+      size_t src_n = k == 1 ? channels[c].n : levels[c][k - 2].size();
+      size_t buckets = (src_n + PREVIEW_FACTOR - 1) / PREVIEW_FACTOR;
+      levels[c].emplace_back(buckets);
+      for (size_t j = 0; j < buckets; j += PREVIEW_CHUNK) tasks.push_back({ c, j });
+    }
+    if (tasks.empty()) break;
+
+    PARALLEL_for(tasks.size(), threads, [&](size_t t) {
+      int c = tasks[t].first;
+      size_t j0 = tasks[t].second;
+      std::vector<PreviewBucket_t> &out = levels[c][k - 1];
+      size_t j1 = j0 + PREVIEW_CHUNK < out.size() ? j0 + PREVIEW_CHUNK : out.size();
+      if (k == 1) {
+        RawView_t src = { channels[c].t_us, channels[c].v };
+        build_chunk(src, channels[c].n, j0, j1, out.data());
+      }
+      else {
+        const std::vector<PreviewBucket_t> &below = levels[c][k - 2];
+        BucketView_t src = { below.data() };
+        build_chunk(src, below.size(), j0, j1, out.data());
+      }
+    });
+    for (int c = 0; c < n_channels; c++) {
+      if (!done[c] && levels[c].back().size() <= PREVIEW_TOP) done[c] = true;
+    }
+  }
+
+  // Layout : header, channel table, then every level of every channel.
+  PreviewHeader_t header = {};
+  memcpy(header.magic, "PVW1", 4);
+  header.channels = (uint32_t)n_channels;
+  header.factor = PREVIEW_FACTOR;
+  header.log_size = log_size;
+  header.log_hash = log_hash;
+  std::vector<PreviewChannel_t> table(n_channels);
+  uint64_t offset = sizeof(header) + n_channels * sizeof(PreviewChannel_t);
+  for (int c = 0; c < n_channels; c++) {
+    PreviewChannel_t &ch = table[c];
+    memset(&ch, 0, sizeof(ch));
+    snprintf(ch.name, sizeof(ch.name), "%s", channels[c].name);
+    snprintf(ch.units, sizeof(ch.units), "%s", channels[c].units);
+    ch.samples = channels[c].n;
+    ch.levels = 1 + (uint32_t)levels[c].size();
+    ch.offset[0] = offset;
+    ch.count[0] = channels[c].n;
+    offset += channels[c].n * sizeof(PreviewSample_t);
+    for (size_t k = 1; k < ch.levels; k++) {
+      ch.offset[k] = offset;
+      ch.count[k] = levels[c][k - 1].size();
+      offset += ch.count[k] * sizeof(PreviewBucket_t);
+    }
+  }
+
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    return false;
+  }
+  fwrite(&header, sizeof(header), 1, f);
+  fwrite(table.data(), sizeof(PreviewChannel_t), table.size(), f);
+  std::vector<PreviewSample_t> block(PREVIEW_CHUNK);
+  for (int c = 0; c < n_channels; c++) {
+    for (size_t i = 0; i < channels[c].n; i += PREVIEW_CHUNK) {
+      size_t m = channels[c].n - i < PREVIEW_CHUNK ? channels[c].n - i : PREVIEW_CHUNK;
+      for (size_t k = 0; k < m; k++) {
+        block[k].t_us = channels[c].t_us[i + k];
+        block[k].v = channels[c].v[i + k];
+      }
+      fwrite(block.data(), sizeof(PreviewSample_t), m, f);
+    }
+    for (const std::vector<PreviewBucket_t> &level : levels[c]) {
+      fwrite(level.data(), sizeof(PreviewBucket_t), level.size(), f);
+    }
+  }
+  bool ok = !ferror(f);
+  return fclose(f) == 0 && ok;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Query
+//--------------------------------------------------------------------------------------------
+bool PREVIEW_open(Preview_t *p, const char *path) {
+  memset(p, 0, sizeof(*p));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(PreviewHeader_t)) {
+    close(fd);
+    return false;
+  }
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  p->map = (const uint8_t *)map;
+  p->size = (size_t)st.st_size;
+  p->header = (const PreviewHeader_t *)p->map;
+  p->channels = (const PreviewChannel_t *)(p->map + sizeof(PreviewHeader_t));
+
+  // Every level must lie inside the file.
+  bool ok = !memcmp(p->header->magic, "PVW1", 4) &&
+            sizeof(PreviewHeader_t) + p->header->channels * sizeof(PreviewChannel_t) <= p->size;
+  for (uint32_t c = 0; ok && c < p->header->channels; c++) {
+    const PreviewChannel_t &ch = p->channels[c];
+    ok = ch.levels >= 1 && ch.levels <= PREVIEW_MAX_LEVELS;
+    for (uint32_t k = 0; ok && k < ch.levels; k++) {
+      size_t entry = k ? sizeof(PreviewBucket_t) : sizeof(PreviewSample_t);
+      ok = ch.offset[k] <= p->size && ch.count[k] <= (p->size - ch.offset[k]) / entry;
+    }
+  }
+  if (!ok) {
+    PREVIEW_close(p);
+  }
+  return ok;
+}
+
+
+void PREVIEW_close(Preview_t *p) {
+  if (p->map) {
+    munmap((void *)p->map, p->size);
+  }
+  memset(p, 0, sizeof(*p));
+}
+
+
+int PREVIEW_channel(const Preview_t *p, const char *name) {
+  for (uint32_t c = 0; c < p->header->channels; c++) {
+    if (!strncmp(p->channels[c].name, name, PREVIEW_NAME_SIZE)) return (int)c;
+  }
+  return -1;
+}
+
+
+// Entry stamp of level k (start of the bucket).
+static int64_t entry_t(const PreviewChannel_t &ch, const uint8_t *map, int k, size_t i) {
+  if (k == 0) return ((const PreviewSample_t *)(map + ch.offset[0]))[i].t_us;
+  return ((const PreviewBucket_t *)(map + ch.offset[k]))[i].t_us;
+}
+
+
+// First entry of level k with stamp > t.
+static size_t upper_bound(const PreviewChannel_t &ch, const uint8_t *map, int k, int64_t t) {
+  size_t lo = 0, hi = ch.count[k];
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (entry_t(ch, map, k, mid) <= t) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+
+size_t PREVIEW_query(const Preview_t *p, int channel, int64_t t0_us, int64_t t1_us, size_t max_points,
+                     std::vector<PreviewPoint_t> *out, int *level) {
+  out->clear();
+  *level = 0;
+  if (channel < 0 || (uint32_t)channel >= p->header->channels || t1_us < t0_us) {
+    return 0;
+  }
+  const PreviewChannel_t &ch = p->channels[channel];
+
+  // Range on level k : the entry holding t0 (last one starting at or before it)
+  // through the first one starting after t1.
+  size_t i0 = 0, i1 = 0;
+  int k = 0;
+  for (; k < (int)ch.levels; k++) {
+    size_t a = upper_bound(ch, p->map, k, t0_us);
+    size_t b = upper_bound(ch, p->map, k, t1_us);
+    i0 = a ? a - 1 : 0;
+    i1 = b < ch.count[k] ? b + 1 : b;
+    if (i1 - i0 <= max_points) break;
+  }
+  if (k == (int)ch.levels) k--;
+  *level = k;
+
+  out->resize(i1 - i0);
+  if (k == 0) {
+    const PreviewSample_t *s = (const PreviewSample_t *)(p->map + ch.offset[0]);
+    for (size_t i = i0; i < i1; i++) {
+      (*out)[i - i0] = { s[i].t_us, s[i].t_us, s[i].v, s[i].v, s[i].v, 1 };
+    }
+  }
+  else {
+    const PreviewBucket_t *b = (const PreviewBucket_t *)(p->map + ch.offset[k]);
+    for (size_t i = i0; i < i1; i++) {
+      (*out)[i - i0] = { b[i].t_us, b[i].t_pick_us, b[i].pick, b[i].min, b[i].max, b[i].count };
+    }
+  }
+  return out->size();
+}
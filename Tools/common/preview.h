@@ -0,0 +1,150 @@
+/**
+ * @file preview.h
+ * @brief Multi resolution preview of the channels of a log, for plotting at any zoom.
+ *
+ * Per channel, a pyramid of levels :
+ *
+ * | Level | Entry                 | Covers                      |
+ * | ----- | --------------------- | --------------------------- |
+ * | 0     | raw sample            | 1 sample                    |
+ * | k > 0 | bucket : LTTB pick,   | PREVIEW_FACTOR^k samples    |
+ * |       | min, max, count       |                             |
+ *
+ * Level k is built from level k - 1 only (PREVIEW_FACTOR entries per
+ * bucket), so the whole pyramid costs n (1 + 1/F + 1/F^2 ...) : linear.
+ * The pick of a bucket is the largest-triangle-three-buckets choice among
+ * the picks below it (triangle with the previous pick and the mean of the
+ * next bucket), min and max are exact over every sample of the bucket. A
+ * plot draws the min/max band and the pick line, which keeps spikes visible
+ * at any zoom.
+ *
+ * LTTB carries the previous pick from bucket to bucket; buckets are cut in
+ * chunks of PREVIEW_CHUNK that start from the mean of the bucket before them,
+ * so (channel, chunk) tasks run on the worker threads and the result does not
+ * depend on the thread count.
+ *
+ * Sidecar file (<log>.preview), little endian :
+ *
+ *   | Header : "PVW1", channels u32, factor u32, 0 u32, log size u64, log hash u64 |
+ *   | Channel table : PreviewChannel_t x channels                                  |
+ *   | Levels : PreviewSample_t (level 0), PreviewBucket_t (levels > 0)             |
+ *
+ * log size / hash (PREVIEW_hash() of the log bytes) tell whether the sidecar
+ * still matches its log. PREVIEW_open() maps the file, a query binary searches
+ * the range on the finest level that fits and copies it out : O(log n) plus
+ * O(points returned), whatever the log size.
+ */
+
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+#define PREVIEW_FACTOR 8              // Entries of level k - 1 per bucket of level k
+#define PREVIEW_TOP 1024              // Stop adding levels once a level has at most this many buckets
+#define PREVIEW_CHUNK 65536           // Buckets per build task
+#define PREVIEW_MAX_LEVELS 16
+#define PREVIEW_NAME_SIZE 24
+#define PREVIEW_UNITS_SIZE 8
+
+
+typedef struct __attribute__((packed)) {
+  int64_t t_us;
+  float v;
+} PreviewSample_t;
+
+typedef struct __attribute__((packed)) {
+  int64_t t_us;               // First sample of the bucket
+  int64_t t_pick_us;          // LTTB pick
+  float pick;
+  float min;
+  float max;
+  uint32_t count;             // Samples covered
+} PreviewBucket_t;
+
+typedef struct __attribute__((packed)) {
+  char name[PREVIEW_NAME_SIZE];
+  char units[PREVIEW_UNITS_SIZE];
+  uint64_t samples;
+  uint32_t levels;            // Including level 0
+  uint32_t reserved;
+  uint64_t offset[PREVIEW_MAX_LEVELS];  // File offset of each level
+  uint64_t count[PREVIEW_MAX_LEVELS];   // Entries of each level
+} PreviewChannel_t;
+
+typedef struct __attribute__((packed)) {
+  char magic[4];
+  uint32_t channels;
+  uint32_t factor;
+  uint32_t reserved;
+  uint64_t log_size;
+  uint64_t log_hash;
+} PreviewHeader_t;
+
+// One channel to build : stamps increasing.
+typedef struct {
+  const char *name;
+  const char *units;
+  const int64_t *t_us;
+  const float *v;
+  size_t n;
+} PreviewInput_t;
+
+// An opened sidecar, mapped read only.
+typedef struct {
+  const uint8_t *map;
+  size_t size;
+  const PreviewHeader_t *header;
+  const PreviewChannel_t *channels;
+} Preview_t;
+
+// Query result entry; raw samples have min = max = pick and count 1.
+typedef struct {
+  int64_t t_us;
+  int64_t t_pick_us;
+  float pick;
+  float min;
+  float max;
+  uint32_t count;
+} PreviewPoint_t;
+
+
+/**
+ * @brief 64 bit FNV-1a of the log bytes, stored in the sidecar header.
+ */
+uint64_t PREVIEW_hash(const uint8_t *buf, size_t n);
+
+/**
+ * @brief Build the pyramid of every channel and write the sidecar.
+ * @return false if the file cannot be written.
+ */
+bool PREVIEW_write(const char *path, const PreviewInput_t *channels, int n_channels, uint64_t log_size,
+                   uint64_t log_hash, int threads);
+
+/**
+ * @brief Map a sidecar. @return false if missing or not a preview file.
+ */
+bool PREVIEW_open(Preview_t *p, const char *path);
+
+void PREVIEW_close(Preview_t *p);
+
+/**
+ * @brief Index of the channel called name, -1 if none.
+ */
+int PREVIEW_channel(const Preview_t *p, const char *name);
+
+/**
+ * @brief Entries of a channel over [t0_us, t1_us] from the finest level with at most max_points of them.
+ *
+ * The entries just outside the range are included so a plot reaches the edges.
+ *
+ * @param[out] level Level used, 0 for raw samples.
+ * @return Number of points written to out (replaced).
+ */
+size_t PREVIEW_query(const Preview_t *p, int channel, int64_t t0_us, int64_t t1_us, size_t max_points,
+                     std::vector<PreviewPoint_t> *out, int *level);
+
+#endif /* PREVIEW_H */
@@ -0,0 +1,147 @@
+/**
+ * @file pty_link.cpp
+ * @brief A pseudo terminal standing in for a board's serial port, with a link model, for host tools to talk to.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "pty_link.h"
+
+
+const PtyLinkModel_t PTYLINK_USB_FS = { "ESP32-S3 USB CDC (~1 MB/s)", 1.0e6, 1000.0, 0.0, 0.0 };
+const PtyLinkModel_t PTYLINK_UART_921600 = { "STM32G030 USART2 921600 8N1", 92160.0, 2000.0, 0.0, 0.0 };
+const PtyLinkModel_t PTYLINK_PTY = { "pty, no limit", 0.0, 0.0, 0.0, 0.0 };
+
+
+double PTYLINK_now_s(void) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static void sleep_until(double t_s) {
+  double now = PTYLINK_now_s();
+  if (t_s > now) std::this_thread::sleep_for(std::chrono::duration<double>(t_s - now));
+}
+
+
+bool PTYLINK_open(PtyLink_t *l, const PtyLinkModel_t *model, uint64_t seed) {
+  l->model = *model;
+  l->master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (l->master < 0 || grantpt(l->master) != 0 || unlockpt(l->master) != 0) {
+    return false;
+  }
+  l->slave_path = ptsname(l->master);
+  l->slave = open(l->slave_path.c_str(), O_RDWR | O_NOCTTY);
+  if (l->slave < 0) {
+    return false;
+  }
+  struct termios tio;
+  tcgetattr(l->slave, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(l->slave, TCSANOW, &tio);
+  fcntl(l->master, F_SETFL, fcntl(l->master, F_GETFL) | O_NONBLOCK);
+  l->free_at_s = 0.0;
+  l->inbound.clear();
+  l->rng.seed(seed);
+  l->writes = l->bytes_out = l->bytes_in = 0;
+  l->corrupted = l->dropped = 0;
+  return true;
+}
+
+
+void PTYLINK_close(PtyLink_t *l) {
+  if (l->slave >= 0) close(l->slave);
+  if (l->master >= 0) close(l->master);
+  l->slave = l->master = -1;
+}
+
+
+static bool one_in(PtyLink_t *l, double every) {
+  return every > 0.0 && std::uniform_real_distribution<double>(0.0, every)(l->rng) < 1.0;
+}
+
+
+bool PTYLINK_write(PtyLink_t *l, const uint8_t *buf, size_t n) {
+  sleep_until(l->free_at_s);
+  double start = std::max(PTYLINK_now_s(), l->free_at_s);
+  l->free_at_s = l->model.bytes_per_s > 0.0 ? start + n / l->model.bytes_per_s : 0.0;
+  l->writes++;
+  l->bytes_out += n;
+  if (one_in(l, l->model.drop_every)) {
+    l->dropped++;
+    return true;
+  }
+  std::string copy;
+  if (one_in(l, l->model.corrupt_every) && n > 0) {
+    copy.assign((const char *)buf, n);
+    copy[l->rng() % n] ^= (char)(1u << (l->rng() % 8));
+    buf = (const uint8_t *)copy.data();
+    l->corrupted++;
+  }
+  // The master is non blocking : wait for the host to drain the pty, and
+  // give up on a host gone (no port open) as a USB CDC write times out.
+  double stuck_since = PTYLINK_now_s();
+  for (size_t at = 0; at < n;) {
+    ssize_t w = write(l->master, buf + at, n - at);
+    if (w > 0) {
+      at += (size_t)w;
+      stuck_since = PTYLINK_now_s();
+    } else if (w < 0 && errno != EAGAIN && errno != EINTR) {
+      return false;
+    } else if (PTYLINK_now_s() - stuck_since > PTYLINK_WRITE_TIMEOUT_S) {
+      l->dropped++;
+      return true;
+    } else {
+      struct pollfd p = { l->master, POLLOUT, 0 };
+      poll(&p, 1, 10);
+    }
+  }
+  return true;
+}
+
+
+static void pull(PtyLink_t *l) {
+  uint8_t buf[4096];
+  ssize_t r;
+  double arrive = PTYLINK_now_s() + l->model.latency_us * 1e-6;
+  while ((r = read(l->master, buf, sizeof(buf))) > 0) {
+    for (ssize_t i = 0; i < r; i++) l->inbound.emplace_back(arrive, buf[i]);
+    l->bytes_in += (uint64_t)r;
+  }
+}
+
+
+size_t PTYLINK_read(PtyLink_t *l, uint8_t *buf, size_t cap, int timeout_ms) {
+  double deadline = PTYLINK_now_s() + timeout_ms * 1e-3;
+  for (;;) {
+    pull(l);
+    double now = PTYLINK_now_s();
+    size_t n = 0;
+    while (n < cap && !l->inbound.empty() && l->inbound.front().first <= now) {
+      buf[n++] = l->inbound.front().second;
+      l->inbound.pop_front();
+    }
+    if (n > 0 || now >= deadline) {
+      return n;
+    }
+    double wake = l->inbound.empty() ? deadline : std::min(deadline, l->inbound.front().first);
+    struct pollfd p = { l->master, POLLIN, 0 };
+    poll(&p, 1, std::max(0, (int)std::ceil((wake - now) * 1e3)));
+  }
+}
+
+
+void PTYLINK_flush_input(PtyLink_t *l) {
+  pull(l);
+  l->inbound.clear();
+}
@@ -0,0 +1,93 @@
+/**
+ * @file pty_link.h
+ * @brief A pseudo terminal standing in for a board's serial port, with a link model, for host tools to talk to.
+ *
+ * The host side opens slave_path like any /dev/ttyACM0 or /dev/ttyUSB0 and
+ * never knows the difference. The simulated board reads and writes the
+ * master side through PTYLINK_read() and PTYLINK_write(), which model the
+ * link :
+ *
+ * - rate : each write leaves the board at bytes_per_s, the next one waits
+ *   for the last to be out (a UART or a USB CDC endpoint), 0 for as fast
+ *   as the pty goes;
+ * - latency : bytes from the host reach the board latency_us after they
+ *   were written (USB frames, a USB serial adapter's latency timer);
+ * - faults, per write : one in corrupt_every gets a random byte flipped,
+ *   one in drop_every never arrives (0 : never). A write the host does not
+ *   read for PTYLINK_WRITE_TIMEOUT_S is dropped too (no port open).
+ *
+ * The board keeps a slave descriptor of its own open, so the host may close
+ * and open the port again (a client killed and restarted) without the pty
+ * hanging up.
+ */
+
+#ifndef PTY_LINK_H
+#define PTY_LINK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+
+
+#define PTYLINK_WRITE_TIMEOUT_S 0.2   // A write nobody reads is dropped after this
+
+typedef struct {
+  const char *name;
+  double bytes_per_s;
+  double latency_us;
+  double corrupt_every;
+  double drop_every;
+} PtyLinkModel_t;
+
+// Native USB of the ESP32-S3 : full speed CDC, ~1 MB/s of bulk transfers
+// (an assumption, TinyUSB CDC on a full speed bus), 1 ms USB frames.
+extern const PtyLinkModel_t PTYLINK_USB_FS;
+// STM32G030 USART2 at 921600 baud 8N1 through a USB serial adapter (2 ms latency timer).
+extern const PtyLinkModel_t PTYLINK_UART_921600;
+// No limit but the pty itself.
+extern const PtyLinkModel_t PTYLINK_PTY;
+
+typedef struct {
+  PtyLinkModel_t model;
+  int master;
+  int slave;                  // Held open by the board
+  std::string slave_path;
+  double free_at_s;           // The link is done with the last write
+  std::deque<std::pair<double, uint8_t>> inbound;  // Host bytes and when they reach the board
+  std::mt19937_64 rng;
+  // Statistics
+  uint64_t writes, bytes_out, bytes_in;
+  uint64_t corrupted, dropped;
+} PtyLink_t;
+
+
+/**
+ * @brief Open a pty pair in raw mode. false if the system has none.
+ */
+bool PTYLINK_open(PtyLink_t *l, const PtyLinkModel_t *model, uint64_t seed);
+
+void PTYLINK_close(PtyLink_t *l);
+
+/**
+ * @brief Board to host : wait for the link to be free, then send buf (maybe corrupted or dropped).
+ */
+bool PTYLINK_write(PtyLink_t *l, const uint8_t *buf, size_t n);
+
+/**
+ * @brief Host to board : bytes that have reached the board, waiting up to timeout_ms for some.
+ */
+size_t PTYLINK_read(PtyLink_t *l, uint8_t *buf, size_t cap, int timeout_ms);
+
+/**
+ * @brief Drop everything the host sent so far (a board reset loses its receive buffer).
+ */
+void PTYLINK_flush_input(PtyLink_t *l);
+
+/**
+ * @brief Seconds on a monotonic clock.
+ */
+double PTYLINK_now_s(void);
+
+#endif /* PTY_LINK_H */
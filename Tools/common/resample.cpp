@@ -0,0 +1,206 @@
+/**
+ * @file resample.cpp
+ * @brief Resample stamped sensor series onto a uniform time grid.
+ *
+ * The kernel loops are written for the auto-vectoriser (-O3 -march=native) :
+ * zoh / linear are gathers through the pos map, the polyphase dot product
+ * keeps RESAMPLE_LANES independent sums so it vectorises without
+ * -ffast-math reassociation.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "resample.h"
+
+
+const char *RESAMPLE_mode_name(ResampleMode_t mode) {
+  switch (mode) {
+    case RESAMPLE_ZOH:       return "zoh";
+    case RESAMPLE_LINEAR:    return "linear";
+    case RESAMPLE_POLYPHASE: return "polyphase";
+  }
+  return "?";
+}
+
+
+bool RESAMPLE_parse_mode(const char *name, ResampleMode_t *mode) {
+  for (int m = RESAMPLE_ZOH; m <= RESAMPLE_POLYPHASE; m++) {
+    if (!strcmp(name, RESAMPLE_mode_name((ResampleMode_t)m))) {
+      *mode = (ResampleMode_t)m;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+int64_t RESAMPLE_median_period(const int64_t *t, size_t n) {
+  if (n < 2) {
+    return 0;
+  }
+  // A strided subset is plenty for a median and keeps this cheap on long logs.
+  size_t stride = n > 100000 ? n / 100000 : 1;
+  std::vector<int64_t> d;
+  for (size_t k = 1; k < n; k += stride) d.push_back(t[k] - t[k - 1]);
+  std::nth_element(d.begin(), d.begin() + d.size() / 2, d.end());
+  return d[d.size() / 2];
+}
+
+
+double RESAMPLE_nominal_period(const int64_t *t, size_t n) {
+  int64_t median = RESAMPLE_median_period(t, n);
+  if (median <= 0) {
+    return (double)median;
+  }
+  int64_t limit = median + median / 2;
+  int64_t sum = 0;
+  size_t count = 0;
+  for (size_t k = 1; k < n; k++) {
+    int64_t d = t[k] - t[k - 1];
+    if (d < limit) {
+      sum += d;
+      count++;
+    }
+  }
+  return count ? (double)sum / (double)count : (double)median;
+}
+
+
+void RESAMPLE_locate(const int64_t *t, size_t n_t, int64_t max_gap_us, double t0_us, double dt_us,
+                     size_t k0, size_t n, int32_t *pos, float *frac) {
+  if (n_t == 0) {
+    memset(pos, 0, n * sizeof(*pos));
+    memset(frac, 0, n * sizeof(*frac));
+    return;
+  }
+  // Binary search for the block start, then walk : the grid is increasing.
+  double tk = t0_us + (double)k0 * dt_us;
+  size_t i = std::upper_bound(t, t + n_t, (int64_t)std::floor(tk)) - t;
+  for (size_t k = 0; k < n; k++) {
+    tk = t0_us + (double)(k0 + k) * dt_us;
+    while (i < n_t && (double)t[i] <= tk) i++;
+    // t[i - 1] <= tk < t[i]
+    if (i == 0) {
+      pos[k] = 0;
+      frac[k] = 0.0f;
+    }
+    else if (i == n_t) {
+      bool held = tk - (double)t[n_t - 1] <= (double)max_gap_us;
+      pos[k] = held ? (int32_t)n_t : 0;
+      frac[k] = 0.0f;
+    }
+    else {
+      int64_t gap = t[i] - t[i - 1];
+      bool ok = gap <= max_gap_us;
+      pos[k] = ok ? (int32_t)i : 0;
+      frac[k] = ok ? (float)((tk - (double)t[i - 1]) / (double)gap) : 0.0f;
+    }
+  }
+}
+
+
+void RESAMPLE_pad_points(const float *v, size_t n, std::vector<float> &out) {
+  out.resize(n + 2);
+  out[0] = NAN;
+  memcpy(&out[1], v, n * sizeof(float));
+  out[n + 1] = n ? v[n - 1] : NAN;
+}
+
+
+void RESAMPLE_pad_fir(const ResamplePolyphase_t *pp, const float *v, size_t n, std::vector<float> &out) {
+  size_t half = (size_t)pp->half;
+  out.resize(n + 2 * half);
+  float first = n ? v[0] : NAN;
+  float last = n ? v[n - 1] : NAN;
+  for (size_t k = 0; k < half; k++) {
+    out[k] = first;
+    out[half + n + k] = last;
+  }
+  memcpy(&out[half], v, n * sizeof(float));
+}
+
+
+// Zeroth order modified Bessel function of the first kind, power series.
+static double bessel_i0(double x) {
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 40; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < 1e-12 * sum) break;
+  }
+  return sum;
+}
+
+
+void RESAMPLE_polyphase_design(ResamplePolyphase_t *pp, double rate_in_hz, double rate_out_hz) {
+  double ratio = rate_out_hz < rate_in_hz ? rate_out_hz / rate_in_hz : 1.0;
+  pp->cutoff = 0.5 * RESAMPLE_PASSBAND * ratio;
+
+  // Enough taps for RESAMPLE_ZEROS zero crossings each side, rounded up so
+  // the row is a whole number of accumulator lanes.
+  int half = (int)std::ceil(RESAMPLE_ZEROS / (2.0 * pp->cutoff));
+  int step = RESAMPLE_LANES / 2;
+  pp->half = (half + step - 1) / step * step;
+  pp->taps = 2 * pp->half;
+  pp->h.assign((size_t)(RESAMPLE_PHASES + 1) * pp->taps, 0.0f);
+
+  double i0_beta = bessel_i0(RESAMPLE_KAISER_BETA);
+  for (int q = 0; q <= RESAMPLE_PHASES; q++) {
+    float *row = &pp->h[(size_t)q * pp->taps];
+    double delay = (double)q / RESAMPLE_PHASES;
+    double sum = 0.0;
+    for (int j = 0; j < pp->taps; j++) {
+      // Tap j weighs input sample (i - half + 1 + j), at u samples from the output instant.
+      double u = (double)(j - pp->half + 1) - delay;
+      double x = 2.0 * pp->cutoff * u;
+      double sinc = x == 0.0 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+      double w = u / pp->half;
+      double kaiser = std::fabs(w) < 1.0 ? bessel_i0(RESAMPLE_KAISER_BETA * std::sqrt(1.0 - w * w)) / i0_beta : 0.0;
+      row[j] = (float)(sinc * kaiser);
+      sum += row[j];
+    }
+    // Unity gain at DC in every phase, so a constant stays constant.
+    for (int j = 0; j < pp->taps; j++) row[j] = (float)(row[j] / sum);
+  }
+}
+
+
+void RESAMPLE_zoh(const float *__restrict v, const int32_t *__restrict pos, float *__restrict out, size_t n) {
+  for (size_t k = 0; k < n; k++) {
+    out[k] = v[pos[k]];
+  }
+}
+
+
+void RESAMPLE_linear(const float *__restrict v, const int32_t *__restrict pos, const float *__restrict frac,
+                     float *__restrict out, size_t n) {
+  for (size_t k = 0; k < n; k++) {
+    float a = v[pos[k]];
+    float b = v[pos[k] + 1];
+    out[k] = a + frac[k] * (b - a);
+  }
+}
+
+
+void RESAMPLE_polyphase(const ResamplePolyphase_t *pp, const float *__restrict v, const int32_t *__restrict pos,
+                        const float *__restrict frac, float *__restrict out, size_t n) {
+  const int taps = pp->taps;
+  for (size_t k = 0; k < n; k++) {
+    if (pos[k] == 0) {
+      out[k] = NAN;
+      continue;
+    }
+    int q = (int)(frac[k] * RESAMPLE_PHASES + 0.5f);
+    const float *__restrict x = v + pos[k];
+    const float *__restrict h = &pp->h[(size_t)q * taps];
+    float acc[RESAMPLE_LANES] = { 0 };
+    for (int j = 0; j < taps; j += RESAMPLE_LANES) {
+      for (int l = 0; l < RESAMPLE_LANES; l++) acc[l] += x[j + l] * h[j + l];
+    }
+    float sum = 0.0f;
+    for (int l = 0; l < RESAMPLE_LANES; l++) sum += acc[l];
+    out[k] = sum;
+  }
+}
@@ -0,0 +1,116 @@
+/**
+ * @file resample.h
+ * @brief Resample stamped sensor series onto a uniform time grid.
+ *
+ * Every record of a log has its own esp_timer stamp, so the sensors sit on
+ * different, jittered time bases. Resampling is split in two steps :
+ *
+ * 1. RESAMPLE_locate() places every grid instant t_k = t0 + k * dt in an input
+ *    series : the last sample at or before t_k and the fraction of the way to
+ *    the next one. This is done once per series and shared by its columns.
+ * 2. A kernel builds one output column from one input column and that map :
+ *
+ * | Kernel      | Output                                                       |
+ * | ----------- | ------------------------------------------------------------ |
+ * | zoh         | last sample at or before t_k                                 |
+ * | linear      | straight line between the samples around t_k                 |
+ * | polyphase   | windowed sinc interpolation (Kaiser), band limited to the     |
+ * |             | lower of the two Nyquist rates, from a RESAMPLE_PHASES table |
+ *
+ * The polyphase kernel assumes a nearly uniform input (the accelerometer) :
+ * the stamps give the fractional position, the neighbour samples are taken
+ * one input period apart.
+ *
+ * Grid instants before the first sample, after the last one by more than
+ * max_gap, or inside a gap longer than max_gap come out as NaN.
+ *
+ * Columns are padded once (RESAMPLE_pad_points(), RESAMPLE_pad_fir()) so the
+ * kernels have no edge cases in their loops and vectorise; ranges of the grid
+ * are independent so callers split them into blocks across threads.
+ */
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+#define RESAMPLE_PHASES 256           // Fractional delay steps of the polyphase table
+#define RESAMPLE_ZEROS 8              // Sinc zero crossings each side of the polyphase kernel
+#define RESAMPLE_PASSBAND 0.9         // Polyphase cutoff, fraction of the lower Nyquist rate
+#define RESAMPLE_KAISER_BETA 7.0      // ~70 dB stop band
+#define RESAMPLE_LANES 8              // Accumulator lanes of the polyphase dot product
+
+
+typedef enum {
+  RESAMPLE_ZOH = 0,
+  RESAMPLE_LINEAR,
+  RESAMPLE_POLYPHASE,
+} ResampleMode_t;
+
+typedef struct {
+  int half;                   // Taps each side of the interpolation point, multiple of RESAMPLE_LANES / 2
+  int taps;                   // 2 * half
+  double cutoff;              // cycles per input sample
+  std::vector<float> h;       // (RESAMPLE_PHASES + 1) rows of taps
+} ResamplePolyphase_t;
+
+
+/**
+ * @brief Name of a mode ("zoh", "linear", "polyphase"), and back. Parse returns false if unknown.
+ */
+const char *RESAMPLE_mode_name(ResampleMode_t mode);
+bool RESAMPLE_parse_mode(const char *name, ResampleMode_t *mode);
+
+/**
+ * @brief Median sample spacing of a series (us), 0 if fewer than two samples.
+ */
+int64_t RESAMPLE_median_period(const int64_t *t, size_t n);
+
+/**
+ * @brief Nominal sample spacing (us) : mean of the spacings under 1.5 median periods.
+ *
+ * Unlike the median it is not rounded to the microsecond stamps, and missed
+ * samples do not bias it. 0 if fewer than two samples.
+ */
+double RESAMPLE_nominal_period(const int64_t *t, size_t n);
+
+/**
+ * @brief Locate grid instants k0 .. k0 + n - 1 in an input series.
+ *
+ * @param[in] t Input stamps (us), non decreasing.
+ * @param[in] n_t Number of input samples.
+ * @param[in] max_gap_us Longest spacing still interpolated across.
+ * @param[in] t0_us, dt_us Grid origin and step.
+ * @param[out] pos Input sample at or before t_k, plus one (0 : no data, NaN out).
+ * @param[out] frac Position between that sample and the next, [0, 1].
+ */
+void RESAMPLE_locate(const int64_t *t, size_t n_t, int64_t max_gap_us, double t0_us, double dt_us,
+                     size_t k0, size_t n, int32_t *pos, float *frac);
+
+/**
+ * @brief Pad a column for the zoh and linear kernels : [NaN, v..., v[n-1]].
+ */
+void RESAMPLE_pad_points(const float *v, size_t n, std::vector<float> &out);
+
+/**
+ * @brief Pad a column for the polyphase kernel : pp->half copies of the end samples each side.
+ */
+void RESAMPLE_pad_fir(const ResamplePolyphase_t *pp, const float *v, size_t n, std::vector<float> &out);
+
+/**
+ * @brief Design the polyphase table for an input and output rate.
+ */
+void RESAMPLE_polyphase_design(ResamplePolyphase_t *pp, double rate_in_hz, double rate_out_hz);
+
+/**
+ * @brief Kernels, n outputs from a pos / frac map. v is padded for the kernel.
+ */
+void RESAMPLE_zoh(const float *v, const int32_t *pos, float *out, size_t n);
+void RESAMPLE_linear(const float *v, const int32_t *pos, const float *frac, float *out, size_t n);
+void RESAMPLE_polyphase(const ResamplePolyphase_t *pp, const float *v, const int32_t *pos, const float *frac,
+                        float *out, size_t n);
+
+#endif /* RESAMPLE_H */
@@ -0,0 +1,269 @@
+/**
+ * @file rts_smoother.cpp
+ * @brief Forward Kalman filter and Rauch-Tung-Striebel smoother for post-flight trajectories.
+ */
+
+#include <cmath>
+#include <cstring>
+
+#include "rts_smoother.h"
+
+
+void RTS_default_config(RTS_Config_t *cfg) {
+  KF_Config_t kf;
+  KF_default_config(&kf);
+  cfg->accel_sigma = kf.accel_sigma;
+  cfg->baro_sigma = kf.baro_sigma;
+  cfg->gps_sigma = RTS_GPS_SIGMA;
+  cfg->jerk_psd = kf.jerk_psd;
+  cfg->baro_lockout_speed = kf.baro_lockout_speed;
+  cfg->baro_unlock_speed = kf.baro_unlock_speed;
+  cfg->baro_gate_sigma = kf.baro_gate_sigma;
+  cfg->gps_gate_sigma = RTS_GPS_GATE_SIGMA;
+}
+
+
+void RTS_forward_init(RTS_Forward_t *f, const RTS_Config_t *cfg) {
+  memset(f, 0, sizeof(*f));
+  f->cfg = *cfg;
+  // Sitting on the pad, altitude and velocity are well known (as KF_init()).
+  f->P[0][0] = cfg->baro_sigma * cfg->baro_sigma;
+  f->P[1][1] = 0.01;
+  f->P[2][2] = cfg->accel_sigma * cfg->accel_sigma;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// 3x3 helpers
+//--------------------------------------------------------------------------------------------
+typedef double Mat3_t[3][3];
+
+static void transition(double dt, Mat3_t F) {
+  memset(F, 0, sizeof(Mat3_t));
+  F[0][0] = F[1][1] = F[2][2] = 1.0;
+  F[0][1] = F[1][2] = dt;
+  F[0][2] = 0.5 * dt * dt;
+}
+
+
+// Discretised white jerk process noise, as KF_predict().
+static void process_noise(double q, double dt, Mat3_t Q) {
+  double dt2 = dt * dt, dt3 = dt2 * dt;
+  Q[0][0] = q * dt3 * dt2 / 20.0;
+  Q[0][1] = Q[1][0] = q * dt2 * dt2 / 8.0;
+  Q[0][2] = Q[2][0] = q * dt3 / 6.0;
+  Q[1][1] = q * dt3 / 3.0;
+  Q[1][2] = Q[2][1] = q * dt2 / 2.0;
+  Q[2][2] = q * dt;
+}
+
+
+static void mul(const Mat3_t A, const Mat3_t B, Mat3_t out) {
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      out[i][j] = A[i][0] * B[0][j] + A[i][1] * B[1][j] + A[i][2] * B[2][j];
+    }
+  }
+}
+
+
+// A B^T
+static void mul_t(const Mat3_t A, const Mat3_t B, Mat3_t out) {
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      out[i][j] = A[i][0] * B[j][0] + A[i][1] * B[j][1] + A[i][2] * B[j][2];
+    }
+  }
+}
+
+
+// P' = F P F^T + Q, symmetrised.
+static void propagate(const Mat3_t P, const Mat3_t F, const Mat3_t Q, Mat3_t out) {
+  Mat3_t FP;
+  mul(F, P, FP);
+  mul_t(FP, F, out);
+  for (int i = 0; i < 3; i++) {
+    for (int j = i; j < 3; j++) {
+      double v = 0.5 * (out[i][j] + out[j][i]) + Q[i][j];
+      out[i][j] = out[j][i] = v;
+    }
+  }
+}
+
+
+static bool invert(const Mat3_t A, Mat3_t out) {
+  double c00 = A[1][1] * A[2][2] - A[1][2] * A[2][1];
+  double c01 = A[1][2] * A[2][0] - A[1][0] * A[2][2];
+  double c02 = A[1][0] * A[2][1] - A[1][1] * A[2][0];
+  double det = A[0][0] * c00 + A[0][1] * c01 + A[0][2] * c02;
+  if (!(std::fabs(det) > 0.0)) {
+    return false;
+  }
+  double inv = 1.0 / det;
+  out[0][0] = c00 * inv;
+  out[1][0] = c01 * inv;
+  out[2][0] = c02 * inv;
+  out[0][1] = (A[0][2] * A[2][1] - A[0][1] * A[2][2]) * inv;
+  out[1][1] = (A[0][0] * A[2][2] - A[0][2] * A[2][0]) * inv;
+  out[2][1] = (A[0][1] * A[2][0] - A[0][0] * A[2][1]) * inv;
+  out[0][2] = (A[0][1] * A[1][2] - A[0][2] * A[1][1]) * inv;
+  out[1][2] = (A[0][2] * A[1][0] - A[0][0] * A[1][2]) * inv;
+  out[2][2] = (A[0][0] * A[1][1] - A[0][1] * A[1][0]) * inv;
+  return true;
+}
+
+
+static void unpack(const double *p, Mat3_t P) {
+  P[0][0] = p[0];
+  P[0][1] = P[1][0] = p[1];
+  P[0][2] = P[2][0] = p[2];
+  P[1][1] = p[3];
+  P[1][2] = P[2][1] = p[4];
+  P[2][2] = p[5];
+}
+
+
+static void pack(const Mat3_t P, double *p) {
+  p[0] = P[0][0];
+  p[1] = P[0][1];
+  p[2] = P[0][2];
+  p[3] = P[1][1];
+  p[4] = P[1][2];
+  p[5] = P[2][2];
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Forward filter
+//--------------------------------------------------------------------------------------------
+static void predict(RTS_Forward_t *f, double dt) {
+  Mat3_t F, Q, P;
+  transition(dt, F);
+  process_noise(f->cfg.jerk_psd, dt, Q);
+  double *x = f->x;
+  x[0] += x[1] * dt + x[2] * 0.5 * dt * dt;
+  x[1] += x[2] * dt;
+  propagate(f->P, F, Q, P);
+  memcpy(f->P, P, sizeof(P));
+}
+
+
+bool RTS_forward_update(RTS_Forward_t *f, int64_t t_us, RtsMeasKind_t kind, double z) {
+  if (!f->started) {
+    f->started = true;
+    f->t_us = t_us;
+  }
+  if (t_us > f->t_us) {
+    predict(f, (double)(t_us - f->t_us) * 1e-6);
+    f->t_us = t_us;
+  }
+
+  int i = 0;
+  double sigma = 0.0, gate = 0.0;
+  switch (kind) {
+    case RTS_MEAS_ACCEL: i = 2; sigma = f->cfg.accel_sigma; break;
+    case RTS_MEAS_BARO:  i = 0; sigma = f->cfg.baro_sigma; gate = f->cfg.baro_gate_sigma; break;
+    case RTS_MEAS_GPS:   i = 0; sigma = f->cfg.gps_sigma; gate = f->cfg.gps_gate_sigma; break;
+  }
+
+  if (kind == RTS_MEAS_BARO) {
+    // Transonic lockout with hysteresis, as onboard
+    double speed = std::fabs(f->x[1]);
+    if (f->baro_locked) {
+      if (speed < f->cfg.baro_unlock_speed) f->baro_locked = false;
+    }
+    else if (speed > f->cfg.baro_lockout_speed) {
+      f->baro_locked = true;
+    }
+    if (f->baro_locked) {
+      f->rejected[kind]++;
+      return false;
+    }
+  }
+
+  double r = sigma * sigma;
+  double s = f->P[i][i] + r;
+  double innov = z - f->x[i];
+  f->nll += 0.5 * (std::log(2.0 * M_PI * s) + innov * innov / s);
+  f->scored++;
+
+  if (gate > 0.0 && innov * innov > gate * gate * s && f->gate_streak[kind] < KF_BARO_GATE_MAX_REJECT) {
+    f->gate_streak[kind]++;
+    f->rejected[kind]++;
+    return false;
+  }
+  f->gate_streak[kind] = 0;
+
+  double p[3] = { f->P[0][i], f->P[1][i], f->P[2][i] };
+  for (int a = 0; a < 3; a++) {
+    double k = p[a] / s;
+    f->x[a] += k * innov;
+    for (int b = 0; b < 3; b++) f->P[a][b] -= k * p[b];
+  }
+  f->used[kind]++;
+  return true;
+}
+
+
+void RTS_forward_step(const RTS_Forward_t *f, RTS_Step_t *out) {
+  out->t_us = f->t_us;
+  memcpy(out->x, f->x, sizeof(out->x));
+  pack(f->P, out->P);
+}
+
+
+double RTS_forward_score(const RTS_Forward_t *f) {
+  return f->scored ? f->nll / (double)f->scored : 0.0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Backward pass
+//--------------------------------------------------------------------------------------------
+void RTS_backward(const RTS_Config_t *cfg, const RTS_Step_t *filtered, const RTS_Step_t *next_smoothed,
+                  RTS_Step_t *smoothed) {
+  double dt = (double)(next_smoothed->t_us - filtered->t_us) * 1e-6;
+  Mat3_t F, Q, Pf, Pp, Pp_inv;
+  unpack(filtered->P, Pf);
+  transition(dt > 0.0 ? dt : 0.0, F);
+  process_noise(cfg->jerk_psd, dt > 0.0 ? dt : 0.0, Q);
+  propagate(Pf, F, Q, Pp);
+  smoothed->t_us = filtered->t_us;
+  if (!(dt > 0.0) || !invert(Pp, Pp_inv)) {
+    // Same instant : the later step already holds everything.
+    memcpy(smoothed->x, next_smoothed->x, sizeof(smoothed->x));
+    memcpy(smoothed->P, next_smoothed->P, sizeof(smoothed->P));
+    return;
+  }
+
+  // C = Pf F^T Pp^-1
+  Mat3_t PfFt, C;
+  mul_t(Pf, F, PfFt);
+  mul(PfFt, Pp_inv, C);
+
+  const double *xf = filtered->x;
+  double xp[3] = { xf[0] + xf[1] * dt + xf[2] * 0.5 * dt * dt, xf[1] + xf[2] * dt, xf[2] };
+  double dx[3];
+  for (int i = 0; i < 3; i++) dx[i] = next_smoothed->x[i] - xp[i];
+  for (int i = 0; i < 3; i++) smoothed->x[i] = xf[i] + C[i][0] * dx[0] + C[i][1] * dx[1] + C[i][2] * dx[2];
+
+  // Ps = Pf + C (Ps1 - Pp) C^T
+  Mat3_t Ps1, D, CD, CDCt, Ps;
+  unpack(next_smoothed->P, Ps1);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) D[i][j] = Ps1[i][j] - Pp[i][j];
+  }
+  mul(C, D, CD);
+  mul_t(CD, C, CDCt);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) Ps[i][j] = Pf[i][j] + 0.5 * (CDCt[i][j] + CDCt[j][i]);
+  }
+  pack(Ps, smoothed->P);
+}
+
+
+double RTS_sigma(const RTS_Step_t *s, int i) {
+  static const int diag[3] = { 0, 3, 5 };
+  double v = s->P[diag[i]];
+  return v > 0.0 ? std::sqrt(v) : 0.0;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file rts_smoother.h
+ * @brief Forward Kalman filter and Rauch-Tung-Striebel smoother for post-flight trajectories.
+ *
+ * Same state and process model as the onboard filter (lib/AltitudeKF) :
+ * altitude, vertical velocity, vertical acceleration, constant acceleration
+ * driven by white jerk noise. Offline there is no CPU budget, so the host
+ * version runs in double precision, also fuses GPS height (H = [1 0 0]) and
+ * keeps the likelihood of its innovations for noise model tuning.
+ *
+ * Forward pass : every measurement is one step; RTS_forward_step() snapshots
+ * the filtered state and covariance after it. The caller stores the steps
+ * (RTS_Step_t, fixed size, so they can be spilled to disk in blocks).
+ *
+ * Backward pass : from the last step back to the first,
+ *
+ *   x_p = F x_f(k)                    P_p = F P_f(k) F' + Q
+ *   C   = P_f(k) F' P_p^-1
+ *   x_s(k) = x_f(k) + C (x_s(k+1) - x_p)
+ *   P_s(k) = P_f(k) + C (P_s(k+1) - P_p) C'
+ *
+ * with F and Q over the step spacing. The prediction is recomputed from the
+ * filtered step rather than stored, which halves the spilled data.
+ *
+ * The transonic baro lockout and the innovation gate work as onboard; gated
+ * and locked out measurements are not fused, but every innovation outside
+ * the lockout is scored so the likelihood of different configurations
+ * covers the same data.
+ */
+
+#ifndef RTS_SMOOTHER_H
+#define RTS_SMOOTHER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "altitude_kf.h"
+
+
+#ifndef RTS_GPS_SIGMA
+#define RTS_GPS_SIGMA 5.0             // NEO-7M height noise (m, 1 sigma)
+#endif
+#define RTS_GPS_GATE_SIGMA 6.0        // Reject GPS innovations larger than this many sigma
+
+
+typedef enum {
+  RTS_MEAS_ACCEL = 0,         // Vertical acceleration, gravity removed (m/s^2)
+  RTS_MEAS_BARO,              // Baro altitude above the pad (m)
+  RTS_MEAS_GPS,               // GPS height above the pad (m)
+} RtsMeasKind_t;
+
+typedef struct {
+  double accel_sigma;         // m/s^2
+  double baro_sigma;          // m
+  double gps_sigma;           // m
+  double jerk_psd;            // (m/s^3)^2/Hz
+  double baro_lockout_speed;  // m/s
+  double baro_unlock_speed;   // m/s
+  double baro_gate_sigma;     // 0 disables
+  double gps_gate_sigma;      // 0 disables
+} RTS_Config_t;
+
+// One filtered or smoothed step. P is the upper triangle : 00 01 02 11 12 22.
+typedef struct {
+  int64_t t_us;
+  double x[3];
+  double P[6];
+} RTS_Step_t;
+
+typedef struct {
+  RTS_Config_t cfg;
+  bool started;
+  int64_t t_us;
+  double x[3];
+  double P[3][3];
+  bool baro_locked;
+  uint32_t gate_streak[3];    // Consecutive gated measurements per kind
+  size_t used[3];             // Measurements fused per kind
+  size_t rejected[3];         // Gated or locked out per kind
+  double nll;                 // Negative log likelihood of the scored innovations
+  size_t scored;
+} RTS_Forward_t;
+
+
+/**
+ * @brief Defaults : the onboard KF_* noise model plus RTS_GPS_SIGMA.
+ */
+void RTS_default_config(RTS_Config_t *cfg);
+
+/**
+ * @brief Reset the forward filter, at rest at altitude 0, first step at the first measurement.
+ */
+void RTS_forward_init(RTS_Forward_t *f, const RTS_Config_t *cfg);
+
+/**
+ * @brief Predict to t_us and fuse one measurement.
+ *
+ * Measurements must come in time order; one stamped before the filter time
+ * is fused at the filter time.
+ *
+ * @return true if it was fused, false if locked out or gated.
+ */
+bool RTS_forward_update(RTS_Forward_t *f, int64_t t_us, RtsMeasKind_t kind, double z);
+
+/**
+ * @brief Filtered state after the last update.
+ */
+void RTS_forward_step(const RTS_Forward_t *f, RTS_Step_t *out);
+
+/**
+ * @brief Mean negative log likelihood per scored innovation. Lower is a better noise model.
+ */
+double RTS_forward_score(const RTS_Forward_t *f);
+
+/**
+ * @brief One backward step : smoothed k from filtered k and smoothed k + 1.
+ */
+void RTS_backward(const RTS_Config_t *cfg, const RTS_Step_t *filtered, const RTS_Step_t *next_smoothed,
+                  RTS_Step_t *smoothed);
+
+/**
+ * @brief Standard deviation of state i (0 altitude, 1 velocity, 2 acceleration) of a step.
+ */
+double RTS_sigma(const RTS_Step_t *s, int i);
+
+#endif /* RTS_SMOOTHER_H */
@@ -0,0 +1,44 @@
+/**
+ * @file sim_pipeline.cpp
+ * @brief Replay a simulated flight as flight computer inputs.
+ */
+
+#include <algorithm>
+#include "baro_altitude.h"
+#include "sim_pipeline.h"
+
+
+std::vector<SimInput_t> SIMPIPE_build_inputs(const SimFlight_t &f, bool with_gps) {
+  double p0 = 0.0;
+  int n0 = 0;
+  for (const SimSample_t &b : f.baro) {
+    if (b.t > 1.0) break;
+    p0 += b.value;
+    n0++;
+  }
+  p0 /= (n0 > 0 ? n0 : 1);
+  float ground = BARO_pressure_altitude((float)p0);
+
+  std::vector<SimInput_t> in;
+  in.reserve(f.accel.size() + f.baro.size() + (with_gps ? f.gps.size() : 0));
+  for (const SimAccel_t &a : f.accel) {
+    SimInput_t k = { a.t, SIM_INPUT_ACCEL,
+                     (float)((a.raw[2] * FLIGHTSIM_ADXL_G_PER_LSB - 1.0) * FLIGHTSIM_G0) };
+    in.push_back(k);
+  }
+  for (const SimSample_t &b : f.baro) {
+    SimInput_t k = { b.t, SIM_INPUT_BARO, BARO_altitude_above((float)b.value, ground) };
+    in.push_back(k);
+  }
+  if (with_gps) {
+    for (const SimSample_t &g : f.gps) {
+      SimInput_t k = { g.t, SIM_INPUT_GPS, (float)g.value };
+      in.push_back(k);
+    }
+  }
+  // Stable so equal timestamps keep accel, baro, GPS order.
+  std::stable_sort(in.begin(), in.end(), [](const SimInput_t &a, const SimInput_t &b) {
+    return a.t < b.t;
+  });
+  return in;
+}
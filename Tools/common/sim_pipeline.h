@@ -0,0 +1,44 @@
+/**
+ * @file sim_pipeline.h
+ * @brief Replay a simulated flight as the stream of inputs the flight computer sees.
+ *
+ * Converts simulator sensor streams with the same arithmetic as the firmware :
+ * - ADXL375 axial counts -> vertical acceleration, gravity removed (m/s^2)
+ * - BMP390 pressure -> altitude above the pad with the BaroAltitude table,
+ *   pad reference is the mean of the first second, as BMP390_ground_reference()
+ * - GPS height (m)
+ *
+ * and merges them in time order.
+ */
+
+#ifndef SIM_PIPELINE_H
+#define SIM_PIPELINE_H
+
+#include <vector>
+#include "flight_sim.h"
+
+
+typedef enum {
+  SIM_INPUT_ACCEL = 0,
+  SIM_INPUT_BARO,
+  SIM_INPUT_GPS,
+} SimInputKind_t;
+
+typedef struct {
+  double t;                   // s
+  int kind;                   // SimInputKind_t
+  float value;                // m/s^2 or m
+} SimInput_t;
+
+
+/**
+ * @brief Build the time ordered firmware inputs for a flight.
+ *
+ * BARO_init_table() must have been called.
+ *
+ * @param[in] f Simulated flight.
+ * @param[in] with_gps Include GPS fixes.
+ */
+std::vector<SimInput_t> SIMPIPE_build_inputs(const SimFlight_t &f, bool with_gps);
+
+#endif /* SIM_PIPELINE_H */
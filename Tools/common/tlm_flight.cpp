@@ -0,0 +1,122 @@
+/**
+ * @file tlm_flight.cpp
+ * @brief The telemetry state (lib/Telemetry) the flight computer holds through a simulated flight.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "altitude_kf.h"
+#include "apogee_detect.h"
+#include "sim_pipeline.h"
+#include "tlm_flight.h"
+
+
+#define GROUND_ACCEL_RATE 800.0       // Hz, inputs fed on the ground after touchdown
+#define GROUND_BARO_RATE 50.0
+#define GROUND_BARO_NOISE 0.3         // m RMS
+#define GROUND_ACCEL_NOISE 0.5        // m/s^2 RMS
+#define BATTERY_START_MV 8200         // 2S LiPo, full
+#define BATTERY_DRAIN_MV_S 0.5
+
+
+TlmFlight_t TLMFLIGHT_run(const SimConfig_t &cfg, uint32_t seed, double after_s) {
+  SimFlight_t flight = FLIGHTSIM_run(cfg, seed);
+  std::vector<SimInput_t> in = SIMPIPE_build_inputs(flight, true);
+
+  TlmFlight_t out;
+  out.name = flight.name;
+  out.launch_t = flight.launch_t;
+  out.apogee_t = flight.apogee_t;
+  out.apogee_h = flight.apogee_h;
+  out.touchdown_t = in.empty() ? 0.0 : in.back().t;
+  out.landed_t = NAN;
+
+  // The rest on the ground, as the sensors would see it.
+  std::mt19937 rng(seed ^ 0x7E1E);
+  std::normal_distribution<double> gauss(0.0, 1.0);
+  float ground_h = 0.0f;
+  for (auto it = in.rbegin(); it != in.rend(); ++it) {
+    if (it->kind == SIM_INPUT_BARO) {
+      ground_h = it->value;
+      break;
+    }
+  }
+  int per_baro = (int)(GROUND_ACCEL_RATE / GROUND_BARO_RATE);
+  for (int i = 1; i <= (int)(after_s * GROUND_ACCEL_RATE); i++) {
+    double t = out.touchdown_t + i / GROUND_ACCEL_RATE;
+    SimInput_t a = { t, SIM_INPUT_ACCEL, (float)(GROUND_ACCEL_NOISE * gauss(rng)) };
+    in.push_back(a);
+    if (i % per_baro == 0) {
+      SimInput_t b = { t, SIM_INPUT_BARO, (float)(ground_h + GROUND_BARO_NOISE * gauss(rng)) };
+      in.push_back(b);
+    }
+  }
+
+  KF_Config_t kcfg;
+  KF_default_config(&kcfg);
+  KF_t kf;
+  KF_init(&kf, &kcfg, 0.0f);
+  APOGEE_Config_t acfg;
+  APOGEE_default_config(&acfg);
+  APOGEE_t ad;
+  APOGEE_init(&ad, &acfg);
+  TLM_PhaseTracker_t phase;
+  TLM_phase_init(&phase);
+
+  TLM_State_t s = {};
+  s.lat_e7 = TLMFLIGHT_PAD_LAT_E7;
+  s.lon_e7 = TLMFLIGHT_PAD_LON_E7;
+  s.gps_height_mm = (int32_t)llround(cfg.pad_altitude_msl * 1000.0);
+  s.gps_fix = 3;
+  const double m_per_lon_e7 = 111320.0 * cos(TLMFLIGHT_PAD_LAT_E7 * 1e-7 * M_PI / 180.0) * 1e-7;
+  double last_t = in.empty() ? 0.0 : in[0].t;
+  double next_state_t = 0.0;
+  for (const SimInput_t &k : in) {
+    int64_t t_us = (int64_t)llround(k.t * 1e6);
+    if (k.kind != SIM_INPUT_GPS) {
+      KF_predict(&kf, (float)(k.t - last_t));
+      last_t = k.t;
+      if (k.kind == SIM_INPUT_ACCEL) KF_update_accel(&kf, k.value);
+      else KF_update_baro(&kf, k.value);
+      APOGEE_update_kf(&ad, t_us, kf.x[0], kf.x[1]);
+      if (k.kind == SIM_INPUT_BARO) APOGEE_update_baro(&ad, t_us, k.value, !kf.baro_locked);
+      TLM_phase_update(&phase, t_us, (uint8_t)ad.phase, kf.x[1], kf.x[2]);
+    } else {
+      APOGEE_update_gps(&ad, t_us, k.value);
+      double drift_s = std::min(std::max(k.t - out.launch_t, 0.0), out.touchdown_t - out.launch_t);
+      s.lon_e7 = TLMFLIGHT_PAD_LON_E7 + (int32_t)llround(TLMFLIGHT_WIND * drift_s / m_per_lon_e7);
+      s.gps_height_mm = (int32_t)llround((cfg.pad_altitude_msl + k.value) * 1000.0);
+    }
+    APOGEE_Event_t ev;
+    APOGEE_check(&ad, t_us, &ev);
+    if (phase.phase == TLM_PHASE_LANDED && std::isnan(out.landed_t)) {
+      out.landed_t = k.t;
+    }
+
+    if (k.t >= next_state_t) {
+      next_state_t += TLMFLIGHT_PERIOD_US * 1e-6;
+      s.t_us = (uint64_t)t_us;
+      s.phase = (uint8_t)phase.phase;
+      s.altitude = kf.x[0];
+      s.velocity = kf.x[1];
+      s.acceleration = kf.x[2];
+      if (kf.x[0] > s.max_altitude) s.max_altitude = kf.x[0];
+      s.battery_mv = (uint16_t)(BATTERY_START_MV - BATTERY_DRAIN_MV_S * k.t);
+      s.health = TLM_HEALTH_SD | TLM_HEALTH_FLASH | TLM_HEALTH_GPS_3D | TLM_HEALTH_TIME_LOCKED |
+                 (kf.baro_locked ? TLM_HEALTH_BARO_LOCKED : 0);
+      out.states.push_back(s);
+    }
+  }
+  return out;
+}
+
+
+const TLM_State_t &TLMFLIGHT_at(const TlmFlight_t &f, uint64_t t_us) {
+  size_t i = (size_t)(t_us / TLMFLIGHT_PERIOD_US);
+  if (i >= f.states.size()) i = f.states.size() - 1;
+  while (i > 0 && f.states[i].t_us > t_us) i--;
+  while (i + 1 < f.states.size() && f.states[i + 1].t_us <= t_us) i++;
+  return f.states[i];
+}
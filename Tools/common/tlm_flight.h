@@ -0,0 +1,55 @@
+/**
+ * @file tlm_flight.h
+ * @brief The telemetry state (lib/Telemetry) the flight computer holds through a simulated flight.
+ *
+ * A flight of the library is replayed through the Kalman filter and the
+ * apogee detector as on the board (common/sim_pipeline.h), and after the
+ * touchdown the rocket lies on the ground for after_s more seconds (the
+ * filter still fed : accel at rest, baro at the landing altitude). Every
+ * STATE record period (10 ms) the TLM_State_t loop() would hand the radio
+ * task is kept, with its flight phase from lib/Telemetry.
+ *
+ * The simulator flies straight up, so the GPS position is made up : the pad
+ * at TLMFLIGHT_PAD_LAT_E7 / TLMFLIGHT_PAD_LON_E7, drifting east with a
+ * TLMFLIGHT_WIND m/s wind from launch to touchdown. GPS height is the
+ * simulated one above the pad's MSL altitude.
+ */
+
+#ifndef TLM_FLIGHT_H
+#define TLM_FLIGHT_H
+
+#include <cstdint>
+#include <vector>
+
+#include "flight_sim.h"
+#include "telemetry.h"
+
+
+#define TLMFLIGHT_PERIOD_US 10000     // STATE record period
+#define TLMFLIGHT_PAD_LAT_E7 520000000
+#define TLMFLIGHT_PAD_LON_E7 44000000
+#define TLMFLIGHT_WIND 5.0            // m/s, eastward drift
+
+
+typedef struct {
+  std::string name;
+  std::vector<TLM_State_t> states;  // Every TLMFLIGHT_PERIOD_US, t_us from the start of the recording
+  double launch_t;            // s, ignition
+  double apogee_t;            // s, true apogee
+  double apogee_h;            // m
+  double touchdown_t;         // s, end of the simulated flight
+  double landed_t;            // s, first LANDED phase, NAN if never
+} TlmFlight_t;
+
+
+/**
+ * @brief Fly cfg with seed, then after_s on the ground. BARO_init_table() must have been called.
+ */
+TlmFlight_t TLMFLIGHT_run(const SimConfig_t &cfg, uint32_t seed, double after_s);
+
+/**
+ * @brief The newest state at t_us (the first one before the flight starts).
+ */
+const TLM_State_t &TLMFLIGHT_at(const TlmFlight_t &f, uint64_t t_us);
+
+#endif /* TLM_FLIGHT_H */
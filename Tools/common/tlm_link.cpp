@@ -0,0 +1,72 @@
+/**
+ * @file tlm_link.cpp
+ * @brief The flight computer's radio task (lib/Telemetry, lib/Rfm95) through a simulated flight, on a modelled RFM95.
+ */
+
+#include <cstdio>
+
+#include "tlm_link.h"
+
+
+const RFM_Config_t TLMLINK_RADIO = { 869525000, 250000, 7, 5, 8, 0x12, 17 };
+
+
+TLM_SchedConfig_t TLMLINK_sched_config(const RFM_Config_t &rc, double duty) {
+  TLM_SchedConfig_t c = {};
+  c.airtime_us[TLM_PKT_STATE] = RFM_airtime_us(&rc, TLM_STATE_SIZE);
+  c.airtime_us[TLM_PKT_BEACON] = RFM_airtime_us(&rc, TLM_BEACON_SIZE);
+  c.airtime_us[TLM_PKT_DELTA] = RFM_airtime_us(&rc, TLM_DELTA_SIZE);
+  c.duty = (float)duty;
+  c.min_period_us[TLM_PKT_BEACON] = TLMLINK_BEACON_PERIOD_US;
+  c.keyframe_every = TLMLINK_KEYFRAME_EVERY;
+  c.fec_k = TLMLINK_FEC_K;
+  c.fec_m = TLMLINK_FEC_M;
+  for (size_t n = TLM_REPAIR_HEADER + 2; n <= TLM_MAX_PACKET; n++) {
+    c.repair_airtime_us[n] = RFM_airtime_us(&rc, n);
+  }
+  return c;
+}
+
+
+bool TLMLINK_transmit(const TlmFlight_t &f, const RFM_Config_t &rc, const TLM_SchedConfig_t &sc, TlmAir_t *out) {
+  MockRfm_t m;
+  MOCKRFM_init(&m, &MOCKRFM_ESP32);
+  RFM_Bus_t bus = MOCKRFM_bus(&m);
+  RFM_t radio;
+  if (!RFM_init(&radio, &bus, &rc)) {
+    fprintf(stderr, "RFM_init failed\n");
+    return false;
+  }
+  TLM_Sched_t sched;
+  TLM_sched_init(&sched, &sc);
+
+  out->sent.clear();
+  uint8_t buf[TLM_MAX_PACKET];
+  uint64_t end_us = f.states.back().t_us;
+  uint64_t wake_us = 0;
+  for (uint64_t t = 0; t <= end_us; t += TLMLINK_TICK_US) {
+    MOCKRFM_advance(&m, (double)t);
+    if (radio.busy && (MOCKRFM_dio0(&m) || t >= wake_us)) {
+      RFM_service(&radio);
+      wake_us = t + TLMLINK_WAKE_US;
+    }
+    if (radio.busy) continue;
+    const TLM_State_t &s = TLMFLIGHT_at(f, t);
+    size_t len = TLM_sched_poll(&sched, (int64_t)(uint64_t)m.now_us, &s, buf);
+    if (len && RFM_send(&radio, buf, len)) {
+      out->sent.push_back(s);
+      wake_us = t + TLMLINK_WAKE_US;
+    }
+  }
+  MOCKRFM_advance(&m, m.now_us + 2.0 * TLMLINK_WAKE_US);
+  RFM_service(&radio);
+
+  out->air = m.air;
+  out->end_us = (double)end_us;
+  out->air_us = m.air_us;
+  out->load_us_max = radio.load_us_max;
+  out->timeouts = radio.timeouts;
+  out->forced_keys = sched.forced_keys;
+  out->violations = m.violations;
+  return true;
+}
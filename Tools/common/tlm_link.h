@@ -0,0 +1,61 @@
+/**
+ * @file tlm_link.h
+ * @brief The flight computer's radio task (lib/Telemetry, lib/Rfm95) through a simulated flight, on a modelled RFM95.
+ *
+ * Runs Telemetry_Task as main.cpp does, on a 1 ms tick : DIO0 (TxDone)
+ * serviced, or the radio polled every TLMLINK_WAKE_US without it, and the
+ * packet the scheduler hands out for the newest state (common/tlm_flight.h)
+ * loaded through lib/Rfm95 into an SX1276 register model
+ * (common/mock_rfm95.h). What leaves the model is every packet on the air
+ * with its start and end, and the state each one was built from, for a
+ * ground model to receive.
+ */
+
+#ifndef TLM_LINK_H
+#define TLM_LINK_H
+
+#include <cstdint>
+#include <vector>
+
+#include "mock_rfm95.h"
+#include "rfm95.h"
+#include "telemetry.h"
+#include "tlm_flight.h"
+
+
+#define TLMLINK_TICK_US 1000          // Radio task tick
+#define TLMLINK_WAKE_US 100000        // The radio task wakes this often without DIO0 (TLM_WAKE_MS)
+#define TLMLINK_BEACON_PERIOD_US 5000000  // As TLM_BEACON_PERIOD_MS in main.cpp
+#define TLMLINK_DUTY 0.10             // As TLM_DUTY_PERCENT in main.cpp
+#define TLMLINK_KEYFRAME_EVERY 4      // As TLM_KEYFRAME_EVERY in main.cpp
+#define TLMLINK_FEC_K 4               // As TLM_FEC_K / TLM_FEC_M in main.cpp
+#define TLMLINK_FEC_M 0
+
+// main.cpp defaults : 869.525 MHz (10 % band), 250 kHz, SF7, 4/5, 8 symbols, PA_BOOST 17 dBm.
+extern const RFM_Config_t TLMLINK_RADIO;
+
+typedef struct {
+  std::vector<MockRfmPacket_t> air;   // Every packet sent, oldest first
+  std::vector<TLM_State_t> sent;      // The state packet i was built from
+  double end_us;                      // Length of the run
+  double air_us;                      // Time on the air
+  uint32_t load_us_max;               // Longest RFM_send()
+  uint32_t timeouts;                  // TxDone given up
+  uint32_t forced_keys;               // Keyframes sent early, the state out of DELTA range
+  uint64_t violations;                // Radio model protocol violations
+} TlmAir_t;
+
+
+/**
+ * @brief Scheduler settings of main.cpp for the radio settings rc and a duty cycle, keyframe every
+ *        TLMLINK_KEYFRAME_EVERY, TLMLINK_FEC_M REPAIRs every TLMLINK_FEC_K packets.
+ */
+TLM_SchedConfig_t TLMLINK_sched_config(const RFM_Config_t &rc, double duty);
+
+/**
+ * @brief Every packet the flight computer sends through flight f.
+ * @return false (and a message on stderr) if the radio does not start.
+ */
+bool TLMLINK_transmit(const TlmFlight_t &f, const RFM_Config_t &rc, const TLM_SchedConfig_t &sc, TlmAir_t *out);
+
+#endif /* TLM_LINK_H */
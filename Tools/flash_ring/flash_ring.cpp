@@ -0,0 +1,442 @@
+/**
+ * @file flash_ring.cpp
+ * @brief Flash fallback log (lib/FlashRing) on a mock NOR flash : throughput against ODR, wrap, wear, power cuts.
+ *
+ * Logs the flight computer's record stream (ACCEL carrying a record counter,
+ * 50 Hz BARO, STATE every 8 ACCEL, two TIMING, a SPECTRUM and two STORAGE
+ * once a second) into the flash ring on a mock flash the size of the
+ * firmware's flightlog partition (common/mock_flash.h, quad SPI NOR timing),
+ * as main.cpp does : a power on boot fills the runway to FLASH_RUNWAY_SLOTS
+ * sectors erased ahead (the pad keeps it full up to launch), in flight a slot
+ * is committed when full and once a second, nothing is erased ahead. Per
+ * logged ACCEL rate :
+ *
+ * - slot bytes written per second (records and the padding of the slot
+ *   committed each second) against what the flash sustains, programming
+ *   only (runway) and erasing each sector on the way (runway used up);
+ * - how long the runway lasts, commits that had to erase first, worst
+ *   commit before and after;
+ * - flash busy time over the flight and how many minutes the ring holds.
+ *
+ * Then the log is read back after a reboot : every slot from the oldest kept
+ * to the newest, in order, every ACCEL counter. Checks :
+ *
+ * - wrap : twelve boots on a 1 MB ring, each a few laps, logging resumes
+ *   after the newest slot, every sector erased the same number of times
+ *   (within one), no byte ever programmed over unerased bits;
+ * - power cuts : inside every kind of flash operation (erase ahead, slot
+ *   program, erase at commit), recovery keeps every slot committed before the
+ *   cut and logs on after it.
+ *
+ * Usage :
+ *   flash_ring [--minutes N]
+ *   flash_ring unwrap <partition dump> <journal out>
+ *
+ * unwrap takes a dump of the partition (esptool.py read_flash, partitions.csv)
+ * and writes its slots oldest first, renumbered 0, 1, 2... : a log journal
+ * for log_decode and the other host tools.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "flash_ring.h"
+#include "flight_log.h"
+#include "mock_flash.h"
+
+
+#define PARTITION_BYTES 0xCF0000u      // flightlog partition, partitions.csv
+#define RUNWAY_SLOTS 1280              // FLASH_RUNWAY_SLOTS of the firmware
+#define WRAP_BYTES (1024u * 1024)
+#define WRAP_RUNWAY 32
+#define WRAP_BOOTS 12
+
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Logger
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  MockFlash_t flash;
+  FRING_t r;
+  uint32_t runway;            // Erased ahead before launch, 0 : never
+  uint64_t counter;           // Next ACCEL counter
+  uint64_t t_us;              // Flight clock, carried across boots
+  std::vector<double> commit_us;
+  uint32_t first_stall;       // Commits before the first one that erased, UINT32_MAX : none
+  uint64_t committed;         // ACCEL counter after the newest committed slot
+  uint64_t staged;            // ACCEL counters staged, not yet committed
+} Logger_t;
+
+
+static bool logger_boot(Logger_t *l, FRING_Recovery_t *rec) {
+  FRING_Io_t io = MOCKFLASH_ring_io(&l->flash);
+  if (!FRING_open(&l->r, &io, 0x464C5348u, rec)) {
+    return false;
+  }
+  l->staged = 0;
+  return true;
+}
+
+
+static bool logger_commit(Logger_t *l) {
+  if (l->r.used == 0) {
+    return true;
+  }
+  uint32_t stalls = l->r.stalls;
+  double clock0 = l->flash.clock_us;
+  bool ok = FRING_commit(&l->r);
+  l->commit_us.push_back(l->flash.clock_us - clock0);
+  if (l->r.stalls != stalls && l->first_stall == UINT32_MAX) {
+    l->first_stall = (uint32_t)l->commit_us.size() - 1;
+  }
+  if (ok) l->committed += l->staged;
+  l->staged = 0;
+  return ok;
+}
+
+
+static void logger_record(Logger_t *l, uint8_t type, const void *payload, uint16_t len) {
+  if (!FRING_fits(&l->r, len)) logger_commit(l);
+  FRING_append(&l->r, type, l->t_us, payload, len);
+  if (type == LOG_REC_ACCEL) l->staged++;
+}
+
+
+// A power on boot : erase ahead until the runway is there (main.cpp Flash_Fill_Runway()).
+static void logger_fill(Logger_t *l) {
+  while (FRING_service(&l->r, l->runway)) {
+  }
+}
+
+
+// seconds of flight at accel_hz, ACCEL counters going on from l->counter.
+static void logger_fly(Logger_t *l, double seconds, uint32_t accel_hz) {
+  uint64_t end = l->t_us + (uint64_t)(seconds * 1e6);
+  uint64_t period = 1000000 / accel_hz;
+  uint64_t next_accel = l->t_us, next_baro = l->t_us, next_second = l->t_us + 1000000;
+  uint32_t state_div = 0;
+  static const uint8_t zeros[sizeof(LOG_Spectrum_t)] = { 0 };
+  while (next_accel < end) {
+    uint64_t t = std::min(next_accel, std::min(next_baro, next_second));
+    l->t_us = t;
+    if (t == next_accel) {
+      LOG_Accel_t a;
+      uint64_t c = l->counter++;
+      memcpy(a.acc_raw, &c, sizeof(a.acc_raw));
+      logger_record(l, LOG_REC_ACCEL, &a, sizeof(a));
+      if (++state_div == 8) {
+        logger_record(l, LOG_REC_STATE, zeros, sizeof(LOG_State_t));
+        state_div = 0;
+      }
+      next_accel += period;
+    } else if (t == next_baro) {
+      logger_record(l, LOG_REC_BARO, zeros, sizeof(LOG_Baro_t));
+      next_baro += 20000;
+    } else {
+      logger_record(l, LOG_REC_TIMING, zeros, sizeof(LOG_Timing_t));
+      logger_record(l, LOG_REC_TIMING, zeros, sizeof(LOG_Timing_t));
+      logger_record(l, LOG_REC_SPECTRUM, zeros, sizeof(LOG_Spectrum_t));
+      logger_record(l, LOG_REC_STORAGE, zeros, sizeof(LOG_Storage_t));
+      logger_record(l, LOG_REC_STORAGE, zeros, sizeof(LOG_Storage_t));
+      logger_commit(l);
+      next_second += 1000000;
+    }
+  }
+  logger_commit(l);
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Read back
+//--------------------------------------------------------------------------------------------
+// Every slot from first to next - 1 checks, and its ACCEL counters go on by
+// one from the first found. *first_counter, *end_counter : the range read.
+static bool read_back(FRING_t *r, uint64_t *first_counter, uint64_t *end_counter) {
+  static uint8_t slot[LOG_SLOT_SIZE];
+  bool started = false;
+  uint64_t expect = 0;
+  for (uint32_t seq = r->first; seq < r->next; seq++) {
+    if (!FRING_read(r, seq, slot)) {
+      return false;
+    }
+    LOG_Commit_t c;
+    LOG_slot_check(slot, &c);
+    size_t at = 0;
+    while (at < c.used) {
+      LOG_Record_t rec;
+      if (LOG_decode(slot + at, c.used - at, &rec) != LOG_OK) {
+        return false;
+      }
+      if (rec.type == LOG_REC_ACCEL) {
+        uint64_t counter = 0;
+        memcpy(&counter, rec.payload, sizeof(LOG_Accel_t));
+        if (!started) {
+          *first_counter = expect = counter;
+          started = true;
+        }
+        if (counter != expect) {
+          return false;
+        }
+        expect++;
+      }
+      at += rec.size;
+    }
+  }
+  if (!started) *first_counter = 0;
+  *end_counter = expect;
+  return true;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Throughput against ODR
+//--------------------------------------------------------------------------------------------
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0.0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))];
+}
+
+
+// Bytes per second written to the flash, programming only and erasing each sector too.
+static void flash_capacity(const MockFlashTiming_t *t, double *program_kb_s, double *erase_kb_s) {
+  double pages = LOG_SLOT_SIZE / MOCKFLASH_PAGE;
+  double program_us = pages * (t->cmd_us + MOCKFLASH_PAGE / t->bus_mb_s + t->page_program_us);
+  double erase_us = t->cmd_us + t->sector_erase_us;
+  *program_kb_s = LOG_SLOT_SIZE / program_us * 1e3;
+  *erase_kb_s = LOG_SLOT_SIZE / (program_us + erase_us) * 1e3;
+}
+
+
+static bool bench_rate(uint32_t accel_hz, double minutes) {
+  static Logger_t l;
+  MOCKFLASH_init(&l.flash, PARTITION_BYTES, &MOCKFLASH_QSPI_NOR);
+  l.runway = RUNWAY_SLOTS;
+  l.counter = 0;
+  l.t_us = 0;
+  l.commit_us.clear();
+  l.first_stall = UINT32_MAX;
+  l.committed = 0;
+  FRING_Recovery_t rec;
+  if (!logger_boot(&l, &rec)) {
+    return false;
+  }
+  // A ring written before : every sector holds an old slot and must be erased.
+  memset(l.flash.mem.data(), 0, l.flash.size);
+  logger_boot(&l, &rec);
+  logger_fill(&l);
+  double fill_s = l.flash.clock_us * 1e-6;
+  double clock0 = l.flash.clock_us;
+
+  logger_fly(&l, minutes * 60.0, accel_hz);
+  double flight_s = minutes * 60.0;
+  double data_kb_s = (double)l.r.next * LOG_SLOT_SIZE / flight_s * 1e-3;
+  double busy = (l.flash.clock_us - clock0) * 1e-6 / flight_s;
+  uint32_t stall_at = l.first_stall == UINT32_MAX ? (uint32_t)l.commit_us.size() : l.first_stall;
+  std::vector<double> before(l.commit_us.begin(), l.commit_us.begin() + stall_at);
+  std::vector<double> after(l.commit_us.begin() + stall_at, l.commit_us.end());
+  double runway_s = (double)RUNWAY_SLOTS * LOG_SLOT_SIZE / (data_kb_s * 1e3);
+  double ring_min = (double)l.r.slots * LOG_SLOT_SIZE / (data_kb_s * 1e3) / 60.0;
+  uint32_t stalls = l.r.stalls;
+
+  // Reboot and read back what the ring kept.
+  uint64_t first, end;
+  bool ok = logger_boot(&l, &rec) && rec.slots == std::min(l.r.next, l.r.slots) &&
+            read_back(&l.r, &first, &end) && end == l.committed && l.flash.dirty_programs == 0;
+  char after_s[16] = "-";
+  if (!after.empty()) snprintf(after_s, sizeof(after_s), "%.1f", *std::max_element(after.begin(), after.end()) * 1e-3);
+  printf("| %10u | %14.1f | %7.0f s | %5.0f s | %17.2f | %17s | %6u | %4.1f %% | %10.1f | %-5s |\n", accel_hz,
+         data_kb_s, fill_s, runway_s, percentile(before, 1.0) * 1e-3, after_s, stalls, busy * 100.0, ring_min,
+         ok ? "ok" : "FAIL");
+  return ok;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Wrap and wear, power cuts
+//--------------------------------------------------------------------------------------------
+// Boots of a few laps each : the ring goes on from its head, sectors wear evenly.
+static bool check_wrap(void) {
+  static Logger_t l;
+  MOCKFLASH_init(&l.flash, WRAP_BYTES, &MOCKFLASH_QSPI_NOR);
+  l.runway = WRAP_RUNWAY;
+  l.counter = 0;
+  l.t_us = 0;
+  l.committed = 0;
+  uint32_t expect_next = 0;
+  for (int boot = 0; boot < WRAP_BOOTS; boot++) {
+    FRING_Recovery_t rec;
+    if (!logger_boot(&l, &rec) || l.r.next != expect_next || l.r.session != (uint32_t)boot + 1) {
+      return false;
+    }
+    uint64_t first, end;
+    if (!read_back(&l.r, &first, &end) || end != l.committed) {
+      return false;
+    }
+    logger_fill(&l);
+    logger_fly(&l, 20.0 + 17.0 * boot, 800);
+    expect_next = l.r.next;
+  }
+  uint32_t lo = *std::min_element(l.flash.erase_count.begin(), l.flash.erase_count.end());
+  uint32_t hi = *std::max_element(l.flash.erase_count.begin(), l.flash.erase_count.end());
+  printf("wrap : %d boots, %u slots on a %u slot ring, sector erases %u to %u, %llu bytes programmed dirty\n",
+         WRAP_BOOTS, expect_next, l.r.slots, lo, hi, (unsigned long long)l.flash.dirty_programs);
+  return hi - lo <= 1 && l.flash.dirty_programs == 0;
+}
+
+
+// One cut per operation of a boot that erases ahead, then runs out of runway :
+// the slots committed before it stay, logging goes on after it.
+static bool check_power_cuts(void) {
+  static Logger_t l;
+  uint64_t ops_total = 0;
+  {
+    MOCKFLASH_init(&l.flash, WRAP_BYTES, &MOCKFLASH_QSPI_NOR);
+    l.runway = WRAP_RUNWAY;
+    l.counter = 0;
+    l.t_us = 0;
+    l.committed = 0;
+    FRING_Recovery_t rec;
+    logger_boot(&l, &rec);
+    logger_fly(&l, 90.0, 800);     // Written once, so erases are real
+    logger_boot(&l, &rec);
+    uint64_t ops0 = l.flash.pages_programmed + l.flash.sectors_erased;
+    logger_fill(&l);
+    logger_fly(&l, 30.0, 800);
+    ops_total = l.flash.pages_programmed + l.flash.sectors_erased - ops0;
+  }
+
+  int cuts = 0, failures = 0;
+  for (uint64_t cut = 0; cut < ops_total; cut += 7) {
+    MOCKFLASH_init(&l.flash, WRAP_BYTES, &MOCKFLASH_QSPI_NOR);
+    l.runway = WRAP_RUNWAY;
+    l.counter = 0;
+    l.t_us = 0;
+    l.committed = 0;
+    FRING_Recovery_t rec;
+    logger_boot(&l, &rec);
+    logger_fly(&l, 90.0, 800);
+    logger_boot(&l, &rec);
+    MOCKFLASH_cut_after(&l.flash, cut);
+    logger_fill(&l);
+    logger_fly(&l, 30.0, 800);
+    MOCKFLASH_power_on(&l.flash);
+    cuts++;
+
+    // Everything committed before the cut is there, and logging goes on.
+    uint64_t first, end, committed = l.committed;
+    bool ok = logger_boot(&l, &rec) && read_back(&l.r, &first, &end) && end == committed;
+    l.committed = end;
+    l.counter = end;
+    logger_fill(&l);
+    logger_fly(&l, 10.0, 800);
+    ok = ok && logger_boot(&l, &rec) && read_back(&l.r, &first, &end) && end == l.committed;
+    failures += !ok;
+  }
+  printf("power cuts : %d cuts over %llu erase and program operations, %d lost a committed slot or the log after\n",
+         cuts, (unsigned long long)ops_total, failures);
+  return failures == 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Unwrap a partition dump
+//--------------------------------------------------------------------------------------------
+static int unwrap(const char *in_path, const char *out_path) {
+  FILE *in = fopen(in_path, "rb");
+  if (!in) {
+    fprintf(stderr, "cannot open %s\n", in_path);
+    return 1;
+  }
+  fseek(in, 0, SEEK_END);
+  long size = ftell(in);
+  fseek(in, 0, SEEK_SET);
+  static MockFlash_t flash;
+  MOCKFLASH_init(&flash, (uint32_t)size, &MOCKFLASH_QSPI_NOR);
+  size_t got = fread(flash.mem.data(), 1, flash.size, in);
+  fclose(in);
+  if (got != flash.size) {
+    fprintf(stderr, "cannot read %s\n", in_path);
+    return 1;
+  }
+
+  static FRING_t r;
+  FRING_Recovery_t rec;
+  FRING_Io_t io = MOCKFLASH_ring_io(&flash);
+  if (!FRING_open(&r, &io, 0, &rec) || rec.slots == 0) {
+    fprintf(stderr, "%s : no flash ring slot\n", in_path);
+    return 1;
+  }
+  FILE *out = fopen(out_path, "wb");
+  if (!out) {
+    fprintf(stderr, "cannot create %s\n", out_path);
+    return 1;
+  }
+  static uint8_t slot[LOG_SLOT_SIZE];
+  uint32_t written = 0, sessions = 0, session = 0;
+  for (uint32_t seq = r.first; seq < r.next; seq++) {
+    LOG_Commit_t c;
+    if (!FRING_read(&r, seq, slot) || !LOG_slot_check(slot, &c)) {
+      break;
+    }
+    if (c.session != session) sessions++;
+    session = c.session;
+    c.seq = written++;
+    LOG_slot_close(slot, c.used, &c);
+    fwrite(slot, 1, LOG_SLOT_SIZE, out);
+  }
+  fclose(out);
+  printf("%s : %u slots (ring seq %u to %u, %u sessions) written to %s\n", in_path, written, r.first,
+         r.first + written - 1, sessions, out_path);
+  return written == r.next - r.first ? 0 : 1;
+}
+
+
+int main(int argc, char **argv) {
+  if (argc == 4 && !strcmp(argv[1], "unwrap")) {
+    return unwrap(argv[2], argv[3]);
+  }
+  double minutes = 15.0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--minutes") && i + 1 < argc) minutes = atof(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--minutes N]\n       %s unwrap <partition dump> <journal out>\n", argv[0], argv[0]);
+      return 1;
+    }
+  }
+  if (minutes <= 0.0) {
+    fprintf(stderr, "--minutes must be positive\n");
+    return 1;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  const MockFlashTiming_t *t = &MOCKFLASH_QSPI_NOR;
+  double program_kb_s, erase_kb_s;
+  flash_capacity(t, &program_kb_s, &erase_kb_s);
+  printf("Flash (%s) : %.0f kB/s programming erased sectors, %.0f kB/s erasing each one first\n",
+         t->name, program_kb_s, erase_kb_s);
+  printf("Partition %u kB (%u slots), runway %u slots erased ahead before launch, %.0f min of flight\n\n",
+         PARTITION_BYTES >> 10, PARTITION_BYTES / LOG_SLOT_SIZE, RUNWAY_SLOTS, minutes);
+
+  int failures = 0;
+  printf("| ACCEL (Hz) | Written (kB/s) | Boot fill | Runway  | Worst commit (ms) | After runway (ms) | Stalls | Busy   | Ring (min) | Check |\n");
+  printf("| ---------- | -------------- | --------- | ------- | ----------------- | ----------------- | ------ | ------ | ---------- | ----- |\n");
+  for (uint32_t hz : { 400u, 800u, 1600u, 3200u }) {
+    failures += !bench_rate(hz, minutes);
+  }
+  printf("\n");
+  failures += !check_wrap();
+  failures += !check_power_cuts();
+  printf("\n%s (%.1f s)\n", failures ? "FAIL" : "all logs read back exactly", seconds_since(t0));
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,1043 @@
+/**
+ * @file ground_station.cpp
+ * @brief Ground station for the LoRa telemetry (lib/Telemetry) : live flight state, dashboard and log from a serial receiver.
+ *
+ * A LoRa receiver on a serial port forwards each packet it hears as a RADIO
+ * record (lib/FlightLog) : its clock at RxDone, RSSI, SNR and the packet.
+ * listen reads that stream and keeps the flight state from it.
+ *
+ * - A reader thread does nothing but move bytes from the port into a
+ *   RX_RING_SIZE ring, so a slow terminal or disk never leaves bytes in
+ *   the kernel's few kB of tty buffer long enough to be lost.
+ * - Records are decoded where they lie in the ring : the packet is
+ *   unpacked straight from the record payload, and the record is written
+ *   to the log from there too. Only a record split by the end of the ring
+ *   is copied, once, to put its two halves together.
+ * - The log is a record log like the flight computer's : every RADIO
+ *   record as it came, then STATE, GPS and EVENT (launch, apogee) records
+ *   decoded from the packets, at the flight computer's time. log_decode,
+ *   traj_smooth and the other tools read it as they read the board's.
+ * - DELTA packets are applied to their keyframe (TLM_receive()); one whose
+ *   keyframe was lost is counted and gives no state until the next one.
+ * - With FEC on the board, REPAIR packets rebuild what their group lost
+ *   (TLM_rebuilt()). A rebuilt state is logged at its own time and shown
+ *   if it is the newest; it has no latency of its own.
+ * - Loss is counted from the packet sequence numbers. The board's clock is
+ *   unknown on the ground : latency is taken against the fastest packet so
+ *   far, as if that one had waited for nothing but its own airtime.
+ *
+ * The dashboard shows phase, altitude, velocity, GPS position, range and
+ * bearing from the pad, battery and health, and the link : packets, loss,
+ * RSSI, SNR, rate and latency, overall and over the last STATS_WINDOW
+ * packets. Not on a terminal (or --quiet) it prints phase changes only.
+ *
+ * receiver stands in for the receiver : a flight of the library through
+ * the flight computer's radio task (common/tlm_link.h), received with a
+ * loss rate and a path loss model and sent on a pseudo terminal
+ * (common/pty_link.h) at 115200 baud, in real time or faster.
+ *
+ * sim runs listen's decoder against the receiver stand-in :
+ * - every flight of the library, with and without FEC, checking what the
+ *   station saw (packets, loss, latency, events, the final state, its log
+ *   read back) against what was sent;
+ * - bursts of records at 1 MB/s while the decoder stalls every
+ *   half second, read through the ring and straight from the port;
+ * - the decoder's time per record.
+ *
+ * Usage :
+ *   ground_station listen <tty> [--baud N] [--log FILE] [--sf N] [--bw HZ] [--quiet]
+ *   ground_station receiver [--flight N] [--loss P] [--speed X] [--fec M]
+ *   ground_station sim
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "baro_altitude.h"
+#include "flight_log.h"
+#include "log_reader.h"
+#include "pty_link.h"
+#include "rfm95.h"
+#include "telemetry.h"
+#include "tlm_flight.h"
+#include "tlm_link.h"
+
+
+#define RX_RING_SIZE (1u << 20)       // Bytes between the reader thread and the decoder
+#define RX_READ_CHUNK 4096
+#define RX_MAX_RECORD (LOG_OVERHEAD + LOG_RADIO_HEADER + LOG_RADIO_MAX_PACKET)
+#define RX_REOPEN_MS 1000             // A port gone (receiver unplugged) is opened again this often
+#define STATS_WINDOW 100              // Packets of the recent loss and latency
+#define RATE_WINDOW_US 10000000       // Packet rate over the last 10 s
+#define DASH_PERIOD_S 0.2
+#define LOG_FLUSH_S 1.0
+#define AFTER_LANDING_S 60.0
+#define GROUND_DISTANCE_M 1000.0      // Receiver from the pad, for the path loss
+#define RX_GAIN_DB 4.0                // Both antennas
+#define RX_NOISE_FIGURE_DB 6.0
+#define RX_OFFSET_US 5000000000ULL    // Receiver clock at the board's boot
+#define RX_STAMP_US 60                // RxDone to the receiver's stamp
+#define BURST_RECORDS 256             // Records per write in the burst test
+#define BURST_TOTAL 40000
+#define STALL_EVERY_S 0.5             // Burst test : the decoder stalls this often ...
+#define STALL_S 0.3                   // ... this long (a terminal, a disk)
+
+// USB serial adapter of a LoRa receiver at 115200 8N1, 2 ms latency timer.
+static const PtyLinkModel_t RECEIVER_LINK = { "LoRa receiver, 115200 8N1", 11520.0, 2000.0, 0.0, 0.0 };
+
+static const char *PHASE_NAMES[] = { "PAD", "BOOST", "COAST", "DESCENT", "LANDED" };
+
+
+//--------------------------------------------------------------------------------------------
+// Receive ring
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  const char *path;
+  long baud;
+  int fd;
+  std::vector<uint8_t> buf;
+  std::atomic<uint64_t> head;         // Bytes read, written by the reader thread only
+  std::atomic<uint64_t> tail;         // Bytes decoded, written by the decoder only
+  std::atomic<bool> stop;
+  // Statistics
+  std::atomic<uint64_t> full_waits;   // The ring was full : the reader left bytes in the port
+  std::atomic<uint64_t> depth_max;
+  std::atomic<uint32_t> reopens;
+} RxRing_t;
+
+
+static speed_t baud_code(long baud) {
+  switch (baud) {
+    case 9600: return B9600;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return B0;
+  }
+}
+
+
+static int port_open(const char *tty, long baud) {
+  int fd = open(tty, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) {
+    return -1;
+  }
+  struct termios tio;
+  tcgetattr(fd, &tio);
+  cfmakeraw(&tio);
+  if (baud_code(baud) != B0) {
+    cfsetispeed(&tio, baud_code(baud));
+    cfsetospeed(&tio, baud_code(baud));
+  }
+  tcsetattr(fd, TCSANOW, &tio);
+  return fd;
+}
+
+
+static void ring_init(RxRing_t *r, const char *path, long baud, int fd) {
+  r->path = path;
+  r->baud = baud;
+  r->fd = fd;
+  r->buf.assign(RX_RING_SIZE, 0);
+  r->head = r->tail = 0;
+  r->stop = false;
+  r->full_waits = r->depth_max = 0;
+  r->reopens = 0;
+}
+
+
+// The reader thread : port to ring, nothing else.
+static void ring_reader(RxRing_t *r) {
+  while (!r->stop) {
+    if (r->fd < 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(RX_REOPEN_MS));
+      r->fd = port_open(r->path, r->baud);
+      if (r->fd >= 0) r->reopens++;
+      continue;
+    }
+    uint64_t head = r->head.load(std::memory_order_relaxed);
+    uint64_t free = RX_RING_SIZE - (head - r->tail.load(std::memory_order_acquire));
+    if (free == 0) {
+      r->full_waits++;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    struct pollfd p = { r->fd, POLLIN, 0 };
+    if (poll(&p, 1, 50) <= 0) continue;
+    size_t at = (size_t)(head % RX_RING_SIZE);
+    size_t room = (size_t)std::min<uint64_t>(free, RX_RING_SIZE - at);
+    ssize_t got = read(r->fd, &r->buf[at], std::min<size_t>(room, RX_READ_CHUNK));
+    if (got > 0) {
+      r->head.store(head + (uint64_t)got, std::memory_order_release);
+      uint64_t depth = head + (uint64_t)got - r->tail.load(std::memory_order_relaxed);
+      if (depth > r->depth_max) r->depth_max = depth;
+    } else if (got == 0 || (errno != EAGAIN && errno != EINTR)) {
+      close(r->fd);                   // Unplugged : try again later
+      r->fd = -1;
+    }
+  }
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Decoder and flight state
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  RFM_Config_t radio;                 // For the airtime of each packet
+  FILE *log;
+
+  // Flight
+  TLM_Receiver_t rx;                  // Keyframe of the DELTAs
+  TLM_State_t state;                  // Newest decoded
+  bool have_state;
+  uint64_t board_epoch_us;            // Wraps of the 24 bit packet stamp
+  uint32_t board_last_raw;
+  bool launched, apogee;
+  uint64_t launch_board_us, apogee_board_us;
+  int32_t pad_lat_e7, pad_lon_e7;
+  bool have_pad;
+  LOG_Gps_t gps_logged;
+
+  // Link
+  uint64_t packets, by_type[TLM_PKT_TYPES], bad;
+  uint64_t states;                    // Whole states, received or rebuilt
+  uint64_t lost, resets;              // From the sequence numbers
+  int last_seq;
+  int16_t rssi_last, rssi_min;
+  double snr_last, snr_min;
+  double offset_min_us;               // Smallest receiver - board time less airtime so far
+  uint64_t rx_last_us;                // Receiver clock of the newest packet
+  double host_last_s;                 // Host clock when it was decoded
+  std::vector<uint8_t> window_lost;   // Per packet : packets lost just before it, last STATS_WINDOW
+  std::vector<double> window_latency_ms;
+  std::vector<uint64_t> recent_rx_us; // Last RATE_WINDOW_US of packets
+  std::vector<double> latency_ms;     // Every packet, raw receiver - board time (offset applied at the end), NAN without one
+  std::vector<uint32_t> airtime_us;
+
+  // Stream
+  uint64_t bytes, records, others, skipped, wrap_copies;
+} Station_t;
+
+
+static void station_init(Station_t *st, const RFM_Config_t &radio, FILE *log) {
+  *st = Station_t();
+  st->radio = radio;
+  st->log = log;
+  TLM_rx_init(&st->rx);
+  st->last_seq = -1;
+  st->rssi_min = INT16_MAX;
+  st->snr_min = INFINITY;
+  st->offset_min_us = INFINITY;
+}
+
+
+static void log_record(Station_t *st, uint8_t type, uint64_t t_us, const void *payload, uint16_t len) {
+  if (!st->log) return;
+  uint8_t out[LOG_OVERHEAD + sizeof(LOG_Event_t) + sizeof(LOG_Gps_t)];
+  size_t n = LOG_encode(out, type, t_us, payload, len);
+  fwrite(out, 1, n, st->log);
+}
+
+
+static void log_event(Station_t *st, uint8_t id, uint64_t board_us, float altitude) {
+  LOG_Event_t ev = {};
+  ev.id = id;
+  ev.t_fired_us = (int64_t)board_us;
+  ev.t_estimate_us = (int64_t)board_us;
+  ev.altitude = altitude;
+  for (int i = 0; i < 3; i++) ev.vote_offset_ms[i] = INT32_MIN;
+  log_record(st, LOG_REC_EVENT, board_us, &ev, sizeof(ev));
+}
+
+
+template <typename T>
+static void window_push(std::vector<T> &w, T v) {
+  if (w.size() == STATS_WINDOW) w.erase(w.begin());
+  w.push_back(v);
+}
+
+
+// Launch and apogee, from the first state of their phase.
+static void station_events(Station_t *st, const TLM_State_t &s, uint64_t board_us) {
+  if (!st->launched && s.phase != TLM_PHASE_PAD) {
+    st->launched = true;
+    st->launch_board_us = board_us;
+    log_event(st, LOG_EVENT_LAUNCH, board_us, s.altitude);
+  }
+  if (!st->apogee && s.phase >= TLM_PHASE_DESCENT) {
+    st->apogee = true;
+    st->apogee_board_us = board_us;
+    log_event(st, LOG_EVENT_APOGEE, board_us, std::max(st->state.max_altitude, s.max_altitude));
+  }
+}
+
+
+// Board time of a packet's stamp, 24 bits of 10 ms : ~46 h before it wraps. Only packets in order move it on.
+static uint64_t board_time(Station_t *st, uint64_t t_us, bool late) {
+  uint32_t raw = (uint32_t)(t_us / 10000);
+  if (late) {
+    bool before_wrap = raw > st->board_last_raw + (1u << 23) && st->board_epoch_us;
+    return st->board_epoch_us - (before_wrap ? (1ull << 24) * 10000 : 0) + t_us;
+  }
+  if (st->have_state && raw + (1u << 23) < st->board_last_raw) st->board_epoch_us += (1ull << 24) * 10000;
+  st->board_last_raw = raw;
+  return st->board_epoch_us + t_us;
+}
+
+
+// The flight from a state, received or rebuilt late. A late one older than the state shown is logged and may
+// still be the first of its phase, nothing more.
+static void station_state(Station_t *st, const TLM_Packet_t &pkt, uint64_t board_us, bool late) {
+  const TLM_State_t &s = pkt.state;
+  if (pkt.type != TLM_PKT_BEACON) {
+    st->states++;
+    LOG_State_t rs = { s.altitude, s.velocity, s.acceleration, (uint8_t)((s.health & TLM_HEALTH_BARO_LOCKED) != 0) };
+    log_record(st, LOG_REC_STATE, board_us, &rs, sizeof(rs));
+  }
+  if (late && st->have_state && board_us <= st->state.t_us) {
+    station_events(st, s, board_us);
+    return;
+  }
+  if (pkt.type != TLM_PKT_BEACON) {
+    TLM_State_t keep = st->state;
+    st->state = s;
+    st->state.t_us = board_us;
+    if (st->have_state && keep.max_altitude > st->state.max_altitude) st->state.max_altitude = keep.max_altitude;
+  } else {
+    // A beacon : position, peak altitude, battery and health only.
+    st->state.t_us = board_us;
+    st->state.phase = s.phase;
+    st->state.max_altitude = std::max(st->state.max_altitude, s.max_altitude);
+    st->state.lat_e7 = s.lat_e7;
+    st->state.lon_e7 = s.lon_e7;
+    st->state.gps_height_mm = s.gps_height_mm;
+    st->state.gps_fix = s.gps_fix;
+    st->state.battery_mv = s.battery_mv;
+    st->state.health = s.health;
+    st->state.velocity = 0.0f;
+    st->state.acceleration = 0.0f;
+  }
+  st->have_state = true;
+  if (!st->have_pad && s.gps_fix >= 3) {
+    st->pad_lat_e7 = s.lat_e7;
+    st->pad_lon_e7 = s.lon_e7;
+    st->have_pad = true;
+  }
+  station_events(st, s, board_us);
+  if (s.gps_fix != st->gps_logged.gps_fix || s.lat_e7 != st->gps_logged.gps_lat ||
+      s.lon_e7 != st->gps_logged.gps_lon || s.gps_height_mm / 1000 != st->gps_logged.gps_height / 1000) {
+    LOG_Gps_t g = {};
+    g.gps_fix = s.gps_fix;
+    g.gps_lat = s.lat_e7;
+    g.gps_lon = s.lon_e7;
+    g.gps_height = s.gps_height_mm;
+    st->gps_logged = g;
+    log_record(st, LOG_REC_GPS, board_us, &g, sizeof(g));
+  }
+}
+
+
+
+
+// One RADIO record, its payload where it lies.
+static void station_packet(Station_t *st, const LOG_Record_t &rec) {
+  const uint8_t *p = rec.payload;
+  uint8_t len = p[3];
+  const uint8_t *packet = p + LOG_RADIO_HEADER;
+  TLM_Packet_t pkt;
+  TLM_RxStatus_t status = TLM_receive(&st->rx, packet, len, &pkt);
+  if (status == TLM_RX_BAD) {
+    st->bad++;
+    return;
+  }
+  st->packets++;
+  st->by_type[pkt.type]++;
+  st->rssi_last = (int16_t)(p[0] | p[1] << 8);
+  st->snr_last = (int8_t)p[2] * 0.25;
+  st->rssi_min = std::min(st->rssi_min, st->rssi_last);
+  st->snr_min = std::min(st->snr_min, st->snr_last);
+
+  uint8_t gap = 0;
+  if (status != TLM_RX_REPAIR) {      // A REPAIR carries its group's first SEQ, none of its own
+    if (st->last_seq >= 0) {
+      uint32_t d = (pkt.seq - (uint32_t)st->last_seq - 1) & TLM_SEQ_MASK;
+      if (d <= TLM_SEQ_MASK / 2) {
+        st->lost += d;
+        gap = (uint8_t)std::min<uint32_t>(d, 255);
+      } else {
+        st->resets++;                 // Repeated or out of order : the board rebooted
+      }
+    }
+    st->last_seq = pkt.seq;
+  }
+  window_push(st->window_lost, gap);
+  st->recent_rx_us.push_back(rec.t_us);
+  while (!st->recent_rx_us.empty() && st->recent_rx_us.front() + RATE_WINDOW_US < rec.t_us) {
+    st->recent_rx_us.erase(st->recent_rx_us.begin());
+  }
+  st->rx_last_us = rec.t_us;
+  st->host_last_s = PTYLINK_now_s();
+  if (status != TLM_RX_OK) {
+    // NO_KEY : no time nor state without the keyframe, wait for the next one. REPAIR : what it rebuilt, late.
+    st->latency_ms.push_back(NAN);
+    st->airtime_us.push_back(0);
+    while (status == TLM_RX_REPAIR && TLM_rebuilt(&st->rx, &pkt)) {
+      station_state(st, pkt, board_time(st, pkt.state.t_us, true), true);
+    }
+    return;
+  }
+
+  uint64_t board_us = board_time(st, pkt.state.t_us, false);
+  uint32_t airtime = RFM_airtime_us(&st->radio, len);
+  double raw_latency = (double)rec.t_us - (double)board_us;
+  st->offset_min_us = std::min(st->offset_min_us, raw_latency - airtime);
+  double latency_ms = (raw_latency - st->offset_min_us) * 1e-3;
+  st->latency_ms.push_back(raw_latency);
+  st->airtime_us.push_back(airtime);
+  window_push(st->window_latency_ms, latency_ms);
+  station_state(st, pkt, board_us, false);
+}
+
+
+/**
+ * Decode the records in buf[0 .. n), in place. A SYNC announcing more than
+ * a RADIO record holds is skipped at once rather than waited on : on a
+ * quiet link a corrupted length would hold up the packets behind it.
+ * @return Bytes used; a record cut by the end of buf is left for later.
+ */
+static size_t station_feed(Station_t *st, const uint8_t *buf, size_t n) {
+  size_t pos = 0;
+  while (pos < n) {
+    if (buf[pos] == LOG_SYNC && n - pos >= 4 &&
+        (uint16_t)(buf[pos + 2] | buf[pos + 3] << 8) > RX_MAX_RECORD - LOG_OVERHEAD) {
+      pos++;
+      st->skipped++;
+      continue;
+    }
+    LOG_Record_t rec;
+    LOG_Status_t s = LOG_decode(buf + pos, n - pos, &rec);
+    if (s == LOG_NEED_MORE) break;
+    if (s == LOG_BAD_RECORD) {
+      pos++;
+      st->skipped++;
+      continue;
+    }
+    st->records++;
+    if (rec.type == LOG_REC_RADIO && rec.len >= LOG_RADIO_HEADER && rec.len == LOG_RADIO_HEADER + rec.payload[3]) {
+      if (st->log) fwrite(buf + pos, 1, rec.size, st->log);
+      station_packet(st, rec);
+    } else {
+      st->others++;
+    }
+    pos += rec.size;
+  }
+  st->bytes += pos;
+  return pos;
+}
+
+
+// Everything the reader thread has put in the ring so far.
+static void station_drain(Station_t *st, RxRing_t *r) {
+  uint64_t head = r->head.load(std::memory_order_acquire);
+  uint64_t tail = r->tail.load(std::memory_order_relaxed);
+  while (tail < head) {
+    size_t at = (size_t)(tail % RX_RING_SIZE);
+    size_t span = (size_t)std::min<uint64_t>(head - tail, RX_RING_SIZE - at);
+    size_t used = station_feed(st, &r->buf[at], span);
+    if (used == 0 && span < head - tail) {
+      // A record across the end of the ring : its two halves together.
+      uint8_t joined[RX_MAX_RECORD];
+      size_t n = (size_t)std::min<uint64_t>(head - tail, sizeof(joined));
+      for (size_t i = 0; i < n; i++) joined[i] = r->buf[(at + i) % RX_RING_SIZE];
+      used = station_feed(st, joined, n);
+      st->wrap_copies++;
+    }
+    if (used == 0) break;
+    tail += used;
+    r->tail.store(tail, std::memory_order_release);
+  }
+}
+
+
+static double max_of(const std::vector<double> &v) {
+  double m = NAN;
+  for (double x : v) {
+    if (!std::isnan(x) && !(x <= m)) m = x;
+  }
+  return m;
+}
+
+
+static double median(std::vector<double> v) {
+  v.erase(std::remove_if(v.begin(), v.end(), [](double x) { return std::isnan(x); }), v.end());
+  if (v.empty()) return NAN;
+  std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+  return v[v.size() / 2];
+}
+
+
+// Latencies of every packet so far, against the fastest one.
+static std::vector<double> station_latencies_ms(const Station_t *st) {
+  std::vector<double> ms;
+  for (size_t i = 0; i < st->latency_ms.size(); i++) ms.push_back((st->latency_ms[i] - st->offset_min_us) * 1e-3);
+  return ms;
+}
+
+
+static double loss_percent(uint64_t lost, uint64_t got) {
+  return got + lost ? 100.0 * lost / (double)(got + lost) : 0.0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Dashboard
+//--------------------------------------------------------------------------------------------
+static void pad_vector(const Station_t *st, double *range_m, double *bearing_deg) {
+  double lat0 = st->pad_lat_e7 * 1e-7 * M_PI / 180.0;
+  double north = (st->state.lat_e7 - st->pad_lat_e7) * 1e-7 * 111320.0;
+  double east = (st->state.lon_e7 - st->pad_lon_e7) * 1e-7 * 111320.0 * cos(lat0);
+  *range_m = hypot(north, east);
+  *bearing_deg = fmod(atan2(east, north) * 180.0 / M_PI + 360.0, 360.0);
+}
+
+
+static void dashboard(const Station_t *st, const RxRing_t *r, double up_s) {
+  std::string o = "\x1b[H\x1b[2J";
+  char line[256];
+  const TLM_State_t &s = st->state;
+  snprintf(line, sizeof(line), " Ground station   %s %ld baud   up %02d:%02d:%02d\n\n", r->path, r->baud,
+           (int)up_s / 3600, (int)up_s / 60 % 60, (int)up_s % 60);
+  o += line;
+  if (!st->have_state) {
+    o += " Waiting for telemetry...\n\n";
+  } else {
+    double since = st->launched ? (s.t_us - (double)st->launch_board_us) * 1e-6 : 0.0;
+    snprintf(line, sizeof(line), " Phase     %-8s          T+ %7.1f s   (board %.2f s)\n",
+             PHASE_NAMES[std::min<int>(s.phase, TLM_PHASE_LANDED)], since, s.t_us * 1e-6);
+    o += line;
+    snprintf(line, sizeof(line), " Altitude  %8.1f m         max %8.1f m\n", s.altitude, s.max_altitude);
+    o += line;
+    snprintf(line, sizeof(line), " Velocity  %8.1f m/s       accel %7.1f m/s^2\n", s.velocity, s.acceleration);
+    o += line;
+    double range = 0.0, bearing = 0.0;
+    if (st->have_pad) pad_vector(st, &range, &bearing);
+    snprintf(line, sizeof(line), " GPS       %.5f %c  %.5f %c   fix %uD   height %.0f m   %.0f m at %03.0f deg from the pad\n",
+             fabs(s.lat_e7 * 1e-7), s.lat_e7 >= 0 ? 'N' : 'S', fabs(s.lon_e7 * 1e-7), s.lon_e7 >= 0 ? 'E' : 'W',
+             s.gps_fix, s.gps_height_mm * 1e-3, range, bearing);
+    o += line;
+    snprintf(line, sizeof(line), " Battery   %5.2f V   health%s%s%s%s%s   dropped %u samples, %u blocks\n\n",
+             s.battery_mv * 1e-3, s.health & TLM_HEALTH_SD ? " SD" : " sd-off", s.health & TLM_HEALTH_FLASH ? " FLASH" : "",
+             s.health & TLM_HEALTH_GPS_3D ? " GPS-3D" : " gps-no-3d", s.health & TLM_HEALTH_TIME_LOCKED ? " PPS" : "",
+             s.health & TLM_HEALTH_BARO_LOCKED ? " BARO-LOCKOUT" : "", s.samples_dropped, s.blocks_dropped);
+    o += line;
+  }
+  uint64_t wlost = 0;
+  for (uint8_t l : st->window_lost) wlost += l;
+  std::vector<double> window = st->window_latency_ms;
+  double wmax = window.empty() ? NAN : *std::max_element(window.begin(), window.end());
+  snprintf(line, sizeof(line), " Link      %llu packets (%llu STATE, %llu DELTA, %llu BEACON, %llu REPAIR), %llu lost (%.1f %%, last %zu : %.1f %%), %llu bad\n",
+           (unsigned long long)st->packets, (unsigned long long)st->by_type[TLM_PKT_STATE],
+           (unsigned long long)st->by_type[TLM_PKT_DELTA], (unsigned long long)st->by_type[TLM_PKT_BEACON],
+           (unsigned long long)st->by_type[TLM_PKT_REPAIR],
+           (unsigned long long)st->lost, loss_percent(st->lost, st->packets), st->window_lost.size(),
+           loss_percent(wlost, st->window_lost.size()), (unsigned long long)st->bad);
+  o += line;
+  snprintf(line, sizeof(line), "           %llu states, %lu DELTAs without their keyframe, %lu packets rebuilt, %lu DELTAs given theirs back\n",
+           (unsigned long long)st->states, (unsigned long)st->rx.no_key, (unsigned long)st->rx.rebuilt,
+           (unsigned long)st->rx.rekeyed);
+  o += line;
+  snprintf(line, sizeof(line), "           RSSI %d dBm (min %d)   SNR %.1f dB (min %.1f)   %.2f packets/s   last %.1f s ago\n",
+           st->rssi_last, st->packets ? st->rssi_min : 0, st->snr_last, st->packets ? st->snr_min : 0.0,
+           st->recent_rx_us.size() * 1e6 / RATE_WINDOW_US, st->packets ? PTYLINK_now_s() - st->host_last_s : 0.0);
+  o += line;
+  snprintf(line, sizeof(line), "           latency p50 %.0f ms, max %.0f ms (last %zu, against the fastest packet)\n",
+           median(window), wmax, window.size());
+  o += line;
+  uint64_t depth = r->head - r->tail;
+  snprintf(line, sizeof(line), " Serial    %.1f kB, %llu records, %llu bytes skipped, ring %.1f %% (max %.1f %%), %u reconnects\n",
+           st->bytes / 1e3, (unsigned long long)st->records, (unsigned long long)st->skipped,
+           100.0 * depth / RX_RING_SIZE, 100.0 * r->depth_max / RX_RING_SIZE, (unsigned)r->reopens);
+  o += line;
+  fwrite(o.data(), 1, o.size(), stdout);
+  fflush(stdout);
+}
+
+
+static volatile sig_atomic_t Interrupted = 0;
+
+static void on_signal(int) {
+  Interrupted = 1;
+}
+
+
+static int listen(const char *tty, long baud, const char *log_path, const RFM_Config_t &radio, bool quiet) {
+  int fd = port_open(tty, baud);
+  if (fd < 0) {
+    fprintf(stderr, "cannot open %s\n", tty);
+    return 1;
+  }
+  char name[64];
+  if (!log_path) {
+    time_t now = time(NULL);
+    strftime(name, sizeof(name), "telemetry_%Y%m%d_%H%M%S.bin", localtime(&now));
+    log_path = name;
+  }
+  FILE *log = fopen(log_path, "wb");
+  if (!log) {
+    fprintf(stderr, "cannot write %s\n", log_path);
+    return 1;
+  }
+  setvbuf(log, NULL, _IOFBF, 1 << 16);
+  static RxRing_t ring;
+  ring_init(&ring, tty, baud, fd);
+  static Station_t st;
+  station_init(&st, radio, log);
+  std::thread reader(ring_reader, &ring);
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  bool dash = !quiet && isatty(STDOUT_FILENO);
+  if (!dash) printf("listening on %s, logging to %s\n", tty, log_path);
+
+  double start = PTYLINK_now_s(), next_dash = 0.0, next_flush = start + LOG_FLUSH_S;
+  uint8_t phase = 0xFF;
+  while (!Interrupted) {
+    station_drain(&st, &ring);
+    double now = PTYLINK_now_s();
+    if (dash && now >= next_dash) {
+      next_dash = now + DASH_PERIOD_S;
+      dashboard(&st, &ring, now - start);
+    }
+    if (!dash && st.have_state && st.state.phase != phase) {
+      phase = st.state.phase;
+      printf("%10.2f s  %-8s  %.1f m  %.1f m/s  %.5f %.5f\n", st.state.t_us * 1e-6, PHASE_NAMES[std::min<int>(phase, 4)],
+             st.state.altitude, st.state.velocity, st.state.lat_e7 * 1e-7, st.state.lon_e7 * 1e-7);
+      fflush(stdout);
+    }
+    if (now >= next_flush) {
+      next_flush = now + LOG_FLUSH_S;
+      fflush(log);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ring.stop = true;
+  reader.join();
+  station_drain(&st, &ring);
+  fclose(log);
+  if (ring.fd >= 0) close(ring.fd);
+  std::vector<double> lat = station_latencies_ms(&st);
+  printf("\n%llu packets, %llu lost (%.1f %%), %llu bad, latency p50 %.0f ms, %llu bytes skipped, log %s\n",
+         (unsigned long long)st.packets, (unsigned long long)st.lost, loss_percent(st.lost, st.packets),
+         (unsigned long long)st.bad, median(lat), (unsigned long long)st.skipped, log_path);
+  return 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Receiver stand-in
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  double t_us;                        // Receiver clock at RxDone
+  size_t packet;                      // Index in the TlmAir_t
+  std::vector<uint8_t> record;        // RADIO record
+} Heard_t;
+
+
+// What a receiver GROUND_DISTANCE_M from the pad hears : free space path loss, noise at the bandwidth.
+static std::vector<Heard_t> receive(const TlmAir_t &air, const RFM_Config_t &rc, double loss, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  std::normal_distribution<double> fade(0.0, 2.0);
+  double noise_dbm = -174.0 + 10.0 * log10((double)rc.bw_hz) + RX_NOISE_FIGURE_DB;
+  const double m_per_lon_e7 = 111320.0 * cos(TLMFLIGHT_PAD_LAT_E7 * 1e-7 * M_PI / 180.0) * 1e-7;
+  std::vector<Heard_t> out;
+  for (size_t i = 0; i < air.air.size(); i++) {
+    if (u(rng) < loss) continue;
+    const TLM_State_t &s = air.sent[i];
+    double east = GROUND_DISTANCE_M + (s.lon_e7 - TLMFLIGHT_PAD_LON_E7) * m_per_lon_e7;
+    double d = std::max(hypot(east, (double)s.altitude), 10.0);
+    double fspl = 20.0 * log10(d) + 20.0 * log10((double)rc.freq_hz) - 147.55;
+    double rssi = rc.power_dbm + RX_GAIN_DB - fspl + fade(rng);
+    double snr = std::min(rssi - noise_dbm, 10.0);
+
+    Heard_t h;
+    h.t_us = air.air[i].t_end_us + RX_OFFSET_US + RX_STAMP_US;
+    h.packet = i;
+    LOG_Radio_t r = {};
+    r.rssi_dbm = (int16_t)lround(rssi);
+    r.snr_qdb = (int8_t)std::max(-128L, std::min(127L, lround(snr * 4.0)));
+    r.len = (uint8_t)air.air[i].bytes.size();
+    memcpy(r.packet, air.air[i].bytes.data(), r.len);
+    h.record.resize(LOG_OVERHEAD + LOG_RADIO_HEADER + r.len);
+    LOG_encode(h.record.data(), LOG_REC_RADIO, (uint64_t)h.t_us, &r, (uint16_t)(LOG_RADIO_HEADER + r.len));
+    out.push_back(h);
+  }
+  return out;
+}
+
+
+// Flight index sent with fec_m REPAIRs every TLMLINK_FEC_K packets, and what the receiver hears of it.
+static bool fly(size_t index, double loss, uint8_t fec_m, uint32_t seed, TlmFlight_t *f, TlmAir_t *air,
+                std::vector<Heard_t> *heard) {
+  std::vector<SimConfig_t> lib = FLIGHTSIM_library();
+  if (index >= lib.size()) return false;
+  *f = TLMFLIGHT_run(lib[index], seed, AFTER_LANDING_S);
+  TLM_SchedConfig_t sc = TLMLINK_sched_config(TLMLINK_RADIO, TLMLINK_DUTY);
+  sc.fec_m = fec_m;
+  if (!TLMLINK_transmit(*f, TLMLINK_RADIO, sc, air)) return false;
+  *heard = receive(*air, TLMLINK_RADIO, loss, seed * 31 + 7);
+  return true;
+}
+
+
+static int receiver(int argc, char **argv) {
+  size_t index = 0;
+  double loss = 0.05, speed = 1.0;
+  uint8_t fec_m = TLMLINK_FEC_M;
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "--flight") && i + 1 < argc) index = (size_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--loss") && i + 1 < argc) loss = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--speed") && i + 1 < argc) speed = std::max(atof(argv[++i]), 0.01);
+    else if (!strcmp(argv[i], "--fec") && i + 1 < argc) fec_m = (uint8_t)atoi(argv[++i]);
+    else return -1;
+  }
+  BARO_init_table();
+  TlmFlight_t f;
+  TlmAir_t air;
+  std::vector<Heard_t> heard;
+  if (!fly(index, loss, fec_m, 48, &f, &air, &heard)) {
+    fprintf(stderr, "no flight %zu in the library\n", index);
+    return 1;
+  }
+  PtyLink_t link;
+  if (!PTYLINK_open(&link, &RECEIVER_LINK, 48)) {
+    fprintf(stderr, "no pty available\n");
+    return 1;
+  }
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  printf("%s : %s, %zu of %zu packets heard, %.0fx real time, on %s\n", f.name.c_str(), RECEIVER_LINK.name,
+         heard.size(), air.air.size(), speed, link.slave_path.c_str());
+  fflush(stdout);
+  double start = PTYLINK_now_s();
+  for (size_t i = 0; i < heard.size() && !Interrupted; i++) {
+    double at = start + (heard[i].t_us - RX_OFFSET_US) * 1e-6 / speed;
+    while (!Interrupted && PTYLINK_now_s() < at) {
+      std::this_thread::sleep_for(std::chrono::microseconds(std::min(100000L, (long)((at - PTYLINK_now_s()) * 1e6) + 1)));
+    }
+    PTYLINK_write(&link, heard[i].record.data(), heard[i].record.size());
+  }
+  printf("done, %llu writes dropped (nobody reading)\n", (unsigned long long)link.dropped);
+  PTYLINK_close(&link);
+  return 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  std::string name;
+  size_t sent, heard, received;
+  uint64_t lost_true, lost_seen, no_key, rebuilt;
+  double lat_true_p50, lat_seen_p50, lat_true_max, lat_seen_max, lat_err_max;
+  double launch_err_s, apogee_err_s;
+  bool final_ok, log_ok;
+  size_t log_radio, log_state, log_gps, log_events;
+} FlightRun_t;
+
+
+// The station on a pty fed by the stand-in, as fast as the pty goes : the times come from the records.
+static FlightRun_t run_flight(size_t index, double loss, uint8_t fec_m, uint32_t seed, const char *log_path) {
+  FlightRun_t r = {};
+  TlmFlight_t f;
+  TlmAir_t air;
+  std::vector<Heard_t> heard;
+  fly(index, loss, fec_m, seed, &f, &air, &heard);
+  r.name = f.name;
+  r.sent = air.air.size();
+  r.heard = heard.size();
+
+  PtyLink_t link;
+  PTYLINK_open(&link, &PTYLINK_PTY, seed);
+  int fd = port_open(link.slave_path.c_str(), 115200);
+  static RxRing_t ring;
+  ring_init(&ring, link.slave_path.c_str(), 115200, fd);
+  FILE *log = fopen(log_path, "wb");
+  static Station_t st;
+  station_init(&st, TLMLINK_RADIO, log);
+  std::thread reader(ring_reader, &ring);
+  std::thread writer([&]() {
+    for (const Heard_t &h : heard) PTYLINK_write(&link, h.record.data(), h.record.size());
+  });
+  writer.join();
+  uint64_t expect = 0;
+  for (const Heard_t &h : heard) expect += h.record.size();
+  double give_up = PTYLINK_now_s() + 5.0;
+  while (st.bytes < expect && PTYLINK_now_s() < give_up) {
+    station_drain(&st, &ring);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ring.stop = true;
+  reader.join();
+  fclose(log);
+  close(fd);
+  PTYLINK_close(&link);
+  r.received = st.packets;
+  r.no_key = st.rx.no_key;
+  r.rebuilt = st.rx.rebuilt;
+
+  // Against the truth
+  // Data packets lost before the first or after the last one heard leave no gap to see, REPAIRs have no SEQ.
+  auto is_data = [&](size_t i) { return (air.air[i].bytes[0] & 0x07) != TLM_PKT_REPAIR; };
+  std::vector<bool> was_heard(air.air.size(), false);
+  size_t first_data = air.air.size(), last_data = 0;
+  for (const Heard_t &h : heard) {
+    was_heard[h.packet] = true;
+    if (is_data(h.packet)) {
+      first_data = std::min(first_data, h.packet);
+      last_data = std::max(last_data, h.packet);
+    }
+  }
+  for (size_t i = first_data; i <= last_data && i < air.air.size(); i++) {
+    if (is_data(i) && !was_heard[i]) r.lost_true++;
+  }
+  r.lost_seen = st.lost;
+  std::vector<double> truth, seen = station_latencies_ms(&st);
+  for (size_t i = 0; i < heard.size(); i++) {
+    bool data = is_data(heard[i].packet);
+    truth.push_back(data ? (heard[i].t_us - RX_OFFSET_US - (double)air.sent[heard[i].packet].t_us) * 1e-3 : NAN);
+    if (data && i < seen.size() && !std::isnan(seen[i])) {
+      r.lat_err_max = std::max(r.lat_err_max, fabs(seen[i] - truth.back()));
+    }
+  }
+  r.lat_true_p50 = median(truth);
+  r.lat_seen_p50 = median(seen);
+  r.lat_true_max = max_of(truth);
+  r.lat_seen_max = max_of(seen);
+  r.launch_err_s = st.launched ? st.launch_board_us * 1e-6 - f.launch_t : NAN;
+  r.apogee_err_s = st.apogee ? st.apogee_board_us * 1e-6 - f.apogee_t : NAN;
+  const TLM_State_t &last = air.sent[heard.back().packet];
+  r.final_ok = st.state.phase == last.phase && abs(st.state.lat_e7 - last.lat_e7) <= 50 &&
+               abs(st.state.lon_e7 - last.lon_e7) <= 50;
+
+  // The log, read back as log_decode reads it
+  std::vector<uint8_t> data;
+  LogData_t d = {};
+  if (LOGREAD_load_file(log_path, data)) LOGREAD_parse(data.data(), data.size(), &d);
+  r.log_radio = d.radio.size();
+  r.log_state = d.state.size();
+  r.log_gps = d.gps.size();
+  r.log_events = d.events.size();
+  r.log_ok = d.skipped == 0 && d.unknown == 0 && d.radio.size() == r.heard && d.state.size() == st.states &&
+             d.events.size() == 2;
+  for (size_t i = 0; r.log_ok && i < d.radio.size(); i++) {
+    r.log_ok = d.radio[i].v.len == heard[i].record.size() - LOG_OVERHEAD - LOG_RADIO_HEADER &&
+               !memcmp(d.radio[i].v.packet, heard[i].record.data() + LOG_HEADER_SIZE + LOG_RADIO_HEADER, d.radio[i].v.len);
+  }
+  return r;
+}
+
+
+typedef struct {
+  uint64_t records_sent, bytes_sent, bytes_dropped, records;
+  uint64_t depth_max, wrap_copies;
+  double mb_s;
+} BurstRun_t;
+
+
+// Bursts of records at the USB serial rate while the decoder stalls; through the ring, or read in the decoder's own loop.
+static BurstRun_t run_burst(bool ring_thread, uint32_t seed) {
+  BurstRun_t r = {};
+  std::vector<uint8_t> burst;
+  std::mt19937 rng(seed);
+  TLM_State_t s = {};
+  for (int i = 0; i < BURST_RECORDS; i++) {
+    s.t_us = (uint64_t)i * 10000;
+    s.altitude = (float)(rng() % 10000) * 0.1f;
+    LOG_Radio_t rad = {};
+    rad.len = (uint8_t)TLM_encode(TLM_PKT_STATE, (uint16_t)i, &s, rad.packet);
+    rad.rssi_dbm = -90;
+    uint8_t rec[RX_MAX_RECORD];
+    size_t n = LOG_encode(rec, LOG_REC_RADIO, s.t_us, &rad, (uint16_t)(LOG_RADIO_HEADER + rad.len));
+    burst.insert(burst.end(), rec, rec + n);
+  }
+  PtyLink_t link;
+  PTYLINK_open(&link, &PTYLINK_USB_FS, seed);
+  int fd = port_open(link.slave_path.c_str(), 115200);
+  static RxRing_t ring;
+  ring_init(&ring, link.slave_path.c_str(), 115200, fd);
+  static Station_t st;
+  station_init(&st, TLMLINK_RADIO, NULL);
+  std::thread reader;
+  if (ring_thread) reader = std::thread(ring_reader, &ring);
+  std::atomic<bool> done(false);
+  std::thread writer([&]() {
+    for (int i = 0; i < BURST_TOTAL / BURST_RECORDS; i++) PTYLINK_write(&link, burst.data(), burst.size());
+    done = true;
+  });
+
+  double start = PTYLINK_now_s(), next_stall = start + STALL_EVERY_S, quiet_since = 0.0;
+  std::vector<uint8_t> direct(RX_READ_CHUNK * 4);
+  size_t direct_len = 0;
+  for (;;) {
+    uint64_t before = st.bytes;
+    if (ring_thread) {
+      station_drain(&st, &ring);
+    } else {
+      struct pollfd p = { fd, POLLIN, 0 };
+      if (poll(&p, 1, 10) > 0) {
+        ssize_t got = read(fd, direct.data() + direct_len, direct.size() - direct_len);
+        if (got > 0) direct_len += (size_t)got;
+        size_t used = station_feed(&st, direct.data(), direct_len);
+        memmove(direct.data(), direct.data() + used, direct_len - used);
+        direct_len -= used;
+      }
+    }
+    double now = PTYLINK_now_s();
+    if (now >= next_stall && !done) {
+      std::this_thread::sleep_for(std::chrono::duration<double>(STALL_S));
+      next_stall = PTYLINK_now_s() + STALL_EVERY_S;
+    }
+    if (st.bytes != before) quiet_since = now;
+    if (done && now - quiet_since > 0.3) break;
+    if (ring_thread) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  double secs = PTYLINK_now_s() - start;
+  writer.join();
+  ring.stop = true;
+  if (ring_thread) reader.join();
+  close(fd);
+
+  r.records_sent = (uint64_t)(BURST_TOTAL / BURST_RECORDS) * BURST_RECORDS;
+  r.bytes_sent = link.bytes_out;
+  r.bytes_dropped = link.bytes_out - st.bytes;
+  r.records = st.packets;
+  r.depth_max = ring.depth_max;
+  r.wrap_copies = st.wrap_copies;
+  r.mb_s = st.bytes / secs / 1e6;
+  PTYLINK_close(&link);
+  return r;
+}
+
+
+static int sim(void) {
+  BARO_init_table();
+  const char *log_path = "/tmp/ground_station_sim.bin";
+  printf("Flights through the receiver stand-in (%.0f m from the pad) and the station, over a pty :\n\n", GROUND_DISTANCE_M);
+  printf("| Flight       | Loss | FEC      | Sent | Heard | Decoded | Lost | Seen lost | Rebuilt | No key | Latency p50 (ms) | Seen p50 | Latency max (ms) | Seen max | Worst error (ms) | Launch (s) | Apogee (s) | Final state | Log RADIO / STATE / GPS / EVENT | Log check |\n");
+  printf("| ------------ | ---- | -------- | ---- | ----- | ------- | ---- | --------- | ------- | ------ | ---------------- | -------- | ---------------- | -------- | ---------------- | ---------- | ---------- | ----------- | ------------------------------- | --------- |\n");
+  bool ok = true;
+  size_t flights = FLIGHTSIM_library().size();
+  for (size_t fi = 0; fi < flights; fi++) {
+    for (auto run : { std::make_pair(0.0, 0), std::make_pair(0.2, 0), std::make_pair(0.2, 2) }) {
+      double loss = run.first;
+      uint8_t fec_m = (uint8_t)run.second;
+      FlightRun_t r = run_flight(fi, loss, fec_m, 480 + (uint32_t)fi, log_path);
+      char fec[16] = "none";
+      if (fec_m) snprintf(fec, sizeof(fec), "K %d, M %d", TLMLINK_FEC_K, fec_m);
+      char logs[64];
+      snprintf(logs, sizeof(logs), "%zu / %zu / %zu / %zu", r.log_radio, r.log_state, r.log_gps, r.log_events);
+      printf("| %-12s | %3.0f%% | %-8s | %4zu | %5zu | %7zu | %4llu | %9llu | %7llu | %6llu | %16.0f | %8.0f | %16.0f | %8.0f | %16.0f | %+10.2f | %+10.2f | %-11s | %-31s | %-9s |\n",
+             r.name.c_str(), loss * 100, fec, r.sent, r.heard, r.received, (unsigned long long)r.lost_true,
+             (unsigned long long)r.lost_seen, (unsigned long long)r.rebuilt, (unsigned long long)r.no_key, r.lat_true_p50, r.lat_seen_p50, r.lat_true_max, r.lat_seen_max,
+             r.lat_err_max, r.launch_err_s, r.apogee_err_s, r.final_ok ? "ok" : "WRONG", logs, r.log_ok ? "ok" : "FAIL");
+      fflush(stdout);
+      ok = ok && r.received == r.heard && r.lost_seen == r.lost_true && r.final_ok && r.log_ok;
+    }
+  }
+
+  printf("\nBursts of %d records (%d in all) at %s, the decoder stalling %.0f ms every %.0f ms :\n\n", BURST_RECORDS,
+         BURST_TOTAL / BURST_RECORDS * BURST_RECORDS, PTYLINK_USB_FS.name, STALL_S * 1e3, STALL_EVERY_S * 1e3);
+  printf("| Reading                     | Records sent | kB sent | kB lost | Records decoded | Ring max (kB) | Split records | MB/s |\n");
+  printf("| --------------------------- | ------------ | ------- | ------- | --------------- | ------------- | ------------- | ---- |\n");
+  for (bool threaded : { true, false }) {
+    BurstRun_t b = run_burst(threaded, 4800);
+    printf("| %-27s | %12llu | %7.0f | %7.0f | %15llu | %13s | %13llu | %4.2f |\n",
+           threaded ? "reader thread, 1 MB ring" : "in the decoder loop", (unsigned long long)b.records_sent,
+           b.bytes_sent / 1e3, b.bytes_dropped / 1e3, (unsigned long long)b.records,
+           threaded ? std::to_string(b.depth_max / 1000).c_str() : "-", (unsigned long long)b.wrap_copies, b.mb_s);
+    fflush(stdout);
+    if (threaded) ok = ok && b.bytes_dropped == 0 && b.records == b.records_sent;
+  }
+
+  // Decoder time per record : parse, unpack, state, stats and log, from memory.
+  TlmFlight_t f;
+  TlmAir_t air;
+  std::vector<Heard_t> heard;
+  fly(2, 0.0, TLMLINK_FEC_M, 4801, &f, &air, &heard);
+  std::vector<uint8_t> stream;
+  for (const Heard_t &h : heard) stream.insert(stream.end(), h.record.begin(), h.record.end());
+  FILE *devnull = fopen("/dev/null", "wb");
+  static Station_t st;
+  uint64_t n = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  double secs;
+  do {
+    station_init(&st, TLMLINK_RADIO, devnull);
+    station_feed(&st, stream.data(), stream.size());
+    n += st.records;
+    secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  } while (secs < 0.3);
+  fclose(devnull);
+  printf("\nDecoder : %.0f ns a record (parse, unpack, flight state, statistics, log) on this machine\n", secs * 1e9 / n);
+  printf("%s\n", ok ? "every packet heard decoded, loss and events seen as sent, logs read back whole, no byte lost through the ring" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s listen <tty> [--baud N] [--log FILE] [--sf N] [--bw HZ] [--quiet]\n"
+          "       %s receiver [--flight N] [--loss P] [--speed X] [--fec M]\n"
+          "       %s sim\n",
+          argv0, argv0, argv0);
+}
+
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && !strcmp(argv[1], "sim")) {
+    return sim();
+  }
+  if (argc >= 2 && !strcmp(argv[1], "receiver")) {
+    int rc = receiver(argc, argv);
+    if (rc >= 0) return rc;
+  }
+  if (argc >= 3 && !strcmp(argv[1], "listen")) {
+    long baud = 115200;
+    const char *log = NULL;
+    bool quiet = false;
+    RFM_Config_t radio = TLMLINK_RADIO;
+    bool bad = false;
+    for (int i = 3; i < argc; i++) {
+      if (!strcmp(argv[i], "--baud") && i + 1 < argc) baud = atol(argv[++i]);
+      else if (!strcmp(argv[i], "--log") && i + 1 < argc) log = argv[++i];
+      else if (!strcmp(argv[i], "--sf") && i + 1 < argc) radio.sf = (uint8_t)atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--bw") && i + 1 < argc) radio.bw_hz = (uint32_t)atol(argv[++i]);
+      else if (!strcmp(argv[i], "--quiet")) quiet = true;
+      else bad = true;
+    }
+    if (!bad) return listen(argv[2], baud, log, radio, quiet);
+  }
+  usage(argv[0]);
+  return 1;
+}
@@ -0,0 +1,319 @@
+/**
+ * @file journal_bench.cpp
+ * @brief Power cut and recovery benchmark of the log journal on a mock SD card.
+ *
+ * Runs the flight computer journal (lib/LogJournal) on a mock card
+ * (common/mock_sd.h, SPI timing profile) :
+ *
+ * 1. Recovery time against card size. The card holds a journal filled to
+ *    FILL_FRACTION (generated on demand, nothing is written) followed by
+ *    stale slots of an older journal; JRNL_open() finds the end by binary
+ *    search. The linear scan a journal without it would need is timed on
+ *    the same card for comparison (extrapolated, "~", past LINEAR_MAX_SLOTS).
+ *
+ * 2. Power cuts. Sessions log a flight-like record stream (800 Hz ACCEL
+ *    carrying a record counter, 50 Hz BARO, 100 Hz STATE, a SPECTRUM and a
+ *    commit once a second, as the firmware does); the power fails at a random
+ *    byte of the writes, tearing the sector being written, and the next
+ *    session recovers and appends. After every recovery the journal must hold
+ *    exactly the slots whose write completed, and at the end every ACCEL
+ *    counter committed must read back in order, none missing, none extra.
+ *
+ * Times are the card model's (command latency + bus transfer + housekeeping
+ * stalls), not host time.
+ *
+ * Usage :
+ *   journal_bench [--trials N] [--seed N]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "flight_log.h"
+#include "log_journal.h"
+#include "mock_sd.h"
+
+
+#define FILL_FRACTION 0.9             // Part of the card the journal holds for the recovery test
+#define STALE_FRACTION 0.97           // Older journal slots up to here
+#define CUT_CARD_MB 64                // Card of the power cut trials
+#define SESSIONS_PER_TRIAL 4
+#define SESSION_MAX_S 90.0            // Logging time of a session before its cut
+#define LINEAR_MAX_SLOTS 131072       // Linear scans longer than this are timed this far and extrapolated
+
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Recovery time against card size
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  uint32_t generation;
+  uint32_t valid;             // Slots of the current journal
+  uint32_t stale;             // Slots of the older one behind it
+} FilledCard_t;
+
+
+// Content of a card already holding a journal : slot i is a closed slot of padding.
+static void filled_blank(void *ctx, uint64_t offset, uint8_t *buf, size_t n) {
+  const FilledCard_t *card = (const FilledCard_t *)ctx;
+  uint8_t slot[LOG_SLOT_SIZE];
+  while (n > 0) {
+    uint32_t i = (uint32_t)(offset / LOG_SLOT_SIZE);
+    size_t at = (size_t)(offset % LOG_SLOT_SIZE);
+    size_t take = std::min(n, (size_t)LOG_SLOT_SIZE - at);
+    if (i < card->stale) {
+      LOG_Commit_t c = { LOG_JOURNAL_MAGIC, i < card->valid ? card->generation : card->generation ^ 0x5A5A5A5Au,
+                         1 + i / 100000, i, 0, 0 };
+      LOG_slot_close(slot, 0, &c);
+      memcpy(buf, slot + at, take);
+    } else {
+      memset(buf, 0, take);
+    }
+    buf += take;
+    offset += take;
+    n -= take;
+  }
+}
+
+
+static int bench_recovery(void) {
+  static const double sizes_mb[] = { 64.0, 512.0, 4095.99 };
+  printf("Recovery, journal filled to %.0f %% of the file, stale slots of an older journal behind it\n\n",
+         FILL_FRACTION * 100.0);
+  printf("| File     | Slots    | Found    | Reads | Recovery (ms) | Linear scan (s) | Host (ms) |\n");
+  printf("| -------- | -------- | -------- | ----- | ------------- | --------------- | --------- |\n");
+  int failures = 0;
+  for (double mb : sizes_mb) {
+    uint64_t size = (uint64_t)(mb * 1024 * 1024) / LOG_SLOT_SIZE * LOG_SLOT_SIZE;
+    uint32_t slots = (uint32_t)(size / LOG_SLOT_SIZE);
+    FilledCard_t card = { 0xC0FFEE01u, (uint32_t)(FILL_FRACTION * slots), (uint32_t)(STALE_FRACTION * slots) };
+    MockSd_t sd;
+    MOCKSD_init(&sd, size, &MOCKSD_SPI_20MHZ);
+    sd.blank = filled_blank;
+    sd.blank_ctx = &card;
+
+    JRNL_Io_t io = MOCKSD_journal_io(&sd);
+    JRNL_t *j = new JRNL_t;
+    JRNL_Recovery_t rec;
+    auto start = std::chrono::steady_clock::now();
+    JRNL_open(j, &io, 1234, &rec);
+    double host_ms = seconds_since(start) * 1e3;
+    double recovery_ms = sd.clock_us * 1e-3;
+    bool ok = rec.slots == card.valid && j->next == card.valid && j->generation == card.generation &&
+              j->session == rec.last_session + 1;
+    failures += !ok;
+
+    // What finding the end slot by slot costs on the same card.
+    sd.clock_us = 0.0;
+    uint8_t slot[LOG_SLOT_SIZE];
+    LOG_Commit_t c;
+    uint32_t i = 0;
+    while (i < slots && i < LINEAR_MAX_SLOTS && MOCKSD_read(&sd, (uint64_t)i * LOG_SLOT_SIZE, slot, LOG_SLOT_SIZE) &&
+           LOG_slot_check(slot, &c) && c.seq == i && c.generation == card.generation) {
+      i++;
+    }
+    bool extrapolated = i == LINEAR_MAX_SLOTS && card.valid > LINEAR_MAX_SLOTS;
+    double linear_s = sd.clock_us * 1e-6 * (extrapolated ? (double)(card.valid + 1) / i : 1.0);
+    failures += !extrapolated && i != card.valid;
+
+    char file[32];
+    snprintf(file, sizeof(file), "%.0f MB", mb);
+    char linear[32];
+    snprintf(linear, sizeof(linear), "%s%.1f", extrapolated ? "~" : "", linear_s);
+    printf("| %-8s | %8u | %8u | %5u | %13.1f | %15s | %9.3f |%s\n", file, slots, rec.slots, rec.reads, recovery_ms,
+           linear, host_ms, ok ? "" : " FAIL");
+    delete j;
+  }
+  return failures;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Power cuts
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  JRNL_t j;
+  std::vector<uint64_t> staged;       // ACCEL counters of the slot being staged
+  std::vector<uint64_t> committed;    // ACCEL counters of the slots written
+  uint32_t committed_slots;
+  uint32_t last_session;              // Session of the last slot written
+  uint64_t used_bytes;                // Record bytes of the committed slots
+  uint64_t lost;                      // ACCEL records of slots whose write failed
+} Logger_t;
+
+
+// As SD_Flush() : commit the staged slot, its records count only if the write completed.
+static void logger_commit(Logger_t *lg) {
+  if (lg->j.used == 0) return;
+  size_t used = lg->j.used;
+  if (JRNL_commit(&lg->j)) {
+    lg->committed.insert(lg->committed.end(), lg->staged.begin(), lg->staged.end());
+    lg->committed_slots++;
+    lg->last_session = lg->j.session;
+    lg->used_bytes += used;
+  } else {
+    lg->lost += lg->staged.size();
+  }
+  lg->staged.clear();
+}
+
+
+static void logger_record(Logger_t *lg, uint8_t type, uint64_t t_us, const void *payload, uint16_t len,
+                          uint64_t counter) {
+  if (!JRNL_fits(&lg->j, len)) logger_commit(lg);
+  if (JRNL_append(&lg->j, type, t_us, payload, len) && type == LOG_REC_ACCEL) lg->staged.push_back(counter);
+}
+
+
+// One session : a flight-like stream for duration_s, stopping early if the card loses power.
+static void log_session(Logger_t *lg, MockSd_t *sd, double duration_s, uint64_t *counter) {
+  uint64_t end = (uint64_t)(duration_s * 1e6);
+  uint64_t next_accel = 0, next_baro = 0, next_state = 0, next_second = 1000000;
+  static const uint8_t zeros[sizeof(LOG_Spectrum_t)] = { 0 };
+  while (sd->powered && next_accel < end) {
+    uint64_t t = std::min(std::min(next_accel, next_baro), std::min(next_state, next_second));
+    if (t == next_accel) {
+      LOG_Accel_t a;
+      uint64_t c = (*counter)++;
+      memcpy(a.acc_raw, &c, sizeof(a.acc_raw));
+      logger_record(lg, LOG_REC_ACCEL, t, &a, sizeof(a), c);
+      next_accel += 1250;
+    } else if (t == next_baro) {
+      logger_record(lg, LOG_REC_BARO, t, zeros, sizeof(LOG_Baro_t), 0);
+      next_baro += 20000;
+    } else if (t == next_state) {
+      logger_record(lg, LOG_REC_STATE, t, zeros, sizeof(LOG_State_t), 0);
+      next_state += 10000;
+    } else {
+      logger_record(lg, LOG_REC_SPECTRUM, t, zeros, sizeof(LOG_Spectrum_t), 0);
+      logger_commit(lg);
+      next_second += 1000000;
+    }
+  }
+  if (sd->powered) logger_commit(lg);   // Clean shutdown after the last flush
+}
+
+
+// Every valid slot of the card in order : the ACCEL counters, sessions never going back.
+static bool read_back(MockSd_t *sd, uint32_t slots, std::vector<uint64_t> *counters) {
+  counters->clear();
+  uint8_t slot[LOG_SLOT_SIZE];
+  uint32_t session = 0;
+  for (uint32_t i = 0; i < slots; i++) {
+    LOG_Commit_t c;
+    if (!MOCKSD_read(sd, (uint64_t)i * LOG_SLOT_SIZE, slot, LOG_SLOT_SIZE) || !LOG_slot_check(slot, &c) ||
+        c.seq != i || c.session < session) {
+      return false;
+    }
+    session = c.session;
+    for (size_t pos = 0; pos < c.used;) {
+      LOG_Record_t rec;
+      if (LOG_decode(slot + pos, c.used - pos, &rec) != LOG_OK) return false;
+      if (rec.type == LOG_REC_ACCEL) {
+        uint64_t v = 0;
+        memcpy(&v, rec.payload, sizeof(LOG_Accel_t));
+        counters->push_back(v);
+      }
+      pos += rec.size;
+    }
+  }
+  return true;
+}
+
+
+static int bench_power_cuts(int trials, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  uint64_t size = (uint64_t)CUT_CARD_MB * 1024 * 1024;
+  int failures = 0;
+  uint64_t cuts = 0, torn = 0, sessions = 0, records = 0, lost = 0, slots_total = 0, used_total = 0;
+  double rec_ms_sum = 0.0, rec_ms_max = 0.0;
+  uint32_t reads_max = 0;
+
+  for (int trial = 0; trial < trials; trial++) {
+    MockSd_t sd;
+    MOCKSD_init(&sd, size, &MOCKSD_SPI_20MHZ);
+    sd.rng.seed(seed + trial);
+    JRNL_Io_t io = MOCKSD_journal_io(&sd);
+    Logger_t *lg = new Logger_t();
+    uint64_t counter = 0;
+    bool ok = true;
+
+    for (int s = 0; s < SESSIONS_PER_TRIAL && ok; s++) {
+      double clock0 = sd.clock_us;
+      JRNL_Recovery_t rec;
+      JRNL_open(&lg->j, &io, (uint32_t)rng(), &rec);
+      double ms = (sd.clock_us - clock0) * 1e-3;
+      rec_ms_sum += ms;
+      rec_ms_max = std::max(rec_ms_max, ms);
+      reads_max = std::max(reads_max, rec.reads);
+      // A session cut before its first commit leaves no trace : the next one reuses its number.
+      ok = ok && rec.slots == lg->committed_slots && lg->j.session == lg->last_session + 1;
+      sessions++;
+
+      // Power fails somewhere in the session's writes, or the session ends first.
+      double duration = 5.0 + u(rng) * (SESSION_MAX_S - 5.0);
+      MOCKSD_cut_after(&sd, (uint64_t)(u(rng) * 1.2 * duration * 18000.0));
+      uint32_t errors = lg->j.write_errors;
+      log_session(lg, &sd, duration, &counter);
+      if (!sd.powered) {
+        cuts++;
+        torn += lg->j.write_errors > errors;
+        lg->lost += lg->staged.size();
+        lg->staged.clear();
+      }
+      MOCKSD_power_on(&sd);
+    }
+
+    JRNL_Recovery_t rec;
+    JRNL_open(&lg->j, &io, 0, &rec);
+    std::vector<uint64_t> back;
+    ok = ok && rec.slots == lg->committed_slots && read_back(&sd, rec.slots, &back) && back == lg->committed;
+    failures += !ok;
+    records += lg->committed.size();
+    lost += lg->lost;
+    slots_total += lg->committed_slots;
+    used_total += lg->used_bytes;
+    delete lg;
+  }
+
+  printf("\nPower cuts, %d trials x %d sessions on a %d MB card\n\n", trials, SESSIONS_PER_TRIAL, CUT_CARD_MB);
+  printf("| Sessions | Cuts | Torn slot writes | ACCEL committed | ACCEL lost at cuts | Recovered exactly |\n");
+  printf("| -------- | ---- | ---------------- | --------------- | ------------------ | ----------------- |\n");
+  printf("| %8llu | %4llu | %16llu | %15llu | %18llu | %17s |\n", (unsigned long long)sessions,
+         (unsigned long long)cuts, (unsigned long long)torn, (unsigned long long)records, (unsigned long long)lost,
+         failures ? "FAIL" : "all");
+  printf("\nRecovery : mean %.1f ms, max %.1f ms, max %u slot reads. Slot fill with 1 s commits %.1f %%.\n",
+         rec_ms_sum / (double)sessions, rec_ms_max, reads_max,
+         100.0 * (double)used_total / ((double)slots_total * LOG_SLOT_SIZE));
+  return failures;
+}
+
+
+int main(int argc, char **argv) {
+  int trials = 100;
+  uint32_t seed = 39;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--trials") && i + 1 < argc) trials = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (uint32_t)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--trials N] [--seed N]\n", argv[0]);
+      return 1;
+    }
+  }
+  int failures = bench_recovery();
+  failures += bench_power_cuts(trials, seed);
+  printf("\n%s\n", failures ? "FAIL" : "all recoveries exact");
+  return failures ? 1 : 0;
+}
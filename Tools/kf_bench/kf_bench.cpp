@@ -0,0 +1,146 @@
+/**
+ * @file kf_bench.cpp
+ * @brief Accuracy and speed benchmark of the onboard altitude Kalman filter.
+ *
+ * Runs the flight computer filter (lib/AltitudeKF) against every flight in the
+ * simulator library, feeding ADXL375 and BMP390 samples at their native rates in
+ * time order exactly as the firmware does, and compares the estimate with truth.
+ *
+ * Usage :
+ *   kf_bench [--seed N] [--flight NAME] [--csv FILE]
+ *
+ * Reported per flight :
+ * - RMS / max altitude and velocity error from ignition to landing
+ * - Apogee altitude and time error (peak of the filter altitude)
+ * - Baro samples rejected by the transonic lockout and innovation gate
+ * - ns per predict+update on this host
+ *
+ * Each flight passes when its errors are inside the KF_BENCH_* bounds below
+ * (roughly twice the worst seen over many seeds, so a regression of the filter
+ * or its tuning shows up as FAIL). Exits 1 if any flight fails.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "altitude_kf.h"
+#include "baro_altitude.h"
+#include "flight_sim.h"
+#include "sim_pipeline.h"
+
+
+#define KF_BENCH_MAX_H_RMS 1.0        // m, RMS altitude error after ignition
+#define KF_BENCH_MAX_H_ERR 2.5        // m, worst altitude error
+#define KF_BENCH_MAX_V_RMS 0.25       // m/s, RMS velocity error
+#define KF_BENCH_MAX_V_ERR 0.8        // m/s, worst velocity error
+#define KF_BENCH_MAX_APO_ERR 1.5      // m, filter peak against true apogee
+#define KF_BENCH_MAX_APO_DT 0.1       // s, time of the filter peak against true apogee
+
+
+int main(int argc, char **argv) {
+  uint32_t seed = 1;
+  const char *only = NULL;
+  const char *csv_path = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--flight") && i + 1 < argc) only = argv[++i];
+    else if (!strcmp(argv[i], "--csv") && i + 1 < argc) csv_path = argv[++i];
+    else {
+      fprintf(stderr, "usage: %s [--seed N] [--flight NAME] [--csv FILE]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  FILE *csv = csv_path ? fopen(csv_path, "w") : NULL;
+  if (csv) fprintf(csv, "flight,t,h_true,h_kf,v_true,v_kf,a_true,a_kf\n");
+
+  BARO_init_table();
+  KF_Config_t cfg;
+  KF_default_config(&cfg);
+
+  printf("%-14s %6s %9s %9s %9s %9s %9s %8s %8s %8s %6s\n",
+         "flight", "mach", "h_rms", "h_max", "v_rms", "v_max", "apo_err", "apo_dt", "baro_rej", "ns/upd", "check");
+
+  int flights = 0, failures = 0;
+
+  for (const SimConfig_t &sc : FLIGHTSIM_library()) {
+    if (only && strcmp(only, sc.name)) continue;
+
+    SimFlight_t f = FLIGHTSIM_run(sc, seed);
+    std::vector<SimInput_t> in = SIMPIPE_build_inputs(f, false);
+
+    KF_t kf;
+    KF_init(&kf, &cfg, 0.0f);
+    double last_t = in.empty() ? 0.0 : in[0].t;
+    double se_h = 0.0, se_v = 0.0, max_h = 0.0, max_v = 0.0;
+    size_t n = 0;
+    double kf_apo_h = -1e9, kf_apo_t = 0.0;
+
+    for (const SimInput_t &k : in) {
+      KF_predict(&kf, (float)(k.t - last_t));
+      last_t = k.t;
+      if (k.kind == SIM_INPUT_ACCEL) KF_update_accel(&kf, k.value);
+      else KF_update_baro(&kf, k.value);
+
+      if (kf.x[0] > kf_apo_h) {
+        kf_apo_h = kf.x[0];
+        kf_apo_t = k.t;
+      }
+      if (k.t >= f.launch_t) {
+        SimTruth_t tr = FLIGHTSIM_truth_at(f, k.t);
+        double eh = kf.x[0] - tr.h;
+        double ev = kf.x[1] - tr.v;
+        se_h += eh * eh;
+        se_v += ev * ev;
+        if (fabs(eh) > max_h) max_h = fabs(eh);
+        if (fabs(ev) > max_v) max_v = fabs(ev);
+        n++;
+        if (csv && k.kind == SIM_INPUT_BARO) {
+          fprintf(csv, "%s,%.4f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", sc.name, k.t,
+                  tr.h, kf.x[0], tr.v, kf.x[1], tr.a, kf.x[2]);
+        }
+      }
+    }
+
+    // Timing : replay the same inputs several times and average.
+    const int reps = 20;
+    KF_t bench;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; r++) {
+      KF_init(&bench, &cfg, 0.0f);
+      double lt = in.empty() ? 0.0 : in[0].t;
+      for (const SimInput_t &k : in) {
+        KF_predict(&bench, (float)(k.t - lt));
+        lt = k.t;
+        if (k.kind == SIM_INPUT_ACCEL) KF_update_accel(&bench, k.value);
+        else KF_update_baro(&bench, k.value);
+      }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / ((double)reps * in.size());
+    if (bench.x[0] != bench.x[0]) printf("NaN in benchmark run\n"); // keeps the loop observable
+
+    double rms_h = sqrt(se_h / (n ? n : 1));
+    double rms_v = sqrt(se_v / (n ? n : 1));
+    double apo_err = kf_apo_h - f.apogee_h;
+    double apo_dt = kf_apo_t - f.apogee_t;
+    bool ok = n > 0 && rms_h < KF_BENCH_MAX_H_RMS && max_h < KF_BENCH_MAX_H_ERR &&
+              rms_v < KF_BENCH_MAX_V_RMS && max_v < KF_BENCH_MAX_V_ERR &&
+              fabs(apo_err) < KF_BENCH_MAX_APO_ERR && fabs(apo_dt) < KF_BENCH_MAX_APO_DT;
+    flights++;
+    if (!ok) failures++;
+
+    printf("%-14s %6.2f %9.3f %9.3f %9.3f %9.3f %9.3f %8.3f %8u %8.1f %6s\n",
+           sc.name, f.max_mach, rms_h, max_h, rms_v, max_v,
+           apo_err, apo_dt, (unsigned)kf.baro_rejected, ns, ok ? "PASS" : "FAIL");
+  }
+
+  printf("\n%d flights, %d outside the error bounds\n", flights, failures);
+  if (csv) fclose(csv);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,519 @@
+/**
+ * @file log_align.cpp
+ * @brief Resample every sensor of a record log onto one common time grid.
+ *
+ * The flight computer logs each sensor at its own rate (ADXL375 800 - 3200 Hz,
+ * BMP390 50 - 200 Hz, NAV-PVT 1 - 25 Hz, Kalman STATE) with its own jittered
+ * esp_timer stamps. This tool produces one table with a row every dt on the
+ * MCU clock, from the first to the last accelerometer sample :
+ *
+ * | Column                                | Series | Unit                           |
+ * | ------------------------------------- | ------ | ------------------------------ |
+ * | acc_x, acc_y, acc_z                   | accel  | g                              |
+ * | pressure, temperature, baro_alt       | baro   | Pa, C, m above the pad         |
+ * | gps_north, gps_east, gps_height       | gps    | m from the first 3D fix, m     |
+ * | kf_alt, kf_vel, kf_acc                | state  | m, m/s, m/s^2                  |
+ *
+ * Interpolation is chosen per series group : --accel zoh|linear|polyphase
+ * (default polyphase, band limited to the output rate), --slow zoh|linear for
+ * baro, GPS and state (default linear). Rows further than GAP_PERIODS median
+ * periods from data of a series are NaN in its columns. The default grid rate
+ * is the nominal accel rate.
+ *
+ * The grid is cut in blocks of rows; each (series, block) pair is one task
+ * locating the block in the series and running the kernels for all of its
+ * columns, spread over --threads workers (default : all hardware threads).
+ *
+ * Output, from the extension of the out path :
+ * - .csv : t_us, [utc,] columns. utc (Unix seconds) when the log has TIMESYNC records.
+ * - anything else, binary, little endian :
+ *
+ *   | "ALN1" | columns u32 | rows u64 | t0_us f64 | dt_us f64 |
+ *   | columns x 16 byte NUL padded names | columns x rows f32, column after column |
+ *
+ *   row k is at MCU time t0_us + k * dt_us.
+ *
+ * --bench [minutes] aligns a synthetic log instead (3200 Hz accel with 35,
+ * 180 and 900 Hz tones, 100 Hz baro, 10 Hz GPS, 400 Hz state), reports the
+ * time of each step and the accel error of each mode against the exact
+ * band limited signal, at the accel rate and decimated to 1 kHz.
+ *
+ * Usage :
+ *   log_align <SENSOR_DATA.bin> <out.bin | out.csv> [--rate HZ] [--accel MODE] [--slow MODE]
+ *             [--threads N] [--block ROWS] [--ground-frames N]
+ *   log_align --bench [minutes] [--threads N] [--block ROWS]
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "baro_altitude.h"
+#include "flight_log.h"
+#include "log_reader.h"
+#include "parallel.h"
+#include "resample.h"
+
+
+#define ADXL_G_PER_LSB 0.049
+#define EARTH_RADIUS_M 6371000.0
+#define GAP_PERIODS 5                 // Series gaps longer than this many median periods are not interpolated
+#define DEFAULT_BLOCK_ROWS 65536
+#define NAME_LEN 16
+
+
+typedef struct {
+  const char *name;
+  ResampleMode_t mode;
+  std::vector<int64_t> t;
+  std::vector<const char *> names;
+  std::vector<std::vector<float>> columns;  // Raw, then padded for the kernel in place
+  int64_t period_us;
+  ResamplePolyphase_t pp;
+} Series_t;
+
+typedef struct {
+  double t0_us;
+  double dt_us;
+  size_t rows;
+  std::vector<const char *> names;
+  std::vector<std::vector<float>> columns;
+} Aligned_t;
+
+typedef struct {
+  double prepare_s;           // Unit conversion and padding
+  double align_s;             // Locate and kernels
+} AlignTiming_t;
+
+typedef struct __attribute__((packed)) {
+  char magic[4];
+  uint32_t columns;
+  uint64_t rows;
+  double t0_us;
+  double dt_us;
+} AlignHeader_t;
+
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Series from the log
+//--------------------------------------------------------------------------------------------
+static Series_t make_series(const char *name, ResampleMode_t mode, std::vector<const char *> names) {
+  Series_t s;
+  s.name = name;
+  s.mode = mode;
+  s.names = names;
+  s.columns.resize(names.size());
+  s.period_us = 0;
+  return s;
+}
+
+
+static std::vector<Series_t> build_series(const LogData_t &d, ResampleMode_t accel_mode, ResampleMode_t slow_mode,
+                                          size_t ground_frames) {
+  std::vector<Series_t> all;
+
+  Series_t acc = make_series("accel", accel_mode, { "acc_x", "acc_y", "acc_z" });
+  acc.t.resize(d.accel.size());
+  for (int a = 0; a < 3; a++) acc.columns[a].resize(d.accel.size());
+  for (size_t k = 0; k < d.accel.size(); k++) {
+    acc.t[k] = (int64_t)d.accel[k].t_us;
+    for (int a = 0; a < 3; a++) acc.columns[a][k] = (float)(d.accel[k].v.acc_raw[a] * ADXL_G_PER_LSB);
+  }
+  all.push_back(std::move(acc));
+
+  Series_t baro = make_series("baro", slow_mode, { "pressure", "temperature", "baro_alt" });
+  size_t nb = d.baro.size();
+  baro.t.resize(nb);
+  for (int c = 0; c < 3; c++) baro.columns[c].resize(nb);
+  for (size_t k = 0; k < nb; k++) {
+    baro.t[k] = (int64_t)d.baro[k].t_us;
+    baro.columns[0][k] = d.baro[k].v.pressure;
+    baro.columns[1][k] = d.baro[k].v.temperature;
+  }
+  BARO_pressure_altitude_batch(baro.columns[0].data(), baro.columns[2].data(), nb);
+  size_t ng = ground_frames < nb ? ground_frames : nb;
+  double ground = 0.0;
+  for (size_t k = 0; k < ng; k++) ground += baro.columns[2][k];
+  ground = ng ? ground / ng : 0.0;
+  for (float &h : baro.columns[2]) h = (float)(h - ground);
+  all.push_back(std::move(baro));
+
+  Series_t gps = make_series("gps", slow_mode, { "gps_north", "gps_east", "gps_height" });
+  bool have_ref = false;
+  double lat0 = 0.0, lon0 = 0.0, cos_lat0 = 1.0;
+  for (const LogGps_t &g : d.gps) {
+    if (g.v.gps_fix < 3) continue;
+    double lat = g.v.gps_lat * 1e-7 * M_PI / 180.0;
+    double lon = g.v.gps_lon * 1e-7 * M_PI / 180.0;
+    if (!have_ref) {
+      have_ref = true;
+      lat0 = lat;
+      lon0 = lon;
+      cos_lat0 = std::cos(lat0);
+    }
+    gps.t.push_back((int64_t)g.t_us);
+    gps.columns[0].push_back((float)((lat - lat0) * EARTH_RADIUS_M));
+    gps.columns[1].push_back((float)((lon - lon0) * cos_lat0 * EARTH_RADIUS_M));
+    gps.columns[2].push_back((float)(g.v.gps_height * 1e-3));
+  }
+  all.push_back(std::move(gps));
+
+  Series_t st = make_series("state", slow_mode, { "kf_alt", "kf_vel", "kf_acc" });
+  for (const LogState_t &s : d.state) {
+    st.t.push_back((int64_t)s.t_us);
+    st.columns[0].push_back(s.v.altitude);
+    st.columns[1].push_back(s.v.velocity);
+    st.columns[2].push_back(s.v.acceleration);
+  }
+  all.push_back(std::move(st));
+  return all;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Alignment
+//--------------------------------------------------------------------------------------------
+// Grid from the first to the last accel sample (baro if there is no accel).
+static bool make_grid(const std::vector<Series_t> &series, double rate_hz, Aligned_t *out) {
+  const Series_t *ref = !series[0].t.empty() ? &series[0] : !series[1].t.empty() ? &series[1] : NULL;
+  if (!ref) {
+    return false;
+  }
+  if (rate_hz <= 0.0) {
+    double p = RESAMPLE_nominal_period(ref->t.data(), ref->t.size());
+    rate_hz = p > 0.0 ? 1e6 / p : 1.0;
+  }
+  out->dt_us = 1e6 / rate_hz;
+  out->t0_us = (double)ref->t.front();
+  out->rows = (size_t)(((double)ref->t.back() - out->t0_us) / out->dt_us) + 1;
+  return true;
+}
+
+
+static void align(std::vector<Series_t> &series, Aligned_t *out, size_t block, int threads, AlignTiming_t *timing) {
+  auto t_start = std::chrono::steady_clock::now();
+
+  // Pad every column for its kernel, one task per column.
+  std::vector<std::pair<size_t, size_t>> cols;
+  for (size_t s = 0; s < series.size(); s++) {
+    Series_t &se = series[s];
+    se.period_us = RESAMPLE_median_period(se.t.data(), se.t.size());
+    if (se.mode == RESAMPLE_POLYPHASE && se.period_us > 0) {
+      double nominal = RESAMPLE_nominal_period(se.t.data(), se.t.size());
+      RESAMPLE_polyphase_design(&se.pp, 1e6 / nominal, 1e6 / out->dt_us);
+    }
+    for (size_t c = 0; c < se.columns.size(); c++) cols.push_back({ s, c });
+  }
+  PARALLEL_for(cols.size(), threads, [&](size_t k) {
+    Series_t &se = series[cols[k].first];
+    std::vector<float> raw;
+    raw.swap(se.columns[cols[k].second]);
+    if (se.mode == RESAMPLE_POLYPHASE) RESAMPLE_pad_fir(&se.pp, raw.data(), raw.size(), se.columns[cols[k].second]);
+    else RESAMPLE_pad_points(raw.data(), raw.size(), se.columns[cols[k].second]);
+  });
+
+  out->names.clear();
+  out->columns.clear();
+  std::vector<size_t> first_col;
+  for (const Series_t &se : series) {
+    first_col.push_back(out->names.size());
+    for (const char *n : se.names) out->names.push_back(n);
+  }
+  out->columns.resize(out->names.size());
+  PARALLEL_for(out->columns.size(), threads, [&](size_t c) { out->columns[c].resize(out->rows); });
+  timing->prepare_s = seconds_since(t_start);
+
+  // One task per (series, block of rows) : locate once, then every column of the series.
+  t_start = std::chrono::steady_clock::now();
+  size_t blocks = (out->rows + block - 1) / block;
+  PARALLEL_for(series.size() * blocks, threads, [&](size_t task) {
+    const Series_t &se = series[task / blocks];
+    size_t k0 = (task % blocks) * block;
+    size_t n = out->rows - k0 < block ? out->rows - k0 : block;
+    std::vector<int32_t> pos(n);
+    std::vector<float> frac(n);
+    int64_t max_gap = se.period_us * GAP_PERIODS;
+    RESAMPLE_locate(se.t.data(), se.t.size(), max_gap, out->t0_us, out->dt_us, k0, n, pos.data(), frac.data());
+    for (size_t c = 0; c < se.columns.size(); c++) {
+      const float *v = se.columns[c].data();
+      float *dst = out->columns[first_col[task / blocks] + c].data() + k0;
+      switch (se.mode) {
+        case RESAMPLE_ZOH:       RESAMPLE_zoh(v, pos.data(), dst, n); break;
+        case RESAMPLE_LINEAR:    RESAMPLE_linear(v, pos.data(), frac.data(), dst, n); break;
+        case RESAMPLE_POLYPHASE: RESAMPLE_polyphase(&se.pp, v, pos.data(), frac.data(), dst, n); break;
+      }
+    }
+  });
+  timing->align_s = seconds_since(t_start);
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Output
+//--------------------------------------------------------------------------------------------
+static bool write_binary(const char *path, const Aligned_t &a) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  AlignHeader_t hdr;
+  memcpy(hdr.magic, "ALN1", 4);
+  hdr.columns = (uint32_t)a.columns.size();
+  hdr.rows = a.rows;
+  hdr.t0_us = a.t0_us;
+  hdr.dt_us = a.dt_us;
+  fwrite(&hdr, sizeof(hdr), 1, f);
+  for (const char *n : a.names) {
+    char name[NAME_LEN] = { 0 };
+    strncpy(name, n, NAME_LEN - 1);
+    fwrite(name, NAME_LEN, 1, f);
+  }
+  for (const std::vector<float> &c : a.columns) fwrite(c.data(), sizeof(float), c.size(), f);
+  bool ok = !ferror(f);
+  fclose(f);
+  return ok;
+}
+
+
+static bool write_csv(const char *path, const Aligned_t &a, const LogTimeMap_t *map) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  fprintf(f, "t_us%s", map ? ",utc" : "");
+  for (const char *n : a.names) fprintf(f, ",%s", n);
+  fprintf(f, "\n");
+  for (size_t k = 0; k < a.rows; k++) {
+    int64_t t = (int64_t)llround(a.t0_us + (double)k * a.dt_us);
+    fprintf(f, "%lld", (long long)t);
+    double utc;
+    if (map && LOGREAD_utc(*map, t, &utc)) fprintf(f, ",%.6f", utc);
+    else if (map) fprintf(f, ",");
+    for (const std::vector<float> &c : a.columns) {
+      if (std::isnan(c[k])) fprintf(f, ",");
+      else fprintf(f, ",%.6g", c[k]);
+    }
+    fprintf(f, "\n");
+  }
+  bool ok = !ferror(f);
+  fclose(f);
+  return ok;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------------
+#define BENCH_ACCEL_HZ 3200.0
+#define BENCH_JITTER_US 3.0
+#define BENCH_MISS_RATE 1e-4
+
+static const double BenchTone_hz[3] = { 35.0, 180.0, 900.0 };
+static const double BenchTone_g[3] = { 1.0, 2.0, 0.5 };
+
+// Accel X truth, keeping only the tones below f_max.
+static double bench_accel_truth(double t_s, double f_max) {
+  double a = 0.0;
+  for (int i = 0; i < 3; i++) {
+    if (BenchTone_hz[i] < f_max) a += BenchTone_g[i] * std::sin(2.0 * M_PI * BenchTone_hz[i] * t_s + i);
+  }
+  return a;
+}
+
+
+static void bench_log(double minutes, LogData_t *d) {
+  std::mt19937 rng(3200);
+  std::normal_distribution<double> jitter(0.0, BENCH_JITTER_US);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  double duration_us = minutes * 60e6;
+  double t_first = 1e6;
+
+  double period = 1e6 / BENCH_ACCEL_HZ;
+  size_t n = (size_t)(duration_us / period);
+  d->accel.reserve(n);
+  for (size_t k = 0; k < n; k++) {
+    if (u(rng) < BENCH_MISS_RATE) continue;
+    double t = t_first + (double)k * period + jitter(rng);
+    double ax = bench_accel_truth(t * 1e-6, 1e9);
+    LogAccel_t a;
+    a.t_us = (uint64_t)llround(t);
+    a.v.acc_raw[0] = (int16_t)lrint(ax / ADXL_G_PER_LSB);
+    a.v.acc_raw[1] = (int16_t)lrint(0.1 * ax / ADXL_G_PER_LSB);
+    a.v.acc_raw[2] = (int16_t)lrint(1.0 / ADXL_G_PER_LSB);
+    d->accel.push_back(a);
+  }
+  for (double t = t_first; t < t_first + duration_us; t += 10000.0) {
+    LogBaro_t b;
+    b.t_us = (uint64_t)llround(t + jitter(rng));
+    b.v.pressure = (float)(86000.0 + 50.0 * std::sin(t * 1e-8));
+    b.v.temperature = 21.5f;
+    d->baro.push_back(b);
+  }
+  for (double t = t_first; t < t_first + duration_us; t += 100000.0) {
+    LogGps_t g = {};
+    g.t_us = (uint64_t)llround(t + 30000.0 + jitter(rng));
+    g.v.gps_fix = 3;
+    g.v.gps_lat = 475000000 + (int32_t)((t - t_first) * 1e-5);
+    g.v.gps_lon = 85000000;
+    g.v.gps_height = 1400000;
+    d->gps.push_back(g);
+  }
+  for (double t = t_first; t < t_first + duration_us; t += 2500.0) {
+    LogState_t s = {};
+    s.t_us = (uint64_t)llround(t + jitter(rng));
+    s.v.altitude = (float)(100.0 * std::sin(t * 1e-7));
+    d->state.push_back(s);
+  }
+}
+
+
+static int run_bench(double minutes, int threads, size_t block) {
+  LogData_t d = {};
+  auto t0 = std::chrono::steady_clock::now();
+  bench_log(minutes, &d);
+  printf("synthetic log : %.0f min, %zu accel, %zu baro, %zu gps, %zu state samples (%.2f s to generate)\n",
+         minutes, d.accel.size(), d.baro.size(), d.gps.size(), d.state.size(), seconds_since(t0));
+  printf("threads %d, block %zu rows\n\n", threads, block);
+  printf("| Grid    | Accel mode | Taps | Rows     | Prepare (s) | Align (s) | Mrows/s | acc_x rms err (mg) |\n");
+  printf("| ------- | ---------- | ---- | -------- | ----------- | --------- | ------- | ------------------ |\n");
+
+  const double rates[2] = { 0.0, 1000.0 };
+  for (double rate : rates) {
+    for (int m = RESAMPLE_ZOH; m <= RESAMPLE_POLYPHASE; m++) {
+      std::vector<Series_t> series = build_series(d, (ResampleMode_t)m, RESAMPLE_LINEAR, 50);
+      Aligned_t a;
+      make_grid(series, rate, &a);
+      AlignTiming_t tm;
+      align(series, &a, block, threads, &tm);
+
+      // Error against the tones the grid can carry, away from the ends.
+      double f_max = 0.5e6 / a.dt_us;
+      double sq = 0.0;
+      size_t cnt = 0;
+      for (size_t k = 1000; k + 1000 < a.rows; k += 7) {
+        float v = a.columns[0][k];
+        if (std::isnan(v)) continue;
+        double e = v - bench_accel_truth((a.t0_us + (double)k * a.dt_us) * 1e-6, f_max);
+        sq += e * e;
+        cnt++;
+      }
+      printf("| %4.0f Hz | %-10s | %4d | %8zu | %11.3f | %9.3f | %7.1f | %18.1f |\n", 1e6 / a.dt_us,
+             RESAMPLE_mode_name((ResampleMode_t)m), m == RESAMPLE_POLYPHASE ? series[0].pp.taps : m + 1, a.rows,
+             tm.prepare_s, tm.align_s, a.rows / (tm.prepare_s + tm.align_s) * 1e-6, 1e3 * std::sqrt(sq / cnt));
+    }
+  }
+  return 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------------------------------
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s <SENSOR_DATA.bin> <out.bin | out.csv> [--rate HZ] [--accel zoh|linear|polyphase]\n"
+          "          [--slow zoh|linear] [--threads N] [--block ROWS] [--ground-frames N]\n"
+          "       %s --bench [minutes] [--threads N] [--block ROWS]\n", prog, prog);
+}
+
+
+int main(int argc, char **argv) {
+  const char *in_path = NULL;
+  const char *out_path = NULL;
+  double rate = 0.0;
+  ResampleMode_t accel_mode = RESAMPLE_POLYPHASE;
+  ResampleMode_t slow_mode = RESAMPLE_LINEAR;
+  int threads = 0;
+  size_t block = DEFAULT_BLOCK_ROWS;
+  size_t ground_frames = 50;
+  double bench_minutes = -1.0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--rate") && i + 1 < argc) rate = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--accel") && i + 1 < argc) {
+      if (!RESAMPLE_parse_mode(argv[++i], &accel_mode)) { usage(argv[0]); return 1; }
+    }
+    else if (!strcmp(argv[i], "--slow") && i + 1 < argc) {
+      if (!RESAMPLE_parse_mode(argv[++i], &slow_mode) || slow_mode == RESAMPLE_POLYPHASE) {
+        fprintf(stderr, "--slow : zoh or linear (polyphase needs a uniform series, accel only)\n");
+        return 1;
+      }
+    }
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--block") && i + 1 < argc) block = (size_t)atol(argv[++i]);
+    else if (!strcmp(argv[i], "--ground-frames") && i + 1 < argc) ground_frames = (size_t)atol(argv[++i]);
+    else if (!strcmp(argv[i], "--bench")) {
+      bench_minutes = 30.0;
+      if (i + 1 < argc && argv[i + 1][0] != '-') bench_minutes = atof(argv[++i]);
+    }
+    else if (!in_path) in_path = argv[i];
+    else if (!out_path) out_path = argv[i];
+    else { usage(argv[0]); return 1; }
+  }
+  threads = PARALLEL_threads(threads);
+  if (block == 0) block = DEFAULT_BLOCK_ROWS;
+
+  BARO_init_table();
+  if (bench_minutes > 0.0) {
+    return run_bench(bench_minutes, threads, block);
+  }
+  if (!in_path || !out_path) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  std::vector<uint8_t> data;
+  if (!LOGREAD_load_file(in_path, data)) {
+    perror(in_path);
+    return 1;
+  }
+  if (!LOGREAD_is_record_log(data.data(), data.size())) {
+    fprintf(stderr, "%s : not a record log (legacy frames have one stamp for all sensors, use log_decode)\n", in_path);
+    return 1;
+  }
+  LogData_t d = {};
+  LOGREAD_parse(data.data(), data.size(), &d);
+  data.clear();
+  data.shrink_to_fit();
+  double parse_s = seconds_since(t0);
+
+  std::vector<Series_t> series = build_series(d, accel_mode, slow_mode, ground_frames);
+  Aligned_t a;
+  if (!make_grid(series, rate, &a)) {
+    fprintf(stderr, "%s : no accel or baro samples\n", in_path);
+    return 1;
+  }
+  AlignTiming_t tm;
+  align(series, &a, block, threads, &tm);
+
+  t0 = std::chrono::steady_clock::now();
+  size_t len = strlen(out_path);
+  bool csv = len > 4 && !strcmp(out_path + len - 4, ".csv");
+  LogTimeMap_t map;
+  LOGREAD_time_map(d, &map);
+  bool ok = csv ? write_csv(out_path, a, map.mcu_us.size() >= 2 ? &map : NULL) : write_binary(out_path, a);
+  if (!ok) {
+    return 1;
+  }
+
+  fprintf(stderr, "%zu rows x %zu columns at %.1f Hz, accel %s, slow %s\n", a.rows, a.columns.size(), 1e6 / a.dt_us,
+          RESAMPLE_mode_name(accel_mode), RESAMPLE_mode_name(slow_mode));
+  for (const Series_t &se : series) {
+    fprintf(stderr, "  %-5s %8zu samples, median period %lld us\n", se.name, se.t.size(), (long long)se.period_us);
+  }
+  fprintf(stderr, "parse %.3f s, prepare %.3f s, align %.3f s, write %.3f s (%d threads)\n", parse_s, tm.prepare_s,
+          tm.align_s, seconds_since(t0), threads);
+  return 0;
+}
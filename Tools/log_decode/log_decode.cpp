@@ -0,0 +1,540 @@
+/**
+ * @file log_decode.cpp
+ * @brief Decode a flight computer SD card log into CSV.
+ *
+ * Input is the binary file written by the ESP32_FC logger, in one of two
+ * formats, detected from the first bytes :
+ *
+ * Record log (current) : see lib/FlightLog/flight_log.h. Every record carries
+ * its esp_timer microsecond stamp. One CSV per record type is written next to
+ * the output prefix (default : the input path without extension) :
+ *
+ * | File          | Rows                                                    |
+ * | ------------- | ------------------------------------------------------- |
+ * | _accel.csv    | t_us, raw counts, g                                     |
+ * | _baro.csv     | t_us, pressure, temperature, altitude above the pad     |
+ * | _gps.csv      | t_us, NAV-PVT fields                                    |
+ * | _state.csv    | t_us, Kalman altitude, velocity, acceleration, lockout  |
+ * | _events.csv   | t_us, apogee votes and detector latencies               |
+ * | _timing.csv   | t_us, per sensor jitter window                          |
+ * | _timesync.csv | t_us of each PPS edge, GPS/UTC time, onboard clock fit  |
+ * | _spectrum.csv | t_us, axis, peak, vibration PSD per bin (dB re g^2/Hz)  |
+ * | _storage.csv  | t_us, path (file / raw / flash), slot writes and worst  |
+ *                 | write / flush times                                     |
+ * | _sinks.csv    | t_us, path, blocks handed over, written, dropped and    |
+ *                 | failed, deepest queue, longest wait                     |
+ * | _radio.csv    | t_us (receiver clock), RSSI, SNR, telemetry packet hex  |
+ *
+ * When the log has TIMESYNC records every file gets a utc column (Unix
+ * seconds), interpolated between the PPS edges around each stamp.
+ *
+ * The jitter distribution of the whole flight (sum of the TIMING windows) and
+ * the worst log write and flush times (STORAGE, per destination : SD card,
+ * flash ring) are printed to stderr.
+ *
+ * A preview sidecar (<prefix>.preview, common/preview.h) is written alongside :
+ * per channel LTTB and min/max pyramid so a plot of any zoom level reads a few
+ * thousand points (log_preview). Channels : acc_x/y/z (g), pressure (Pa),
+ * temperature (C), altitude (m above the pad), kf_altitude (m), kf_velocity
+ * (m/s), kf_acceleration (m/s^2), gps_height (m). --no-preview skips it,
+ * --threads sets the build workers.
+ *
+ * Legacy frames (before the record log). Each data frame is 47 bytes, little endian :
+ *
+ *  |------------------------------------------------------------------------------------|
+ *  | 0xFF | AccX AccY AccZ (i16) | Pressure (f64) | Temp (f64) | iTOW (u32) | year (u16) |
+ *  | month day hour min sec (u8) | lon lat height (i32)                          | 0xFF |
+ *  |------------------------------------------------------------------------------------|
+ *
+ * Frames are found by checking both separator bytes, so a corrupted frame only
+ * loses itself. Legacy logs decode to a single CSV (out, or stdout).
+ *
+ * In both formats altitude above the pad is computed with the batch form of the
+ * flight computer pressure to altitude table; the pad reference is the mean
+ * pressure altitude of the first N baro samples (--ground-frames).
+ *
+ * Usage :
+ *   log_decode <SENSOR_DATA.bin> [out prefix | out.csv] [--ground-frames N] [--no-preview] [--threads N]
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "baro_altitude.h"
+#include "flight_log.h"
+#include "log_reader.h"
+#include "parallel.h"
+#include "preview.h"
+
+
+#define FRAME_SEPARATOR 0xFF
+#define FRAME_SIZE 47
+#define ADXL_G_PER_LSB 0.049
+
+
+typedef struct {
+  int16_t acc[3];
+  double pressure;
+  double temperature;
+  uint32_t itow;
+  uint16_t year;
+  uint8_t month, day, hour, min, sec;
+  int32_t lon, lat, height;
+} LegacyFrame_t;
+
+
+static bool parse_frame(const uint8_t *b, LegacyFrame_t *f) {
+  if (b[0] != FRAME_SEPARATOR || b[FRAME_SIZE - 1] != FRAME_SEPARATOR) {
+    return false;
+  }
+  const uint8_t *p = b + 1;
+  memcpy(f->acc, p, 6);            p += 6;
+  memcpy(&f->pressure, p, 8);      p += 8;
+  memcpy(&f->temperature, p, 8);   p += 8;
+  memcpy(&f->itow, p, 4);          p += 4;
+  memcpy(&f->year, p, 2);          p += 2;
+  f->month = *p++;
+  f->day = *p++;
+  f->hour = *p++;
+  f->min = *p++;
+  f->sec = *p++;
+  memcpy(&f->lon, p, 4);           p += 4;
+  memcpy(&f->lat, p, 4);           p += 4;
+  memcpy(&f->height, p, 4);
+  // Reject frames whose separators matched by chance.
+  return f->pressure > 1000.0 && f->pressure < 200000.0;
+}
+
+
+// Altitude above the pad for a pressure series, pad = mean of the first n_ground.
+static std::vector<float> altitude_above_pad(const std::vector<float> &pressure, size_t n_ground) {
+  std::vector<float> altitude(pressure.size());
+  BARO_pressure_altitude_batch(pressure.data(), altitude.data(), pressure.size());
+  if (n_ground > altitude.size()) n_ground = altitude.size();
+  double ground = 0.0;
+  for (size_t k = 0; k < n_ground; k++) ground += altitude[k];
+  ground = n_ground ? ground / n_ground : 0.0;
+  for (float &a : altitude) a = (float)(a - ground);
+  return altitude;
+}
+
+
+static int decode_legacy(const std::vector<uint8_t> &data, const char *out_path, size_t ground_frames) {
+  std::vector<LegacyFrame_t> frames;
+  size_t skipped = 0;
+  for (size_t pos = 0; pos + FRAME_SIZE <= data.size();) {
+    LegacyFrame_t f;
+    if (parse_frame(&data[pos], &f)) {
+      frames.push_back(f);
+      pos += FRAME_SIZE;
+    }
+    else {
+      pos++;
+      skipped++;
+    }
+  }
+
+  std::vector<float> pressure(frames.size());
+  for (size_t k = 0; k < frames.size(); k++) pressure[k] = (float)frames[k].pressure;
+  std::vector<float> altitude = altitude_above_pad(pressure, ground_frames);
+
+  FILE *out = out_path ? fopen(out_path, "w") : stdout;
+  if (!out) {
+    perror(out_path);
+    return 1;
+  }
+  fprintf(out, "acc_x,acc_y,acc_z,pressure,temperature,altitude,itow,year,month,day,hour,min,sec,lon,lat,height\n");
+  for (size_t k = 0; k < frames.size(); k++) {
+    const LegacyFrame_t &f = frames[k];
+    fprintf(out, "%d,%d,%d,%.2f,%.2f,%.3f,%u,%u,%u,%u,%u,%u,%u,%d,%d,%d\n",
+            f.acc[0], f.acc[1], f.acc[2], f.pressure, f.temperature, altitude[k],
+            f.itow, f.year, f.month, f.day, f.hour, f.min, f.sec, f.lon, f.lat, f.height);
+  }
+  if (out != stdout) fclose(out);
+
+  fprintf(stderr, "%zu legacy frames decoded, %zu bytes skipped\n", frames.size(), skipped);
+  return 0;
+}
+
+
+// UTC column, only when the log has PPS time sync records.
+static const LogTimeMap_t *TimeMap = NULL;
+
+static FILE *open_csv(const std::string &prefix, const char *suffix, const char *header) {
+  std::string path = prefix + suffix;
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f) {
+    perror(path.c_str());
+    return NULL;
+  }
+  fprintf(f, "%s%s\n", header, TimeMap ? ",utc" : "");
+  return f;
+}
+
+// Ends a row : the UTC column if there is one, then the newline.
+static void end_row(FILE *f, uint64_t t_us) {
+  double utc;
+  if (TimeMap && LOGREAD_utc(*TimeMap, (int64_t)t_us, &utc)) fprintf(f, ",%.6f", utc);
+  else if (TimeMap) fprintf(f, ",");
+  fprintf(f, "\n");
+}
+
+
+static void print_jitter_summary(const LogData_t &d) {
+  static const char *names[2] = { "accel", "baro" };
+  static const char *bins[8] = { "<1", "<2", "<5", "<10", "<20", "<50", "<100", ">=100" };
+  for (uint8_t sensor = LOG_SENSOR_ACCEL; sensor <= LOG_SENSOR_BARO; sensor++) {
+    uint64_t samples = 0, missed = 0, dropped = 0, hist[8] = { 0 };
+    int32_t jmin = INT32_MAX, jmax = INT32_MIN;
+    double sq = 0.0;
+    uint32_t period = 0;
+    for (const LogTiming_t &t : d.timing) {
+      if (t.v.sensor != sensor || !t.v.samples) continue;
+      period = t.v.period_us;
+      samples += t.v.samples;
+      missed += t.v.missed;
+      dropped += t.v.dropped;
+      if (t.v.jitter_min_us < jmin) jmin = t.v.jitter_min_us;
+      if (t.v.jitter_max_us > jmax) jmax = t.v.jitter_max_us;
+      sq += (double)t.v.jitter_rms_us * t.v.jitter_rms_us * t.v.samples;
+      for (int i = 0; i < 8; i++) hist[i] += t.v.hist[i];
+    }
+    if (!samples) continue;
+    fprintf(stderr, "%-5s period %u us : %llu samples, %llu missed, %llu dropped, jitter min %d max %d rms %.1f us\n",
+            names[sensor], period, (unsigned long long)samples, (unsigned long long)missed,
+            (unsigned long long)dropped, jmin, jmax, sqrt(sq / samples));
+    fprintf(stderr, "      |jitter| us :");
+    for (int i = 0; i < 8; i++) fprintf(stderr, " %s %.2f%%", bins[i], 100.0 * hist[i] / samples);
+    fprintf(stderr, "\n");
+  }
+}
+
+
+static const char *storage_path_name(uint8_t path) {
+  switch (path) {
+    case LOG_STORAGE_RAW: return "raw";
+    case LOG_STORAGE_FLASH: return "flash";
+    default: return "file";
+  }
+}
+
+
+// Slot writes over the whole log : how long the logging loop stalled on each
+// destination. The SD card is the file or raw one, whichever the log used.
+static void print_storage_summary(const LogData_t &d) {
+  for (int flash = 0; flash <= 1; flash++) {
+    uint64_t slots = 0, write_us = 0;
+    uint32_t write_max = 0, flush_max = 0;
+    const LOG_Storage_t *last = NULL;
+    for (const LogStorage_t &s : d.storage) {
+      if ((s.v.path == LOG_STORAGE_FLASH) != (flash == 1)) continue;
+      slots += s.v.slots;
+      write_us += s.v.write_us;
+      write_max = std::max(write_max, s.v.write_max_us);
+      flush_max = std::max(flush_max, s.v.flush_max_us);
+      last = &s.v;
+    }
+    if (!last) {
+      continue;
+    }
+    if (flash) {
+      fprintf(stderr, "storage (flash ring) : %llu slots, mean write %.2f ms, worst write %.2f ms, "
+              "worst erase ahead %.2f ms, %u write errors, %u commits erased first\n",
+              (unsigned long long)slots, slots ? write_us * 1e-3 / slots : 0.0, write_max * 1e-3, flush_max * 1e-3,
+              last->write_errors, last->dropped);
+    }
+    else {
+      fprintf(stderr, "storage (%s) : %llu slots, mean write %.2f ms, worst write %.2f ms, worst flush %.2f ms, "
+              "%u write errors, %u records dropped\n", last->path == LOG_STORAGE_RAW ? "raw sectors" : "file",
+              (unsigned long long)slots, slots ? write_us * 1e-3 / slots : 0.0, write_max * 1e-3, flush_max * 1e-3,
+              last->write_errors, last->dropped);
+    }
+  }
+}
+
+
+// Each log destination's health at the end of the log : blocks lost to a
+// full queue or a failed write are in the other copy, if there is one.
+static void print_sink_summary(const LogData_t &d) {
+  for (uint8_t path : { (uint8_t)LOG_STORAGE_FILE, (uint8_t)LOG_STORAGE_RAW, (uint8_t)LOG_STORAGE_FLASH }) {
+    const LOG_Sink_t *last = NULL;
+    for (const LogSink_t &s : d.sinks) {
+      if (s.v.path == path) last = &s.v;
+    }
+    if (!last) {
+      continue;
+    }
+    fprintf(stderr, "destination (%s) : %u blocks, %u written, %u dropped on a full queue, %u failed, "
+            "deepest queue %u, longest wait %.1f ms\n", storage_path_name(path), last->blocks, last->written,
+            last->overruns, last->write_errors, last->queue_max, last->wait_max_us * 1e-3);
+  }
+}
+
+
+// Preview channels : stamps and values per channel, then the sidecar.
+static bool write_preview(const LogData_t &d, const std::vector<float> &altitude, const std::vector<uint8_t> &data,
+                          const std::string &prefix, int threads) {
+  typedef struct {
+    const char *name, *units;
+    std::vector<int64_t> t;
+    std::vector<float> v;
+  } Channel_t;
+  std::vector<Channel_t> ch = {
+    { "acc_x", "g", {}, {} }, { "acc_y", "g", {}, {} }, { "acc_z", "g", {}, {} },
+    { "pressure", "Pa", {}, {} }, { "temperature", "C", {}, {} }, { "altitude", "m", {}, {} },
+    { "kf_altitude", "m", {}, {} }, { "kf_velocity", "m/s", {}, {} }, { "kf_acceleration", "m/s^2", {}, {} },
+    { "gps_height", "m", {}, {} },
+  };
+  for (const LogAccel_t &a : d.accel) {
+    for (int i = 0; i < 3; i++) {
+      ch[i].t.push_back((int64_t)a.t_us);
+      ch[i].v.push_back((float)(a.v.acc_raw[i] * ADXL_G_PER_LSB));
+    }
+  }
+  for (size_t k = 0; k < d.baro.size(); k++) {
+    const float v[3] = { d.baro[k].v.pressure, d.baro[k].v.temperature, altitude[k] };
+    for (int i = 0; i < 3; i++) {
+      ch[3 + i].t.push_back((int64_t)d.baro[k].t_us);
+      ch[3 + i].v.push_back(v[i]);
+    }
+  }
+  for (const LogState_t &s : d.state) {
+    const float v[3] = { s.v.altitude, s.v.velocity, s.v.acceleration };
+    for (int i = 0; i < 3; i++) {
+      ch[6 + i].t.push_back((int64_t)s.t_us);
+      ch[6 + i].v.push_back(v[i]);
+    }
+  }
+  for (const LogGps_t &g : d.gps) {
+    ch[9].t.push_back((int64_t)g.t_us);
+    ch[9].v.push_back(g.v.gps_height * 1e-3f);
+  }
+
+  // The logger stamps every record at the time it was taken, in order per sensor;
+  // drop anything that would step back (a corrupted stamp) so levels stay sorted.
+  std::vector<PreviewInput_t> in;
+  for (Channel_t &c : ch) {
+    size_t w = 0;
+    for (size_t k = 0; k < c.t.size(); k++) {
+      if (w && c.t[k] < c.t[w - 1]) continue;
+      c.t[w] = c.t[k];
+      c.v[w++] = c.v[k];
+    }
+    c.t.resize(w);
+    c.v.resize(w);
+    in.push_back({ c.name, c.units, c.t.data(), c.v.data(), c.t.size() });
+  }
+  std::string path = prefix + ".preview";
+  if (!PREVIEW_write(path.c_str(), in.data(), (int)in.size(), data.size(), PREVIEW_hash(data.data(), data.size()),
+                     threads)) {
+    perror(path.c_str());
+    return false;
+  }
+  return true;
+}
+
+
+static int decode_records(const std::vector<uint8_t> &data, const std::string &prefix, size_t ground_frames,
+                          bool preview, int threads) {
+  LogData_t d = {};
+  LOGREAD_parse(data.data(), data.size(), &d);
+  LogTimeMap_t map;
+  LOGREAD_time_map(d, &map);
+  TimeMap = map.mcu_us.size() >= 2 ? &map : NULL;
+
+  FILE *f = open_csv(prefix, "_accel.csv", "t_us,acc_x,acc_y,acc_z,g_x,g_y,g_z");
+  if (!f) return 1;
+  for (const LogAccel_t &a : d.accel) {
+    fprintf(f, "%llu,%d,%d,%d,%.3f,%.3f,%.3f", (unsigned long long)a.t_us, a.v.acc_raw[0], a.v.acc_raw[1],
+            a.v.acc_raw[2], a.v.acc_raw[0] * ADXL_G_PER_LSB, a.v.acc_raw[1] * ADXL_G_PER_LSB,
+            a.v.acc_raw[2] * ADXL_G_PER_LSB);
+    end_row(f, a.t_us);
+  }
+  fclose(f);
+
+  std::vector<float> pressure(d.baro.size());
+  for (size_t k = 0; k < d.baro.size(); k++) pressure[k] = d.baro[k].v.pressure;
+  std::vector<float> altitude = altitude_above_pad(pressure, ground_frames);
+  f = open_csv(prefix, "_baro.csv", "t_us,pressure,temperature,altitude");
+  if (!f) return 1;
+  for (size_t k = 0; k < d.baro.size(); k++) {
+    fprintf(f, "%llu,%.2f,%.2f,%.3f", (unsigned long long)d.baro[k].t_us, d.baro[k].v.pressure,
+            d.baro[k].v.temperature, altitude[k]);
+    end_row(f, d.baro[k].t_us);
+  }
+  fclose(f);
+  if (preview && !write_preview(d, altitude, data, prefix, threads)) return 1;
+
+  f = open_csv(prefix, "_gps.csv", "t_us,itow,year,month,day,hour,min,sec,fix,lon,lat,height");
+  if (!f) return 1;
+  for (const LogGps_t &g : d.gps) {
+    fprintf(f, "%llu,%u,%u,%u,%u,%u,%u,%u,%u,%d,%d,%d", (unsigned long long)g.t_us, g.v.gps_itow,
+            g.v.gps_year, g.v.gps_month, g.v.gps_day, g.v.gps_hour, g.v.gps_min, g.v.gps_sec, g.v.gps_fix,
+            g.v.gps_lon, g.v.gps_lat, g.v.gps_height);
+    end_row(f, g.t_us);
+  }
+  fclose(f);
+
+  f = open_csv(prefix, "_state.csv", "t_us,kf_altitude,kf_velocity,kf_acceleration,baro_locked");
+  if (!f) return 1;
+  for (const LogState_t &s : d.state) {
+    fprintf(f, "%llu,%.3f,%.3f,%.3f,%u", (unsigned long long)s.t_us, s.v.altitude, s.v.velocity,
+            s.v.acceleration, s.v.baro_locked);
+    end_row(f, s.t_us);
+  }
+  fclose(f);
+
+  f = open_csv(prefix, "_events.csv", "t_us,id,votes,t_fired_us,t_estimate_us,altitude,kf_vote_ms,baro_vote_ms,gps_vote_ms");
+  if (!f) return 1;
+  for (const LogEvent_t &e : d.events) {
+    fprintf(f, "%llu,%u,%u,%lld,%lld,%.2f", (unsigned long long)e.t_us, e.v.id, e.v.votes,
+            (long long)e.v.t_fired_us, (long long)e.v.t_estimate_us, e.v.altitude);
+    for (int i = 0; i < 3; i++) {
+      if (e.v.vote_offset_ms[i] == INT32_MIN) fprintf(f, ",");
+      else fprintf(f, ",%d", e.v.vote_offset_ms[i]);
+    }
+    end_row(f, e.t_us);
+  }
+  fclose(f);
+
+  f = open_csv(prefix, "_timing.csv", "t_us,sensor,period_us,samples,missed,dropped,jitter_min_us,jitter_max_us,"
+               "jitter_rms_us,h_lt1,h_lt2,h_lt5,h_lt10,h_lt20,h_lt50,h_lt100,h_ge100");
+  if (!f) return 1;
+  for (const LogTiming_t &t : d.timing) {
+    fprintf(f, "%llu,%u,%u,%u,%u,%u,%d,%d,%u", (unsigned long long)t.t_us, t.v.sensor, t.v.period_us,
+            t.v.samples, t.v.missed, t.v.dropped, t.v.jitter_min_us, t.v.jitter_max_us, t.v.jitter_rms_us);
+    for (int i = 0; i < 8; i++) fprintf(f, ",%u", t.v.hist[i]);
+    end_row(f, t.t_us);
+  }
+  fclose(f);
+
+  f = open_csv(prefix, "_timesync.csv", "t_us,itow,utc_year,utc_month,utc_day,utc_hour,utc_min,utc_sec,"
+               "flags,offset_us,drift_ppb,residual_ns");
+  if (!f) return 1;
+  for (const LogTimeSync_t &t : d.timesync) {
+    fprintf(f, "%llu,%u,%u,%u,%u,%u,%u,%u,%u,%lld,%d,%u", (unsigned long long)t.t_us, t.v.gps_itow, t.v.utc_year,
+            t.v.utc_month, t.v.utc_day, t.v.utc_hour, t.v.utc_min, t.v.utc_sec, t.v.flags,
+            (long long)t.v.offset_us, t.v.drift_ppb, t.v.residual_ns);
+    end_row(f, t.t_us);
+  }
+  fclose(f);
+
+  // One row per axis; bin columns are named after their centre frequency.
+  std::string header = "t_us,axis,windows,peak_hz,peak_db";
+  double bin_hz = d.spectrum.empty() ? 0.0 : (double)d.spectrum[0].v.rate_hz / d.spectrum[0].v.n_fft;
+  for (int k = 0; k < LOG_SPECTRUM_BINS; k++) {
+    char name[32];
+    snprintf(name, sizeof(name), ",db_%g", k * bin_hz);
+    header += name;
+  }
+  f = open_csv(prefix, "_spectrum.csv", header.c_str());
+  if (!f) return 1;
+  for (const LogSpectrum_t &s : d.spectrum) {
+    double hz = s.v.n_fft ? (double)s.v.rate_hz / s.v.n_fft : 0.0;
+    for (int a = 0; a < 3; a++) {
+      // Peak above DC, the mean is removed before the FFT
+      int peak = 1;
+      for (int k = 2; k < LOG_SPECTRUM_BINS; k++) {
+        if (s.v.db[a][k] > s.v.db[a][peak]) peak = k;
+      }
+      fprintf(f, "%llu,%c,%u,%g,%.1f", (unsigned long long)s.t_us, 'x' + a, s.v.windows, peak * hz,
+              LOG_SPECTRUM_DB_MIN + s.v.db[a][peak] * LOG_SPECTRUM_DB_STEP);
+      for (int k = 0; k < LOG_SPECTRUM_BINS; k++) {
+        fprintf(f, ",%.1f", LOG_SPECTRUM_DB_MIN + s.v.db[a][k] * LOG_SPECTRUM_DB_STEP);
+      }
+      end_row(f, s.t_us);
+    }
+  }
+  fclose(f);
+
+  f = open_csv(prefix, "_storage.csv", "t_us,path,slots,write_us,write_max_us,flush_max_us,write_errors,dropped");
+  if (!f) return 1;
+  for (const LogStorage_t &s : d.storage) {
+    fprintf(f, "%llu,%s,%u,%u,%u,%u,%u,%u", (unsigned long long)s.t_us, storage_path_name(s.v.path),
+            s.v.slots, s.v.write_us, s.v.write_max_us, s.v.flush_max_us, s.v.write_errors, s.v.dropped);
+    end_row(f, s.t_us);
+  }
+  fclose(f);
+
+  f = open_csv(prefix, "_sinks.csv", "t_us,path,blocks,written,overruns,write_errors,queue_max,wait_max_us");
+  if (!f) return 1;
+  for (const LogSink_t &s : d.sinks) {
+    fprintf(f, "%llu,%s,%u,%u,%u,%u,%u,%u", (unsigned long long)s.t_us, storage_path_name(s.v.path),
+            s.v.blocks, s.v.written, s.v.overruns, s.v.write_errors, s.v.queue_max, s.v.wait_max_us);
+    end_row(f, s.t_us);
+  }
+  fclose(f);
+
+  f = open_csv(prefix, "_radio.csv", "t_us,rssi_dbm,snr_db,len,packet");
+  if (!f) return 1;
+  for (const LogRadio_t &r : d.radio) {
+    fprintf(f, "%llu,%d,%.2f,%u,", (unsigned long long)r.t_us, r.v.rssi_dbm, r.v.snr_qdb * 0.25, r.v.len);
+    for (int i = 0; i < r.v.len; i++) fprintf(f, "%02x", r.v.packet[i]);
+    end_row(f, r.t_us);
+  }
+  fclose(f);
+
+  fprintf(stderr, "%zu records : %zu accel, %zu baro, %zu gps, %zu state, %zu events, %zu timing, "
+          "%zu timesync, %zu spectrum, %zu storage, %zu radio, %zu unknown, %zu bytes skipped\n", d.records, d.accel.size(),
+          d.baro.size(), d.gps.size(), d.state.size(), d.events.size(), d.timing.size(), d.timesync.size(),
+          d.spectrum.size(), d.storage.size(), d.radio.size(), d.unknown, d.skipped);
+  if (d.journal_slots) fprintf(stderr, "journal : %zu valid slots (%.1f MB)\n", d.journal_slots,
+                               d.journal_slots * LOG_SLOT_SIZE / 1e6);
+  if (TimeMap) fprintf(stderr, "UTC column from %zu PPS edges\n", map.mcu_us.size());
+  if (preview) fprintf(stderr, "preview sidecar %s.preview\n", prefix.c_str());
+  print_jitter_summary(d);
+  print_storage_summary(d);
+  print_sink_summary(d);
+  return 0;
+}
+
+
+int main(int argc, char **argv) {
+  const char *in_path = NULL;
+  const char *out_path = NULL;
+  size_t ground_frames = 50;
+  bool preview = true;
+  int threads = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--ground-frames") && i + 1 < argc) ground_frames = (size_t)atol(argv[++i]);
+    else if (!strcmp(argv[i], "--no-preview")) preview = false;
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = atoi(argv[++i]);
+    else if (!in_path) in_path = argv[i];
+    else if (!out_path) out_path = argv[i];
+    else in_path = NULL;
+  }
+  if (!in_path) {
+    fprintf(stderr, "usage: %s <SENSOR_DATA.bin> [out prefix | out.csv] [--ground-frames N] [--no-preview] "
+            "[--threads N]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<uint8_t> data;
+  if (!LOGREAD_load_file(in_path, data)) {
+    perror(in_path);
+    return 1;
+  }
+
+  BARO_init_table();
+  if (!LOGREAD_is_record_log(data.data(), data.size())) {
+    return decode_legacy(data, out_path, ground_frames);
+  }
+
+  std::string prefix;
+  if (out_path) {
+    prefix = out_path;
+  }
+  else {
+    prefix = in_path;
+    size_t dot = prefix.find_last_of('.');
+    size_t slash = prefix.find_last_of('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) prefix.erase(dot);
+  }
+  return decode_records(data, prefix, ground_frames, preview, PARALLEL_threads(threads));
+}
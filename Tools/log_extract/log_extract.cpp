@@ -0,0 +1,456 @@
+/**
+ * @file log_extract.cpp
+ * @brief Cut a time range out of a flight log, seeking with its time index.
+ *
+ * Writes the records of SENSOR_DATA.bin stamped in [--from, --to] (seconds of
+ * flight computer time), or around the first EVENT of a kind (--event apogee,
+ * --before / --after seconds, 1 s each by default), as a record log every
+ * other tool reads.
+ *
+ * The start of the range is found with the sidecar index the logger writes
+ * (SENSOR_DATA.idx, common/log_index.h) : a binary search of the index, then
+ * only the blocks of the range are read. Without the index (--no-index, or
+ * the file is missing) the log bytes are bisected instead, events need a
+ * scan from the start. Reading stops LOG_INDEX_SLACK_US past the end of the
+ * range.
+ *
+ * --bench [minutes] writes a synthetic log and index the way the firmware
+ * does (LOG_index_add / LOG_index_close per block, sync once a second) and
+ * times extracting 2 s around apogee and random ranges three ways : scan from
+ * the start, bisection, index. Every extract is checked against the records
+ * a full parse keeps. Then the log is cut mid record and the index given a
+ * torn entry, as on a card pulled in flight, and the checks run again.
+ *
+ * Usage :
+ *   log_extract <SENSOR_DATA.bin> <out.bin> --from S --to S [--index PATH | --no-index]
+ *   log_extract <SENSOR_DATA.bin> <out.bin> --event launch|apogee [--before S] [--after S] [--index PATH | --no-index]
+ *   log_extract --bench [minutes] [--tmp DIR]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "log_index.h"
+#include "log_reader.h"
+
+
+#define BENCH_QUERIES 50
+#define BENCH_SPAN_US 2000000         // Range extracted by the benchmark
+#define BENCH_LAUNCH_FRACTION 0.8     // Launch this far into the synthetic log
+#define BENCH_APOGEE_AFTER_US 12000000
+
+
+typedef enum {
+  SEEK_SCAN,                  // Read from the start
+  SEEK_BISECT,                // Bisect the log bytes
+  SEEK_INDEX,                 // Binary search the index
+} SeekMode_t;
+
+static const char *SEEK_NAMES[] = { "scan", "bisect", "index" };
+
+typedef struct {
+  uint64_t start;             // Offset reading started from
+  uint64_t bytes;             // Log bytes read : seek, then decoded from start
+  size_t records;             // Records kept
+  size_t lookups;             // pread() calls of the seek
+} ExtractStats_t;
+
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+static void append_record(std::vector<uint8_t> *out, const LOG_Record_t &rec) {
+  size_t at = out->size();
+  out->resize(at + rec.size);
+  LOG_encode(out->data() + at, rec.type, rec.t_us, rec.payload, rec.len);
+}
+
+
+// Records of the log stamped in [t0_us, t1_us], read from offset on.
+static bool copy_range(const char *log_path, uint64_t offset, uint64_t t0_us, uint64_t t1_us,
+                       std::vector<uint8_t> *out, ExtractStats_t *st) {
+  LogStream_t s;
+  if (!LOGREAD_stream_open(&s, log_path) || !LOGREAD_stream_seek(&s, offset)) {
+    return false;
+  }
+  st->start = offset;
+  LOG_Record_t rec;
+  uint64_t decoded = 0;
+  while (LOGREAD_stream_next(&s, &rec)) {
+    decoded += rec.size;
+    if (rec.t_us >= t0_us && rec.t_us <= t1_us) {
+      append_record(out, rec);
+      st->records++;
+    } else if ((rec.type == LOG_REC_ACCEL || rec.type == LOG_REC_BARO) && rec.t_us > t1_us + LOG_INDEX_SLACK_US) {
+      break;
+    }
+  }
+  st->bytes += decoded + s.skipped;
+  LOGREAD_stream_close(&s);
+  return true;
+}
+
+
+static bool extract_time(const char *log_path, const char *index_path, SeekMode_t mode, uint64_t t0_us,
+                         uint64_t t1_us, std::vector<uint8_t> *out, ExtractStats_t *st) {
+  memset(st, 0, sizeof(*st));
+  out->clear();
+  LogIndex_t x;
+  if (!LOGINDEX_open(&x, log_path, mode == SEEK_INDEX ? index_path : NULL)) {
+    return false;
+  }
+  uint64_t offset = mode == SEEK_SCAN ? 0 : LOGINDEX_seek_time(&x, t0_us);
+  st->lookups = x.reads;
+  st->bytes = x.bytes_read;
+  LOGINDEX_close(&x);
+  return copy_range(log_path, offset, t0_us, t1_us, out, st);
+}
+
+
+static bool extract_event(const char *log_path, const char *index_path, SeekMode_t mode, uint8_t id,
+                          uint64_t before_us, uint64_t after_us, std::vector<uint8_t> *out, ExtractStats_t *st,
+                          uint64_t *t_event_us) {
+  memset(st, 0, sizeof(*st));
+  out->clear();
+  LogIndex_t x;
+  if (!LOGINDEX_open(&x, log_path, mode == SEEK_INDEX ? index_path : NULL)) {
+    return false;
+  }
+  uint64_t at, t;
+  bool found = LOGINDEX_find_event(&x, id, &at, NULL, &t);
+  if (found) {
+    uint64_t t0 = t > before_us ? t - before_us : 0;
+    uint64_t offset = mode == SEEK_SCAN ? 0 : LOGINDEX_seek_time(&x, t0);
+    st->lookups = x.reads;
+    st->bytes = x.bytes_read;
+    *t_event_us = t;
+    found = copy_range(log_path, offset, t0, t + after_us, out, st);
+  }
+  LOGINDEX_close(&x);
+  return found;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------------
+// Firmware side of the log : records staged in 4 KB blocks, each block
+// appended with its index entry, a partial block flushed once a second.
+typedef struct {
+  FILE *log;
+  FILE *index;
+  std::vector<uint8_t> block;
+  size_t used;
+  uint32_t offset;
+  LOG_IndexBlock_t ib;
+} BenchWriter_t;
+
+
+static void bench_flush(BenchWriter_t *w) {
+  if (!w->used) return;
+  LOG_IndexEntry_t e;
+  LOG_index_close(&w->ib, w->offset, &e);
+  fwrite(w->block.data(), 1, w->used, w->log);
+  fwrite(&e, sizeof(e), 1, w->index);
+  w->offset += (uint32_t)w->used;
+  w->used = 0;
+}
+
+
+static void bench_record(BenchWriter_t *w, uint8_t type, uint64_t t_us, const void *payload, uint16_t len) {
+  w->used += LOG_encode(w->block.data() + w->used, type, t_us, payload, len);
+  LOG_index_add(&w->ib, type, t_us, payload);
+  if (w->used >= 4096) bench_flush(w);
+}
+
+
+static bool bench_write_log(const char *log_path, const char *index_path, double minutes, uint64_t *t_launch,
+                            uint64_t *t_end) {
+  BenchWriter_t w = {};
+  w.log = fopen(log_path, "wb");
+  w.index = fopen(index_path, "wb");
+  if (!w.log || !w.index) {
+    return false;
+  }
+  w.block.resize(8192);
+  std::mt19937 rng(38);
+  std::normal_distribution<double> g(0.0, 1.0);
+  const uint64_t t_start = 2000000;
+  const uint64_t duration = (uint64_t)(minutes * 60e6);
+  *t_launch = t_start + (uint64_t)(BENCH_LAUNCH_FRACTION * duration);
+  uint64_t t_apogee = *t_launch + BENCH_APOGEE_AFTER_US;
+  bool launched = false, apogee = false;
+
+  uint64_t next_accel = t_start, next_baro = t_start, next_second = t_start + 1000000;
+  while (next_accel < t_start + duration) {
+    uint64_t t = std::min(next_accel, next_baro);
+    if (t == next_accel) {
+      LOG_Accel_t a;
+      for (int k = 0; k < 3; k++) a.acc_raw[k] = (int16_t)std::lround(g(rng) * 3.0 + (k == 2 ? 20.0 : 0.0));
+      bench_record(&w, LOG_REC_ACCEL, next_accel + (uint64_t)std::abs(g(rng) * 5.0), &a, sizeof(a));
+      next_accel += 1250;
+    } else {
+      LOG_Baro_t b = { 101325.0f + (float)g(rng), 21.0f };
+      bench_record(&w, LOG_REC_BARO, next_baro, &b, sizeof(b));
+      next_baro += 20000;
+    }
+    if (!launched && t >= *t_launch) {
+      LOG_Event_t ev = {};
+      ev.id = LOG_EVENT_LAUNCH;
+      ev.t_fired_us = ev.t_estimate_us = (int64_t)t;
+      bench_record(&w, LOG_REC_EVENT, t, &ev, sizeof(ev));
+      launched = true;
+    }
+    if (!apogee && t >= t_apogee) {
+      LOG_Event_t ev = {};
+      ev.id = LOG_EVENT_APOGEE;
+      ev.votes = 0x7;
+      ev.t_fired_us = (int64_t)t;
+      ev.t_estimate_us = (int64_t)t - 400000;
+      bench_record(&w, LOG_REC_EVENT, t, &ev, sizeof(ev));
+      apogee = true;
+    }
+    if (t >= next_second) {
+      // Once a second : TIMING, a TIMESYNC for the PPS edge a little before (older stamp), sync.
+      LOG_Timing_t tm = {};
+      bench_record(&w, LOG_REC_TIMING, t, &tm, sizeof(tm));
+      LOG_TimeSync_t ts = {};
+      bench_record(&w, LOG_REC_TIMESYNC, next_second - 700000, &ts, sizeof(ts));
+      bench_flush(&w);
+      next_second += 1000000;
+    }
+  }
+  bench_flush(&w);
+  *t_end = t_start + duration;
+  fclose(w.log);
+  fclose(w.index);
+  return true;
+}
+
+
+// What every extract must return : the records of a full parse in range, in file order.
+static void reference_range(const std::vector<uint8_t> &log, uint64_t t0, uint64_t t1, std::vector<uint8_t> *out) {
+  out->clear();
+  for (size_t pos = 0; pos < log.size();) {
+    LOG_Record_t rec;
+    LOG_Status_t st = LOG_decode(log.data() + pos, log.size() - pos, &rec);
+    if (st == LOG_NEED_MORE) break;
+    if (st == LOG_BAD_RECORD) {
+      pos++;
+      continue;
+    }
+    if (rec.t_us >= t0 && rec.t_us <= t1) append_record(out, rec);
+    pos += rec.size;
+  }
+}
+
+
+static void print_row(const char *what, SeekMode_t mode, double seconds, const ExtractStats_t &st, int n,
+                      bool exact) {
+  printf("| %-22s | %-6s | %10.3f | %12.1f | %7.1f | %8zu | %-5s |\n", what, SEEK_NAMES[mode], seconds / n * 1e3,
+         (double)st.bytes / 1e3, (double)st.lookups, st.records, exact ? "exact" : "FAIL");
+}
+
+
+static int bench_pass(const char *log_path, const char *index_path, uint64_t t_first, uint64_t t_last,
+                      std::mt19937 &rng) {
+  std::vector<uint8_t> log, got, ref;
+  LOGREAD_load_file(log_path, log);
+  int failures = 0;
+
+  printf("| Extract                | Seek   | Time (ms)  | Read (kB)    | pread() | Records  | Check |\n");
+  printf("| ---------------------- | ------ | ---------- | ------------ | ------- | -------- | ----- |\n");
+  for (int m = SEEK_SCAN; m <= SEEK_INDEX; m++) {
+    ExtractStats_t st;
+    uint64_t t_apogee = 0;
+    auto start = std::chrono::steady_clock::now();
+    bool found = extract_event(log_path, index_path, (SeekMode_t)m, LOG_EVENT_APOGEE, BENCH_SPAN_US / 2,
+                               BENCH_SPAN_US / 2, &got, &st, &t_apogee);
+    double s = seconds_since(start);
+    if (found) reference_range(log, t_apogee - BENCH_SPAN_US / 2, t_apogee + BENCH_SPAN_US / 2, &ref);
+    bool exact = found && got == ref && !got.empty();
+    failures += !exact;
+    print_row("2 s around apogee", (SeekMode_t)m, s, st, 1, exact);
+  }
+
+  // Random ranges, the same ones for every mode.
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  std::vector<uint64_t> t0s(BENCH_QUERIES);
+  std::vector<std::vector<uint8_t>> refs(BENCH_QUERIES);
+  for (int q = 0; q < BENCH_QUERIES; q++) {
+    t0s[q] = t_first + (uint64_t)(u(rng) * (double)(t_last - t_first - BENCH_SPAN_US));
+    reference_range(log, t0s[q], t0s[q] + BENCH_SPAN_US, &refs[q]);
+  }
+  for (int m = SEEK_SCAN; m <= SEEK_INDEX; m++) {
+    ExtractStats_t st, total = {};
+    double s = 0.0;
+    bool exact = true;
+    for (int q = 0; q < BENCH_QUERIES; q++) {
+      auto start = std::chrono::steady_clock::now();
+      extract_time(log_path, index_path, (SeekMode_t)m, t0s[q], t0s[q] + BENCH_SPAN_US, &got, &st);
+      s += seconds_since(start);
+      exact = exact && got == refs[q] && !got.empty();
+      total.bytes += st.bytes;
+      total.lookups += st.lookups;
+      total.records += st.records;
+    }
+    failures += !exact;
+    total.bytes /= BENCH_QUERIES;
+    total.lookups /= BENCH_QUERIES;
+    total.records /= BENCH_QUERIES;
+    print_row("random 2 s ranges", (SeekMode_t)m, s, total, BENCH_QUERIES, exact);
+  }
+  return failures;
+}
+
+
+static int run_bench(double minutes, const char *tmp_dir) {
+  char log_path[512], index_path[512];
+  snprintf(log_path, sizeof(log_path), "%s/log_extract.%d.bin", tmp_dir, (int)getpid());
+  snprintf(index_path, sizeof(index_path), "%s/log_extract.%d.idx", tmp_dir, (int)getpid());
+  uint64_t t_launch, t_end;
+  if (!bench_write_log(log_path, index_path, minutes, &t_launch, &t_end)) {
+    perror(tmp_dir);
+    return 1;
+  }
+  LogIndex_t x;
+  LOGINDEX_open(&x, log_path, index_path);
+  printf("%.0f min synthetic log : %.1f MB, index %zu entries (%.1f kB)\n\n", minutes, x.log_size / 1e6, x.entries,
+         x.entries * sizeof(LOG_IndexEntry_t) / 1e3);
+  LOGINDEX_close(&x);
+
+  std::mt19937 rng(1038);
+  int failures = bench_pass(log_path, index_path, 2000000, t_end, rng);
+
+  // Card pulled during the flight : log cut mid record ~half way through the
+  // boost-to-apogee interval, index carries entries past it and a torn one.
+  LogIndex_t full;
+  LOGINDEX_open(&full, log_path, index_path);
+  uint64_t cut = LOGINDEX_seek_time(&full, t_launch + BENCH_APOGEE_AFTER_US + 3 * LOG_INDEX_SLACK_US) + 1234;
+  LOGINDEX_close(&full);
+  if (truncate(log_path, (off_t)cut) != 0) {
+    perror(log_path);
+    return 1;
+  }
+  FILE *f = fopen(index_path, "ab");
+  uint8_t torn[9] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99 };
+  fwrite(torn, 1, sizeof(torn), f);
+  fclose(f);
+  LOGINDEX_open(&x, log_path, index_path);
+  printf("\nTruncated to %.1f MB, torn index entry appended : %zu entries usable, %zu dropped (%zu pread)\n\n",
+         x.log_size / 1e6, x.entries, x.dropped, x.reads);
+  uint64_t t_cut = t_launch + BENCH_APOGEE_AFTER_US + 3 * LOG_INDEX_SLACK_US;
+  LOGINDEX_close(&x);
+  failures += bench_pass(log_path, index_path, 2000000, t_cut - 2 * LOG_INDEX_SLACK_US, rng);
+
+  remove(log_path);
+  remove(index_path);
+  printf("\n%s\n", failures ? "FAIL" : "all extracts exact");
+  return failures ? 1 : 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------------------------------
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s <SENSOR_DATA.bin> <out.bin> --from S --to S [--index PATH | --no-index]\n"
+          "       %s <SENSOR_DATA.bin> <out.bin> --event launch|apogee [--before S] [--after S] "
+          "[--index PATH | --no-index]\n"
+          "       %s --bench [minutes] [--tmp DIR]\n", prog, prog, prog);
+}
+
+
+int main(int argc, char **argv) {
+  const char *in_path = NULL;
+  const char *out_path = NULL;
+  const char *index_arg = NULL;
+  const char *event = NULL;
+  const char *tmp_dir = "/tmp";
+  double from_s = -1.0, to_s = -1.0, before_s = 1.0, after_s = 1.0;
+  bool no_index = false;
+  double bench = -1.0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--from") && i + 1 < argc) from_s = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--to") && i + 1 < argc) to_s = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--event") && i + 1 < argc) event = argv[++i];
+    else if (!strcmp(argv[i], "--before") && i + 1 < argc) before_s = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--after") && i + 1 < argc) after_s = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--index") && i + 1 < argc) index_arg = argv[++i];
+    else if (!strcmp(argv[i], "--no-index")) no_index = true;
+    else if (!strcmp(argv[i], "--tmp") && i + 1 < argc) tmp_dir = argv[++i];
+    else if (!strcmp(argv[i], "--bench")) {
+      bench = 60.0;
+      if (i + 1 < argc && argv[i + 1][0] != '-') bench = atof(argv[++i]);
+    }
+    else if (!in_path) in_path = argv[i];
+    else if (!out_path) out_path = argv[i];
+    else { usage(argv[0]); return 1; }
+  }
+  if (bench > 0.0) {
+    return run_bench(bench, tmp_dir);
+  }
+  uint8_t event_id = 0;
+  if (event) {
+    if (!strcmp(event, "launch")) event_id = LOG_EVENT_LAUNCH;
+    else if (!strcmp(event, "apogee")) event_id = LOG_EVENT_APOGEE;
+  }
+  if (!in_path || !out_path || (event ? event_id == 0 : (from_s < 0.0 || to_s < from_s))) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // Default index : the log path with .idx for its extension.
+  std::string index_path;
+  if (index_arg) {
+    index_path = index_arg;
+  } else {
+    index_path = in_path;
+    size_t dot = index_path.find_last_of('.');
+    size_t slash = index_path.find_last_of('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) index_path.resize(dot);
+    index_path += ".idx";
+  }
+  bool have_index = !no_index && access(index_path.c_str(), R_OK) == 0;
+  if (!no_index && !have_index) fprintf(stderr, "%s : no index, bisecting the log\n", index_path.c_str());
+  SeekMode_t mode = have_index ? SEEK_INDEX : SEEK_BISECT;
+
+  std::vector<uint8_t> out;
+  ExtractStats_t st;
+  auto start = std::chrono::steady_clock::now();
+  if (event) {
+    uint64_t t_event;
+    if (!extract_event(in_path, index_path.c_str(), mode, event_id, (uint64_t)(before_s * 1e6),
+                       (uint64_t)(after_s * 1e6), &out, &st, &t_event)) {
+      fprintf(stderr, "%s : no %s event\n", in_path, event);
+      return 1;
+    }
+    printf("%s at %.6f s\n", event, t_event * 1e-6);
+  } else if (!extract_time(in_path, index_path.c_str(), mode, (uint64_t)(from_s * 1e6), (uint64_t)(to_s * 1e6),
+                           &out, &st)) {
+    perror(in_path);
+    return 1;
+  }
+  double s = seconds_since(start);
+
+  FILE *f = fopen(out_path, "wb");
+  if (!f || fwrite(out.data(), 1, out.size(), f) != out.size()) {
+    perror(out_path);
+    return 1;
+  }
+  fclose(f);
+  printf("%zu records (%.1f kB) to %s : %s seek, read from offset %llu, %.1f kB decoded, %.3f ms\n", st.records,
+         out.size() / 1e3, out_path, SEEK_NAMES[mode], (unsigned long long)st.start, st.bytes / 1e3, s * 1e3);
+  return 0;
+}
@@ -0,0 +1,803 @@
+/**
+ * @file log_merge.cpp
+ * @brief Merge the copies of a flight log written to several destinations, and simulate writing them.
+ *
+ * The flight computer hands every block of its record stream to each log
+ * destination (SD journal, flash ring) through that destination's own
+ * buffers and writer task (lib/LogSink). Each block is one journal slot and
+ * starts with a BLOCK record : a boot id picked at random at power on and a
+ * block number counting from 0. A destination that stalls or fails loses
+ * blocks of its own copy only, so the copies of a flight differ : the SD
+ * journal misses what was written while the card did not answer, the flash
+ * ring misses what it has written over since.
+ *
+ * Merge : log_merge <out.bin> <copy> <copy> [...]
+ *
+ *   Each copy is a journal file (SENSOR_DATA.bin) or a raw dump of the
+ *   flash ring partition, told apart by their first slot. Slots are keyed by
+ *   (boot, block) and every block found in any copy is kept once, the first
+ *   copy on the command line winning when two copies hold a block. Copies of
+ *   a block that differ are counted (they should not). Boots are taken in
+ *   the order the copies hold them. The merged log is a journal file again,
+ *   slots renumbered, one session per boot, readable by every other tool.
+ *   Per boot, the blocks found in every copy, in one copy only and in none
+ *   (gaps no copy can fill) are printed.
+ *
+ * Simulation : log_merge --sim [--minutes N] [--keep <dir>]
+ *
+ *   A flight at 800 Hz logged to both destinations : the SD journal (raw
+ *   slots, common/mock_sd.h SPI timing) and the flash ring on the partition
+ *   of partitions.csv (common/mock_flash.h), each block pushed to a SINK_t of
+ *   SINK_BLOCKS buffers and written by its own consumer whenever the
+ *   previous write has finished, times from the storage models. Scenarios :
+ *
+ *   - nominal : the ring wraps in a 10 min flight, its copy misses the start.
+ *   - an SD card outage : no write completes for OUTAGE_S, each one failing
+ *     after SD_TIMEOUT_US.
+ *   - no runway : the flash sectors are not erased ahead before launch,
+ *     every flash write erases its sector first. The loop only sees the
+ *     flash queue; on the internal flash each of those erases also stops
+ *     both cores and the sampling tasks, which this model leaves out.
+ *   - both, and an outage early enough for the ring to have written over
+ *     the flash copy of it (the one case the merge cannot fill).
+ *
+ *   For each, the health of each destination (the SINK record the firmware
+ *   logs), the ACCEL samples each copy holds, and the merge of the two copies
+ *   : every sample must appear in it once and in order when either copy has
+ *   it. The same flight with the writes inline in the logging loop (how the
+ *   firmware wrote before lib/LogSink) gives the loop stall and the samples
+ *   dropped on a full SAMPLE_QUEUE_LEN queue for comparison. A sweep of the
+ *   buffers per destination shows what the pool depth buys. --keep writes
+ *   the two copies of the SD outage flight to <dir> (SENSOR_DATA.bin and
+ *   flightlog.bin, the partition dump) to try the merge on.
+ *
+ * Usage :
+ *   log_merge <out.bin> <copy> <copy> [...]
+ *   log_merge --sim [--minutes N] [--keep <dir>]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "flight_log.h"
+#include "flash_ring.h"
+#include "log_journal.h"
+#include "log_sink.h"
+#include "mock_flash.h"
+#include "mock_sd.h"
+
+
+#define FLASH_PARTITION_BYTES 0xCF0000 // partitions.csv, flightlog
+#define FLASH_RUNWAY_SLOTS 1280       // main.cpp
+#define SINK_BLOCKS 8                 // main.cpp, LOG_SINK_BLOCKS
+#define SAMPLE_QUEUE_LEN 512          // main.cpp
+#define SIM_CARD_MB 1024              // Mock card holding the journal
+#define SD_TIMEOUT_US 1000000.0       // A write to a card that stopped answering fails after this (assumed)
+#define OUTAGE_S 30.0
+#define ACCEL_HZ 800
+
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Copies
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  std::string name;
+  bool ring;                  // Flash ring dump, else journal
+  std::vector<uint8_t> slots; // LOG_SLOT_SIZE each, in the copy's order
+  uint32_t n;
+} Copy_t;
+
+
+static bool read_mem_slot(void *ctx, uint32_t slot, uint8_t *buf) {
+  const std::vector<uint8_t> *bytes = (const std::vector<uint8_t> *)ctx;
+  if ((uint64_t)(slot + 1) * LOG_SLOT_SIZE > bytes->size()) {
+    return false;
+  }
+  memcpy(buf, bytes->data() + (size_t)slot * LOG_SLOT_SIZE, LOG_SLOT_SIZE);
+  return true;
+}
+
+
+// The valid slots of a journal file (a prefix) or of a flash ring dump (first
+// to next - 1). A ring that has not wrapped yet reads the same either way; one
+// that has starts anywhere, so whichever reading finds more slots is kept.
+static bool copy_from_bytes(Copy_t *copy, std::vector<uint8_t> &bytes) {
+  static uint8_t slot[LOG_SLOT_SIZE];
+  LOG_Commit_t c;
+  copy->slots.clear();
+  copy->n = 0;
+  if (bytes.size() < LOG_SLOT_SIZE) {
+    return false;
+  }
+  uint32_t journal = 0;
+  if (LOG_slot_check(bytes.data(), &c) && c.seq == 0) {
+    journal = LOG_journal_scan(read_mem_slot, &bytes, (uint32_t)(bytes.size() / LOG_SLOT_SIZE), slot, &c, NULL);
+  }
+
+  static MockFlash_t flash;
+  MOCKFLASH_init(&flash, (uint32_t)bytes.size(), &MOCKFLASH_QSPI_NOR);
+  memcpy(flash.mem.data(), bytes.data(), flash.size);
+  static FRING_t r;
+  FRING_Recovery_t rec;
+  FRING_Io_t io = MOCKFLASH_ring_io(&flash);
+  if (FRING_open(&r, &io, 0, &rec) && rec.slots > journal) {
+    copy->ring = true;
+    for (uint32_t seq = r.first; seq < r.next; seq++) {
+      if (FRING_read(&r, seq, slot)) {
+        copy->slots.insert(copy->slots.end(), slot, slot + LOG_SLOT_SIZE);
+        copy->n++;
+      }
+    }
+    return copy->n > 0;
+  }
+  copy->ring = false;
+  copy->slots.assign(bytes.begin(), bytes.begin() + (size_t)journal * LOG_SLOT_SIZE);
+  copy->n = journal;
+  return journal > 0;
+}
+
+
+static bool copy_load(Copy_t *copy, const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  std::vector<uint8_t> bytes((size_t)std::max(size, 0L));
+  size_t got = fread(bytes.data(), 1, bytes.size(), f);
+  fclose(f);
+  copy->name = path;
+  if (got != bytes.size() || !copy_from_bytes(copy, bytes)) {
+    fprintf(stderr, "%s : no journal or flash ring slot\n", path);
+    return false;
+  }
+  return true;
+}
+
+
+// The BLOCK record a slot starts with.
+static bool slot_block(const uint8_t *slot, LOG_Block_t *id, uint16_t *used) {
+  LOG_Commit_t c;
+  LOG_Record_t rec;
+  if (!LOG_slot_check(slot, &c) || LOG_decode(slot, c.used, &rec) != LOG_OK ||
+      rec.type != LOG_REC_BLOCK || rec.len != sizeof(LOG_Block_t)) {
+    return false;
+  }
+  memcpy(id, rec.payload, sizeof(*id));
+  *used = c.used;
+  return true;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Merge
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  const uint8_t *slot;        // From the first copy holding the block
+  uint16_t used;
+  uint32_t copies;            // Bit per copy holding it
+} Block_t;
+
+typedef struct {
+  std::vector<uint32_t> boots;                          // In flight order
+  std::map<uint32_t, std::map<uint32_t, Block_t>> blocks;  // boot, block number
+  std::vector<uint32_t> unkeyed;                        // Per copy, slots without a BLOCK record
+  uint32_t conflicts;                                   // Blocks whose copies differ
+} Merge_t;
+
+
+static void merge(const std::vector<Copy_t> &copies, Merge_t *m) {
+  m->boots.clear();
+  m->blocks.clear();
+  m->unkeyed.assign(copies.size(), 0);
+  m->conflicts = 0;
+  for (size_t k = 0; k < copies.size(); k++) {
+    const Copy_t &copy = copies[k];
+    // A boot this copy holds and the merge does not yet goes after the boot
+    // this copy held before it.
+    int after = -1;
+    uint32_t boot = 0;
+    bool any = false;
+    for (uint32_t i = 0; i < copy.n; i++) {
+      const uint8_t *slot = copy.slots.data() + (size_t)i * LOG_SLOT_SIZE;
+      LOG_Block_t id;
+      uint16_t used;
+      if (!slot_block(slot, &id, &used)) {
+        m->unkeyed[k]++;
+        continue;
+      }
+      if (!any || id.boot != boot) {
+        std::vector<uint32_t>::iterator it = std::find(m->boots.begin(), m->boots.end(), id.boot);
+        if (it == m->boots.end()) {
+          it = m->boots.insert(m->boots.begin() + (after + 1), id.boot);
+        }
+        after = (int)(it - m->boots.begin());
+        boot = id.boot;
+        any = true;
+      }
+      std::map<uint32_t, Block_t> &blocks = m->blocks[id.boot];
+      std::map<uint32_t, Block_t>::iterator b = blocks.find(id.block);
+      if (b == blocks.end()) {
+        Block_t nb = { slot, used, 1u << k };
+        blocks[id.block] = nb;
+        continue;
+      }
+      if (b->second.used != used || memcmp(b->second.slot, slot, used) != 0) {
+        m->conflicts++;
+      }
+      b->second.copies |= 1u << k;
+    }
+  }
+}
+
+
+// One journal, slots renumbered, a session per boot.
+static uint32_t merge_slots(const Merge_t *m, uint32_t generation, std::vector<uint8_t> *out) {
+  uint8_t slot[LOG_SLOT_SIZE];
+  uint32_t seq = 0;
+  out->clear();
+  for (size_t i = 0; i < m->boots.size(); i++) {
+    const std::map<uint32_t, Block_t> &blocks = m->blocks.at(m->boots[i]);
+    for (std::map<uint32_t, Block_t>::const_iterator b = blocks.begin(); b != blocks.end(); ++b) {
+      LOG_Commit_t c;
+      memcpy(slot, b->second.slot, LOG_SLOT_SIZE);
+      c.magic = LOG_JOURNAL_MAGIC;
+      c.generation = generation;
+      c.session = (uint32_t)i + 1;
+      c.seq = seq++;
+      LOG_slot_close(slot, b->second.used, &c);
+      out->insert(out->end(), slot, slot + LOG_SLOT_SIZE);
+    }
+  }
+  return seq;
+}
+
+
+static void merge_report(const std::vector<Copy_t> &copies, const Merge_t *m) {
+  uint32_t all = (1u << copies.size()) - 1;
+  for (size_t i = 0; i < m->boots.size(); i++) {
+    const std::map<uint32_t, Block_t> &blocks = m->blocks.at(m->boots[i]);
+    uint32_t every = 0, none = 0;
+    std::vector<uint32_t> only(copies.size(), 0);
+    uint32_t expect = 0;
+    for (std::map<uint32_t, Block_t>::const_iterator b = blocks.begin(); b != blocks.end(); ++b) {
+      none += b->first - expect;
+      expect = b->first + 1;
+      if (b->second.copies == all) every++;
+      for (size_t k = 0; k < copies.size(); k++) {
+        if (b->second.copies == 1u << k) only[k]++;
+      }
+    }
+    printf("boot %08x : blocks 0 to %u, %u in every copy", m->boots[i], expect - 1, every);
+    for (size_t k = 0; k < copies.size(); k++) {
+      printf(", %u only in %s", only[k], copies[k].name.c_str());
+    }
+    printf(", %u in none\n", none);
+  }
+  for (size_t k = 0; k < copies.size(); k++) {
+    if (m->unkeyed[k]) {
+      printf("%s : %u slots without a BLOCK record left out (logged before lib/LogSink?)\n", copies[k].name.c_str(),
+             m->unkeyed[k]);
+    }
+  }
+  if (m->conflicts) {
+    printf("%u blocks differ between copies, the first copy's kept\n", m->conflicts);
+  }
+}
+
+
+static int merge_files(const char *out_path, int n, char **paths) {
+  std::vector<Copy_t> copies((size_t)n);
+  if (n > 31) {
+    fprintf(stderr, "at most 31 copies\n");
+    return 1;
+  }
+  for (int k = 0; k < n; k++) {
+    if (!copy_load(&copies[k], paths[k])) {
+      return 1;
+    }
+    printf("%s : %s, %u slots\n", paths[k], copies[k].ring ? "flash ring dump" : "journal", copies[k].n);
+  }
+  Merge_t m;
+  merge(copies, &m);
+  if (m.boots.empty()) {
+    fprintf(stderr, "no slot starts with a BLOCK record, nothing to merge\n");
+    return 1;
+  }
+  LOG_Commit_t c;
+  LOG_slot_check(copies[0].slots.data(), &c);
+  std::vector<uint8_t> slots;
+  uint32_t written = merge_slots(&m, c.generation, &slots);
+  FILE *out = fopen(out_path, "wb");
+  if (!out || fwrite(slots.data(), 1, slots.size(), out) != slots.size()) {
+    fprintf(stderr, "cannot write %s\n", out_path);
+    if (out) fclose(out);
+    return 1;
+  }
+  fclose(out);
+  merge_report(copies, &m);
+  printf("%s : %u slots, %zu boots\n", out_path, written, m.boots.size());
+  return 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Simulation
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  const char *name;
+  double outage_at_s;         // SD card stops answering for OUTAGE_S, < 0 : never
+  uint32_t runway;            // Flash sectors erased ahead on the pad
+  bool complete;              // Every sample is expected in the merge
+} Scenario_t;
+
+typedef struct {
+  SINK_t sink;
+  std::vector<SINK_Block_t> pool;
+  bool active;                // A block is being written
+  bool written;
+  double done_us;             // End of the active write, or of the last one
+} Writer_t;
+
+typedef struct {
+  const Scenario_t *sc;
+  bool inline_writes;         // Writes in the logging loop, no sinks
+
+  MockSd_t sd;
+  JRNL_t journal;
+  MockFlash_t flash;
+  FRING_t ring;
+  Writer_t writers[2];        // SD, flash
+  SINK_Stage_t stage;
+
+  uint64_t counter;           // Next ACCEL counter
+  double busy_until_us;       // Inline : the loop is writing until then
+  std::deque<uint64_t> pending;  // Inline : ACCEL counters queued while the loop writes
+  uint64_t samples_lost;
+  double stall_max_us;
+} Sim_t;
+
+enum { SIM_SD = 0, SIM_FLASH = 1 };
+
+
+static double sd_write(Sim_t *s, const uint8_t *records, uint16_t used, double at_us, bool *ok) {
+  bool out = s->sc->outage_at_s >= 0.0 && at_us >= s->sc->outage_at_s * 1e6 &&
+             at_us < (s->sc->outage_at_s + OUTAGE_S) * 1e6;
+  if (out) {
+    s->sd.powered = false;
+  } else {
+    MOCKSD_power_on(&s->sd);
+  }
+  double clock0 = s->sd.clock_us;
+  *ok = JRNL_append_block(&s->journal, records, used) && JRNL_commit(&s->journal);
+  return *ok ? s->sd.clock_us - clock0 : SD_TIMEOUT_US;
+}
+
+
+static double flash_write(Sim_t *s, const uint8_t *records, uint16_t used, bool *ok) {
+  double clock0 = s->flash.clock_us;
+  *ok = FRING_append_block(&s->ring, records, used) && FRING_commit(&s->ring);
+  return s->flash.clock_us - clock0;
+}
+
+
+// Writer k works through its queue up to t_us : a write starts once the
+// previous one is done and the block is queued, the block is popped when it ends.
+static void writer_run(Sim_t *s, int k, double t_us) {
+  Writer_t *w = &s->writers[k];
+  for (;;) {
+    if (w->active) {
+      if (w->done_us > t_us) {
+        return;
+      }
+      SINK_pop(&w->sink, w->written, (int64_t)w->done_us);
+      w->active = false;
+    }
+    SINK_Block_t *b = SINK_peek(&w->sink);
+    if (!b) {
+      return;
+    }
+    double start = std::max(w->done_us, (double)b->queued_us);
+    if (start > t_us) {
+      return;
+    }
+    double dur = k == SIM_SD ? sd_write(s, b->data, b->used, start, &w->written)
+                             : flash_write(s, b->data, b->used, &w->written);
+    w->done_us = start + dur;
+    w->active = true;
+  }
+}
+
+
+// The staged block to every destination : queued, or written right here inline.
+static void sim_flush(Sim_t *s, double t_us) {
+  if (s->stage.used == 0) {
+    return;
+  }
+  if (s->inline_writes) {
+    bool ok;
+    double dur = sd_write(s, s->stage.data, (uint16_t)s->stage.used, t_us, &ok);
+    dur += flash_write(s, s->stage.data, (uint16_t)s->stage.used, &ok);
+    s->busy_until_us = t_us + dur;
+    s->stall_max_us = std::max(s->stall_max_us, dur);
+  } else {
+    for (int k = 0; k < 2; k++) {
+      writer_run(s, k, t_us);
+      SINK_push(&s->writers[k].sink, s->stage.data, (uint16_t)s->stage.used, false, (int64_t)t_us);
+    }
+  }
+  SINK_stage_next(&s->stage);
+}
+
+
+static void sim_record(Sim_t *s, double t_us, uint8_t type, const void *payload, uint16_t len) {
+  if (!SINK_stage_add(&s->stage, type, (uint64_t)t_us, payload, len)) {
+    sim_flush(s, t_us);
+    SINK_stage_add(&s->stage, type, (uint64_t)t_us, payload, len);
+  }
+}
+
+
+static void sim_accel(Sim_t *s, double t_us, uint64_t counter, uint32_t *state_div) {
+  static const uint8_t zeros[sizeof(LOG_State_t)] = { 0 };
+  LOG_Accel_t a;
+  memcpy(a.acc_raw, &counter, sizeof(a.acc_raw));
+  sim_record(s, t_us, LOG_REC_ACCEL, &a, sizeof(a));
+  if (++*state_div == 8) {
+    sim_record(s, t_us, LOG_REC_STATE, zeros, sizeof(LOG_State_t));
+    *state_div = 0;
+  }
+}
+
+
+// Inline : the loop takes the samples queued while it was writing, at the
+// time its write ends; a sample finding SAMPLE_QUEUE_LEN queued is lost.
+static void sim_catch_up(Sim_t *s, double t_us, uint32_t *state_div) {
+  while (!s->pending.empty() && s->busy_until_us <= t_us) {
+    uint64_t c = s->pending.front();
+    s->pending.pop_front();
+    sim_accel(s, s->busy_until_us, c, state_div);
+  }
+}
+
+
+static void sim_fly(Sim_t *s, double seconds) {
+  static const uint8_t zeros[sizeof(LOG_Spectrum_t)] = { 0 };
+  double end = seconds * 1e6, period = 1e6 / ACCEL_HZ;
+  double next_accel = 0.0, next_baro = 0.0, next_second = 1e6;
+  uint32_t state_div = 0;
+  while (next_accel < end) {
+    double t = std::min(next_accel, std::min(next_baro, next_second));
+    if (s->inline_writes) {
+      sim_catch_up(s, t, &state_div);
+    }
+    bool busy = s->inline_writes && s->busy_until_us > t;
+    if (t == next_accel) {
+      uint64_t c = s->counter++;
+      if (!busy) {
+        sim_accel(s, t, c, &state_div);
+      } else if (s->pending.size() < SAMPLE_QUEUE_LEN) {
+        s->pending.push_back(c);
+      } else {
+        s->samples_lost++;
+      }
+      next_accel += period;
+    } else if (t == next_baro) {
+      if (!busy) sim_record(s, t, LOG_REC_BARO, zeros, sizeof(LOG_Baro_t));
+      next_baro += 20000.0;
+    } else {
+      if (!busy) {
+        sim_record(s, t, LOG_REC_TIMING, zeros, sizeof(LOG_Timing_t));
+        sim_record(s, t, LOG_REC_TIMING, zeros, sizeof(LOG_Timing_t));
+        sim_record(s, t, LOG_REC_SPECTRUM, zeros, sizeof(LOG_Spectrum_t));
+        for (int k = 0; k < 2; k++) {
+          sim_record(s, t, LOG_REC_STORAGE, zeros, sizeof(LOG_Storage_t));
+          sim_record(s, t, LOG_REC_SINK, zeros, sizeof(LOG_Sink_t));
+        }
+        sim_flush(s, t);
+      }
+      next_second += 1e6;
+    }
+  }
+  if (s->inline_writes) {
+    sim_catch_up(s, 1e300, &state_div);
+  }
+  sim_flush(s, end);
+  for (int k = 0; k < 2; k++) {
+    writer_run(s, k, 1e300);
+  }
+}
+
+
+static void sim_init(Sim_t *s, const Scenario_t *sc, bool inline_writes, uint32_t blocks) {
+  s->sc = sc;
+  s->inline_writes = inline_writes;
+  MOCKSD_init(&s->sd, (uint64_t)SIM_CARD_MB << 20, &MOCKSD_SPI_20MHZ);
+  JRNL_Io_t jio = MOCKSD_journal_io(&s->sd);
+  JRNL_Recovery_t jrec;
+  JRNL_open(&s->journal, &jio, 0x53445344u, &jrec);
+
+  // A partition written over before : every sector must be erased again.
+  MOCKFLASH_init(&s->flash, FLASH_PARTITION_BYTES, &MOCKFLASH_QSPI_NOR);
+  memset(s->flash.mem.data(), 0, s->flash.size);
+  FRING_Io_t fio = MOCKFLASH_ring_io(&s->flash);
+  FRING_Recovery_t frec;
+  FRING_open(&s->ring, &fio, 0x464C5348u, &frec);
+  while (FRING_service(&s->ring, sc->runway)) {
+  }
+
+  static const uint8_t paths[2] = { LOG_STORAGE_RAW, LOG_STORAGE_FLASH };
+  for (int k = 0; k < 2; k++) {
+    Writer_t *w = &s->writers[k];
+    w->pool.assign(blocks, SINK_Block_t());
+    SINK_init(&w->sink, w->pool.data(), blocks, paths[k]);
+    w->active = false;
+    w->done_us = 0.0;
+  }
+  SINK_stage_init(&s->stage, 0x0B0075EDu);
+  s->counter = 0;
+  s->busy_until_us = 0.0;
+  s->pending.clear();
+  s->samples_lost = 0;
+  s->stall_max_us = 0.0;
+}
+
+
+static void sim_copies(Sim_t *s, std::vector<Copy_t> *copies) {
+  static uint8_t slot[LOG_SLOT_SIZE];
+  copies->assign(2, Copy_t());
+  Copy_t *sd = &(*copies)[SIM_SD], *fl = &(*copies)[SIM_FLASH];
+  sd->name = "SD";
+  sd->ring = false;
+  sd->n = s->journal.next;
+  sd->slots.resize((size_t)sd->n * LOG_SLOT_SIZE);
+  MOCKSD_power_on(&s->sd);
+  MOCKSD_read(&s->sd, 0, sd->slots.data(), sd->slots.size());
+  fl->name = "flash";
+  fl->ring = true;
+  fl->n = 0;
+  for (uint32_t seq = s->ring.first; seq < s->ring.next; seq++) {
+    if (FRING_read(&s->ring, seq, slot)) {
+      fl->slots.insert(fl->slots.end(), slot, slot + LOG_SLOT_SIZE);
+      fl->n++;
+    }
+  }
+}
+
+
+// Marks the ACCEL counters of a run of slots in have; false if they are not in order.
+static bool accel_counters(const uint8_t *slots, uint32_t n, std::vector<uint8_t> *have, uint64_t *count) {
+  bool started = false;
+  uint64_t last = 0;
+  *count = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    const uint8_t *slot = slots + (size_t)i * LOG_SLOT_SIZE;
+    LOG_Commit_t c;
+    if (!LOG_slot_check(slot, &c)) {
+      return false;
+    }
+    size_t at = 0;
+    while (at < c.used) {
+      LOG_Record_t rec;
+      if (LOG_decode(slot + at, c.used - at, &rec) != LOG_OK) {
+        return false;
+      }
+      if (rec.type == LOG_REC_ACCEL) {
+        uint64_t counter = 0;
+        memcpy(&counter, rec.payload, sizeof(LOG_Accel_t));
+        if ((started && counter <= last) || counter >= have->size()) {
+          return false;
+        }
+        (*have)[counter] = 1;
+        (*count)++;
+        last = counter;
+        started = true;
+      }
+      at += rec.size;
+    }
+  }
+  return true;
+}
+
+
+typedef struct {
+  LOG_Sink_t health[2];
+  uint64_t samples;
+  uint64_t held[2];           // ACCEL samples in each copy
+  uint64_t merged;
+  uint64_t in_both, sd_only, flash_only, in_none;
+  uint32_t conflicts;
+  bool ok;
+} SimResult_t;
+
+
+// The journal and the raw flash partition of a simulated flight, as read off the flight computer.
+static bool sim_keep(Sim_t *s, const char *dir) {
+  char path[512];
+  std::vector<uint8_t> journal((size_t)s->journal.next * LOG_SLOT_SIZE);
+  MOCKSD_power_on(&s->sd);
+  MOCKSD_read(&s->sd, 0, journal.data(), journal.size());
+  snprintf(path, sizeof(path), "%s/SENSOR_DATA.bin", dir);
+  FILE *f = fopen(path, "wb");
+  bool ok = f && fwrite(journal.data(), 1, journal.size(), f) == journal.size();
+  if (f) fclose(f);
+  snprintf(path, sizeof(path), "%s/flightlog.bin", dir);
+  f = fopen(path, "wb");
+  ok = ok && f && fwrite(s->flash.mem.data(), 1, s->flash.size, f) == s->flash.size;
+  if (f) fclose(f);
+  return ok;
+}
+
+
+static void sim_run(const Scenario_t *sc, uint32_t blocks, double minutes, const char *keep, SimResult_t *res) {
+  static Sim_t s;
+  sim_init(&s, sc, false, blocks);
+  sim_fly(&s, minutes * 60.0);
+  if (keep && !sim_keep(&s, keep)) {
+    fprintf(stderr, "cannot write the copies to %s\n", keep);
+  }
+  for (int k = 0; k < 2; k++) {
+    SINK_health(&s.writers[k].sink, &res->health[k]);
+  }
+  res->samples = s.counter;
+
+  std::vector<Copy_t> copies;
+  sim_copies(&s, &copies);
+  std::vector<uint8_t> have[2];
+  bool ok = true;
+  for (int k = 0; k < 2; k++) {
+    have[k].assign(s.counter, 0);
+    ok = accel_counters(copies[k].slots.data(), copies[k].n, &have[k], &res->held[k]) && ok;
+  }
+  Merge_t m;
+  merge(copies, &m);
+  std::vector<uint8_t> merged_slots;
+  uint32_t n = merge_slots(&m, s.journal.generation, &merged_slots);
+  std::vector<uint8_t> have_merged(s.counter, 0);
+  ok = accel_counters(merged_slots.data(), n, &have_merged, &res->merged) && ok;
+  res->in_both = res->sd_only = res->flash_only = res->in_none = 0;
+  for (uint64_t c = 0; c < s.counter; c++) {
+    bool a = have[SIM_SD][c], b = have[SIM_FLASH][c];
+    res->in_both += a && b;
+    res->sd_only += a && !b;
+    res->flash_only += !a && b;
+    res->in_none += !a && !b;
+    ok = ok && have_merged[c] == (a || b);
+  }
+  res->conflicts = m.conflicts;
+  res->ok = ok && m.conflicts == 0 && m.boots.size() == 1 && (!sc->complete || res->in_none == 0);
+}
+
+
+// The same flight written inline in the logging loop.
+static void sim_run_inline(const Scenario_t *sc, double minutes, double *stall_max_ms, uint64_t *lost) {
+  static Sim_t s;
+  sim_init(&s, sc, true, 1);
+  sim_fly(&s, minutes * 60.0);
+  *stall_max_ms = s.stall_max_us * 1e-3;
+  *lost = s.samples_lost;
+}
+
+
+static double pct(uint64_t n, uint64_t of) {
+  return of ? 100.0 * (double)n / (double)of : 0.0;
+}
+
+
+static int simulate(double minutes, const char *keep) {
+  static const Scenario_t scenarios[] = {
+    { "nominal", -1.0, FLASH_RUNWAY_SLOTS, true },
+    { "SD outage at 2 min", 120.0, FLASH_RUNWAY_SLOTS, true },
+    { "no flash runway", -1.0, 0, true },
+    { "SD outage at 2 min, no flash runway", 120.0, 0, true },
+    { "SD outage at 30 s", 30.0, FLASH_RUNWAY_SLOTS, false },
+  };
+  const size_t n_sc = sizeof(scenarios) / sizeof(scenarios[0]);
+  static const char *dest[2] = { "SD", "flash" };
+  bool all_ok = true;
+  std::vector<SimResult_t> results(n_sc);
+
+  printf("%.0f min flight at %d Hz, %d buffers per destination, SD outages of %.0f s\n\n", minutes, ACCEL_HZ,
+         SINK_BLOCKS, OUTAGE_S);
+  printf("| Scenario                            | Destination | Blocks | Written | Dropped (queue full) | Failed "
+         "| Deepest queue | Longest wait (ms) | ACCEL kept |\n");
+  printf("|-------------------------------------|-------------|--------|---------|----------------------|--------"
+         "|---------------|-------------------|------------|\n");
+  for (size_t i = 0; i < n_sc; i++) {
+    SimResult_t *r = &results[i];
+    sim_run(&scenarios[i], SINK_BLOCKS, minutes, i == 1 ? keep : NULL, r);
+    for (int k = 0; k < 2; k++) {
+      const LOG_Sink_t *h = &r->health[k];
+      printf("| %-35s | %-11s | %6u | %7u | %20u | %6u | %13u | %17.1f | %8.1f %% |\n", k ? "" : scenarios[i].name,
+             dest[k], h->blocks, h->written, h->overruns, h->write_errors, h->queue_max, h->wait_max_us * 1e-3,
+             pct(r->held[k], r->samples));
+    }
+  }
+
+  printf("\n| Scenario                            | In both | SD only | Flash only | In neither | Merged ACCEL "
+         "| Merge | Inline : worst loop stall (ms) | Inline : samples lost |\n");
+  printf("|-------------------------------------|---------|---------|------------|------------|--------------"
+         "|-------|--------------------------------|-----------------------|\n");
+  for (size_t i = 0; i < n_sc; i++) {
+    SimResult_t *r = &results[i];
+    double stall_ms;
+    uint64_t lost;
+    sim_run_inline(&scenarios[i], minutes, &stall_ms, &lost);
+    printf("| %-35s | %7llu | %7llu | %10llu | %10llu | %10.2f %% | %-5s | %30.1f | %21llu |\n", scenarios[i].name,
+           (unsigned long long)r->in_both, (unsigned long long)r->sd_only, (unsigned long long)r->flash_only,
+           (unsigned long long)r->in_none, pct(r->merged, r->samples), r->ok ? "ok" : "FAIL", stall_ms,
+           (unsigned long long)lost);
+    all_ok = all_ok && r->ok;
+  }
+
+  static const uint32_t depths[] = { 2, 4, 8, 16 };
+  const Scenario_t *sweep = &scenarios[3];
+  printf("\n%s, buffers per destination :\n\n", sweep->name);
+  printf("| Buffers | SD : dropped | SD : deepest | Flash : dropped | Flash : deepest | Flash : longest wait (ms) "
+         "| Buffer RAM |\n");
+  printf("|---------|--------------|--------------|-----------------|-----------------|--------------------------"
+         "|------------|\n");
+  for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+    SimResult_t r;
+    sim_run(sweep, depths[i], minutes, NULL, &r);
+    printf("| %7u | %12u | %12u | %15u | %15u | %24.1f | %7.0f kB |\n", depths[i], r.health[SIM_SD].overruns,
+           r.health[SIM_SD].queue_max, r.health[SIM_FLASH].overruns, r.health[SIM_FLASH].queue_max,
+           r.health[SIM_FLASH].wait_max_us * 1e-3, 2.0 * depths[i] * sizeof(SINK_Block_t) / 1024.0);
+    all_ok = all_ok && r.ok;
+  }
+  return all_ok ? 0 : 1;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------------------------------
+static void usage(void) {
+  fprintf(stderr,
+          "usage : log_merge <out.bin> <copy> <copy> [...]\n"
+          "        log_merge --sim [--minutes N] [--keep <dir>]\n"
+          "  copy : a journal file (SENSOR_DATA.bin) or a dump of the flash ring partition\n");
+}
+
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && strcmp(argv[1], "--sim") == 0) {
+    double minutes = 10.0;
+    const char *keep = NULL;
+    for (int i = 2; i < argc; i++) {
+      if (strcmp(argv[i], "--minutes") == 0 && i + 1 < argc) {
+        minutes = atof(argv[++i]);
+      } else if (strcmp(argv[i], "--keep") == 0 && i + 1 < argc) {
+        keep = argv[++i];
+      } else {
+        usage();
+        return 1;
+      }
+    }
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    int rc = simulate(minutes, keep);
+    printf("\n%s (%.1f s)\n", rc == 0 ? "ok" : "FAIL", seconds_since(t0));
+    return rc;
+  }
+  if (argc < 4) {
+    usage();
+    return 1;
+  }
+  return merge_files(argv[1], argc - 2, argv + 2);
+}
@@ -0,0 +1,293 @@
+/**
+ * @file log_preview.cpp
+ * @brief Inspect and query the preview sidecar log_decode writes next to a log.
+ *
+ * Without --channel, lists the channels of the sidecar with their levels; with
+ * --log it also checks the sidecar still matches the log (size and hash).
+ *
+ * With --channel, writes the points a plot of [--from, --to] (seconds from the
+ * first sample of the channel) needs at --points resolution, from the finest
+ * level that fits (common/preview.h), as CSV :
+ *
+ *   t_us, t_pick_us, pick, min, max, count
+ *
+ * Draw min .. max as a band and (t_pick_us, pick) as the line. Level 0 rows
+ * are raw samples.
+ *
+ * --bench [Msamples] builds the pyramid of three synthetic channels (noise,
+ * chirp and isolated spikes) and times queries at zoom spans from the whole
+ * log down to a few samples, against the same plot made from the raw samples
+ * (min / max per pixel column, O(samples in range)). Every query checks the
+ * envelope it returns against the raw minimum and maximum of the range.
+ *
+ * Usage :
+ *   log_preview <log.preview> [--log SENSOR_DATA.bin]
+ *   log_preview <log.preview> --channel NAME [--from S] [--to S] [--points N] [out.csv]
+ *   log_preview --bench [Msamples] [--threads N] [--tmp DIR]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "log_reader.h"
+#include "parallel.h"
+#include "preview.h"
+
+
+#define DEFAULT_POINTS 2000
+
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+static int list_channels(const Preview_t &p, const char *log_path) {
+  printf("%u channels, factor %u, %zu bytes\n\n", p.header->channels, p.header->factor, p.size);
+  printf("| Channel         | Units | Samples  | Levels | Entries per level\n");
+  printf("| --------------- | ----- | -------- | ------ | -----------------\n");
+  for (uint32_t c = 0; c < p.header->channels; c++) {
+    const PreviewChannel_t &ch = p.channels[c];
+    printf("| %-15.24s | %-5.8s | %8llu | %6u |", ch.name, ch.units, (unsigned long long)ch.samples, ch.levels);
+    for (uint32_t k = 0; k < ch.levels; k++) printf(" %llu", (unsigned long long)ch.count[k]);
+    printf("\n");
+  }
+  if (log_path) {
+    std::vector<uint8_t> data;
+    if (!LOGREAD_load_file(log_path, data)) {
+      perror(log_path);
+      return 1;
+    }
+    bool match = data.size() == p.header->log_size && PREVIEW_hash(data.data(), data.size()) == p.header->log_hash;
+    printf("\n%s : %s\n", log_path, match ? "matches" : "does NOT match, rerun log_decode");
+    return match ? 0 : 1;
+  }
+  return 0;
+}
+
+
+static int query(const Preview_t &p, const char *name, double from_s, double to_s, size_t points,
+                 const char *out_path) {
+  int c = PREVIEW_channel(&p, name);
+  if (c < 0) {
+    fprintf(stderr, "no channel %s\n", name);
+    return 1;
+  }
+  const PreviewChannel_t &ch = p.channels[c];
+  if (!ch.samples) {
+    fprintf(stderr, "%s is empty\n", name);
+    return 1;
+  }
+  const PreviewSample_t *raw = (const PreviewSample_t *)(p.map + ch.offset[0]);
+  int64_t first = raw[0].t_us;
+  int64_t t0 = first + (int64_t)(from_s * 1e6);
+  int64_t t1 = to_s >= 0.0 ? first + (int64_t)(to_s * 1e6) : raw[ch.samples - 1].t_us;
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<PreviewPoint_t> pts;
+  int level;
+  PREVIEW_query(&p, c, t0, t1, points, &pts, &level);
+  double query_s = seconds_since(start);
+
+  FILE *f = out_path ? fopen(out_path, "w") : stdout;
+  if (!f) {
+    perror(out_path);
+    return 1;
+  }
+  fprintf(f, "t_us,t_pick_us,pick,min,max,count\n");
+  for (const PreviewPoint_t &q : pts) {
+    fprintf(f, "%lld,%lld,%.6g,%.6g,%.6g,%u\n", (long long)q.t_us, (long long)q.t_pick_us, q.pick, q.min, q.max,
+            q.count);
+  }
+  if (out_path) fclose(f);
+  fprintf(stderr, "%s : level %d (%u samples per point), %zu points, %.1f us\n", name, level,
+          (unsigned)std::pow((double)p.header->factor, level), pts.size(), query_s * 1e6);
+  return 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Bench
+//--------------------------------------------------------------------------------------------
+#define BENCH_RATE_HZ 3200.0
+#define BENCH_QUERIES 200
+
+
+// The same plot from the raw samples : min / max per pixel column over the range.
+static size_t raw_plot(const PreviewSample_t *s, size_t n, int64_t t0, int64_t t1, size_t points,
+                       std::vector<PreviewPoint_t> *out) {
+  size_t i0 = std::lower_bound(s, s + n, t0, [](const PreviewSample_t &a, int64_t t) { return a.t_us < t; }) - s;
+  size_t i1 = std::upper_bound(s, s + n, t1, [](int64_t t, const PreviewSample_t &a) { return t < a.t_us; }) - s;
+  out->assign(points, { 0, 0, 0.0f, INFINITY, -INFINITY, 0 });
+  double scale = (double)points / (double)(t1 - t0 + 1);
+  for (size_t i = i0; i < i1; i++) {
+    size_t col = (size_t)((double)(s[i].t_us - t0) * scale);
+    PreviewPoint_t &q = (*out)[col < points ? col : points - 1];
+    if (!q.count) q.t_us = s[i].t_us;
+    q.min = std::min(q.min, s[i].v);
+    q.max = std::max(q.max, s[i].v);
+    q.count++;
+  }
+  return i1 - i0;
+}
+
+
+static int run_bench(double msamples, int threads, const char *tmp_dir) {
+  size_t n = (size_t)(msamples * 1e6);
+  std::vector<int64_t> t(n);
+  std::vector<float> v[3];
+  std::mt19937 rng(37);
+  std::normal_distribution<float> g(0.0f, 1.0f);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  for (int c = 0; c < 3; c++) v[c].resize(n);
+  for (size_t i = 0; i < n; i++) {
+    double s = (double)i / BENCH_RATE_HZ;
+    t[i] = 1000000 + (int64_t)std::llround(s * 1e6) + (int64_t)(g(rng) * 3.0f);
+    v[0][i] = g(rng);
+    v[1][i] = (float)std::sin(2.0 * M_PI * (0.01 + 2e-5 * s) * s) + 0.05f * g(rng);
+    v[2][i] = u(rng) < 1e-6 ? 50.0f : 0.1f * g(rng);     // Isolated spikes the envelope must keep
+  }
+  PreviewInput_t in[3] = {
+    { "noise", "g", t.data(), v[0].data(), n },
+    { "chirp", "g", t.data(), v[1].data(), n },
+    { "spikes", "g", t.data(), v[2].data(), n },
+  };
+
+  char path[512];
+  snprintf(path, sizeof(path), "%s/log_preview.%d.preview", tmp_dir, (int)getpid());
+  auto start = std::chrono::steady_clock::now();
+  if (!PREVIEW_write(path, in, 3, 0, 0, threads)) {
+    perror(path);
+    return 1;
+  }
+  double build_s = seconds_since(start);
+  Preview_t p;
+  bool ok = PREVIEW_open(&p, path);
+  remove(path);                 // Stays mapped
+  if (!ok) {
+    fprintf(stderr, "cannot map %s\n", path);
+    return 1;
+  }
+  printf("%zu samples x 3 channels at %.0f Hz (%.0f min), threads %d\n", n, BENCH_RATE_HZ, n / BENCH_RATE_HZ / 60.0,
+         threads);
+  printf("build + write %.3f s (%.1f Msamples/s), sidecar %.1f MB, %u levels\n\n", build_s, 3.0 * n / build_s * 1e-6,
+         p.size / 1e6, p.channels[0].levels);
+
+  // Zoom spans from the whole log down to a few samples, random positions, every channel.
+  const PreviewChannel_t &ch = p.channels[2];
+  const PreviewSample_t *raw = (const PreviewSample_t *)(p.map + ch.offset[0]);
+  int64_t t_first = raw[0].t_us, t_last = raw[n - 1].t_us, span_all = t_last - t_first;
+  printf("| Span          | Level | Points | Query (us) | Raw plot (us) | Raw samples | Envelope |\n");
+  printf("| ------------- | ----- | ------ | ---------- | ------------- | ----------- | -------- |\n");
+  std::vector<PreviewPoint_t> pts, ref;
+  int failures = 0;
+  for (double frac = 1.0; frac * span_all > 1000.0; frac /= 10.0) {
+    int64_t span = (int64_t)(frac * span_all);
+    double q_s = 0.0, r_s = 0.0, points = 0.0, raw_n = 0.0;
+    int level = 0, bad = 0;
+    for (int q = 0; q < BENCH_QUERIES; q++) {
+      int c = q % 3;
+      int64_t t0 = t_first + (int64_t)(u(rng) * (double)(span_all - span));
+      auto a = std::chrono::steady_clock::now();
+      PREVIEW_query(&p, c, t0, t0 + span, DEFAULT_POINTS, &pts, &level);
+      q_s += seconds_since(a);
+      a = std::chrono::steady_clock::now();
+      raw_n += (double)raw_plot((const PreviewSample_t *)(p.map + p.channels[c].offset[0]), n, t0, t0 + span,
+                                DEFAULT_POINTS, &ref);
+      r_s += seconds_since(a);
+      points += (double)pts.size();
+
+      // Returned envelope covers the range : same extremes as the raw samples of the entries it spans.
+      const PreviewSample_t *s = (const PreviewSample_t *)(p.map + p.channels[c].offset[0]);
+      int64_t e0 = pts.front().t_us, e1 = pts.size() > 1 ? pts.back().t_us : e0;
+      size_t i0 = std::lower_bound(s, s + n, e0, [](const PreviewSample_t &x, int64_t tt) { return x.t_us < tt; }) - s;
+      size_t i1 = i0;
+      uint64_t covered = 0;
+      float lo = INFINITY, hi = -INFINITY, raw_lo = INFINITY, raw_hi = -INFINITY;
+      for (const PreviewPoint_t &e : pts) {
+        lo = std::min(lo, e.min);
+        hi = std::max(hi, e.max);
+        covered += e.count;
+      }
+      i1 = std::min(n, i0 + (size_t)covered);
+      for (size_t i = i0; i < i1; i++) {
+        raw_lo = std::min(raw_lo, s[i].v);
+        raw_hi = std::max(raw_hi, s[i].v);
+      }
+      if (lo != raw_lo || hi != raw_hi || (pts.size() > 1 && s[i1 - 1].t_us < e1)) bad++;
+    }
+    failures += bad;
+    char span_name[32];
+    snprintf(span_name, sizeof(span_name), "%.4g s", span * 1e-6);
+    printf("| %-13s | %5d | %6.0f | %10.1f | %13.1f | %11.0f | %-8s |\n", span_name, level, points / BENCH_QUERIES,
+           q_s / BENCH_QUERIES * 1e6, r_s / BENCH_QUERIES * 1e6, raw_n / BENCH_QUERIES, bad ? "FAIL" : "exact");
+  }
+  PREVIEW_close(&p);
+  printf("\n%s\n", failures ? "FAIL" : "all envelopes exact");
+  return failures ? 1 : 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------------------------------
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s <log.preview> [--log SENSOR_DATA.bin]\n"
+          "       %s <log.preview> --channel NAME [--from S] [--to S] [--points N] [out.csv]\n"
+          "       %s --bench [Msamples] [--threads N] [--tmp DIR]\n", prog, prog, prog);
+}
+
+
+int main(int argc, char **argv) {
+  const char *in_path = NULL;
+  const char *out_path = NULL;
+  const char *log_path = NULL;
+  const char *channel = NULL;
+  const char *tmp_dir = "/tmp";
+  double from_s = 0.0, to_s = -1.0;
+  size_t points = DEFAULT_POINTS;
+  int threads = 0;
+  double bench = -1.0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--log") && i + 1 < argc) log_path = argv[++i];
+    else if (!strcmp(argv[i], "--channel") && i + 1 < argc) channel = argv[++i];
+    else if (!strcmp(argv[i], "--from") && i + 1 < argc) from_s = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--to") && i + 1 < argc) to_s = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--points") && i + 1 < argc) points = (size_t)atol(argv[++i]);
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--tmp") && i + 1 < argc) tmp_dir = argv[++i];
+    else if (!strcmp(argv[i], "--bench")) {
+      bench = 10.0;
+      if (i + 1 < argc && argv[i + 1][0] != '-') bench = atof(argv[++i]);
+    }
+    else if (!in_path) in_path = argv[i];
+    else if (!out_path) out_path = argv[i];
+    else { usage(argv[0]); return 1; }
+  }
+  threads = PARALLEL_threads(threads);
+  if (bench > 0.0) {
+    return run_bench(bench, threads, tmp_dir);
+  }
+  if (!in_path || points < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  Preview_t p;
+  if (!PREVIEW_open(&p, in_path)) {
+    fprintf(stderr, "%s : not a preview sidecar\n", in_path);
+    return 1;
+  }
+  int rc = channel ? query(p, channel, from_s, to_s, points, out_path) : list_channels(p, log_path);
+  PREVIEW_close(&p);
+  return rc;
+}
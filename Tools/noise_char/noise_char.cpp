@@ -0,0 +1,715 @@
+/**
+ * @file noise_char.cpp
+ * @brief Allan deviation and noise model of the ADXL375 and BMP390 from bench logs.
+ *
+ * Record a log with the board still on the bench (hours, the longer the
+ * better for the random walk), at the sensor settings of ADXL375_init() and
+ * BMP390_init(); one log per setting. This tool computes the overlapping
+ * Allan deviation of every channel :
+ *
+ *   | Channel       | Record | Units  |
+ *   | ------------- | ------ | ------ |
+ *   | accel_x/y/z   | ACCEL  | m/s^2  |
+ *   | baro_altitude | BARO   | m      |
+ *   | baro_pressure | BARO   | Pa     |
+ *   | baro_temp     | BARO   | C      |
+ *
+ * and fits the IEEE 952 terms to it :
+ *
+ *   | Term             | Slope | Allan variance              |
+ *   | ---------------- | ----- | --------------------------- |
+ *   | white noise N    | -1/2  | N^2 / tau                   |
+ *   | bias instability | 0     | (0.664 B)^2                 |
+ *   | random walk K    | +1/2  | K^2 tau / 3                 |
+ *   | drift ramp R     | +1    | R^2 tau^2 / 2               |
+ *
+ * The fit is least squares on the relative avar error of every point with
+ * less than FIT_MAX_ERROR uncertainty, all terms >= 0, so one term does not
+ * leak into the slope of its neighbour as reading slopes off the plot does.
+ *
+ * The white noise term gives the per sample sigma the Kalman filter wants,
+ * N sqrt(rate), which goes into a noise header for AltitudeKF
+ * (KF_ACCEL_SIGMA from the --axial axis, KF_BARO_SIGMA from baro_altitude;
+ * build with -DKF_NOISE_HEADER='"kf_noise.h"') and into the traj_smooth
+ * options printed at the end.
+ *
+ * Algorithm : samples go on the nominal grid (a missed sample repeats the
+ * previous one), mean removed, summed once into double phase x. Then every
+ * tau = m tau0 is one pass over x :
+ *
+ *   avar(m) = sum (x[i + 2m] - 2 x[i + m] + x[i])^2 / (2 m^2 tau0^2 (n - 2m))
+ *
+ * with m log spaced (--per-decade), so the whole curve is O(n log n). Each
+ * (channel, tau) is a task for the worker threads (--threads).
+ *
+ * Outputs : <prefix>_adev.csv (channel, tau, adev, error, terms) and
+ * <prefix>_kf_noise.h, prefix defaults to the log path without extension.
+ *
+ * --bench [hours] writes a synthetic bench log (white noise, flicker bias,
+ * random walk of known size on every channel) to a temporary file, runs
+ * the tool on it and compares the fitted terms with the truth.
+ *
+ * Usage :
+ *   noise_char <SENSOR_DATA.bin> [--out PREFIX] [--name LABEL] [--axial 0|1|2] [--per-decade N] [--threads N]
+ *   noise_char --bench [hours] [--threads N] [--tmp DIR]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "baro_altitude.h"
+#include "flight_log.h"
+#include "log_reader.h"
+#include "parallel.h"
+#include "resample.h"
+
+
+#define ADXL_G_PER_LSB 0.049
+#define GRAVITY 9.80665
+#define DEFAULT_AXIAL 2               // ADXL375_AXIAL_AXIS in main.cpp
+#define DEFAULT_PER_DECADE 10
+#define MIN_TERMS 8                   // Smallest n - 2m kept on the curve
+#define FIT_MAX_ERROR 0.3             // Points with a larger relative error are not fitted
+#define BIAS_FACTOR 0.664             // sqrt(2 ln 2 / pi), flicker floor to bias instability
+
+
+typedef enum { CH_ACCEL_X = 0, CH_ACCEL_Y, CH_ACCEL_Z, CH_BARO_ALT, CH_BARO_PRESS, CH_BARO_TEMP, CH_COUNT } Channel_t;
+
+static const char *ChannelNames[CH_COUNT] = { "accel_x", "accel_y", "accel_z", "baro_altitude", "baro_pressure",
+                                              "baro_temp" };
+static const char *ChannelUnits[CH_COUNT] = { "m/s^2", "m/s^2", "m/s^2", "m", "Pa", "C" };
+
+typedef struct {
+  std::vector<int64_t> t;
+  std::vector<float> v;
+  double tau0;                // s
+  size_t filled;              // Missed samples filled with the previous one
+  std::vector<double> x;      // Phase, sum of (v - mean) tau0
+} Series_t;
+
+typedef struct {
+  size_t m;
+  double tau;
+  double adev;
+  double error;               // Relative, 1 sigma
+  size_t terms;
+} AdevPoint_t;
+
+typedef struct {
+  double white;               // N, units sqrt(s)
+  double bias;                // B, units
+  double bias_tau;            // s, where the curve is lowest
+  double walk;                // K, units / sqrt(s), 0 if the curve never turns up
+  double ramp;                // R, units / s, drift
+  double sample_sigma;        // N sqrt(rate), per sample white noise
+} NoiseTerms_t;
+
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Input
+//--------------------------------------------------------------------------------------------
+static bool read_log(const char *path, Series_t series[CH_COUNT]) {
+  LogStream_t s;
+  if (!LOGREAD_stream_open(&s, path)) {
+    return false;
+  }
+  LOG_Record_t rec;
+  while (LOGREAD_stream_next(&s, &rec)) {
+    if (rec.type == LOG_REC_ACCEL && rec.len == sizeof(LOG_Accel_t)) {
+      LOG_Accel_t a;
+      memcpy(&a, rec.payload, sizeof(a));
+      for (int i = 0; i < 3; i++) {
+        series[CH_ACCEL_X + i].t.push_back((int64_t)rec.t_us);
+        series[CH_ACCEL_X + i].v.push_back((float)(a.acc_raw[i] * ADXL_G_PER_LSB * GRAVITY));
+      }
+    }
+    else if (rec.type == LOG_REC_BARO && rec.len == sizeof(LOG_Baro_t)) {
+      LOG_Baro_t b;
+      memcpy(&b, rec.payload, sizeof(b));
+      series[CH_BARO_PRESS].t.push_back((int64_t)rec.t_us);
+      series[CH_BARO_PRESS].v.push_back(b.pressure);
+      series[CH_BARO_TEMP].t.push_back((int64_t)rec.t_us);
+      series[CH_BARO_TEMP].v.push_back(b.temperature);
+    }
+  }
+  LOGREAD_stream_close(&s);
+
+  Series_t &p = series[CH_BARO_PRESS], &alt = series[CH_BARO_ALT];
+  alt.t = p.t;
+  alt.v.resize(p.v.size());
+  BARO_pressure_altitude_batch(p.v.data(), alt.v.data(), p.v.size());
+  return true;
+}
+
+
+// Samples onto the nominal grid, then the phase sum.
+static void prepare(Series_t *s) {
+  s->filled = 0;
+  s->tau0 = 0.0;
+  s->x.clear();
+  size_t n = s->t.size();
+  if (n < 2) {
+    return;
+  }
+  double period_us = RESAMPLE_nominal_period(s->t.data(), n);
+  s->tau0 = period_us * 1e-6;
+  std::vector<float> grid;
+  grid.reserve(n + n / 100);
+  grid.push_back(s->v[0]);
+  for (size_t i = 1; i < n; i++) {
+    long steps = std::lround((double)(s->t[i] - s->t[i - 1]) / period_us);
+    for (long k = 1; k < steps; k++) {
+      grid.push_back(s->v[i - 1]);
+      s->filled++;
+    }
+    grid.push_back(s->v[i]);
+  }
+  double mean = 0.0;
+  for (float v : grid) mean += v;
+  mean /= (double)grid.size();
+  s->x.resize(grid.size() + 1);
+  s->x[0] = 0.0;
+  for (size_t i = 0; i < grid.size(); i++) s->x[i + 1] = s->x[i] + ((double)grid[i] - mean) * s->tau0;
+  s->v.swap(grid);
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Allan deviation
+//--------------------------------------------------------------------------------------------
+// Log spaced averaging factors, 1 .. (n - MIN_TERMS) / 2.
+static std::vector<size_t> tau_factors(size_t n, int per_decade) {
+  std::vector<size_t> m;
+  if (n < MIN_TERMS + 2) {
+    return m;
+  }
+  size_t m_max = (n - MIN_TERMS) / 2;
+  for (int k = 0;; k++) {
+    size_t v = (size_t)std::llround(std::pow(10.0, (double)k / per_decade));
+    if (v > m_max) break;
+    if (m.empty() || v != m.back()) m.push_back(v);
+  }
+  return m;
+}
+
+
+static AdevPoint_t adev_at(const Series_t &s, size_t m) {
+  const double *__restrict x = s.x.data();
+  const size_t n = s.x.size() - 1;        // Samples
+  const size_t terms = n + 1 - 2 * m;     // x has n + 1 points
+  double sum = 0.0;
+  for (size_t i = 0; i < terms; i++) {
+    double d = x[i + 2 * m] - 2.0 * x[i + m] + x[i];
+    sum += d * d;
+  }
+  AdevPoint_t p;
+  p.m = m;
+  p.tau = (double)m * s.tau0;
+  p.terms = terms;
+  p.adev = std::sqrt(sum / (2.0 * p.tau * p.tau * (double)terms));
+  // Non overlapped count as the degrees of freedom : conservative for the overlapped estimator.
+  double clusters = (double)n / (double)m;
+  p.error = clusters > 1.0 ? 1.0 / std::sqrt(2.0 * (clusters - 1.0)) : 1.0;
+  return p;
+}
+
+
+// Weighted least squares of the Allan variance on the IEEE 952 terms, all
+// coefficients >= 0 : every subset of terms is solved and the best feasible
+// one kept (FIT_TERMS is small).
+#define FIT_TERMS 4
+
+static double fit_basis(int k, double tau) {
+  switch (k) {
+    case 0: return 1.0 / tau;               // N^2 / tau
+    case 1: return 1.0;                     // (0.664 B)^2
+    case 2: return tau / 3.0;               // K^2 tau / 3
+    default: return tau * tau / 2.0;        // R^2 tau^2 / 2, drift ramp
+  }
+}
+
+
+// Solve the normal equations A x = b of size n in place, false if singular.
+static bool solve(double A[FIT_TERMS][FIT_TERMS], double b[FIT_TERMS], int n) {
+  for (int c = 0; c < n; c++) {
+    int pivot = c;
+    for (int r = c + 1; r < n; r++) {
+      if (std::fabs(A[r][c]) > std::fabs(A[pivot][c])) pivot = r;
+    }
+    if (std::fabs(A[pivot][c]) < 1e-12) return false;
+    std::swap(A[c], A[pivot]);
+    std::swap(b[c], b[pivot]);
+    for (int r = c + 1; r < n; r++) {
+      double f = A[r][c] / A[c][c];
+      for (int k = c; k < n; k++) A[r][k] -= f * A[c][k];
+      b[r] -= f * b[c];
+    }
+  }
+  for (int c = n - 1; c >= 0; c--) {
+    for (int k = c + 1; k < n; k++) b[c] -= A[c][k] * b[k];
+    b[c] /= A[c][c];
+  }
+  return true;
+}
+
+
+static NoiseTerms_t fit_terms(const std::vector<AdevPoint_t> &c, double tau0) {
+  NoiseTerms_t t = {};
+  if (c.empty()) {
+    return t;
+  }
+  size_t used = 0;
+  while (used < c.size() && c[used].error < FIT_MAX_ERROR) used++;
+  if (used == 0) used = 1;
+
+  size_t lowest = 0;
+  for (size_t j = 1; j < used; j++) {
+    if (c[j].adev < c[lowest].adev) lowest = j;
+  }
+  t.bias_tau = c[lowest].tau;
+
+  // Rows scaled to relative residuals of avar (error of avar ~ 2 x error of adev).
+  double best_cost = INFINITY, best[FIT_TERMS] = {};
+  for (int mask = 1; mask < (1 << FIT_TERMS); mask++) {
+    int idx[FIT_TERMS], n = 0;
+    for (int k = 0; k < FIT_TERMS; k++) {
+      if (mask & (1 << k)) idx[n++] = k;
+    }
+    if ((size_t)n > used) continue;
+    double A[FIT_TERMS][FIT_TERMS] = {}, b[FIT_TERMS] = {}, norm[FIT_TERMS] = {};
+    for (int a = 0; a < n; a++) {
+      for (size_t j = 0; j < used; j++) {
+        double v = fit_basis(idx[a], c[j].tau) / (c[j].adev * c[j].adev * c[j].error);
+        norm[a] += v * v;
+      }
+      norm[a] = std::sqrt(norm[a]);
+    }
+    for (size_t j = 0; j < used; j++) {
+      double w = 1.0 / (c[j].adev * c[j].adev * c[j].error);
+      double row[FIT_TERMS];
+      for (int a = 0; a < n; a++) row[a] = fit_basis(idx[a], c[j].tau) * w / norm[a];
+      for (int a = 0; a < n; a++) {
+        for (int k = 0; k < n; k++) A[a][k] += row[a] * row[k];
+        b[a] += row[a] / c[j].error;
+      }
+    }
+    if (!solve(A, b, n)) continue;
+    double coef[FIT_TERMS] = {};
+    bool feasible = true;
+    for (int a = 0; a < n; a++) {
+      coef[idx[a]] = b[a] / norm[a];
+      if (coef[idx[a]] < 0.0) feasible = false;
+    }
+    if (!feasible) continue;
+    double cost = 0.0;
+    for (size_t j = 0; j < used; j++) {
+      double model = 0.0;
+      for (int k = 0; k < FIT_TERMS; k++) model += coef[k] * fit_basis(k, c[j].tau);
+      double r = (model / (c[j].adev * c[j].adev) - 1.0) / c[j].error;
+      cost += r * r;
+    }
+    if (cost < best_cost) {
+      best_cost = cost;
+      memcpy(best, coef, sizeof(best));
+    }
+  }
+  t.white = std::sqrt(best[0]);
+  t.bias = std::sqrt(best[1]) / BIAS_FACTOR;
+  t.walk = std::sqrt(best[2]);
+  t.ramp = std::sqrt(best[3]);
+  t.sample_sigma = t.white / std::sqrt(tau0);
+  return t;
+}
+
+
+typedef struct {
+  std::vector<AdevPoint_t> curve[CH_COUNT];
+  NoiseTerms_t terms[CH_COUNT];
+} Analysis_t;
+
+
+static void analyse(const Series_t series[CH_COUNT], int per_decade, int threads, Analysis_t *an) {
+  std::vector<std::pair<int, size_t>> tasks;
+  for (int ch = 0; ch < CH_COUNT; ch++) {
+    std::vector<size_t> m = tau_factors(series[ch].v.size(), per_decade);
+    an->curve[ch].resize(m.size());
+    for (size_t j = 0; j < m.size(); j++) {
+      an->curve[ch][j].m = m[j];
+      tasks.push_back({ ch, j });
+    }
+  }
+  PARALLEL_for(tasks.size(), threads, [&](size_t k) {
+    int ch = tasks[k].first;
+    size_t j = tasks[k].second;
+    an->curve[ch][j] = adev_at(series[ch], an->curve[ch][j].m);
+  });
+  for (int ch = 0; ch < CH_COUNT; ch++) an->terms[ch] = fit_terms(an->curve[ch], series[ch].tau0);
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Output
+//--------------------------------------------------------------------------------------------
+static bool write_curves(const char *path, const Analysis_t &an) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  fprintf(f, "channel,units,tau_s,adev,error,terms\n");
+  for (int ch = 0; ch < CH_COUNT; ch++) {
+    for (const AdevPoint_t &p : an.curve[ch]) {
+      fprintf(f, "%s,%s,%.6g,%.6e,%.4f,%zu\n", ChannelNames[ch], ChannelUnits[ch], p.tau, p.adev, p.error, p.terms);
+    }
+  }
+  bool ok = !ferror(f);
+  fclose(f);
+  return ok;
+}
+
+
+static void macro_name(char *out, size_t size, int ch, const char *term) {
+  snprintf(out, size, "NOISE_%s_%s", ChannelNames[ch], term);
+  for (char *c = out; *c; c++) *c = (char)toupper(*c);
+}
+
+
+static bool write_header(const char *path, const char *source, const char *label, int axial,
+                         const Series_t series[CH_COUNT], const Analysis_t &an) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  const char *base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  std::string guard = base;
+  for (char &c : guard) c = isalnum((unsigned char)c) ? (char)toupper(c) : '_';
+
+  fprintf(f, "/**\n * @file %s\n * @brief Sensor noise model measured by Tools/noise_char.\n *\n", base);
+  fprintf(f, " * Source : %s\n * Setting : %s\n *\n", source, label);
+  fprintf(f, " * White noise N (units sqrt(s)), bias instability B (units), random walk K\n");
+  fprintf(f, " * (units / sqrt(s)) and drift ramp R (units / s) per channel, 0 when the log\n");
+  fprintf(f, " * does not show the term. KF_ sigmas are the per sample white noise N sqrt(rate).\n");
+  fprintf(f, " *\n * Build with -DKF_NOISE_HEADER='\"%s\"' to use it in AltitudeKF.\n */\n\n", base);
+  fprintf(f, "#ifndef %s\n#define %s\n\n", guard.c_str(), guard.c_str());
+
+  // Only the channels the log has, the others keep their AltitudeKF default.
+  const int acc_ch = CH_ACCEL_X + axial;
+  if (!an.curve[acc_ch].empty()) {
+    fprintf(f, "#define KF_ACCEL_SIGMA %.4ff    // %s at %.0f Hz (m/s^2, 1 sigma)\n", an.terms[acc_ch].sample_sigma,
+            ChannelNames[acc_ch], 1.0 / series[acc_ch].tau0);
+  }
+  if (!an.curve[CH_BARO_ALT].empty()) {
+    fprintf(f, "#define KF_BARO_SIGMA %.4ff     // baro_altitude at %.0f Hz (m, 1 sigma)\n",
+            an.terms[CH_BARO_ALT].sample_sigma, 1.0 / series[CH_BARO_ALT].tau0);
+  }
+  fprintf(f, "\n");
+
+  fprintf(f, "#define NOISE_ACCEL_RATE_HZ %.1f\n", series[CH_ACCEL_X].tau0 > 0 ? 1.0 / series[CH_ACCEL_X].tau0 : 0.0);
+  fprintf(f, "#define NOISE_BARO_RATE_HZ %.1f\n\n", series[CH_BARO_ALT].tau0 > 0 ? 1.0 / series[CH_BARO_ALT].tau0 : 0.0);
+  for (int ch = 0; ch < CH_COUNT; ch++) {
+    if (an.curve[ch].empty()) continue;
+    const NoiseTerms_t &t = an.terms[ch];
+    char name[64];
+    fprintf(f, "// %s (%s), Allan deviation lowest at %.3g s\n", ChannelNames[ch], ChannelUnits[ch], t.bias_tau);
+    macro_name(name, sizeof(name), ch, "WHITE");
+    fprintf(f, "#define %-32s %.6e\n", name, t.white);
+    macro_name(name, sizeof(name), ch, "BIAS");
+    fprintf(f, "#define %-32s %.6e\n", name, t.bias);
+    macro_name(name, sizeof(name), ch, "WALK");
+    fprintf(f, "#define %-32s %.6e\n", name, t.walk);
+    macro_name(name, sizeof(name), ch, "RAMP");
+    fprintf(f, "#define %-32s %.6e\n\n", name, t.ramp);
+  }
+  fprintf(f, "#endif /* %s */\n", guard.c_str());
+  bool ok = !ferror(f);
+  fclose(f);
+  return ok;
+}
+
+
+static void print_terms(const Series_t series[CH_COUNT], const Analysis_t &an) {
+  printf("| Channel       | Units | Rate   | Samples  | Filled | N (white) | B (bias)  | Lowest at | K (walk)  | R (ramp)  | Sample sigma |\n");
+  printf("| ------------- | ----- | ------ | -------- | ------ | --------- | --------- | --------- | --------- | --------- | ------------ |\n");
+  for (int ch = 0; ch < CH_COUNT; ch++) {
+    if (an.curve[ch].empty()) continue;
+    const NoiseTerms_t &t = an.terms[ch];
+    printf("| %-13s | %-5s | %6.0f | %8zu | %6zu | %9.3e | %9.3e | %7.3g s | %9.3e | %9.3e | %12.4g |\n",
+           ChannelNames[ch], ChannelUnits[ch], 1.0 / series[ch].tau0, series[ch].v.size(), series[ch].filled, t.white,
+           t.bias, t.bias_tau, t.walk, t.ramp, t.sample_sigma);
+  }
+}
+
+
+static int run(const char *in_path, const std::string &prefix, const char *label, int axial, int per_decade,
+               int threads) {
+  auto t0 = std::chrono::steady_clock::now();
+  Series_t series[CH_COUNT];
+  if (!read_log(in_path, series)) {
+    perror(in_path);
+    return 1;
+  }
+  PARALLEL_for(CH_COUNT, threads, [&](size_t ch) { prepare(&series[ch]); });
+  double read_s = seconds_since(t0);
+
+  t0 = std::chrono::steady_clock::now();
+  Analysis_t an;
+  analyse(series, per_decade, threads, &an);
+  double adev_s = seconds_since(t0);
+  if (an.curve[CH_ACCEL_X].empty() && an.curve[CH_BARO_ALT].empty()) {
+    fprintf(stderr, "%s : not enough ACCEL or BARO samples\n", in_path);
+    return 1;
+  }
+
+  std::string csv = prefix + "_adev.csv", header = prefix + "_kf_noise.h";
+  std::string setting;
+  if (label) {
+    setting = label;
+  }
+  else {
+    char part[64];
+    if (!an.curve[CH_ACCEL_X].empty()) {
+      snprintf(part, sizeof(part), "ADXL375 %.0f Hz", 1.0 / series[CH_ACCEL_X].tau0);
+      setting += part;
+    }
+    if (!an.curve[CH_BARO_ALT].empty()) {
+      snprintf(part, sizeof(part), "%sBMP390 %.0f Hz", setting.empty() ? "" : ", ", 1.0 / series[CH_BARO_ALT].tau0);
+      setting += part;
+    }
+  }
+  if (!write_curves(csv.c_str(), an) || !write_header(header.c_str(), in_path, setting.c_str(), axial, series, an)) {
+    return 1;
+  }
+
+  print_terms(series, an);
+  printf("\ntraj_smooth :");
+  if (!an.curve[CH_ACCEL_X + axial].empty()) printf(" --accel-sigma %.4g", an.terms[CH_ACCEL_X + axial].sample_sigma);
+  if (!an.curve[CH_BARO_ALT].empty()) printf(" --baro-sigma %.4g", an.terms[CH_BARO_ALT].sample_sigma);
+  printf("\n");
+  printf("-> %s, %s\nread %.3f s, adev %.3f s, %d threads\n", csv.c_str(), header.c_str(), read_s, adev_s, threads);
+  return 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Bench
+//--------------------------------------------------------------------------------------------
+#define BENCH_ACCEL_HZ 800.0
+#define BENCH_BARO_HZ 100.0
+#define BENCH_JITTER_US 3.0
+#define BENCH_MISS_RATE 1e-5
+
+#define BENCH_FLICKER_DECADES 4       // Gauss-Markov terms of the flicker bias, 0.1 .. 100 s
+
+// Per channel truth. The bias is one Gauss-Markov process per decade of
+// correlation time, each with the variance of a 0.664 B flicker floor :
+// flat Allan deviation over the decades, close to a true 1/f bias.
+typedef struct {
+  double white;               // N
+  double bias;                // B
+  double walk;                // K
+} BenchNoise_t;
+
+static const BenchNoise_t BenchAccel = { 0.035, 0.004, 5e-4 };        // m/s^2 units
+static const BenchNoise_t BenchPressure = { 0.12, 0.04, 1e-2 };       // Pa units
+
+
+typedef struct {
+  std::normal_distribution<double> g;
+  double gm[BENCH_FLICKER_DECADES], rw;
+} NoiseGen_t;
+
+static double bench_noise(const BenchNoise_t &n, double dt, NoiseGen_t *s, std::mt19937 &rng) {
+  double v = n.white / std::sqrt(dt) * s->g(rng);
+  for (int d = 0; d < BENCH_FLICKER_DECADES; d++) {
+    double a = std::exp(-dt / (0.1 * std::pow(10.0, d)));
+    s->gm[d] = a * s->gm[d] + BIAS_FACTOR * n.bias * std::sqrt(1.0 - a * a) * s->g(rng);
+    v += s->gm[d];
+  }
+  s->rw += n.walk * std::sqrt(dt) * s->g(rng);
+  return v + s->rw;
+}
+
+
+static bool bench_log(const char *path, double hours, size_t *records) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  std::mt19937 rng(952);
+  std::normal_distribution<double> jitter(0.0, BENCH_JITTER_US);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  NoiseGen_t acc[3] = {}, press = {};
+  double temp_rw = 0.0;
+  double acc_dt = 1.0 / BENCH_ACCEL_HZ, baro_dt = 1.0 / BENCH_BARO_HZ;
+  size_t n = (size_t)(hours * 3600.0 * BENCH_ACCEL_HZ);
+  size_t per_baro = (size_t)(BENCH_ACCEL_HZ / BENCH_BARO_HZ);
+  std::vector<uint8_t> buf;
+  buf.reserve(1 << 20);
+  *records = 0;
+  for (size_t k = 0; k < n; k++) {
+    double t = 1e6 + (double)k * acc_dt * 1e6;
+    double g[3];
+    for (int i = 0; i < 3; i++) g[i] = (i == 2 ? GRAVITY : 0.0) + bench_noise(BenchAccel, acc_dt, &acc[i], rng);
+    if (u(rng) >= BENCH_MISS_RATE) {
+      LOG_Accel_t v;
+      for (int i = 0; i < 3; i++) v.acc_raw[i] = (int16_t)std::lrint(g[i] / (ADXL_G_PER_LSB * GRAVITY));
+      uint8_t rec[LOG_OVERHEAD + sizeof(v)];
+      size_t len = LOG_encode(rec, LOG_REC_ACCEL, (uint64_t)std::llround(t + jitter(rng)), &v, sizeof(v));
+      buf.insert(buf.end(), rec, rec + len);
+      (*records)++;
+    }
+    if (k % per_baro == 0) {
+      LOG_Baro_t b;
+      temp_rw += 0.002 * std::sqrt(baro_dt) * press.g(rng);
+      b.pressure = (float)(101325.0 + bench_noise(BenchPressure, baro_dt, &press, rng));
+      b.temperature = (float)(24.0 + temp_rw + 0.003 * press.g(rng));
+      uint8_t rec[LOG_OVERHEAD + sizeof(b)];
+      size_t len = LOG_encode(rec, LOG_REC_BARO, (uint64_t)std::llround(t + 250.0 + jitter(rng)), &b, sizeof(b));
+      buf.insert(buf.end(), rec, rec + len);
+      (*records)++;
+    }
+    if (buf.size() >= (1 << 20)) {
+      fwrite(buf.data(), 1, buf.size(), f);
+      buf.clear();
+    }
+  }
+  fwrite(buf.data(), 1, buf.size(), f);
+  fclose(f);
+  return true;
+}
+
+
+static int run_bench(double hours, int per_decade, int threads, const char *tmp_dir) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/noise_char.%d.bin", tmp_dir, (int)getpid());
+  size_t records;
+  if (!bench_log(path, hours, &records)) {
+    return 1;
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  Series_t series[CH_COUNT];
+  bool ok = read_log(path, series);
+  remove(path);
+  if (!ok) {
+    perror(path);
+    return 1;
+  }
+  PARALLEL_for(CH_COUNT, threads, [&](size_t ch) { prepare(&series[ch]); });
+  double read_s = seconds_since(t0);
+
+  t0 = std::chrono::steady_clock::now();
+  Analysis_t an;
+  analyse(series, per_decade, threads, &an);
+  double adev_s = seconds_since(t0);
+
+  size_t taus = 0, terms = 0;
+  for (int ch = 0; ch < CH_COUNT; ch++) {
+    taus += an.curve[ch].size();
+    for (const AdevPoint_t &p : an.curve[ch]) terms += p.terms;
+  }
+  printf("synthetic bench log : %.1f h, %zu records, %d taus per decade, threads %d\n", hours, records, per_decade,
+         threads);
+  printf("read + grid %.3f s, adev %.3f s (%zu taus, %.0f Mterms/s)\n\n", read_s, adev_s, taus, terms / adev_s * 1e-6);
+  print_terms(series, an);
+
+  // Pressure truth also holds for altitude through dh/dp at the pad.
+  double dh_dp = std::fabs((double)BARO_pressure_altitude(101325.0f + 50.0f) - BARO_pressure_altitude(101325.0f - 50.0f))
+                 / 100.0;
+  printf("\n| Channel       | Term | True      | Fit       | Error   |\n");
+  printf("| ------------- | ---- | --------- | --------- | ------- |\n");
+  const int checked[3] = { CH_ACCEL_Z, CH_BARO_PRESS, CH_BARO_ALT };
+  for (int ch : checked) {
+    const BenchNoise_t &truth = ch == CH_ACCEL_Z ? BenchAccel : BenchPressure;
+    double scale = ch == CH_BARO_ALT ? dh_dp : 1.0;
+    const NoiseTerms_t &t = an.terms[ch];
+    const double rows[3][2] = { { truth.white, t.white }, { truth.bias, t.bias }, { truth.walk, t.walk } };
+    const char *names[3] = { "N", "B", "K" };
+    for (int r = 0; r < 3; r++) {
+      double ref = rows[r][0] * scale;
+      printf("| %-13s | %-4s | %9.3e | %9.3e | %+6.1f%% |\n", ChannelNames[ch], names[r], ref, rows[r][1],
+             100.0 * (rows[r][1] / ref - 1.0));
+    }
+  }
+  double q = ADXL_G_PER_LSB * GRAVITY;
+  double quantised = std::sqrt(BenchAccel.white * BenchAccel.white + q * q / 12.0 / BENCH_ACCEL_HZ);
+  printf("\naccel N with the ADXL375 quantisation (q^2 / 12 per sample) : %.3e\n", quantised);
+  return 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------------------------------
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s <SENSOR_DATA.bin> [--out PREFIX] [--name LABEL] [--axial 0|1|2] [--per-decade N] "
+          "[--threads N]\n"
+          "       %s --bench [hours] [--threads N] [--tmp DIR]\n", prog, prog);
+}
+
+
+int main(int argc, char **argv) {
+  const char *in_path = NULL;
+  const char *out_prefix = NULL;
+  const char *label = NULL;
+  const char *tmp_dir = "/tmp";
+  int axial = DEFAULT_AXIAL;
+  int per_decade = DEFAULT_PER_DECADE;
+  int threads = 0;
+  double bench_hours = -1.0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--out") && i + 1 < argc) out_prefix = argv[++i];
+    else if (!strcmp(argv[i], "--name") && i + 1 < argc) label = argv[++i];
+    else if (!strcmp(argv[i], "--axial") && i + 1 < argc) axial = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--per-decade") && i + 1 < argc) per_decade = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--tmp") && i + 1 < argc) tmp_dir = argv[++i];
+    else if (!strcmp(argv[i], "--bench")) {
+      bench_hours = 2.0;
+      if (i + 1 < argc && argv[i + 1][0] != '-') bench_hours = atof(argv[++i]);
+    }
+    else if (!in_path) in_path = argv[i];
+    else { usage(argv[0]); return 1; }
+  }
+  if (axial < 0 || axial > 2 || per_decade < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+  threads = PARALLEL_threads(threads);
+  BARO_init_table();
+
+  if (bench_hours > 0.0) {
+    return run_bench(bench_hours, per_decade, threads, tmp_dir);
+  }
+  if (!in_path) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::string prefix;
+  if (out_prefix) {
+    prefix = out_prefix;
+  }
+  else {
+    prefix = in_path;
+    size_t dot = prefix.find_last_of('.');
+    size_t slash = prefix.find_last_of('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) prefix.erase(dot);
+  }
+  return run(in_path, prefix, label, axial, per_decade, threads);
+}
@@ -0,0 +1,685 @@
+/**
+ * @file offload.cpp
+ * @brief Log offload client (lib/Offload) : fetch a board's logs over its serial port, resumable and verified, and a pty board simulator.
+ *
+ * list asks the board for its files. get fetches them into a folder :
+ * each one streamed in CRC-checked chunks through a sliding window (READ,
+ * DATA, ACK), a file already there in part resumed after its last whole
+ * chunk. A gap in the stream (a frame lost or corrupted), or silence (the
+ * board reset, a cable pulled), asks again from the first byte missing.
+ * The file written is then read back and its CRC-32 checked against the
+ * board's (SUM); a mismatch is narrowed down to OFFLOAD_VERIFY_BLOCK ranges
+ * and those are fetched again.
+ *
+ * board serves files as a board would, on a pseudo terminal
+ * (common/pty_link.h) with the link of the ESP32-S3 USB CDC port, the
+ * STM32G030 UART or no limit, and injected faults, so list and get can be
+ * tried without hardware.
+ *
+ * sim runs get against that simulator : clean links for throughput, the
+ * window against the link's latency, frames corrupted and dropped, board
+ * resets, a client killed and restarted, a saved file damaged. Every file
+ * fetched must match the board's byte for byte.
+ *
+ * Usage :
+ *   offload list <tty> [--baud N]
+ *   offload get <tty> <dir> [--file NAME] [--window KB] [--baud N]
+ *   offload board [--link usb|uart|pty] [--corrupt N] [--drop N] <file>...
+ *   offload sim
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "offload.h"
+#include "pty_link.h"
+
+
+#define OFFLOAD_TIMEOUT_MS 300        // Silence before asking again from the first byte missing
+#define OFFLOAD_GIVE_UP_S 15.0        // Without progress
+#define OFFLOAD_LIST_TRIES 10
+#define OFFLOAD_VERIFY_BLOCK (1u << 20)  // A mismatching file is checked again in ranges of this
+#define OFFLOAD_SUM_RATE 1e6          // Bytes/s the board reads back for a SUM, for its timeout
+#define OFFLOAD_WINDOW (64u * 1024)
+
+
+//--------------------------------------------------------------------------------------------
+// Client
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  std::string name;
+  uint8_t id;
+  uint32_t size;
+} Remote_t;
+
+typedef struct {
+  int fd;
+  OFF_Parser_t parser;
+  std::vector<uint8_t> frame_buf;
+  uint8_t in[65536];
+  size_t in_len, in_at;
+  uint32_t chunk;             // The board's, from INFO
+} Client_t;
+
+typedef struct {
+  uint64_t payload;           // DATA bytes received, repeats included
+  uint32_t resumed_from;
+  uint32_t asks;              // READ requests after the first
+  uint32_t timeouts;
+  uint32_t repaired;          // Verify blocks fetched again
+  bool stopped;               // Left at stop_at, as a client killed
+  double seconds;
+} Fetch_t;
+
+
+static speed_t baud_code(long baud) {
+  switch (baud) {
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    case 2000000: return B2000000;
+    default: return B0;
+  }
+}
+
+
+static int port_open(const char *tty, long baud) {
+  int fd = open(tty, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    fprintf(stderr, "cannot open %s\n", tty);
+    return -1;
+  }
+  struct termios tio;
+  tcgetattr(fd, &tio);
+  cfmakeraw(&tio);
+  if (baud_code(baud) != B0) {
+    cfsetispeed(&tio, baud_code(baud));
+    cfsetospeed(&tio, baud_code(baud));
+  }
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  tcsetattr(fd, TCSANOW, &tio);
+  tcflush(fd, TCIOFLUSH);
+  return fd;
+}
+
+
+static void client_init(Client_t *c, int fd) {
+  c->fd = fd;
+  c->frame_buf.assign(OFF_OVERHEAD + OFF_CHUNK_MAX, 0);
+  OFF_parser_init(&c->parser, c->frame_buf.data(), c->frame_buf.size());
+  c->in_len = c->in_at = 0;
+  c->chunk = 0;
+}
+
+
+static bool ask(Client_t *c, uint8_t type, uint8_t file, uint32_t offset, uint32_t arg) {
+  uint8_t f[OFF_OVERHEAD];
+  size_t n = OFF_encode(f, type, file, offset, arg, NULL, 0);
+  return write(c->fd, f, n) == (ssize_t)n;
+}
+
+
+// Next frame that checks, false after timeout_ms without one.
+static bool next_frame(Client_t *c, int timeout_ms, OFF_Frame_t *f) {
+  double deadline = PTYLINK_now_s() + timeout_ms * 1e-3;
+  for (;;) {
+    bool got;
+    c->in_at += OFF_parse(&c->parser, c->in + c->in_at, c->in_len - c->in_at, f, &got);
+    if (got) {
+      return true;
+    }
+    double left = deadline - PTYLINK_now_s();
+    if (left <= 0.0) {
+      return false;
+    }
+    struct pollfd p = { c->fd, POLLIN, 0 };
+    if (poll(&p, 1, (int)(left * 1e3) + 1) <= 0) {
+      continue;
+    }
+    ssize_t r = read(c->fd, c->in, sizeof(c->in));
+    c->in_at = 0;
+    c->in_len = r > 0 ? (size_t)r : 0;
+  }
+}
+
+
+static bool list(Client_t *c, std::vector<Remote_t> *files) {
+  for (int tries = 0; tries < OFFLOAD_LIST_TRIES; tries++) {
+    ask(c, OFF_LIST, 0, 0, 0);
+    OFF_Frame_t f;
+    double deadline = PTYLINK_now_s() + OFFLOAD_TIMEOUT_MS * 1e-3;
+    while (next_frame(c, OFFLOAD_TIMEOUT_MS, &f) && PTYLINK_now_s() < deadline) {
+      if (f.type != OFF_INFO) continue;
+      files->clear();
+      c->chunk = f.arg;
+      for (size_t at = 0; at + 5 <= f.len;) {
+        Remote_t r;
+        r.size = (uint32_t)f.payload[at] | (uint32_t)f.payload[at + 1] << 8 | (uint32_t)f.payload[at + 2] << 16 |
+                 (uint32_t)f.payload[at + 3] << 24;
+        size_t name = f.payload[at + 4];
+        if (at + 5 + name > f.len) break;
+        r.name.assign((const char *)f.payload + at + 5, name);
+        r.id = (uint8_t)files->size();
+        files->push_back(r);
+        at += 5 + name;
+      }
+      return c->chunk > 0;
+    }
+  }
+  return false;
+}
+
+
+// Fetch [from, to) of a file into out, asking again from the first byte
+// missing after a gap or silence. Stops early at stop_at (a client killed).
+static bool fetch_range(Client_t *c, int out, const Remote_t *r, uint32_t from, uint32_t to, uint32_t window,
+                        uint32_t stop_at, Fetch_t *st) {
+  uint32_t have = from, acked = from, asked = from;
+  double progress_s = PTYLINK_now_s();
+  ask(c, OFF_READ, r->id, from, window);
+  while (have < to) {
+    if (have >= stop_at) {
+      st->stopped = true;
+      return true;
+    }
+    OFF_Frame_t f;
+    if (!next_frame(c, OFFLOAD_TIMEOUT_MS, &f)) {
+      if (PTYLINK_now_s() - progress_s > OFFLOAD_GIVE_UP_S) {
+        fprintf(stderr, "%s : no data for %.0f s at %u\n", r->name.c_str(), OFFLOAD_GIVE_UP_S, have);
+        return false;
+      }
+      st->timeouts++;
+      st->asks++;
+      ask(c, OFF_READ, r->id, have, window);
+      asked = have;
+      continue;
+    }
+    if (f.type == OFF_ERROR && f.file == r->id) {
+      fprintf(stderr, "%s : board error %u at %u\n", r->name.c_str(), f.arg, f.offset);
+      return false;
+    }
+    if (f.type != OFF_DATA || f.file != r->id) {
+      continue;
+    }
+    st->payload += f.len;
+    uint32_t end = f.offset + f.len;
+    if (f.offset <= have && end > have) {
+      uint32_t n = std::min(end, to) - have;
+      if (pwrite(out, f.payload + (have - f.offset), n, have) != (ssize_t)n) {
+        fprintf(stderr, "%s : write failed\n", r->name.c_str());
+        return false;
+      }
+      have += n;
+      progress_s = PTYLINK_now_s();
+      if (have - acked >= std::max(window / 4, c->chunk) || have == to) {
+        ask(c, OFF_ACK, r->id, have, 0);
+        acked = have;
+      }
+    } else if (f.offset > have && asked != have) {
+      // A gap : the frames still on their way from before are skipped until
+      // the board starts again from the first byte missing.
+      st->asks++;
+      ask(c, OFF_READ, r->id, have, window);
+      asked = have;
+    }
+  }
+  return true;
+}
+
+
+static bool remote_sum(Client_t *c, const Remote_t *r, uint32_t offset, uint32_t len, uint32_t *crc) {
+  int timeout_ms = 2000 + (int)(len / OFFLOAD_SUM_RATE * 1e3);
+  for (int tries = 0; tries < 3; tries++) {
+    ask(c, OFF_SUM, r->id, offset, len);
+    OFF_Frame_t f;
+    double deadline = PTYLINK_now_s() + timeout_ms * 1e-3;
+    while (next_frame(c, timeout_ms, &f) && PTYLINK_now_s() < deadline) {
+      if (f.file != r->id || f.offset != offset) continue;
+      if (f.type == OFF_ERROR) return false;
+      if (f.type == OFF_SUM && f.arg == len && f.len == 4) {
+        *crc = (uint32_t)f.payload[0] | (uint32_t)f.payload[1] << 8 | (uint32_t)f.payload[2] << 16 |
+               (uint32_t)f.payload[3] << 24;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+
+static uint32_t local_sum(int fd, uint32_t offset, uint32_t len) {
+  static uint8_t buf[1 << 16];
+  uint32_t crc = 0;
+  for (uint32_t at = offset; at < offset + len;) {
+    ssize_t n = pread(fd, buf, std::min((uint32_t)sizeof(buf), offset + len - at), at);
+    if (n <= 0) return ~crc;  // Short file : never matches
+    crc = OFF_crc32(crc, buf, (size_t)n);
+    at += (uint32_t)n;
+  }
+  return crc;
+}
+
+
+// The file against the board's, block by block when it differs, those blocks fetched again.
+static bool verify(Client_t *c, int out, const Remote_t *r, uint32_t window, Fetch_t *st) {
+  for (int pass = 0; pass < 3; pass++) {
+    uint32_t remote;
+    if (!remote_sum(c, r, 0, r->size, &remote)) {
+      fprintf(stderr, "%s : no SUM from the board\n", r->name.c_str());
+      return false;
+    }
+    if (remote == local_sum(out, 0, r->size)) {
+      return true;
+    }
+    for (uint32_t at = 0; at < r->size; at += OFFLOAD_VERIFY_BLOCK) {
+      uint32_t len = std::min(OFFLOAD_VERIFY_BLOCK, r->size - at);
+      if (!remote_sum(c, r, at, len, &remote)) return false;
+      if (remote == local_sum(out, at, len)) continue;
+      st->repaired++;
+      if (!fetch_range(c, out, r, at, at + len, window, UINT32_MAX, st)) return false;
+    }
+  }
+  return false;
+}
+
+
+// One file into dir/name, resumed after the last whole chunk already there.
+static bool get_file(Client_t *c, const char *dir, const Remote_t *r, uint32_t window, uint32_t stop_at,
+                     Fetch_t *st) {
+  memset(st, 0, sizeof(*st));
+  std::string path = std::string(dir) + "/" + r->name;
+  int out = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (out < 0) {
+    fprintf(stderr, "cannot create %s\n", path.c_str());
+    return false;
+  }
+  struct stat sb;
+  fstat(out, &sb);
+  uint32_t have = (uint64_t)sb.st_size > r->size ? 0 : (uint32_t)sb.st_size;
+  have -= have % c->chunk;
+  if (ftruncate(out, have) != 0) {
+    close(out);
+    return false;
+  }
+  st->resumed_from = have;
+  auto t0 = std::chrono::steady_clock::now();
+  bool ok = fetch_range(c, out, r, have, r->size, window, stop_at, st);
+  if (ok && !st->stopped) ok = verify(c, out, r, window, st);
+  fsync(out);
+  close(out);
+  st->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  return ok;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Simulated board
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  PtyLink_t link;
+  std::vector<std::string> names;
+  std::vector<std::vector<uint8_t>> data;
+  std::vector<OFF_File_t> files;
+  std::vector<uint8_t> buf;
+  OFF_Server_t server;
+  std::vector<uint64_t> reset_at;   // Link bytes out at which the board resets
+  uint32_t resets;
+  std::atomic<bool> stop;
+  std::thread thread;
+} Board_t;
+
+#define BOARD_RESET_S 0.5             // A reset and boot, the port silent
+
+
+static bool board_read(void *ctx, uint32_t offset, void *buf, size_t n) {
+  const std::vector<uint8_t> *d = (const std::vector<uint8_t> *)ctx;
+  if ((uint64_t)offset + n > d->size()) return false;
+  memcpy(buf, d->data() + offset, n);
+  return true;
+}
+
+
+// The USB CDC and UART writes of the firmware return once the bytes are queued.
+static bool board_send(void *ctx, const uint8_t *buf, size_t n) {
+  Board_t *b = (Board_t *)ctx;
+  PTYLINK_write(&b->link, buf, n);
+  return true;
+}
+
+
+static void board_boot(Board_t *b) {
+  b->files.clear();
+  for (size_t i = 0; i < b->data.size(); i++) {
+    b->files.push_back({ b->names[i].c_str(), (uint32_t)b->data[i].size(), board_read, &b->data[i] });
+  }
+  OFF_Link_t link = { board_send, b };
+  OFF_server_init(&b->server, b->files.data(), (uint8_t)b->files.size(), &link, b->buf.data(), b->buf.size());
+}
+
+
+static void board_run(Board_t *b) {
+  uint8_t rx[512];
+  bool busy = false;
+  while (!b->stop) {
+    size_t n = PTYLINK_read(&b->link, rx, sizeof(rx), busy ? 0 : 1);
+    if (n) OFF_server_rx(&b->server, rx, n);
+    if (!b->reset_at.empty() && b->link.bytes_out >= b->reset_at.front()) {
+      b->reset_at.erase(b->reset_at.begin());
+      b->resets++;
+      std::this_thread::sleep_for(std::chrono::duration<double>(BOARD_RESET_S));
+      PTYLINK_flush_input(&b->link);
+      board_boot(b);
+      continue;
+    }
+    busy = OFF_server_service(&b->server);
+  }
+}
+
+
+// chunk : the DATA payload of the board (frame buffers of chunk + OFF_OVERHEAD, two of them).
+static bool board_start(Board_t *b, const PtyLinkModel_t *model, size_t chunk, uint64_t seed) {
+  if (!PTYLINK_open(&b->link, model, seed)) {
+    fprintf(stderr, "no pseudo terminal\n");
+    return false;
+  }
+  b->buf.assign(2 * (chunk + OFF_OVERHEAD), 0);
+  b->resets = 0;
+  b->stop = false;
+  board_boot(b);
+  b->thread = std::thread(board_run, b);
+  return true;
+}
+
+
+static void board_stop(Board_t *b) {
+  b->stop = true;
+  b->thread.join();
+  PTYLINK_close(&b->link);
+}
+
+
+//--------------------------------------------------------------------------------------------
+// sim
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  const char *name;
+  const PtyLinkModel_t *link;
+  uint32_t chunk;
+  uint32_t window;
+  uint32_t size;
+  double corrupt_every, drop_every;
+  double reset_at[2];         // Fractions of the file, 0 : none
+  double kill_at;             // The client killed here then started again, 0 : never
+  bool damage;                // A byte of the saved part flipped before the restart
+} Scenario_t;
+
+
+static bool run_scenario(const Scenario_t *s, const char *dir) {
+  static Board_t b;
+  PtyLinkModel_t model = *s->link;
+  model.corrupt_every = s->corrupt_every;
+  model.drop_every = s->drop_every;
+  b.names = { "SENSOR_DATA.bin" };
+  b.data.assign(1, std::vector<uint8_t>(s->size));
+  std::mt19937_64 rng(s->size);
+  for (uint8_t &v : b.data[0]) v = (uint8_t)rng();
+  b.reset_at.clear();
+  for (double f : s->reset_at) {
+    if (f > 0.0) b.reset_at.push_back((uint64_t)(f * s->size));
+  }
+  if (!board_start(&b, &model, s->chunk, 45)) {
+    return false;
+  }
+  std::string path = std::string(dir) + "/SENSOR_DATA.bin";
+  unlink(path.c_str());
+
+  Fetch_t st, first = {};
+  bool ok = true;
+  int runs = s->kill_at > 0.0 ? 2 : 1;
+  double seconds = 0.0;
+  uint64_t payload = 0, bad = 0;
+  for (int run = 0; run < runs && ok; run++) {
+    int fd = port_open(b.link.slave_path.c_str(), 0);
+    Client_t c;
+    client_init(&c, fd);
+    std::vector<Remote_t> files;
+    ok = fd >= 0 && list(&c, &files) && files.size() == 1;
+    uint32_t stop_at = run == 0 && runs == 2 ? (uint32_t)(s->kill_at * s->size) : UINT32_MAX;
+    ok = ok && get_file(&c, dir, &files[0], s->window, stop_at, &st);
+    if (run == 0 && runs == 2) {
+      first = st;
+      if (s->damage) {
+        int out = open(path.c_str(), O_RDWR);
+        uint8_t v = 0;
+        ok = ok && pread(out, &v, 1, s->size / 4) == 1;
+        v ^= 0x10;
+        ok = ok && pwrite(out, &v, 1, s->size / 4) == 1;
+        close(out);
+      }
+    } else if (ok) {
+      ask(&c, OFF_BYE, 0, 0, 0);
+    }
+    seconds += st.seconds;
+    payload += st.payload;
+    bad += c.parser.bad_frames;
+    if (fd >= 0) close(fd);
+  }
+  board_stop(&b);
+
+  // Byte for byte against the board.
+  std::vector<uint8_t> got(s->size + 1);
+  int in = open(path.c_str(), O_RDONLY);
+  ssize_t n = in >= 0 ? pread(in, got.data(), got.size(), 0) : -1;
+  if (in >= 0) close(in);
+  ok = ok && n == (ssize_t)s->size && memcmp(got.data(), b.data[0].data(), s->size) == 0;
+
+  double rate = s->size / seconds;
+  char link_use[16] = "-";
+  if (s->link->bytes_per_s > 0.0) snprintf(link_use, sizeof(link_use), "%.0f %%", rate / s->link->bytes_per_s * 100.0);
+  char resumed[16] = "-";
+  if (runs == 2) snprintf(resumed, sizeof(resumed), "%u", st.resumed_from >> 10);
+  printf("| %-38s | %-27s | %5u | %6u | %5.1f | %8.2f | %8.0f | %5s | %15.0f | %12s | %4u | %8u | %8u | %10llu | %-5s |\n",
+         s->name, s->link->name, s->chunk, s->window >> 10, s->size / 1048576.0, seconds, rate * 1e-3, link_use,
+         (double)(payload > s->size ? payload - s->size : 0) / 1024.0, resumed, first.asks + st.asks,
+         first.timeouts + st.timeouts, st.repaired, (unsigned long long)bad, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+
+static int sim(void) {
+  char dir[] = "/tmp/offload_sim_XXXXXX";
+  if (!mkdtemp(dir)) {
+    fprintf(stderr, "no temporary folder\n");
+    return 1;
+  }
+  const uint32_t MB = 1u << 20;
+  static const Scenario_t scenarios[] = {
+    { "clean", &PTYLINK_PTY, 4096, 256 * 1024, 64 * MB, 0, 0, { 0, 0 }, 0, false },
+    { "clean", &PTYLINK_USB_FS, 4096, 64 * 1024, 4 * MB, 0, 0, { 0, 0 }, 0, false },
+    { "clean", &PTYLINK_UART_921600, 512, 8 * 1024, MB / 2, 0, 0, { 0, 0 }, 0, false },
+    { "window 4 KB", &PTYLINK_USB_FS, 4096, 4 * 1024, 4 * MB, 0, 0, { 0, 0 }, 0, false },
+    { "window 8 KB", &PTYLINK_USB_FS, 4096, 8 * 1024, 4 * MB, 0, 0, { 0, 0 }, 0, false },
+    { "window 16 KB", &PTYLINK_USB_FS, 4096, 16 * 1024, 4 * MB, 0, 0, { 0, 0 }, 0, false },
+    { "window 4 KB", &PTYLINK_PTY, 4096, 4 * 1024, 16 * MB, 0, 0, { 0, 0 }, 0, false },
+    { "window 16 KB", &PTYLINK_PTY, 4096, 16 * 1024, 16 * MB, 0, 0, { 0, 0 }, 0, false },
+    { "window 64 KB", &PTYLINK_PTY, 4096, 64 * 1024, 16 * MB, 0, 0, { 0, 0 }, 0, false },
+    { "1 frame in 50 corrupted", &PTYLINK_USB_FS, 4096, 64 * 1024, 4 * MB, 50, 0, { 0, 0 }, 0, false },
+    { "1 frame in 50 lost", &PTYLINK_USB_FS, 4096, 64 * 1024, 4 * MB, 0, 50, { 0, 0 }, 0, false },
+    { "1 in 20 corrupted, 1 in 20 lost", &PTYLINK_UART_921600, 512, 8 * 1024, MB / 2, 20, 20, { 0, 0 }, 0, false },
+    { "board reset at 30 % and 70 %", &PTYLINK_USB_FS, 4096, 64 * 1024, 4 * MB, 0, 0, { 0.3, 0.7 }, 0, false },
+    { "client killed at 50 %, restarted", &PTYLINK_USB_FS, 4096, 64 * 1024, 4 * MB, 0, 0, { 0, 0 }, 0.5, false },
+    { "killed at 60 %, saved part damaged", &PTYLINK_USB_FS, 4096, 64 * 1024, 4 * MB, 0, 0, { 0, 0 }, 0.6, true },
+  };
+  printf("| Scenario                               | Link                        | Chunk | Window | MB    | Time (s) | kB/s     | Link  | Sent again (kB) | Resumed (kB) | Asks | Timeouts | Repaired | Bad frames | Check |\n");
+  printf("| -------------------------------------- | --------------------------- | ----- | ------ | ----- | -------- | -------- | ----- | --------------- | ------------ | ---- | -------- | -------- | ---------- | ----- |\n");
+  int failures = 0;
+  for (const Scenario_t &s : scenarios) {
+    failures += !run_scenario(&s, dir);
+    fflush(stdout);
+  }
+  std::string rm = std::string("rm -rf ") + dir;
+  if (system(rm.c_str()) != 0) fprintf(stderr, "could not remove %s\n", dir);
+  printf("\n%s\n", failures ? "FAIL" : "every file fetched matches the board byte for byte");
+  return failures ? 1 : 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Commands
+//--------------------------------------------------------------------------------------------
+static volatile sig_atomic_t Interrupted = 0;
+
+static void on_signal(int) {
+  Interrupted = 1;
+}
+
+
+static int board(int argc, char **argv) {
+  static Board_t b;
+  PtyLinkModel_t model = PTYLINK_USB_FS;
+  size_t chunk = 4096;
+  b.names.clear();
+  b.data.clear();
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--link") && i + 1 < argc) {
+      i++;
+      if (!strcmp(argv[i], "uart")) {
+        model = PTYLINK_UART_921600;
+        chunk = 512;
+      } else if (!strcmp(argv[i], "pty")) {
+        model = PTYLINK_PTY;
+      }
+    } else if (!strcmp(argv[i], "--corrupt") && i + 1 < argc) {
+      model.corrupt_every = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--drop") && i + 1 < argc) {
+      model.drop_every = atof(argv[++i]);
+    } else {
+      FILE *f = fopen(argv[i], "rb");
+      if (!f) {
+        fprintf(stderr, "cannot open %s\n", argv[i]);
+        return 1;
+      }
+      std::vector<uint8_t> d;
+      uint8_t buf[65536];
+      size_t n;
+      while ((n = fread(buf, 1, sizeof(buf), f)) > 0) d.insert(d.end(), buf, buf + n);
+      fclose(f);
+      const char *slash = strrchr(argv[i], '/');
+      b.names.push_back(slash ? slash + 1 : argv[i]);
+      b.data.push_back(d);
+    }
+  }
+  if (b.data.empty() || b.data.size() > OFF_FILES_MAX) {
+    fprintf(stderr, "1 to %d files to serve\n", OFF_FILES_MAX);
+    return 1;
+  }
+  if (!board_start(&b, &model, chunk, 45)) {
+    return 1;
+  }
+  printf("board on %s (%s), Ctrl-C to stop\n", b.link.slave_path.c_str(), model.name);
+  fflush(stdout);
+  signal(SIGINT, on_signal);
+  while (!Interrupted) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  board_stop(&b);
+  printf("\n%llu bytes out in %llu writes, %llu corrupted, %llu dropped; %u requests, %u READ, %u bytes sent again\n",
+         (unsigned long long)b.link.bytes_out, (unsigned long long)b.link.writes,
+         (unsigned long long)b.link.corrupted, (unsigned long long)b.link.dropped, b.server.requests,
+         b.server.reads, b.server.resent);
+  return 0;
+}
+
+
+static int get(const char *tty, const char *dir, const char *only, uint32_t window, long baud, bool list_only) {
+  int fd = port_open(tty, baud);
+  if (fd < 0) {
+    return 1;
+  }
+  Client_t c;
+  client_init(&c, fd);
+  std::vector<Remote_t> files;
+  if (!list(&c, &files)) {
+    fprintf(stderr, "%s : no answer from the board\n", tty);
+    close(fd);
+    return 1;
+  }
+  int failures = 0;
+  for (const Remote_t &r : files) {
+    if (list_only) {
+      printf("%-31s %10u bytes\n", r.name.c_str(), r.size);
+      continue;
+    }
+    if (only && r.name != only) {
+      continue;
+    }
+    Fetch_t st;
+    bool ok = get_file(&c, dir, &r, window, UINT32_MAX, &st);
+    printf("%s : %u bytes from %u in %.1f s (%.0f kB/s), %u asks, %u timeouts, %u blocks repaired, %s\n",
+           r.name.c_str(), r.size, st.resumed_from, st.seconds,
+           (r.size - st.resumed_from) / std::max(st.seconds, 1e-3) * 1e-3, st.asks, st.timeouts, st.repaired,
+           ok ? "verified" : "FAILED");
+    failures += !ok;
+  }
+  ask(&c, OFF_BYE, 0, 0, 0);
+  close(fd);
+  return failures ? 1 : 0;
+}
+
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s list <tty> [--baud N]\n"
+          "       %s get <tty> <dir> [--file NAME] [--window KB] [--baud N]\n"
+          "       %s board [--link usb|uart|pty] [--corrupt N] [--drop N] <file>...\n"
+          "       %s sim\n",
+          argv0, argv0, argv0, argv0);
+}
+
+
+int main(int argc, char **argv) {
+  if (argc == 2 && !strcmp(argv[1], "sim")) {
+    return sim();
+  }
+  if (argc >= 3 && !strcmp(argv[1], "board")) {
+    return board(argc - 2, argv + 2);
+  }
+  bool list_only = argc >= 3 && !strcmp(argv[1], "list");
+  if (!list_only && !(argc >= 4 && !strcmp(argv[1], "get"))) {
+    usage(argv[0]);
+    return 1;
+  }
+  const char *only = NULL;
+  uint32_t window = OFFLOAD_WINDOW;
+  long baud = 921600;
+  for (int i = list_only ? 3 : 4; i < argc; i++) {
+    if (!strcmp(argv[i], "--file") && i + 1 < argc) only = argv[++i];
+    else if (!strcmp(argv[i], "--window") && i + 1 < argc) window = (uint32_t)atol(argv[++i]) * 1024;
+    else if (!strcmp(argv[i], "--baud") && i + 1 < argc) baud = atol(argv[++i]);
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (baud_code(baud) == B0) {
+    fprintf(stderr, "unsupported baud rate %ld\n", baud);
+    return 1;
+  }
+  return get(argv[2], list_only ? NULL : argv[3], only, window, baud, list_only);
+}
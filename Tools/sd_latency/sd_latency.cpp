@@ -0,0 +1,552 @@
+/**
+ * @file sd_latency.cpp
+ * @brief Worst case SD write latency of the flight logger, file system writes against raw sectors.
+ *
+ * Logs the flight computer's record stream (800 Hz ACCEL carrying a record
+ * counter, 50 Hz BARO, 100 Hz STATE, two TIMING, a SPECTRUM and a STORAGE
+ * once a second, a LAUNCH and an APOGEE EVENT) into the log journal
+ * (lib/LogJournal) on a mock card (common/mock_sd.h, SPI timing profile)
+ * formatted FAT32 with 32 KB clusters, the way FatFs writes it
+ * (common/fat_image.h). Every SD_Flush() equivalent (slot commit, index
+ * entry, the once a second sync) is timed on the card model. Four loggers :
+ *
+ * | Logger      | Log file                      | Index                               |
+ * | ----------- | ----------------------------- | ----------------------------------- |
+ * | append      | grows as written (before 039) | appended, 16 bytes per slot         |
+ * | file        | preallocated, slots in place  | appended, 16 bytes per slot (039)   |
+ * | file sector | preallocated, slots in place  | preallocated, a sector per 32 slots |
+ * | raw         | its card sectors, writeRAW()  | its card sectors, writeRAW()        |
+ *
+ * "file sector" is what the firmware falls back to when the preallocated
+ * file is fragmented, "raw" what it does otherwise (040). Raw writes are one
+ * sector per call, as the Arduino SD library's writeRAW().
+ *
+ * Then checks that the logs stay normal files : read back through the FAT
+ * as a PC does, every slot is there in order with every ACCEL counter, and
+ * every index entry written is slot i's, the same LOG_index_slot() rebuilds
+ * from the log at boot. lib/FatExtent is checked to find the card sectors
+ * the file system allocated, and to refuse a fragmented or missing file.
+ *
+ * Both card buses of the firmware (SD_BACKEND) are modelled : SPI at 20 MHz
+ * and the SDMMC host's 4 bit bus. Per bus, the firmware's SD_Benchmark() is
+ * run on the model too : 16 MB of 4 KB slots raw and through the file system,
+ * write MB/s and p50 / p99 / worst slot write, read MB/s.
+ *
+ * The card's random write penalty and buffer merges (FAT, directory and
+ * FSInfo rewrites hit them) are model assumptions, see common/mock_sd.h.
+ *
+ * Usage :
+ *   sd_latency [--minutes N] [--bus spi|sdmmc]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "fat_extent.h"
+#include "fat_image.h"
+#include "flight_log.h"
+#include "log_journal.h"
+#include "mock_sd.h"
+
+
+#define CARD_BYTES (8ULL * 1024 * 1024 * 1024)
+#define CLUSTER_BYTES 32768
+#define JOURNAL_BYTES (1024u * 1024 * 1024)   // LOG_JOURNAL_SIZE of the firmware
+#define INDEX_BYTES (JOURNAL_BYTES / LOG_SLOT_SIZE * sizeof(LOG_IndexEntry_t))
+#define SLOW_FLUSH_MS 50.0                    // 40 ACCEL samples of FIFO at 800 Hz
+#define LOG_NAME "/SENSOR_DATA.bin"
+#define INDEX_NAME "/SENSOR_DATA.idx"
+#define SDBENCH_NAME "/SD_BENCH.bin"
+#define SDBENCH_BYTES (16u * 1024 * 1024)    // SD_BENCH_SIZE of the firmware
+#define SDBENCH_SYNC_SLOTS 4
+
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+typedef enum {
+  MODE_APPEND = 0,
+  MODE_FILE,
+  MODE_FILE_SECTOR,
+  MODE_RAW,
+} Mode_t;
+
+static const char *MODE_NAMES[] = { "append", "file", "file sector", "raw" };
+
+typedef struct {
+  Mode_t mode;
+  MockSd_t sd;
+  FatImage_t vol;
+  FatFile_t log;
+  FatFile_t idx;
+  FATX_Extent_t log_ext;
+  FATX_Extent_t idx_ext;
+  uint8_t sector_buf[FATX_SECTOR_SIZE];
+
+  JRNL_t j;
+  LOG_IndexBlock_t ib;
+  LOG_IndexEntry_t sector[LOG_INDEX_SECTOR_ENTRIES];
+  std::vector<LOG_IndexEntry_t> entries;   // Entries of the slots written, slot i at i
+  std::vector<double> flush_us;
+  uint64_t accel;                          // ACCEL records staged
+  uint64_t accel_lost;                     // Those of slots whose write failed
+
+  double prealloc_ms;
+  double find_ms;
+  uint32_t find_reads;
+  bool extent_ok;
+} Bench_t;
+
+
+//--------------------------------------------------------------------------------------------
+// Storage of each logger
+//--------------------------------------------------------------------------------------------
+static bool card_sector(void *ctx, uint32_t lba, uint8_t *buf) {
+  return MOCKSD_read((MockSd_t *)ctx, (uint64_t)lba * MOCKSD_SECTOR, buf, MOCKSD_SECTOR);
+}
+
+
+// Through the file system; an appended log reads as zeros past its end (no journal there yet).
+static bool file_read(void *ctx, uint64_t offset, void *buf, size_t n) {
+  Bench_t *b = (Bench_t *)ctx;
+  if (offset + n > b->log.size) {
+    memset(buf, 0, n);
+    return true;
+  }
+  return FATIMG_read(&b->vol, &b->log, (uint32_t)offset, buf, n);
+}
+
+static bool file_write(void *ctx, uint64_t offset, const void *buf, size_t n) {
+  Bench_t *b = (Bench_t *)ctx;
+  return FATIMG_seek(&b->vol, &b->log, (uint32_t)offset) && FATIMG_write(&b->vol, &b->log, buf, n);
+}
+
+static bool file_sync(void *ctx) {
+  Bench_t *b = (Bench_t *)ctx;
+  return FATIMG_sync(&b->vol, &b->log);
+}
+
+
+// Sector by sector, as SD.readRAW() / SD.writeRAW().
+static bool raw_read(void *ctx, uint64_t offset, void *buf, size_t n) {
+  Bench_t *b = (Bench_t *)ctx;
+  uint64_t lba = b->log_ext.first_lba + offset / MOCKSD_SECTOR;
+  for (size_t i = 0; i < n / MOCKSD_SECTOR; i++) {
+    if (!MOCKSD_read(&b->sd, (lba + i) * MOCKSD_SECTOR, (uint8_t *)buf + i * MOCKSD_SECTOR, MOCKSD_SECTOR)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool raw_write(void *ctx, uint64_t offset, const void *buf, size_t n) {
+  Bench_t *b = (Bench_t *)ctx;
+  uint64_t lba = b->log_ext.first_lba + offset / MOCKSD_SECTOR;
+  for (size_t i = 0; i < n / MOCKSD_SECTOR; i++) {
+    if (!MOCKSD_write(&b->sd, (lba + i) * MOCKSD_SECTOR, (const uint8_t *)buf + i * MOCKSD_SECTOR, MOCKSD_SECTOR)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+// As SD_Preallocate() : zero the first slot, seek past the end, write a byte.
+static bool preallocate(Bench_t *b, const char *name, FatFile_t *f, uint32_t size) {
+  static const uint8_t zeros[LOG_SLOT_SIZE] = { 0 };
+  static const uint8_t one = 0;
+  return FATIMG_create(&b->vol, name, f) && FATIMG_write(&b->vol, f, zeros, sizeof(zeros)) &&
+         FATIMG_seek(&b->vol, f, size - 1) && FATIMG_write(&b->vol, f, &one, 1) && FATIMG_sync(&b->vol, f);
+}
+
+
+// Card, files and journal of a logger, as SD_Card_Init().
+static bool bench_open(Bench_t *b, Mode_t mode, const MockSdTiming_t *timing) {
+  b->mode = mode;
+  MOCKSD_init(&b->sd, CARD_BYTES, timing);
+  if (!FATIMG_format(&b->vol, &b->sd, CLUSTER_BYTES)) {
+    return false;
+  }
+  double clock0 = b->sd.clock_us;
+  bool ok;
+  if (mode == MODE_APPEND) {
+    ok = FATIMG_create(&b->vol, LOG_NAME, &b->log) && FATIMG_create(&b->vol, INDEX_NAME, &b->idx);
+  } else if (mode == MODE_FILE) {
+    ok = preallocate(b, LOG_NAME, &b->log, JOURNAL_BYTES) && FATIMG_create(&b->vol, INDEX_NAME, &b->idx);
+  } else {
+    ok = preallocate(b, LOG_NAME, &b->log, JOURNAL_BYTES) && preallocate(b, INDEX_NAME, &b->idx, INDEX_BYTES);
+  }
+  b->prealloc_ms = (b->sd.clock_us - clock0) * 1e-3;
+  if (!ok) {
+    return false;
+  }
+
+  // The card sectors lib/FatExtent finds must be those the file system allocated.
+  b->extent_ok = true;
+  if (mode == MODE_RAW) {
+    clock0 = b->sd.clock_us;
+    FATX_Status_t st = FATX_find(card_sector, &b->sd, LOG_NAME, b->sector_buf, &b->log_ext);
+    b->find_reads = b->log_ext.reads;
+    FATX_Status_t st_idx = FATX_find(card_sector, &b->sd, INDEX_NAME, b->sector_buf, &b->idx_ext);
+    b->find_reads += b->idx_ext.reads;
+    b->find_ms = (b->sd.clock_us - clock0) * 1e-3;
+    b->extent_ok = st == FATX_OK && st_idx == FATX_OK &&
+                   b->log_ext.first_lba == FATIMG_cluster_lba(&b->vol, b->log.first_cluster) &&
+                   b->idx_ext.first_lba == FATIMG_cluster_lba(&b->vol, b->idx.first_cluster) &&
+                   b->log_ext.size == JOURNAL_BYTES && (uint64_t)b->log_ext.sectors * MOCKSD_SECTOR >= JOURNAL_BYTES &&
+                   b->idx_ext.size == INDEX_BYTES && (uint64_t)b->idx_ext.sectors * MOCKSD_SECTOR >= INDEX_BYTES;
+    if (!b->extent_ok) {
+      return false;
+    }
+  }
+
+  JRNL_Io_t io = { file_read, file_write, file_sync, b, JOURNAL_BYTES };
+  if (mode == MODE_RAW) {
+    io = { raw_read, raw_write, NULL, b, JOURNAL_BYTES };
+  }
+  JRNL_Recovery_t rec;
+  return JRNL_open(&b->j, &io, 0x0400C0DEu, &rec) && rec.slots == 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Logging
+//--------------------------------------------------------------------------------------------
+static bool index_write(Bench_t *b, uint32_t slot, const LOG_IndexEntry_t *e) {
+  if (b->mode == MODE_APPEND || b->mode == MODE_FILE) {
+    return FATIMG_write(&b->vol, &b->idx, e, sizeof(*e));
+  }
+  b->sector[slot % LOG_INDEX_SECTOR_ENTRIES] = *e;
+  if (slot % LOG_INDEX_SECTOR_ENTRIES != LOG_INDEX_SECTOR_ENTRIES - 1) {
+    return true;
+  }
+  uint32_t offset = slot / LOG_INDEX_SECTOR_ENTRIES * MOCKSD_SECTOR;
+  bool ok = b->mode == MODE_RAW
+                ? MOCKSD_write(&b->sd, ((uint64_t)b->idx_ext.first_lba + offset / MOCKSD_SECTOR) * MOCKSD_SECTOR,
+                               b->sector, MOCKSD_SECTOR)
+                : FATIMG_seek(&b->vol, &b->idx, offset) && FATIMG_write(&b->vol, &b->idx, b->sector, MOCKSD_SECTOR);
+  memset(b->sector, 0, sizeof(b->sector));
+  return ok;
+}
+
+
+// As SD_Flush() : commit the staged slot, its index entry, sync if asked. Timed.
+static void bench_flush(Bench_t *b, bool sync, uint64_t *staged_accel) {
+  double clock0 = b->sd.clock_us;
+  if (b->j.used) {
+    uint32_t slot = b->j.next;
+    LOG_IndexEntry_t e;
+    LOG_index_close(&b->ib, (uint32_t)JRNL_offset(&b->j), &e);
+    if (JRNL_commit(&b->j)) {
+      index_write(b, slot, &e);
+      b->entries.push_back(e);
+    } else {
+      b->accel_lost += *staged_accel;
+    }
+    *staged_accel = 0;
+  }
+  if (sync && b->mode != MODE_RAW) {
+    FATIMG_sync(&b->vol, &b->log);
+    FATIMG_sync(&b->vol, &b->idx);
+  }
+  b->flush_us.push_back(b->sd.clock_us - clock0);
+}
+
+
+static void bench_record(Bench_t *b, uint8_t type, uint64_t t_us, const void *payload, uint16_t len,
+                         uint64_t *staged_accel) {
+  if (!JRNL_fits(&b->j, len)) bench_flush(b, false, staged_accel);
+  if (JRNL_append(&b->j, type, t_us, payload, len)) {
+    LOG_index_add(&b->ib, type, t_us, payload);
+    if (type == LOG_REC_ACCEL) (*staged_accel)++;
+  }
+}
+
+
+static void bench_log(Bench_t *b, double minutes) {
+  uint64_t end = (uint64_t)(minutes * 60e6);
+  uint64_t next_accel = 0, next_baro = 0, next_state = 0, next_second = 1000000;
+  uint64_t counter = 0, staged = 0;
+  static const uint8_t zeros[sizeof(LOG_Spectrum_t)] = { 0 };
+  while (next_accel < end) {
+    uint64_t t = std::min(std::min(next_accel, next_baro), std::min(next_state, next_second));
+    if (t == next_accel) {
+      LOG_Accel_t a;
+      uint64_t c = counter++;
+      memcpy(a.acc_raw, &c, sizeof(a.acc_raw));
+      bench_record(b, LOG_REC_ACCEL, t, &a, sizeof(a), &staged);
+      next_accel += 1250;
+    } else if (t == next_baro) {
+      bench_record(b, LOG_REC_BARO, t, zeros, sizeof(LOG_Baro_t), &staged);
+      next_baro += 20000;
+    } else if (t == next_state) {
+      bench_record(b, LOG_REC_STATE, t, zeros, sizeof(LOG_State_t), &staged);
+      next_state += 10000;
+    } else {
+      if (t == 60000000 || t == 120000000) {
+        LOG_Event_t ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.id = t == 60000000 ? LOG_EVENT_LAUNCH : LOG_EVENT_APOGEE;
+        bench_record(b, LOG_REC_EVENT, t, &ev, sizeof(ev), &staged);
+      }
+      bench_record(b, LOG_REC_TIMING, t, zeros, sizeof(LOG_Timing_t), &staged);
+      bench_record(b, LOG_REC_TIMING, t, zeros, sizeof(LOG_Timing_t), &staged);
+      bench_record(b, LOG_REC_SPECTRUM, t, zeros, sizeof(LOG_Spectrum_t), &staged);
+      bench_record(b, LOG_REC_STORAGE, t, zeros, sizeof(LOG_Storage_t), &staged);
+      bench_flush(b, true, &staged);
+      next_second += 1000000;
+    }
+  }
+  bench_flush(b, true, &staged);   // Landed, last flush
+  b->accel = counter;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Read back, as a PC
+//--------------------------------------------------------------------------------------------
+// Every slot in order with every ACCEL counter; every index entry slot i's,
+// and what LOG_index_slot() rebuilds from the log.
+static bool bench_check(Bench_t *b) {
+  uint32_t slots = b->j.next;
+  if (b->accel_lost || b->j.write_errors || b->entries.size() != slots) {
+    return false;
+  }
+  std::vector<uint8_t> log((size_t)slots * LOG_SLOT_SIZE);
+  if (!FATIMG_read(&b->vol, &b->log, 0, log.data(), log.size())) {
+    return false;
+  }
+  uint64_t counter = 0;
+  LOG_IndexBlock_t ib;
+  memset(&ib, 0, sizeof(ib));
+  for (uint32_t i = 0; i < slots; i++) {
+    const uint8_t *slot = &log[(size_t)i * LOG_SLOT_SIZE];
+    LOG_Commit_t c;
+    LOG_IndexEntry_t e;
+    if (!LOG_slot_check(slot, &c) || c.seq != i || !LOG_index_slot(&ib, slot, i * LOG_SLOT_SIZE, &e) ||
+        memcmp(&e, &b->entries[i], sizeof(e)) != 0) {
+      return false;
+    }
+    for (size_t pos = 0; pos < c.used;) {
+      LOG_Record_t rec;
+      if (LOG_decode(slot + pos, c.used - pos, &rec) != LOG_OK) return false;
+      if (rec.type == LOG_REC_ACCEL) {
+        uint64_t v = 0;
+        memcpy(&v, rec.payload, sizeof(LOG_Accel_t));
+        if (v != counter++) return false;
+      }
+      pos += rec.size;
+    }
+  }
+  if (counter != b->accel) {
+    return false;
+  }
+
+  // Appended : one entry per slot. Preallocated : the whole sectors written,
+  // then zeros, which no reader takes for an entry.
+  bool appended = b->mode == MODE_APPEND || b->mode == MODE_FILE;
+  size_t n = appended ? slots : slots / LOG_INDEX_SECTOR_ENTRIES * LOG_INDEX_SECTOR_ENTRIES;
+  size_t want = appended ? n : n + 1;
+  if (appended && b->idx.size != n * sizeof(LOG_IndexEntry_t)) {
+    return false;
+  }
+  std::vector<LOG_IndexEntry_t> idx(want);
+  if (!FATIMG_read(&b->vol, &b->idx, 0, idx.data(), want * sizeof(LOG_IndexEntry_t))) {
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (!LOG_index_valid(&idx[i]) || idx[i].offset != i * LOG_SLOT_SIZE ||
+        memcmp(&idx[i], &b->entries[i], sizeof(idx[i])) != 0) {
+      return false;
+    }
+  }
+  return appended || idx[n].records == 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// FAT extent lookups
+//--------------------------------------------------------------------------------------------
+// A fragmented file and a missing one are refused; a preallocated one is
+// found by any case of its name, at its first cluster.
+static bool check_extents(void) {
+  MockSd_t *sd = new MockSd_t();
+  MOCKSD_init(sd, 1024ULL * 1024 * 1024, &MOCKSD_SPI_20MHZ);
+  FatImage_t *v = new FatImage_t();
+  FatFile_t *a = new FatFile_t(), *b = new FatFile_t(), *c = new FatFile_t();
+  bool ok = FATIMG_format(v, sd, 4096) && FATIMG_create(v, "INTERLEAVED_A.bin", a) &&
+            FATIMG_create(v, "INTERLEAVED_B.bin", b);
+  static const uint8_t zeros[4096] = { 0 };
+  for (int i = 0; i < 8 && ok; i++) {
+    ok = FATIMG_write(v, a, zeros, sizeof(zeros)) && FATIMG_write(v, b, zeros, sizeof(zeros));
+  }
+  ok = ok && FATIMG_sync(v, a) && FATIMG_sync(v, b) && FATIMG_create(v, "SENSOR_DATA.bin", c) &&
+       FATIMG_seek(v, c, 64 * 1024 * 1024) && FATIMG_write(v, c, zeros, 1) && FATIMG_sync(v, c);
+
+  uint8_t buf[FATX_SECTOR_SIZE];
+  FATX_Extent_t ext;
+  ok = ok && FATX_find(card_sector, sd, "/INTERLEAVED_A.bin", buf, &ext) == FATX_FRAGMENTED;
+  ok = ok && FATX_find(card_sector, sd, "/MISSING.bin", buf, &ext) == FATX_NOT_FOUND;
+  ok = ok && FATX_find(card_sector, sd, "/sensor_data.BIN", buf, &ext) == FATX_OK &&
+       ext.first_lba == FATIMG_cluster_lba(v, c->first_cluster) && ext.size == c->size &&
+       (uint64_t)ext.sectors * FATX_SECTOR_SIZE >= c->size && ext.fat_bits == 32;
+  delete a;
+  delete b;
+  delete c;
+  delete v;
+  delete sd;
+  return ok;
+}
+
+
+static double percentile(std::vector<double> v, double p) {
+  std::sort(v.begin(), v.end());
+  size_t i = (size_t)std::ceil(p * (double)v.size()) - 1;
+  return v[std::min(i, v.size() - 1)];
+}
+
+
+//--------------------------------------------------------------------------------------------
+// SD_Benchmark() on the model
+//--------------------------------------------------------------------------------------------
+// As SD_Bench_Pass() : 4 KB slots of a counter pattern to a preallocated
+// scratch file, a sync every SDBENCH_SYNC_SLOTS, each write and sync timed.
+// Read back slot by slot raw, in one pass through the FAT otherwise (the
+// model's file reads walk the chain from the start).
+static bool bench_throughput(const MockSdTiming_t *timing, bool raw) {
+  Bench_t *b = new Bench_t();
+  b->mode = raw ? MODE_RAW : MODE_FILE_SECTOR;
+  MOCKSD_init(&b->sd, CARD_BYTES, timing);
+  bool ok = FATIMG_format(&b->vol, &b->sd, CLUSTER_BYTES) && preallocate(b, SDBENCH_NAME, &b->log, SDBENCH_BYTES);
+  if (ok && raw) {
+    ok = FATX_find(card_sector, &b->sd, SDBENCH_NAME, b->sector_buf, &b->log_ext) == FATX_OK;
+  }
+  uint32_t slots = SDBENCH_BYTES / LOG_SLOT_SIZE;
+  std::vector<uint8_t> data((size_t)SDBENCH_BYTES);
+  for (size_t k = 0; k < data.size(); k += 4) {
+    uint32_t word = (uint32_t)k;
+    memcpy(&data[k], &word, 4);
+  }
+  std::vector<double> lat;
+  double clock0 = b->sd.clock_us;
+  for (uint32_t i = 0; i < slots && ok; i++) {
+    double w0 = b->sd.clock_us;
+    const uint8_t *slot = &data[(size_t)i * LOG_SLOT_SIZE];
+    ok = raw ? raw_write(b, (uint64_t)i * LOG_SLOT_SIZE, slot, LOG_SLOT_SIZE)
+             : file_write(b, (uint64_t)i * LOG_SLOT_SIZE, slot, LOG_SLOT_SIZE);
+    if (ok && !raw && i % SDBENCH_SYNC_SLOTS == SDBENCH_SYNC_SLOTS - 1) {
+      ok = FATIMG_sync(&b->vol, &b->log);
+    }
+    lat.push_back(b->sd.clock_us - w0);
+  }
+  double write_us = b->sd.clock_us - clock0;
+
+  std::vector<uint8_t> back(data.size());
+  clock0 = b->sd.clock_us;
+  for (uint32_t i = 0; i < slots && ok && raw; i++) {
+    ok = raw_read(b, (uint64_t)i * LOG_SLOT_SIZE, &back[(size_t)i * LOG_SLOT_SIZE], LOG_SLOT_SIZE);
+  }
+  if (ok && !raw) {
+    ok = FATIMG_read(&b->vol, &b->log, 0, back.data(), back.size());
+  }
+  double read_us = b->sd.clock_us - clock0;
+  ok = ok && back == data;
+
+  if (lat.empty()) lat.push_back(0.0);
+  printf("| %-18s | %-4s | %12.2f | %8.2f | %8.2f | %10.2f | %11.2f | %6s |\n", timing->name, raw ? "raw" : "file",
+         (double)SDBENCH_BYTES / write_us, percentile(lat, 0.5) * 1e-3, percentile(lat, 0.99) * 1e-3,
+         *std::max_element(lat.begin(), lat.end()) * 1e-3, (double)SDBENCH_BYTES / read_us, ok ? "ok" : "FAIL");
+  delete b;
+  return ok;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------------------------------
+static int bench_flushes(const MockSdTiming_t *timing, double minutes) {
+  int failures = 0;
+  printf("SD_Flush() latency, %.0f min of flight records, 8 GB FAT32 card, 32 KB clusters, %s\n\n", minutes,
+         timing->name);
+  printf("| Logger      | Flushes | Mean (ms) | p99 (ms) | p99.9 (ms) | Worst (ms) | > %.0f ms | FS sector writes | Random writes | Read back |\n",
+         SLOW_FLUSH_MS);
+  printf("| ----------- | ------- | --------- | -------- | ---------- | ---------- | ------- | ---------------- | ------------- | --------- |\n");
+  for (int m = MODE_APPEND; m <= MODE_RAW; m++) {
+    auto start = std::chrono::steady_clock::now();
+    Bench_t *b = new Bench_t();
+    bool ok = bench_open(b, (Mode_t)m, timing);
+    uint64_t meta0 = b->vol.meta_writes, random0 = b->sd.random_writes;
+    if (ok) {
+      bench_log(b, minutes);
+      ok = bench_check(b);
+    }
+    failures += !ok;
+    if (b->flush_us.empty()) b->flush_us.push_back(0.0);
+    double sum = 0.0;
+    size_t slow = 0;
+    for (double us : b->flush_us) {
+      sum += us;
+      slow += us > SLOW_FLUSH_MS * 1e3;
+    }
+    printf("| %-11s | %7zu | %9.2f | %8.2f | %10.2f | %10.2f | %7zu | %16llu | %13llu | %9s |\n", MODE_NAMES[m],
+           b->flush_us.size(), sum / (double)b->flush_us.size() * 1e-3, percentile(b->flush_us, 0.99) * 1e-3,
+           percentile(b->flush_us, 0.999) * 1e-3,
+           *std::max_element(b->flush_us.begin(), b->flush_us.end()) * 1e-3, slow,
+           (unsigned long long)(b->vol.meta_writes - meta0), (unsigned long long)(b->sd.random_writes - random0),
+           ok ? "exact" : "FAIL");
+    if (m == MODE_RAW) {
+      printf("\nBoot : preallocating the journal and index %.0f ms, finding their sectors %.1f ms (%u sector reads). "
+             "Host %.1f s.\n\n",
+             b->prealloc_ms, b->find_ms, b->find_reads, seconds_since(start));
+    }
+    delete b;
+  }
+  return failures;
+}
+
+
+int main(int argc, char **argv) {
+  double minutes = 30.0;
+  std::vector<const MockSdTiming_t *> buses = { &MOCKSD_SPI_20MHZ, &MOCKSD_SDMMC_4BIT };
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--minutes") && i + 1 < argc) minutes = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--bus") && i + 1 < argc && !strcmp(argv[i + 1], "spi")) buses = { &MOCKSD_SPI_20MHZ }, i++;
+    else if (!strcmp(argv[i], "--bus") && i + 1 < argc && !strcmp(argv[i + 1], "sdmmc")) buses = { &MOCKSD_SDMMC_4BIT }, i++;
+    else {
+      fprintf(stderr, "usage: %s [--minutes N] [--bus spi|sdmmc]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (minutes <= 0.0) {
+    fprintf(stderr, "--minutes must be positive\n");
+    return 1;
+  }
+
+  int failures = 0;
+  bool extents = check_extents();
+  failures += !extents;
+  printf("FAT extents : fragmented and missing files refused, preallocated file found : %s\n\n",
+         extents ? "ok" : "FAIL");
+
+  for (const MockSdTiming_t *timing : buses) {
+    failures += bench_flushes(timing, minutes);
+  }
+
+  printf("SD_Benchmark(), %u MB of 4 KB slots, a sync every %d\n\n", SDBENCH_BYTES >> 20, SDBENCH_SYNC_SLOTS);
+  printf("| Bus                | Path | Write (MB/s) | p50 (ms) | p99 (ms) | Worst (ms) | Read (MB/s) | Check  |\n");
+  printf("| ------------------ | ---- | ------------ | -------- | -------- | ---------- | ----------- | ------ |\n");
+  for (const MockSdTiming_t *timing : buses) {
+    failures += !bench_throughput(timing, true);
+    failures += !bench_throughput(timing, false);
+  }
+  printf("\n%s\n", failures ? "FAIL" : "all logs read back exactly");
+  return failures ? 1 : 0;
+}
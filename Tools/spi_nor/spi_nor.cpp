@@ -0,0 +1,685 @@
+/**
+ * @file spi_nor.cpp
+ * @brief External SPI NOR log (lib/SpiNor) on a W25Q chip model : throughput, a flight, power cuts, read out.
+ *
+ * Drives the driver against the command level chip model of
+ * common/mock_w25q.h (W25Q128JV, 16 MB) at the bus speed of each board, the
+ * STM32G030 (SPI1 at 8 MHz) and the ESP32-S3 (40 MHz). Every run counts the
+ * commands the chip would have ignored (protocol violations, must be 0).
+ *
+ * - Throughput : 4 MB written as fast as a producer fills pages (--fill-us of
+ *   CPU per page, encoding records), on a blank chip and erasing 64 KB blocks
+ *   on the way. The blocking writer programs a page and waits for it, and
+ *   erases a block in line when it gets there; the pipelined one (NOR_Log_t)
+ *   fills the next page while the last one programs and erases one block
+ *   ahead in the background, suspending it for each page.
+ *
+ * - Flight : the flight computer's record stream (ACCEL at 800 Hz carrying a
+ *   record counter, 50 Hz BARO, STATE every 8 ACCEL, two TIMING, a SPECTRUM
+ *   and two STORAGE once a second) for --minutes, the writer serviced at
+ *   every ACCEL as a main loop would. Per writer : rate logged, share of the
+ *   CPU inside writer calls, the longest call, ACCEL samples handed over more
+ *   than LATE_US after they were due (a sensor FIFO of ~8 samples gone),
+ *   bytes dropped, erase suspends, pages that waited for an erase of their
+ *   own block, chip busy time. Then the log is read back : every ACCEL
+ *   counter, in order, and the minutes of flight kept (the ring writes over
+ *   its oldest slots, it must keep an unbroken tail). The ESP32 row is the flash ring (lib/FlashRing) on
+ *   the chip, as main.cpp runs it with FLASH_LOG_DEVICE at FLASH_DEVICE_W25Q.
+ *
+ * - Power cuts : inside every 5th page program or block erase of a streaming
+ *   log flight, the log opened again keeps every page programmed before the
+ *   cut, goes on after it and never programs over bits that are not erased.
+ *
+ * - Read out : time to stream the log to the host, bus and link.
+ *
+ * Usage :
+ *   spi_nor [--minutes N] [--fill-us N]
+ *   spi_nor fetch <tty> <out.bin> [baud]
+ *
+ * fetch reads the log out of a board over its serial port : it sends 'D'
+ * every 0.2 s (start it, then reset the board) until the firmware answers
+ * "NORDUMP <bytes>\n" and the raw bytes of the log (STM32 : W25Q_Dump(),
+ * ESP32 : at boot, FLASH_DUMP_WAIT_MS). The STM32 log
+ * is a record stream that log_decode reads as it is; the ESP32 one is a flash
+ * ring partition, for flash_ring unwrap.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "flash_ring.h"
+#include "flight_log.h"
+#include "mock_w25q.h"
+#include "spi_nor.h"
+
+
+#define CHIP_BYTES (16u * 1024 * 1024)
+#define THROUGHPUT_BYTES (4u * 1024 * 1024)
+#define LATE_US 10000.0               // ~8 ACCEL samples at 800 Hz
+#define RUNWAY_SLOTS 1280             // FLASH_RUNWAY_SLOTS of the firmware
+#define CUT_SECONDS 20.0
+#define CUT_STEP 5
+#define FETCH_ASKS 150                // 30 s of 'D' without a NORDUMP header
+
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Writers
+//--------------------------------------------------------------------------------------------
+typedef enum {
+  WRITER_BLOCKING = 0,        // Program a page and wait, erase in line
+  WRITER_PIPELINED,           // NOR_Log_t
+  WRITER_RING,                // lib/FlashRing on the chip
+} Writer_t;
+
+typedef struct {
+  MockW25Q_t chip;
+  NOR_t nor;
+  Writer_t writer;
+  NOR_Log_t log;
+  // Blocking writer
+  uint8_t page[NOR_PAGE_SIZE];
+  uint32_t fill, head, erased;
+  // Flash ring
+  FRING_t ring;
+  uint32_t runway;
+  // MCU time inside writer calls
+  double call_us, call_max_us;
+  double t0_us;
+} Rig_t;
+
+
+static void idle_yield(void *ctx, uint32_t waited_us) {
+  (void)waited_us;
+  MOCKW25Q_advance((MockW25Q_t *)ctx, ((MockW25Q_t *)ctx)->now_us + 50.0);   // taskYIELD() to other work
+}
+
+
+static bool ring_read(void *ctx, uint32_t offset, void *buf, size_t n) {
+  return NOR_read((NOR_t *)ctx, offset, buf, n);
+}
+
+
+static bool ring_write(void *ctx, uint32_t offset, const void *buf, size_t n) {
+  return NOR_program((NOR_t *)ctx, offset, buf, n);
+}
+
+
+static bool ring_erase(void *ctx, uint32_t offset, size_t n) {
+  return NOR_erase((NOR_t *)ctx, offset, n);
+}
+
+
+// Boot on the chip as it is : the driver, then the log.
+static bool rig_boot(Rig_t *r, Writer_t writer, uint32_t runway) {
+  NOR_Bus_t bus = MOCKW25Q_bus(&r->chip);
+  if (writer == WRITER_RING) bus.idle = idle_yield;
+  if (!NOR_init(&r->nor, &bus)) {
+    return false;
+  }
+  r->writer = writer;
+  r->runway = runway;
+  r->call_us = r->call_max_us = 0.0;
+  switch (writer) {
+    case WRITER_BLOCKING:
+      // Its end found as the streaming log's.
+      if (!NOR_log_open(&r->log, &r->nor, 0, r->nor.size, 0)) {
+        return false;
+      }
+      r->fill = 0;
+      r->head = r->log.head;
+      r->erased = r->log.erased;
+      return true;
+    case WRITER_PIPELINED:
+      return NOR_log_open(&r->log, &r->nor, 0, r->nor.size, runway);
+    default: {
+      FRING_Io_t io = { ring_read, ring_write, ring_erase, &r->nor, r->nor.size };
+      FRING_Recovery_t rec;
+      return FRING_open(&r->ring, &io, 0x4E4F5231u, &rec);
+    }
+  }
+}
+
+
+static void call_begin(Rig_t *r) {
+  r->t0_us = r->chip.now_us;
+}
+
+
+static void call_end(Rig_t *r) {
+  double us = r->chip.now_us - r->t0_us;
+  r->call_us += us;
+  r->call_max_us = std::max(r->call_max_us, us);
+}
+
+
+static void blocking_page(Rig_t *r) {
+  if (r->head >= r->erased) {
+    NOR_erase(&r->nor, r->head, NOR_BLOCK_SIZE);
+    NOR_wait(&r->nor);
+    r->erased += NOR_BLOCK_SIZE;
+  }
+  NOR_program(&r->nor, r->head, r->page, NOR_PAGE_SIZE);
+  NOR_wait(&r->nor);
+  r->head += NOR_PAGE_SIZE;
+  r->fill = 0;
+}
+
+
+static void rig_write(Rig_t *r, uint8_t type, uint64_t t_us, const void *payload, uint16_t len) {
+  uint8_t rec[LOG_OVERHEAD + sizeof(LOG_Spectrum_t)];
+  call_begin(r);
+  switch (r->writer) {
+    case WRITER_BLOCKING: {
+      size_t n = LOG_encode(rec, type, t_us, payload, len);
+      for (size_t at = 0; at < n;) {
+        size_t take = std::min(n - at, (size_t)(NOR_PAGE_SIZE - r->fill));
+        memcpy(r->page + r->fill, rec + at, take);
+        r->fill += (uint32_t)take;
+        at += take;
+        if (r->fill == NOR_PAGE_SIZE) blocking_page(r);
+      }
+      break;
+    }
+    case WRITER_PIPELINED:
+      NOR_log_write(&r->log, rec, LOG_encode(rec, type, t_us, payload, len));
+      break;
+    default:
+      if (!FRING_fits(&r->ring, len)) FRING_commit(&r->ring);
+      FRING_append(&r->ring, type, t_us, payload, len);
+      break;
+  }
+  call_end(r);
+}
+
+
+// Main loop pass : start the next page program, erase ahead.
+static void rig_service(Rig_t *r) {
+  call_begin(r);
+  if (r->writer == WRITER_PIPELINED) NOR_log_service(&r->log);
+  if (r->writer == WRITER_RING) FRING_service(&r->ring, r->runway);
+  call_end(r);
+}
+
+
+// Once a second : the ring commits its slot, the streaming log needs nothing.
+static void rig_second(Rig_t *r) {
+  call_begin(r);
+  if (r->writer == WRITER_RING) FRING_commit(&r->ring);
+  call_end(r);
+}
+
+
+// The pad : erase the runway ahead.
+static void rig_pad(Rig_t *r) {
+  if (r->writer == WRITER_PIPELINED) {
+    while (r->log.erased < r->log.end && r->log.erased - r->log.head < r->log.runway) {
+      NOR_log_service(&r->log);
+    }
+  } else if (r->writer == WRITER_RING) {
+    while (FRING_service(&r->ring, r->runway)) {
+    }
+  }
+  NOR_wait(&r->nor);
+}
+
+
+static void rig_flush(Rig_t *r) {
+  if (r->writer == WRITER_PIPELINED) NOR_log_flush(&r->log);
+  if (r->writer == WRITER_RING) FRING_commit(&r->ring);
+  if (r->writer == WRITER_BLOCKING && r->fill > 0) {
+    memset(r->page + r->fill, 0xFF, NOR_PAGE_SIZE - r->fill);
+    blocking_page(r);
+  }
+  NOR_wait(&r->nor);
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Flight
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  uint64_t counter;           // Next ACCEL counter
+  uint64_t late;              // ACCEL handed over more than LATE_US after due
+  double t_us;                // Flight clock
+  std::vector<uint32_t> accel_end;  // Streaming log : bytes handed over up to the end of each ACCEL
+} Flight_t;
+
+
+static void flight_start(Flight_t *f, uint64_t counter, double t_us) {
+  f->counter = counter;
+  f->late = 0;
+  f->t_us = t_us;
+  f->accel_end.clear();
+}
+
+
+// seconds of flight, the chip's clock following the flight clock; stops at a power cut.
+static void fly(Rig_t *r, Flight_t *f, double seconds) {
+  static const uint8_t zeros[sizeof(LOG_Spectrum_t)] = { 0 };
+  double end = f->t_us + seconds * 1e6;
+  double next_accel = f->t_us, next_baro = f->t_us, next_second = f->t_us + 1e6;
+  uint32_t state_div = 0;
+  while (next_accel < end && r->chip.powered) {
+    double t = std::min(next_accel, std::min(next_baro, next_second));
+    f->t_us = t;
+    MOCKW25Q_advance(&r->chip, t);
+    uint64_t t_us = (uint64_t)t;
+    if (t == next_accel) {
+      if (r->chip.now_us > t + LATE_US) f->late++;
+      LOG_Accel_t a;
+      uint64_t c = f->counter++;
+      memcpy(a.acc_raw, &c, sizeof(a.acc_raw));
+      rig_write(r, LOG_REC_ACCEL, t_us, &a, sizeof(a));
+      if (r->writer == WRITER_PIPELINED) f->accel_end.push_back(r->log.filled * NOR_PAGE_SIZE + r->log.fill);
+      if (++state_div == 8) {
+        rig_write(r, LOG_REC_STATE, t_us, zeros, sizeof(LOG_State_t));
+        state_div = 0;
+      }
+      rig_service(r);
+      next_accel += 1250.0;
+    } else if (t == next_baro) {
+      rig_write(r, LOG_REC_BARO, t_us, zeros, sizeof(LOG_Baro_t));
+      next_baro += 20000.0;
+    } else {
+      rig_write(r, LOG_REC_TIMING, t_us, zeros, sizeof(LOG_Timing_t));
+      rig_write(r, LOG_REC_TIMING, t_us, zeros, sizeof(LOG_Timing_t));
+      rig_write(r, LOG_REC_SPECTRUM, t_us, zeros, sizeof(LOG_Spectrum_t));
+      rig_write(r, LOG_REC_STORAGE, t_us, zeros, sizeof(LOG_Storage_t));
+      rig_write(r, LOG_REC_STORAGE, t_us, zeros, sizeof(LOG_Storage_t));
+      rig_second(r);
+      next_second += 1e6;
+    }
+  }
+}
+
+
+// ACCEL counters of a record stream, bad bytes skipped as log_decode does.
+static void stream_counters(const uint8_t *buf, size_t n, std::vector<uint64_t> *counters) {
+  size_t at = 0;
+  while (at < n) {
+    LOG_Record_t rec;
+    LOG_Status_t st = LOG_decode(buf + at, n - at, &rec);
+    if (st == LOG_NEED_MORE) {
+      break;
+    }
+    if (st != LOG_OK) {
+      at++;
+      continue;
+    }
+    if (rec.type == LOG_REC_ACCEL) {
+      uint64_t c = 0;
+      memcpy(&c, rec.payload, sizeof(LOG_Accel_t));
+      counters->push_back(c);
+    }
+    at += rec.size;
+  }
+}
+
+
+// Every ACCEL counter the chip holds, reading it as the host would after a dump.
+static bool read_counters(Rig_t *r, std::vector<uint64_t> *counters) {
+  counters->clear();
+  if (r->writer == WRITER_RING) {
+    static uint8_t slot[LOG_SLOT_SIZE];
+    for (uint32_t seq = r->ring.first; seq < r->ring.next; seq++) {
+      LOG_Commit_t c;
+      if (!FRING_read(&r->ring, seq, slot) || !LOG_slot_check(slot, &c)) {
+        return false;
+      }
+      stream_counters(slot, c.used, counters);
+    }
+    return true;
+  }
+  uint32_t head = r->writer == WRITER_PIPELINED ? r->log.head : r->head;
+  std::vector<uint8_t> buf(head);
+  if (!NOR_read(&r->nor, 0, buf.data(), head)) {
+    return false;
+  }
+  stream_counters(buf.data(), head, counters);
+  return true;
+}
+
+
+typedef struct {
+  const char *name;
+  const MockW25QTiming_t *timing;
+  Writer_t writer;
+  uint32_t runway;
+} Setup_t;
+
+
+static bool bench_flight(const Setup_t *s, double minutes) {
+  static Rig_t r;
+  MOCKW25Q_init(&r.chip, CHIP_BYTES, s->timing);
+  // The streaming log's chip is erased after each read out; the ring's holds
+  // the flights before, every sector it takes must be erased.
+  if (s->writer == WRITER_RING) memset(r.chip.flash.mem.data(), 0, CHIP_BYTES);
+  if (!rig_boot(&r, s->writer, s->runway)) {
+    return false;
+  }
+  rig_pad(&r);
+  static Flight_t f;
+  flight_start(&f, 0, r.chip.now_us);
+  double clock0 = r.chip.now_us, busy0 = r.chip.chip_busy_us;
+  uint64_t suspends0 = r.chip.suspends;
+  fly(&r, &f, minutes * 60.0);
+  double flight_us = r.chip.now_us - clock0;
+  double call_us = r.call_us, call_max_us = r.call_max_us;
+  rig_flush(&r);
+  double busy = (r.chip.chip_busy_us - busy0) / flight_us;
+  uint32_t bytes = s->writer == WRITER_RING ? (r.ring.next * LOG_SLOT_SIZE)
+                   : s->writer == WRITER_PIPELINED ? r.log.head : r.head;
+  uint32_t dropped = s->writer == WRITER_PIPELINED ? r.log.dropped : 0;
+  uint32_t erase_waits = s->writer == WRITER_PIPELINED ? r.log.erase_waits : 0;
+
+  // Reboot and read back : counters strictly in order; when nothing was
+  // dropped, every one from the oldest kept to the last.
+  std::vector<uint64_t> counters;
+  bool ok = rig_boot(&r, s->writer, s->runway) && read_counters(&r, &counters) && !counters.empty();
+  for (size_t i = 1; ok && i < counters.size(); i++) ok = counters[i] > counters[i - 1];
+  ok = ok && (dropped > 0 || (counters.back() == f.counter - 1 &&
+                              counters.size() == counters.back() - counters.front() + 1)) &&
+       (s->writer == WRITER_RING || dropped > 0 || counters.front() == 0) && r.chip.violations == 0 &&
+       r.chip.flash.dirty_programs == 0;
+  double kept_min = counters.size() / 800.0 / 60.0;
+  // The ring runs in its own writer task : late samples are not its business.
+  char late[16] = "-";
+  if (s->writer != WRITER_RING) snprintf(late, sizeof(late), "%llu", (unsigned long long)f.late);
+  printf("| %-34s | %6.1f | %5.2f %% | %17.1f | %6s | %11u | %10.1f | %8llu | %11u | %7.1f %% | %10llu | %-5s |\n",
+         s->name, bytes / flight_us * 1e3, call_us / flight_us * 100.0, call_max_us * 1e-3, late,
+         dropped, kept_min, (unsigned long long)(r.chip.suspends - suspends0), erase_waits, busy * 100.0,
+         (unsigned long long)r.chip.violations, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Throughput
+//--------------------------------------------------------------------------------------------
+// THROUGHPUT_BYTES as fast as the producer fills pages. The writers erase a block before using it, blank or not.
+static bool bench_throughput(const MockW25QTiming_t *t, Writer_t writer, bool erase, double fill_us, double *kb_s) {
+  static Rig_t r;
+  MOCKW25Q_init(&r.chip, CHIP_BYTES, t);
+  if (!rig_boot(&r, writer, NOR_BLOCK_SIZE)) {
+    return false;
+  }
+  if (!erase) {
+    // As after a pad erase of the whole run.
+    r.erased = r.log.erased = THROUGHPUT_BYTES;
+  }
+  static uint8_t data[NOR_PAGE_SIZE];
+  memset(data, 0x5A, sizeof(data));
+  double clock0 = r.chip.now_us;
+  for (uint32_t done = 0; done < THROUGHPUT_BYTES; done += NOR_PAGE_SIZE) {
+    MOCKW25Q_advance(&r.chip, r.chip.now_us + fill_us);
+    call_begin(&r);
+    if (writer == WRITER_BLOCKING) {
+      memcpy(r.page, data, sizeof(data));
+      blocking_page(&r);
+    } else {
+      while (r.log.filled - r.log.programmed >= NOR_LOG_PAGES) NOR_log_service(&r.log);
+      NOR_log_write(&r.log, data, sizeof(data));
+      NOR_log_service(&r.log);
+    }
+    call_end(&r);
+  }
+  rig_flush(&r);
+  *kb_s = THROUGHPUT_BYTES / (r.chip.now_us - clock0) * 1e3;
+  std::vector<uint8_t> back(THROUGHPUT_BYTES);
+  return NOR_read(&r.nor, 0, back.data(), back.size()) &&
+         std::all_of(back.begin(), back.end(), [](uint8_t b) { return b == 0x5A; }) &&
+         r.chip.violations == 0 && r.chip.flash.dirty_programs == 0 && (writer != WRITER_PIPELINED || r.log.dropped == 0);
+}
+
+
+static bool bench_throughputs(double fill_us) {
+  static const MockW25QTiming_t *timings[] = { &MOCKW25Q_STM32G0, &MOCKW25Q_ESP32 };
+  bool ok = true;
+  printf("| Bus                              | Writer    | Blank (kB/s) | Erasing (kB/s) | Check |\n");
+  printf("| -------------------------------- | --------- | ------------ | -------------- | ----- |\n");
+  for (const MockW25QTiming_t *t : timings) {
+    for (Writer_t w : { WRITER_BLOCKING, WRITER_PIPELINED }) {
+      double blank, erasing;
+      bool run_ok = bench_throughput(t, w, false, fill_us, &blank) && bench_throughput(t, w, true, fill_us, &erasing);
+      printf("| %-32s | %-9s | %12.0f | %14.0f | %-5s |\n", t->name, w == WRITER_BLOCKING ? "blocking" : "pipelined",
+             blank, erasing, run_ok ? "ok" : "FAIL");
+      ok = ok && run_ok;
+    }
+  }
+  return ok;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Power cuts
+//--------------------------------------------------------------------------------------------
+// A cut inside every CUT_STEP-th program or erase of a streaming log flight :
+// the pages programmed before it read back, the log goes on after it.
+static bool check_power_cuts(void) {
+  static Rig_t r;
+  static Flight_t f, again;
+  uint64_t ops_total;
+  {
+    MOCKW25Q_init(&r.chip, CHIP_BYTES, &MOCKW25Q_STM32G0);
+    rig_boot(&r, WRITER_PIPELINED, NOR_BLOCK_SIZE);
+    rig_pad(&r);
+    flight_start(&f, 0, r.chip.now_us);
+    fly(&r, &f, CUT_SECONDS);
+    ops_total = r.chip.programs + r.chip.erases;
+  }
+
+  int cuts = 0, failures = 0;
+  for (uint64_t cut = 0; cut < ops_total; cut += CUT_STEP) {
+    MOCKW25Q_init(&r.chip, CHIP_BYTES, &MOCKW25Q_STM32G0);
+    rig_boot(&r, WRITER_PIPELINED, NOR_BLOCK_SIZE);
+    uint64_t ops0 = r.chip.programs + r.chip.erases;
+    MOCKW25Q_cut_after(&r.chip, cut - std::min(cut, ops0));
+    rig_pad(&r);
+    flight_start(&f, 0, r.chip.now_us);
+    fly(&r, &f, CUT_SECONDS);
+    // Pages handed to the chip before the one cut are programmed, and the ACCEL records inside them.
+    uint32_t safe_bytes = r.log.programmed > 1 ? (r.log.programmed - 1) * NOR_PAGE_SIZE : 0;
+    uint64_t safe = std::upper_bound(f.accel_end.begin(), f.accel_end.end(), safe_bytes) - f.accel_end.begin();
+    MOCKW25Q_power_on(&r.chip);
+    cuts++;
+
+    std::vector<uint64_t> counters;
+    bool ok = rig_boot(&r, WRITER_PIPELINED, NOR_BLOCK_SIZE) && r.log.head >= safe_bytes &&
+              read_counters(&r, &counters);
+    uint64_t expect = 0;
+    while (expect < counters.size() && counters[expect] == expect) expect++;
+    ok = ok && r.log.dropped == 0 && expect >= safe;
+    for (size_t i = 1; ok && i < counters.size(); i++) ok = counters[i] > counters[i - 1];
+
+    // Log on after the cut, everything programmed is read back.
+    rig_pad(&r);
+    flight_start(&again, counters.empty() ? 0 : counters.back() + 1, r.chip.now_us);
+    uint64_t first_new = again.counter;
+    fly(&r, &again, 5.0);
+    rig_flush(&r);
+    ok = ok && rig_boot(&r, WRITER_PIPELINED, NOR_BLOCK_SIZE) && read_counters(&r, &counters) &&
+         !counters.empty() && counters.back() == again.counter - 1 &&
+         std::count_if(counters.begin(), counters.end(), [&](uint64_t c) { return c >= first_new; }) ==
+             (long)(again.counter - first_new) &&
+         r.chip.violations == 0 && r.chip.flash.dirty_programs == 0;
+    failures += !ok;
+  }
+  printf("power cuts : %d cuts over %llu program and erase operations, %d lost a programmed page or the log after\n",
+         cuts, (unsigned long long)ops_total, failures);
+  return failures == 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Read out
+//--------------------------------------------------------------------------------------------
+static void read_out_times(uint32_t log_bytes) {
+  typedef struct { const char *name; const MockW25QTiming_t *bus; double link_kb_s; } Link_t;
+  static const Link_t links[] = {
+    { "STM32G030 USART2 921600 8N1", &MOCKW25Q_STM32G0, 92.16 },
+    { "ESP32-S3 USB CDC (~1 MB/s)", &MOCKW25Q_ESP32, 1000.0 },
+  };
+  printf("| Link                         | Bus read (kB/s) | Link (kB/s) | %5.1f MB log (s) | 16 MB chip (s) |\n",
+         log_bytes / 1e6);
+  printf("| ---------------------------- | --------------- | ----------- | ---------------- | -------------- |\n");
+  for (const Link_t &l : links) {
+    // 4 KB reads, as the dump does.
+    double read_us = l.bus->xfer_us + (5.0 + 4096.0) * 8.0 / l.bus->spi_mhz;
+    double bus_kb_s = 4096.0 / read_us * 1e3;
+    // The link sends while the next chunk is read.
+    double kb_s = std::min(bus_kb_s, l.link_kb_s);
+    printf("| %-28s | %15.0f | %11.0f | %16.0f | %14.0f |\n", l.name, bus_kb_s, l.link_kb_s, log_bytes / kb_s * 1e-3,
+           CHIP_BYTES / kb_s * 1e-3);
+  }
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Fetch a dump over a serial port
+//--------------------------------------------------------------------------------------------
+static speed_t baud_code(long baud) {
+  switch (baud) {
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return B0;
+  }
+}
+
+
+static int fetch(const char *tty, const char *out_path, long baud) {
+  speed_t speed = baud_code(baud);
+  if (speed == B0) {
+    fprintf(stderr, "unsupported baud rate %ld\n", baud);
+    return 1;
+  }
+  int fd = open(tty, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    fprintf(stderr, "cannot open %s\n", tty);
+    return 1;
+  }
+  struct termios tio;
+  tcgetattr(fd, &tio);
+  cfmakeraw(&tio);
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 2;          // 0.2 s without a byte : 'D' again
+  tcsetattr(fd, TCSANOW, &tio);
+  tcflush(fd, TCIOFLUSH);
+
+  // "NORDUMP <bytes>\n", anything the board printed before it skipped.
+  char line[64];
+  size_t len = 0;
+  unsigned long total = 0;
+  int asks = 0;
+  for (;;) {
+    char c;
+    if (read(fd, &c, 1) != 1) {
+      if (asks++ == FETCH_ASKS || write(fd, "D", 1) != 1) {
+        fprintf(stderr, "%s : no NORDUMP header\n", tty);
+        close(fd);
+        return 1;
+      }
+      continue;
+    }
+    if (c != '\n') {
+      if (len < sizeof(line) - 1) line[len++] = c;
+      continue;
+    }
+    line[len] = 0;
+    len = 0;
+    if (sscanf(line, "NORDUMP %lu", &total) == 1) {
+      break;
+    }
+  }
+
+  tio.c_cc[VTIME] = 20;         // 2 s without a byte ends the dump
+  tcsetattr(fd, TCSANOW, &tio);
+  FILE *out = fopen(out_path, "wb");
+  if (!out) {
+    fprintf(stderr, "cannot create %s\n", out_path);
+    close(fd);
+    return 1;
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  static uint8_t buf[4096];
+  unsigned long got = 0;
+  while (got < total) {
+    ssize_t n = read(fd, buf, std::min((unsigned long)sizeof(buf), total - got));
+    if (n <= 0) {
+      break;
+    }
+    fwrite(buf, 1, (size_t)n, out);
+    got += (unsigned long)n;
+    if (got % (256 * 1024) < (unsigned long)n) {
+      fprintf(stderr, "\r%lu / %lu kB", got >> 10, total >> 10);
+    }
+  }
+  fclose(out);
+  close(fd);
+  double s = seconds_since(t0);
+  fprintf(stderr, "\n");
+  printf("%s : %lu of %lu bytes in %.1f s (%.0f kB/s) to %s\n", tty, got, total, s, got / s * 1e-3, out_path);
+  return got == total ? 0 : 1;
+}
+
+
+int main(int argc, char **argv) {
+  if ((argc == 4 || argc == 5) && !strcmp(argv[1], "fetch")) {
+    return fetch(argv[2], argv[3], argc == 5 ? atol(argv[4]) : 921600);
+  }
+  double minutes = 10.0, fill_us = 300.0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--minutes") && i + 1 < argc) minutes = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--fill-us") && i + 1 < argc) fill_us = atof(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--minutes N] [--fill-us N]\n       %s fetch <tty> <out.bin> [baud]\n", argv[0],
+              argv[0]);
+      return 1;
+    }
+  }
+  if (minutes <= 0.0 || minutes > 12.0 || fill_us < 0.0) {
+    fprintf(stderr, "--minutes must be in (0, 12] (16 MB at ~20 kB/s), --fill-us positive\n");
+    return 1;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  int failures = 0;
+  printf("Throughput : %u kB, %.0f us of CPU to fill each page\n\n", THROUGHPUT_BYTES >> 10, fill_us);
+  failures += !bench_throughputs(fill_us);
+
+  printf("\nFlight : %.0f min, 800 Hz ACCEL, writer serviced at every ACCEL\n\n", minutes);
+  static const Setup_t setups[] = {
+    { "STM32G030, blocking", &MOCKW25Q_STM32G0, WRITER_BLOCKING, 0 },
+    { "STM32G030, pipelined, no runway", &MOCKW25Q_STM32G0, WRITER_PIPELINED, 0 },
+    { "STM32G030, pipelined, 64 KB runway", &MOCKW25Q_STM32G0, WRITER_PIPELINED, NOR_BLOCK_SIZE },
+    { "ESP32-S3, flash ring, 1280 slots", &MOCKW25Q_ESP32, WRITER_RING, RUNWAY_SLOTS },
+  };
+  printf("| Setup                              | kB/s   | CPU     | Longest call (ms) | Late   | Dropped (B) | Kept (min) | Suspends | Erase waits | Chip busy | Violations | Check |\n");
+  printf("| ---------------------------------- | ------ | ------- | ----------------- | ------ | ----------- | ---------- | -------- | ----------- | --------- | ---------- | ----- |\n");
+  for (const Setup_t &s : setups) {
+    failures += !bench_flight(&s, minutes);
+  }
+  printf("\n");
+  failures += !check_power_cuts();
+  printf("\n");
+  read_out_times((uint32_t)(minutes * 60.0 * 20500.0));
+  printf("\n%s (%.1f s)\n", failures ? "FAIL" : "all logs read back exactly", seconds_since(t0));
+  return failures ? 1 : 0;
+}
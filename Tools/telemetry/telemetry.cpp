@@ -0,0 +1,553 @@
+/**
+ * @file telemetry.cpp
+ * @brief LoRa telemetry downlink (lib/Telemetry, lib/Rfm95) on a simulated radio : rate, state age, landing beacons.
+ *
+ * sim first lists the airtime of the STATE, DELTA and BEACON packets for a
+ * few LoRa settings and the rate the duty cycle leaves them. It then flies the
+ * flight library (common/tlm_flight.h) and runs the radio task as the
+ * flight computer does (common/tlm_link.h) : every 1 ms tick, TxDone (DIO0)
+ * serviced, and the packet the scheduler hands out loaded into an SX1276
+ * register model (common/mock_rfm95.h) through lib/Rfm95. The packets that
+ * leave the model go through a link losing each with probability loss, and
+ * are decoded as the ground station would (TLM_receive()).
+ *
+ * Reported per flight : packets sent and received, states received per
+ * second between launch and touchdown (keyframes and the DELTAs applied), age of the newest state on the
+ * ground over that time (p50, max), landing detection and the first beacon
+ * after touchdown, the largest error of a decoded field against what was
+ * sent, the longest RFM_send() (SPI included, the only time the radio task
+ * holds the bus), and protocol violations seen by the radio model.
+ *
+ * keyframes holds the airtime budget (the duty) and changes the keyframe
+ * interval, from absolute STATE packets only to a keyframe every 16, over
+ * the flight library and a range of loss : states received per second,
+ * DELTAs dropped for a lost keyframe, and the age of the newest state.
+ *
+ * fec times the erasure code (lib/Fec) on this machine, then holds the
+ * duty and adds REPAIR packets, from none to M = 4 every 16 packets, over
+ * channels that lose packets in bursts : fades of the antenna pattern
+ * around apogee (tumbling, ejection) and under the parachute (swinging),
+ * a two state channel in time (Gilbert-Elliott) that loses every packet
+ * on the air while it is bad. Reported : the airtime the repairs take,
+ * packets lost on the link and rebuilt, the share of states sent that
+ * reach the ground, states per second and the age of the newest state.
+ *
+ * Usage :
+ *   telemetry sim [--loss P] [--sf N] [--bw HZ] [--duty D] [--key N]
+ *   telemetry keyframes [--sf N] [--bw HZ] [--duty D]
+ *   telemetry fec [--sf N] [--bw HZ] [--duty D] [--seeds N]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "baro_altitude.h"
+#include "fec.h"
+#include "rfm95.h"
+#include "telemetry.h"
+#include "tlm_flight.h"
+#include "tlm_link.h"
+
+
+#define AFTER_LANDING_S 60.0          // On the ground after touchdown
+
+// What the link loses : any packet with probability loss and, from apogee + from_s to apogee + to_s (touchdown at
+// the latest), every packet on the air during a fade. Fades and the time between them are exponential, of mean
+// bad_ms and good_ms (Gilbert-Elliott in time); bad_ms 0 : none.
+typedef struct {
+  const char *name;
+  double loss;
+  double from_s, to_s;
+  double good_ms, bad_ms;
+} Channel_t;
+
+static const Channel_t CHANNELS[] = {
+  { "20 % uniform", 0.20, 0.0, 0.0, 0.0, 0.0 },
+  { "apogee fades", 0.02, -4.0, 6.0, 800.0, 400.0 },          // Tumbling over the top, ejection
+  { "parachute fades", 0.02, 2.0, INFINITY, 1500.0, 300.0 },  // Swinging under the chute
+  { "parachute, long fades", 0.02, 2.0, INFINITY, 2000.0, 1000.0 },
+};
+
+typedef struct {
+  size_t sent[TLM_PKT_TYPES];
+  size_t received[TLM_PKT_TYPES];
+  size_t bad;                 // Received but not decoded
+  size_t no_key;              // DELTAs received, keyframe lost (and not rebuilt)
+  size_t rebuilt;             // Lost packets rebuilt from REPAIRs
+  size_t rekeyed;             // DELTAs whose keyframe was rebuilt
+  // Where the channel fades (launch to touchdown without fades) :
+  double window_s;
+  double data_sent;           // Data packets sent ...
+  double data_lost;           // ... lost on the link ...
+  double states;              // ... and states from them on the ground
+  double air_us, repair_air_us;  // Time on the air, and of it REPAIRs
+  std::vector<double> ages;   // ms, age of the newest state on the ground every 10 ms
+  double sent_hz;             // Packets sent per second, launch to touchdown
+  double received_hz;         // Packets received per second, launch to touchdown
+  double rate_hz;             // States received per second, launch to touchdown
+  double age_p50_ms, age_max_ms;
+  double landed_s;            // LANDED phase, after touchdown
+  double beacon_s;            // First beacon received, after touchdown
+  double err_alt, err_vel, err_pos_m;
+  double duty;                // Air time over the whole run
+  uint32_t load_us_max;
+  uint64_t violations;
+  uint32_t timeouts;
+  uint32_t forced_keys;
+} LinkResult_t;
+
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) return NAN;
+  size_t k = (size_t)std::min<double>(v.size() - 1, floor(p * v.size()));
+  std::nth_element(v.begin(), v.begin() + k, v.end());
+  return v[k];
+}
+
+
+static Channel_t uniform(double loss) {
+  Channel_t c = { "uniform", loss, 0.0, 0.0, 0.0, 0.0 };
+  return c;
+}
+
+
+static LinkResult_t run_link(const TlmFlight_t &f, const RFM_Config_t &rc, const TLM_SchedConfig_t &sc,
+                             const Channel_t &ch, uint32_t seed) {
+  LinkResult_t r = {};
+  TlmAir_t a;
+  if (!TLMLINK_transmit(f, rc, sc, &a)) {
+    exit(1);
+  }
+
+  // The ground
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  const double m_per_e7 = 111320.0 * 1e-7;
+  double launch_us = f.launch_t * 1e6, touchdown_us = f.touchdown_t * 1e6;
+  std::vector<std::pair<double, uint64_t>> arrivals;  // Received at, state stamp
+  r.beacon_s = NAN;
+
+  double from_us = launch_us, to_us = touchdown_us;
+  std::vector<std::pair<double, double>> fades;
+  if (ch.bad_ms > 0.0) {
+    from_us = std::max((f.apogee_t + ch.from_s) * 1e6, launch_us);
+    to_us = std::min((f.apogee_t + ch.to_s) * 1e6, touchdown_us);
+    std::mt19937 frng(seed ^ 0xFADE);
+    std::exponential_distribution<double> good(1e-3 / ch.good_ms), bad(1e-3 / ch.bad_ms);
+    for (double t = from_us + good(frng); t < to_us;) {
+      double b = bad(frng);
+      fades.push_back({ t, std::min(t + b, to_us) });
+      t += b + good(frng);
+    }
+  }
+  r.window_s = (to_us - from_us) * 1e-6;
+  size_t fade = 0;
+
+  // What the ground makes of a state sent in packet i, received or rebuilt at t_us.
+  auto take = [&](const TLM_Packet_t &pkt, size_t i, double t_us) {
+    const MockRfmPacket_t &p = a.air[i];
+    const TLM_State_t &s = a.sent[i];
+    const TLM_State_t &g = pkt.state;
+    double pos = hypot((g.lat_e7 - s.lat_e7) * m_per_e7,
+                       (g.lon_e7 - s.lon_e7) * m_per_e7 * cos(s.lat_e7 * 1e-7 * M_PI / 180.0));
+    r.err_pos_m = std::max(r.err_pos_m, pos);
+    if (pkt.type != TLM_PKT_DELTA) {
+      // A DELTA carries no peak : the keyframe's, or its own altitude above it.
+      r.err_alt = std::max(r.err_alt, (double)fabsf(g.max_altitude - s.max_altitude));
+    }
+    if (pkt.type != TLM_PKT_BEACON) {
+      r.err_alt = std::max(r.err_alt, (double)fabsf(g.altitude - s.altitude));
+      r.err_vel = std::max(r.err_vel, (double)fabsf(g.velocity - s.velocity));
+      arrivals.push_back({ t_us, g.t_us });
+      if (p.t_end_us >= launch_us && p.t_end_us <= touchdown_us) r.rate_hz += 1.0;
+      if (p.t_end_us >= from_us && p.t_end_us <= to_us) r.states += 1.0;
+    } else if (std::isnan(r.beacon_s)) {
+      r.beacon_s = t_us * 1e-6 - f.touchdown_t;
+    }
+  };
+
+  TLM_Receiver_t rx;
+  TLM_rx_init(&rx);
+  std::vector<size_t> packet_of(TLM_SEQ_MASK + 1, 0);  // Data packet by SEQ, for what is rebuilt
+  for (size_t i = 0; i < a.air.size() && i < a.sent.size(); i++) {
+    const MockRfmPacket_t &p = a.air[i];
+    bool in_flight = p.t_end_us >= launch_us && p.t_end_us <= touchdown_us;
+    bool in_window = p.t_end_us >= from_us && p.t_end_us <= to_us;
+    uint8_t type = std::min<uint8_t>(p.bytes[0] & 0x07, TLM_PKT_TYPES - 1);  // TYPE, the low 3 bits
+    r.sent[type]++;
+    if (type != TLM_PKT_REPAIR) {
+      packet_of[((p.bytes[0] >> 3) | (p.bytes[1] << 5)) & TLM_SEQ_MASK] = i;  // SEQ, the next 13
+    }
+    if (in_flight) r.sent_hz += 1.0;
+    if (in_window) {
+      r.air_us += p.t_end_us - p.t_start_us;
+      if (type == TLM_PKT_REPAIR) r.repair_air_us += p.t_end_us - p.t_start_us;
+      else r.data_sent += 1.0;
+    }
+    while (fade < fades.size() && fades[fade].second < p.t_start_us) fade++;
+    bool faded = fade < fades.size() && fades[fade].first <= p.t_end_us;
+    if (u(rng) < ch.loss || faded) {
+      if (in_window && type != TLM_PKT_REPAIR) r.data_lost += 1.0;
+      continue;
+    }
+    if (in_flight) r.received_hz += 1.0;
+    TLM_Packet_t pkt;
+    TLM_RxStatus_t st = TLM_receive(&rx, p.bytes.data(), p.bytes.size(), &pkt);
+    if (st == TLM_RX_BAD) {
+      r.bad++;
+      continue;
+    }
+    r.received[pkt.type]++;
+    if (st == TLM_RX_REPAIR) {
+      while (TLM_rebuilt(&rx, &pkt)) take(pkt, packet_of[pkt.seq], p.t_end_us);
+    } else if (st == TLM_RX_OK) {
+      take(pkt, i, p.t_end_us);
+    }
+  }
+  r.no_key = rx.no_key;
+  r.rebuilt = rx.rebuilt;
+  r.rekeyed = rx.rekeyed;
+  r.sent_hz /= f.touchdown_t - f.launch_t;
+  r.received_hz /= f.touchdown_t - f.launch_t;
+  r.rate_hz /= f.touchdown_t - f.launch_t;
+
+  // Age of the newest state on the ground, every 10 ms in flight
+  std::vector<double> ages;
+  size_t k = 0;
+  uint64_t newest = 0;
+  for (double t = launch_us; t <= touchdown_us; t += 10000.0) {
+    while (k < arrivals.size() && arrivals[k].first <= t) newest = std::max(newest, arrivals[k++].second);
+    ages.push_back((t - (double)newest) * 1e-3);
+    if (t >= from_us && t <= to_us) r.ages.push_back(ages.back());
+  }
+  r.age_p50_ms = percentile(ages, 0.5);
+  r.age_max_ms = ages.empty() ? NAN : *std::max_element(ages.begin(), ages.end());
+  r.landed_s = f.landed_t - f.touchdown_t;
+  r.duty = a.air_us / a.end_us;
+  r.load_us_max = a.load_us_max;
+  r.violations = a.violations;
+  r.timeouts = a.timeouts;
+  r.forced_keys = a.forced_keys;
+  return r;
+}
+
+
+template <typename F>
+static double ns_per_call(F fn) {
+  int reps = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  double s;
+  do {
+    fn();
+    reps++;
+    s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  } while (s < 0.2);
+  return s * 1e9 / reps;
+}
+
+
+static void print_settings(double duty) {
+  struct { const char *name; uint32_t bw; uint8_t sf; } rows[] = {
+    { "SF7, 250 kHz (default)", 250000, 7 },
+    { "SF7, 125 kHz", 125000, 7 },
+    { "SF8, 125 kHz", 125000, 8 },
+    { "SF9, 125 kHz", 125000, 9 },
+    { "SF10, 125 kHz", 125000, 10 },
+    { "SF12, 125 kHz", 125000, 12 },
+  };
+  printf("| LoRa setting           | STATE (B) | Airtime (ms) | DELTA (B) | Airtime (ms) | BEACON (B) | Airtime (ms) | STATE only at %2.0f %% (Hz) | Keyframe every %d (Hz) |\n",
+         duty * 100, TLMLINK_KEYFRAME_EVERY);
+  printf("| ---------------------- | --------- | ------------ | --------- | ------------ | ---------- | ------------ | ----------------------- | --------------------- |\n");
+  for (const auto &row : rows) {
+    RFM_Config_t rc = TLMLINK_RADIO;
+    rc.bw_hz = row.bw;
+    rc.sf = row.sf;
+    TLM_SchedConfig_t c = TLMLINK_sched_config(rc, duty);
+    TLM_Sched_t s;
+    TLM_sched_init(&s, &c);
+    double group_us = s.period_us[TLM_PKT_STATE] + (TLMLINK_KEYFRAME_EVERY - 1) * (double)s.period_us[TLM_PKT_DELTA];
+    printf("| %-22s | %9d | %12.1f | %9d | %12.1f | %10d | %12.1f | %23.2f | %21.2f |\n", row.name, TLM_STATE_SIZE,
+           c.airtime_us[TLM_PKT_STATE] * 1e-3, TLM_DELTA_SIZE, c.airtime_us[TLM_PKT_DELTA] * 1e-3, TLM_BEACON_SIZE,
+           c.airtime_us[TLM_PKT_BEACON] * 1e-3, 1e6 / s.period_us[TLM_PKT_STATE], TLMLINK_KEYFRAME_EVERY * 1e6 / group_us);
+  }
+}
+
+
+static bool link_ok(const LinkResult_t &r, double duty) {
+  return r.bad == 0 && r.violations == 0 && r.timeouts == 0 && r.err_alt <= 0.05 + 1e-3 && r.err_vel <= 0.05 + 1e-3 &&
+         r.err_pos_m < 1.0 && r.duty <= duty + 1e-3;
+}
+
+
+static int sim(int argc, char **argv) {
+  std::vector<double> losses = { 0.0, 0.2 };
+  RFM_Config_t rc = TLMLINK_RADIO;
+  double duty = TLMLINK_DUTY;
+  int key = TLMLINK_KEYFRAME_EVERY;
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "--loss") && i + 1 < argc) losses = { atof(argv[++i]) };
+    else if (!strcmp(argv[i], "--sf") && i + 1 < argc) rc.sf = (uint8_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--bw") && i + 1 < argc) rc.bw_hz = (uint32_t)atol(argv[++i]);
+    else if (!strcmp(argv[i], "--duty") && i + 1 < argc) duty = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--key") && i + 1 < argc) key = atoi(argv[++i]);
+    else return -1;
+  }
+
+  BARO_init_table();
+  print_settings(duty);
+  TLM_SchedConfig_t sc = TLMLINK_sched_config(rc, duty);
+  sc.keyframe_every = (uint8_t)std::min(std::max(key, 1), TLM_KEYFRAME_MAX);
+  printf("\nSF%d, %lu kHz, %.0f %% duty : STATE every %.0f ms, DELTA every %.0f ms, keyframe every %d, BEACON every %.1f s after landing\n\n",
+         rc.sf, (unsigned long)(rc.bw_hz / 1000), duty * 100, sc.airtime_us[TLM_PKT_STATE] / duty * 1e-3,
+         sc.airtime_us[TLM_PKT_DELTA] / duty * 1e-3, sc.keyframe_every,
+         std::max(sc.airtime_us[TLM_PKT_BEACON] / duty, (double)TLMLINK_BEACON_PERIOD_US) * 1e-6);
+  printf("| Flight       | Loss | STATE sent | Received | DELTA sent | Received | No key | BEACON sent | Received | Rate (Hz) | Age p50 (ms) | Age max (ms) | Landed (s) | Beacon (s) | Err alt (m) | Err vel (m/s) | Err pos (m) | Duty   | Load (us) | Violations |\n");
+  printf("| ------------ | ---- | ---------- | -------- | ---------- | -------- | ------ | ----------- | -------- | --------- | ------------ | ------------ | ---------- | ---------- | ----------- | ------------- | ----------- | ------ | --------- | ---------- |\n");
+  bool ok = true;
+  std::vector<SimConfig_t> lib = FLIGHTSIM_library();
+  std::vector<TLM_State_t> all;
+  for (size_t fi = 0; fi < lib.size(); fi++) {
+    TlmFlight_t f = TLMFLIGHT_run(lib[fi], 47 + (uint32_t)fi, AFTER_LANDING_S);
+    all.insert(all.end(), f.states.begin(), f.states.end());
+    for (double loss : losses) {
+      LinkResult_t r = run_link(f, rc, sc, uniform(loss), 4700 + (uint32_t)fi);
+      printf("| %-12s | %3.0f%% | %10zu | %8zu | %10zu | %8zu | %6zu | %11zu | %8zu | %9.2f | %12.0f | %12.0f | %10.1f | %10.1f | %11.2f | %13.2f | %11.2f | %5.1f%% | %9u | %10llu |\n",
+             f.name.c_str(), loss * 100, r.sent[TLM_PKT_STATE], r.received[TLM_PKT_STATE], r.sent[TLM_PKT_DELTA],
+             r.received[TLM_PKT_DELTA], r.no_key, r.sent[TLM_PKT_BEACON], r.received[TLM_PKT_BEACON], r.rate_hz,
+             r.age_p50_ms, r.age_max_ms, r.landed_s, r.beacon_s, r.err_alt, r.err_vel, r.err_pos_m, r.duty * 100,
+             r.load_us_max, (unsigned long long)r.violations);
+      ok = ok && link_ok(r, duty);
+    }
+    fflush(stdout);
+  }
+
+  uint8_t buf[TLM_MAX_PACKET];
+  size_t i = 0;
+  double enc_ns = ns_per_call([&]() {
+    TLM_encode(TLM_PKT_STATE, (uint16_t)i, &all[i % all.size()], buf);
+    i++;
+  });
+  TLM_Packet_t pkt;
+  double dec_ns = ns_per_call([&]() { TLM_decode(buf, TLM_STATE_SIZE, &pkt); });
+  uint8_t dbuf[TLM_MAX_PACKET];
+  i = 1;
+  double delta_enc_ns = ns_per_call([&]() {
+    TLM_encode_delta((uint16_t)i, 1, &all[(i - 1) % all.size()], &all[i % all.size()], dbuf);
+    i++;
+  });
+  TLM_Receiver_t rx;
+  TLM_rx_init(&rx);
+  TLM_receive(&rx, buf, TLM_STATE_SIZE, &pkt);
+  TLM_encode_delta((uint16_t)(pkt.seq + 1), 1, &all[0], &all[1], dbuf);
+  double delta_dec_ns = ns_per_call([&]() {
+    rx.last_seq = -1;
+    TLM_receive(&rx, dbuf, TLM_DELTA_SIZE, &pkt);
+  });
+  printf("\nSTATE packet : %.0f ns to encode, %.0f ns to decode; DELTA : %.0f ns to encode, %.0f ns to receive on this machine\n",
+         enc_ns, dec_ns, delta_enc_ns, delta_dec_ns);
+  printf("%s\n", ok ? "every packet decoded within its field resolution, duty within the limit, no protocol violation" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+
+static int keyframes(int argc, char **argv) {
+  RFM_Config_t rc = TLMLINK_RADIO;
+  double duty = TLMLINK_DUTY;
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "--sf") && i + 1 < argc) rc.sf = (uint8_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--bw") && i + 1 < argc) rc.bw_hz = (uint32_t)atol(argv[++i]);
+    else if (!strcmp(argv[i], "--duty") && i + 1 < argc) duty = atof(argv[++i]);
+    else return -1;
+  }
+
+  BARO_init_table();
+  std::vector<TlmFlight_t> flights;
+  for (const SimConfig_t &cfg : FLIGHTSIM_library()) {
+    flights.push_back(TLMFLIGHT_run(cfg, 49 + (uint32_t)flights.size(), AFTER_LANDING_S));
+  }
+  printf("SF%d, %lu kHz, %.0f %% of the time on the air, every flight of the library, launch to touchdown :\n\n", rc.sf,
+         (unsigned long)(rc.bw_hz / 1000), duty * 100);
+  printf("| Packets               | Loss | Airtime a packet (ms) | Sent (Hz) | Received (Hz) | States (Hz) | Against STATE only | No key | Age p50 (ms) | Age max (ms) | Forced keyframes | Duty   |\n");
+  printf("| --------------------- | ---- | --------------------- | --------- | ------------- | ----------- | ------------------ | ------ | ------------ | ------------ | ---------------- | ------ |\n");
+  bool ok = true;
+  for (double loss : { 0.0, 0.1, 0.2, 0.3, 0.5 }) {
+    double base = NAN;
+    for (int key : { 1, 2, 4, 8, 16 }) {
+      TLM_SchedConfig_t sc = TLMLINK_sched_config(rc, duty);
+      sc.keyframe_every = (uint8_t)key;
+      double sent = 0.0, received = 0.0, sent_n = 0.0, received_n = 0.0, states = 0.0, air = 0.0, no_key = 0.0;
+      double flight_s = 0.0, duty_max = 0.0;
+      std::vector<double> p50;
+      double age_max = 0.0;
+      uint32_t forced = 0;
+      for (size_t fi = 0; fi < flights.size(); fi++) {
+        const TlmFlight_t &f = flights[fi];
+        LinkResult_t r = run_link(f, rc, sc, uniform(loss), 4900 + (uint32_t)fi);
+        double s = f.touchdown_t - f.launch_t;
+        size_t n_sent = r.sent[TLM_PKT_STATE] + r.sent[TLM_PKT_DELTA];
+        size_t n_received = r.received[TLM_PKT_STATE] + r.received[TLM_PKT_DELTA];
+        air += r.sent[TLM_PKT_STATE] * (double)sc.airtime_us[TLM_PKT_STATE] + r.sent[TLM_PKT_DELTA] * (double)sc.airtime_us[TLM_PKT_DELTA];
+        sent_n += n_sent;
+        received_n += n_received;
+        sent += r.sent_hz * s;
+        received += r.received_hz * s;
+        states += r.rate_hz * s;
+        no_key += r.no_key;
+        flight_s += s;
+        p50.push_back(r.age_p50_ms);
+        age_max = std::max(age_max, r.age_max_ms);
+        forced += r.forced_keys;
+        duty_max = std::max(duty_max, r.duty);
+        ok = ok && link_ok(r, duty);
+      }
+      double air_ms = air / sent_n * 1e-3;
+      double rate = states / flight_s;
+      if (key == 1) base = rate;
+      char name[32];
+      snprintf(name, sizeof(name), key == 1 ? "STATE only" : "keyframe every %d", key);
+      std::sort(p50.begin(), p50.end());
+      printf("| %-21s | %3.0f%% | %21.1f | %9.2f | %13.2f | %11.2f | %17.0f%% | %5.1f%% | %12.0f | %12.0f | %16u | %5.1f%% |\n",
+             name, loss * 100, air_ms, sent / flight_s, received / flight_s, rate,
+             100.0 * (rate / base - 1.0), received_n > 0 ? 100.0 * no_key / received_n : 0.0, p50[p50.size() / 2], age_max,
+             forced, duty_max * 100);
+      fflush(stdout);
+    }
+  }
+  printf("\n%s\n", ok ? "every state received within its field resolution, duty within the limit" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+
+// Time to encode a group's M repairs and to rebuild M of its K packets, symbols of a STATE packet.
+static void print_fec_timing() {
+  printf("| K  | M | Symbol (B) | Encode M repairs (us) | Rebuild M lost (us) |\n");
+  printf("| -- | - | ---------- | --------------------- | ------------------- |\n");
+  const size_t len = 1 + TLM_STATE_SIZE;
+  std::mt19937 rng(50);
+  uint8_t data[FEC_MAX_K][FEC_MAX_SYMBOL], repair[FEC_MAX_M][FEC_MAX_SYMBOL];
+  for (auto &d : data) for (uint8_t &b : d) b = (uint8_t)rng();
+  const uint8_t *in[FEC_MAX_K];
+  uint8_t *io[FEC_MAX_K];
+  for (int i = 0; i < FEC_MAX_K; i++) in[i] = io[i] = data[i];
+  const uint8_t *rep[FEC_MAX_M];
+  uint8_t rows[FEC_MAX_M];
+  for (int j = 0; j < FEC_MAX_M; j++) {
+    rep[j] = repair[j];
+    rows[j] = (uint8_t)j;
+  }
+  for (auto km : { std::make_pair(4, 1), std::make_pair(8, 1), std::make_pair(4, 2), std::make_pair(8, 2),
+                   std::make_pair(8, 4), std::make_pair(16, 4) }) {
+    uint8_t k = (uint8_t)km.first, m = (uint8_t)km.second;
+    double enc_ns = ns_per_call([&]() {
+      for (uint8_t j = 0; j < m; j++) FEC_encode(in, k, len, j, repair[j]);
+    });
+    uint32_t have = ((1UL << k) - 1) & ~((1UL << m) - 1);   // The first m lost
+    double dec_ns = ns_per_call([&]() { FEC_decode(io, have, k, rep, rows, m, len); });
+    printf("| %2d | %d | %10zu | %21.2f | %19.2f |\n", k, m, len, enc_ns * 1e-3, dec_ns * 1e-3);
+  }
+}
+
+
+static int fec(int argc, char **argv) {
+  RFM_Config_t rc = TLMLINK_RADIO;
+  double duty = TLMLINK_DUTY;
+  int seeds = 4;
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "--sf") && i + 1 < argc) rc.sf = (uint8_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--bw") && i + 1 < argc) rc.bw_hz = (uint32_t)atol(argv[++i]);
+    else if (!strcmp(argv[i], "--duty") && i + 1 < argc) duty = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seeds") && i + 1 < argc) seeds = std::max(atoi(argv[++i]), 1);
+    else return -1;
+  }
+
+  FEC_init_tables();
+  printf("Erasure code on this machine :\n\n");
+  print_fec_timing();
+
+  BARO_init_table();
+  std::vector<TlmFlight_t> flights;
+  for (const SimConfig_t &cfg : FLIGHTSIM_library()) {
+    flights.push_back(TLMFLIGHT_run(cfg, 50 + (uint32_t)flights.size(), AFTER_LANDING_S));
+  }
+  printf("\nSF%d, %lu kHz, %.0f %% of the time on the air, keyframe every %d, every flight of the library %d times, where the channel fades (launch to touchdown for uniform loss) :\n\n",
+         rc.sf, (unsigned long)(rc.bw_hz / 1000), duty * 100, TLMLINK_KEYFRAME_EVERY, seeds);
+  printf("| Channel               | FEC            | Repair airtime | Lost on the link | Rebuilt | DELTAs rekeyed | States delivered | States (Hz) | Against none | Age p50 (ms) | Age p99 (ms) | Age max (ms) |\n");
+  printf("| --------------------- | -------------- | -------------- | ---------------- | ------- | -------------- | ---------------- | ----------- | ------------ | ------------ | ------------ | ------------ |\n");
+  struct { const char *name; uint8_t k, m; } codes[] = {
+    { "none", 0, 0 },
+    { "K 4, M 1 (XOR)", 4, 1 },
+    { "K 8, M 1 (XOR)", 8, 1 },
+    { "K 4, M 2", 4, 2 },
+    { "K 8, M 2", 8, 2 },
+    { "K 8, M 4", 8, 4 },
+    { "K 16, M 4", 16, 4 },
+  };
+  bool ok = true;
+  for (const Channel_t &ch : CHANNELS) {
+    double base = NAN;
+    for (const auto &code : codes) {
+      TLM_SchedConfig_t sc = TLMLINK_sched_config(rc, duty);
+      sc.fec_k = code.k;
+      sc.fec_m = code.m;
+      double data_sent = 0.0, data_lost = 0.0, states = 0.0, air = 0.0, repair_air = 0.0, window_s = 0.0;
+      size_t rebuilt = 0, rekeyed = 0;
+      std::vector<double> ages;
+      for (int seed = 0; seed < seeds; seed++) {
+        for (size_t fi = 0; fi < flights.size(); fi++) {
+          const TlmFlight_t &f = flights[fi];
+          LinkResult_t r = run_link(f, rc, sc, ch, 5000 + 100 * (uint32_t)seed + (uint32_t)fi);
+          data_sent += r.data_sent;
+          data_lost += r.data_lost;
+          states += r.states;
+          air += r.air_us;
+          repair_air += r.repair_air_us;
+          window_s += r.window_s;
+          rebuilt += r.rebuilt;
+          rekeyed += r.rekeyed;
+          ages.insert(ages.end(), r.ages.begin(), r.ages.end());
+          ok = ok && link_ok(r, duty);
+        }
+      }
+      double age_max = ages.empty() ? NAN : *std::max_element(ages.begin(), ages.end());
+      double rate = states / window_s;
+      if (code.m == 0) base = rate;
+      printf("| %-21s | %-14s | %13.1f%% | %15.1f%% | %7zu | %14zu | %15.1f%% | %11.2f | %11.0f%% | %12.0f | %12.0f | %12.0f |\n",
+             ch.name, code.name, 100.0 * repair_air / air, 100.0 * data_lost / data_sent, rebuilt, rekeyed,
+             100.0 * states / data_sent, rate, 100.0 * (rate / base - 1.0), percentile(ages, 0.5), percentile(ages, 0.99),
+             age_max);
+      fflush(stdout);
+    }
+  }
+  printf("\n%s\n", ok ? "every state received or rebuilt within its field resolution, duty within the limit" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && !strcmp(argv[1], "sim")) {
+    int rc = sim(argc, argv);
+    if (rc >= 0) return rc;
+  }
+  if (argc >= 2 && !strcmp(argv[1], "keyframes")) {
+    int rc = keyframes(argc, argv);
+    if (rc >= 0) return rc;
+  }
+  if (argc >= 2 && !strcmp(argv[1], "fec")) {
+    int rc = fec(argc, argv);
+    if (rc >= 0) return rc;
+  }
+  fprintf(stderr,
+          "usage: %s sim [--loss P] [--sf N] [--bw HZ] [--duty D] [--key N]\n"
+          "       %s keyframes [--sf N] [--bw HZ] [--duty D]\n"
+          "       %s fec [--sf N] [--bw HZ] [--duty D] [--seeds N]\n",
+          argv[0], argv[0], argv[0]);
+  return 1;
+}
@@ -0,0 +1,270 @@
+/**
+ * @file timesync_sim.cpp
+ * @brief Convergence and accuracy of the PPS time discipline on a simulated GPS.
+ *
+ * The flight computer clock is simulated with a crystal error (offset ppm,
+ * warm-up ramp, random walk wander). A simulated NEO-7M gives a PPS edge at
+ * every GPS second and 10 Hz NAV-PVT messages that arrive 60 - 300 ms after
+ * their epoch. The edge stamp includes interrupt latency, with occasional
+ * long spikes (interrupts held off), and some edges are missed.
+ *
+ * Everything goes through lib/TimeSync exactly as in GPS_Capture_data(), and
+ * the TIMESYNC records it would log go through the host UTC mapping of
+ * log_decode (common/log_reader), so both ends are checked against truth.
+ *
+ * Usage :
+ *   timesync_sim [--seeds N] [--seconds S]
+ *
+ * Reported per scenario (mean over seeds) :
+ * - time from first fix to a valid fit and to lock (s)
+ * - onboard MCU to GPS error after lock + 10 s : rms, p99, max (us)
+ * - drift estimate error at the end (ppb)
+ * - host MCU to UTC error from the logged records : rms, max (us)
+ * - pairs rejected as outliers
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "flight_log.h"
+#include "log_reader.h"
+#include "time_sync.h"
+
+
+#define SIM_STEP_S 0.01               // Clock model resolution
+#define SIM_BOOT_US 5000000.0         // MCU time at the start of the simulation
+#define SIM_UNIX0 1792324800LL        // 2026-10-18 12:00:00 UTC at t = 0
+
+
+typedef struct {
+  const char *name;
+  double drift_ppm;           // Crystal error at start
+  double ramp_ppm;            // Added linearly over the run (warm-up)
+  double wander_ppm;          // Random walk, ppm per sqrt(s)
+  double isr_spike_rate;      // Fraction of edges with a long interrupt latency
+  double miss_rate;           // Fraction of edges not seen
+  double outage_start;        // s, GPS lost (no PPS, no fix) for outage_len
+  double outage_len;
+  double tow0;                // GPS time of week at t = 0
+} Scenario_t;
+
+typedef struct {
+  double t_valid, t_lock;
+  double err_rms, err_p99, err_max;
+  double drift_err_ppb;
+  double host_rms, host_max;
+  int rejected;
+} Result_t;
+
+typedef struct {
+  double t;                   // True GPS time since start (s)
+  int kind;                   // 0 = PPS edge, 1 = NAV-PVT
+  int64_t mcu_us;             // Stamp seen by the MCU
+  double epoch;               // GPS time of the epoch (NAV-PVT)
+} SimEvent_t;
+
+
+// MCU clock in us for a true time, linear between model steps.
+static double mcu_at(const std::vector<double> &clock, double t) {
+  double x = t / SIM_STEP_S;
+  size_t i = (size_t)x;
+  if (i + 1 >= clock.size()) i = clock.size() - 2;
+  double f = x - i;
+  return clock[i] + f * (clock[i + 1] - clock[i]);
+}
+
+
+static void utc_fields(double t_gps_from_start, LOG_TimeSync_t *rec) {
+  int64_t unix_s = SIM_UNIX0 + (int64_t)llround(t_gps_from_start);
+  int64_t days = unix_s / 86400, sod = unix_s % 86400;
+  // Civil date from days since 1970 (inverse of days_from_civil).
+  days += 719468;
+  int64_t era = days / 146097;
+  unsigned doe = (unsigned)(days - era * 146097);
+  unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned mp = (5 * doy + 2) / 153;
+  unsigned d = doy - (153 * mp + 2) / 5 + 1;
+  unsigned m = mp < 10 ? mp + 3 : mp - 9;
+  rec->utc_year = (uint16_t)(yoe + era * 400 + (m <= 2));
+  rec->utc_month = (uint8_t)m;
+  rec->utc_day = (uint8_t)d;
+  rec->utc_hour = (uint8_t)(sod / 3600);
+  rec->utc_min = (uint8_t)((sod / 60) % 60);
+  rec->utc_sec = (uint8_t)(sod % 60);
+}
+
+
+static Result_t run(const Scenario_t &sc, double seconds, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> gauss(0.0, 1.0);
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  std::exponential_distribution<double> expo(1.0);
+
+  // Clock model
+  size_t steps = (size_t)(seconds / SIM_STEP_S) + 2;
+  std::vector<double> clock(steps), drift(steps);
+  double walk = 0.0, mcu = SIM_BOOT_US;
+  for (size_t i = 0; i < steps; i++) {
+    double t = i * SIM_STEP_S;
+    drift[i] = (sc.drift_ppm + sc.ramp_ppm * t / seconds + walk) * 1e-6;
+    clock[i] = mcu;
+    mcu += SIM_STEP_S * 1e6 * (1.0 + drift[i]);
+    walk += sc.wander_ppm * sqrt(SIM_STEP_S) * gauss(rng);
+  }
+
+  // GPS events, in MCU arrival order
+  std::vector<SimEvent_t> ev;
+  for (int k = 1; k < (int)seconds - 1; k++) {
+    bool outage = k >= sc.outage_start && k < sc.outage_start + sc.outage_len;
+    if (outage) continue;
+    if (uni(rng) >= sc.miss_rate) {
+      double latency = 2.0 + expo(rng);
+      if (uni(rng) < sc.isr_spike_rate) latency = 20.0 + 130.0 * uni(rng);
+      SimEvent_t e = { (double)k, 0, (int64_t)floor(mcu_at(clock, k) + latency), 0.0 };
+      ev.push_back(e);
+    }
+    for (int j = 0; j < 10; j++) {
+      double epoch = k + 0.1 * j;
+      double arrive = epoch + 0.06 + 0.24 * uni(rng);
+      SimEvent_t e = { arrive, 1, (int64_t)floor(mcu_at(clock, arrive)), epoch };
+      ev.push_back(e);
+    }
+  }
+  std::sort(ev.begin(), ev.end(), [](const SimEvent_t &a, const SimEvent_t &b) { return a.t < b.t; });
+
+  TS_t ts;
+  TS_init(&ts);
+  LogData_t log = {};
+  Result_t r;
+  memset(&r, 0, sizeof(r));
+  r.t_valid = r.t_lock = NAN;
+  const double fix_time = 3.0;
+
+  std::vector<double> err;
+  size_t next_query = 0;
+  for (const SimEvent_t &e : ev) {
+    // Queries up to this event : onboard error against truth
+    while (next_query * 0.1 < e.t) {
+      double tq = next_query * 0.1;
+      next_query++;
+      if (!ts.locked || std::isnan(r.t_lock) || tq < r.t_lock + 10.0) continue;
+      double truth = (sc.tow0 + tq) * 1e6;
+      err.push_back((double)TS_mcu_to_gps(&ts, (int64_t)llround(mcu_at(clock, tq))) - truth);
+    }
+
+    if (e.kind == 0) {
+      TS_pps_edge(&ts, e.mcu_us);
+      continue;
+    }
+    double tow = fmod(sc.tow0 + e.epoch, 604800.0);
+    uint32_t itow_ms = (uint32_t)llround(tow * 1000.0);
+    bool fix_ok = e.epoch >= fix_time;
+    uint8_t rejects_before = ts.rejects;
+    if (!TS_nav_epoch(&ts, e.mcu_us, itow_ms, fix_ok)) continue;
+    if (ts.rejects > rejects_before) r.rejected++;
+    if (ts.valid && std::isnan(r.t_valid)) r.t_valid = e.t - fix_time;
+    if (ts.locked && std::isnan(r.t_lock)) r.t_lock = e.t;
+
+    // The TIMESYNC record the firmware writes for this pair
+    LogTimeSync_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.t_us = (uint64_t)ts.edge_us;
+    rec.v.gps_itow = itow_ms;
+    utc_fields(e.epoch, &rec.v);
+    rec.v.flags = (ts.valid ? LOG_TIMESYNC_VALID : 0) | (ts.locked ? LOG_TIMESYNC_LOCKED : 0) |
+                  (ts.rejects ? LOG_TIMESYNC_REJECTED : 0);
+    log.timesync.push_back(rec);
+  }
+  if (!std::isnan(r.t_lock)) r.t_lock -= fix_time;
+
+  if (!err.empty()) {
+    double ss = 0.0;
+    std::vector<double> mag;
+    for (double x : err) {
+      ss += x * x;
+      mag.push_back(fabs(x));
+    }
+    std::sort(mag.begin(), mag.end());
+    r.err_rms = sqrt(ss / err.size());
+    r.err_p99 = mag[(size_t)(0.99 * (mag.size() - 1))];
+    r.err_max = mag.back();
+  }
+  r.drift_err_ppb = (ts.drift - drift[(size_t)(ts.mcu_ref_us > 0 ? ev.back().t / SIM_STEP_S : 0)]) * 1e9;
+
+  // Host side mapping from the logged records
+  LogTimeMap_t map;
+  LOGREAD_time_map(log, &map);
+  double hs = 0.0;
+  size_t hn = 0;
+  for (double tq = fix_time + 2.0; tq < seconds - 3.0; tq += 0.1) {
+    double utc;
+    if (!LOGREAD_utc(map, (int64_t)llround(mcu_at(clock, tq)), &utc)) break;
+    double e = (utc - (double)SIM_UNIX0 - tq) * 1e6;
+    hs += e * e;
+    hn++;
+    if (fabs(e) > r.host_max) r.host_max = fabs(e);
+  }
+  r.host_rms = hn ? sqrt(hs / hn) : NAN;
+  return r;
+}
+
+
+int main(int argc, char **argv) {
+  int seeds = 10;
+  double seconds = 1200.0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--seeds") && i + 1 < argc) seeds = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) seconds = atof(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seeds N] [--seconds S]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // name, drift, ramp, wander, spike rate, miss rate, outage start, outage len, tow0
+  const Scenario_t scenarios[] = {
+    { "nominal",       25.0, 0.0, 0.002, 0.005, 0.00,   0.0,  0.0, 345600.0 },
+    { "warm_up",      -30.0, 5.0, 0.002, 0.005, 0.00,   0.0,  0.0, 345600.0 },
+    { "isr_spikes",    25.0, 0.0, 0.002, 0.050, 0.02,   0.0,  0.0, 345600.0 },
+    { "gps_outage",    25.0, 2.0, 0.002, 0.005, 0.00, 400.0, 60.0, 345600.0 },
+    { "week_rollover", 25.0, 0.0, 0.002, 0.005, 0.00,   0.0,  0.0, 604800.0 - 300.0 },
+  };
+
+  printf("%d seeds x %.0f s per scenario\n", seeds, seconds);
+  printf("%-14s %7s %7s %8s %8s %8s %9s %8s %8s %6s\n", "scenario", "valid_s", "lock_s", "err_rms",
+         "err_p99", "err_max", "drift_ppb", "host_rms", "host_max", "reject");
+  for (const Scenario_t &sc : scenarios) {
+    Result_t sum;
+    memset(&sum, 0, sizeof(sum));
+    double worst = 0.0, host_worst = 0.0;
+    int locked = 0;
+    for (int s = 1; s <= seeds; s++) {
+      Result_t r = run(sc, seconds, (uint32_t)s);
+      if (std::isnan(r.t_lock)) continue;
+      locked++;
+      sum.t_valid += r.t_valid;
+      sum.t_lock += r.t_lock;
+      sum.err_rms += r.err_rms;
+      sum.err_p99 += r.err_p99;
+      sum.drift_err_ppb += fabs(r.drift_err_ppb);
+      sum.host_rms += r.host_rms;
+      sum.rejected += r.rejected;
+      worst = std::max(worst, r.err_max);
+      host_worst = std::max(host_worst, r.host_max);
+    }
+    if (!locked) {
+      printf("%-14s never locked\n", sc.name);
+      continue;
+    }
+    printf("%-14s %7.1f %7.1f %8.2f %8.2f %8.2f %9.1f %8.2f %8.2f %6.1f\n", sc.name, sum.t_valid / locked,
+           sum.t_lock / locked, sum.err_rms / locked, sum.err_p99 / locked, worst, sum.drift_err_ppb / locked,
+           sum.host_rms / locked, host_worst, (double)sum.rejected / locked);
+  }
+  return 0;
+}
@@ -0,0 +1,700 @@
+/**
+ * @file traj_smooth.cpp
+ * @brief Post-flight trajectory reconstruction : forward Kalman filter + RTS smoother.
+ *
+ * Fuses the ADXL375 axial acceleration, BMP390 altitude and NAV-PVT height of
+ * a record log (lib/FlightLog) with common/rts_smoother and writes the best
+ * estimate altitude, velocity and acceleration with their 1 sigma uncertainty,
+ * next to the forward (onboard-like) estimate.
+ *
+ * The log is never held in memory. Four stages stream through files in
+ * blocks of BLOCK_STEPS entries, so memory stays at a few MB whatever the log
+ * size (temporary files need ~100 bytes per measurement, in --tmp) :
+ *
+ * 1. extract  : log records -> measurement file (time, kind, value in SI units,
+ *               baro and GPS referenced to the pad)
+ * 2. forward  : measurements -> filtered step file (state + covariance per measurement)
+ * 3. backward : step file read block by block from the end -> smoothed rows,
+ *               one per output period (--rate), written in reverse order
+ * 4. output   : reverse row file read from the end -> CSV or binary, in time order
+ *
+ * Output rows (default <log>_traj.csv; CSV if the path ends in .csv, else binary : "RTS1", u32 row
+ * size, u64 rows, then packed OutRow_t) :
+ *   t_us, alt, vel, acc, alt_sd, vel_sd, acc_sd, fwd_alt, fwd_vel, fwd_acc
+ *
+ * Noise model tuning : --sweep name=v1,v2,... (accel_sigma, baro_sigma,
+ * gps_sigma, jerk_psd; repeat for a grid) runs every combination on the
+ * worker threads, each a forward pass over the shared measurement file, and
+ * ranks them by the mean negative log likelihood of the innovations.
+ *
+ * --sim FLIGHT writes a record log of a simulated flight (common/flight_sim)
+ * and runs the same pipeline on it, reporting the error against truth; with
+ * --sweep each combination is also smoothed and scored against truth.
+ *
+ * Usage :
+ *   traj_smooth <SENSOR_DATA.bin | --sim FLIGHT> [out.csv | out.bin] [--rate HZ] [--no-gps]
+ *               [--accel-sigma S] [--baro-sigma S] [--gps-sigma S] [--jerk-psd Q]
+ *               [--sweep name=v1,v2,...]... [--threads N] [--tmp DIR] [--seed N]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+#include "baro_altitude.h"
+#include "flight_log.h"
+#include "flight_sim.h"
+#include "log_reader.h"
+#include "parallel.h"
+#include "rts_smoother.h"
+
+
+#define BLOCK_STEPS 65536             // Entries per block of every stage
+#define ADXL_G_PER_LSB 0.049
+#define ADXL_AXIAL_AXIS 2             // As ADXL375_AXIAL_AXIS in the firmware
+#define G0 9.80665
+#define BARO_GROUND_SAMPLES 50        // As the firmware pad reference
+#define GPS_GROUND_FIXES 10
+#define SIM_T0_US 1000000             // MCU time of the start of a simulated recording
+
+
+typedef struct {
+  int64_t t_us;
+  float z;
+  uint8_t kind;               // RtsMeasKind_t
+} Meas_t;
+
+typedef struct __attribute__((packed)) {
+  int64_t t_us;
+  float x[3];                 // Smoothed altitude, velocity, acceleration
+  float sd[3];                // Smoothed 1 sigma
+  float fwd[3];               // Forward filter altitude, velocity, acceleration
+} OutRow_t;
+
+typedef struct {
+  size_t meas[3];             // Measurements per kind
+  double baro_ground;         // Pad pressure altitude (m)
+  double gps_ground;          // Pad GPS height (m)
+  size_t records, skipped;
+} Extract_t;
+
+typedef struct {
+  const SimFlight_t *flight;  // Truth, or NULL
+  double sq[2][3];            // [forward, smoothed] squared error sums
+  size_t inside[3];           // Smoothed error within 2 sigma
+  size_t n;
+} TruthError_t;
+
+typedef struct {
+  std::string meas, steps, rows;
+} TempFiles_t;
+
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Block files
+//--------------------------------------------------------------------------------------------
+// Read block b (of BLOCK_STEPS entries) of a file of n entries. Returns the entries read.
+template <typename T>
+static size_t read_block(FILE *f, size_t n, size_t b, std::vector<T> &buf) {
+  size_t first = b * BLOCK_STEPS;
+  size_t count = std::min((size_t)BLOCK_STEPS, n - first);
+  buf.resize(count);
+  fseeko(f, (off_t)(first * sizeof(T)), SEEK_SET);
+  return fread(buf.data(), sizeof(T), count, f);
+}
+
+
+template <typename T>
+static void flush_block(FILE *f, std::vector<T> &buf) {
+  fwrite(buf.data(), sizeof(T), buf.size(), f);
+  buf.clear();
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Stage 1 : extract
+//--------------------------------------------------------------------------------------------
+// Pad references : mean of the first baro samples and GPS fixes, as the
+// firmware does on the pad. Reads only as far as needed.
+static void pad_reference(const char *log_path, bool use_gps, Extract_t *ex) {
+  LogStream_t s;
+  if (!LOGREAD_stream_open(&s, log_path)) {
+    return;
+  }
+  double baro_sum = 0.0, gps_sum = 0.0;
+  size_t nb = 0, ng = 0;
+  LOG_Record_t rec;
+  while ((nb < BARO_GROUND_SAMPLES || (use_gps && ng < GPS_GROUND_FIXES)) && LOGREAD_stream_next(&s, &rec)) {
+    if (rec.type == LOG_REC_BARO && rec.len == sizeof(LOG_Baro_t) && nb < BARO_GROUND_SAMPLES) {
+      LOG_Baro_t b;
+      memcpy(&b, rec.payload, sizeof(b));
+      baro_sum += BARO_pressure_altitude(b.pressure);
+      nb++;
+    }
+    else if (rec.type == LOG_REC_GPS && rec.len == sizeof(LOG_Gps_t) && ng < GPS_GROUND_FIXES) {
+      LOG_Gps_t g;
+      memcpy(&g, rec.payload, sizeof(g));
+      if (g.gps_fix < 3) continue;
+      gps_sum += g.gps_height * 1e-3;
+      ng++;
+    }
+  }
+  LOGREAD_stream_close(&s);
+  ex->baro_ground = nb ? baro_sum / nb : 0.0;
+  ex->gps_ground = ng ? gps_sum / ng : 0.0;
+}
+
+
+static bool extract(const char *log_path, const char *meas_path, bool use_gps, Extract_t *ex) {
+  memset(ex, 0, sizeof(*ex));
+  pad_reference(log_path, use_gps, ex);
+  LogStream_t s;
+  if (!LOGREAD_stream_open(&s, log_path)) {
+    perror(log_path);
+    return false;
+  }
+  FILE *out = fopen(meas_path, "wb");
+  if (!out) {
+    perror(meas_path);
+    LOGREAD_stream_close(&s);
+    return false;
+  }
+
+  std::vector<Meas_t> block;
+  LOG_Record_t rec;
+  while (LOGREAD_stream_next(&s, &rec)) {
+    Meas_t m;
+    m.t_us = (int64_t)rec.t_us;
+    if (rec.type == LOG_REC_ACCEL && rec.len == sizeof(LOG_Accel_t)) {
+      LOG_Accel_t a;
+      memcpy(&a, rec.payload, sizeof(a));
+      m.kind = RTS_MEAS_ACCEL;
+      m.z = (float)((a.acc_raw[ADXL_AXIAL_AXIS] * ADXL_G_PER_LSB - 1.0) * G0);
+    }
+    else if (rec.type == LOG_REC_BARO && rec.len == sizeof(LOG_Baro_t)) {
+      LOG_Baro_t b;
+      memcpy(&b, rec.payload, sizeof(b));
+      m.kind = RTS_MEAS_BARO;
+      m.z = (float)(BARO_pressure_altitude(b.pressure) - ex->baro_ground);
+    }
+    else if (use_gps && rec.type == LOG_REC_GPS && rec.len == sizeof(LOG_Gps_t)) {
+      LOG_Gps_t g;
+      memcpy(&g, rec.payload, sizeof(g));
+      if (g.gps_fix < 3) continue;
+      m.kind = RTS_MEAS_GPS;
+      m.z = (float)(g.gps_height * 1e-3 - ex->gps_ground);
+    }
+    else {
+      continue;
+    }
+    block.push_back(m);
+    ex->meas[m.kind]++;
+    if (block.size() == BLOCK_STEPS) flush_block(out, block);
+  }
+  flush_block(out, block);
+
+  ex->records = s.records;
+  ex->skipped = s.skipped;
+  LOGREAD_stream_close(&s);
+  bool ok = !ferror(out);
+  fclose(out);
+  return ok;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Stage 2 : forward
+//--------------------------------------------------------------------------------------------
+// Forward pass over the measurement file. Writes the filtered steps if steps_path is set.
+static bool forward(const char *meas_path, size_t n_meas, const RTS_Config_t *cfg, const char *steps_path,
+                    RTS_Forward_t *f) {
+  FILE *in = fopen(meas_path, "rb");
+  FILE *out = steps_path ? fopen(steps_path, "wb") : NULL;
+  if (!in || (steps_path && !out)) {
+    perror(!in ? meas_path : steps_path);
+    if (in) fclose(in);
+    return false;
+  }
+  RTS_forward_init(f, cfg);
+  std::vector<Meas_t> meas;
+  std::vector<RTS_Step_t> steps;
+  size_t blocks = (n_meas + BLOCK_STEPS - 1) / BLOCK_STEPS;
+  for (size_t b = 0; b < blocks; b++) {
+    read_block(in, n_meas, b, meas);
+    for (const Meas_t &m : meas) {
+      RTS_forward_update(f, m.t_us, (RtsMeasKind_t)m.kind, m.z);
+      if (!out) continue;
+      steps.emplace_back();
+      RTS_forward_step(f, &steps.back());
+    }
+    if (out) flush_block(out, steps);
+  }
+  fclose(in);
+  bool ok = true;
+  if (out) {
+    ok = !ferror(out);
+    fclose(out);
+  }
+  return ok;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Stage 3 : backward
+//--------------------------------------------------------------------------------------------
+static void make_row(const RTS_Step_t &smoothed, const RTS_Step_t &filtered, OutRow_t *row) {
+  row->t_us = smoothed.t_us;
+  for (int i = 0; i < 3; i++) {
+    row->x[i] = (float)smoothed.x[i];
+    row->sd[i] = (float)RTS_sigma(&smoothed, i);
+    row->fwd[i] = (float)filtered.x[i];
+  }
+}
+
+
+// Smooths the step file into the reverse row file : the last step of every
+// output period (all steps if rate_hz <= 0). Returns the number of rows.
+static size_t backward(const char *steps_path, size_t n_steps, const RTS_Config_t *cfg, double rate_hz,
+                       const char *rows_path) {
+  FILE *in = fopen(steps_path, "rb");
+  FILE *out = fopen(rows_path, "wb");
+  if (!in || !out) {
+    perror(!in ? steps_path : rows_path);
+    if (in) fclose(in);
+    if (out) fclose(out);
+    return 0;
+  }
+  double period_us = rate_hz > 0.0 ? 1e6 / rate_hz : 0.0;
+  auto slot = [&](int64_t t_us) { return period_us > 0.0 ? (int64_t)std::floor((double)t_us / period_us) : t_us; };
+
+  std::vector<RTS_Step_t> filtered;
+  std::vector<OutRow_t> rows;
+  RTS_Step_t next = {}, smoothed;
+  size_t n_rows = 0;
+  bool have_next = false;
+  size_t blocks = (n_steps + BLOCK_STEPS - 1) / BLOCK_STEPS;
+  for (size_t b = blocks; b-- > 0;) {
+    read_block(in, n_steps, b, filtered);
+    for (size_t k = filtered.size(); k-- > 0;) {
+      bool emit;
+      if (!have_next) {
+        smoothed = filtered[k];         // Last step : smoothed = filtered
+        emit = true;
+        have_next = true;
+      }
+      else {
+        RTS_backward(cfg, &filtered[k], &next, &smoothed);
+        emit = slot(smoothed.t_us) != slot(next.t_us);
+      }
+      if (emit) {
+        rows.emplace_back();
+        make_row(smoothed, filtered[k], &rows.back());
+        if (rows.size() == BLOCK_STEPS) {
+          n_rows += rows.size();
+          flush_block(out, rows);
+        }
+      }
+      next = smoothed;
+    }
+  }
+  n_rows += rows.size();
+  flush_block(out, rows);
+  fclose(in);
+  fclose(out);
+  return n_rows;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Stage 4 : output
+//--------------------------------------------------------------------------------------------
+static void truth_add(TruthError_t *te, const OutRow_t &r) {
+  double t = (double)(r.t_us - SIM_T0_US) * 1e-6;
+  SimTruth_t tr = FLIGHTSIM_truth_at(*te->flight, t);
+  double truth[3] = { tr.h, tr.v, tr.a };
+  for (int i = 0; i < 3; i++) {
+    double ef = r.fwd[i] - truth[i];
+    double es = r.x[i] - truth[i];
+    te->sq[0][i] += ef * ef;
+    te->sq[1][i] += es * es;
+    if (std::fabs(es) <= 2.0 * r.sd[i]) te->inside[i]++;
+  }
+  te->n++;
+}
+
+
+// Reverse row file -> output in time order. out_path NULL : truth scoring only.
+static bool write_output(const char *rows_path, size_t n_rows, const char *out_path, TruthError_t *te) {
+  FILE *in = fopen(rows_path, "rb");
+  if (!in) {
+    perror(rows_path);
+    return false;
+  }
+  FILE *out = NULL;
+  bool csv = false;
+  if (out_path) {
+    size_t len = strlen(out_path);
+    csv = len > 4 && !strcmp(out_path + len - 4, ".csv");
+    out = fopen(out_path, csv ? "w" : "wb");
+    if (!out) {
+      perror(out_path);
+      fclose(in);
+      return false;
+    }
+    if (csv) {
+      fprintf(out, "t_us,alt,vel,acc,alt_sd,vel_sd,acc_sd,fwd_alt,fwd_vel,fwd_acc\n");
+    }
+    else {
+      uint32_t row_size = sizeof(OutRow_t);
+      uint64_t rows = n_rows;
+      fwrite("RTS1", 4, 1, out);
+      fwrite(&row_size, sizeof(row_size), 1, out);
+      fwrite(&rows, sizeof(rows), 1, out);
+    }
+  }
+
+  std::vector<OutRow_t> rows;
+  size_t blocks = (n_rows + BLOCK_STEPS - 1) / BLOCK_STEPS;
+  for (size_t b = blocks; b-- > 0;) {
+    read_block(in, n_rows, b, rows);
+    std::reverse(rows.begin(), rows.end());
+    if (te && te->flight) {
+      for (const OutRow_t &r : rows) truth_add(te, r);
+    }
+    if (!out) continue;
+    if (!csv) {
+      fwrite(rows.data(), sizeof(OutRow_t), rows.size(), out);
+      continue;
+    }
+    for (const OutRow_t &r : rows) {
+      fprintf(out, "%lld,%.3f,%.3f,%.3f,%.4f,%.4f,%.4f,%.3f,%.3f,%.3f\n", (long long)r.t_us, r.x[0], r.x[1], r.x[2],
+              r.sd[0], r.sd[1], r.sd[2], r.fwd[0], r.fwd[1], r.fwd[2]);
+    }
+  }
+  fclose(in);
+  bool ok = true;
+  if (out) {
+    ok = !ferror(out);
+    fclose(out);
+  }
+  return ok;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Simulated log
+//--------------------------------------------------------------------------------------------
+static bool write_sim_log(const SimFlight_t &f, const SimConfig_t &sc, const char *path) {
+  FILE *out = fopen(path, "wb");
+  if (!out) {
+    perror(path);
+    return false;
+  }
+  // Merge the three streams in time order, as the logger writes them.
+  size_t ia = 0, ib = 0, ig = 0;
+  uint8_t buf[LOG_OVERHEAD + 64];
+  while (ia < f.accel.size() || ib < f.baro.size() || ig < f.gps.size()) {
+    double ta = ia < f.accel.size() ? f.accel[ia].t : INFINITY;
+    double tb = ib < f.baro.size() ? f.baro[ib].t : INFINITY;
+    double tg = ig < f.gps.size() ? f.gps[ig].t : INFINITY;
+    size_t n;
+    if (ta <= tb && ta <= tg) {
+      LOG_Accel_t a;
+      memcpy(a.acc_raw, f.accel[ia].raw, sizeof(a.acc_raw));
+      n = LOG_encode(buf, LOG_REC_ACCEL, SIM_T0_US + (uint64_t)llround(ta * 1e6), &a, sizeof(a));
+      ia++;
+    }
+    else if (tb <= tg) {
+      LOG_Baro_t b = { (float)f.baro[ib].value, 20.0f };
+      n = LOG_encode(buf, LOG_REC_BARO, SIM_T0_US + (uint64_t)llround(tb * 1e6), &b, sizeof(b));
+      ib++;
+    }
+    else {
+      LOG_Gps_t g = {};
+      g.gps_itow = (uint32_t)llround(tg * 1e3);
+      g.gps_fix = 3;
+      g.gps_height = (int32_t)llround((sc.pad_altitude_msl + f.gps[ig].value) * 1e3);
+      n = LOG_encode(buf, LOG_REC_GPS, SIM_T0_US + (uint64_t)llround(tg * 1e6), &g, sizeof(g));
+      ig++;
+    }
+    fwrite(buf, 1, n, out);
+  }
+  bool ok = !ferror(out);
+  fclose(out);
+  return ok;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Parameter sweep
+//--------------------------------------------------------------------------------------------
+typedef struct {
+  const char *name;
+  size_t offset;
+} SweepParam_t;
+
+static const SweepParam_t SweepParams[] = {
+  { "accel_sigma", offsetof(RTS_Config_t, accel_sigma) },
+  { "baro_sigma", offsetof(RTS_Config_t, baro_sigma) },
+  { "gps_sigma", offsetof(RTS_Config_t, gps_sigma) },
+  { "jerk_psd", offsetof(RTS_Config_t, jerk_psd) },
+};
+
+typedef struct {
+  size_t param;               // Index in SweepParams
+  std::vector<double> values;
+} SweepAxis_t;
+
+typedef struct {
+  RTS_Config_t cfg;
+  double score;
+  TruthError_t te;
+  bool ok;
+} SweepResult_t;
+
+
+static bool parse_sweep(const char *arg, SweepAxis_t *axis) {
+  const char *eq = strchr(arg, '=');
+  if (!eq) {
+    return false;
+  }
+  axis->param = sizeof(SweepParams) / sizeof(SweepParams[0]);
+  for (size_t p = 0; p < sizeof(SweepParams) / sizeof(SweepParams[0]); p++) {
+    if (strlen(SweepParams[p].name) == (size_t)(eq - arg) && !strncmp(arg, SweepParams[p].name, eq - arg)) {
+      axis->param = p;
+    }
+  }
+  if (axis->param == sizeof(SweepParams) / sizeof(SweepParams[0])) {
+    return false;
+  }
+  for (const char *v = eq + 1; *v;) {
+    char *end;
+    axis->values.push_back(strtod(v, &end));
+    if (end == v) return false;
+    v = *end == ',' ? end + 1 : end;
+  }
+  return !axis->values.empty();
+}
+
+
+static double *param_ref(RTS_Config_t *cfg, size_t param) {
+  return (double *)((char *)cfg + SweepParams[param].offset);
+}
+
+
+static int run_sweep(const std::vector<SweepAxis_t> &axes, const RTS_Config_t &base, const TempFiles_t &tmp,
+                     size_t n_meas, const SimFlight_t *flight, int threads) {
+  size_t combos = 1;
+  for (const SweepAxis_t &a : axes) combos *= a.values.size();
+  std::vector<SweepResult_t> results(combos);
+  for (size_t c = 0; c < combos; c++) {
+    results[c].cfg = base;
+    size_t rest = c;
+    for (const SweepAxis_t &a : axes) {
+      *param_ref(&results[c].cfg, a.param) = a.values[rest % a.values.size()];
+      rest /= a.values.size();
+    }
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  PARALLEL_for(combos, threads, [&](size_t c) {
+    SweepResult_t &r = results[c];
+    std::string suffix = "." + std::to_string(c);
+    std::string steps = tmp.steps + suffix, rows = tmp.rows + suffix;
+    RTS_Forward_t f;
+    r.ok = forward(tmp.meas.c_str(), n_meas, &r.cfg, flight ? steps.c_str() : NULL, &f);
+    r.score = RTS_forward_score(&f);
+    memset(&r.te, 0, sizeof(r.te));
+    if (r.ok && flight) {
+      r.te.flight = flight;
+      size_t n_rows = backward(steps.c_str(), n_meas, &r.cfg, 100.0, rows.c_str());
+      r.ok = write_output(rows.c_str(), n_rows, NULL, &r.te);
+      remove(steps.c_str());
+      remove(rows.c_str());
+    }
+  });
+  double elapsed = seconds_since(t0);
+
+  std::vector<size_t> order(combos);
+  for (size_t c = 0; c < combos; c++) order[c] = c;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return results[a].score < results[b].score; });
+
+  printf("%zu combinations on %d threads in %.2f s\n\n", combos, threads, elapsed);
+  printf("%11s %10s %9s %8s %9s", "accel_sigma", "baro_sigma", "gps_sigma", "jerk_psd", "mean_nll");
+  if (flight) printf(" %9s %9s", "h_rms_s", "v_rms_s");
+  printf("\n");
+  for (size_t c : order) {
+    const SweepResult_t &r = results[c];
+    if (!r.ok) continue;
+    printf("%11.3f %10.3f %9.3f %8.1f %9.4f", r.cfg.accel_sigma, r.cfg.baro_sigma, r.cfg.gps_sigma, r.cfg.jerk_psd,
+           r.score);
+    if (flight && r.te.n) printf(" %9.3f %9.3f", std::sqrt(r.te.sq[1][0] / r.te.n), std::sqrt(r.te.sq[1][1] / r.te.n));
+    printf("\n");
+  }
+  const RTS_Config_t &best = results[order[0]].cfg;
+  printf("\nbest : --accel-sigma %g --baro-sigma %g --gps-sigma %g --jerk-psd %g\n", best.accel_sigma,
+         best.baro_sigma, best.gps_sigma, best.jerk_psd);
+  return 0;
+}
+
+
+//--------------------------------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------------------------------
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s <SENSOR_DATA.bin | --sim FLIGHT> [out.csv | out.bin] [--rate HZ] [--no-gps]\n"
+          "          [--accel-sigma S] [--baro-sigma S] [--gps-sigma S] [--jerk-psd Q]\n"
+          "          [--sweep name=v1,v2,...]... [--threads N] [--tmp DIR] [--seed N]\n"
+          "sweep names : accel_sigma baro_sigma gps_sigma jerk_psd\n", prog);
+}
+
+
+int main(int argc, char **argv) {
+  const char *in_path = NULL;
+  const char *out_path = NULL;
+  const char *sim_name = NULL;
+  const char *tmp_dir = NULL;
+  double rate = 100.0;
+  bool use_gps = true;
+  int threads = 0;
+  uint32_t seed = 1;
+  std::vector<SweepAxis_t> axes;
+  RTS_Config_t cfg;
+  RTS_default_config(&cfg);
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--rate") && i + 1 < argc) rate = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--no-gps")) use_gps = false;
+    else if (!strcmp(argv[i], "--accel-sigma") && i + 1 < argc) cfg.accel_sigma = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--baro-sigma") && i + 1 < argc) cfg.baro_sigma = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--gps-sigma") && i + 1 < argc) cfg.gps_sigma = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--jerk-psd") && i + 1 < argc) cfg.jerk_psd = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--tmp") && i + 1 < argc) tmp_dir = argv[++i];
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--sim") && i + 1 < argc) sim_name = argv[++i];
+    else if (!strcmp(argv[i], "--sweep") && i + 1 < argc) {
+      SweepAxis_t axis;
+      if (!parse_sweep(argv[++i], &axis)) {
+        usage(argv[0]);
+        return 1;
+      }
+      axes.push_back(axis);
+    }
+    else if (!in_path && !sim_name && argv[i][0] != '-') in_path = argv[i];
+    else if (!out_path && argv[i][0] != '-') out_path = argv[i];
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (!in_path && !sim_name) {
+    usage(argv[0]);
+    return 1;
+  }
+  threads = PARALLEL_threads(threads);
+  BARO_init_table();
+
+  std::string default_out;
+  if (in_path && !out_path && axes.empty()) {
+    default_out = in_path;
+    size_t dot = default_out.find_last_of('.');
+    size_t slash = default_out.find_last_of('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) default_out.erase(dot);
+    default_out += "_traj.csv";
+    out_path = default_out.c_str();
+  }
+
+  // Temporary files next to the output unless told otherwise.
+  std::string dir = tmp_dir ? tmp_dir : ".";
+  if (!tmp_dir && out_path && strrchr(out_path, '/')) dir = std::string(out_path, strrchr(out_path, '/') - out_path);
+  std::string base = dir + "/traj_smooth." + std::to_string(getpid());
+  TempFiles_t tmp = { base + ".meas", base + ".steps", base + ".rows" };
+
+  SimFlight_t flight;
+  std::string sim_log;
+  if (sim_name) {
+    const SimConfig_t *sc = NULL;
+    std::vector<SimConfig_t> lib = FLIGHTSIM_library();
+    for (const SimConfig_t &c : lib) {
+      if (!strcmp(c.name, sim_name)) sc = &c;
+    }
+    if (!sc) {
+      fprintf(stderr, "unknown flight %s\n", sim_name);
+      return 1;
+    }
+    flight = FLIGHTSIM_run(*sc, seed);
+    sim_log = base + ".sim.bin";
+    if (!write_sim_log(flight, *sc, sim_log.c_str())) return 1;
+    in_path = sim_log.c_str();
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  Extract_t ex;
+  if (!extract(in_path, tmp.meas.c_str(), use_gps, &ex)) return 1;
+  if (sim_name) remove(sim_log.c_str());
+  size_t n_meas = ex.meas[0] + ex.meas[1] + ex.meas[2];
+  fprintf(stderr, "%zu records (%zu bytes skipped) : %zu accel, %zu baro, %zu gps measurements, "
+          "pad baro %.1f m, gps %.1f m (%.2f s)\n", ex.records, ex.skipped, ex.meas[RTS_MEAS_ACCEL],
+          ex.meas[RTS_MEAS_BARO], ex.meas[RTS_MEAS_GPS], ex.baro_ground, ex.gps_ground, seconds_since(t0));
+  if (n_meas == 0) {
+    remove(tmp.meas.c_str());
+    return 1;
+  }
+
+  int rc = 0;
+  if (!axes.empty()) {
+    rc = run_sweep(axes, cfg, tmp, n_meas, sim_name ? &flight : NULL, threads);
+    remove(tmp.meas.c_str());
+    return rc;
+  }
+
+  t0 = std::chrono::steady_clock::now();
+  RTS_Forward_t f;
+  if (!forward(tmp.meas.c_str(), n_meas, &cfg, tmp.steps.c_str(), &f)) rc = 1;
+  double t_fwd = seconds_since(t0);
+  remove(tmp.meas.c_str());
+
+  t0 = std::chrono::steady_clock::now();
+  size_t n_rows = rc ? 0 : backward(tmp.steps.c_str(), n_meas, &cfg, rate, tmp.rows.c_str());
+  double t_bwd = seconds_since(t0);
+  remove(tmp.steps.c_str());
+
+  t0 = std::chrono::steady_clock::now();
+  TruthError_t te = {};
+  te.flight = sim_name ? &flight : NULL;
+  if (n_rows && !write_output(tmp.rows.c_str(), n_rows, out_path, &te)) rc = 1;
+  double t_out = seconds_since(t0);
+  remove(tmp.rows.c_str());
+  if (rc) return rc;
+
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  fprintf(stderr, "forward %.2f s, backward %.2f s, output %.2f s : %zu rows, peak RSS %ld MB\n", t_fwd, t_bwd, t_out,
+          n_rows, ru.ru_maxrss / 1024);
+  fprintf(stderr, "baro fused %zu, locked out / gated %zu; gps fused %zu, gated %zu; mean innovation nll %.4f\n",
+          f.used[RTS_MEAS_BARO], f.rejected[RTS_MEAS_BARO], f.used[RTS_MEAS_GPS], f.rejected[RTS_MEAS_GPS],
+          RTS_forward_score(&f));
+  if (te.flight && te.n) {
+    static const char *names[3] = { "altitude (m)", "velocity (m/s)", "accel (m/s^2)" };
+    printf("%-15s %10s %10s %12s\n", "rms error", "forward", "smoothed", "within 2sd");
+    for (int i = 0; i < 3; i++) {
+      printf("%-15s %10.3f %10.3f %11.1f%%\n", names[i], std::sqrt(te.sq[0][i] / te.n), std::sqrt(te.sq[1][i] / te.n),
+             100.0 * te.inside[i] / te.n);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,270 @@
+/**
+ * @file vib_check.cpp
+ * @brief Host reference checks of the onboard vibration kernels (lib/Vibration).
+ *
+ * Usage :
+ *   vib_check [--seconds S] [--seed N]
+ *
+ * Builds the portable kernels that the flight computer uses without esp-dsp,
+ * and that VIB_self_test() compares esp-dsp against at boot, and checks them
+ * against double precision references :
+ *
+ * | Check      | Reference                                  | Pass when                     |
+ * | ---------- | ------------------------------------------ | ----------------------------- |
+ * | response   | FIR design, |H(f)| evaluated in double     | ripple < 0.05 dB to 250 Hz,   |
+ * |            |                                            | < -50 dB from 520 Hz          |
+ * | fird       | direct convolution, double                 | error < 1e-5 of full scale    |
+ * | decimate   | VIB_process() in random FIFO bursts        | counts within 1 (rounding),   |
+ * |            | against the convolution, stamps vs truth   | stamps within 1 us            |
+ * | fft        | naive DFT, double                          | error < 1e-5 of rms           |
+ * | spectrum   | Welch PSD in double on the same samples    | within 0.3 dB above -90 dB,   |
+ * |            | (tones + noise, gravity on Z)              | tone peaks in the right bins  |
+ *
+ * Then times VIB_process() per input sample (host figure, for regressions;
+ * the ESP32-S3 budget is checked onboard with the TIMING records).
+ *
+ * Exit status is 0 only if every check passes.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "vibration.h"
+
+
+static const double FS = VIB_INPUT_RATE_HZ;
+static const double PERIOD_US = 1e6 / VIB_INPUT_RATE_HZ;
+static int Failures = 0;
+
+
+static void report(const char *name, bool pass, const char *fmt, double a, double b = 0.0) {
+  printf("%-9s %s  ", name, pass ? "PASS" : "FAIL");
+  printf(fmt, a, b);
+  printf("\n");
+  if (!pass) Failures++;
+}
+
+
+// Full rate test signal, ADXL375 counts : tones per axis, white noise, 1 g on Z.
+static void make_signal(size_t n, uint32_t seed, std::vector<int16_t> &raw) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> noise(0.0, 0.3 / VIB_G_PER_LSB);
+  // Tones on bin centres (12.5 Hz bins) so the leakage is the window's own.
+  const double tone_hz[3] = { 150.0, 437.5, 1000.0 };
+  const double tone_g[3] = { 5.0, 2.0, 0.5 };
+  const double offset_g[3] = { 0.0, 0.0, 1.0 };
+  raw.resize(n * 3);
+  for (size_t i = 0; i < n; i++) {
+    for (int a = 0; a < 3; a++) {
+      double g = offset_g[a] + tone_g[a] * sin(2.0 * M_PI * tone_hz[a] * i / FS);
+      double v = std::round(g / VIB_G_PER_LSB + noise(rng));
+      raw[i * 3 + a] = (int16_t)std::max(-32768.0, std::min(32767.0, v));
+    }
+  }
+}
+
+
+// Decimated output k is completed by input (k + 1) * VIB_DECIM - 1.
+static double convolve(const std::vector<float> &h, const std::vector<int16_t> &raw, int axis, size_t k) {
+  long last = (long)(k + 1) * VIB_DECIM - 1;
+  double acc = 0.0;
+  for (int j = 0; j < VIB_FIR_TAPS; j++) {
+    long i = last - (VIB_FIR_TAPS - 1) + j;     // h[0] weighs the oldest sample
+    if (i >= 0) acc += (double)h[j] * raw[(size_t)i * 3 + axis];
+  }
+  return acc;
+}
+
+
+static void check_response(const VIB_t &vib) {
+  double ripple = 0.0, stop = -1e9;
+  for (double f = 0.0; f <= FS / 2; f += 1.0) {
+    std::complex<double> H = 0.0;
+    for (int j = 0; j < VIB_FIR_TAPS; j++) H += (double)vib.coeffs[j] * std::polar(1.0, -2.0 * M_PI * f * j / FS);
+    double db = 20.0 * log10(std::abs(H) + 1e-300);
+    if (f <= 250.0) ripple = std::max(ripple, std::fabs(db));
+    if (f >= 520.0) stop = std::max(stop, db);
+  }
+  report("response", ripple < 0.05 && stop < -50.0, "passband ripple %.4f dB, stopband %.1f dB", ripple, stop);
+}
+
+
+static void check_fird(const VIB_t &vib, const std::vector<int16_t> &raw, size_t n) {
+  std::vector<float> h(vib.coeffs, vib.coeffs + VIB_FIR_TAPS);
+  size_t n_out = n / VIB_DECIM;
+  std::vector<float> in(n), out(n_out);
+  for (size_t i = 0; i < n; i++) in[i] = raw[i * 3];
+  float delay[2 * VIB_FIR_TAPS] = { 0 };
+  int pos = 0;
+  VIB_fird_c(vib.coeffs, delay, &pos, in.data(), out.data(), (int)n_out);
+  double err = 0.0;
+  for (size_t k = 0; k < n_out; k++) err = std::max(err, std::fabs(out[k] - convolve(h, raw, 0, k)));
+  report("fird", err < 1e-5 * 32768.0, "max error %.2e counts over %.0f outputs", err, (double)n_out);
+}
+
+
+static void check_decimate(const std::vector<int16_t> &raw, size_t n, uint32_t seed) {
+  static VIB_t vib;
+  VIB_init(&vib);
+  std::vector<float> h(vib.coeffs, vib.coeffs + VIB_FIR_TAPS);
+  std::mt19937 rng(seed + 1);
+  std::uniform_int_distribution<int> burst(1, 8);
+  int16_t out[80][3];
+  int64_t t_out[80];
+  size_t i = 0, k = 0;
+  double count_err = 0.0, stamp_err = 0.0;
+  while (i < n) {
+    // Mostly FIFO sized bursts, sometimes a long one (task starved) to exercise chunking.
+    size_t len = (rng() % 50 == 0) ? 70 : (size_t)burst(rng);
+    if (len > n - i) len = n - i;
+    int64_t t_newest = (int64_t)std::llround((i + len - 1) * PERIOD_US);
+    int m = VIB_process(&vib, (const int16_t (*)[3])&raw[i * 3], (int)len, t_newest, out, t_out);
+    for (int j = 0; j < m; j++, k++) {
+      for (int a = 0; a < 3; a++) {
+        count_err = std::max(count_err, std::fabs(out[j][a] - convolve(h, raw, a, k)));
+      }
+      // Centre of the FIR window
+      double truth = ((k + 1) * VIB_DECIM - 1 - 0.5 * (VIB_FIR_TAPS - 1)) * PERIOD_US;
+      stamp_err = std::max(stamp_err, std::fabs(t_out[j] - truth));
+    }
+    i += len;
+  }
+  report("decimate", count_err <= 0.5 + 1e-3 && stamp_err <= 1.0,
+         "max count error %.3f, max stamp error %.2f us", count_err, stamp_err);
+}
+
+
+static void check_fft(const VIB_t &vib, uint32_t seed) {
+  std::mt19937 rng(seed + 2);
+  std::normal_distribution<double> g(0.0, 1000.0);
+  std::vector<float> data(2 * VIB_FFT_N);
+  for (float &v : data) v = (float)g(rng);
+  std::vector<std::complex<double>> ref(VIB_FFT_N);
+  for (int k = 0; k < VIB_FFT_N; k++) {
+    for (int i = 0; i < VIB_FFT_N; i++) {
+      ref[k] += std::complex<double>(data[2 * i], data[2 * i + 1]) * std::polar(1.0, -2.0 * M_PI * k * i / VIB_FFT_N);
+    }
+  }
+  VIB_fft_c(data.data(), vib.twiddle);
+  double err = 0.0, sq = 0.0;
+  for (int k = 0; k < VIB_FFT_N; k++) {
+    err = std::max(err, std::abs(std::complex<double>(data[2 * k], data[2 * k + 1]) - ref[k]));
+    sq += std::norm(ref[k]);
+  }
+  double rms = sqrt(sq / VIB_FFT_N);
+  report("fft", err < 1e-5 * rms, "max error %.2e of rms (N = %.0f)", err / rms, (double)VIB_FFT_N);
+}
+
+
+static void check_spectrum(const std::vector<int16_t> &raw, size_t n) {
+  static VIB_t vib;
+  VIB_init(&vib);
+  int16_t out[80][3];
+  int64_t t_out[80];
+  for (size_t i = 0; i < n; i += 4) {
+    size_t len = std::min<size_t>(4, n - i);
+    VIB_process(&vib, (const int16_t (*)[3])&raw[i * 3], (int)len, (int64_t)((i + len - 1) * PERIOD_US), out, t_out);
+  }
+  uint8_t db[VIB_AXES][VIB_BINS];
+  int64_t t_us;
+  uint16_t windows = VIB_spectrum_take(&vib, db, &t_us);
+
+  // Double precision Welch over the same windows
+  std::vector<double> w(VIB_FFT_N);
+  double w2 = 0.0;
+  for (int i = 0; i < VIB_FFT_N; i++) {
+    w[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / VIB_FFT_N);
+    w2 += w[i] * w[i];
+  }
+  std::vector<double> psd(3 * VIB_BINS, 0.0);
+  size_t frames = 0;
+  for (size_t start = 0; start + VIB_FFT_N <= n; start += VIB_FFT_N / 2, frames++) {
+    for (int a = 0; a < 3; a++) {
+      double mean = 0.0;
+      for (int i = 0; i < VIB_FFT_N; i++) mean += raw[(start + i) * 3 + a];
+      mean /= VIB_FFT_N;
+      for (int k = 0; k < VIB_BINS; k++) {
+        std::complex<double> X = 0.0;
+        for (int i = 0; i < VIB_FFT_N; i++) {
+          X += (raw[(start + i) * 3 + a] - mean) * w[i] * std::polar(1.0, -2.0 * M_PI * k * i / VIB_FFT_N);
+        }
+        psd[a * VIB_BINS + k] += std::norm(X);
+      }
+    }
+  }
+
+  const int tone_bin[3] = { 12, 35, 80 };
+  double worst = 0.0;
+  bool peaks = frames == windows;
+  for (int a = 0; a < 3; a++) {
+    int peak = 1;
+    for (int k = 0; k < VIB_BINS; k++) {
+      double g2hz = psd[a * VIB_BINS + k] * (k ? 2.0 : 1.0) * VIB_G_PER_LSB * VIB_G_PER_LSB / (FS * w2 * frames);
+      double ref_db = 10.0 * log10(g2hz + 1e-300);
+      double got_db = VIB_DB_MIN + db[a][k] * VIB_DB_STEP;
+      if (ref_db > VIB_DB_MIN + 10.0) worst = std::max(worst, std::fabs(got_db - ref_db));
+      if (k && db[a][k] > db[a][peak]) peak = k;
+    }
+    peaks = peaks && peak == tone_bin[a];
+    printf("          axis %c : peak %.1f Hz %.1f dB, floor %.1f dB re g^2/Hz\n", 'x' + a,
+           peak * FS / VIB_FFT_N, VIB_DB_MIN + db[a][peak] * VIB_DB_STEP, VIB_DB_MIN + db[a][VIB_BINS - 5] * VIB_DB_STEP);
+  }
+  report("spectrum", worst < 0.3 && peaks, "max error %.2f dB vs double Welch over %.0f windows", worst, (double)windows);
+}
+
+
+static void bench(const std::vector<int16_t> &raw, size_t n) {
+  static VIB_t vib;
+  VIB_init(&vib);
+  int16_t out[80][3];
+  int64_t t_out[80];
+  int reps = 5;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < reps; r++) {
+    for (size_t i = 0; i + 4 <= n; i += 4) {
+      VIB_process(&vib, (const int16_t (*)[3])&raw[i * 3], 4, (int64_t)(i * PERIOD_US), out, t_out);
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / ((double)n * reps);
+  printf("bench     %.1f ns per 3-axis input sample (decimate + spectrum), %.3f %% of one core at %d Hz\n",
+         ns, ns * VIB_INPUT_RATE_HZ * 1e-7, VIB_INPUT_RATE_HZ);
+}
+
+
+int main(int argc, char **argv) {
+  double seconds = 10.0;
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--seconds") && i + 1 < argc) seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (uint32_t)atol(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seconds S] [--seed N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  size_t n = (size_t)(seconds * FS);
+  if (n < VIB_FFT_N) n = VIB_FFT_N;
+  std::vector<int16_t> raw;
+  make_signal(n, seed, raw);
+  static VIB_t vib;
+  VIB_init(&vib);
+
+  printf("%d Hz in, decimate by %d, %d taps, FFT %d, %.1f s of samples\n",
+         VIB_INPUT_RATE_HZ, VIB_DECIM, VIB_FIR_TAPS, VIB_FFT_N, n / FS);
+  check_response(vib);
+  check_fird(vib, raw, n);
+  check_decimate(raw, n, seed);
+  check_fft(vib, seed);
+  check_spectrum(raw, std::min<size_t>(n, 2 * VIB_INPUT_RATE_HZ));
+  bench(raw, n);
+  printf("%s\n", Failures ? "FAILED" : "all checks passed");
+  return Failures ? 1 : 0;
+}